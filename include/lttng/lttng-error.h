@@ -140,6 +140,8 @@ enum lttng_error_code {
 	LTTNG_ERR_FILTER_NOMEM           = 107, /* Lack of memory for filter bytecode */
 	LTTNG_ERR_FILTER_EXIST           = 108, /* Filter already exist */
 	LTTNG_ERR_NO_CONSUMER            = 109, /* No consumer exist for the session */
+	LTTNG_ERR_NOT_SNAPSHOT_SESSION   = 110, /* Session not in snapshot mode */
+	LTTNG_ERR_SNAPSHOT_FAIL          = 111, /* Snapshot record failed */
 
 	/* MUST be last element */
 	LTTNG_ERR_NR,                           /* Last element */
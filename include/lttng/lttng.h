@@ -112,6 +112,15 @@ enum lttng_event_output {
 	LTTNG_EVENT_MMAP                      = 1,
 };
 
+/*
+ * Compression of the trace packets of a channel
+ */
+enum lttng_compression {
+	LTTNG_COMPRESSION_NONE                = 0,
+	LTTNG_COMPRESSION_LZ4                 = 1,
+	LTTNG_COMPRESSION_ZSTD                = 2,
+};
+
 /* Event context possible type */
 enum lttng_event_context_type {
 	LTTNG_EVENT_CONTEXT_PID               = 0,
@@ -142,6 +151,62 @@ enum lttng_health_component {
 	LTTNG_HEALTH_ALL,
 };
 
+/*
+ * Latency histogram of the session daemon statistics. Bucket 0 counts the
+ * latencies under 1 microsecond and bucket N the ones in [2^(N-1), 2^N[
+ * microseconds. The last bucket counts every latency above.
+ */
+#define LTTNG_HEALTH_LATENCY_NR_BUCKETS     24
+#define LTTNG_HEALTH_LATENCY_PADDING1       8
+struct lttng_health_latency {
+	uint64_t count;
+	uint64_t total_ns;
+	uint64_t max_ns;
+	uint64_t buckets[LTTNG_HEALTH_LATENCY_NR_BUCKETS];
+	/*
+	 * Upper bound of the 99th percentile, from the histogram. Filled in the
+	 * statistics returned by lttng_health_stats().
+	 */
+	uint64_t p99_ns;
+
+	char padding[LTTNG_HEALTH_LATENCY_PADDING1];
+};
+
+/*
+ * Session daemon internal statistics returned by lttng_health_stats().
+ */
+#define LTTNG_HEALTH_STATS_NR_CMD           64
+#define LTTNG_HEALTH_STATS_PADDING1         256
+struct lttng_health_stats {
+	/*
+	 * Client command processing time indexed by the command code of the
+	 * session daemon protocol.
+	 */
+	struct lttng_health_latency cmd[LTTNG_HEALTH_STATS_NR_CMD];
+	/* From the connection of an application up to its registration done. */
+	struct lttng_health_latency app_registration;
+	/* Round trip of the commands sent to the applications. */
+	struct lttng_health_latency app_cmd;
+	/* Round trip of the commands sent to the consumer daemons. */
+	struct lttng_health_latency consumer_cmd;
+	/* Applications waiting in the registration queue. */
+	uint64_t app_reg_queue_depth;
+	uint64_t app_reg_queue_max_depth;
+
+	char padding[LTTNG_HEALTH_STATS_PADDING1];
+};
+
+/*
+ * Per application command round trip statistics.
+ */
+#define LTTNG_HEALTH_APP_STATS_PADDING1     32
+struct lttng_health_app_stats {
+	pid_t pid;
+	struct lttng_health_latency cmd;
+
+	char padding[LTTNG_HEALTH_APP_STATS_PADDING1];
+};
+
 /* Buffer type for a specific domain. */
 enum lttng_buffer_type {
 	LTTNG_BUFFER_PER_PID,	/* Only supported by UST being the default. */
@@ -255,6 +320,34 @@ struct lttng_event {
 	} attr;
 };
 
+/*
+ * Tracepoint listing query used by lttng_list_tracepoints_query(). A zeroed
+ * field means no restriction so a zeroed query lists the same tracepoints as
+ * lttng_list_tracepoints().
+ *
+ * The resulting list is sorted by PID and name, or by name only when
+ * duplicates are merged, so pages of a same listing are consistent as long as
+ * no application registers or unregisters in between.
+ */
+#define LTTNG_TRACEPOINT_QUERY_PADDING1    64
+struct lttng_tracepoint_query {
+	/* fnmatch(3) pattern on the tracepoint name. Empty matches all. */
+	char name[LTTNG_SYMBOL_NAME_LEN];
+	/* Only list the tracepoints of this application PID. 0 matches all. */
+	pid_t pid;
+	/* Number of tracepoints to skip at the start of the list. */
+	uint32_t offset;
+	/* Maximum number of tracepoints returned. 0 is unlimited. */
+	uint32_t count;
+	/*
+	 * If set, tracepoints with the same name and loglevel in multiple
+	 * applications are returned once with a PID of 0.
+	 */
+	uint32_t merge_duplicates;
+
+	char padding[LTTNG_TRACEPOINT_QUERY_PADDING1];
+};
+
 enum lttng_event_field_type {
 	LTTNG_EVENT_FIELD_OTHER			= 0,
 	LTTNG_EVENT_FIELD_INTEGER		= 1,
@@ -277,7 +370,7 @@ struct lttng_event_field {
  *
  * The structures should be initialized to zero before use.
  */
-#define LTTNG_CHANNEL_ATTR_PADDING1        LTTNG_SYMBOL_NAME_LEN + 16
+#define LTTNG_CHANNEL_ATTR_PADDING1        LTTNG_SYMBOL_NAME_LEN + 8
 struct lttng_channel_attr {
 	int overwrite;                      /* 1: overwrite, 0: discard */
 	uint64_t subbuf_size;               /* bytes */
@@ -288,6 +381,8 @@ struct lttng_channel_attr {
 	/* LTTng 2.1 padding limit */
 	uint64_t tracefile_size;            /* bytes */
 	uint64_t tracefile_count;           /* number of tracefiles */
+	uint32_t compression;               /* enum lttng_compression */
+	uint32_t live_timer_interval;       /* usec, streamed channels only */
 
 	char padding[LTTNG_CHANNEL_ATTR_PADDING1];
 };
@@ -440,6 +535,17 @@ extern int lttng_list_events(struct lttng_handle *handle,
 extern int lttng_list_tracepoints(struct lttng_handle *handle,
 		struct lttng_event **events);
 
+/*
+ * List the available tracepoints of a specific lttng domain matching the
+ * given query, see struct lttng_tracepoint_query.
+ *
+ * Return the size (number of entries) of the "lttng_event" array.
+ * Caller must free(3).
+ */
+extern int lttng_list_tracepoints_query(struct lttng_handle *handle,
+		const struct lttng_tracepoint_query *query,
+		struct lttng_event **events);
+
 /*
  * List the available tracepoints fields of a specific lttng domain.
  *
@@ -624,6 +730,18 @@ int lttng_disable_consumer(struct lttng_handle *handle);
  */
 extern int lttng_health_check(enum lttng_health_component c);
 
+/*
+ * Get the session daemon internal statistics through the health socket.
+ *
+ * The apps array is set to the statistics of every registered application.
+ * Caller must free(3) it.
+ *
+ * Return the number of entries of the apps array or else a negative lttng
+ * error code.
+ */
+extern int lttng_health_stats(struct lttng_health_stats *stats,
+		struct lttng_health_app_stats **apps);
+
 /*
  * For a given session name, this call checks if the data is ready to be read
  * or is still being extracted by the consumer(s) (pending) hence not ready to
@@ -636,6 +754,40 @@ extern int lttng_health_check(enum lttng_health_component c);
  */
 extern int lttng_data_pending(const char *session_name);
 
+/*
+ * Create a tracing session in snapshot mode using a name and an optional URL
+ * for the destination of its snapshots, as lttng_create_session().
+ *
+ * The channels of a snapshot session are in overwrite mode and their buffers
+ * are never consumed. Their content is only written to the output when
+ * lttng_snapshot_record() is called.
+ */
+extern int lttng_create_session_snapshot(const char *name, const char *url);
+
+/*
+ * Record a snapshot of the buffers of the snapshot mode session session_name
+ * without stopping tracing. The snapshot is written in a directory named
+ * snapshot_name under the session output; a name made of a sequence number and
+ * the date and time is used if NULL. max_size, if not 0, is the maximum size
+ * in bytes recorded for each stream: the most recent sub-buffers are kept.
+ *
+ * Return 0 on success else a negative LTTng error code.
+ */
+extern int lttng_snapshot_record(const char *session_name,
+		const char *snapshot_name, uint64_t max_size);
+
+/*
+ * Set the UIDs of which the per UID buffers of the handle session are created
+ * when tracing starts, so the first application of each of them does not wait
+ * for the buffers to be allocated. Only the UST domain with per UID buffers is
+ * supported and at most 64 UIDs can be given; the list replaces the previous
+ * one.
+ *
+ * Return 0 on success else a negative LTTng error code.
+ */
+extern int lttng_set_provision_uids(struct lttng_handle *handle,
+		const uid_t *uids, unsigned int count);
+
 #ifdef __cplusplus
 }
 #endif
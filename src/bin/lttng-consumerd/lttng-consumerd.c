@@ -54,7 +54,7 @@
 
 /* threads (channel handling, poll, metadata, sessiond) */
 
-static pthread_t channel_thread, data_thread, metadata_thread, sessiond_thread;
+static pthread_t channel_thread, metadata_thread, sessiond_thread;
 static pthread_t metadata_timer_thread;
 
 /* to count the number of times the user pressed ctrl+c */
@@ -264,6 +264,7 @@ static void set_ulimit(void)
 int main(int argc, char **argv)
 {
 	int ret = 0;
+	unsigned int i, nb_data_threads = 0;
 	void *status;
 
 	/* Parse arguments */
@@ -367,17 +368,10 @@ int main(int argc, char **argv)
 	lttng_consumer_set_error_sock(ctx, ret);
 
 	/*
-	 * For UST consumer, we block RT signals used for periodical metadata flush
-	 * in main and create a dedicated thread to handle these signals.
+	 * We block RT signals used for periodical metadata and live flush in main
+	 * and create a dedicated thread to handle these signals.
 	 */
-	switch (opt_type) {
-	case LTTNG_CONSUMER32_UST:
-	case LTTNG_CONSUMER64_UST:
-		consumer_signal_init();
-		break;
-	default:
-		break;
-	}
+	consumer_signal_init();
 	ctx->type = opt_type;
 
 	/* Create thread to manage channels */
@@ -396,12 +390,19 @@ int main(int argc, char **argv)
 		goto metadata_error;
 	}
 
-	/* Create thread to manage the polling/writing of trace data */
-	ret = pthread_create(&data_thread, NULL, consumer_thread_data_poll,
-			(void *) ctx);
-	if (ret != 0) {
-		perror("pthread_create");
-		goto data_error;
+	/*
+	 * Create the threads to manage the polling/writing of trace data, one
+	 * unless they are spread over the NUMA nodes or CPU groups.
+	 */
+	for (nb_data_threads = 0; nb_data_threads < ctx->nb_data_threads;
+			nb_data_threads++) {
+		ret = pthread_create(&ctx->data_threads[nb_data_threads].thread, NULL,
+				consumer_thread_data_poll,
+				(void *) &ctx->data_threads[nb_data_threads]);
+		if (ret != 0) {
+			perror("pthread_create");
+			goto data_error;
+		}
 	}
 
 	/* Create the thread to manage the receive of fd */
@@ -412,25 +413,18 @@ int main(int argc, char **argv)
 		goto sessiond_error;
 	}
 
-	switch (opt_type) {
-	case LTTNG_CONSUMER32_UST:
-	case LTTNG_CONSUMER64_UST:
-		/* Create the thread to manage the metadata periodic timers */
-		ret = pthread_create(&metadata_timer_thread, NULL,
-				consumer_timer_metadata_thread, (void *) ctx);
-		if (ret != 0) {
-			perror("pthread_create");
-			goto metadata_timer_error;
-		}
+	/* Create the thread to manage the metadata and live periodic timers */
+	ret = pthread_create(&metadata_timer_thread, NULL,
+			consumer_timer_metadata_thread, (void *) ctx);
+	if (ret != 0) {
+		perror("pthread_create");
+		goto metadata_timer_error;
+	}
 
-		ret = pthread_detach(metadata_timer_thread);
-		if (ret) {
-			errno = ret;
-			perror("pthread_detach");
-		}
-		break;
-	default:
-		break;
+	ret = pthread_detach(metadata_timer_thread);
+	if (ret) {
+		errno = ret;
+		perror("pthread_detach");
 	}
 
 metadata_timer_error:
@@ -441,13 +435,15 @@ metadata_timer_error:
 	}
 
 sessiond_error:
-	ret = pthread_join(data_thread, &status);
-	if (ret != 0) {
-		perror("pthread_join");
-		goto error;
+data_error:
+	for (i = 0; i < nb_data_threads; i++) {
+		ret = pthread_join(ctx->data_threads[i].thread, &status);
+		if (ret != 0) {
+			perror("pthread_join");
+			goto error;
+		}
 	}
 
-data_error:
 	ret = pthread_join(metadata_thread, &status);
 	if (ret != 0) {
 		perror("pthread_join");
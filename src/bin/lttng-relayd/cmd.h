@@ -22,5 +22,6 @@
 #include "cmd-generic.h"
 #include "cmd-2-1.h"
 #include "cmd-2-2.h"
+#include "cmd-2-3.h"
 
 #endif /* RELAYD_CMD_H */
@@ -0,0 +1,1216 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <lttng/lttng.h>
+#include <common/common.h>
+#include <common/compat/endian.h>
+#include <common/compat/poll.h>
+#include <common/defaults.h>
+#include <common/index/index.h>
+#include <common/compress/compress.h>
+#include <common/sessiond-comm/sessiond-comm.h>
+#include <common/sessiond-comm/inet.h>
+#include <common/uri.h>
+#include <common/utils.h>
+
+#include "lttng-relayd.h"
+#include "lttng-viewer.h"
+#include "live.h"
+#include "viewer-request.h"
+
+/*
+ * The live thread serves the viewers on the viewer port. It reads the
+ * tracefiles and index files written by the relayd while the sessions are
+ * streamed, so it only shares the sessions and streams hash tables with the
+ * worker thread, under RCU.
+ *
+ * When the tracefiles of a stream are a ring of files, a viewer slower than
+ * the tracer can lose the packets of a tracefile overwritten before it is read.
+ */
+
+static pthread_t live_thread;
+static struct lttcomm_sock *live_sock;
+static int live_quit_pipe = -1;
+
+/*
+ * A stream as seen by a viewer connection. The names are copied at attach
+ * time since the relayd stream is freed when it is closed.
+ */
+struct relay_viewer_stream {
+	uint64_t stream_handle;
+	struct lttng_ht_node_ulong stream_n;
+	char *path_name;
+	char *channel_name;
+	int metadata_flag;
+	uint64_t tracefile_size;
+	uint64_t tracefile_count;
+	/* Tracefile being read and last tracefile written by the relayd. */
+	uint64_t tracefile_count_current;
+	uint64_t tracefile_count_last;
+	/*
+	 * Files of the current tracefile, closed by the fd cache of the
+	 * tracefiles while the viewer is idle.
+	 */
+	int files_open;
+	int read_fd;
+	int index_read_fd;
+	struct lttng_fd_cache_entry read_fd_entry;
+	struct lttng_fd_cache_entry index_fd_entry;
+	/* Offset of the next entry to read in the index file. */
+	uint64_t index_read_pos;
+	/*
+	 * End of the packets of the current tracefile whose index entries were
+	 * sent, bounding the packets the viewer can request.
+	 */
+	uint64_t index_end;
+	/* Metadata already sent to the viewer. */
+	uint64_t metadata_offset;
+};
+
+struct relay_viewer_connection {
+	struct lttcomm_sock *sock;
+	struct lttng_ht_node_ulong sock_n;
+	/* Streams of the attached sessions, indexed by stream handle. */
+	struct lttng_ht *viewer_streams_ht;
+	unsigned int version_check_done:1;
+};
+
+/*
+ * Create and init the viewer socket from uri.
+ */
+static
+struct lttcomm_sock *live_init_sock(struct lttng_uri *uri)
+{
+	int ret;
+	struct lttcomm_sock *sock = NULL;
+
+	sock = lttcomm_alloc_sock_from_uri(uri);
+	if (sock == NULL) {
+		ERR("Allocating viewer socket");
+		goto error;
+	}
+
+	ret = lttcomm_create_sock(sock);
+	if (ret < 0) {
+		goto error;
+	}
+	DBG("Listening for viewers on sock %d", sock->fd);
+
+	ret = sock->ops->bind(sock);
+	if (ret < 0) {
+		goto error;
+	}
+
+	ret = sock->ops->listen(sock, -1);
+	if (ret < 0) {
+		goto error;
+	}
+
+	return sock;
+
+error:
+	if (sock) {
+		lttcomm_destroy_sock(sock);
+	}
+	return NULL;
+}
+
+/*
+ * Read exactly len bytes at the given offset of a file.
+ *
+ * Return the number of bytes read, which is smaller than len at the end of
+ * the file, or a negative value on error.
+ */
+static
+ssize_t pread_full(int fd, void *buf, size_t len, off_t offset)
+{
+	ssize_t ret;
+	size_t done = 0;
+
+	while (done < len) {
+		ret = pread(fd, (char *) buf + done, len - done, offset + done);
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		if (ret == 0) {
+			break;
+		}
+		done += ret;
+	}
+
+	return done;
+}
+
+/*
+ * Receive the payload of a viewer command, which must be exactly len bytes.
+ *
+ * Return 0 on success or else a negative value.
+ */
+static
+int recv_payload(struct relay_viewer_connection *conn,
+		struct lttng_viewer_cmd *hdr, void *buf, size_t len)
+{
+	ssize_t ret;
+
+	if (be64toh(hdr->data_size) != len) {
+		ERR("Viewer command %u with invalid size %" PRIu64,
+				be32toh(hdr->cmd), be64toh(hdr->data_size));
+		return -1;
+	}
+
+	ret = conn->sock->ops->recvmsg(conn->sock, buf, len, 0);
+	if (ret < (ssize_t) len) {
+		if (ret == 0) {
+			/* Orderly shutdown. Not necessary to print an error. */
+			DBG("Viewer socket %d did an orderly shutdown", conn->sock->fd);
+		} else {
+			ERR("Viewer didn't send a valid command payload: %zd", ret);
+		}
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Send a reply and its optional data to a viewer.
+ *
+ * Return 0 on success or else a negative value.
+ */
+static
+int send_reply(struct relay_viewer_connection *conn, void *reply,
+		size_t reply_len, void *data, size_t data_len)
+{
+	ssize_t ret;
+
+	ret = conn->sock->ops->sendmsg(conn->sock, reply, reply_len, 0);
+	if (ret < 0) {
+		ERR("Sending reply to viewer");
+		return -1;
+	}
+	if (data_len > 0) {
+		ret = conn->sock->ops->sendmsg(conn->sock, data, data_len, 0);
+		if (ret < 0) {
+			ERR("Sending data to viewer");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Reopen the current tracefile of a viewer stream, closed by the fd cache.
+ */
+static
+int viewer_reopen_tracefile(struct lttng_fd_cache_entry *entry)
+{
+	struct relay_viewer_stream *vstream = caa_container_of(entry,
+			struct relay_viewer_stream, read_fd_entry);
+
+	return utils_open_stream_file(vstream->path_name, vstream->channel_name,
+			vstream->tracefile_size, vstream->tracefile_count_current);
+}
+
+/*
+ * Reopen the index of the current tracefile of a viewer stream, closed by the
+ * fd cache. Its entries are read at index_read_pos.
+ */
+static
+int viewer_reopen_index(struct lttng_fd_cache_entry *entry)
+{
+	struct relay_viewer_stream *vstream = caa_container_of(entry,
+			struct relay_viewer_stream, index_fd_entry);
+
+	return index_open_file(vstream->path_name, vstream->channel_name,
+			vstream->tracefile_size, vstream->tracefile_count_current);
+}
+
+/*
+ * Close the tracefile and index file of a viewer stream, if opened, removing
+ * them from the fd cache first.
+ */
+static
+void viewer_close_tracefile(struct relay_viewer_stream *vstream)
+{
+	lttng_fd_cache_del(&stream_fd_cache, &vstream->read_fd_entry);
+	lttng_fd_cache_del(&stream_fd_cache, &vstream->index_fd_entry);
+	vstream->files_open = 0;
+	if (vstream->read_fd >= 0) {
+		if (close(vstream->read_fd)) {
+			PERROR("close viewer stream tracefile");
+		}
+		vstream->read_fd = -1;
+	}
+	if (vstream->index_read_fd >= 0) {
+		if (close(vstream->index_read_fd)) {
+			PERROR("close viewer stream index");
+		}
+		vstream->index_read_fd = -1;
+	}
+}
+
+/*
+ * Open the current tracefile of a data stream and its index.
+ *
+ * Return 0 on success, -ENOENT or -EAGAIN if the relayd did not create them
+ * yet, or another negative value on error.
+ */
+static
+int viewer_open_tracefile(struct relay_viewer_stream *vstream)
+{
+	int ret;
+
+	ret = index_open_file(vstream->path_name, vstream->channel_name,
+			vstream->tracefile_size, vstream->tracefile_count_current);
+	if (ret < 0) {
+		goto end;
+	}
+	vstream->index_read_fd = ret;
+	vstream->index_read_pos = sizeof(struct ctf_packet_index_file_hdr);
+	vstream->index_end = 0;
+
+	ret = utils_open_stream_file(vstream->path_name, vstream->channel_name,
+			vstream->tracefile_size, vstream->tracefile_count_current);
+	if (ret < 0) {
+		PERROR("open viewer stream tracefile %s", vstream->channel_name);
+		viewer_close_tracefile(vstream);
+		goto end;
+	}
+	vstream->read_fd = ret;
+	vstream->files_open = 1;
+	lttng_fd_cache_add(&stream_fd_cache, &vstream->index_fd_entry);
+	lttng_fd_cache_add(&stream_fd_cache, &vstream->read_fd_entry);
+	ret = 0;
+
+end:
+	return ret;
+}
+
+/*
+ * Close the files of a viewer stream and free it.
+ */
+static
+void viewer_destroy_stream(struct relay_viewer_stream *vstream)
+{
+	viewer_close_tracefile(vstream);
+	free(vstream->path_name);
+	free(vstream->channel_name);
+	free(vstream);
+}
+
+/*
+ * Return the viewer stream of a connection or NULL if the viewer is not
+ * attached to it.
+ */
+static
+struct relay_viewer_stream *viewer_stream_find(
+		struct relay_viewer_connection *conn, uint64_t stream_id)
+{
+	struct lttng_ht_node_ulong *node;
+	struct lttng_ht_iter iter;
+
+	lttng_ht_lookup(conn->viewer_streams_ht,
+			(void *)((unsigned long) stream_id), &iter);
+	node = lttng_ht_iter_get_node_ulong(&iter);
+	if (!node) {
+		DBG("Viewer stream %" PRIu64 " not found", stream_id);
+		return NULL;
+	}
+	return caa_container_of(node, struct relay_viewer_stream, stream_n);
+}
+
+/*
+ * Return the relayd stream of the given handle, NULL once it is closed. Must
+ * be called with the RCU read side lock held.
+ */
+static
+struct relay_stream *relay_stream_find(uint64_t stream_id)
+{
+	struct lttng_ht_node_ulong *node;
+	struct lttng_ht_iter iter;
+
+	lttng_ht_lookup(relay_streams_ht,
+			(void *)((unsigned long) stream_id), &iter);
+	node = lttng_ht_iter_get_node_ulong(&iter);
+	if (!node) {
+		return NULL;
+	}
+	return caa_container_of(node, struct relay_stream, stream_n);
+}
+
+/*
+ * Handle VIEWER_CONNECT: exchange the protocol versions.
+ */
+static
+int viewer_connect(struct relay_viewer_connection *conn,
+		struct lttng_viewer_cmd *hdr)
+{
+	int ret;
+	struct lttng_viewer_connect msg;
+
+	ret = recv_payload(conn, hdr, &msg, sizeof(msg));
+	if (ret < 0) {
+		goto end;
+	}
+
+	if (be32toh(msg.major) != LTTNG_VIEWER_VERSION_MAJOR) {
+		ERR("Incompatible viewer protocol version %u.%u",
+				be32toh(msg.major), be32toh(msg.minor));
+		ret = -1;
+	}
+
+	msg.major = htobe32(LTTNG_VIEWER_VERSION_MAJOR);
+	msg.minor = htobe32(LTTNG_VIEWER_VERSION_MINOR);
+	if (send_reply(conn, &msg, sizeof(msg), NULL, 0) < 0) {
+		ret = -1;
+	}
+	if (ret == 0) {
+		conn->version_check_done = 1;
+	}
+
+end:
+	return ret;
+}
+
+/*
+ * Handle VIEWER_LIST_SESSIONS: send the sessions being streamed with their
+ * number of streams.
+ */
+static
+int viewer_list_sessions(struct relay_viewer_connection *conn,
+		struct lttng_viewer_cmd *hdr)
+{
+	int ret;
+	uint32_t count = 0, alloc_count = 0;
+	struct lttng_ht_iter iter, stream_iter;
+	struct relay_session *session;
+	struct relay_stream *stream;
+	struct lttng_viewer_session *sessions = NULL, *tmp;
+	struct lttng_viewer_list_sessions reply;
+
+	if (be64toh(hdr->data_size) != 0) {
+		ret = -1;
+		goto end;
+	}
+
+	rcu_read_lock();
+	cds_lfht_for_each_entry(relay_sessions_ht->ht, &iter.iter, session,
+			session_n.node) {
+		uint32_t nb_streams = 0;
+
+		cds_lfht_for_each_entry(relay_streams_ht->ht, &stream_iter.iter,
+				stream, stream_n.node) {
+			if (stream->session == session) {
+				nb_streams++;
+			}
+		}
+
+		if (count == alloc_count) {
+			alloc_count = alloc_count ? alloc_count << 1 : 16;
+			tmp = realloc(sessions, alloc_count * sizeof(*sessions));
+			if (!tmp) {
+				PERROR("realloc viewer sessions");
+				rcu_read_unlock();
+				ret = -1;
+				goto end;
+			}
+			sessions = tmp;
+		}
+		sessions[count].id = htobe64(session->id);
+		sessions[count].streams = htobe32(nb_streams);
+		count++;
+	}
+	rcu_read_unlock();
+
+	reply.sessions_count = htobe32(count);
+	ret = send_reply(conn, &reply, sizeof(reply), sessions,
+			count * sizeof(*sessions));
+
+end:
+	free(sessions);
+	return ret;
+}
+
+/*
+ * Handle VIEWER_ATTACH_SESSION: start following every stream of a session and
+ * send them to the viewer. Attaching again only sends the streams.
+ */
+static
+int viewer_attach_session(struct relay_viewer_connection *conn,
+		struct lttng_viewer_cmd *hdr)
+{
+	int ret;
+	uint64_t session_id;
+	uint32_t count = 0, alloc_count = 0;
+	struct lttng_ht_iter iter;
+	struct lttng_ht_node_ulong *node;
+	struct relay_stream *stream;
+	struct relay_viewer_stream *vstream;
+	struct lttng_viewer_stream *streams = NULL, *tmp;
+	struct lttng_viewer_attach_session_request request;
+	struct lttng_viewer_attach_session_response reply;
+
+	ret = recv_payload(conn, hdr, &request, sizeof(request));
+	if (ret < 0) {
+		goto end;
+	}
+	session_id = be64toh(request.session_id);
+
+	memset(&reply, 0, sizeof(reply));
+
+	rcu_read_lock();
+	lttng_ht_lookup(relay_sessions_ht, (void *)((unsigned long) session_id),
+			&iter);
+	node = lttng_ht_iter_get_node_ulong(&iter);
+	if (!node) {
+		DBG("Viewer attach to unknown session %" PRIu64, session_id);
+		rcu_read_unlock();
+		reply.status = htobe32(VIEWER_ATTACH_UNK);
+		ret = send_reply(conn, &reply, sizeof(reply), NULL, 0);
+		goto end;
+	}
+
+	cds_lfht_for_each_entry(relay_streams_ht->ht, &iter.iter, stream,
+			stream_n.node) {
+		if (stream->session->id != session_id) {
+			continue;
+		}
+
+		if (count == alloc_count) {
+			alloc_count = alloc_count ? alloc_count << 1 : 16;
+			tmp = realloc(streams, alloc_count * sizeof(*streams));
+			if (!tmp) {
+				PERROR("realloc viewer streams");
+				ret = -1;
+				goto end_unlock;
+			}
+			streams = tmp;
+		}
+		memset(&streams[count], 0, sizeof(streams[count]));
+		streams[count].id = htobe64(stream->stream_handle);
+		streams[count].metadata_flag = htobe32(
+				!strcmp(stream->channel_name, DEFAULT_METADATA_NAME));
+		strncpy(streams[count].path_name, stream->path_name,
+				sizeof(streams[count].path_name) - 1);
+		strncpy(streams[count].channel_name, stream->channel_name,
+				sizeof(streams[count].channel_name) - 1);
+		count++;
+
+		if (viewer_stream_find(conn, stream->stream_handle)) {
+			continue;
+		}
+
+		vstream = zmalloc(sizeof(*vstream));
+		if (!vstream) {
+			PERROR("zmalloc viewer stream");
+			ret = -1;
+			goto end_unlock;
+		}
+		vstream->read_fd = -1;
+		vstream->index_read_fd = -1;
+		lttng_fd_cache_entry_init(&vstream->read_fd_entry, &vstream->read_fd,
+				viewer_reopen_tracefile);
+		lttng_fd_cache_entry_init(&vstream->index_fd_entry,
+				&vstream->index_read_fd, viewer_reopen_index);
+		vstream->path_name = strdup(stream->path_name);
+		vstream->channel_name = strdup(stream->channel_name);
+		if (!vstream->path_name || !vstream->channel_name) {
+			PERROR("strdup viewer stream");
+			viewer_destroy_stream(vstream);
+			ret = -1;
+			goto end_unlock;
+		}
+		vstream->stream_handle = stream->stream_handle;
+		vstream->metadata_flag =
+			!strcmp(stream->channel_name, DEFAULT_METADATA_NAME);
+		vstream->tracefile_size = stream->tracefile_size;
+		vstream->tracefile_count = stream->tracefile_count;
+		/* Read from the first tracefile, zeroed by zmalloc. */
+		vstream->tracefile_count_last =
+			CMM_LOAD_SHARED(stream->tracefile_count_current);
+		lttng_ht_node_init_ulong(&vstream->stream_n,
+				(unsigned long) vstream->stream_handle);
+		lttng_ht_add_unique_ulong(conn->viewer_streams_ht, &vstream->stream_n);
+	}
+	rcu_read_unlock();
+
+	DBG("Viewer attached to session %" PRIu64 " with %u streams",
+			session_id, count);
+
+	reply.status = htobe32(VIEWER_ATTACH_OK);
+	reply.streams_count = htobe32(count);
+	ret = send_reply(conn, &reply, sizeof(reply), streams,
+			count * sizeof(*streams));
+	goto end;
+
+end_unlock:
+	rcu_read_unlock();
+end:
+	free(streams);
+	return ret;
+}
+
+/*
+ * Handle VIEWER_GET_NEXT_INDEX: send the next index entry of a data stream,
+ * following the rotation of its tracefiles.
+ */
+static
+int viewer_get_next_index(struct relay_viewer_connection *conn,
+		struct lttng_viewer_cmd *hdr)
+{
+	int ret, fd, closed;
+	ssize_t read_len;
+	uint64_t end_offset;
+	struct relay_stream *stream;
+	struct relay_viewer_stream *vstream;
+	struct ctf_packet_index entry;
+	struct lttng_viewer_get_next_index request;
+	struct lttng_viewer_index reply;
+
+	ret = recv_payload(conn, hdr, &request, sizeof(request));
+	if (ret < 0) {
+		goto end;
+	}
+
+	memset(&reply, 0, sizeof(reply));
+
+	rcu_read_lock();
+	vstream = viewer_stream_find(conn, be64toh(request.stream_id));
+	if (!vstream || vstream->metadata_flag) {
+		rcu_read_unlock();
+		reply.status = htobe32(VIEWER_INDEX_ERR);
+		goto send_reply;
+	}
+
+	/*
+	 * A stream is removed once its packets are all written, so everything in
+	 * the files is final when it is gone.
+	 */
+	stream = relay_stream_find(vstream->stream_handle);
+	closed = !stream;
+	if (stream) {
+		vstream->tracefile_count_last =
+			CMM_LOAD_SHARED(stream->tracefile_count_current);
+	}
+	rcu_read_unlock();
+
+	for (;;) {
+		if (!vstream->files_open) {
+			ret = viewer_open_tracefile(vstream);
+			if (ret == -ENOENT || ret == -EAGAIN) {
+				reply.status = htobe32(closed ?
+						VIEWER_INDEX_HUP : VIEWER_INDEX_RETRY);
+				break;
+			} else if (ret < 0) {
+				reply.status = htobe32(VIEWER_INDEX_ERR);
+				break;
+			}
+		}
+
+		fd = lttng_fd_cache_get(&stream_fd_cache, &vstream->index_fd_entry);
+		if (fd < 0) {
+			lttng_fd_cache_put(&vstream->index_fd_entry);
+			ERR("Reopening index of viewer stream %s", vstream->channel_name);
+			reply.status = htobe32(VIEWER_INDEX_ERR);
+			break;
+		}
+		read_len = pread_full(fd, &entry, sizeof(entry),
+				vstream->index_read_pos);
+		lttng_fd_cache_put(&vstream->index_fd_entry);
+		if (read_len == sizeof(entry)) {
+			vstream->index_read_pos += sizeof(entry);
+			end_offset = viewer_index_entry_end(&entry);
+			if (end_offset > vstream->index_end) {
+				vstream->index_end = end_offset;
+			}
+			reply.offset = entry.offset;
+			reply.packet_size = entry.packet_size;
+			reply.content_size = entry.content_size;
+			reply.timestamp_begin = entry.timestamp_begin;
+			reply.timestamp_end = entry.timestamp_end;
+			reply.events_discarded = entry.events_discarded;
+			reply.stream_id = entry.stream_id;
+			reply.status = htobe32(VIEWER_INDEX_OK);
+			break;
+		} else if (read_len < 0) {
+			PERROR("read viewer stream index");
+			reply.status = htobe32(VIEWER_INDEX_ERR);
+			break;
+		} else if (read_len > 0) {
+			/* Entry being written, read it again on the next request. */
+			reply.status = htobe32(VIEWER_INDEX_RETRY);
+			break;
+		}
+
+		/* End of the index, move to the next tracefile if it exists. */
+		if (vstream->tracefile_size > 0 &&
+				vstream->tracefile_count_current !=
+				vstream->tracefile_count_last) {
+			viewer_close_tracefile(vstream);
+			vstream->tracefile_count_current++;
+			if (vstream->tracefile_count > 0) {
+				vstream->tracefile_count_current %= vstream->tracefile_count;
+			}
+			continue;
+		}
+		reply.status = htobe32(closed ? VIEWER_INDEX_HUP : VIEWER_INDEX_RETRY);
+		break;
+	}
+
+send_reply:
+	ret = send_reply(conn, &reply, sizeof(reply), NULL, 0);
+
+end:
+	return ret;
+}
+
+/*
+ * Read a packet of len bytes at the given offset of the current tracefile of
+ * a stream, open on fd, in buf, decompressing it if it is a frame.
+ *
+ * Return 0 on success or else a negative value.
+ */
+static
+int read_stream_packet(struct relay_viewer_stream *vstream, int fd,
+		uint64_t offset, char *buf, uint32_t len)
+{
+	int ret;
+	ssize_t read_len;
+	size_t frame_len;
+	char *frame = NULL;
+	struct lttng_compress_frame_hdr frame_hdr;
+
+	read_len = pread_full(fd, &frame_hdr, sizeof(frame_hdr),
+			offset);
+	if (read_len < 0) {
+		PERROR("pread viewer stream tracefile");
+		ret = -1;
+		goto end;
+	}
+
+	if (!lttng_compress_is_frame((const char *) &frame_hdr, read_len)) {
+		read_len = pread_full(fd, buf, len, offset);
+		if (read_len < 0) {
+			PERROR("pread viewer stream tracefile");
+			ret = -1;
+			goto end;
+		}
+		ret = read_len == len ? 0 : -1;
+		goto end;
+	}
+
+	/* The frame size comes from the file, check it before reading it. */
+	frame_len = viewer_frame_len(&frame_hdr, offset, len, vstream->index_end);
+	if (frame_len == 0) {
+		ERR("Invalid compressed packet frame of stream %s at offset %" PRIu64,
+				vstream->channel_name, offset);
+		ret = -1;
+		goto end;
+	}
+	frame = zmalloc(frame_len);
+	if (!frame) {
+		PERROR("zmalloc viewer packet frame");
+		ret = -1;
+		goto end;
+	}
+	read_len = pread_full(fd, frame, frame_len, offset);
+	if (read_len < 0 || read_len != frame_len) {
+		ERR("Reading compressed packet of stream %s", vstream->channel_name);
+		ret = -1;
+		goto end;
+	}
+	read_len = lttng_compress_frame_decode(frame, frame_len, buf, len);
+	ret = read_len == len ? 0 : -1;
+
+end:
+	free(frame);
+	return ret;
+}
+
+/*
+ * Handle VIEWER_GET_PACKET: send a packet of the current tracefile of a
+ * stream, at the offset of one of its index entries.
+ */
+static
+int viewer_get_packet(struct relay_viewer_connection *conn,
+		struct lttng_viewer_cmd *hdr)
+{
+	int ret, fd;
+	uint32_t len;
+	char *data = NULL;
+	struct relay_viewer_stream *vstream;
+	struct lttng_viewer_get_packet request;
+	struct lttng_viewer_trace_packet reply;
+
+	ret = recv_payload(conn, hdr, &request, sizeof(request));
+	if (ret < 0) {
+		goto end;
+	}
+	len = be32toh(request.len);
+
+	memset(&reply, 0, sizeof(reply));
+	reply.status = htobe32(VIEWER_GET_PACKET_ERR);
+
+	rcu_read_lock();
+	vstream = viewer_stream_find(conn, be64toh(request.stream_id));
+	rcu_read_unlock();
+	if (!vstream || !vstream->files_open) {
+		goto send_reply;
+	}
+	if (!viewer_packet_request_valid(be64toh(request.offset), len,
+				vstream->index_end)) {
+		DBG("Viewer packet request out of the index of stream %s",
+				vstream->channel_name);
+		goto send_reply;
+	}
+
+	data = zmalloc(len);
+	if (!data) {
+		PERROR("zmalloc viewer packet");
+		goto send_reply;
+	}
+
+	fd = lttng_fd_cache_get(&stream_fd_cache, &vstream->read_fd_entry);
+	if (fd < 0) {
+		ERR("Reopening tracefile of viewer stream %s", vstream->channel_name);
+		ret = fd;
+	} else {
+		ret = read_stream_packet(vstream, fd, be64toh(request.offset),
+				data, len);
+	}
+	lttng_fd_cache_put(&vstream->read_fd_entry);
+	if (ret < 0) {
+		goto send_reply;
+	}
+	reply.status = htobe32(VIEWER_GET_PACKET_OK);
+	reply.len = htobe32(len);
+
+send_reply:
+	ret = send_reply(conn, &reply, sizeof(reply), data,
+			be32toh(reply.len));
+
+end:
+	free(data);
+	return ret;
+}
+
+/*
+ * Handle VIEWER_GET_METADATA: send the metadata written since the previous
+ * request, by chunks.
+ */
+static
+int viewer_get_metadata(struct relay_viewer_connection *conn,
+		struct lttng_viewer_cmd *hdr)
+{
+	int ret, fd;
+	ssize_t read_len;
+	char *data = NULL;
+	struct relay_viewer_stream *vstream;
+	struct lttng_viewer_get_metadata request;
+	struct lttng_viewer_metadata_packet reply;
+
+	ret = recv_payload(conn, hdr, &request, sizeof(request));
+	if (ret < 0) {
+		goto end;
+	}
+
+	memset(&reply, 0, sizeof(reply));
+	reply.status = htobe32(VIEWER_METADATA_ERR);
+
+	rcu_read_lock();
+	vstream = viewer_stream_find(conn, be64toh(request.stream_id));
+	rcu_read_unlock();
+	if (!vstream || !vstream->metadata_flag) {
+		goto send_reply;
+	}
+
+	if (!vstream->files_open) {
+		ret = utils_open_stream_file(vstream->path_name,
+				vstream->channel_name, vstream->tracefile_size, 0);
+		if (ret < 0) {
+			if (errno == ENOENT) {
+				reply.status = htobe32(VIEWER_NO_NEW_METADATA);
+			} else {
+				PERROR("open viewer metadata");
+			}
+			goto send_reply;
+		}
+		vstream->read_fd = ret;
+		vstream->files_open = 1;
+		lttng_fd_cache_add(&stream_fd_cache, &vstream->read_fd_entry);
+	}
+
+	data = zmalloc(DEFAULT_RELAYD_VIEWER_METADATA_CHUNK);
+	if (!data) {
+		PERROR("zmalloc viewer metadata");
+		goto send_reply;
+	}
+
+	fd = lttng_fd_cache_get(&stream_fd_cache, &vstream->read_fd_entry);
+	if (fd < 0) {
+		lttng_fd_cache_put(&vstream->read_fd_entry);
+		ERR("Reopening viewer metadata %s", vstream->channel_name);
+		goto send_reply;
+	}
+	read_len = pread_full(fd, data,
+			DEFAULT_RELAYD_VIEWER_METADATA_CHUNK, vstream->metadata_offset);
+	lttng_fd_cache_put(&vstream->read_fd_entry);
+	if (read_len < 0) {
+		PERROR("pread viewer metadata");
+		goto send_reply;
+	} else if (read_len == 0) {
+		reply.status = htobe32(VIEWER_NO_NEW_METADATA);
+		goto send_reply;
+	}
+	vstream->metadata_offset += read_len;
+	reply.status = htobe32(VIEWER_METADATA_OK);
+	reply.len = htobe64(read_len);
+
+send_reply:
+	ret = send_reply(conn, &reply, sizeof(reply), data, be64toh(reply.len));
+
+end:
+	free(data);
+	return ret;
+}
+
+/*
+ * Process a command of a viewer.
+ *
+ * Return 0 on success or a negative value if the connection must be closed.
+ */
+static
+int process_viewer_cmd(struct relay_viewer_connection *conn,
+		struct lttng_viewer_cmd *hdr)
+{
+	int ret;
+	uint32_t cmd = be32toh(hdr->cmd);
+
+	if (cmd != VIEWER_CONNECT && !conn->version_check_done) {
+		ERR("Viewer command %u before the version check", cmd);
+		return -1;
+	}
+
+	switch (cmd) {
+	case VIEWER_CONNECT:
+		ret = viewer_connect(conn, hdr);
+		break;
+	case VIEWER_LIST_SESSIONS:
+		ret = viewer_list_sessions(conn, hdr);
+		break;
+	case VIEWER_ATTACH_SESSION:
+		ret = viewer_attach_session(conn, hdr);
+		break;
+	case VIEWER_GET_NEXT_INDEX:
+		ret = viewer_get_next_index(conn, hdr);
+		break;
+	case VIEWER_GET_PACKET:
+		ret = viewer_get_packet(conn, hdr);
+		break;
+	case VIEWER_GET_METADATA:
+		ret = viewer_get_metadata(conn, hdr);
+		break;
+	default:
+		ERR("Unknown viewer command %u", cmd);
+		ret = -1;
+		break;
+	}
+
+	return ret;
+}
+
+/*
+ * Accept a viewer connection and add it to the poll set.
+ */
+static
+int viewer_add_connection(struct lttng_poll_event *events,
+		struct lttng_ht *viewer_connections_ht)
+{
+	int ret;
+	struct lttcomm_sock *newsock;
+	struct relay_viewer_connection *conn;
+
+	newsock = live_sock->ops->accept(live_sock);
+	if (!newsock) {
+		PERROR("accepting viewer sock");
+		goto error;
+	}
+
+	conn = zmalloc(sizeof(*conn));
+	if (!conn) {
+		PERROR("zmalloc viewer connection");
+		goto error_sock;
+	}
+	conn->sock = newsock;
+	conn->viewer_streams_ht = lttng_ht_new(0, LTTNG_HT_TYPE_ULONG);
+	if (!conn->viewer_streams_ht) {
+		goto error_free;
+	}
+
+	ret = lttng_poll_add(events, newsock->fd, LPOLLIN | LPOLLRDHUP);
+	if (ret < 0) {
+		goto error_ht;
+	}
+
+	lttng_ht_node_init_ulong(&conn->sock_n, (unsigned long) newsock->fd);
+	rcu_read_lock();
+	lttng_ht_add_unique_ulong(viewer_connections_ht, &conn->sock_n);
+	rcu_read_unlock();
+
+	DBG("Viewer connection accepted, socket %d", newsock->fd);
+	return 0;
+
+error_ht:
+	lttng_ht_destroy(conn->viewer_streams_ht);
+error_free:
+	free(conn);
+error_sock:
+	lttcomm_destroy_sock(newsock);
+error:
+	return -1;
+}
+
+/*
+ * Close a viewer connection and free its streams. Must be called with the RCU
+ * read side lock held.
+ */
+static
+void viewer_del_connection(struct lttng_poll_event *events,
+		struct lttng_ht *viewer_connections_ht,
+		struct relay_viewer_connection *conn)
+{
+	int ret;
+	struct lttng_ht_iter iter;
+	struct relay_viewer_stream *vstream;
+
+	DBG("Closing viewer connection, socket %d", conn->sock->fd);
+
+	lttng_poll_del(events, conn->sock->fd);
+
+	iter.iter.node = &conn->sock_n.node;
+	ret = lttng_ht_del(viewer_connections_ht, &iter);
+	assert(!ret);
+
+	/* Only this thread reads the viewer streams. */
+	cds_lfht_for_each_entry(conn->viewer_streams_ht->ht, &iter.iter, vstream,
+			stream_n.node) {
+		ret = lttng_ht_del(conn->viewer_streams_ht, &iter);
+		assert(!ret);
+		viewer_destroy_stream(vstream);
+	}
+	lttng_ht_destroy(conn->viewer_streams_ht);
+
+	conn->sock->ops->close(conn->sock);
+	lttcomm_destroy_sock(conn->sock);
+	free(conn);
+}
+
+/*
+ * This thread serves the live viewers.
+ */
+static
+void *thread_live(void *data)
+{
+	int i, ret, pollfd;
+	uint32_t revents, nb_fd;
+	struct lttng_poll_event events;
+	struct lttng_ht *viewer_connections_ht;
+	struct lttng_ht_node_ulong *node;
+	struct lttng_ht_iter iter;
+	struct relay_viewer_connection *conn;
+	struct lttng_viewer_cmd hdr;
+
+	DBG("[thread] Relay live started");
+
+	rcu_register_thread();
+
+	viewer_connections_ht = lttng_ht_new(0, LTTNG_HT_TYPE_ULONG);
+	if (!viewer_connections_ht) {
+		goto error_ht;
+	}
+
+	ret = lttng_poll_create(&events, 2, LTTNG_CLOEXEC);
+	if (ret < 0) {
+		goto error_poll_create;
+	}
+
+	ret = lttng_poll_add(&events, live_quit_pipe, LPOLLIN);
+	if (ret < 0) {
+		goto error;
+	}
+
+	ret = lttng_poll_add(&events, live_sock->fd, LPOLLIN | LPOLLRDHUP);
+	if (ret < 0) {
+		goto error;
+	}
+
+	while (1) {
+restart:
+		ret = lttng_poll_wait(&events, -1);
+		if (ret < 0) {
+			/*
+			 * Restart interrupted system call.
+			 */
+			if (errno == EINTR) {
+				goto restart;
+			}
+			goto error;
+		}
+
+		nb_fd = ret;
+
+		for (i = 0; i < nb_fd; i++) {
+			/* Fetch once the poll data */
+			revents = LTTNG_POLL_GETEV(&events, i);
+			pollfd = LTTNG_POLL_GETFD(&events, i);
+
+			/* Thread quit pipe has been closed. Killing thread. */
+			if (pollfd == live_quit_pipe && (revents & LPOLLIN)) {
+				goto exit;
+			}
+
+			if (pollfd == live_sock->fd) {
+				if (revents & (LPOLLERR | LPOLLHUP | LPOLLRDHUP)) {
+					ERR("Viewer socket poll error");
+					goto error;
+				} else if (revents & LPOLLIN) {
+					/* A failed connection doesn't stop the thread. */
+					(void) viewer_add_connection(&events,
+							viewer_connections_ht);
+				}
+				continue;
+			}
+
+			rcu_read_lock();
+			lttng_ht_lookup(viewer_connections_ht,
+					(void *)((unsigned long) pollfd), &iter);
+			node = lttng_ht_iter_get_node_ulong(&iter);
+			if (!node) {
+				DBG2("Viewer connection fd %d not found", pollfd);
+				rcu_read_unlock();
+				continue;
+			}
+			conn = caa_container_of(node, struct relay_viewer_connection,
+					sock_n);
+
+			if (revents & (LPOLLERR | LPOLLHUP | LPOLLRDHUP)) {
+				viewer_del_connection(&events, viewer_connections_ht, conn);
+			} else if (revents & LPOLLIN) {
+				ret = conn->sock->ops->recvmsg(conn->sock, &hdr,
+						sizeof(hdr), 0);
+				if (ret < (int) sizeof(hdr) ||
+						process_viewer_cmd(conn, &hdr) < 0) {
+					viewer_del_connection(&events,
+							viewer_connections_ht, conn);
+				}
+			}
+			rcu_read_unlock();
+		}
+	}
+
+exit:
+error:
+	rcu_read_lock();
+	cds_lfht_for_each_entry(viewer_connections_ht->ht, &iter.iter, conn,
+			sock_n.node) {
+		viewer_del_connection(&events, viewer_connections_ht, conn);
+	}
+	rcu_read_unlock();
+	lttng_poll_clean(&events);
+error_poll_create:
+	lttng_ht_destroy(viewer_connections_ht);
+error_ht:
+	DBG("Live viewer thread cleanup complete");
+	rcu_unregister_thread();
+	return NULL;
+}
+
+/*
+ * Listen for viewers on the live uri and start the live thread, which exits
+ * when the quit pipe is written.
+ *
+ * Return 0 on success or else a negative value.
+ */
+int live_start_threads(struct lttng_uri *live_uri, int quit_pipe)
+{
+	int ret;
+
+	assert(live_uri);
+
+	live_sock = live_init_sock(live_uri);
+	if (!live_sock) {
+		ret = -1;
+		goto error;
+	}
+	live_quit_pipe = quit_pipe;
+
+	ret = pthread_create(&live_thread, NULL, thread_live, NULL);
+	if (ret != 0) {
+		errno = ret;
+		PERROR("pthread_create live");
+		ret = -1;
+		goto error_sock;
+	}
+
+	return 0;
+
+error_sock:
+	lttcomm_destroy_sock(live_sock);
+	live_sock = NULL;
+error:
+	return ret;
+}
+
+/*
+ * Join the live thread and close the viewer socket.
+ */
+void live_stop_threads(void)
+{
+	int ret;
+	void *status;
+
+	if (!live_sock) {
+		return;
+	}
+
+	ret = pthread_join(live_thread, &status);
+	if (ret != 0) {
+		errno = ret;
+		PERROR("pthread_join live");
+	}
+
+	if (live_sock->fd >= 0) {
+		ret = live_sock->ops->close(live_sock);
+		if (ret) {
+			PERROR("close");
+		}
+	}
+	lttcomm_destroy_sock(live_sock);
+	live_sock = NULL;
+}
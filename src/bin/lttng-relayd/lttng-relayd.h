@@ -23,6 +23,8 @@
 #include <urcu.h>
 #include <urcu/wfqueue.h>
 #include <common/hashtable/hashtable.h>
+#include <common/compress/compress-pool.h>
+#include <common/fd-cache.h>
 
 /*
  * Queue used to enqueue relay requests
@@ -48,6 +50,9 @@ struct relay_session {
 	 */
 	uint64_t id;
 	struct lttcomm_sock *sock;
+	/* Node of relay_sessions_ht, read by the live thread. */
+	struct lttng_ht_node_ulong session_n;
+	struct rcu_head rcu_node;
 };
 
 /*
@@ -58,8 +63,11 @@ struct relay_stream {
 	uint64_t prev_seq;	/* previous data sequence number encountered */
 	struct lttng_ht_node_ulong stream_n;
 	struct relay_session *session;
-	struct rcu_head rcu_node;
 	int fd;
+	/* The tracefile can be closed while the stream is idle. */
+	struct lttng_fd_cache_entry fd_entry;
+	/* Packet index file of the current tracefile, -1 if not indexed. */
+	int index_fd;
 
 	char *path_name;
 	char *channel_name;
@@ -69,6 +77,18 @@ struct relay_stream {
 	uint64_t tracefile_count;
 	uint64_t tracefile_count_current;
 
+	/*
+	 * The packets of a data stream are written, and compressed if needed, by
+	 * the writer thread of its lane, which owns the files and the tracefile
+	 * counters until the lane is drained.
+	 */
+	enum lttng_compression compression;
+	struct lttng_compress_lane write_lane;
+	/* Set by the writer when a packet is lost, closes the data connection. */
+	int write_error;
+	/* The data connection waits for the queue to go down. */
+	int throttled;
+
 	/* Information telling us when to close the stream  */
 	unsigned int close_flag:1;
 	uint64_t last_net_seq_num;
@@ -85,14 +105,26 @@ struct relay_command {
 	struct relay_session *session;
 	struct cds_wfq_node node;
 	struct lttng_ht_node_ulong sock_n;
-	struct rcu_head rcu_node;
 	enum connection_type type;
 	unsigned int version_check_done:1;
 	/* protocol version to use for this session */
 	uint32_t major;
 	uint32_t minor;
+	/* Data connection not polled until the queue of the stream goes down. */
+	unsigned int throttled:1;
+	uint64_t throttled_stream;
 };
 
 extern char *opt_output_path;
 
+/*
+ * Sessions and streams indexed by id, updated by the worker thread and read
+ * under RCU by the live thread.
+ */
+extern struct lttng_ht *relay_sessions_ht;
+extern struct lttng_ht *relay_streams_ht;
+
+/* Tracefiles of the streams and of the live viewer streams. */
+extern struct lttng_fd_cache stream_fd_cache;
+
 #endif /* LTTNG_RELAYD_H */
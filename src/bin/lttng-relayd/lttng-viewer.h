@@ -0,0 +1,176 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef LTTNG_VIEWER_H
+#define LTTNG_VIEWER_H
+
+#include <limits.h>
+#include <stdint.h>
+
+#include <common/defaults.h>
+#include <common/macros.h>
+
+/*
+ * Protocol spoken by the live viewers on the viewer port of the relayd. Every
+ * field is big endian.
+ *
+ * A viewer connects, lists the sessions being streamed and attaches to one of
+ * them to receive its streams. It then polls the packet index of each data
+ * stream and fetches the packets and the metadata as they are written. The
+ * indexes and packets are the ones of the tracefiles: a packet of a
+ * compressed stream is sent decompressed.
+ */
+#define LTTNG_VIEWER_VERSION_MAJOR	2
+#define LTTNG_VIEWER_VERSION_MINOR	4
+
+enum lttng_viewer_command {
+	VIEWER_CONNECT		= 1,
+	VIEWER_LIST_SESSIONS	= 2,
+	VIEWER_ATTACH_SESSION	= 3,
+	VIEWER_GET_NEXT_INDEX	= 4,
+	VIEWER_GET_PACKET	= 5,
+	VIEWER_GET_METADATA	= 6,
+};
+
+enum lttng_viewer_attach_return_code {
+	VIEWER_ATTACH_OK	= 1,	/* The session is attached. */
+	VIEWER_ATTACH_UNK	= 2,	/* The session does not exist. */
+};
+
+enum lttng_viewer_next_index_return_code {
+	VIEWER_INDEX_OK		= 1,	/* Index is available. */
+	VIEWER_INDEX_RETRY	= 2,	/* No new index yet, retry later. */
+	VIEWER_INDEX_HUP	= 3,	/* The stream is closed and fully read. */
+	VIEWER_INDEX_ERR	= 4,	/* Unknown stream or read error. */
+};
+
+enum lttng_viewer_get_packet_return_code {
+	VIEWER_GET_PACKET_OK	= 1,
+	VIEWER_GET_PACKET_ERR	= 2,
+};
+
+enum lttng_viewer_get_metadata_return_code {
+	VIEWER_METADATA_OK	= 1,
+	VIEWER_NO_NEW_METADATA	= 2,
+	VIEWER_METADATA_ERR	= 3,
+};
+
+/*
+ * Header of every viewer command.
+ */
+struct lttng_viewer_cmd {
+	uint64_t data_size;	/* data size following this header */
+	uint32_t cmd;		/* enum lttng_viewer_command */
+} LTTNG_PACKED;
+
+/*
+ * VIEWER_CONNECT payload and reply. The relayd replies with its own version
+ * and closes the connection if the major versions differ.
+ */
+struct lttng_viewer_connect {
+	uint32_t major;
+	uint32_t minor;
+} LTTNG_PACKED;
+
+/*
+ * VIEWER_LIST_SESSIONS reply, followed by sessions_count sessions.
+ */
+struct lttng_viewer_list_sessions {
+	uint32_t sessions_count;
+} LTTNG_PACKED;
+
+struct lttng_viewer_session {
+	uint64_t id;
+	uint32_t streams;
+} LTTNG_PACKED;
+
+/*
+ * VIEWER_ATTACH_SESSION payload.
+ */
+struct lttng_viewer_attach_session_request {
+	uint64_t session_id;
+} LTTNG_PACKED;
+
+/*
+ * VIEWER_ATTACH_SESSION reply, followed by streams_count streams.
+ */
+struct lttng_viewer_attach_session_response {
+	uint32_t status;	/* enum lttng_viewer_attach_return_code */
+	uint32_t streams_count;
+} LTTNG_PACKED;
+
+struct lttng_viewer_stream {
+	uint64_t id;
+	uint32_t metadata_flag;
+	char path_name[PATH_MAX];
+	char channel_name[DEFAULT_STREAM_NAME_LEN];
+} LTTNG_PACKED;
+
+/*
+ * VIEWER_GET_NEXT_INDEX payload.
+ */
+struct lttng_viewer_get_next_index {
+	uint64_t stream_id;
+} LTTNG_PACKED;
+
+/*
+ * VIEWER_GET_NEXT_INDEX reply, the fields of the index entry of the packet.
+ * The offset is opaque and only meant for VIEWER_GET_PACKET.
+ */
+struct lttng_viewer_index {
+	uint64_t offset;
+	uint64_t packet_size;		/* in bits */
+	uint64_t content_size;		/* in bits */
+	uint64_t timestamp_begin;
+	uint64_t timestamp_end;
+	uint64_t events_discarded;
+	uint64_t stream_id;
+	uint32_t status;		/* enum lttng_viewer_next_index_return_code */
+} LTTNG_PACKED;
+
+/*
+ * VIEWER_GET_PACKET payload, len being the packet size of the index in bytes.
+ */
+struct lttng_viewer_get_packet {
+	uint64_t stream_id;
+	uint64_t offset;
+	uint32_t len;
+} LTTNG_PACKED;
+
+/*
+ * VIEWER_GET_PACKET reply, followed by len bytes of packet.
+ */
+struct lttng_viewer_trace_packet {
+	uint32_t status;	/* enum lttng_viewer_get_packet_return_code */
+	uint32_t len;
+} LTTNG_PACKED;
+
+/*
+ * VIEWER_GET_METADATA payload.
+ */
+struct lttng_viewer_get_metadata {
+	uint64_t stream_id;
+} LTTNG_PACKED;
+
+/*
+ * VIEWER_GET_METADATA reply, followed by len bytes of metadata following the
+ * previous ones sent on the connection.
+ */
+struct lttng_viewer_metadata_packet {
+	uint64_t len;
+	uint32_t status;	/* enum lttng_viewer_get_metadata_return_code */
+} LTTNG_PACKED;
+
+#endif /* LTTNG_VIEWER_H */
@@ -50,16 +50,22 @@
 #include <common/sessiond-comm/relayd.h>
 #include <common/uri.h>
 #include <common/utils.h>
+#include <common/index/index.h>
+#include <common/compress/compress.h>
+#include <common/obj-pool.h>
 
 #include "cmd.h"
 #include "utils.h"
 #include "lttng-relayd.h"
+#include "live.h"
+#include "stream-throttle.h"
 
 /* command line options */
 char *opt_output_path;
 static int opt_daemon;
 static struct lttng_uri *control_uri;
 static struct lttng_uri *data_uri;
+static struct lttng_uri *live_uri;
 
 const char *progname;
 static int is_root;			/* Set to 1 if the daemon is running as root */
@@ -86,6 +92,9 @@ static pthread_t worker_thread;
 static uint64_t last_relay_stream_id;
 static uint64_t last_relay_session_id;
 
+struct lttng_ht *relay_sessions_ht;
+struct lttng_ht *relay_streams_ht;
+
 /*
  * Relay command queue.
  *
@@ -98,6 +107,37 @@ static struct relay_cmd_queue relay_cmd_queue;
 static char *data_buffer;
 static unsigned int data_buffer_size;
 
+/*
+ * Writer threads of the data streams, compressing the packets of compressed
+ * streams. Created with the first data stream by the worker thread.
+ */
+static struct lttng_compress_pool *writer_pool;
+
+/*
+ * Wakes up the worker thread when the queue of a throttled stream goes below
+ * its low watermark.
+ */
+static int writer_wakeup_pipe[2] = { -1, -1 };
+
+/*
+ * Tracefiles of the streams, and the files read by the live viewers, closed
+ * while the streams are idle when there are too many of them.
+ */
+struct lttng_fd_cache stream_fd_cache;
+
+/*
+ * Streams and connections, recycled once freed instead of going back to
+ * malloc as the per-PID streams and the sessiond connections come and go.
+ */
+static struct lttng_obj_pool stream_pool;
+static struct lttng_obj_pool command_pool;
+
+/* A packet of a stream waiting to be written. */
+struct relay_write_job {
+	struct lttng_compress_job job;
+	struct relay_stream *stream;
+};
+
 /*
  * usage function on stderr
  */
@@ -109,6 +149,7 @@ void usage(void)
 	fprintf(stderr, "  -d, --daemonize           Start as a daemon.\n");
 	fprintf(stderr, "  -C, --control-port URL    Control port listening.\n");
 	fprintf(stderr, "  -D, --data-port URL       Data port listening.\n");
+	fprintf(stderr, "  -L, --live-port URL       Live view port listening.\n");
 	fprintf(stderr, "  -o, --output PATH         Output path for traces. Must use an absolute path.\n");
 	fprintf(stderr, "  -v, --verbose             Verbose mode. Activate DBG() macro.\n");
 }
@@ -123,6 +164,7 @@ int parse_args(int argc, char **argv)
 	static struct option long_options[] = {
 		{ "control-port", 1, 0, 'C', },
 		{ "data-port", 1, 0, 'D', },
+		{ "live-port", 1, 0, 'L', },
 		{ "daemonize", 0, 0, 'd', },
 		{ "help", 0, 0, 'h', },
 		{ "output", 1, 0, 'o', },
@@ -132,7 +174,7 @@ int parse_args(int argc, char **argv)
 
 	while (1) {
 		int option_index = 0;
-		c = getopt_long(argc, argv, "dhv" "C:D:o:",
+		c = getopt_long(argc, argv, "dhv" "C:D:L:o:",
 				long_options, &option_index);
 		if (c == -1) {
 			break;
@@ -165,6 +207,16 @@ int parse_args(int argc, char **argv)
 				data_uri->port = DEFAULT_NETWORK_DATA_PORT;
 			}
 			break;
+		case 'L':
+			ret = uri_parse(optarg, &live_uri);
+			if (ret < 0) {
+				ERR("Invalid live URI specified");
+				goto exit;
+			}
+			if (live_uri->port == 0) {
+				live_uri->port = DEFAULT_NETWORK_VIEWER_PORT;
+			}
+			break;
 		case 'd':
 			opt_daemon = 1;
 			break;
@@ -221,17 +273,53 @@ int parse_args(int argc, char **argv)
 			goto exit;
 		}
 	}
+	if (live_uri == NULL) {
+		/*
+		 * The viewers are not authenticated so only local ones can attach
+		 * unless a live URI is given.
+		 */
+		ret = asprintf(&default_address, "tcp://127.0.0.1:%d",
+				DEFAULT_NETWORK_VIEWER_PORT);
+		if (ret < 0) {
+			PERROR("asprintf default viewer address");
+			goto exit;
+		}
+
+		ret = uri_parse(default_address, &live_uri);
+		free(default_address);
+		if (ret < 0) {
+			ERR("Invalid live URI specified");
+			goto exit;
+		}
+	}
 
 exit:
 	return ret;
 }
 
+/*
+ * Log the memory footprint of an object pool.
+ */
+static
+void log_obj_pool(struct lttng_obj_pool *pool)
+{
+	struct lttng_obj_pool_stats stats;
+
+	lttng_obj_pool_get_stats(pool, &stats);
+	DBG("Relay %s pool: %zu bytes per object, %" PRIu64 " allocated "
+			"(%" PRIu64 " recycled), %lu in use at most (%zu bytes), %lu free",
+			pool->name, stats.obj_size, stats.allocs, stats.reuses,
+			stats.max_used, stats.max_used * stats.obj_size, stats.nr_free);
+}
+
 /*
  * Cleanup the daemon
  */
 static
 void cleanup(void)
 {
+	struct lttng_fd_cache_stats stats;
+
 	DBG("Cleaning up");
 
 	/* free the dynamically allocated opt_output_path */
@@ -242,6 +330,29 @@ void cleanup(void)
 
 	uri_free(control_uri);
 	uri_free(data_uri);
+	uri_free(live_uri);
+
+	if (relay_streams_ht) {
+		lttng_ht_destroy(relay_streams_ht);
+	}
+	if (relay_sessions_ht) {
+		lttng_ht_destroy(relay_sessions_ht);
+	}
+
+	lttng_compress_pool_destroy(writer_pool);
+	utils_close_pipe(writer_wakeup_pipe);
+
+	lttng_fd_cache_get_stats(&stream_fd_cache, &stats);
+	DBG("Relay tracefile cache: %" PRIu64 " hits, %" PRIu64 " reopens "
+			"(%" PRIu64 " ns average), %" PRIu64 " closed while idle",
+			stats.hits, stats.reopens,
+			stats.reopens ? stats.reopen_ns / stats.reopens : 0,
+			stats.evictions);
+
+	log_obj_pool(&stream_pool);
+	log_obj_pool(&command_pool);
+	lttng_obj_pool_destroy(&stream_pool);
+	lttng_obj_pool_destroy(&command_pool);
 }
 
 /*
@@ -554,9 +665,8 @@ restart:
 				struct relay_command *relay_cmd;
 				struct lttcomm_sock *newsock;
 
-				relay_cmd = zmalloc(sizeof(struct relay_command));
+				relay_cmd = lttng_obj_pool_zalloc(&command_pool);
 				if (relay_cmd == NULL) {
-					PERROR("relay command zmalloc");
 					goto error;
 				}
 
@@ -564,7 +674,7 @@ restart:
 					newsock = data_sock->ops->accept(data_sock);
 					if (!newsock) {
 						PERROR("accepting data sock");
-						free(relay_cmd);
+						lttng_obj_pool_free(&command_pool, relay_cmd);
 						goto error;
 					}
 					relay_cmd->type = RELAY_DATA;
@@ -574,7 +684,7 @@ restart:
 					newsock = control_sock->ops->accept(control_sock);
 					if (!newsock) {
 						PERROR("accepting control sock");
-						free(relay_cmd);
+						lttng_obj_pool_free(&command_pool, relay_cmd);
 						goto error;
 					}
 					relay_cmd->type = RELAY_CONTROL;
@@ -585,7 +695,7 @@ restart:
 				if (ret < 0) {
 					PERROR("setsockopt inet");
 					lttcomm_destroy_sock(newsock);
-					free(relay_cmd);
+					lttng_obj_pool_free(&command_pool, relay_cmd);
 					goto error;
 				}
 				relay_cmd->sock = newsock;
@@ -669,7 +779,9 @@ void *relay_thread_dispatcher(void *data)
 				ret = write(relay_cmd_pipe[1], relay_cmd,
 						sizeof(struct relay_command));
 			} while (ret < 0 && errno == EINTR);
-			free(relay_cmd);
+			/* The socket now belongs to the copy read by the worker. */
+			relay_cmd->sock = NULL;
+			lttng_obj_pool_free(&command_pool, relay_cmd);
 			if (ret < 0 || ret != sizeof(struct relay_command)) {
 				PERROR("write cmd pipe");
 				goto error;
@@ -714,14 +826,355 @@ end:
 	return ret;
 }
 
+/*
+ * Close the packet index file of a stream, if any.
+ */
+static
+void close_stream_index(struct relay_stream *stream)
+{
+	int ret;
+
+	if (stream->index_fd < 0) {
+		return;
+	}
+
+	ret = close(stream->index_fd);
+	if (ret < 0) {
+		PERROR("close stream index");
+	}
+	stream->index_fd = -1;
+}
+
+/*
+ * Create the packet index file of the current tracefile of a stream. A stream
+ * without index is still written.
+ */
+static
+void create_stream_index(struct relay_stream *stream)
+{
+	int ret;
+
+	ret = index_create_file(-1, stream->path_name, stream->channel_name,
+			stream->tracefile_size, stream->tracefile_count_current, -1, -1);
+	if (ret < 0) {
+		ERR("Unable to create index of stream %s, packets won't be indexed",
+				stream->channel_name);
+		stream->index_fd = -1;
+		return;
+	}
+	stream->index_fd = ret;
+}
+
+/*
+ * Append the index entry of a packet received at the given offset of the
+ * current tracefile.
+ *
+ * The size of the events_discarded field depends on the bitness of the
+ * traced application which is not known by the relayd: the one of the relayd
+ * is assumed.
+ */
+static
+void write_stream_index(struct relay_stream *stream, const char *buf,
+		size_t len, uint64_t offset)
+{
+	int ret;
+	ssize_t hdr_len;
+	struct ctf_packet_index index;
+	char hdr[CTF_PACKET_HEADER_MAX_LEN];
+
+	/* Only the packet header of a compressed packet is needed. */
+	if (lttng_compress_is_frame(buf, len)) {
+		hdr_len = lttng_compress_frame_decode(buf, len, hdr, sizeof(hdr));
+		if (hdr_len < 0) {
+			DBG("Invalid compressed packet in stream %s, not indexed",
+					stream->channel_name);
+			return;
+		}
+		buf = hdr;
+		len = hdr_len;
+	}
+
+	ret = index_packet_parse(buf, len, sizeof(long), offset, &index);
+	if (ret < 0) {
+		DBG("Invalid packet header in stream %s, not indexed",
+				stream->channel_name);
+		return;
+	}
+
+	ret = index_write(stream->index_fd, &index);
+	if (ret < 0) {
+		errno = -ret;
+		PERROR("write index of stream %s", stream->channel_name);
+		close_stream_index(stream);
+	}
+}
+
+/*
+ * Reopen the current tracefile of a stream, closed by the fd cache.
+ */
 static
-void deferred_free_stream(struct rcu_head *head)
+int reopen_stream_fd(struct lttng_fd_cache_entry *entry)
 {
 	struct relay_stream *stream =
-		caa_container_of(head, struct relay_stream, rcu_node);
+		caa_container_of(entry, struct relay_stream, fd_entry);
+
+	DBG3("Reopening tracefile of stream %" PRIu64, stream->stream_handle);
+	return utils_reopen_stream_file(-1, stream->path_name,
+			stream->channel_name, stream->tracefile_size,
+			stream->tracefile_count_current, -1, -1);
+}
+
+/*
+ * Close the tracefile of a stream, removing it from the fd cache first.
+ */
+static
+void close_stream_fd(struct relay_stream *stream)
+{
+	int ret;
+
+	lttng_fd_cache_del(&stream_fd_cache, &stream->fd_entry);
+	if (stream->fd < 0) {
+		return;
+	}
+	ret = close(stream->fd);
+	if (ret < 0) {
+		PERROR("close stream fd");
+	}
+}
+
+/*
+ * Rotate the tracefile of a stream if a packet of the given size doesn't fit
+ * in it, and account for the packet in the current tracefile.
+ *
+ * Return 0 and the offset of the packet in the tracefile, or a negative value
+ * on error.
+ */
+static
+int reserve_stream_packet(struct relay_stream *stream, uint64_t size,
+		uint64_t *offset)
+{
+	int ret;
+
+	if (stream->tracefile_size > 0 &&
+			(stream->tracefile_size_current + size) >
+			stream->tracefile_size) {
+		ret = utils_rotate_stream_file(-1, stream->path_name,
+				stream->channel_name, stream->tracefile_size,
+				stream->tracefile_count, -1, -1,
+				stream->fd, &(stream->tracefile_count_current));
+		if (ret < 0) {
+			ERR("Rotating output file");
+			/* The previous tracefile is closed. */
+			stream->fd = -1;
+			return ret;
+		}
+		stream->fd = ret;
+		/* Reset current size because we just perform a stream rotation. */
+		stream->tracefile_size_current = 0;
+		if (stream->index_fd >= 0) {
+			close_stream_index(stream);
+			create_stream_index(stream);
+		}
+	}
+	*offset = stream->tracefile_size_current;
+	stream->tracefile_size_current += size;
+
+	return 0;
+}
+
+/*
+ * Completion of a write job, called by the writer of the stream lane in the
+ * order the packets were received. A compressed packet is written as a frame
+ * without padding and the index entry describes the uncompressed packet.
+ */
+static
+void write_job_done(struct lttng_compress_job *job)
+{
+	int ret;
+	char *buf;
+	size_t len;
+	uint64_t packet_offset;
+	struct relay_write_job *wjob =
+		caa_container_of(job, struct relay_write_job, job);
+	struct relay_stream *stream = wjob->stream;
+
+	if (job->frame_len < 0) {
+		errno = -job->frame_len;
+		PERROR("Compressing packet of stream %s", stream->channel_name);
+		goto error;
+	}
+
+	if (job->frame) {
+		buf = job->frame;
+		len = job->frame_len;
+	} else {
+		buf = job->src;
+		len = job->src_len;
+	}
+
+	/* The tracefile is reopened if it was closed while idle. */
+	ret = lttng_fd_cache_get(&stream_fd_cache, &stream->fd_entry);
+	if (ret < 0) {
+		ERR("Reopening tracefile of stream %" PRIu64, stream->stream_handle);
+		goto error_put;
+	}
+
+	/* The padding is part of the packet, count it for the index offsets. */
+	ret = reserve_stream_packet(stream, len, &packet_offset);
+	if (ret < 0) {
+		goto error_put;
+	}
+
+	do {
+		ret = write(stream->fd, buf, len);
+	} while (ret < 0 && errno == EINTR);
+	if (ret < 0 || ret != len) {
+		ERR("Relay error writing data to file");
+		goto error_put;
+	}
+
+	DBG2("Relay wrote %d bytes to tracefile for stream id %" PRIu64,
+			ret, stream->stream_handle);
+
+	if (stream->index_fd >= 0) {
+		write_stream_index(stream, job->src, job->src_len, packet_offset);
+	}
+	lttng_fd_cache_put(&stream->fd_entry);
+	goto end;
+
+error_put:
+	lttng_fd_cache_put(&stream->fd_entry);
+error:
+	/* Reported to the data connection by its next packet on the stream. */
+	uatomic_set(&stream->write_error, 1);
+end:
+	free(job->frame);
+	free(job->src);
+	free(wjob);
+}
+
+/*
+ * Lane completion callback, called with the writer pool lock held. Wake up
+ * the worker thread if the stream is throttled and its queue is low enough.
+ */
+static
+void write_lane_completed(struct lttng_compress_lane *lane)
+{
+	int ret;
+	struct relay_stream *stream =
+		caa_container_of(lane, struct relay_stream, write_lane);
+
+	if (!stream_throttle_release(stream, lane->pending)) {
+		return;
+	}
+
+	do {
+		ret = write(writer_wakeup_pipe[1], "!", 1);
+	} while (ret < 0 && errno == EINTR);
+	/* A full pipe already has a wakeup pending. */
+	if (ret < 0 && errno != EAGAIN) {
+		PERROR("write writer wakeup pipe");
+	}
+}
+
+/*
+ * Queue a packet, padding included, on the writer lane of its stream. The
+ * data is copied so the receive buffer can be reused.
+ *
+ * Return 0 on success, 1 if the stream queue is full and the data connection
+ * must be throttled, or else a negative value.
+ */
+static
+int queue_stream_packet(struct relay_stream *stream, const char *buf,
+		uint32_t data_size, uint32_t padding_size)
+{
+	struct relay_write_job *wjob;
+
+	wjob = zmalloc(sizeof(*wjob));
+	if (!wjob) {
+		PERROR("zmalloc write job");
+		return -ENOMEM;
+	}
+
+	/* The padding is zeroed by zmalloc. */
+	wjob->job.src_len = (size_t) data_size + padding_size;
+	wjob->job.src = zmalloc(wjob->job.src_len);
+	if (!wjob->job.src) {
+		PERROR("zmalloc write job packet");
+		free(wjob);
+		return -ENOMEM;
+	}
+	memcpy(wjob->job.src, buf, data_size);
+
+	wjob->job.lane = &stream->write_lane;
+	wjob->job.algo = stream->compression;
+	wjob->job.done = write_job_done;
+	wjob->stream = stream;
+
+	lttng_compress_pool_submit(writer_pool, &wjob->job);
+
+	return stream_throttle_queued(writer_pool, stream);
+}
+
+/*
+ * Bind a data stream to a lane of the writer pool, creating the pool if
+ * needed. On error, the stream is written synchronously and uncompressed.
+ */
+static
+void init_stream_writer(struct relay_stream *stream)
+{
+	long nr_cpus;
+
+	if (!writer_pool) {
+		nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		if (nr_cpus < 1) {
+			nr_cpus = 1;
+		}
+		/* The stream queues are bounded instead of the pool. */
+		writer_pool = lttng_compress_pool_create(nr_cpus, 0);
+		if (!writer_pool) {
+			WARN("Unable to create writer threads, writing stream %s "
+					"synchronously", stream->channel_name);
+			stream->compression = LTTNG_COMPRESSION_NONE;
+			return;
+		}
+	}
+
+	lttng_compress_lane_init(writer_pool, &stream->write_lane,
+			stream->stream_handle);
+	stream->write_lane.completed = write_lane_completed;
+}
+
+/*
+ * Wait for the queued packets of a stream to be written. Must be called
+ * before closing the stream files.
+ */
+static
+void wait_stream_packets(struct relay_stream *stream)
+{
+	if (stream->write_lane.worker) {
+		lttng_compress_lane_wait(writer_pool, &stream->write_lane);
+	}
+}
+
+/*
+ * Free the names of a stream once it is no more read.
+ */
+static
+void release_stream(void *obj)
+{
+	struct relay_stream *stream = obj;
+
 	free(stream->path_name);
 	free(stream->channel_name);
-	free(stream);
+}
+
+static
+void deferred_free_session(struct rcu_head *head)
+{
+	struct relay_session *session =
+		caa_container_of(head, struct relay_session, rcu_node);
+	free(session);
 }
 
 /*
@@ -749,20 +1202,20 @@ void relay_delete_session(struct relay_command *cmd, struct lttng_ht *streams_ht
 			stream = caa_container_of(node,
 					struct relay_stream, stream_n);
 			if (stream->session == cmd->session) {
-				ret = close(stream->fd);
-				if (ret < 0) {
-					PERROR("close stream fd on delete session");
-				}
+				wait_stream_packets(stream);
+				close_stream_fd(stream);
+				close_stream_index(stream);
 				ret = lttng_ht_del(streams_ht, &iter);
 				assert(!ret);
-				call_rcu(&stream->rcu_node,
-					deferred_free_stream);
+				lttng_obj_pool_free_rcu(&stream_pool, stream);
 			}
 		}
 	}
+	iter.iter.node = &cmd->session->session_n.node;
+	ret = lttng_ht_del(relay_sessions_ht, &iter);
+	assert(!ret);
+	call_rcu(&cmd->session->rcu_node, deferred_free_session);
 	rcu_read_unlock();
-
-	free(cmd->session);
 }
 
 /*
@@ -794,6 +1247,12 @@ int relay_create_session(struct lttcomm_relayd_hdr *recv_hdr,
 	session->sock = cmd->sock;
 	cmd->session = session;
 
+	lttng_ht_node_init_ulong(&session->session_n,
+			(unsigned long) session->id);
+	rcu_read_lock();
+	lttng_ht_add_unique_ulong(relay_sessions_ht, &session->session_n);
+	rcu_read_unlock();
+
 	reply.session_id = htobe64(session->id);
 
 	DBG("Created session %" PRIu64, session->id);
@@ -832,21 +1291,26 @@ int relay_add_stream(struct lttcomm_relayd_hdr *recv_hdr,
 		goto end_no_session;
 	}
 
-	stream = zmalloc(sizeof(struct relay_stream));
+	stream = lttng_obj_pool_zalloc(&stream_pool);
 	if (stream == NULL) {
-		PERROR("relay stream zmalloc");
 		ret = -1;
 		goto end_no_session;
 	}
+	stream->fd = -1;
+	stream->index_fd = -1;
+	lttng_fd_cache_entry_init(&stream->fd_entry, &stream->fd, reopen_stream_fd);
 
 	switch (cmd->minor) {
 	case 1: /* LTTng sessiond 2.1 */
 		ret = cmd_recv_stream_2_1(cmd, stream);
 		break;
 	case 2: /* LTTng sessiond 2.2 */
-	default:
 		ret = cmd_recv_stream_2_2(cmd, stream);
 		break;
+	case 3: /* LTTng sessiond with relayd compression */
+	default:
+		ret = cmd_recv_stream_2_3(cmd, stream);
+		break;
 	}
 	if (ret < 0) {
 		goto err_free_stream;
@@ -867,13 +1331,19 @@ int relay_add_stream(struct lttcomm_relayd_hdr *recv_hdr,
 	 * No need to use run_as API here because whatever we receives, the relayd
 	 * uses its own credentials for the stream files.
 	 */
-	ret = utils_create_stream_file(stream->path_name, stream->channel_name,
-			stream->tracefile_size, 0, -1, -1);
+	ret = utils_create_stream_file(-1, stream->path_name,
+			stream->channel_name, stream->tracefile_size, 0, -1, -1);
 	if (ret < 0) {
 		ERR("Create output file");
 		goto end;
 	}
 	stream->fd = ret;
+	lttng_fd_cache_add(&stream_fd_cache, &stream->fd_entry);
+	/* The metadata is received by relay_recv_metadata and is never indexed. */
+	if (strcmp(stream->channel_name, DEFAULT_METADATA_NAME) != 0) {
+		create_stream_index(stream);
+		init_stream_writer(stream);
+	}
 	if (stream->tracefile_size) {
 		DBG("Tracefile %s/%s_0 created", stream->path_name, stream->channel_name);
 	} else {
@@ -893,7 +1363,7 @@ end:
 	if (ret < 0) {
 		reply.ret_code = htobe32(LTTNG_ERR_UNK);
 		/* stream was not properly added to the ht, so free it */
-		free(stream);
+		lttng_obj_pool_free(&stream_pool, stream);
 	} else {
 		reply.ret_code = htobe32(LTTNG_OK);
 	}
@@ -910,9 +1380,7 @@ end_no_session:
 	return ret;
 
 err_free_stream:
-	free(stream->path_name);
-	free(stream->channel_name);
-	free(stream);
+	lttng_obj_pool_free(&stream_pool, stream);
 	return ret;
 }
 
@@ -965,15 +1433,13 @@ int relay_close_stream(struct lttcomm_relayd_hdr *recv_hdr,
 	if (close_stream_check(stream)) {
 		int delret;
 
-		delret = close(stream->fd);
-		if (delret < 0) {
-			PERROR("close stream");
-		}
+		wait_stream_packets(stream);
+		close_stream_fd(stream);
+		close_stream_index(stream);
 		iter.iter.node = &stream->stream_n.node;
 		delret = lttng_ht_del(streams_ht, &iter);
 		assert(!delret);
-		call_rcu(&stream->rcu_node,
-				deferred_free_stream);
+		lttng_obj_pool_free_rcu(&stream_pool, stream);
 		DBG("Closed tracefile %d from close stream", stream->fd);
 	}
 
@@ -1136,6 +1602,13 @@ int relay_recv_metadata(struct lttcomm_relayd_hdr *recv_hdr,
 		goto end_unlock;
 	}
 
+	/* The tracefile is reopened if it was closed while idle. */
+	ret = lttng_fd_cache_get(&stream_fd_cache, &metadata_stream->fd_entry);
+	if (ret < 0) {
+		ERR("Reopening metadata tracefile");
+		goto end_put;
+	}
+
 	do {
 		ret = write(metadata_stream->fd, metadata_struct->payload,
 				payload_size);
@@ -1143,17 +1616,20 @@ int relay_recv_metadata(struct lttcomm_relayd_hdr *recv_hdr,
 	if (ret < 0 || ret != payload_size) {
 		ERR("Relay error writing metadata on file");
 		ret = -1;
-		goto end_unlock;
+		goto end_put;
 	}
 
 	ret = write_padding_to_file(metadata_stream->fd,
 			be32toh(metadata_struct->padding_size));
 	if (ret < 0) {
-		goto end_unlock;
+		goto end_put;
 	}
 
 	DBG2("Relay metadata written");
 
+end_put:
+	lttng_fd_cache_put(&metadata_stream->fd_entry);
+
 end_unlock:
 	rcu_read_unlock();
 end:
@@ -1187,12 +1663,12 @@ int relay_send_version(struct lttcomm_relayd_hdr *recv_hdr,
 		goto end;
 	}
 
-	ret = sscanf(VERSION, "%10u.%10u", &reply.major, &reply.minor);
-	if (ret < 2) {
-		ERR("Error in scanning version");
-		ret = -1;
-		goto end;
-	}
+	/*
+	 * The protocol version, not the one of the package: the protocol can
+	 * move ahead of a release.
+	 */
+	reply.major = RELAYD_VERSION_COMM_MAJOR;
+	reply.minor = RELAYD_VERSION_COMM_MINOR;
 
 	/* Major versions must be the same */
 	if (reply.major != be32toh(msg.major)) {
@@ -1277,8 +1753,9 @@ int relay_data_pending(struct lttcomm_relayd_hdr *recv_hdr,
 
 	/* Avoid wrapping issue */
 	if (((int64_t) (stream->prev_seq - last_net_seq_num)) >= 0) {
-		/* Data has in fact been written and is NOT pending */
-		ret = 0;
+		/* Data has in fact been received, pending until written. */
+		ret = stream->write_lane.worker &&
+			lttng_compress_lane_pending(writer_pool, &stream->write_lane);
 	} else {
 		/* Data still being streamed thus pending */
 		ret = 1;
@@ -1569,8 +2046,8 @@ int relay_process_data(struct relay_command *cmd, struct lttng_ht *streams_ht)
 	struct relay_stream *stream;
 	struct lttcomm_relayd_data_hdr data_hdr;
 	uint64_t stream_id;
-	uint64_t net_seq_num;
-	uint32_t data_size;
+	uint64_t net_seq_num, packet_offset;
+	uint32_t data_size, padding_size;
 
 	ret = cmd->sock->ops->recvmsg(cmd->sock, &data_hdr,
 			sizeof(struct lttcomm_relayd_data_hdr), 0);
@@ -1594,6 +2071,13 @@ int relay_process_data(struct relay_command *cmd, struct lttng_ht *streams_ht)
 		goto end_unlock;
 	}
 
+	if (uatomic_read(&stream->write_error)) {
+		ERR("Previous packets of stream %s could not be written",
+				stream->channel_name);
+		ret = -1;
+		goto end_unlock;
+	}
+
 	data_size = be32toh(data_hdr.data_size);
 	if (data_buffer_size < data_size) {
 		char *tmp_data_ptr;
@@ -1624,58 +2108,81 @@ int relay_process_data(struct relay_command *cmd, struct lttng_ht *streams_ht)
 		goto end_unlock;
 	}
 
-	if (stream->tracefile_size > 0 &&
-			(stream->tracefile_size_current + data_size) >
-			stream->tracefile_size) {
-		ret = utils_rotate_stream_file(stream->path_name,
-				stream->channel_name, stream->tracefile_size,
-				stream->tracefile_count, -1, -1,
-				stream->fd, &(stream->tracefile_count_current));
+	padding_size = be32toh(data_hdr.padding_size);
+
+	/*
+	 * The writer of the stream writes the packet. Stop reading the data
+	 * connection while the stream queue is full.
+	 */
+	if (stream->write_lane.worker) {
+		ret = queue_stream_packet(stream, data_buffer, data_size,
+				padding_size);
 		if (ret < 0) {
-			ERR("Rotating output file");
-			goto end;
+			goto end_unlock;
+		} else if (ret == 1) {
+			DBG("Stream %" PRIu64 " queue full, throttling data connection %d",
+					stream->stream_handle, cmd->sock->fd);
+			cmd->throttled = 1;
+			cmd->throttled_stream = stream->stream_handle;
 		}
-		stream->fd = ret;
-		/* Reset current size because we just perform a stream rotation. */
-		stream->tracefile_size_current = 0;
+		goto end_packet;
+	}
+
+	/* The tracefile is reopened if it was closed while idle. */
+	ret = lttng_fd_cache_get(&stream_fd_cache, &stream->fd_entry);
+	if (ret < 0) {
+		ERR("Reopening tracefile of stream %" PRIu64, stream->stream_handle);
+		goto end_put;
+	}
+
+	/* The padding is part of the packet, count it for the index offsets. */
+	ret = reserve_stream_packet(stream, data_size + padding_size,
+			&packet_offset);
+	if (ret < 0) {
+		goto end_put;
 	}
-	stream->tracefile_size_current += data_size;
 	do {
 		ret = write(stream->fd, data_buffer, data_size);
 	} while (ret < 0 && errno == EINTR);
 	if (ret < 0 || ret != data_size) {
 		ERR("Relay error writing data to file");
 		ret = -1;
-		goto end_unlock;
+		goto end_put;
 	}
 
 	DBG2("Relay wrote %d bytes to tracefile for stream id %" PRIu64,
 			ret, stream->stream_handle);
 
-	ret = write_padding_to_file(stream->fd, be32toh(data_hdr.padding_size));
+	ret = write_padding_to_file(stream->fd, padding_size);
 	if (ret < 0) {
-		goto end_unlock;
+		goto end_put;
 	}
 
+	if (stream->index_fd >= 0) {
+		write_stream_index(stream, data_buffer, data_size, packet_offset);
+	}
+	lttng_fd_cache_put(&stream->fd_entry);
+
+end_packet:
 	stream->prev_seq = net_seq_num;
 
 	/* Check if we need to close the FD */
 	if (close_stream_check(stream)) {
-		int cret;
 		struct lttng_ht_iter iter;
 
-		cret = close(stream->fd);
-		if (cret < 0) {
-			PERROR("close stream process data");
-		}
+		wait_stream_packets(stream);
+		close_stream_fd(stream);
+		close_stream_index(stream);
 		iter.iter.node = &stream->stream_n.node;
 		ret = lttng_ht_del(streams_ht, &iter);
 		assert(!ret);
-		call_rcu(&stream->rcu_node,
-			deferred_free_stream);
+		lttng_obj_pool_free_rcu(&stream_pool, stream);
 		DBG("Closed tracefile %d after recv data", stream->fd);
 	}
+	goto end_unlock;
 
+end_put:
+	lttng_fd_cache_put(&stream->fd_entry);
 end_unlock:
 	rcu_read_unlock();
 end:
@@ -1702,9 +2209,8 @@ int relay_add_connection(int fd, struct lttng_poll_event *events,
 	struct relay_command *relay_connection;
 	int ret;
 
-	relay_connection = zmalloc(sizeof(struct relay_command));
+	relay_connection = lttng_obj_pool_zalloc(&command_pool);
 	if (relay_connection == NULL) {
-		PERROR("Relay command zmalloc");
 		goto error;
 	}
 	do {
@@ -1726,19 +2232,24 @@ int relay_add_connection(int fd, struct lttng_poll_event *events,
 			LPOLLIN | LPOLLRDHUP);
 
 error_read:
-	free(relay_connection);
+	/* Partially read, the socket is not known. */
+	relay_connection->sock = NULL;
+	lttng_obj_pool_free(&command_pool, relay_connection);
 error:
 	return -1;
 }
 
+/*
+ * Destroy the socket of a connection once it is no more read.
+ */
 static
-void deferred_free_connection(struct rcu_head *head)
+void release_connection(void *obj)
 {
-	struct relay_command *relay_connection =
-		caa_container_of(head, struct relay_command, rcu_node);
+	struct relay_command *relay_connection = obj;
 
-	lttcomm_destroy_sock(relay_connection->sock);
-	free(relay_connection);
+	if (relay_connection->sock) {
+		lttcomm_destroy_sock(relay_connection->sock);
+	}
 }
 
 static
@@ -1754,8 +2265,49 @@ void relay_del_connection(struct lttng_ht *relay_connections_ht,
 		relay_delete_session(relay_connection, streams_ht);
 	}
 
-	call_rcu(&relay_connection->rcu_node,
-		deferred_free_connection);
+	lttng_obj_pool_free_rcu(&command_pool, relay_connection);
+}
+
+/*
+ * Drain the writer wakeup pipe and poll again the throttled data connections
+ * whose stream queue went down or whose stream is gone.
+ */
+static
+void relay_resume_connections(struct lttng_poll_event *events,
+		struct lttng_ht *relay_connections_ht, struct lttng_ht *streams_ht)
+{
+	int ret;
+	char buf[64];
+	struct lttng_ht_iter iter;
+	struct relay_command *relay_connection;
+	struct relay_stream *stream;
+
+	do {
+		ret = read(writer_wakeup_pipe[0], buf, sizeof(buf));
+	} while (ret > 0 || (ret < 0 && errno == EINTR));
+
+	rcu_read_lock();
+	cds_lfht_for_each_entry(relay_connections_ht->ht, &iter.iter,
+			relay_connection, sock_n.node) {
+		if (!relay_connection->throttled) {
+			continue;
+		}
+
+		stream = relay_stream_from_stream_id(
+				relay_connection->throttled_stream, streams_ht);
+		if (!stream_throttle_resume(writer_pool, relay_connection, stream)) {
+			continue;
+		}
+
+		DBG("Resuming data connection %d", relay_connection->sock->fd);
+		ret = lttng_poll_add(events, relay_connection->sock->fd,
+				LPOLLIN | LPOLLRDHUP);
+		if (ret < 0) {
+			ERR("Unable to poll again data connection %d",
+					relay_connection->sock->fd);
+		}
+	}
+	rcu_read_unlock();
 }
 
 /*
@@ -1784,13 +2336,10 @@ void *relay_thread_worker(void *data)
 		goto relay_connections_ht_error;
 	}
 
-	/* tables of streams indexed by stream ID */
-	streams_ht = lttng_ht_new(0, LTTNG_HT_TYPE_ULONG);
-	if (!streams_ht) {
-		goto streams_ht_error;
-	}
+	/* Streams indexed by stream ID, shared with the live thread. */
+	streams_ht = relay_streams_ht;
 
-	ret = create_thread_poll_set(&events, 2);
+	ret = create_thread_poll_set(&events, 3);
 	if (ret < 0) {
 		goto error_poll_create;
 	}
@@ -1800,6 +2349,11 @@ void *relay_thread_worker(void *data)
 		goto error;
 	}
 
+	ret = lttng_poll_add(&events, writer_wakeup_pipe[0], LPOLLIN);
+	if (ret < 0) {
+		goto error;
+	}
+
 restart:
 	while (1) {
 		int idx = -1, i, seen_control = 0, last_notdel_data_fd = -1;
@@ -1849,6 +2403,9 @@ restart:
 						goto error;
 					}
 				}
+			} else if (pollfd == writer_wakeup_pipe[0]) {
+				relay_resume_connections(&events, relay_connections_ht,
+						streams_ht);
 			} else if (revents) {
 				rcu_read_lock();
 				lttng_ht_lookup(relay_connections_ht,
@@ -1949,8 +2506,9 @@ restart:
 			uint32_t revents = LTTNG_POLL_GETEV(&events, i);
 			int pollfd = LTTNG_POLL_GETFD(&events, i);
 
-			/* Skip the command pipe. It's handled in the first loop. */
-			if (pollfd == relay_cmd_pipe[0]) {
+			/* Skip the pipes. They are handled in the first loop. */
+			if (pollfd == relay_cmd_pipe[0] ||
+					pollfd == writer_wakeup_pipe[0]) {
 				continue;
 			}
 
@@ -1987,6 +2545,10 @@ restart:
 						 * continue the loop after the connection is deleted.
 						 */
 					} else {
+						/* The writer wakeup pipe resumes it. */
+						if (relay_connection->throttled) {
+							lttng_poll_del(&events, pollfd);
+						}
 						/* Keep last seen port. */
 						last_seen_data_fd = pollfd;
 						rcu_read_unlock();
@@ -2017,8 +2579,6 @@ error:
 	}
 	rcu_read_unlock();
 error_poll_create:
-	lttng_ht_destroy(streams_ht);
-streams_ht_error:
 	lttng_ht_destroy(relay_connections_ht);
 relay_connections_ht_error:
 	/* Close relay cmd pipes */
@@ -2046,6 +2606,32 @@ static int create_relay_cmd_pipe(void)
 	return ret;
 }
 
+/*
+ * Create the pipe used by the writer threads to wake the worker thread. It is
+ * non blocking since it is written with the writer pool lock held.
+ * Closed in cleanup().
+ */
+static int create_writer_wakeup_pipe(void)
+{
+	int ret, i;
+
+	ret = utils_create_pipe_cloexec(writer_wakeup_pipe);
+	if (ret < 0) {
+		goto end;
+	}
+
+	for (i = 0; i < 2; i++) {
+		ret = fcntl(writer_wakeup_pipe[i], F_SETFL, O_NONBLOCK);
+		if (ret < 0) {
+			PERROR("fcntl writer wakeup pipe");
+			goto end;
+		}
+	}
+
+end:
+	return ret;
+}
+
 /*
  * main
  */
@@ -2054,6 +2640,13 @@ int main(int argc, char **argv)
 	int ret = 0;
 	void *status;
 
+	/* Before any exit path, cleanup() logs and destroys them. */
+	lttng_obj_pool_init(&stream_pool, "stream", sizeof(struct relay_stream),
+			DEFAULT_RELAYD_POOL_MAX_FREE, release_stream);
+	lttng_obj_pool_init(&command_pool, "connection",
+			sizeof(struct relay_command), DEFAULT_RELAYD_POOL_MAX_FREE,
+			release_connection);
+
 	/* Create thread quit pipe */
 	if ((ret = init_thread_quit_pipe()) < 0) {
 		goto error;
@@ -2096,7 +2689,8 @@ int main(int argc, char **argv)
 	is_root = !getuid();
 
 	if (!is_root) {
-		if (control_uri->port < 1024 || data_uri->port < 1024) {
+		if (control_uri->port < 1024 || data_uri->port < 1024 ||
+				live_uri->port < 1024) {
 			ERR("Need to be root to use ports < 1024");
 			ret = -1;
 			goto exit;
@@ -2108,9 +2702,29 @@ int main(int argc, char **argv)
 		goto exit;
 	}
 
+	if ((ret = create_writer_wakeup_pipe()) < 0) {
+		goto exit;
+	}
+
 	/* Init relay command queue. */
 	cds_wfq_init(&relay_cmd_queue.queue);
 
+	relay_sessions_ht = lttng_ht_new(0, LTTNG_HT_TYPE_ULONG);
+	if (!relay_sessions_ht) {
+		ret = -1;
+		goto exit;
+	}
+
+	relay_streams_ht = lttng_ht_new(0, LTTNG_HT_TYPE_ULONG);
+	if (!relay_streams_ht) {
+		ret = -1;
+		goto exit;
+	}
+
+	lttng_fd_cache_init(&stream_fd_cache, lttng_fd_cache_default_max());
+	DBG("Relay keeps at most %u tracefiles open (0: no limit)",
+			stream_fd_cache.max_open);
+
 	/* Set up max poll set size */
 	lttng_poll_set_max_size();
 
@@ -2138,6 +2752,15 @@ int main(int argc, char **argv)
 		goto exit_listener;
 	}
 
+	/* Setup the live thread */
+	ret = live_start_threads(live_uri, thread_quit_pipe[0]);
+	if (ret != 0) {
+		ERR("Starting live viewer threads");
+		stop_threads();
+	}
+
+	live_stop_threads();
+
 exit_listener:
 	ret = pthread_join(listener_thread, &status);
 	if (ret != 0) {
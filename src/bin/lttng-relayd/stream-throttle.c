@@ -0,0 +1,96 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include <urcu/uatomic.h>
+
+#include <common/common.h>
+#include <common/defaults.h>
+
+#include "stream-throttle.h"
+
+/*
+ * Flag a stream with a full queue as throttled, unless its queue went below
+ * the low watermark. The stream is flagged before checking its queue so either
+ * the check or the lane completion callback sees the queue going down.
+ *
+ * Return 1 if the stream is throttled else 0.
+ */
+int stream_throttle(struct lttng_compress_pool *pool,
+		struct relay_stream *stream)
+{
+	uatomic_set(&stream->throttled, 1);
+	if (lttng_compress_lane_pending(pool, &stream->write_lane) <=
+			DEFAULT_RELAYD_STREAM_LOW_PACKETS) {
+		uatomic_set(&stream->throttled, 0);
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * Check the queue of a stream after a packet is queued on its lane.
+ *
+ * Return 1 if the queue is full and the data connection must be throttled,
+ * else 0.
+ */
+int stream_throttle_queued(struct lttng_compress_pool *pool,
+		struct relay_stream *stream)
+{
+	if (lttng_compress_lane_pending(pool, &stream->write_lane) <
+			DEFAULT_RELAYD_STREAM_MAX_PACKETS) {
+		return 0;
+	}
+	return stream_throttle(pool, stream);
+}
+
+/*
+ * Called by the lane completion callback, with the pool lock held, with the
+ * packets still pending on the lane of the stream. Unflag a throttled stream
+ * whose queue went below the low watermark.
+ *
+ * Return 1 if the worker thread must be woken up to resume the data
+ * connection, else 0.
+ */
+int stream_throttle_release(struct relay_stream *stream, unsigned int pending)
+{
+	if (!uatomic_read(&stream->throttled) ||
+			pending > DEFAULT_RELAYD_STREAM_LOW_PACKETS) {
+		return 0;
+	}
+
+	uatomic_set(&stream->throttled, 0);
+	return 1;
+}
+
+/*
+ * Resume a throttled data connection if the queue of its stream went down,
+ * or if the stream is gone (NULL).
+ *
+ * Return 1 if the connection must be polled again, else 0.
+ */
+int stream_throttle_resume(struct lttng_compress_pool *pool,
+		struct relay_command *conn, struct relay_stream *stream)
+{
+	if (!conn->throttled) {
+		return 0;
+	}
+	if (stream && stream_throttle(pool, stream)) {
+		return 0;
+	}
+
+	conn->throttled = 0;
+	return 1;
+}
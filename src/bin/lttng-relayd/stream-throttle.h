@@ -0,0 +1,31 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef LTTNG_RELAYD_STREAM_THROTTLE_H
+#define LTTNG_RELAYD_STREAM_THROTTLE_H
+
+#include <common/compress/compress-pool.h>
+
+#include "lttng-relayd.h"
+
+int stream_throttle(struct lttng_compress_pool *pool,
+		struct relay_stream *stream);
+int stream_throttle_queued(struct lttng_compress_pool *pool,
+		struct relay_stream *stream);
+int stream_throttle_release(struct relay_stream *stream, unsigned int pending);
+int stream_throttle_resume(struct lttng_compress_pool *pool,
+		struct relay_command *conn, struct relay_stream *stream);
+
+#endif /* LTTNG_RELAYD_STREAM_THROTTLE_H */
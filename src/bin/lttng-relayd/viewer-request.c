@@ -0,0 +1,94 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include <limits.h>
+
+#include <common/common.h>
+#include <common/compat/endian.h>
+#include <common/defaults.h>
+
+#include "viewer-request.h"
+
+/*
+ * Return the end offset, in bytes, of the packet of an index entry as read
+ * from an index file, or 0 if it overflows.
+ */
+uint64_t viewer_index_entry_end(const struct ctf_packet_index *entry)
+{
+	uint64_t offset, size;
+
+	offset = be64toh(entry->offset);
+	/* In bits in the index. */
+	size = be64toh(entry->packet_size) / CHAR_BIT;
+	if (offset > UINT64_MAX - size) {
+		return 0;
+	}
+
+	return offset + size;
+}
+
+/*
+ * Check a packet request of a viewer: it must be within the packets of the
+ * current tracefile whose index entries were sent, which end at index_end,
+ * and not larger than DEFAULT_RELAYD_VIEWER_PACKET_MAX bytes.
+ *
+ * Return 1 if the request is valid else 0.
+ */
+int viewer_packet_request_valid(uint64_t offset, uint32_t len,
+		uint64_t index_end)
+{
+	if (len == 0 || len > DEFAULT_RELAYD_VIEWER_PACKET_MAX) {
+		return 0;
+	}
+	if (offset > index_end || len > index_end - offset) {
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Check the header of a compressed frame read from a tracefile at the offset
+ * of a valid packet request of len bytes, before the frame is read. It must
+ * decompress to the requested packet and its size must be within the index:
+ * a frame exceeds the packet size of its index entry only if the packet did
+ * not compress, by at most the worst case expansion of the algorithm.
+ *
+ * Return the size of the frame, header included, or 0 if it is invalid.
+ */
+size_t viewer_frame_len(const struct lttng_compress_frame_hdr *hdr,
+		uint64_t offset, uint32_t len, uint64_t index_end)
+{
+	size_t bound, frame_len;
+
+	if (be32toh(hdr->uncompressed_size) != len ||
+			hdr->compressed_size == 0) {
+		return 0;
+	}
+
+	/* 0 for an algorithm this build can not decompress. */
+	bound = lttng_compress_frame_bound(hdr->algo, len);
+	frame_len = sizeof(*hdr) + (size_t) be32toh(hdr->compressed_size);
+	if (bound == 0 || frame_len > bound) {
+		return 0;
+	}
+	if (offset > index_end ||
+			frame_len > index_end - offset + (bound - len)) {
+		return 0;
+	}
+
+	return frame_len;
+}
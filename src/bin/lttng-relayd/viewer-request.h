@@ -0,0 +1,32 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef LTTNG_RELAYD_VIEWER_REQUEST_H
+#define LTTNG_RELAYD_VIEWER_REQUEST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <common/index/ctf-index.h>
+#include <common/compress/compress.h>
+
+uint64_t viewer_index_entry_end(const struct ctf_packet_index *entry);
+int viewer_packet_request_valid(uint64_t offset, uint32_t len,
+		uint64_t index_end);
+size_t viewer_frame_len(const struct lttng_compress_frame_hdr *hdr,
+		uint64_t offset, uint32_t len, uint64_t index_end);
+
+#endif /* LTTNG_RELAYD_VIEWER_REQUEST_H */
@@ -602,6 +602,39 @@ static void rcu_free_buffer_reg_pid(struct rcu_head *head)
 	free(reg);
 }
 
+/*
+ * Ask the consumer to destroy the channels of a buffer registry per UID of a
+ * snapshot session. Their streams are kept by the consumer for the snapshots
+ * so they are not torn down by hanging up.
+ */
+void buffer_reg_uid_destroy_channels(struct buffer_reg_uid *regp,
+		struct consumer_output *consumer)
+{
+	struct lttng_ht_iter iter;
+	struct buffer_reg_channel *reg_chan;
+	struct consumer_socket *socket;
+
+	if (!regp || !consumer) {
+		return;
+	}
+
+	rcu_read_lock();
+	socket = consumer_find_socket_by_bitness(regp->bits_per_long,
+			consumer);
+	if (!socket) {
+		goto end;
+	}
+
+	cds_lfht_for_each_entry(regp->registry->channels->ht, &iter.iter,
+			reg_chan, node.node) {
+		/* Return value does not matter. This call will print errors. */
+		(void) consumer_destroy_channel(socket, reg_chan->consumer_key);
+	}
+
+end:
+	rcu_read_unlock();
+}
+
 /*
  * Destroy buffer registry per UID. The given pointer is NOT removed from any
  * list or hash table. Use buffer_reg_pid_remove() before calling this function
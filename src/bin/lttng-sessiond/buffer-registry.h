@@ -104,6 +104,8 @@ void buffer_reg_uid_add(struct buffer_reg_uid *reg);
 struct buffer_reg_uid *buffer_reg_uid_find(int session_id,
 		uint32_t bits_per_long, uid_t uid);
 void buffer_reg_uid_remove(struct buffer_reg_uid *regp);
+void buffer_reg_uid_destroy_channels(struct buffer_reg_uid *regp,
+		struct consumer_output *consumer);
 void buffer_reg_uid_destroy(struct buffer_reg_uid *regp,
 		struct consumer_output *consumer);
 
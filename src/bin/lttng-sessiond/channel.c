@@ -55,6 +55,8 @@ struct lttng_channel *channel_new_default_attr(int dom,
 	chan->attr.overwrite = DEFAULT_CHANNEL_OVERWRITE;
 	chan->attr.tracefile_size = DEFAULT_CHANNEL_TRACEFILE_SIZE;
 	chan->attr.tracefile_count = DEFAULT_CHANNEL_TRACEFILE_COUNT;
+	chan->attr.compression = DEFAULT_CHANNEL_COMPRESSION;
+	chan->attr.live_timer_interval = DEFAULT_CHANNEL_LIVE_TIMER;
 
 	switch (dom) {
 	case LTTNG_DOMAIN_KERNEL:
@@ -162,6 +164,23 @@ error:
 	return ret;
 }
 
+/*
+ * Force the attributes of a channel of a snapshot session: the buffers are
+ * overwritten and only read by the snapshots, through the mmap output, so
+ * they are never compressed, rotated nor flushed for live reading.
+ */
+static void set_snapshot_attr(struct lttng_channel *attr)
+{
+	DBG("Channel %s in snapshot mode, forcing overwrite and mmap output",
+			attr->name);
+	attr->attr.overwrite = 1;
+	attr->attr.output = LTTNG_EVENT_MMAP;
+	attr->attr.compression = LTTNG_COMPRESSION_NONE;
+	attr->attr.tracefile_size = 0;
+	attr->attr.tracefile_count = 0;
+	attr->attr.live_timer_interval = 0;
+}
+
 /*
  * Create kernel channel of the kernel session and notify kernel thread.
  */
@@ -184,6 +203,20 @@ int channel_kernel_create(struct ltt_kernel_session *ksession,
 		attr = defattr;
 	}
 
+	if (ksession->snapshot_mode) {
+		set_snapshot_attr(attr);
+	}
+
+	/*
+	 * Packets are compressed from a copy of the sub-buffer made through the
+	 * mmap of the stream, spliced packets never reach the consumer memory.
+	 */
+	if (attr->attr.compression != LTTNG_COMPRESSION_NONE &&
+			attr->attr.output != LTTNG_EVENT_MMAP) {
+		DBG("Kernel channel %s compressed, using the mmap output", attr->name);
+		attr->attr.output = LTTNG_EVENT_MMAP;
+	}
+
 	/* Channel not found, creating it */
 	ret = kernel_create_channel(ksession, attr);
 	if (ret < 0) {
@@ -263,6 +296,10 @@ int channel_ust_create(struct ltt_ust_session *usess,
 		attr = defattr;
 	}
 
+	if (usess->snapshot_mode) {
+		set_snapshot_attr(attr);
+	}
+
 	/*
 	 * Validate UST buffer size and number of buffers: must both be power of 2
 	 * and nonzero. We validate right here for UST, because applications will
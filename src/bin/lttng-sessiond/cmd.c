@@ -17,6 +17,7 @@
 
 #define _GNU_SOURCE
 #include <assert.h>
+#include <fnmatch.h>
 #include <urcu/list.h>
 #include <urcu/uatomic.h>
 
@@ -24,6 +25,7 @@
 #include <common/common.h>
 #include <common/sessiond-comm/sessiond-comm.h>
 #include <common/relayd/relayd.h>
+#include <common/compress/compress.h>
 
 #include "channel.h"
 #include "consumer.h"
@@ -45,6 +47,9 @@
 static pthread_mutex_t relayd_net_seq_idx_lock = PTHREAD_MUTEX_INITIALIZER;
 static uint64_t relayd_net_seq_idx;
 
+/* Data connections opened to the relayd of a consumer output. */
+static unsigned int relayd_data_connections = DEFAULT_RELAYD_DATA_CONNECTIONS;
+
 /*
  * Create a session path used by list_lttng_sessions for the case that the
  * session consumer is on the network.
@@ -163,6 +168,8 @@ static void list_lttng_channels(int domain, struct ltt_session *session,
 				uchan->attr.switch_timer_interval;
 			channels[i].attr.read_timer_interval =
 				uchan->attr.read_timer_interval;
+			channels[i].attr.compression = uchan->compression;
+			channels[i].attr.live_timer_interval = uchan->live_timer_interval;
 			channels[i].enabled = uchan->enabled;
 			switch (uchan->attr.output) {
 			case LTTNG_UST_MMAP:
@@ -624,6 +631,7 @@ static int send_consumer_relayd_sockets(int domain,
 		struct consumer_socket *sock)
 {
 	int ret = LTTNG_OK;
+	unsigned int i;
 
 	assert(session);
 	assert(consumer);
@@ -637,12 +645,17 @@ static int send_consumer_relayd_sockets(int domain,
 		}
 	}
 
-	/* Sending data relayd socket. */
+	/*
+	 * Sending data relayd sockets. The consumer spreads the streams over the
+	 * data connections, all of them being sent before any stream.
+	 */
 	if (!sock->data_sock_sent) {
-		ret = send_consumer_relayd_socket(domain, session,
-				&consumer->dst.net.data, consumer, sock);
-		if (ret != LTTNG_OK) {
-			goto error;
+		for (i = 0; i < relayd_data_connections; i++) {
+			ret = send_consumer_relayd_socket(domain, session,
+					&consumer->dst.net.data, consumer, sock);
+			if (ret != LTTNG_OK) {
+				goto error;
+			}
 		}
 	}
 
@@ -858,6 +871,11 @@ int cmd_enable_channel(struct ltt_session *session,
 
 	rcu_read_lock();
 
+	if (!lttng_compress_supported(attr->attr.compression)) {
+		ret = LTTNG_ERR_NOT_SUPPORTED;
+		goto error;
+	}
+
 	switch (domain->type) {
 	case LTTNG_DOMAIN_KERNEL:
 	{
@@ -1449,6 +1467,148 @@ error:
 	return -ret;
 }
 
+/*
+ * Order tracepoints by PID and then by name and loglevel.
+ */
+static int compare_tracepoint_pid_name(const void *a, const void *b)
+{
+	int ret;
+	const struct lttng_event *ev_a = a, *ev_b = b;
+
+	if (ev_a->pid != ev_b->pid) {
+		return ev_a->pid < ev_b->pid ? -1 : 1;
+	}
+	ret = strncmp(ev_a->name, ev_b->name, sizeof(ev_a->name));
+	if (ret) {
+		return ret;
+	}
+	return ev_a->loglevel - ev_b->loglevel;
+}
+
+/*
+ * Order tracepoints by name and loglevel regardless of the PID.
+ */
+static int compare_tracepoint_name(const void *a, const void *b)
+{
+	int ret;
+	const struct lttng_event *ev_a = a, *ev_b = b;
+
+	ret = strncmp(ev_a->name, ev_b->name, sizeof(ev_a->name));
+	if (ret) {
+		return ret;
+	}
+	return ev_a->loglevel - ev_b->loglevel;
+}
+
+/*
+ * Apply the query to the nb_events entries of the events array in place:
+ * filter on name, sort, merge duplicates and paginate.
+ *
+ * Return the resulting number of entries.
+ */
+static size_t apply_tracepoint_query(struct lttng_tracepoint_query *query,
+		struct lttng_event *events, size_t nb_events)
+{
+	size_t i, count = 0;
+
+	/* Name filtering, only needed when not done by the tracer side. */
+	for (i = 0; i < nb_events; i++) {
+		if (query->name[0] != '\0' &&
+				fnmatch(query->name, events[i].name, 0) != 0) {
+			continue;
+		}
+		if (i != count) {
+			memcpy(&events[count], &events[i], sizeof(events[i]));
+		}
+		count++;
+	}
+	nb_events = count;
+
+	if (query->merge_duplicates) {
+		qsort(events, nb_events, sizeof(*events), compare_tracepoint_name);
+		count = 0;
+		for (i = 0; i < nb_events; i++) {
+			if (count > 0 &&
+					!compare_tracepoint_name(&events[count - 1], &events[i])) {
+				continue;
+			}
+			if (i != count) {
+				memcpy(&events[count], &events[i], sizeof(events[i]));
+			}
+			events[count].pid = 0;
+			count++;
+		}
+		nb_events = count;
+	} else {
+		qsort(events, nb_events, sizeof(*events), compare_tracepoint_pid_name);
+	}
+
+	if (query->offset >= nb_events) {
+		return 0;
+	}
+	nb_events -= query->offset;
+	if (query->offset) {
+		memmove(events, &events[query->offset], nb_events * sizeof(*events));
+	}
+	if (query->count && query->count < nb_events) {
+		nb_events = query->count;
+	}
+
+	return nb_events;
+}
+
+/*
+ * Command LTTNG_LIST_TRACEPOINTS_QUERY processed by the client thread.
+ *
+ * The UST tracepoints come from the cached catalogue of the applications,
+ * filtered by PID and name while being collected.
+ */
+ssize_t cmd_list_tracepoints_query(int domain,
+		struct lttng_tracepoint_query *query, struct lttng_event **events)
+{
+	int ret;
+	ssize_t nb_events = 0;
+
+	assert(query);
+
+	/* Make sure the pattern is NULL terminated. */
+	query->name[sizeof(query->name) - 1] = '\0';
+
+	switch (domain) {
+	case LTTNG_DOMAIN_KERNEL:
+		if (query->pid != 0) {
+			/* The kernel tracepoints are not owned by any process. */
+			ret = LTTNG_ERR_INVALID;
+			goto error;
+		}
+		nb_events = kernel_list_events(kernel_tracer_fd, events);
+		if (nb_events < 0) {
+			ret = LTTNG_ERR_KERN_LIST_FAIL;
+			goto error;
+		}
+		break;
+	case LTTNG_DOMAIN_UST:
+		nb_events = ust_app_list_events_cached(query->pid, query->name,
+				events);
+		if (nb_events < 0) {
+			ret = LTTNG_ERR_UST_LIST_FAIL;
+			goto error;
+		}
+		break;
+	default:
+		ret = LTTNG_ERR_UND;
+		goto error;
+	}
+
+	nb_events = apply_tracepoint_query(query, *events, nb_events);
+
+	return nb_events;
+
+error:
+	/* Return negative value to differentiate return code */
+	return -ret;
+}
+
 /*
  * Command LTTNG_LIST_TRACEPOINT_FIELDS processed by the client thread.
  */
@@ -1514,6 +1674,9 @@ int cmd_start_trace(struct ltt_session *session)
 	if (usess) {
 		usess->start_trace = 1;
 
+		/* Per UID buffers of the expected users, before their apps start. */
+		ust_app_provision_uid_buffers(usess);
+
 		ret = ust_app_start_trace_all(usess);
 		if (ret < 0) {
 			ret = LTTNG_ERR_UST_START_FAIL;
@@ -1591,6 +1754,9 @@ int cmd_stop_trace(struct ltt_session *session)
 			ret = LTTNG_ERR_UST_STOP_FAIL;
 			goto error;
 		}
+
+		/* Metadata of the applications that exited while tracing. */
+		ust_app_reclaim_flush();
 	}
 
 	session->started = 0;
@@ -1665,10 +1831,11 @@ error:
 }
 
 /*
- * Command LTTNG_CREATE_SESSION processed by the client thread.
+ * Command LTTNG_CREATE_SESSION and LTTNG_CREATE_SESSION_SNAPSHOT processed by
+ * the client thread.
  */
 int cmd_create_session_uri(char *name, struct lttng_uri *uris,
-		size_t nb_uri, lttng_sock_cred *creds)
+		size_t nb_uri, lttng_sock_cred *creds, int snapshot_mode)
 {
 	int ret;
 	struct ltt_session *session;
@@ -1710,6 +1877,7 @@ int cmd_create_session_uri(char *name, struct lttng_uri *uris,
 	 */
 	session = session_find_by_name(name);
 	assert(session);
+	session->snapshot_mode = snapshot_mode;
 
 	/* Create default consumer output for the session not yet created. */
 	session->consumer = consumer_create_output(CONSUMER_DST_LOCAL);
@@ -1754,6 +1922,9 @@ int cmd_destroy_session(struct ltt_session *session, int wpipe)
 
 	/* UST session teardown */
 	if (usess) {
+		/* The exited applications still use the session consumer. */
+		ust_app_reclaim_flush();
+
 		/* Close any relayd session */
 		consumer_output_send_destroy_relayd(usess->consumer);
 
@@ -2116,6 +2287,9 @@ int cmd_data_pending(struct ltt_session *session)
 	}
 
 	if (usess && usess->consumer) {
+		/* The last metadata of the exited applications is pushed first. */
+		ust_app_reclaim_flush();
+
 		ret = consumer_is_data_pending(usess->id, usess->consumer);
 		if (ret == 1) {
 			/* Data is still being extracted for the kernel. */
@@ -2130,11 +2304,198 @@ error:
 	return ret;
 }
 
+/*
+ * Build in path the output directory of a domain for a snapshot named name,
+ * below the session output: a local directory or a path relative to the
+ * relayd trace directory.
+ */
+static int get_snapshot_path(struct consumer_output *consumer,
+		const char *name, const char *dir_name, char *path, size_t len)
+{
+	int ret;
+
+	if (consumer->type == CONSUMER_DST_LOCAL) {
+		ret = snprintf(path, len, "%s%s/%s%s", consumer->dst.trace_path,
+				consumer->subdir, name, dir_name);
+	} else {
+		ret = snprintf(path, len, "%s/%s%s", consumer->subdir, name,
+				dir_name);
+	}
+	if (ret < 0) {
+		PERROR("snprintf snapshot path");
+	} else if ((size_t) ret >= len) {
+		ERR("Snapshot path too long");
+		ret = -1;
+	}
+
+	return ret;
+}
+
+/*
+ * Command LTTNG_SNAPSHOT_RECORD processed by the client thread.
+ *
+ * Record the buffers of every stream of a snapshot session in a new snapshot
+ * below the session output, without stopping tracing. An empty name gets a
+ * generated one and max_size bounds the bytes recorded per stream, 0 meaning
+ * the whole buffers.
+ */
+int cmd_snapshot_record(struct ltt_session *session, const char *name,
+		uint64_t max_size)
+{
+	int ret;
+	char snapshot_name[NAME_MAX], path[PATH_MAX], datetime[16];
+	time_t rawtime;
+	struct tm *timeinfo;
+	struct ltt_kernel_session *ksess = session->kernel_session;
+	struct ltt_ust_session *usess = session->ust_session;
+
+	assert(session);
+	assert(name);
+
+	if (!session->snapshot_mode) {
+		ret = LTTNG_ERR_NOT_SNAPSHOT_SESSION;
+		goto error;
+	}
+
+	if (!session->consumer) {
+		ret = LTTNG_ERR_NO_CONSUMER;
+		goto error;
+	}
+
+	if (name[0] == '\0') {
+		time(&rawtime);
+		timeinfo = localtime(&rawtime);
+		strftime(datetime, sizeof(datetime), "%Y%m%d-%H%M%S", timeinfo);
+		ret = snprintf(snapshot_name, sizeof(snapshot_name),
+				DEFAULT_SNAPSHOT_NAME "-%u-%s", session->snapshot_seq,
+				datetime);
+	} else {
+		ret = snprintf(snapshot_name, sizeof(snapshot_name), "%s", name);
+	}
+	if (ret < 0) {
+		PERROR("snprintf snapshot name");
+		ret = LTTNG_ERR_FATAL;
+		goto error;
+	}
+	/* The name is a directory of the output, it must not escape it. */
+	if (strchr(snapshot_name, '/') || !strcmp(snapshot_name, ".") ||
+			!strcmp(snapshot_name, "..")) {
+		ret = LTTNG_ERR_INVALID;
+		goto error;
+	}
+
+	DBG("Recording snapshot %s of session %s", snapshot_name, session->name);
+
+	/* The streams are sent to the consumer when tracing starts. */
+	if (ksess && ksess->consumer_fds_sent) {
+		ret = get_snapshot_path(session->consumer, snapshot_name,
+				DEFAULT_KERNEL_TRACE_DIR, path, sizeof(path));
+		if (ret < 0) {
+			ret = LTTNG_ERR_SNAPSHOT_FAIL;
+			goto error;
+		}
+
+		if (ksess->consumer->type == CONSUMER_DST_LOCAL) {
+			ret = run_as_mkdir_recursive(path, S_IRWXU | S_IRWXG,
+					session->uid, session->gid);
+			if (ret < 0 && ret != -EEXIST) {
+				ERR("Snapshot directory creation error");
+				ret = LTTNG_ERR_SNAPSHOT_FAIL;
+				goto error;
+			}
+		}
+
+		ret = kernel_snapshot_record(ksess, path, max_size);
+		if (ret < 0) {
+			ret = LTTNG_ERR_SNAPSHOT_FAIL;
+			goto error;
+		}
+	}
+
+	if (usess) {
+		ret = get_snapshot_path(session->consumer, snapshot_name,
+				DEFAULT_UST_TRACE_DIR, path, sizeof(path));
+		if (ret < 0) {
+			ret = LTTNG_ERR_SNAPSHOT_FAIL;
+			goto error;
+		}
+
+		ret = ust_app_snapshot_record(usess, path, max_size);
+		if (ret < 0) {
+			ret = LTTNG_ERR_SNAPSHOT_FAIL;
+			goto error;
+		}
+	}
+
+	session->snapshot_seq++;
+	ret = LTTNG_OK;
+
+error:
+	return ret;
+}
+
+/*
+ * Command LTTNG_SET_PROVISION_UIDS processed by the client thread.
+ *
+ * Set the UIDs of which the per UID buffers of the session are created when
+ * tracing starts, ahead of their applications. The list replaces the previous
+ * one, buffers already provisioned are kept.
+ */
+int cmd_set_provision_uids(int domain, struct ltt_session *session,
+		const uint32_t *uids, unsigned int count)
+{
+	int ret;
+	unsigned int i;
+	struct ltt_ust_session *usess = session->ust_session;
+
+	assert(session);
+	assert(uids);
+
+	switch (domain) {
+	case LTTNG_DOMAIN_UST:
+		break;
+	default:
+		ret = LTTNG_ERR_UNKNOWN_DOMAIN;
+		goto error;
+	}
+
+	if (count > DEFAULT_UST_PROVISION_UIDS_MAX) {
+		ret = LTTNG_ERR_INVALID;
+		goto error;
+	}
+
+	/* The buffer type is set by the first channel of the session. */
+	if (usess->buffer_type != LTTNG_BUFFER_PER_UID) {
+		ret = LTTNG_ERR_BUFFER_TYPE_MISMATCH;
+		goto error;
+	}
+
+	for (i = 0; i < count; i++) {
+		usess->provision_uids[i] = (uid_t) uids[i];
+	}
+	usess->nb_provision_uids = count;
+
+	DBG("Session %s provisions the per UID buffers of %u uid(s)",
+			session->name, count);
+
+	if (session->enabled) {
+		ust_app_provision_uid_buffers(usess);
+	}
+
+	ret = LTTNG_OK;
+
+error:
+	return ret;
+}
+
 /*
  * Init command subsystem.
  */
 void cmd_init(void)
 {
+	char *env;
+	unsigned long nb;
+
 	/*
 	 * Set network sequence index to 1 for streams to match a relayd
 	 * socket on the consumer side.
@@ -2143,5 +2504,17 @@ void cmd_init(void)
 	relayd_net_seq_idx = 1;
 	pthread_mutex_unlock(&relayd_net_seq_idx_lock);
 
+	env = getenv(DEFAULT_RELAYD_DATA_CONNECTIONS_ENV);
+	if (env) {
+		nb = strtoul(env, NULL, 10);
+		if (nb >= 1 && nb <= DEFAULT_RELAYD_MAX_DATA_CONNECTIONS) {
+			relayd_data_connections = nb;
+		} else {
+			WARN("Invalid %s value %s, using %u data connection(s)",
+					DEFAULT_RELAYD_DATA_CONNECTIONS_ENV, env,
+					relayd_data_connections);
+		}
+	}
+
 	DBG("Command subsystem initialized");
 }
@@ -29,8 +29,12 @@ void cmd_init(void);
 
 /* Session commands */
 int cmd_create_session_uri(char *name, struct lttng_uri *uris,
-		size_t nb_uri, lttng_sock_cred *creds);
+		size_t nb_uri, lttng_sock_cred *creds, int snapshot_mode);
 int cmd_destroy_session(struct ltt_session *session, int wpipe);
+int cmd_snapshot_record(struct ltt_session *session, const char *name,
+		uint64_t max_size);
+int cmd_set_provision_uids(int domain, struct ltt_session *session,
+		const uint32_t *uids, unsigned int count);
 
 /* Channel commands */
 int cmd_disable_channel(struct ltt_session *session, int domain,
@@ -81,6 +85,8 @@ void cmd_list_lttng_sessions(struct lttng_session *sessions, uid_t uid,
 ssize_t cmd_list_tracepoint_fields(int domain,
 		struct lttng_event_field **fields);
 ssize_t cmd_list_tracepoints(int domain, struct lttng_event **events);
+ssize_t cmd_list_tracepoints_query(int domain,
+		struct lttng_tracepoint_query *query, struct lttng_event **events);
 
 int cmd_calibrate(int domain, struct lttng_calibrate *calibrate);
 int cmd_data_pending(struct ltt_session *session);
@@ -31,6 +31,7 @@
 
 #include "consumer.h"
 #include "health.h"
+#include "stats.h"
 #include "ust-app.h"
 
 /*
@@ -591,11 +592,13 @@ error:
 int consumer_send_fds(struct consumer_socket *sock, int *fds, size_t nb_fd)
 {
 	int ret;
+	struct timespec start;
 
 	assert(fds);
 	assert(sock);
 	assert(nb_fd > 0);
 
+	stats_time_begin(&start);
 	ret = lttcomm_send_fds_unix_sock(sock->fd, fds, nb_fd);
 	if (ret < 0) {
 		/* The above call will print a PERROR on error. */
@@ -604,6 +607,7 @@ int consumer_send_fds(struct consumer_socket *sock, int *fds, size_t nb_fd)
 	}
 
 	ret = consumer_recv_status_reply(sock);
+	(void) stats_record(STATS_CONSUMER_CMD, &start);
 
 error:
 	return ret;
@@ -616,11 +620,13 @@ int consumer_send_msg(struct consumer_socket *sock,
 		struct lttcomm_consumer_msg *msg)
 {
 	int ret;
+	struct timespec start;
 
 	assert(msg);
 	assert(sock);
 	assert(sock->fd >= 0);
 
+	stats_time_begin(&start);
 	ret = lttcomm_send_unix_sock(sock->fd, msg,
 			sizeof(struct lttcomm_consumer_msg));
 	if (ret < 0) {
@@ -630,6 +636,7 @@ int consumer_send_msg(struct consumer_socket *sock,
 	}
 
 	ret = consumer_recv_status_reply(sock);
+	(void) stats_record(STATS_CONSUMER_CMD, &start);
 
 error:
 	return ret;
@@ -642,11 +649,13 @@ int consumer_send_channel(struct consumer_socket *sock,
 		struct lttcomm_consumer_msg *msg)
 {
 	int ret;
+	struct timespec start;
 
 	assert(msg);
 	assert(sock);
 	assert(sock->fd >= 0);
 
+	stats_time_begin(&start);
 	ret = lttcomm_send_unix_sock(sock->fd, msg,
 			sizeof(struct lttcomm_consumer_msg));
 	if (ret < 0) {
@@ -656,6 +665,7 @@ int consumer_send_channel(struct consumer_socket *sock,
 	}
 
 	ret = consumer_recv_status_reply(sock);
+	(void) stats_record(STATS_CONSUMER_CMD, &start);
 
 error:
 	return ret;
@@ -683,7 +693,10 @@ void consumer_init_ask_channel_comm_msg(struct lttcomm_consumer_msg *msg,
 		unsigned char *uuid,
 		uint32_t chan_id,
 		uint64_t tracefile_size,
-		uint64_t tracefile_count)
+		uint64_t tracefile_count,
+		enum lttng_compression compression,
+		unsigned int live_timer_interval,
+		int monitor)
 {
 	assert(msg);
 
@@ -706,6 +719,9 @@ void consumer_init_ask_channel_comm_msg(struct lttcomm_consumer_msg *msg,
 	msg->u.ask_channel.chan_id = chan_id;
 	msg->u.ask_channel.tracefile_size = tracefile_size;
 	msg->u.ask_channel.tracefile_count = tracefile_count;
+	msg->u.ask_channel.compression = compression;
+	msg->u.ask_channel.live_timer_interval = live_timer_interval;
+	msg->u.ask_channel.monitor = monitor;
 
 	memcpy(msg->u.ask_channel.uuid, uuid, sizeof(msg->u.ask_channel.uuid));
 
@@ -733,7 +749,10 @@ void consumer_init_channel_comm_msg(struct lttcomm_consumer_msg *msg,
 		enum lttng_event_output output,
 		int type,
 		uint64_t tracefile_size,
-		uint64_t tracefile_count)
+		uint64_t tracefile_count,
+		enum lttng_compression compression,
+		unsigned int live_timer_interval,
+		int monitor)
 {
 	assert(msg);
 
@@ -752,6 +771,9 @@ void consumer_init_channel_comm_msg(struct lttcomm_consumer_msg *msg,
 	msg->u.channel.type = type;
 	msg->u.channel.tracefile_size = tracefile_size;
 	msg->u.channel.tracefile_count = tracefile_count;
+	msg->u.channel.compression = compression;
+	msg->u.channel.live_timer_interval = live_timer_interval;
+	msg->u.channel.monitor = monitor;
 
 	strncpy(msg->u.channel.pathname, pathname,
 			sizeof(msg->u.channel.pathname));
@@ -780,6 +802,43 @@ void consumer_init_stream_comm_msg(struct lttcomm_consumer_msg *msg,
 	msg->u.stream.cpu = cpu;
 }
 
+/*
+ * Init the communication message of a batch of streams of a channel. The
+ * streams are added with consumer_add_streams_comm_msg().
+ */
+void consumer_init_streams_comm_msg(struct lttcomm_consumer_msg *msg,
+		uint64_t channel_key)
+{
+	assert(msg);
+
+	memset(msg, 0, sizeof(struct lttcomm_consumer_msg));
+
+	msg->cmd_type = LTTNG_CONSUMER_ADD_STREAMS;
+	msg->u.streams.channel_key = channel_key;
+}
+
+/*
+ * Add the stream of a CPU to a batch message, its fd being stored at the same
+ * index of fds.
+ *
+ * Return 1 when the batch is full and must be sent, else 0.
+ */
+int consumer_add_streams_comm_msg(struct lttcomm_consumer_msg *msg,
+		int *fds, int fd, int cpu)
+{
+	uint32_t i;
+
+	assert(msg);
+	assert(fds);
+	assert(msg->u.streams.nb_streams < LTTCOMM_MAX_SEND_FDS);
+
+	i = msg->u.streams.nb_streams++;
+	msg->u.streams.cpus[i] = cpu;
+	fds[i] = fd;
+
+	return msg->u.streams.nb_streams == LTTCOMM_MAX_SEND_FDS;
+}
+
 /*
  * Send stream communication structure to the consumer.
  */
@@ -788,6 +847,7 @@ int consumer_send_stream(struct consumer_socket *sock,
 		int *fds, size_t nb_fd)
 {
 	int ret;
+	struct timespec start;
 
 	assert(msg);
 	assert(dst);
@@ -795,6 +855,7 @@ int consumer_send_stream(struct consumer_socket *sock,
 	assert(fds);
 
 	/* Send on socket */
+	stats_time_begin(&start);
 	ret = lttcomm_send_unix_sock(sock->fd, msg,
 			sizeof(struct lttcomm_consumer_msg));
 	if (ret < 0) {
@@ -804,6 +865,7 @@ int consumer_send_stream(struct consumer_socket *sock,
 	}
 
 	ret = consumer_recv_status_reply(sock);
+	(void) stats_record(STATS_CONSUMER_CMD, &start);
 	if (ret < 0) {
 		goto error;
 	}
@@ -939,6 +1001,7 @@ int consumer_is_data_pending(uint64_t session_id,
 	struct consumer_socket *socket;
 	struct lttng_ht_iter iter;
 	struct lttcomm_consumer_msg msg;
+	struct timespec start;
 
 	assert(consumer);
 
@@ -957,6 +1020,7 @@ int consumer_is_data_pending(uint64_t session_id,
 
 		pthread_mutex_lock(socket->lock);
 
+		stats_time_begin(&start);
 		ret = lttcomm_send_unix_sock(socket->fd, &msg, sizeof(msg));
 		if (ret < 0) {
 			/* The above call will print a PERROR on error. */
@@ -971,6 +1035,7 @@ int consumer_is_data_pending(uint64_t session_id,
 		 */
 
 		ret = lttcomm_recv_unix_sock(socket->fd, &ret_code, sizeof(ret_code));
+		(void) stats_record(STATS_CONSUMER_CMD, &start);
 		if (ret <= 0) {
 			if (ret == 0) {
 				/* Orderly shutdown. Don't return 0 which means success. */
@@ -1031,6 +1096,91 @@ end:
 	return ret;
 }
 
+/*
+ * Send a destroy channel command to consumer using the given channel key. Used
+ * for the channels of snapshot sessions which are not torn down by their
+ * streams hanging up.
+ *
+ * Return 0 on success else a negative value.
+ */
+int consumer_destroy_channel(struct consumer_socket *socket, uint64_t key)
+{
+	int ret;
+	struct lttcomm_consumer_msg msg;
+
+	assert(socket);
+	assert(socket->fd >= 0);
+
+	DBG2("Consumer destroy channel key %" PRIu64, key);
+
+	msg.cmd_type = LTTNG_CONSUMER_DESTROY_CHANNEL;
+	msg.u.destroy_channel.key = key;
+
+	pthread_mutex_lock(socket->lock);
+	health_code_update();
+
+	ret = consumer_send_msg(socket, &msg);
+	if (ret < 0) {
+		goto end;
+	}
+
+end:
+	health_code_update();
+	pthread_mutex_unlock(socket->lock);
+	return ret;
+}
+
+/*
+ * Ask the consumer to record a snapshot of the buffers of a channel in the
+ * path of the given output: a directory for a local output or a path
+ * relative to the relayd trace directory for a network output. max_stream_size
+ * bounds the bytes recorded per stream, 0 meaning the whole buffers.
+ *
+ * Return 0 on success else a negative value.
+ */
+int consumer_snapshot_channel(struct consumer_socket *socket, uint64_t key,
+		struct consumer_output *output, int metadata, const char *path,
+		uint64_t max_stream_size)
+{
+	int ret;
+	struct lttcomm_consumer_msg msg;
+
+	assert(socket);
+	assert(socket->fd >= 0);
+	assert(output);
+	assert(path);
+
+	DBG2("Consumer snapshot channel key %" PRIu64 " in %s", key, path);
+
+	memset(&msg, 0, sizeof(msg));
+	msg.cmd_type = LTTNG_CONSUMER_SNAPSHOT_CHANNEL;
+	msg.u.snapshot_channel.key = key;
+	msg.u.snapshot_channel.metadata = metadata;
+	msg.u.snapshot_channel.max_stream_size = max_stream_size;
+	if (output->type == CONSUMER_DST_NET) {
+		msg.u.snapshot_channel.relayd_id = output->net_seq_index;
+	} else {
+		msg.u.snapshot_channel.relayd_id = (uint64_t) -1ULL;
+	}
+	strncpy(msg.u.snapshot_channel.pathname, path,
+			sizeof(msg.u.snapshot_channel.pathname));
+	msg.u.snapshot_channel.pathname[
+			sizeof(msg.u.snapshot_channel.pathname) - 1] = '\0';
+
+	pthread_mutex_lock(socket->lock);
+	health_code_update();
+
+	ret = consumer_send_msg(socket, &msg);
+	if (ret < 0) {
+		goto end;
+	}
+
+end:
+	health_code_update();
+	pthread_mutex_unlock(socket->lock);
+	return ret;
+}
+
 /*
  * Send a close metdata command to consumer using the given channel key.
  *
@@ -202,12 +202,19 @@ void consumer_init_ask_channel_comm_msg(struct lttcomm_consumer_msg *msg,
 		unsigned char *uuid,
 		uint32_t chan_id,
 		uint64_t tracefile_size,
-		uint64_t tracefile_count);
+		uint64_t tracefile_count,
+		enum lttng_compression compression,
+		unsigned int live_timer_interval,
+		int monitor);
 void consumer_init_stream_comm_msg(struct lttcomm_consumer_msg *msg,
 		enum lttng_consumer_command cmd,
 		uint64_t channel_key,
 		uint64_t stream_key,
 		int cpu);
+void consumer_init_streams_comm_msg(struct lttcomm_consumer_msg *msg,
+		uint64_t channel_key);
+int consumer_add_streams_comm_msg(struct lttcomm_consumer_msg *msg,
+		int *fds, int fd, int cpu);
 void consumer_init_channel_comm_msg(struct lttcomm_consumer_msg *msg,
 		enum lttng_consumer_command cmd,
 		uint64_t channel_key,
@@ -221,7 +228,10 @@ void consumer_init_channel_comm_msg(struct lttcomm_consumer_msg *msg,
 		enum lttng_event_output output,
 		int type,
 		uint64_t tracefile_size,
-		uint64_t tracefile_count);
+		uint64_t tracefile_count,
+		enum lttng_compression compression,
+		unsigned int live_timer_interval,
+		int monitor);
 int consumer_is_data_pending(uint64_t session_id,
 		struct consumer_output *consumer);
 int consumer_close_metadata(struct consumer_socket *socket,
@@ -232,5 +242,9 @@ int consumer_push_metadata(struct consumer_socket *socket,
 		uint64_t metadata_key, char *metadata_str, size_t len,
 		size_t target_offset);
 int consumer_flush_channel(struct consumer_socket *socket, uint64_t key);
+int consumer_destroy_channel(struct consumer_socket *socket, uint64_t key);
+int consumer_snapshot_channel(struct consumer_socket *socket, uint64_t key,
+		struct consumer_output *output, int metadata, const char *path,
+		uint64_t max_stream_size);
 
 #endif /* _CONSUMER_H */
@@ -96,7 +96,10 @@ int kernel_consumer_add_channel(struct consumer_socket *sock,
 			channel->channel->attr.output,
 			CONSUMER_CHANNEL_TYPE_DATA,
 			channel->channel->attr.tracefile_size,
-			channel->channel->attr.tracefile_count);
+			channel->channel->attr.tracefile_count,
+			channel->channel->attr.compression,
+			channel->channel->attr.live_timer_interval,
+			!session->snapshot_mode);
 
 	health_code_update();
 
@@ -113,9 +116,10 @@ error:
 
 /*
  * Sending metadata to the consumer with command ADD_CHANNEL and ADD_STREAM.
+ * An unmonitored metadata channel is only read by a snapshot record.
  */
 int kernel_consumer_add_metadata(struct consumer_socket *sock,
-		struct ltt_kernel_session *session)
+		struct ltt_kernel_session *session, int monitor)
 {
 	int ret;
 	char tmp_path[PATH_MAX];
@@ -175,9 +179,10 @@ int kernel_consumer_add_metadata(struct consumer_socket *sock,
 			consumer->net_seq_index,
 			DEFAULT_METADATA_NAME,
 			1,
-			DEFAULT_KERNEL_CHANNEL_OUTPUT,
+			/* The snapshots are read from the command thread. */
+			monitor ? DEFAULT_KERNEL_CHANNEL_OUTPUT : LTTNG_EVENT_MMAP,
 			CONSUMER_CHANNEL_TYPE_METADATA,
-			0, 0);
+			0, 0, LTTNG_COMPRESSION_NONE, 0, monitor);
 
 	health_code_update();
 
@@ -211,57 +216,17 @@ error:
 }
 
 /*
- * Sending a single stream to the consumer with command ADD_STREAM.
- */
-int kernel_consumer_add_stream(struct consumer_socket *sock,
-		struct ltt_kernel_channel *channel, struct ltt_kernel_stream *stream,
-		struct ltt_kernel_session *session)
-{
-	int ret;
-	struct lttcomm_consumer_msg lkm;
-	struct consumer_output *consumer;
-
-	assert(channel);
-	assert(stream);
-	assert(session);
-	assert(session->consumer);
-	assert(sock);
-
-	DBG("Sending stream %d of channel %s to kernel consumer",
-			stream->fd, channel->channel->name);
-
-	/* Get consumer output pointer */
-	consumer = session->consumer;
-
-	/* Prep stream consumer message */
-	consumer_init_stream_comm_msg(&lkm,
-			LTTNG_CONSUMER_ADD_STREAM,
-			channel->fd,
-			stream->fd,
-			stream->cpu);
-
-	health_code_update();
-
-	/* Send stream and file descriptor */
-	ret = consumer_send_stream(sock, consumer, &lkm, &stream->fd, 1);
-	if (ret < 0) {
-		goto error;
-	}
-
-	health_code_update();
-
-error:
-	return ret;
-}
-
-/*
- * Send all stream fds of kernel channel to the consumer.
+ * Send all stream fds of kernel channel to the consumer, in batches of up to
+ * LTTCOMM_MAX_SEND_FDS streams each passed in a single message with one
+ * status reply.
  */
 int kernel_consumer_send_channel_stream(struct consumer_socket *sock,
 		struct ltt_kernel_channel *channel, struct ltt_kernel_session *session)
 {
 	int ret;
+	int fds[LTTCOMM_MAX_SEND_FDS];
 	struct ltt_kernel_stream *stream;
+	struct lttcomm_consumer_msg lkm;
 
 	/* Safety net */
 	assert(channel);
@@ -284,18 +249,39 @@ int kernel_consumer_send_channel_stream(struct consumer_socket *sock,
 	}
 
 	/* Send streams */
+	consumer_init_streams_comm_msg(&lkm, channel->fd);
 	cds_list_for_each_entry(stream, &channel->stream_list.head, list) {
 		if (!stream->fd) {
 			continue;
 		}
 
-		/* Add stream on the kernel consumer side. */
-		ret = kernel_consumer_add_stream(sock, channel, stream, session);
+		if (!consumer_add_streams_comm_msg(&lkm, fds, stream->fd,
+					stream->cpu)) {
+			continue;
+		}
+
+		/* Add the full batch of streams on the kernel consumer side. */
+		health_code_update();
+		ret = consumer_send_stream(sock, session->consumer, &lkm, fds,
+				lkm.u.streams.nb_streams);
 		if (ret < 0) {
 			goto error;
 		}
+		consumer_init_streams_comm_msg(&lkm, channel->fd);
 	}
 
+	if (lkm.u.streams.nb_streams) {
+		health_code_update();
+		ret = consumer_send_stream(sock, session->consumer, &lkm, fds,
+				lkm.u.streams.nb_streams);
+		if (ret < 0) {
+			goto error;
+		}
+	}
+
+	DBG("Sent streams of channel %s to kernel consumer",
+			channel->channel->name);
+
 error:
 	return ret;
 }
@@ -323,7 +309,7 @@ int kernel_consumer_send_session(struct consumer_socket *sock,
 	DBG("Sending session stream to kernel consumer");
 
 	if (session->metadata_stream_fd >= 0) {
-		ret = kernel_consumer_add_metadata(sock, session);
+		ret = kernel_consumer_add_metadata(sock, session, 1);
 		if (ret < 0) {
 			goto error;
 		}
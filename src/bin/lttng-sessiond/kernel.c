@@ -30,6 +30,7 @@
 
 #include "consumer.h"
 #include "kernel.h"
+#include "kernel-consumer.h"
 #include "kern-modules.h"
 
 /*
@@ -744,6 +745,26 @@ void kernel_destroy_session(struct ltt_kernel_session *ksess)
 
 	DBG("Tearing down kernel session");
 
+	/*
+	 * The consumer keeps the streams of a snapshot session until told to
+	 * destroy their channel.
+	 */
+	if (ksess->snapshot_mode && ksess->consumer_fds_sent &&
+			ksess->consumer) {
+		struct consumer_socket *socket;
+		struct lttng_ht_iter iter;
+		struct ltt_kernel_channel *chan;
+
+		rcu_read_lock();
+		cds_lfht_for_each_entry(ksess->consumer->socks->ht, &iter.iter,
+				socket, node.node) {
+			cds_list_for_each_entry(chan, &ksess->channel_list.head, list) {
+				(void) consumer_destroy_channel(socket, chan->fd);
+			}
+		}
+		rcu_read_unlock();
+	}
+
 	/* Close any relayd session */
 	consumer_output_send_destroy_relayd(ksess->consumer);
 
@@ -779,3 +800,85 @@ void kernel_destroy_channel(struct ltt_kernel_channel *kchan)
 		ksess->channel_count--;
 	}
 }
+
+/*
+ * Ask the consumers to record a snapshot of the kernel session buffers in
+ * path, max_stream_size bounding the bytes recorded per stream. The metadata
+ * is read from a new metadata channel holding the whole session metadata.
+ *
+ * The session lock MUST be acquired.
+ *
+ * Return 0 on success or else a negative value.
+ */
+int kernel_snapshot_record(struct ltt_kernel_session *ksess, const char *path,
+		uint64_t max_stream_size)
+{
+	int ret, saved_metadata_fd;
+	struct consumer_socket *socket;
+	struct lttng_ht_iter iter;
+	struct ltt_kernel_channel *chan;
+	struct ltt_kernel_metadata *saved_metadata;
+
+	assert(ksess);
+	assert(ksess->consumer);
+	assert(path);
+
+	DBG("Kernel snapshot record in %s", path);
+
+	/* The snapshot metadata replaces the session one while recording. */
+	saved_metadata = ksess->metadata;
+	saved_metadata_fd = ksess->metadata_stream_fd;
+
+	rcu_read_lock();
+
+	ret = kernel_open_metadata(ksess);
+	if (ret < 0) {
+		goto error_open_metadata;
+	}
+
+	ret = kernel_open_metadata_stream(ksess);
+	if (ret < 0) {
+		goto error_open_stream;
+	}
+
+	cds_lfht_for_each_entry(ksess->consumer->socks->ht, &iter.iter,
+			socket, node.node) {
+		/* Code flow error */
+		assert(socket->fd >= 0);
+
+		cds_list_for_each_entry(chan, &ksess->channel_list.head, list) {
+			ret = consumer_snapshot_channel(socket, chan->fd, ksess->consumer,
+					0, path, max_stream_size);
+			if (ret < 0) {
+				goto error_consumer;
+			}
+		}
+
+		pthread_mutex_lock(socket->lock);
+		ret = kernel_consumer_add_metadata(socket, ksess, 0);
+		pthread_mutex_unlock(socket->lock);
+		if (ret < 0) {
+			goto error_consumer;
+		}
+
+		/* The consumer destroys the metadata channel once recorded. */
+		ret = consumer_snapshot_channel(socket, ksess->metadata->fd,
+				ksess->consumer, 1, path, 0);
+		if (ret < 0) {
+			goto error_consumer;
+		}
+	}
+
+error_consumer:
+	/* Close the snapshot metadata, the consumer has its own fds. */
+	if (close(ksess->metadata_stream_fd)) {
+		PERROR("close snapshot metadata stream");
+	}
+error_open_stream:
+	trace_kernel_destroy_metadata(ksess->metadata);
+error_open_metadata:
+	ksess->metadata = saved_metadata;
+	ksess->metadata_stream_fd = saved_metadata_fd;
+	rcu_read_unlock();
+	return ret;
+}
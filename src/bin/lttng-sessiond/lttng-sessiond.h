@@ -19,6 +19,7 @@
 #define _LTT_SESSIOND_H
 
 #define _LGPL_SOURCE
+#include <time.h>
 #include <urcu.h>
 #include <urcu/wfqueue.h>
 
@@ -53,6 +54,8 @@ struct command_ctx {
 struct ust_command {
 	int sock;
 	struct ust_register_msg reg_msg;
+	/* Time at which the registration was received. */
+	struct timespec registration_time;
 	struct cds_wfq_node node;
 };
 
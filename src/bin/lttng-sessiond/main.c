@@ -61,6 +61,7 @@
 #include "utils.h"
 #include "fd-limit.h"
 #include "health.h"
+#include "stats.h"
 #include "testpoint.h"
 #include "ust-thread.h"
 
@@ -157,6 +158,7 @@ int apps_cmd_notify_pipe[2] = { -1, -1 };
 static pthread_t apps_thread;
 static pthread_t apps_notify_thread;
 static pthread_t reg_apps_thread;
+static pthread_t reclaim_thread;
 static pthread_t client_thread;
 static pthread_t kernel_thread;
 static pthread_t dispatch_thread;
@@ -387,6 +389,9 @@ static void stop_threads(void)
 	/* Dispatch thread */
 	CMM_STORE_SHARED(dispatch_thread_exit, 1);
 	futex_nto1_wake(&ust_cmd_queue.futex);
+
+	/* Reclaim thread */
+	ust_app_reclaim_stop();
 }
 
 /*
@@ -1368,6 +1373,7 @@ static void *thread_dispatch_ust_registration(void *data)
 			}
 
 			ust_cmd = caa_container_of(node, struct ust_command, node);
+			stats_app_reg_queue_dec();
 
 			DBG("Dispatching UST registration pid:%d ppid:%d uid:%d"
 					" gid:%d sock:%d name:%s (version %d.%d)",
@@ -1403,6 +1409,7 @@ static void *thread_dispatch_ust_registration(void *data)
 					free(ust_cmd);
 					continue;
 				}
+				wait_node->app->registration_time = ust_cmd->registration_time;
 				/*
 				 * Add application to the wait queue so we can set the notify
 				 * socket before putting this object in the global ht.
@@ -1490,6 +1497,8 @@ static void *thread_dispatch_ust_registration(void *data)
 				 * handle app unregistration upon socket close.
 				 */
 				(void) ust_app_register_done(app->sock);
+				(void) stats_record(STATS_APP_REGISTRATION,
+						&app->registration_time);
 
 				/*
 				 * Even if the application socket has been closed, send the app
@@ -1632,6 +1641,7 @@ static void *thread_registration_apps(void *data)
 						PERROR("ust command zmalloc");
 						goto error;
 					}
+					stats_time_begin(&ust_cmd->registration_time);
 
 					/*
 					 * Using message-based transmissions to ensure we don't
@@ -1678,6 +1688,7 @@ static void *thread_registration_apps(void *data)
 					 * Lock free enqueue the registration request. The red pill
 					 * has been taken! This apps will be part of the *system*.
 					 */
+					stats_app_reg_queue_inc();
 					cds_wfq_enqueue(&ust_cmd_queue.queue, &ust_cmd->node);
 
 					/*
@@ -2264,6 +2275,7 @@ static int create_ust_session(struct ltt_session *session,
 
 	lus->uid = session->uid;
 	lus->gid = session->gid;
+	lus->snapshot_mode = session->snapshot_mode;
 	session->ust_session = lus;
 
 	/* Copy session output to the newly created UST session */
@@ -2320,6 +2332,7 @@ static int create_kernel_session(struct ltt_session *session)
 
 	session->kernel_session->uid = session->uid;
 	session->kernel_session->gid = session->gid;
+	session->kernel_session->snapshot_mode = session->snapshot_mode;
 
 	return LTTNG_OK;
 
@@ -2375,12 +2388,14 @@ static int process_client_msg(struct command_ctx *cmd_ctx, int sock,
 
 	switch (cmd_ctx->lsm->cmd_type) {
 	case LTTNG_CREATE_SESSION:
+	case LTTNG_CREATE_SESSION_SNAPSHOT:
 	case LTTNG_DESTROY_SESSION:
 	case LTTNG_LIST_SESSIONS:
 	case LTTNG_LIST_DOMAINS:
 	case LTTNG_START_TRACE:
 	case LTTNG_STOP_TRACE:
 	case LTTNG_DATA_PENDING:
+	case LTTNG_SNAPSHOT_RECORD:
 		need_domain = 0;
 		break;
 	default:
@@ -2416,6 +2431,7 @@ static int process_client_msg(struct command_ctx *cmd_ctx, int sock,
 	switch(cmd_ctx->lsm->cmd_type) {
 	case LTTNG_LIST_SESSIONS:
 	case LTTNG_LIST_TRACEPOINTS:
+	case LTTNG_LIST_TRACEPOINTS_QUERY:
 	case LTTNG_LIST_TRACEPOINT_FIELDS:
 	case LTTNG_LIST_DOMAINS:
 	case LTTNG_LIST_CHANNELS:
@@ -2433,9 +2449,11 @@ static int process_client_msg(struct command_ctx *cmd_ctx, int sock,
 	/* Commands that DO NOT need a session. */
 	switch (cmd_ctx->lsm->cmd_type) {
 	case LTTNG_CREATE_SESSION:
+	case LTTNG_CREATE_SESSION_SNAPSHOT:
 	case LTTNG_CALIBRATE:
 	case LTTNG_LIST_SESSIONS:
 	case LTTNG_LIST_TRACEPOINTS:
+	case LTTNG_LIST_TRACEPOINTS_QUERY:
 	case LTTNG_LIST_TRACEPOINT_FIELDS:
 		need_tracing_session = 0;
 		break;
@@ -2742,6 +2760,34 @@ skip_domain:
 		ret = LTTNG_OK;
 		break;
 	}
+	case LTTNG_LIST_TRACEPOINTS_QUERY:
+	{
+		struct lttng_event *events = NULL;
+		ssize_t nb_events;
+
+		nb_events = cmd_list_tracepoints_query(cmd_ctx->lsm->domain.type,
+				&cmd_ctx->lsm->u.tp_query, &events);
+		if (nb_events < 0) {
+			/* Return value is a negative lttng_error_code. */
+			ret = -nb_events;
+			goto error;
+		}
+
+		ret = setup_lttng_msg(cmd_ctx, sizeof(struct lttng_event) * nb_events);
+		if (ret < 0) {
+			free(events);
+			goto setup_error;
+		}
+
+		/* Copy event list into message payload */
+		memcpy(cmd_ctx->llm->payload, events,
+				sizeof(struct lttng_event) * nb_events);
+
+		free(events);
+
+		ret = LTTNG_OK;
+		break;
+	}
 	case LTTNG_LIST_TRACEPOINT_FIELDS:
 	{
 		struct lttng_event_field *fields;
@@ -2844,6 +2890,7 @@ skip_domain:
 		break;
 	}
 	case LTTNG_CREATE_SESSION:
+	case LTTNG_CREATE_SESSION_SNAPSHOT:
 	{
 		size_t nb_uri, len;
 		struct lttng_uri *uris = NULL;
@@ -2878,7 +2925,8 @@ skip_domain:
 		}
 
 		ret = cmd_create_session_uri(cmd_ctx->lsm->session.name, uris, nb_uri,
-			&cmd_ctx->creds);
+			&cmd_ctx->creds,
+			cmd_ctx->lsm->cmd_type == LTTNG_CREATE_SESSION_SNAPSHOT);
 
 		free(uris);
 
@@ -3061,6 +3109,8 @@ skip_domain:
 		ret = cmd_enable_event(cmd_ctx->session, &cmd_ctx->lsm->domain,
 				cmd_ctx->lsm->u.enable.channel_name,
 				&cmd_ctx->lsm->u.enable.event, bytecode, kernel_poll_pipe[1]);
+		/* Events keep a shared copy of the bytecode, see ust-filter.c. */
+		free(bytecode);
 		break;
 	}
 	case LTTNG_DATA_PENDING:
@@ -3068,6 +3118,22 @@ skip_domain:
 		ret = cmd_data_pending(cmd_ctx->session);
 		break;
 	}
+	case LTTNG_SNAPSHOT_RECORD:
+	{
+		cmd_ctx->lsm->u.snapshot_record.name[
+				sizeof(cmd_ctx->lsm->u.snapshot_record.name) - 1] = '\0';
+		ret = cmd_snapshot_record(cmd_ctx->session,
+				cmd_ctx->lsm->u.snapshot_record.name,
+				cmd_ctx->lsm->u.snapshot_record.max_size);
+		break;
+	}
+	case LTTNG_SET_PROVISION_UIDS:
+	{
+		ret = cmd_set_provision_uids(cmd_ctx->lsm->domain.type,
+				cmd_ctx->session, cmd_ctx->lsm->u.provision_uids.uids,
+				cmd_ctx->lsm->u.provision_uids.count);
+		break;
+	}
 	default:
 		ret = LTTNG_ERR_UND;
 		break;
@@ -3093,6 +3159,48 @@ init_setup_error:
 	return ret;
 }
 
+/*
+ * Reply to a LTTNG_HEALTH_STATS command on the health socket with the daemon
+ * statistics followed by the per application ones.
+ *
+ * Return 0 on success or else a negative value.
+ */
+static int send_health_stats(int sock)
+{
+	int ret, nb_apps;
+	struct lttcomm_health_stats_reply reply;
+	struct lttng_health_stats stats;
+	struct lttng_health_app_stats *apps = NULL;
+
+	memset(&reply, 0, sizeof(reply));
+	stats_get(&stats);
+
+	nb_apps = ust_app_get_stats(&apps);
+	if (nb_apps < 0) {
+		reply.ret_code = LTTNG_ERR_FATAL;
+		nb_apps = 0;
+	} else {
+		reply.ret_code = LTTNG_OK;
+		reply.nb_apps = nb_apps;
+	}
+
+	ret = send_unix_sock(sock, (void *) &reply, sizeof(reply));
+	if (ret < 0 || reply.ret_code != LTTNG_OK) {
+		goto end;
+	}
+
+	ret = send_unix_sock(sock, (void *) &stats, sizeof(stats));
+	if (ret < 0 || nb_apps == 0) {
+		goto end;
+	}
+
+	ret = send_unix_sock(sock, (void *) apps, nb_apps * sizeof(*apps));
+
+end:
+	free(apps);
+	return ret < 0 ? ret : 0;
+}
+
 /*
  * Thread managing health check socket.
  */
@@ -3209,6 +3317,14 @@ restart:
 
 		rcu_thread_online();
 
+		if (msg.cmd == LTTNG_HEALTH_STATS) {
+			ret = send_health_stats(new_sock);
+			if (ret < 0) {
+				ERR("Failed to send health stats back to client");
+			}
+			goto end_transmission;
+		}
+
 		switch (msg.component) {
 		case LTTNG_HEALTH_CMD:
 			reply.ret_code = health_check_state(HEALTH_TYPE_CMD);
@@ -3255,6 +3371,7 @@ restart:
 			ERR("Failed to send health data back to client");
 		}
 
+end_transmission:
 		/* End of transmission */
 		ret = close(new_sock);
 		if (ret) {
@@ -3294,6 +3411,7 @@ static void *thread_manage_clients(void *data)
 	uint32_t revents, nb_fd;
 	struct command_ctx *cmd_ctx = NULL;
 	struct lttng_poll_event events;
+	struct timespec cmd_start;
 
 	DBG("[thread] Manage client started");
 
@@ -3454,7 +3572,9 @@ static void *thread_manage_clients(void *data)
 		 * informations for the client. The command context struct contains
 		 * everything this function may needs.
 		 */
+		stats_time_begin(&cmd_start);
 		ret = process_client_msg(cmd_ctx, sock, &sock_error);
+		stats_record_cmd(cmd_ctx->lsm->cmd_type, &cmd_start);
 		rcu_thread_offline();
 		if (ret < 0) {
 			ret = close(sock);
@@ -4363,6 +4483,14 @@ int main(int argc, char **argv)
 		goto exit_reg_apps;
 	}
 
+	/* Create thread to tear down the unregistered applications */
+	ret = pthread_create(&reclaim_thread, NULL,
+			ust_app_thread_reclaim, (void *) NULL);
+	if (ret != 0) {
+		PERROR("pthread_create reclaim");
+		goto exit_reclaim;
+	}
+
 	/* Create thread to manage application socket */
 	ret = pthread_create(&apps_thread, NULL,
 			thread_manage_apps, (void *) NULL);
@@ -4404,6 +4532,13 @@ exit_kernel:
 	}
 
 exit_apps:
+	ret = pthread_join(reclaim_thread, &status);
+	if (ret != 0) {
+		PERROR("pthread_join");
+		goto error;	/* join error, exit without cleanup */
+	}
+
+exit_reclaim:
 	ret = pthread_join(reg_apps_thread, &status);
 	if (ret != 0) {
 		PERROR("pthread_join");
@@ -85,6 +85,14 @@ struct ltt_session {
 
 	/* Did a start command occured before the kern/ust session creation? */
 	unsigned int started;
+
+	/*
+	 * Set for a snapshot session: the channels are in overwrite mode and
+	 * their buffers are only written out by the snapshot record command.
+	 */
+	unsigned int snapshot_mode;
+	/* Number of snapshots recorded, used to name them. */
+	unsigned int snapshot_seq;
 };
 
 /* Prototypes */
@@ -0,0 +1,271 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <pthread.h>
+#include <string.h>
+
+#include <common/error.h>
+
+#include "stats.h"
+
+/*
+ * The statistics are updated once per command sent over a socket so an
+ * uncontended lock is cheap compared to the measured operation and keeps the
+ * 64-bit counters consistent on 32-bit architectures.
+ */
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct lttng_health_stats stats;
+
+/*
+ * Return the histogram bucket of a latency in nanoseconds.
+ */
+unsigned int stats_latency_bucket(uint64_t ns)
+{
+	unsigned int bucket = 0;
+	uint64_t us = ns / 1000;
+
+	while (us) {
+		us >>= 1;
+		bucket++;
+	}
+
+	if (bucket >= LTTNG_HEALTH_LATENCY_NR_BUCKETS) {
+		bucket = LTTNG_HEALTH_LATENCY_NR_BUCKETS - 1;
+	}
+
+	return bucket;
+}
+
+/*
+ * Add a latency to a histogram. The stats lock MUST be held.
+ */
+static void latency_add(struct lttng_health_latency *latency, uint64_t ns)
+{
+	latency->count++;
+	latency->total_ns += ns;
+	if (ns > latency->max_ns) {
+		latency->max_ns = ns;
+	}
+	latency->buckets[stats_latency_bucket(ns)]++;
+}
+
+/*
+ * Return the upper bound, in nanoseconds, of the latencies under the given
+ * percentile: the end of the histogram bucket holding it, capped by the
+ * maximum latency. Return 0 for an empty histogram.
+ */
+uint64_t stats_latency_percentile(const struct lttng_health_latency *latency,
+		unsigned int percentile)
+{
+	unsigned int i;
+	uint64_t rank, seen = 0, bound;
+
+	assert(latency);
+
+	if (!latency->count) {
+		return 0;
+	}
+	if (percentile > 100) {
+		percentile = 100;
+	}
+
+	/* Rank of the latency at the percentile, from 1. */
+	rank = (latency->count * percentile + 99) / 100;
+	if (!rank) {
+		rank = 1;
+	}
+
+	for (i = 0; i < LTTNG_HEALTH_LATENCY_NR_BUCKETS - 1; i++) {
+		seen += latency->buckets[i];
+		if (seen >= rank) {
+			/* Bucket i ends at 2^i microseconds. */
+			bound = (1ULL << i) * 1000;
+			return bound < latency->max_ns ? bound : latency->max_ns;
+		}
+	}
+
+	/* The last bucket has no upper bound. */
+	return latency->max_ns;
+}
+
+/*
+ * Set start to the current time for a following stats_record*() call.
+ */
+void stats_time_begin(struct timespec *start)
+{
+	int ret;
+
+	assert(start);
+
+	ret = clock_gettime(CLOCK_MONOTONIC, start);
+	if (ret < 0) {
+		PERROR("clock_gettime stats");
+		start->tv_sec = 0;
+		start->tv_nsec = 0;
+	}
+}
+
+/*
+ * Return the nanoseconds elapsed since start.
+ */
+static uint64_t time_elapsed(const struct timespec *start)
+{
+	int ret;
+	struct timespec now;
+
+	ret = clock_gettime(CLOCK_MONOTONIC, &now);
+	if (ret < 0 || (start->tv_sec == 0 && start->tv_nsec == 0)) {
+		return 0;
+	}
+
+	return ((uint64_t) now.tv_sec - start->tv_sec) * 1000000000ULL
+		+ now.tv_nsec - start->tv_nsec;
+}
+
+/*
+ * Record the time elapsed since start for the given statistic.
+ *
+ * Return the elapsed time in nanoseconds so the caller can account for it in
+ * a more specific histogram.
+ */
+uint64_t stats_record(enum stats_type type, const struct timespec *start)
+{
+	uint64_t ns;
+	struct lttng_health_latency *latency;
+
+	assert(start);
+
+	switch (type) {
+	case STATS_APP_REGISTRATION:
+		latency = &stats.app_registration;
+		break;
+	case STATS_APP_CMD:
+		latency = &stats.app_cmd;
+		break;
+	case STATS_CONSUMER_CMD:
+		latency = &stats.consumer_cmd;
+		break;
+	default:
+		assert(0);
+		return 0;
+	}
+
+	ns = time_elapsed(start);
+
+	pthread_mutex_lock(&stats_lock);
+	latency_add(latency, ns);
+	pthread_mutex_unlock(&stats_lock);
+
+	return ns;
+}
+
+/*
+ * Record the processing time of a client command.
+ */
+void stats_record_cmd(unsigned int cmd_type, const struct timespec *start)
+{
+	uint64_t ns;
+
+	assert(start);
+
+	if (cmd_type >= LTTNG_HEALTH_STATS_NR_CMD) {
+		return;
+	}
+
+	ns = time_elapsed(start);
+
+	pthread_mutex_lock(&stats_lock);
+	latency_add(&stats.cmd[cmd_type], ns);
+	pthread_mutex_unlock(&stats_lock);
+}
+
+/*
+ * Add a latency to a histogram owned by the caller, for instance the per
+ * application one.
+ */
+void stats_latency_add(struct lttng_health_latency *latency, uint64_t ns)
+{
+	assert(latency);
+
+	pthread_mutex_lock(&stats_lock);
+	latency_add(latency, ns);
+	pthread_mutex_unlock(&stats_lock);
+}
+
+/*
+ * Copy a histogram owned by the caller and updated with stats_latency_add().
+ */
+void stats_latency_get(struct lttng_health_latency *dst,
+		const struct lttng_health_latency *src)
+{
+	assert(dst);
+	assert(src);
+
+	pthread_mutex_lock(&stats_lock);
+	memcpy(dst, src, sizeof(*dst));
+	pthread_mutex_unlock(&stats_lock);
+
+	dst->p99_ns = stats_latency_percentile(dst, 99);
+}
+
+/*
+ * Account for an application enqueued in the registration queue.
+ */
+void stats_app_reg_queue_inc(void)
+{
+	pthread_mutex_lock(&stats_lock);
+	stats.app_reg_queue_depth++;
+	if (stats.app_reg_queue_depth > stats.app_reg_queue_max_depth) {
+		stats.app_reg_queue_max_depth = stats.app_reg_queue_depth;
+	}
+	pthread_mutex_unlock(&stats_lock);
+}
+
+/*
+ * Account for an application dequeued from the registration queue.
+ */
+void stats_app_reg_queue_dec(void)
+{
+	pthread_mutex_lock(&stats_lock);
+	assert(stats.app_reg_queue_depth > 0);
+	stats.app_reg_queue_depth--;
+	pthread_mutex_unlock(&stats_lock);
+}
+
+/*
+ * Copy a consistent snapshot of the statistics, with their percentiles.
+ */
+void stats_get(struct lttng_health_stats *dst)
+{
+	unsigned int i;
+
+	assert(dst);
+
+	pthread_mutex_lock(&stats_lock);
+	memcpy(dst, &stats, sizeof(*dst));
+	pthread_mutex_unlock(&stats_lock);
+
+	for (i = 0; i < LTTNG_HEALTH_STATS_NR_CMD; i++) {
+		dst->cmd[i].p99_ns = stats_latency_percentile(&dst->cmd[i], 99);
+	}
+	dst->app_registration.p99_ns =
+		stats_latency_percentile(&dst->app_registration, 99);
+	dst->app_cmd.p99_ns = stats_latency_percentile(&dst->app_cmd, 99);
+	dst->consumer_cmd.p99_ns =
+		stats_latency_percentile(&dst->consumer_cmd, 99);
+}
@@ -0,0 +1,47 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include <lttng/lttng.h>
+
+/*
+ * Latency statistics of the session daemon, reported through the health
+ * socket. Every function is thread safe.
+ */
+enum stats_type {
+	STATS_APP_REGISTRATION,
+	STATS_APP_CMD,
+	STATS_CONSUMER_CMD,
+};
+
+void stats_time_begin(struct timespec *start);
+uint64_t stats_record(enum stats_type type, const struct timespec *start);
+void stats_record_cmd(unsigned int cmd_type, const struct timespec *start);
+unsigned int stats_latency_bucket(uint64_t ns);
+uint64_t stats_latency_percentile(const struct lttng_health_latency *latency,
+		unsigned int percentile);
+void stats_latency_add(struct lttng_health_latency *latency, uint64_t ns);
+void stats_latency_get(struct lttng_health_latency *dst,
+		const struct lttng_health_latency *src);
+void stats_app_reg_queue_inc(void);
+void stats_app_reg_queue_dec(void);
+void stats_get(struct lttng_health_stats *dst);
+
+#endif /* _STATS_H */
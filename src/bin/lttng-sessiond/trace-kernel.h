@@ -111,6 +111,8 @@ struct ltt_kernel_session {
 	unsigned int id;
 	/* Session is started and active */
 	unsigned int started;
+	/* Channel streams are kept by the consumer for the snapshots. */
+	unsigned int snapshot_mode;
 };
 
 /*
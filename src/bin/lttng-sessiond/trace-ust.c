@@ -26,6 +26,7 @@
 
 #include "buffer-registry.h"
 #include "trace-ust.h"
+#include "ust-filter.h"
 
 /*
  * Match function for the events hash table lookup.
@@ -100,7 +101,13 @@ int trace_ust_ht_match_event(struct cds_lfht_node *node, const void *_key)
 		goto no_match;
 	}
 
-	if (key->filter && event->filter) {
+	/*
+	 * Event filters are shared by content so identical filters usually have
+	 * the same address. The key can come from a client though, in which case
+	 * the content is compared.
+	 */
+	if (key->filter && event->filter &&
+			(const void *) key->filter != (const void *) event->filter) {
 		/* Both filters exists, check length followed by the bytecode. */
 		if (event->filter->len != key->filter->len ||
 				memcmp(event->filter->data, key->filter->data,
@@ -279,6 +286,8 @@ struct ltt_ust_channel *trace_ust_create_channel(struct lttng_channel *chan)
 	/* On-disk circular buffer parameters */
 	luc->tracefile_size = chan->attr.tracefile_size;
 	luc->tracefile_count = chan->attr.tracefile_count;
+	luc->compression = chan->attr.compression;
+	luc->live_timer_interval = chan->attr.live_timer_interval;
 
 	DBG2("Trace UST channel %s created", luc->name);
 
@@ -344,8 +353,14 @@ struct ltt_ust_event *trace_ust_create_event(struct lttng_event *ev,
 		goto error_free_event;
 	}
 
-	/* Same layout. */
-	lue->filter = (struct lttng_ust_filter_bytecode *) filter;
+	if (filter) {
+		/* Same layout. The bytecode remains owned by the caller. */
+		lue->filter = ust_filter_get(
+				(struct lttng_ust_filter_bytecode *) filter);
+		if (!lue->filter) {
+			goto error_free_event;
+		}
+	}
 
 	/* Init node */
 	lttng_ht_node_init_str(&lue->node, lue->attr.name);
@@ -494,7 +509,7 @@ void trace_ust_destroy_event(struct ltt_ust_event *event)
 	assert(event);
 
 	DBG2("Trace destroy UST event %s", event->attr.name);
-	free(event->filter);
+	ust_filter_put(event->filter);
 	free(event);
 }
 
@@ -638,6 +653,9 @@ void trace_ust_destroy_session(struct ltt_ust_session *session)
 			lnode) {
 		cds_list_del(&reg->lnode);
 		buffer_reg_uid_remove(reg);
+		if (session->snapshot_mode) {
+			buffer_reg_uid_destroy_channels(reg, session->consumer);
+		}
 		buffer_reg_uid_destroy(reg, session->consumer);
 	}
 
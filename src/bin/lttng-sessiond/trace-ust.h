@@ -60,6 +60,8 @@ struct ltt_ust_channel {
 	struct lttng_ht_node_str node;
 	uint64_t tracefile_size;
 	uint64_t tracefile_count;
+	enum lttng_compression compression;
+	unsigned int live_timer_interval;	/* usec */
 };
 
 /* UST Metadata */
@@ -105,6 +107,13 @@ struct ltt_ust_session {
 	uint64_t next_channel_id;
 	/* Once this value reaches UINT32_MAX, no more id can be allocated. */
 	uint64_t used_channel_id;
+	/* Channel streams are kept by the consumer for the snapshots. */
+	unsigned int snapshot_mode;
+	/* UIDs of which the per UID buffers are created when tracing starts. */
+	uid_t provision_uids[DEFAULT_UST_PROVISION_UIDS_MAX];
+	unsigned int nb_provision_uids;
+	/* Set when no application gave the ABI of these buffers yet. */
+	int provision_pending;
 };
 
 /*
@@ -17,8 +17,11 @@
 
 #define _GNU_SOURCE
 #include <errno.h>
+#include <fnmatch.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <pthread.h>
+#include <pwd.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -30,19 +33,42 @@
 #include <signal.h>
 
 #include <common/common.h>
+#include <common/compat/endian.h>
+#include <common/defaults.h>
+#include <common/futex.h>
 #include <common/sessiond-comm/sessiond-comm.h>
 
 #include "buffer-registry.h"
 #include "fd-limit.h"
 #include "health.h"
+#include "stats.h"
 #include "ust-app.h"
 #include "ust-consumer.h"
 #include "ust-ctl.h"
+#include "ust-filter.h"
 
 /* Next available channel key. */
 static unsigned long next_channel_key;
 static unsigned long next_session_id;
 
+/*
+ * Unregistered applications waiting to be torn down by the reclaim thread,
+ * off the application management thread. This queue is tied with a futex
+ * using the N wakers / 1 waiter scheme of futex.c/.h.
+ */
+static struct {
+	int32_t futex;
+	struct cds_wfq_queue queue;
+	/*
+	 * Held while applications are dequeued and their metadata closed so a
+	 * flush returns only once every application dequeued before it is done.
+	 */
+	pthread_mutex_t lock;
+	int quit;
+} reclaim_queue = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
 /*
  * Return the atomically incremented value of next_channel_key.
  */
@@ -59,6 +85,18 @@ static inline unsigned long get_next_session_id(void)
 	return uatomic_add_return(&next_session_id, 1);
 }
 
+/*
+ * Account for the round trip of a command sent to the application at start
+ * both globally and for the application.
+ */
+static void app_cmd_latency(struct ust_app *app, const struct timespec *start)
+{
+	uint64_t ns;
+
+	ns = stats_record(STATS_APP_CMD, start);
+	stats_latency_add(&app->cmd_latency, ns);
+}
+
 static void copy_channel_attr_to_ustctl(
 		struct ustctl_consumer_channel_attr *attr,
 		struct lttng_ust_channel_attr *uattr)
@@ -116,7 +154,8 @@ static int ht_match_ust_app_event(struct cds_lfht_node *node, const void *_key)
 		goto no_match;
 	}
 
-	if (key->filter && event->filter) {
+	/* Shared filters with the same content have the same address. */
+	if (key->filter && event->filter && key->filter != event->filter) {
 		/* Both filters exists, check length followed by the bytecode. */
 		if (event->filter->len != key->filter->len ||
 				memcmp(event->filter->data, key->filter->data,
@@ -255,7 +294,7 @@ void delete_ust_app_event(int sock, struct ust_app_event *ua_event)
 
 	assert(ua_event);
 
-	free(ua_event->filter);
+	ust_filter_put(ua_event->filter);
 
 	if (ua_event->obj != NULL) {
 		ret = ustctl_release_object(sock, ua_event->obj);
@@ -636,6 +675,23 @@ void delete_ust_app_session(int sock, struct ust_app_session *ua_sess,
 			node.node) {
 		ret = lttng_ht_del(ua_sess->channels, &iter);
 		assert(!ret);
+		/*
+		 * The streams of a snapshot session are kept by the consumer until
+		 * it is told to destroy their channel. Per UID channels are destroyed
+		 * with the buffer registry.
+		 */
+		if (ua_sess->snapshot_mode && ua_chan->is_sent &&
+				ua_sess->buffer_type == LTTNG_BUFFER_PER_PID &&
+				ua_chan->attr.type != LTTNG_UST_CHAN_METADATA &&
+				ua_sess->consumer) {
+			struct consumer_socket *socket;
+
+			socket = consumer_find_socket_by_bitness(app->bits_per_long,
+					ua_sess->consumer);
+			if (socket) {
+				(void) ust_consumer_destroy_channel(socket, ua_chan);
+			}
+		}
 		delete_ust_app_channel(sock, ua_chan, app);
 	}
 
@@ -662,7 +718,8 @@ void delete_ust_app_session(int sock, struct ust_app_session *ua_sess,
 
 /*
  * Delete a traceable application structure from the global list. Never call
- * this function outside of a call_rcu call.
+ * this function before a grace period has elapsed since its unregistration,
+ * that is outside of a call_rcu call or the reclaim thread.
  *
  * RCU read side lock should _NOT_ be held when calling this function.
  */
@@ -688,6 +745,9 @@ void delete_ust_app(struct ust_app *app)
 	lttng_ht_destroy(app->sessions);
 	lttng_ht_destroy(app->ust_objd);
 
+	free(app->tracepoints);
+	pthread_mutex_destroy(&app->tp_cache_lock);
+
 	/*
 	 * Wait until we have deleted the application from the sock hash table
 	 * before closing this socket, otherwise an application could re-use the
@@ -726,6 +786,151 @@ void delete_ust_app_rcu(struct rcu_head *head)
 	delete_ust_app(app);
 }
 
+/*
+ * Push and close the metadata of the sessions of an unregistered application
+ * so its last events are described before the consumer is asked for data
+ * pending or the session is destroyed. The close nullifies the metadata
+ * pointer in the session so the delete session will NOT push/close a second
+ * time.
+ */
+static
+void close_app_metadata(struct ust_app *app)
+{
+	struct ust_app_session *ua_sess;
+	struct ust_registry_session *registry;
+
+	rcu_read_lock();
+	cds_list_for_each_entry(ua_sess, &app->teardown_head, teardown_node) {
+		pthread_mutex_lock(&ua_sess->lock);
+		registry = get_session_registry(ua_sess);
+		if (registry && !registry->metadata_closed) {
+			/* Push metadata for application before freeing the application. */
+			(void) push_metadata(registry, ua_sess->consumer);
+
+			/*
+			 * Don't ask to close metadata for global per UID buffers. Close
+			 * metadata only on destroy trace session in this case. Also, the
+			 * previous push metadata could have flag the metadata registry to
+			 * close so don't send a close command if closed.
+			 */
+			if (ua_sess->buffer_type != LTTNG_BUFFER_PER_UID &&
+					!registry->metadata_closed) {
+				/* And ask to close it for this session registry. */
+				(void) close_metadata(registry, ua_sess->consumer);
+			}
+		}
+		pthread_mutex_unlock(&ua_sess->lock);
+	}
+	rcu_read_unlock();
+}
+
+/*
+ * Dequeue at most max unregistered applications in batch and close their
+ * metadata, in the order they unregistered.
+ *
+ * The reclaim queue lock MUST be held. Return the number of applications
+ * dequeued.
+ */
+static
+unsigned int dequeue_reclaim_batch(struct ust_app **batch, unsigned int max)
+{
+	unsigned int nb = 0;
+	struct cds_wfq_node *node;
+
+	while (nb < max) {
+		node = cds_wfq_dequeue_blocking(&reclaim_queue.queue);
+		if (!node) {
+			break;
+		}
+		batch[nb] = caa_container_of(node, struct ust_app, reclaim_node);
+		close_app_metadata(batch[nb]);
+		nb++;
+	}
+
+	return nb;
+}
+
+/*
+ * This thread tears down the unregistered applications in batches: their
+ * metadata is pushed and closed, then one grace period is waited for the
+ * whole batch before deleting them, instead of one call_rcu per application.
+ * The application management thread only unlinks an application from the
+ * hash tables and queues it here, keeping it available for the other
+ * applications when many of them exit at once.
+ */
+void *ust_app_thread_reclaim(void *data)
+{
+	unsigned int i, nb;
+	struct ust_app *batch[DEFAULT_UST_APP_RECLAIM_BATCH];
+
+	DBG("[thread] UST app reclaim started");
+
+	rcu_register_thread();
+
+	while (1) {
+		/* Atomically prepare the queue futex */
+		futex_nto1_prepare(&reclaim_queue.futex);
+
+		pthread_mutex_lock(&reclaim_queue.lock);
+		nb = dequeue_reclaim_batch(batch, DEFAULT_UST_APP_RECLAIM_BATCH);
+		pthread_mutex_unlock(&reclaim_queue.lock);
+
+		if (nb == 0) {
+			if (CMM_LOAD_SHARED(reclaim_queue.quit)) {
+				break;
+			}
+			/* Futex wait on queue. Blocking call on futex() */
+			futex_nto1_wait(&reclaim_queue.futex);
+			continue;
+		}
+
+		/* No RCU reader can still see the applications of the batch. */
+		synchronize_rcu();
+		for (i = 0; i < nb; i++) {
+			delete_ust_app(batch[i]);
+		}
+		DBG2("UST app reclaim deleted %u applications", nb);
+	}
+
+	rcu_unregister_thread();
+
+	DBG("[thread] UST app reclaim exiting");
+	return NULL;
+}
+
+/*
+ * Ask the reclaim thread to exit once its queue is empty.
+ */
+void ust_app_reclaim_stop(void)
+{
+	CMM_STORE_SHARED(reclaim_queue.quit, 1);
+	futex_nto1_wake(&reclaim_queue.futex);
+}
+
+/*
+ * Close the metadata of every application unregistered so far before
+ * returning, the reclaim thread possibly not having reached them yet. Used
+ * before the data pending, stop and destroy commands so that they account
+ * for the last events of the exited applications. The applications still
+ * queued are deleted after a grace period with call_rcu.
+ *
+ * Should _NOT_ be called with the reclaim queue lock held.
+ */
+void ust_app_reclaim_flush(void)
+{
+	unsigned int i, nb;
+	struct ust_app *batch[DEFAULT_UST_APP_RECLAIM_BATCH];
+
+	pthread_mutex_lock(&reclaim_queue.lock);
+	do {
+		nb = dequeue_reclaim_batch(batch, DEFAULT_UST_APP_RECLAIM_BATCH);
+		for (i = 0; i < nb; i++) {
+			call_rcu(&batch[i]->pid_n.head, delete_ust_app_rcu);
+		}
+	} while (nb);
+	pthread_mutex_unlock(&reclaim_queue.lock);
+}
+
 /*
  * Delete the session from the application ht and delete the data structure by
  * freeing every object inside and releasing them.
@@ -909,29 +1114,6 @@ error:
 	return ua_ctx;
 }
 
-/*
- * Allocate a filter and copy the given original filter.
- *
- * Return allocated filter or NULL on error.
- */
-static struct lttng_ust_filter_bytecode *alloc_copy_ust_app_filter(
-		struct lttng_ust_filter_bytecode *orig_f)
-{
-	struct lttng_ust_filter_bytecode *filter = NULL;
-
-	/* Copy filter bytecode */
-	filter = zmalloc(sizeof(*filter) + orig_f->len);
-	if (!filter) {
-		PERROR("zmalloc alloc ust app filter");
-		goto error;
-	}
-
-	memcpy(filter, orig_f, sizeof(*filter) + orig_f->len);
-
-error:
-	return filter;
-}
-
 /*
  * Find an ust_app using the sock and return it. RCU read side lock must be
  * held before calling this helper function.
@@ -1024,11 +1206,14 @@ int create_ust_channel_context(struct ust_app_channel *ua_chan,
 		struct ust_app_ctx *ua_ctx, struct ust_app *app)
 {
 	int ret;
+	struct timespec start;
 
 	health_code_update();
 
+	stats_time_begin(&start);
 	ret = ustctl_add_context(app->sock, &ua_ctx->ctx,
 			ua_chan->obj, &ua_ctx->obj);
+	app_cmd_latency(app, &start);
 	if (ret < 0) {
 		if (ret != -EPIPE && ret != -LTTNG_UST_ERR_EXITING) {
 			ERR("UST app create channel context failed for app (pid: %d) "
@@ -1057,6 +1242,7 @@ int set_ust_event_filter(struct ust_app_event *ua_event,
 		struct ust_app *app)
 {
 	int ret;
+	struct timespec start;
 
 	health_code_update();
 
@@ -1065,8 +1251,10 @@ int set_ust_event_filter(struct ust_app_event *ua_event,
 		goto error;
 	}
 
+	stats_time_begin(&start);
 	ret = ustctl_set_filter(app->sock, ua_event->filter,
 			ua_event->obj);
+	app_cmd_latency(app, &start);
 	if (ret < 0) {
 		if (ret != -EPIPE && ret != -LTTNG_UST_ERR_EXITING) {
 			ERR("UST app event %s filter failed for app (pid: %d) "
@@ -1091,10 +1279,13 @@ static int disable_ust_event(struct ust_app *app,
 		struct ust_app_session *ua_sess, struct ust_app_event *ua_event)
 {
 	int ret;
+	struct timespec start;
 
 	health_code_update();
 
+	stats_time_begin(&start);
 	ret = ustctl_disable(app->sock, ua_event->obj);
+	app_cmd_latency(app, &start);
 	if (ret < 0) {
 		if (ret != -EPIPE && ret != -LTTNG_UST_ERR_EXITING) {
 			ERR("UST app event %s disable failed for app (pid: %d) "
@@ -1121,10 +1312,13 @@ static int disable_ust_channel(struct ust_app *app,
 		struct ust_app_session *ua_sess, struct ust_app_channel *ua_chan)
 {
 	int ret;
+	struct timespec start;
 
 	health_code_update();
 
+	stats_time_begin(&start);
 	ret = ustctl_disable(app->sock, ua_chan->obj);
+	app_cmd_latency(app, &start);
 	if (ret < 0) {
 		if (ret != -EPIPE && ret != -LTTNG_UST_ERR_EXITING) {
 			ERR("UST app channel %s disable failed for app (pid: %d) "
@@ -1151,10 +1345,13 @@ static int enable_ust_channel(struct ust_app *app,
 		struct ust_app_session *ua_sess, struct ust_app_channel *ua_chan)
 {
 	int ret;
+	struct timespec start;
 
 	health_code_update();
 
+	stats_time_begin(&start);
 	ret = ustctl_enable(app->sock, ua_chan->obj);
+	app_cmd_latency(app, &start);
 	if (ret < 0) {
 		if (ret != -EPIPE && ret != -LTTNG_UST_ERR_EXITING) {
 			ERR("UST app channel %s enable failed for app (pid: %d) "
@@ -1183,10 +1380,13 @@ static int enable_ust_event(struct ust_app *app,
 		struct ust_app_session *ua_sess, struct ust_app_event *ua_event)
 {
 	int ret;
+	struct timespec start;
 
 	health_code_update();
 
+	stats_time_begin(&start);
 	ret = ustctl_enable(app->sock, ua_event->obj);
+	app_cmd_latency(app, &start);
 	if (ret < 0) {
 		if (ret != -EPIPE && ret != -LTTNG_UST_ERR_EXITING) {
 			ERR("UST app event %s enable failed for app (pid: %d) "
@@ -1262,12 +1462,15 @@ int create_ust_event(struct ust_app *app, struct ust_app_session *ua_sess,
 		struct ust_app_channel *ua_chan, struct ust_app_event *ua_event)
 {
 	int ret = 0;
+	struct timespec start;
 
 	health_code_update();
 
 	/* Create UST event on tracer */
+	stats_time_begin(&start);
 	ret = ustctl_create_event(app->sock, &ua_event->attr, ua_chan->obj,
 			&ua_event->obj);
+	app_cmd_latency(app, &start);
 	if (ret < 0) {
 		if (ret != -EPIPE && ret != -LTTNG_UST_ERR_EXITING) {
 			ERR("Error ustctl create event %s for app pid: %d with ret %d",
@@ -1336,10 +1539,9 @@ static void shadow_copy_event(struct ust_app_event *ua_event,
 	/* Copy event attributes */
 	memcpy(&ua_event->attr, &uevent->attr, sizeof(ua_event->attr));
 
-	/* Copy filter bytecode */
+	/* Share the filter bytecode of the session event. */
 	if (uevent->filter) {
-		ua_event->filter = alloc_copy_ust_app_filter(uevent->filter);
-		/* Filter might be NULL here in case of ENONEM. */
+		ua_event->filter = ust_filter_ref(uevent->filter);
 	}
 }
 
@@ -1362,6 +1564,8 @@ static void shadow_copy_channel(struct ust_app_channel *ua_chan,
 
 	ua_chan->tracefile_size = uchan->tracefile_size;
 	ua_chan->tracefile_count = uchan->tracefile_count;
+	ua_chan->compression = uchan->compression;
+	ua_chan->live_timer_interval = uchan->live_timer_interval;
 
 	/* Copy event attributes since the layout is different. */
 	ua_chan->attr.subbuf_size = uchan->attr.subbuf_size;
@@ -1437,6 +1641,7 @@ static void shadow_copy_session(struct ust_app_session *ua_sess,
 	ua_sess->egid = usess->gid;
 	ua_sess->buffer_type = usess->buffer_type;
 	ua_sess->bits_per_long = app->bits_per_long;
+	ua_sess->snapshot_mode = usess->snapshot_mode;
 	/* There is only one consumer object per session possible. */
 	ua_sess->consumer = usess->consumer;
 
@@ -1657,6 +1862,7 @@ static int create_ust_app_session(struct ltt_ust_session *usess,
 {
 	int ret, created = 0;
 	struct ust_app_session *ua_sess;
+	struct timespec start;
 
 	assert(usess);
 	assert(app);
@@ -1702,7 +1908,9 @@ static int create_ust_app_session(struct ltt_ust_session *usess,
 	health_code_update();
 
 	if (ua_sess->handle == -1) {
+		stats_time_begin(&start);
 		ret = ustctl_create_session(app->sock);
+		app_cmd_latency(app, &start);
 		if (ret < 0) {
 			if (ret != -EPIPE && ret != -LTTNG_UST_ERR_EXITING) {
 				ERR("Creating session for app pid %d with ret %d",
@@ -2233,6 +2441,61 @@ error:
 	return ret;
 }
 
+/*
+ * Create the per UID buffers of a channel on the consumer and add them to the
+ * buffer registry of the UID. If regp is valid, it's set with the created
+ * buffer registry channel.
+ *
+ * Return 0 on success else a negative value.
+ */
+static int create_buffer_reg_uid_channel(struct ltt_ust_session *usess,
+		struct ust_app_session *ua_sess, struct ust_app_channel *ua_chan,
+		struct buffer_reg_uid *reg_uid, struct buffer_reg_channel **regp)
+{
+	int ret;
+	struct buffer_reg_channel *reg_chan;
+
+	/* Create the buffer registry channel object. */
+	ret = create_buffer_reg_channel(reg_uid->registry, ua_chan, &reg_chan);
+	if (ret < 0) {
+		goto error;
+	}
+	assert(reg_chan);
+
+	/*
+	 * Create the buffers on the consumer side. This call populates the
+	 * ust app channel object with all streams and data object.
+	 */
+	ret = do_consumer_create_channel(usess, ua_sess, ua_chan,
+			reg_uid->bits_per_long, reg_uid->registry->reg.ust);
+	if (ret < 0) {
+		/*
+		 * Let's remove the previously created buffer registry channel so
+		 * it's not visible anymore in the session registry.
+		 */
+		ust_registry_channel_del_free(reg_uid->registry->reg.ust,
+				ua_chan->tracing_channel_id);
+		buffer_reg_channel_remove(reg_uid->registry, reg_chan);
+		buffer_reg_channel_destroy(reg_chan, LTTNG_DOMAIN_UST);
+		goto error;
+	}
+
+	/*
+	 * Setup the streams and add it to the session registry.
+	 */
+	ret = setup_buffer_reg_channel(reg_uid->registry, ua_chan, reg_chan);
+	if (ret < 0) {
+		goto error;
+	}
+
+	if (regp) {
+		*regp = reg_chan;
+	}
+
+error:
+	return ret;
+}
+
 /*
  * Create and send to the application the created buffers with per UID buffers.
  *
@@ -2264,39 +2527,11 @@ static int create_channel_per_uid(struct ust_app *app,
 	reg_chan = buffer_reg_channel_find(ua_chan->tracing_channel_id,
 			reg_uid);
 	if (!reg_chan) {
-		/* Create the buffer registry channel object. */
-		ret = create_buffer_reg_channel(reg_uid->registry, ua_chan, &reg_chan);
-		if (ret < 0) {
-			goto error;
-		}
-		assert(reg_chan);
-
-		/*
-		 * Create the buffers on the consumer side. This call populates the
-		 * ust app channel object with all streams and data object.
-		 */
-		ret = do_consumer_create_channel(usess, ua_sess, ua_chan,
-				app->bits_per_long, reg_uid->registry->reg.ust);
-		if (ret < 0) {
-			/*
-			 * Let's remove the previously created buffer registry channel so
-			 * it's not visible anymore in the session registry.
-			 */
-			ust_registry_channel_del_free(reg_uid->registry->reg.ust,
-					ua_chan->tracing_channel_id);
-			buffer_reg_channel_remove(reg_uid->registry, reg_chan);
-			buffer_reg_channel_destroy(reg_chan, LTTNG_DOMAIN_UST);
-			goto error;
-		}
-
-		/*
-		 * Setup the streams and add it to the session registry.
-		 */
-		ret = setup_buffer_reg_channel(reg_uid->registry, ua_chan, reg_chan);
+		ret = create_buffer_reg_uid_channel(usess, ua_sess, ua_chan, reg_uid,
+				&reg_chan);
 		if (ret < 0) {
 			goto error;
 		}
-
 	}
 
 	/* Send buffers to the application. */
@@ -2741,6 +2976,8 @@ struct ust_app *ust_app_create(struct ust_register_msg *msg, int sock)
 	lttng_ht_node_init_ulong(&lta->sock_n, (unsigned long) lta->sock);
 
 	CDS_INIT_LIST_HEAD(&lta->teardown_head);
+	cds_wfq_node_init(&lta->reclaim_node);
+	pthread_mutex_init(&lta->tp_cache_lock, NULL);
 
 error:
 	return lta;
@@ -2821,7 +3058,7 @@ void ust_app_unregister(int sock)
 
 	rcu_read_lock();
 
-	/* Get the node reference for a call_rcu */
+	/* Get the node reference for the reclaim */
 	lttng_ht_lookup(ust_app_ht_by_sock, (void *)((unsigned long) sock), &iter);
 	node = lttng_ht_iter_get_node_ulong(&iter);
 	assert(node);
@@ -2857,8 +3094,6 @@ void ust_app_unregister(int sock)
 	/* Remove sessions so they are not visible during deletion.*/
 	cds_lfht_for_each_entry(lta->sessions->ht, &iter.iter, ua_sess,
 			node.node) {
-		struct ust_registry_session *registry;
-
 		ret = lttng_ht_del(lta->sessions, &iter);
 		if (ret) {
 			/* The session was already removed so scheduled for teardown. */
@@ -2870,42 +3105,18 @@ void ust_app_unregister(int sock)
 		 * are the only one using this list.
 		 */
 		pthread_mutex_lock(&ua_sess->lock);
-
-		/*
-		 * Normally, this is done in the delete session process which is
-		 * executed in the call rcu below. However, upon registration we can't
-		 * afford to wait for the grace period before pushing data or else the
-		 * data pending feature can race between the unregistration and stop
-		 * command where the data pending command is sent *before* the grace
-		 * period ended.
-		 *
-		 * The close metadata below nullifies the metadata pointer in the
-		 * session so the delete session will NOT push/close a second time.
-		 */
-		registry = get_session_registry(ua_sess);
-		if (registry && !registry->metadata_closed) {
-			/* Push metadata for application before freeing the application. */
-			(void) push_metadata(registry, ua_sess->consumer);
-
-			/*
-			 * Don't ask to close metadata for global per UID buffers. Close
-			 * metadata only on destroy trace session in this case. Also, the
-			 * previous push metadata could have flag the metadata registry to
-			 * close so don't send a close command if closed.
-			 */
-			if (ua_sess->buffer_type != LTTNG_BUFFER_PER_UID &&
-					!registry->metadata_closed) {
-				/* And ask to close it for this session registry. */
-				(void) close_metadata(registry, ua_sess->consumer);
-			}
-		}
-
 		cds_list_add(&ua_sess->teardown_node, &lta->teardown_head);
 		pthread_mutex_unlock(&ua_sess->lock);
 	}
 
-	/* Free memory */
-	call_rcu(&lta->pid_n.head, delete_ust_app_rcu);
+	/*
+	 * The metadata push and close, the grace period and the free are done by
+	 * the reclaim thread. The data pending and stop commands flush the queue
+	 * so they can't race with an unregistration whose metadata is not pushed
+	 * yet.
+	 */
+	cds_wfq_enqueue(&reclaim_queue.queue, &lta->reclaim_node);
+	futex_nto1_wake(&reclaim_queue.futex);
 
 	rcu_read_unlock();
 	return;
@@ -2926,108 +3137,365 @@ unsigned long ust_app_list_count(void)
 }
 
 /*
- * Fill events array with all events name of all registered apps.
+ * Fill the stats array with the command statistics of every registered app.
+ *
+ * Return the number of entries or else a negative value.
  */
-int ust_app_list_events(struct lttng_event **events)
+int ust_app_get_stats(struct lttng_health_app_stats **stats)
 {
-	int ret, handle;
+	int ret;
 	size_t nbmem, count = 0;
 	struct lttng_ht_iter iter;
 	struct ust_app *app;
-	struct lttng_event *tmp_event;
+	struct lttng_health_app_stats *tmp_stats;
 
-	nbmem = UST_APP_EVENT_LIST_SIZE;
-	tmp_event = zmalloc(nbmem * sizeof(struct lttng_event));
-	if (tmp_event == NULL) {
-		PERROR("zmalloc ust app events");
+	assert(stats);
+
+	rcu_read_lock();
+
+	/* The count is a hint. Apps can register while iterating. */
+	nbmem = max_t(size_t, lttng_ht_get_count(ust_app_ht), 1);
+	tmp_stats = zmalloc(nbmem * sizeof(*tmp_stats));
+	if (tmp_stats == NULL) {
+		PERROR("zmalloc ust app stats");
 		ret = -ENOMEM;
 		goto error;
 	}
 
-	rcu_read_lock();
-
 	cds_lfht_for_each_entry(ust_app_ht->ht, &iter.iter, app, pid_n.node) {
-		struct lttng_ust_tracepoint_iter uiter;
-
-		health_code_update();
-
-		if (!app->compatible) {
-			/*
-			 * TODO: In time, we should notice the caller of this error by
-			 * telling him that this is a version error.
-			 */
-			continue;
-		}
-		handle = ustctl_tracepoint_list(app->sock);
-		if (handle < 0) {
-			if (handle != -EPIPE && handle != -LTTNG_UST_ERR_EXITING) {
-				ERR("UST app list events getting handle failed for app pid %d",
-						app->pid);
-			}
-			continue;
-		}
-
-		while ((ret = ustctl_tracepoint_list_get(app->sock, handle,
-					&uiter)) != -LTTNG_UST_ERR_NOENT) {
-			/* Handle ustctl error. */
-			if (ret < 0) {
-				free(tmp_event);
-				if (ret != -LTTNG_UST_ERR_EXITING || ret != -EPIPE) {
-					ERR("UST app tp list get failed for app %d with ret %d",
-							app->sock, ret);
-				} else {
-					DBG3("UST app tp list get failed. Application is dead");
-				}
-				goto rcu_error;
-			}
-
-			health_code_update();
-			if (count >= nbmem) {
-				/* In case the realloc fails, we free the memory */
-				void *ptr;
-
-				DBG2("Reallocating event list from %zu to %zu entries", nbmem,
-						2 * nbmem);
-				nbmem *= 2;
-				ptr = realloc(tmp_event, nbmem * sizeof(struct lttng_event));
-				if (ptr == NULL) {
-					PERROR("realloc ust app events");
-					free(tmp_event);
-					ret = -ENOMEM;
-					goto rcu_error;
-				}
-				tmp_event = ptr;
-			}
-			memcpy(tmp_event[count].name, uiter.name, LTTNG_UST_SYM_NAME_LEN);
-			tmp_event[count].loglevel = uiter.loglevel;
-			tmp_event[count].type = (enum lttng_event_type) LTTNG_UST_TRACEPOINT;
-			tmp_event[count].pid = app->pid;
-			tmp_event[count].enabled = -1;
-			count++;
+		if (count >= nbmem) {
+			break;
 		}
+		tmp_stats[count].pid = app->pid;
+		stats_latency_get(&tmp_stats[count].cmd, &app->cmd_latency);
+		count++;
 	}
 
+	*stats = tmp_stats;
 	ret = count;
-	*events = tmp_event;
-
-	DBG2("UST app list events done (%zu events)", count);
 
-rcu_error:
-	rcu_read_unlock();
 error:
-	health_code_update();
+	rcu_read_unlock();
 	return ret;
 }
 
 /*
- * Fill events array with all events name of all registered apps.
+ * Fetch the tracepoint catalogue of the application. On success, *eventsp is
+ * set to an allocated array of *countp tracepoints.
+ *
+ * The app tp_cache_lock must NOT be held, the notify thread taking it while
+ * the application can be waiting for a notification to be answered. The RCU
+ * read side lock MUST be acquired.
+ *
+ * Return 0 on success or else a negative value.
  */
-int ust_app_list_event_fields(struct lttng_event_field **fields)
+static int fetch_app_tracepoints(struct ust_app *app,
+		struct lttng_event **eventsp, size_t *countp)
 {
 	int ret, handle;
 	size_t nbmem, count = 0;
-	struct lttng_ht_iter iter;
-	struct ust_app *app;
+	struct lttng_event *tmp_event;
+	struct lttng_ust_tracepoint_iter uiter;
+
+	handle = ustctl_tracepoint_list(app->sock);
+	if (handle < 0) {
+		if (handle != -EPIPE && handle != -LTTNG_UST_ERR_EXITING) {
+			ERR("UST app list events getting handle failed for app pid %d",
+					app->pid);
+		}
+		ret = handle;
+		goto error;
+	}
+
+	nbmem = UST_APP_EVENT_LIST_SIZE;
+	tmp_event = zmalloc(nbmem * sizeof(struct lttng_event));
+	if (tmp_event == NULL) {
+		PERROR("zmalloc ust app events");
+		ret = -ENOMEM;
+		goto error;
+	}
+
+	while ((ret = ustctl_tracepoint_list_get(app->sock, handle,
+				&uiter)) != -LTTNG_UST_ERR_NOENT) {
+		/* Handle ustctl error. */
+		if (ret < 0) {
+			if (ret != -LTTNG_UST_ERR_EXITING && ret != -EPIPE) {
+				ERR("UST app tp list get failed for app %d with ret %d",
+						app->sock, ret);
+			} else {
+				DBG3("UST app tp list get failed. Application is dead");
+			}
+			goto error_free;
+		}
+
+		health_code_update();
+		if (count >= nbmem) {
+			/* In case the realloc fails, we free the memory */
+			void *ptr;
+
+			DBG2("Reallocating event list from %zu to %zu entries", nbmem,
+					2 * nbmem);
+			nbmem *= 2;
+			ptr = realloc(tmp_event, nbmem * sizeof(struct lttng_event));
+			if (ptr == NULL) {
+				PERROR("realloc ust app events");
+				ret = -ENOMEM;
+				goto error_free;
+			}
+			tmp_event = ptr;
+		}
+		memset(&tmp_event[count], 0, sizeof(tmp_event[count]));
+		memcpy(tmp_event[count].name, uiter.name, LTTNG_UST_SYM_NAME_LEN);
+		tmp_event[count].loglevel = uiter.loglevel;
+		tmp_event[count].type = (enum lttng_event_type) LTTNG_UST_TRACEPOINT;
+		tmp_event[count].pid = app->pid;
+		tmp_event[count].enabled = -1;
+		count++;
+	}
+
+	*eventsp = tmp_event;
+	*countp = count;
+
+	DBG2("UST app pid %d tracepoint catalogue fetched (%zu events)",
+			app->pid, count);
+
+	return 0;
+
+error_free:
+	free(tmp_event);
+error:
+	return ret;
+}
+
+/*
+ * Return 1 if the cached tracepoint catalogue of the application holds the
+ * tracepoint name, else 0.
+ *
+ * The app tp_cache_lock MUST be held.
+ */
+static int app_tracepoints_has(struct ust_app *app, const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < app->nb_tracepoints; i++) {
+		if (!strncmp(app->tracepoints[i].name, name,
+					LTTNG_SYMBOL_NAME_LEN)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Return 1 if the cached tracepoint catalogue of the application is missing
+ * or older than DEFAULT_UST_TRACEPOINT_CACHE_TTL, else 0.
+ *
+ * The app tp_cache_lock MUST be held.
+ */
+static int app_tracepoints_expired(struct ust_app *app)
+{
+	int ret;
+	struct timespec now;
+
+	if (!app->tracepoints_cached) {
+		return 1;
+	}
+
+	ret = clock_gettime(CLOCK_MONOTONIC, &now);
+	if (ret < 0) {
+		PERROR("clock_gettime tracepoint cache");
+		return 1;
+	}
+	return now.tv_sec - app->tracepoints_time.tv_sec >=
+		DEFAULT_UST_TRACEPOINT_CACHE_TTL;
+}
+
+/*
+ * Replace the cached tracepoint catalogue of the application with the given
+ * fetched one. It is only marked valid if the cache was not invalidated since
+ * generation gen, when the fetch started.
+ *
+ * The app tp_cache_lock MUST be held.
+ */
+static void app_tracepoints_replace(struct ust_app *app,
+		struct lttng_event *events, size_t count, unsigned long gen)
+{
+	int ret;
+
+	free(app->tracepoints);
+	app->tracepoints = events;
+	app->nb_tracepoints = count;
+	app->tracepoints_cached = app->tracepoints_gen == gen;
+
+	ret = clock_gettime(CLOCK_MONOTONIC, &app->tracepoints_time);
+	if (ret < 0) {
+		PERROR("clock_gettime tracepoint cache");
+		app->tracepoints_cached = 0;
+	}
+}
+
+/*
+ * Append the tracepoints of the application matching the pattern (NULL or
+ * empty matches all) to the events array, growing it as needed. The catalogue
+ * is fetched from the application if not cached, expired, invalidated or if
+ * refresh is set.
+ *
+ * The RCU read side lock MUST be acquired.
+ *
+ * Return 0 on success, -ENOMEM on allocation failure or else a negative value
+ * meaning the application could not be queried.
+ */
+static int append_app_tracepoints(struct ust_app *app, int refresh,
+		const char *pattern, struct lttng_event **events, size_t *count,
+		size_t *nbmem)
+{
+	int ret = 0, fetch;
+	size_t i, nb_fetched;
+	unsigned long gen;
+	struct lttng_event *fetched;
+
+	pthread_mutex_lock(&app->tp_cache_lock);
+	fetch = refresh || app_tracepoints_expired(app);
+	gen = app->tracepoints_gen;
+	pthread_mutex_unlock(&app->tp_cache_lock);
+
+	if (fetch) {
+		ret = fetch_app_tracepoints(app, &fetched, &nb_fetched);
+		if (ret < 0) {
+			return ret;
+		}
+	}
+
+	pthread_mutex_lock(&app->tp_cache_lock);
+	if (fetch) {
+		app_tracepoints_replace(app, fetched, nb_fetched, gen);
+	}
+
+	for (i = 0; i < app->nb_tracepoints; i++) {
+		struct lttng_event *event = &app->tracepoints[i];
+
+		if (pattern && pattern[0] != '\0' &&
+				fnmatch(pattern, event->name, 0) != 0) {
+			continue;
+		}
+
+		if (*count >= *nbmem) {
+			/* In case the realloc fails, the caller frees the memory */
+			void *ptr;
+			size_t new_nbmem = max_t(size_t, 2 * *nbmem,
+					UST_APP_EVENT_LIST_SIZE);
+
+			DBG2("Reallocating event list from %zu to %zu entries", *nbmem,
+					new_nbmem);
+			ptr = realloc(*events, new_nbmem * sizeof(struct lttng_event));
+			if (ptr == NULL) {
+				PERROR("realloc ust app events");
+				ret = -ENOMEM;
+				goto end;
+			}
+			*events = ptr;
+			*nbmem = new_nbmem;
+		}
+		memcpy(&(*events)[*count], event, sizeof(*event));
+		(*count)++;
+	}
+
+end:
+	pthread_mutex_unlock(&app->tp_cache_lock);
+	return ret;
+}
+
+/*
+ * Fill events array with the tracepoints of the registered apps. Only the
+ * application with the given pid is listed if pid is not 0 and only the
+ * tracepoints matching the pattern are listed if not NULL.
+ */
+static int list_events(pid_t pid, const char *pattern, int refresh,
+		struct lttng_event **events)
+{
+	int ret;
+	size_t nbmem, count = 0;
+	struct lttng_ht_iter iter;
+	struct ust_app *app;
+	struct lttng_event *tmp_event;
+
+	nbmem = UST_APP_EVENT_LIST_SIZE;
+	tmp_event = zmalloc(nbmem * sizeof(struct lttng_event));
+	if (tmp_event == NULL) {
+		PERROR("zmalloc ust app events");
+		ret = -ENOMEM;
+		goto error;
+	}
+
+	rcu_read_lock();
+
+	cds_lfht_for_each_entry(ust_app_ht->ht, &iter.iter, app, pid_n.node) {
+		health_code_update();
+
+		if (!app->compatible) {
+			/*
+			 * TODO: In time, we should notice the caller of this error by
+			 * telling him that this is a version error.
+			 */
+			continue;
+		}
+		if (pid != 0 && app->pid != pid) {
+			continue;
+		}
+
+		ret = append_app_tracepoints(app, refresh, pattern, &tmp_event,
+				&count, &nbmem);
+		if (ret == -ENOMEM) {
+			free(tmp_event);
+			goto rcu_error;
+		}
+		/* On any other error, the application is skipped. */
+	}
+
+	ret = count;
+	*events = tmp_event;
+
+	DBG2("UST app list events done (%zu events)", count);
+
+rcu_error:
+	rcu_read_unlock();
+error:
+	health_code_update();
+	return ret;
+}
+
+/*
+ * Fill events array with all events name of all registered apps.
+ *
+ * The applications are queried so this also refreshes their cached catalogue.
+ */
+int ust_app_list_events(struct lttng_event **events)
+{
+	return list_events(0, NULL, 1, events);
+}
+
+/*
+ * Fill events array with the events of the registered apps matching the pid
+ * (0 for all) and the fnmatch pattern (NULL or empty for all).
+ *
+ * The cached catalogue of the applications is used so only the applications
+ * registered since the last listing are queried.
+ */
+int ust_app_list_events_cached(pid_t pid, const char *pattern,
+		struct lttng_event **events)
+{
+	return list_events(pid, pattern, 0, events);
+}
+
+/*
+ * Fill events array with all events name of all registered apps.
+ */
+int ust_app_list_event_fields(struct lttng_event_field **fields)
+{
+	int ret, handle;
+	size_t nbmem, count = 0;
+	struct lttng_ht_iter iter;
+	struct ust_app *app;
 	struct lttng_event_field *tmp_event;
 
 	nbmem = UST_APP_EVENT_LIST_SIZE;
@@ -3131,6 +3599,9 @@ void ust_app_clean_list(void)
 
 	DBG2("UST app cleaning registered apps hash table");
 
+	/* Applications unregistered after the reclaim thread exited. */
+	ust_app_reclaim_flush();
+
 	rcu_read_lock();
 
 	cds_lfht_for_each_entry(ust_app_ht->ht, &iter.iter, app, pid_n.node) {
@@ -3161,13 +3632,14 @@ void ust_app_clean_list(void)
 }
 
 /*
- * Init UST app hash table.
+ * Init UST app hash table and reclaim queue.
  */
 void ust_app_ht_alloc(void)
 {
 	ust_app_ht = lttng_ht_new(0, LTTNG_HT_TYPE_ULONG);
 	ust_app_ht_by_sock = lttng_ht_new(0, LTTNG_HT_TYPE_ULONG);
 	ust_app_ht_by_notify_sock = lttng_ht_new(0, LTTNG_HT_TYPE_ULONG);
+	cds_wfq_init(&reclaim_queue.queue);
 }
 
 /*
@@ -3630,6 +4102,7 @@ int ust_app_start_trace(struct ltt_ust_session *usess, struct ust_app *app)
 {
 	int ret = 0;
 	struct ust_app_session *ua_sess;
+	struct timespec start;
 
 	DBG("Starting tracing for ust app pid %d", app->pid);
 
@@ -3678,7 +4151,9 @@ int ust_app_start_trace(struct ltt_ust_session *usess, struct ust_app *app)
 
 skip_setup:
 	/* This start the UST tracing */
+	stats_time_begin(&start);
 	ret = ustctl_start_session(app->sock, ua_sess->handle);
+	app_cmd_latency(app, &start);
 	if (ret < 0) {
 		if (ret != -EPIPE && ret != -LTTNG_UST_ERR_EXITING) {
 			ERR("Error starting tracing for app pid: %d (ret: %d)",
@@ -3697,7 +4172,9 @@ skip_setup:
 	health_code_update();
 
 	/* Quiescent wait after starting trace */
+	stats_time_begin(&start);
 	ret = ustctl_wait_quiescent(app->sock);
+	app_cmd_latency(app, &start);
 	if (ret < 0 && ret != -EPIPE && ret != -LTTNG_UST_ERR_EXITING) {
 		ERR("UST app wait quiescent failed for app pid %d ret %d",
 				app->pid, ret);
@@ -3724,6 +4201,7 @@ int ust_app_stop_trace(struct ltt_ust_session *usess, struct ust_app *app)
 	int ret = 0;
 	struct ust_app_session *ua_sess;
 	struct ust_registry_session *registry;
+	struct timespec start;
 
 	DBG("Stopping tracing for ust app pid %d", app->pid);
 
@@ -3753,7 +4231,9 @@ int ust_app_stop_trace(struct ltt_ust_session *usess, struct ust_app *app)
 	health_code_update();
 
 	/* This inhibits UST tracing */
+	stats_time_begin(&start);
 	ret = ustctl_stop_session(app->sock, ua_sess->handle);
+	app_cmd_latency(app, &start);
 	if (ret < 0) {
 		if (ret != -EPIPE && ret != -LTTNG_UST_ERR_EXITING) {
 			ERR("Error stopping tracing for app pid: %d (ret: %d)",
@@ -3767,7 +4247,9 @@ int ust_app_stop_trace(struct ltt_ust_session *usess, struct ust_app *app)
 	health_code_update();
 
 	/* Quiescent wait after stopping trace */
+	stats_time_begin(&start);
 	ret = ustctl_wait_quiescent(app->sock);
+	app_cmd_latency(app, &start);
 	if (ret < 0 && ret != -EPIPE && ret != -LTTNG_UST_ERR_EXITING) {
 		ERR("UST app wait quiescent failed for app pid %d ret %d",
 				app->pid, ret);
@@ -3806,6 +4288,7 @@ int ust_app_flush_trace(struct ltt_ust_session *usess, struct ust_app *app)
 	struct lttng_ht_iter iter;
 	struct ust_app_session *ua_sess;
 	struct ust_app_channel *ua_chan;
+	struct timespec start;
 
 	DBG("Flushing buffers for ust app pid %d", app->pid);
 
@@ -3829,7 +4312,9 @@ int ust_app_flush_trace(struct ltt_ust_session *usess, struct ust_app *app)
 			node.node) {
 		health_code_update();
 		assert(ua_chan->is_sent);
+		stats_time_begin(&start);
 		ret = ustctl_sock_flush_buffer(app->sock, ua_chan->obj);
+		app_cmd_latency(app, &start);
 		if (ret < 0) {
 			if (ret != -EPIPE && ret != -LTTNG_UST_ERR_EXITING) {
 				ERR("UST app PID %d channel %s flush failed with ret %d",
@@ -3863,6 +4348,7 @@ static int destroy_trace(struct ltt_ust_session *usess, struct ust_app *app)
 	struct ust_app_session *ua_sess;
 	struct lttng_ht_iter iter;
 	struct lttng_ht_node_ulong *node;
+	struct timespec start;
 
 	DBG("Destroy tracing for ust app pid %d", app->pid);
 
@@ -3886,7 +4372,9 @@ static int destroy_trace(struct ltt_ust_session *usess, struct ust_app *app)
 	health_code_update();
 
 	/* Quiescent wait after stopping trace */
+	stats_time_begin(&start);
 	ret = ustctl_wait_quiescent(app->sock);
+	app_cmd_latency(app, &start);
 	if (ret < 0 && ret != -EPIPE && ret != -LTTNG_UST_ERR_EXITING) {
 		ERR("UST app wait quiescent failed for app pid %d ret %d",
 				app->pid, ret);
@@ -3923,6 +4411,215 @@ int ust_app_start_trace_all(struct ltt_ust_session *usess)
 	return 0;
 }
 
+/*
+ * Return the primary group of a user, or a group of the same value if it is
+ * unknown. getpwuid() is not used since the client and application threads
+ * look users up concurrently.
+ */
+static gid_t get_uid_gid(uid_t uid)
+{
+	int ret;
+	long buf_len;
+	char *buf;
+	gid_t gid = (gid_t) uid;
+	struct passwd pwd, *pw = NULL;
+
+	buf_len = sysconf(_SC_GETPW_R_SIZE_MAX);
+	if (buf_len < 0) {
+		buf_len = DEFAULT_GETPW_BUF_LEN;
+	}
+	buf = zmalloc(buf_len);
+	if (!buf) {
+		PERROR("zmalloc passwd buffer");
+		goto end;
+	}
+
+	ret = getpwuid_r(uid, &pwd, buf, buf_len, &pw);
+	if (ret) {
+		errno = ret;
+		PERROR("getpwuid_r %d", (int) uid);
+	} else if (pw) {
+		gid = pw->pw_gid;
+	}
+	free(buf);
+
+end:
+	return gid;
+}
+
+/*
+ * Fill the description of an application of a UID for which per UID buffers
+ * are created before any of its applications registers. The ABI is the one of
+ * the session registry if the buffers already exist, else the one of a
+ * registered application of the session daemon bitness.
+ *
+ * RCU read side lock must be held.
+ *
+ * Return 0 on success or -ENOENT if no registered application gives the ABI.
+ */
+static int init_provision_app(struct ust_app *app, uid_t uid,
+		struct ust_registry_session *registry)
+{
+	struct lttng_ht_iter iter;
+	struct ust_app *reg_app;
+
+	memset(app, 0, sizeof(*app));
+	app->sock = -1;
+	app->notify_sock = -1;
+	app->pid = -1;
+	app->uid = uid;
+	app->gid = get_uid_gid(uid);
+	snprintf(app->name, sizeof(app->name), "uid-%d", (int) uid);
+
+	if (registry) {
+		app->bits_per_long = registry->bits_per_long;
+		app->uint8_t_alignment = registry->uint8_t_alignment;
+		app->uint16_t_alignment = registry->uint16_t_alignment;
+		app->uint32_t_alignment = registry->uint32_t_alignment;
+		app->uint64_t_alignment = registry->uint64_t_alignment;
+		app->long_alignment = registry->long_alignment;
+		app->byte_order = registry->byte_order;
+		app->version.major = registry->major;
+		app->version.minor = registry->minor;
+		return 0;
+	}
+
+	cds_lfht_for_each_entry(ust_app_ht->ht, &iter.iter, reg_app, pid_n.node) {
+		if (!reg_app->compatible ||
+				reg_app->bits_per_long != CAA_BITS_PER_LONG) {
+			continue;
+		}
+		app->bits_per_long = reg_app->bits_per_long;
+		app->uint8_t_alignment = reg_app->uint8_t_alignment;
+		app->uint16_t_alignment = reg_app->uint16_t_alignment;
+		app->uint32_t_alignment = reg_app->uint32_t_alignment;
+		app->uint64_t_alignment = reg_app->uint64_t_alignment;
+		app->long_alignment = reg_app->long_alignment;
+		app->byte_order = reg_app->byte_order;
+		app->version = reg_app->version;
+		return 0;
+	}
+
+	return -ENOENT;
+}
+
+/*
+ * Create the buffer registry, metadata and channel buffers of a per UID
+ * session for a UID, so its first application only duplicates them.
+ *
+ * Return 0 on success, -ENOENT if no registered application gives the ABI of
+ * the buffers yet, else a negative value.
+ */
+static int provision_uid_buffers(struct ltt_ust_session *usess, uid_t uid)
+{
+	int ret;
+	struct lttng_ht_iter iter;
+	struct ust_app app;
+	struct ust_app_session *ua_sess;
+	struct ust_app_channel *ua_chan;
+	struct ltt_ust_channel *uchan;
+	struct buffer_reg_uid *reg_uid;
+	struct ustctl_consumer_channel_attr attr, *attrp = NULL;
+
+	rcu_read_lock();
+
+	reg_uid = buffer_reg_uid_find(usess->id, CAA_BITS_PER_LONG, uid);
+	ret = init_provision_app(&app, uid,
+			reg_uid ? reg_uid->registry->reg.ust : NULL);
+	if (ret < 0) {
+		goto error;
+	}
+	if (!reg_uid) {
+		ret = setup_buffer_reg_uid(usess, &app, &reg_uid);
+		if (ret < 0) {
+			goto error;
+		}
+	}
+
+	/* Temporary app session holding the channels of the session. */
+	ua_sess = alloc_ust_app_session(&app);
+	if (!ua_sess) {
+		ret = -ENOMEM;
+		goto error;
+	}
+	shadow_copy_session(ua_sess, usess, &app);
+
+	cds_lfht_for_each_entry(ua_sess->channels->ht, &iter.iter, ua_chan,
+			node.node) {
+		if (!strncmp(ua_chan->name, DEFAULT_METADATA_NAME,
+					sizeof(ua_chan->name))) {
+			continue;
+		}
+		if (buffer_reg_channel_find(ua_chan->tracing_channel_id, reg_uid)) {
+			/* Already created by an application or a previous start. */
+			continue;
+		}
+		ret = create_buffer_reg_uid_channel(usess, ua_sess, ua_chan, reg_uid,
+				NULL);
+		if (ret < 0) {
+			goto error_session;
+		}
+	}
+
+	uchan = trace_ust_find_channel_by_name(usess->domain_global.channels,
+			DEFAULT_METADATA_NAME);
+	if (uchan) {
+		copy_channel_attr_to_ustctl(&attr, &uchan->attr);
+		attrp = &attr;
+	}
+	ret = create_ust_app_metadata(ua_sess, &app, usess->consumer, attrp);
+	if (ret < 0) {
+		goto error_session;
+	}
+
+	DBG("UST per UID buffers provisioned for uid %d", (int) uid);
+
+error_session:
+	delete_ust_app_session(-1, ua_sess, &app);
+error:
+	rcu_read_unlock();
+	return ret;
+}
+
+/*
+ * Create ahead of time the per UID buffers of a session for the UIDs set with
+ * lttng_set_provision_uids(). The first application of each of them then only
+ * duplicates the buffer objects instead of waiting for the consumer in its
+ * constructor.
+ *
+ * Buffers are provisioned for the session daemon bitness with the ABI of a
+ * registered application. If there is none yet, provisioning is left pending
+ * until one registers, see ust_app_global_update(). The UIDs are provisioned
+ * independently, an error being logged before trying the next.
+ *
+ * The session lock must be held.
+ */
+void ust_app_provision_uid_buffers(struct ltt_ust_session *usess)
+{
+	int ret;
+	unsigned int i;
+
+	assert(usess);
+
+	usess->provision_pending = 0;
+	if (usess->buffer_type != LTTNG_BUFFER_PER_UID) {
+		return;
+	}
+
+	for (i = 0; i < usess->nb_provision_uids; i++) {
+		ret = provision_uid_buffers(usess, usess->provision_uids[i]);
+		if (ret == -ENOENT) {
+			DBG("No application gives the ABI of per UID buffers yet, provisioning of session %d pending",
+					usess->id);
+			usess->provision_pending = 1;
+			break;
+		} else if (ret < 0) {
+			ERR("Provisioning per UID buffers of uid %d failed with ret %d",
+					(int) usess->provision_uids[i], ret);
+		}
+	}
+}
+
 /*
  * Start tracing for the UST session.
  */
@@ -3994,6 +4691,160 @@ int ust_app_stop_trace_all(struct ltt_ust_session *usess)
 	return 0;
 }
 
+/*
+ * Ask the consumers to record a snapshot of the UST session buffers, per UID
+ * and per PID, in path. The metadata is recorded from the metadata cache of
+ * the consumer. max_stream_size bounds the bytes recorded per stream.
+ *
+ * The session lock MUST be acquired.
+ *
+ * Return 0 on success or else a negative value.
+ */
+int ust_app_snapshot_record(struct ltt_ust_session *usess, const char *path,
+		uint64_t max_stream_size)
+{
+	int ret = 0;
+	struct lttng_ht_iter iter;
+	struct ust_app *app;
+	char pathname[PATH_MAX];
+
+	assert(usess);
+	assert(path);
+
+	rcu_read_lock();
+
+	switch (usess->buffer_type) {
+	case LTTNG_BUFFER_PER_UID:
+	{
+		struct buffer_reg_uid *reg;
+
+		cds_list_for_each_entry(reg, &usess->buffer_reg_uid_list, lnode) {
+			struct buffer_reg_channel *reg_chan;
+			struct consumer_socket *socket;
+
+			/* Get consumer socket to use to record the snapshot. */
+			socket = consumer_find_socket_by_bitness(reg->bits_per_long,
+					usess->consumer);
+			if (!socket) {
+				ret = -EINVAL;
+				goto error;
+			}
+
+			ret = snprintf(pathname, sizeof(pathname),
+					"%s" DEFAULT_UST_TRACE_UID_PATH, path, reg->uid,
+					reg->bits_per_long);
+			if (ret < 0) {
+				PERROR("snprintf snapshot path");
+				goto error;
+			}
+			if (usess->consumer->type == CONSUMER_DST_LOCAL) {
+				ret = run_as_mkdir_recursive(pathname, S_IRWXU | S_IRWXG,
+						usess->uid, usess->gid);
+				if (ret < 0 && ret != -EEXIST) {
+					ERR("Snapshot directory creation error");
+					goto error;
+				}
+			}
+
+			cds_lfht_for_each_entry(reg->registry->channels->ht,
+					&iter.iter, reg_chan, node.node) {
+				ret = consumer_snapshot_channel(socket,
+						reg_chan->consumer_key, usess->consumer, 0,
+						pathname, max_stream_size);
+				if (ret < 0) {
+					goto error;
+				}
+			}
+
+			/* Make sure the consumer has the whole metadata. */
+			(void) push_metadata(reg->registry->reg.ust, usess->consumer);
+			if (reg->registry->reg.ust->metadata_key) {
+				ret = consumer_snapshot_channel(socket,
+						reg->registry->reg.ust->metadata_key,
+						usess->consumer, 1, pathname, 0);
+				if (ret < 0) {
+					goto error;
+				}
+			}
+		}
+		break;
+	}
+	case LTTNG_BUFFER_PER_PID:
+		cds_lfht_for_each_entry(ust_app_ht->ht, &iter.iter, app, pid_n.node) {
+			struct consumer_socket *socket;
+			struct lttng_ht_iter chan_iter;
+			struct ust_app_channel *ua_chan;
+			struct ust_app_session *ua_sess;
+			struct ust_registry_session *registry;
+
+			ua_sess = lookup_session_by_app(usess, app);
+			if (!ua_sess) {
+				/* Session not associated with this app. */
+				continue;
+			}
+
+			/* Get the right consumer socket for the application. */
+			socket = consumer_find_socket_by_bitness(app->bits_per_long,
+					usess->consumer);
+			if (!socket) {
+				ret = -EINVAL;
+				goto error;
+			}
+
+			ret = snprintf(pathname, sizeof(pathname), "%s%s", path,
+					ua_sess->path);
+			if (ret < 0) {
+				PERROR("snprintf snapshot path");
+				goto error;
+			}
+			if (usess->consumer->type == CONSUMER_DST_LOCAL) {
+				ret = run_as_mkdir_recursive(pathname, S_IRWXU | S_IRWXG,
+						ua_sess->euid, ua_sess->egid);
+				if (ret < 0 && ret != -EEXIST) {
+					ERR("Snapshot directory creation error");
+					goto error;
+				}
+			}
+
+			/* An application exiting meanwhile doesn't fail the snapshot. */
+			cds_lfht_for_each_entry(ua_sess->channels->ht, &chan_iter.iter,
+					ua_chan, node.node) {
+				ret = consumer_snapshot_channel(socket, ua_chan->key,
+						usess->consumer, 0, pathname, max_stream_size);
+				if (ret < 0) {
+					DBG("UST app pid %d snapshot of channel %s failed",
+							app->pid, ua_chan->name);
+				}
+			}
+
+			registry = get_session_registry(ua_sess);
+			if (registry) {
+				/* Make sure the consumer has the whole metadata. */
+				(void) push_metadata(registry, usess->consumer);
+				if (registry->metadata_key) {
+					ret = consumer_snapshot_channel(socket,
+							registry->metadata_key, usess->consumer, 1,
+							pathname, 0);
+					if (ret < 0) {
+						DBG("UST app pid %d snapshot of metadata failed",
+								app->pid);
+					}
+				}
+			}
+		}
+		break;
+	default:
+		assert(0);
+		break;
+	}
+
+	ret = 0;
+
+error:
+	rcu_read_unlock();
+	return ret;
+}
+
 /*
  * Destroy app UST session.
  */
@@ -4126,6 +4977,12 @@ void ust_app_global_update(struct ltt_ust_session *usess, int sock)
 		}
 
 		DBG2("UST trace started for app pid %d", app->pid);
+
+		/* The first application of the daemon bitness gives the ABI. */
+		if (usess->provision_pending &&
+				app->bits_per_long == CAA_BITS_PER_LONG) {
+			ust_app_provision_uid_buffers(usess);
+		}
 	}
 
 	/* Everything went well at this point. */
@@ -4329,6 +5186,7 @@ int ust_app_calibrate_glb(struct lttng_ust_calibrate *calibrate)
 	int ret = 0;
 	struct lttng_ht_iter iter;
 	struct ust_app *app;
+	struct timespec start;
 
 	rcu_read_lock();
 
@@ -4343,7 +5201,9 @@ int ust_app_calibrate_glb(struct lttng_ust_calibrate *calibrate)
 
 		health_code_update();
 
+		stats_time_begin(&start);
 		ret = ustctl_calibrate(app->sock, calibrate);
+		app_cmd_latency(app, &start);
 		if (ret < 0) {
 			switch (ret) {
 			case -ENOSYS:
@@ -4581,6 +5441,18 @@ static int add_event_ust_registry(int sock, int sobjd, int cobjd, char *name,
 		goto error_rcu_unlock;
 	}
 
+	/*
+	 * An event missing from the cached tracepoint catalogue comes from a
+	 * probe provider loaded since it was fetched.
+	 */
+	pthread_mutex_lock(&app->tp_cache_lock);
+	if (app->tracepoints_cached &&
+			!app_tracepoints_has(app, name)) {
+		app->tracepoints_cached = 0;
+		app->tracepoints_gen++;
+	}
+	pthread_mutex_unlock(&app->tp_cache_lock);
+
 	/* Lookup channel by UST object descriptor. Should always be found. */
 	ua_chan = find_channel_by_objd(app, cobjd);
 	assert(ua_chan);
@@ -19,6 +19,9 @@
 #define _LTT_UST_APP_H
 
 #include <stdint.h>
+#include <time.h>
+
+#include <urcu/wfqueue.h>
 
 #include <common/compat/uuid.h>
 #include "trace-ust.h"
@@ -145,6 +148,8 @@ struct ust_app_channel {
 	struct lttng_ht *events;
 	uint64_t tracefile_size;
 	uint64_t tracefile_count;
+	enum lttng_compression compression;
+	unsigned int live_timer_interval;	/* usec */
 	/*
 	 * Node indexed by channel name in the channels' hash table of a session.
 	 */
@@ -195,6 +200,8 @@ struct ust_app_session {
 	enum lttng_buffer_type buffer_type;
 	/* ABI of the session. Same value as the application. */
 	uint32_t bits_per_long;
+	/* Channel streams are kept by the consumer for the snapshots. */
+	unsigned int snapshot_mode;
 	/* For delayed reclaim */
 	struct rcu_head rcu_head;
 };
@@ -244,10 +251,32 @@ struct ust_app {
 	 * when a session is destroyed.
 	 */
 	struct cds_list_head teardown_head;
+	/* Node of the reclaim queue once the application unregistered. */
+	struct cds_wfq_node reclaim_node;
 	/*
 	 * Hash table containing ust_app_channel indexed by channel objd.
 	 */
 	struct lttng_ht *ust_objd;
+	/*
+	 * Cached tracepoint catalogue of the application, fetched on the first
+	 * query and dropped with the application on unregistration. It expires
+	 * DEFAULT_UST_TRACEPOINT_CACHE_TTL seconds after being fetched and is
+	 * invalidated when the application registers an event missing from it,
+	 * which means a probe provider was loaded since. tracepoints_gen counts
+	 * the invalidations so a fetch racing with one is not kept. Protected
+	 * by the tp_cache_lock, which is never held while querying the
+	 * application.
+	 */
+	pthread_mutex_t tp_cache_lock;
+	struct lttng_event *tracepoints;
+	size_t nb_tracepoints;
+	int tracepoints_cached;
+	struct timespec tracepoints_time;
+	unsigned long tracepoints_gen;
+	/* Round trip statistics of the commands sent to the application. */
+	struct lttng_health_latency cmd_latency;
+	/* Time at which the application connected to register. */
+	struct timespec registration_time;
 };
 
 #ifdef HAVE_LIBLTTNG_UST_CTL
@@ -261,10 +290,16 @@ int ust_app_register_done(int sock)
 int ust_app_version(struct ust_app *app);
 void ust_app_unregister(int sock);
 unsigned long ust_app_list_count(void);
+int ust_app_get_stats(struct lttng_health_app_stats **stats);
 int ust_app_start_trace_all(struct ltt_ust_session *usess);
+void ust_app_provision_uid_buffers(struct ltt_ust_session *usess);
 int ust_app_stop_trace_all(struct ltt_ust_session *usess);
 int ust_app_destroy_trace_all(struct ltt_ust_session *usess);
+int ust_app_snapshot_record(struct ltt_ust_session *usess, const char *path,
+		uint64_t max_stream_size);
 int ust_app_list_events(struct lttng_event **events);
+int ust_app_list_events_cached(pid_t pid, const char *pattern,
+		struct lttng_event **events);
 int ust_app_list_event_fields(struct lttng_event_field **fields);
 int ust_app_create_channel_glb(struct ltt_ust_session *usess,
 		struct ltt_ust_channel *uchan);
@@ -294,6 +329,9 @@ void ust_app_global_update(struct ltt_ust_session *usess, int sock);
 
 void ust_app_clean_list(void);
 void ust_app_ht_alloc(void);
+void *ust_app_thread_reclaim(void *data);
+void ust_app_reclaim_stop(void);
+void ust_app_reclaim_flush(void);
 struct lttng_ht *ust_app_get_ht(void);
 struct ust_app *ust_app_find_by_pid(pid_t pid);
 int ust_app_calibrate_glb(struct lttng_ust_calibrate *calibrate);
@@ -324,16 +362,32 @@ int ust_app_start_trace_all(struct ltt_ust_session *usess)
 	return 0;
 }
 static inline
+void ust_app_provision_uid_buffers(struct ltt_ust_session *usess)
+{
+}
+static inline
 int ust_app_stop_trace_all(struct ltt_ust_session *usess)
 {
 	return 0;
 }
 static inline
+int ust_app_snapshot_record(struct ltt_ust_session *usess, const char *path,
+		uint64_t max_stream_size)
+{
+	return 0;
+}
+static inline
 int ust_app_list_events(struct lttng_event **events)
 {
 	return -ENOSYS;
 }
 static inline
+int ust_app_list_events_cached(pid_t pid, const char *pattern,
+		struct lttng_event **events)
+{
+	return -ENOSYS;
+}
+static inline
 int ust_app_list_event_fields(struct lttng_event_field **fields)
 {
 	return -ENOSYS;
@@ -363,6 +417,12 @@ unsigned int ust_app_list_count(void)
 	return 0;
 }
 static inline
+int ust_app_get_stats(struct lttng_health_app_stats **stats)
+{
+	*stats = NULL;
+	return 0;
+}
+static inline
 void ust_app_lock_list(void)
 {
 }
@@ -393,6 +453,17 @@ static inline
 void ust_app_ht_alloc(void)
 {}
 static inline
+void *ust_app_thread_reclaim(void *data)
+{
+	return NULL;
+}
+static inline
+void ust_app_reclaim_stop(void)
+{}
+static inline
+void ust_app_reclaim_flush(void)
+{}
+static inline
 void ust_app_global_update(struct ltt_ust_session *usess, int sock)
 {}
 static inline
@@ -157,7 +157,12 @@ static int ask_channel_creation(struct ust_app_session *ua_sess,
 			registry->uuid,
 			chan_id,
 			ua_chan->tracefile_size,
-			ua_chan->tracefile_count);
+			ua_chan->tracefile_count,
+			ua_chan->compression,
+			ua_chan->live_timer_interval,
+			/* Snapshot sessions still consume their metadata. */
+			!ua_sess->snapshot_mode ||
+				ua_chan->attr.type == LTTNG_UST_CHAN_METADATA);
 
 	health_code_update();
 
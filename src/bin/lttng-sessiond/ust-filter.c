@@ -0,0 +1,212 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <pthread.h>
+#include <string.h>
+
+#include <common/common.h>
+#include <common/hashtable/utils.h>
+
+#include "ust-filter.h"
+
+/*
+ * Content addressed registry of filter bytecode. Objects are indexed by the
+ * hash of the bytecode and matched on the full content. Allocated on first
+ * use and protected by the registry lock for every lookup, add and delete so
+ * a reference can never be taken on an object being removed.
+ */
+static struct lttng_ht *filter_registry;
+static pthread_mutex_t filter_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Return the hash of a filter bytecode content. The sequence number is not
+ * part of the content since it only orders filters on the tracer side.
+ */
+static unsigned long hash_filter(const struct lttng_ust_filter_bytecode *bytecode)
+{
+	unsigned long hash;
+
+	hash = hash_key_buf(bytecode->data, bytecode->len, lttng_ht_seed);
+	return hash ^ hash_key_ulong((void *) (unsigned long) bytecode->reloc_offset,
+			lttng_ht_seed);
+}
+
+/*
+ * Match function for the filter registry hash table.
+ */
+static int ht_match_filter(struct cds_lfht_node *node, const void *_key)
+{
+	struct ust_filter *filter;
+	const struct lttng_ust_filter_bytecode *key;
+
+	assert(node);
+	assert(_key);
+
+	filter = caa_container_of(node, struct ust_filter, node.node);
+	key = _key;
+
+	if (filter->bytecode.len != key->len ||
+			filter->bytecode.reloc_offset != key->reloc_offset) {
+		goto no_match;
+	}
+
+	if (memcmp(filter->bytecode.data, key->data, key->len) != 0) {
+		goto no_match;
+	}
+
+	/* Match. */
+	return 1;
+
+no_match:
+	return 0;
+}
+
+/*
+ * Free filter object from an RCU head.
+ */
+static void destroy_filter_rcu(struct rcu_head *head)
+{
+	struct lttng_ht_node_ulong *node =
+		caa_container_of(head, struct lttng_ht_node_ulong, head);
+	struct ust_filter *filter =
+		caa_container_of(node, struct ust_filter, node);
+
+	free(filter);
+}
+
+/*
+ * Return a shared copy of the given filter bytecode with a reference taken on
+ * it. If an identical bytecode is already registered, it is reused else a new
+ * copy is added to the registry. The given bytecode is not kept and remains
+ * owned by the caller.
+ *
+ * Return the shared bytecode or NULL on error.
+ */
+struct lttng_ust_filter_bytecode *ust_filter_get(
+		const struct lttng_ust_filter_bytecode *bytecode)
+{
+	unsigned long hash;
+	struct cds_lfht_node *node;
+	struct cds_lfht_iter iter;
+	struct ust_filter *filter = NULL;
+
+	assert(bytecode);
+
+	hash = hash_filter(bytecode);
+
+	rcu_read_lock();
+	pthread_mutex_lock(&filter_registry_lock);
+
+	if (!filter_registry) {
+		filter_registry = lttng_ht_new(0, LTTNG_HT_TYPE_ULONG);
+		if (!filter_registry) {
+			goto end;
+		}
+	}
+
+	cds_lfht_lookup(filter_registry->ht, hash, ht_match_filter, bytecode,
+			&iter);
+	node = cds_lfht_iter_get_node(&iter);
+	if (node) {
+		filter = caa_container_of(node, struct ust_filter, node.node);
+		filter->refcount++;
+		DBG3("UST filter bytecode of len %u shared (refcount: %lu)",
+				bytecode->len, filter->refcount);
+		goto end;
+	}
+
+	filter = zmalloc(sizeof(*filter) + bytecode->len);
+	if (!filter) {
+		PERROR("zmalloc ust filter");
+		goto end;
+	}
+	memcpy(&filter->bytecode, bytecode, sizeof(*bytecode) + bytecode->len);
+	filter->refcount = 1;
+	lttng_ht_node_init_ulong(&filter->node, hash);
+	node = cds_lfht_add_unique(filter_registry->ht, hash, ht_match_filter,
+			&filter->bytecode, &filter->node.node);
+	assert(node == &filter->node.node);
+
+	DBG3("UST filter bytecode of len %u added to the registry",
+			bytecode->len);
+
+end:
+	pthread_mutex_unlock(&filter_registry_lock);
+	rcu_read_unlock();
+	return filter ? &filter->bytecode : NULL;
+}
+
+/*
+ * Take an additional reference on a bytecode previously returned by
+ * ust_filter_get(). This avoids hashing the content again when a filter is
+ * copied from an object to another.
+ *
+ * Return the same bytecode pointer.
+ */
+struct lttng_ust_filter_bytecode *ust_filter_ref(
+		struct lttng_ust_filter_bytecode *bytecode)
+{
+	struct ust_filter *filter;
+
+	assert(bytecode);
+
+	filter = caa_container_of(bytecode, struct ust_filter, bytecode);
+
+	pthread_mutex_lock(&filter_registry_lock);
+	assert(filter->refcount > 0);
+	filter->refcount++;
+	pthread_mutex_unlock(&filter_registry_lock);
+
+	return bytecode;
+}
+
+/*
+ * Release a reference on a bytecode returned by ust_filter_get() or
+ * ust_filter_ref(). The shared object is removed from the registry and freed
+ * once the last reference is released. It is safe to pass a NULL pointer.
+ */
+void ust_filter_put(struct lttng_ust_filter_bytecode *bytecode)
+{
+	int ret;
+	struct ust_filter *filter;
+	struct lttng_ht_iter iter;
+
+	if (!bytecode) {
+		return;
+	}
+
+	filter = caa_container_of(bytecode, struct ust_filter, bytecode);
+
+	rcu_read_lock();
+	pthread_mutex_lock(&filter_registry_lock);
+	assert(filter->refcount > 0);
+	if (--filter->refcount > 0) {
+		goto end;
+	}
+
+	iter.iter.node = &filter->node.node;
+	ret = lttng_ht_del(filter_registry, &iter);
+	assert(!ret);
+	call_rcu(&filter->node.head, destroy_filter_rcu);
+
+	DBG3("UST filter bytecode of len %u removed from the registry",
+			bytecode->len);
+
+end:
+	pthread_mutex_unlock(&filter_registry_lock);
+	rcu_read_unlock();
+}
@@ -0,0 +1,70 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef LTTNG_UST_FILTER_H
+#define LTTNG_UST_FILTER_H
+
+#include <config.h>
+
+#include <common/hashtable/hashtable.h>
+
+#include "lttng-ust-abi.h"
+
+/*
+ * Filter bytecode shared by every UST event using the same bytecode content.
+ * One object exists per distinct bytecode in the session daemon and is
+ * referenced by the ltt_ust_event and ust_app_event objects. The object is
+ * immutable once created so it can be sent to the applications without any
+ * locking.
+ */
+struct ust_filter {
+	/* Protected by the filter registry lock. */
+	unsigned long refcount;
+	/* Hash of the bytecode content. Key of the node. */
+	struct lttng_ht_node_ulong node;
+	/* MUST be last since the bytecode data follows it. */
+	struct lttng_ust_filter_bytecode bytecode;
+};
+
+#ifdef HAVE_LIBLTTNG_UST_CTL
+
+struct lttng_ust_filter_bytecode *ust_filter_get(
+		const struct lttng_ust_filter_bytecode *bytecode);
+struct lttng_ust_filter_bytecode *ust_filter_ref(
+		struct lttng_ust_filter_bytecode *bytecode);
+void ust_filter_put(struct lttng_ust_filter_bytecode *bytecode);
+
+#else /* HAVE_LIBLTTNG_UST_CTL */
+
+static inline
+struct lttng_ust_filter_bytecode *ust_filter_get(
+		const struct lttng_ust_filter_bytecode *bytecode)
+{
+	return NULL;
+}
+static inline
+struct lttng_ust_filter_bytecode *ust_filter_ref(
+		struct lttng_ust_filter_bytecode *bytecode)
+{
+	return NULL;
+}
+static inline
+void ust_filter_put(struct lttng_ust_filter_bytecode *bytecode)
+{
+}
+
+#endif /* HAVE_LIBLTTNG_UST_CTL */
+
+#endif /* LTTNG_UST_FILTER_H */
@@ -20,6 +20,7 @@
  */
 
 #define _GNU_SOURCE
+#include <assert.h>
 #include <stdint.h>
 #include <string.h>
 #include <stdarg.h>
@@ -112,6 +113,22 @@ ssize_t metadata_reserve(struct ust_registry_session *session, size_t len)
 	return ret;
 }
 
+/*
+ * Append len bytes of text to the metadata of the session.
+ */
+static
+int lttng_metadata_write(struct ust_registry_session *session,
+		const char *text, size_t len)
+{
+	ssize_t offset;
+
+	offset = metadata_reserve(session, len);
+	if (offset < 0)
+		return offset;
+	memcpy(&session->metadata[offset], text, len);
+	return 0;
+}
+
 /*
  * We have exclusive access to our metadata buffer (protected by the
  * ust_lock), so we can do racy operations such as looking for
@@ -123,9 +140,7 @@ int lttng_metadata_printf(struct ust_registry_session *session,
 		const char *fmt, ...)
 {
 	char *str = NULL;
-	size_t len;
 	va_list ap;
-	ssize_t offset;
 	int ret;
 
 	va_start(ap, fmt);
@@ -134,15 +149,10 @@ int lttng_metadata_printf(struct ust_registry_session *session,
 	if (ret < 0)
 		return -ENOMEM;
 
-	len = strlen(str);
-	offset = metadata_reserve(session, len);
-	if (offset < 0) {
-		ret = offset;
+	ret = lttng_metadata_write(session, str, strlen(str));
+	if (ret)
 		goto end;
-	}
-	memcpy(&session->metadata[offset], str, len);
 	DBG3("Append to metadata: \"%s\"", str);
-	ret = 0;
 
 end:
 	free(str);
@@ -287,13 +297,13 @@ int _lttng_context_metadata_statedump(struct ust_registry_session *session,
 
 static
 int _lttng_fields_metadata_statedump(struct ust_registry_session *session,
-		struct ust_registry_event *event)
+		struct ust_registry_event_desc *desc)
 {
 	int ret = 0;
 	int i;
 
-	for (i = 0; i < event->nr_fields; i++) {
-		const struct ustctl_field *field = &event->fields[i];
+	for (i = 0; i < desc->nr_fields; i++) {
+		const struct ustctl_field *field = &desc->fields[i];
 
 		ret = _lttng_field_statedump(session, field);
 		if (ret)
@@ -303,39 +313,25 @@ int _lttng_fields_metadata_statedump(struct ust_registry_session *session,
 }
 
 /*
- * Should be called with session registry mutex held.
+ * Dump the declaration of an event following its id and stream id, which only
+ * depends on the event description and the session byte order.
  */
-int ust_metadata_event_statedump(struct ust_registry_session *session,
-		struct ust_registry_channel *chan,
-		struct ust_registry_event *event)
+static
+int _lttng_event_body_statedump(struct ust_registry_session *session,
+		struct ust_registry_event_desc *desc)
 {
 	int ret = 0;
 
-	/* Don't dump metadata events */
-	if (chan->chan_id == -1U)
-		return 0;
-
-	ret = lttng_metadata_printf(session,
-		"event {\n"
-		"	name = \"%s\";\n"
-		"	id = %u;\n"
-		"	stream_id = %u;\n",
-		event->name,
-		event->id,
-		chan->chan_id);
-	if (ret)
-		goto end;
-
 	ret = lttng_metadata_printf(session,
 		"	loglevel = %d;\n",
-		event->loglevel);
+		desc->loglevel);
 	if (ret)
 		goto end;
 
-	if (event->model_emf_uri) {
+	if (desc->model_emf_uri) {
 		ret = lttng_metadata_printf(session,
 			"	model.emf.uri = \"%s\";\n",
-			event->model_emf_uri);
+			desc->model_emf_uri);
 		if (ret)
 			goto end;
 	}
@@ -363,13 +359,96 @@ int ust_metadata_event_statedump(struct ust_registry_session *session,
 	if (ret)
 		goto end;
 
-	ret = _lttng_fields_metadata_statedump(session, event);
+	ret = _lttng_fields_metadata_statedump(session, desc);
 	if (ret)
 		goto end;
 
 	ret = lttng_metadata_printf(session,
 		"	};\n"
 		"};\n\n");
+
+end:
+	return ret;
+}
+
+/*
+ * Return the metadata of an event description for the byte order of the
+ * session, rendering it if no registry of that byte order dumped the event
+ * before.
+ */
+static
+struct ust_registry_event_metadata *get_event_metadata(
+		struct ust_registry_session *session,
+		struct ust_registry_event_desc *desc)
+{
+	int ret;
+	struct ust_registry_session scratch;
+	struct ust_registry_event_metadata *metadata, *old;
+	struct ust_registry_event_metadata **slot;
+
+	slot = &desc->metadata[session->byte_order == BIG_ENDIAN];
+	metadata = rcu_dereference(*slot);
+	if (metadata)
+		return metadata;
+
+	/* Render into a scratch metadata buffer with the session byte order. */
+	memset(&scratch, 0, sizeof(scratch));
+	scratch.byte_order = session->byte_order;
+	ret = _lttng_event_body_statedump(&scratch, desc);
+	if (ret)
+		goto end;
+
+	metadata = zmalloc(sizeof(*metadata) + scratch.metadata_len);
+	if (!metadata)
+		goto end;
+	metadata->len = scratch.metadata_len;
+	memcpy(metadata->text, scratch.metadata, scratch.metadata_len);
+
+	/* Registries of other applications may render it concurrently. */
+	old = uatomic_cmpxchg(slot, NULL, metadata);
+	if (old) {
+		free(metadata);
+		metadata = old;
+	}
+
+end:
+	free(scratch.metadata);
+	return metadata;
+}
+
+/*
+ * Should be called with session registry mutex held.
+ */
+int ust_metadata_event_statedump(struct ust_registry_session *session,
+		struct ust_registry_channel *chan,
+		struct ust_registry_event *event)
+{
+	int ret = 0;
+	struct ust_registry_event_metadata *metadata;
+
+	/* Don't dump metadata events */
+	if (chan->chan_id == -1U)
+		return 0;
+
+	metadata = get_event_metadata(session, event->desc);
+	if (!metadata) {
+		ret = -ENOMEM;
+		goto end;
+	}
+
+	ret = lttng_metadata_printf(session,
+		"event {\n"
+		"	name = \"%s\";\n"
+		"	id = %u;\n"
+		"	stream_id = %u;\n",
+		event->desc->name,
+		event->id,
+		chan->chan_id);
+	if (ret)
+		goto end;
+
+	/* The rest of the declaration is shared by the registries. */
+	ret = lttng_metadata_write(session, metadata->text, metadata->len);
 	if (ret)
 		goto end;
 	event->metadata_dumped = 1;
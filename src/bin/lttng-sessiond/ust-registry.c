@@ -25,7 +25,18 @@
 #include "ust-registry.h"
 
 /*
- * Hash table match function for event in the registry.
+ * Interned event descriptions shared by every registry.
+ */
+static struct lttng_ht *event_desc_ht;
+static pthread_mutex_t event_desc_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Hash table match function for event in the registry. An event of a channel
+ * is identified by its name and signature, like the tracer does: the same
+ * event registered with another description, e.g. by another version of an
+ * application with a different log level, gets the id of the first one.
+ * Descriptions are interned so equal pointers match without the strings
+ * being compared.
  */
 static int ht_match_event(struct cds_lfht_node *node, const void *_key)
 {
@@ -39,35 +50,321 @@ static int ht_match_event(struct cds_lfht_node *node, const void *_key)
 	assert(event);
 	key = _key;
 
-	/* It has to be a perfect match. */
-	if (strncmp(event->name, key->name, sizeof(event->name)) != 0) {
-		goto no_match;
+	if (event->desc == key->desc) {
+		return 1;
+	}
+
+	return strcmp(event->desc->name, key->desc->name) == 0 &&
+		strcmp(event->desc->signature, key->desc->signature) == 0;
+}
+
+/*
+ * Hash an event with the name and signature hash of its interned description.
+ */
+static unsigned long ht_hash_event(void *_key, unsigned long seed)
+{
+	struct ust_registry_event *key = _key;
+
+	assert(key);
+
+	return key->desc->key_hash;
+}
+
+/*
+ * Return 1 if two basic types are the same for the metadata. Only the members
+ * of the abstract type are compared, not the padding nor the rest of the
+ * union which the tracer leaves uninitialized.
+ */
+static int basic_type_equal(enum ustctl_abstract_types atype,
+		const union _ustctl_basic_type *a, const union _ustctl_basic_type *b)
+{
+	switch (atype) {
+	case ustctl_atype_integer:
+		return a->integer.size == b->integer.size &&
+			a->integer.signedness == b->integer.signedness &&
+			a->integer.reverse_byte_order ==
+				b->integer.reverse_byte_order &&
+			a->integer.base == b->integer.base &&
+			a->integer.encoding == b->integer.encoding &&
+			a->integer.alignment == b->integer.alignment;
+	case ustctl_atype_float:
+		return a->_float.exp_dig == b->_float.exp_dig &&
+			a->_float.mant_dig == b->_float.mant_dig &&
+			a->_float.reverse_byte_order ==
+				b->_float.reverse_byte_order &&
+			a->_float.alignment == b->_float.alignment;
+	case ustctl_atype_string:
+		return a->string.encoding == b->string.encoding;
+	default:
+		return 1;
+	}
+}
+
+/*
+ * Return 1 if two event fields are the same for the metadata, comparing them
+ * member by member.
+ */
+static int field_equal(const struct ustctl_field *a,
+		const struct ustctl_field *b)
+{
+	const struct ustctl_type *ta = &a->type, *tb = &b->type;
+
+	if (strncmp(a->name, b->name, sizeof(a->name)) != 0 ||
+			ta->atype != tb->atype) {
+		return 0;
+	}
+
+	switch (ta->atype) {
+	case ustctl_atype_array:
+		return ta->u.array.length == tb->u.array.length &&
+			ta->u.array.elem_type.atype == tb->u.array.elem_type.atype &&
+			basic_type_equal(ta->u.array.elem_type.atype,
+				&ta->u.array.elem_type.u.basic,
+				&tb->u.array.elem_type.u.basic);
+	case ustctl_atype_sequence:
+		return ta->u.sequence.length_type.atype ==
+				tb->u.sequence.length_type.atype &&
+			ta->u.sequence.elem_type.atype ==
+				tb->u.sequence.elem_type.atype &&
+			basic_type_equal(ta->u.sequence.length_type.atype,
+				&ta->u.sequence.length_type.u.basic,
+				&tb->u.sequence.length_type.u.basic) &&
+			basic_type_equal(ta->u.sequence.elem_type.atype,
+				&ta->u.sequence.elem_type.u.basic,
+				&tb->u.sequence.elem_type.u.basic);
+	default:
+		return basic_type_equal(ta->atype, &ta->u.basic, &tb->u.basic);
 	}
+}
+
+/*
+ * Hash table match function of the interned descriptions. The whole
+ * description has to match, the field array included.
+ */
+static int ht_match_event_desc(struct cds_lfht_node *node, const void *_key)
+{
+	size_t i;
+	struct ust_registry_event_desc *desc;
+	const struct ust_registry_event_desc *key = _key;
+
+	desc = caa_container_of(node, struct ust_registry_event_desc, node.node);
 
-	/* It has to be a perfect match. */
-	if (strncmp(event->signature, key->signature,
-				strlen(event->signature) != 0)) {
-		goto no_match;
+	if (desc->hash != key->hash || desc->loglevel != key->loglevel ||
+			desc->nr_fields != key->nr_fields) {
+		return 0;
+	}
+	if (strcmp(desc->name, key->name) != 0 ||
+			strcmp(desc->signature, key->signature) != 0) {
+		return 0;
+	}
+	if (!desc->model_emf_uri != !key->model_emf_uri ||
+			(desc->model_emf_uri &&
+			 strcmp(desc->model_emf_uri, key->model_emf_uri) != 0)) {
+		return 0;
+	}
+	for (i = 0; i < desc->nr_fields; i++) {
+		if (!field_equal(&desc->fields[i], &key->fields[i])) {
+			return 0;
+		}
 	}
 
-	/* Match */
 	return 1;
+}
 
-no_match:
-	return 0;
+/*
+ * Hash a 32-bit member of a type.
+ */
+static unsigned long hash_u32(uint32_t value, unsigned long hash)
+{
+	return hash_key_buf(&value, sizeof(value), hash);
 }
 
-static unsigned long ht_hash_event(void *_key, unsigned long seed)
+/*
+ * Hash the members of a basic type compared by basic_type_equal().
+ */
+static unsigned long hash_basic_type(enum ustctl_abstract_types atype,
+		const union _ustctl_basic_type *basic, unsigned long hash)
 {
-	uint64_t xored_key;
-	struct ust_registry_event *key = _key;
+	hash = hash_u32(atype, hash);
+
+	switch (atype) {
+	case ustctl_atype_integer:
+		hash = hash_u32(basic->integer.size, hash);
+		hash = hash_u32(basic->integer.signedness, hash);
+		hash = hash_u32(basic->integer.reverse_byte_order, hash);
+		hash = hash_u32(basic->integer.base, hash);
+		hash = hash_u32(basic->integer.encoding, hash);
+		hash = hash_u32(basic->integer.alignment, hash);
+		break;
+	case ustctl_atype_float:
+		hash = hash_u32(basic->_float.exp_dig, hash);
+		hash = hash_u32(basic->_float.mant_dig, hash);
+		hash = hash_u32(basic->_float.reverse_byte_order, hash);
+		hash = hash_u32(basic->_float.alignment, hash);
+		break;
+	case ustctl_atype_string:
+		hash = hash_u32(basic->string.encoding, hash);
+		break;
+	default:
+		break;
+	}
 
-	assert(key);
+	return hash;
+}
 
-	xored_key = (uint64_t) (hash_key_str(key->name, seed) ^
-			hash_key_str(key->signature, seed));
+/*
+ * Hash the members of an event field compared by field_equal().
+ */
+static unsigned long hash_field(const struct ustctl_field *field,
+		unsigned long hash)
+{
+	const struct ustctl_type *type = &field->type;
+
+	hash = hash_key_buf(field->name, strnlen(field->name, sizeof(field->name)),
+			hash);
+
+	switch (type->atype) {
+	case ustctl_atype_array:
+		hash = hash_u32(type->atype, hash);
+		hash = hash_u32(type->u.array.length, hash);
+		return hash_basic_type(type->u.array.elem_type.atype,
+				&type->u.array.elem_type.u.basic, hash);
+	case ustctl_atype_sequence:
+		hash = hash_u32(type->atype, hash);
+		hash = hash_basic_type(type->u.sequence.length_type.atype,
+				&type->u.sequence.length_type.u.basic, hash);
+		return hash_basic_type(type->u.sequence.elem_type.atype,
+				&type->u.sequence.elem_type.u.basic, hash);
+	default:
+		return hash_basic_type(type->atype, &type->u.basic, hash);
+	}
+}
 
-	return hash_key_u64(&xored_key, seed);
+/*
+ * Set the hashes of an event description: by name and signature, then by
+ * fields too. The name hash seeds the one of the signature and so on so each
+ * is read once.
+ */
+static void hash_event_desc(struct ust_registry_event_desc *desc)
+{
+	size_t i;
+	unsigned long hash;
+
+	hash = hash_key_str(desc->name, lttng_ht_seed);
+	hash = hash_key_buf(desc->signature, strlen(desc->signature), hash);
+	desc->key_hash = hash;
+	for (i = 0; i < desc->nr_fields; i++) {
+		hash = hash_field(&desc->fields[i], hash);
+	}
+	desc->hash = hash;
+}
+
+/*
+ * Free an event description and its rendered metadata.
+ */
+static void destroy_event_desc(struct ust_registry_event_desc *desc)
+{
+	free(desc->metadata[0]);
+	free(desc->metadata[1]);
+	free(desc->fields);
+	free(desc->model_emf_uri);
+	free(desc->signature);
+	free(desc);
+}
+
+static void destroy_event_desc_rcu(struct rcu_head *head)
+{
+	struct lttng_ht_node_u64 *node =
+		caa_container_of(head, struct lttng_ht_node_u64, head);
+	struct ust_registry_event_desc *desc =
+		caa_container_of(node, struct ust_registry_event_desc, node);
+
+	destroy_event_desc(desc);
+}
+
+/*
+ * Return a reference on the interned description of an event, taking
+ * ownership of the signature, field array and model EMF URI allocated by
+ * ustctl. If the description is already interned, they are freed.
+ *
+ * Return the description or NULL on error, the strings and fields being
+ * untouched.
+ */
+static struct ust_registry_event_desc *intern_event_desc(char *name, char *sig,
+		size_t nr_fields, struct ustctl_field *fields, int loglevel,
+		char *model_emf_uri)
+{
+	struct cds_lfht_iter iter;
+	struct cds_lfht_node *node;
+	struct ust_registry_event_desc key, *desc = NULL;
+
+	memset(&key, 0, sizeof(key));
+	/* Copy event name and force NULL byte. */
+	strncpy(key.name, name, sizeof(key.name));
+	key.name[sizeof(key.name) - 1] = '\0';
+	key.signature = sig;
+	key.loglevel = loglevel;
+	key.nr_fields = nr_fields;
+	key.fields = fields;
+	key.model_emf_uri = model_emf_uri;
+	hash_event_desc(&key);
+
+	pthread_mutex_lock(&event_desc_lock);
+	rcu_read_lock();
+	if (!event_desc_ht) {
+		event_desc_ht = lttng_ht_new(0, LTTNG_HT_TYPE_U64);
+		if (!event_desc_ht) {
+			goto end;
+		}
+	}
+
+	cds_lfht_lookup(event_desc_ht->ht, key.hash, ht_match_event_desc, &key,
+			&iter);
+	node = cds_lfht_iter_get_node(&iter);
+	if (node) {
+		desc = caa_container_of(node, struct ust_registry_event_desc,
+				node.node);
+		desc->refcount++;
+		free(fields);
+		free(model_emf_uri);
+		free(sig);
+		goto end;
+	}
+
+	desc = zmalloc(sizeof(*desc));
+	if (!desc) {
+		PERROR("zmalloc ust registry event description");
+		goto end;
+	}
+	memcpy(desc, &key, sizeof(*desc));
+	desc->refcount = 1;
+	lttng_ht_node_init_u64(&desc->node, 0);
+	cds_lfht_add(event_desc_ht->ht, desc->hash, &desc->node.node);
+
+end:
+	rcu_read_unlock();
+	pthread_mutex_unlock(&event_desc_lock);
+	return desc;
+}
+
+/*
+ * Release a reference on an interned description, freeing it once unused.
+ */
+static void put_event_desc(struct ust_registry_event_desc *desc)
+{
+	int ret;
+	struct lttng_ht_iter iter;
+
+	pthread_mutex_lock(&event_desc_lock);
+	if (--desc->refcount == 0) {
+		rcu_read_lock();
+		iter.iter.node = &desc->node.node;
+		ret = lttng_ht_del(event_desc_ht, &iter);
+		assert(!ret);
+		rcu_read_unlock();
+		call_rcu(&desc->node.head, destroy_event_desc_rcu);
+	}
+	pthread_mutex_unlock(&event_desc_lock);
 }
 
 /*
@@ -75,8 +372,7 @@ static unsigned long ht_hash_event(void *_key, unsigned long seed)
  * registry.
  */
 static struct ust_registry_event *alloc_event(int session_objd,
-		int channel_objd, char *name, char *sig, size_t nr_fields,
-		struct ustctl_field *fields, int loglevel, char *model_emf_uri)
+		int channel_objd, struct ust_registry_event_desc *desc)
 {
 	struct ust_registry_event *event = NULL;
 
@@ -88,17 +384,7 @@ static struct ust_registry_event *alloc_event(int session_objd,
 
 	event->session_objd = session_objd;
 	event->channel_objd = channel_objd;
-	/* Allocated by ustctl. */
-	event->signature = sig;
-	event->nr_fields = nr_fields;
-	event->fields = fields;
-	event->loglevel = loglevel;
-	event->model_emf_uri = model_emf_uri;
-	if (name) {
-		/* Copy event name and force NULL byte. */
-		strncpy(event->name, name, sizeof(event->name));
-		event->name[sizeof(event->name) - 1] = '\0';
-	}
+	event->desc = desc;
 	cds_lfht_node_init(&event->node.node);
 
 error:
@@ -106,9 +392,10 @@ error:
 }
 
 /*
- * Free event data structure. This does NOT delete it from any hash table. It's
- * safe to pass a NULL pointer. This shoudl be called inside a call RCU if the
- * event is previously deleted from a rcu hash table.
+ * Free event data structure and release its description. This does NOT
+ * delete it from any hash table. It's safe to pass a NULL pointer. This shoudl
+ * be called inside a call RCU if the event is previously deleted from a rcu
+ * hash table.
  */
 static void destroy_event(struct ust_registry_event *event)
 {
@@ -116,9 +403,7 @@ static void destroy_event(struct ust_registry_event *event)
 		return;
 	}
 
-	free(event->fields);
-	free(event->model_emf_uri);
-	free(event->signature);
+	put_event_desc(event->desc);
 	free(event);
 }
 
@@ -136,14 +421,16 @@ static void destroy_event_rcu(struct rcu_head *head)
 }
 
 /*
- * Find an event using the name and signature in the given registry. RCU read
- * side lock MUST be acquired before calling this function and as long as the
- * event reference is kept by the caller.
+ * Find the event of the name and signature of a description in the given
+ * registry. RCU
+ * read side lock MUST be acquired before calling this function and as long as
+ * the event reference is kept by the caller.
  *
  * On success, the event pointer is returned else NULL.
  */
 struct ust_registry_event *ust_registry_find_event(
-		struct ust_registry_channel *chan, char *name, char *sig)
+		struct ust_registry_channel *chan,
+		struct ust_registry_event_desc *desc)
 {
 	struct lttng_ht_node_u64 *node;
 	struct lttng_ht_iter iter;
@@ -151,13 +438,10 @@ struct ust_registry_event *ust_registry_find_event(
 	struct ust_registry_event key;
 
 	assert(chan);
-	assert(name);
-	assert(sig);
+	assert(desc);
 
 	/* Setup key for the match function. */
-	strncpy(key.name, name, sizeof(key.name));
-	key.name[sizeof(key.name) - 1] = '\0';
-	key.signature = sig;
+	key.desc = desc;
 
 	cds_lfht_lookup(chan->ht->ht, chan->ht->hash_fct(&key, lttng_ht_seed),
 			chan->ht->match_fct, &key, &iter.iter);
@@ -190,6 +474,7 @@ int ust_registry_create_event(struct ust_registry_session *session,
 	uint32_t event_id;
 	struct cds_lfht_node *nptr;
 	struct ust_registry_event *event = NULL;
+	struct ust_registry_event_desc *desc;
 	struct ust_registry_channel *chan;
 
 	assert(session);
@@ -220,21 +505,28 @@ int ust_registry_create_event(struct ust_registry_session *session,
 		goto error_unlock;
 	}
 
-	event = alloc_event(session_objd, channel_objd, name, sig, nr_fields,
-			fields, loglevel, model_emf_uri);
+	desc = intern_event_desc(name, sig, nr_fields, fields, loglevel,
+			model_emf_uri);
+	if (!desc) {
+		ret = -ENOMEM;
+		goto error_unlock;
+	}
+
+	event = alloc_event(session_objd, channel_objd, desc);
 	if (!event) {
+		put_event_desc(desc);
 		ret = -ENOMEM;
 		goto error_unlock;
 	}
 
 	DBG3("UST registry creating event with event: %s, sig: %s, id: %u, "
-			"chan_objd: %u, sess_objd: %u, chan_id: %u", event->name,
-			event->signature, event->id, event->channel_objd,
+			"chan_objd: %u, sess_objd: %u, chan_id: %u", desc->name,
+			desc->signature, event->id, event->channel_objd,
 			event->session_objd, chan->chan_id);
 
 	/*
 	 * This is an add unique with a custom match function for event. The node
-	 * are matched using the event name and signature.
+	 * are matched using the name and signature of the interned description.
 	 */
 	nptr = cds_lfht_add_unique(chan->ht->ht, chan->ht->hash_fct(event,
 				lttng_ht_seed), chan->ht->match_fct, event, &event->node.node);
@@ -253,7 +545,7 @@ int ust_registry_create_event(struct ust_registry_session *session,
 		} else {
 			ERR("UST registry create event add unique failed for event: %s, "
 					"sig: %s, id: %u, chan_objd: %u, sess_objd: %u",
-					event->name, event->signature, event->id,
+					desc->name, desc->signature, event->id,
 					event->channel_objd, event->session_objd);
 			ret = -EINVAL;
 			goto error_unlock;
@@ -497,6 +789,8 @@ int ust_registry_session_init(struct ust_registry_session **sessionp,
 	session->uint64_t_alignment = uint64_t_alignment;
 	session->long_alignment = long_alignment;
 	session->byte_order = byte_order;
+	session->major = major;
+	session->minor = minor;
 
 	session->channels = lttng_ht_new(0, LTTNG_HT_TYPE_U64);
 	if (!session->channels) {
@@ -56,6 +56,8 @@ struct ust_registry_session {
 		long_alignment;
 	/* endianness */
 	int byte_order;	/* BIG_ENDIAN or LITTLE_ENDIAN */
+	/* Version of the tracer ABI. */
+	uint32_t major, minor;
 
 	/* Generated metadata. */
 	char *metadata;		/* NOT null-terminated ! Use memcpy. */
@@ -112,14 +114,23 @@ struct ust_registry_channel {
 };
 
 /*
- * Event registered from a UST tracer sent to the session daemon. This is
- * indexed and matched by <event_name/signature>.
+ * Declaration of an event following its id and stream id, from the log level
+ * to the end of the fields, for one byte order.
  */
-struct ust_registry_event {
-	int id;
-	/* Both objd are set by the tracer. */
-	int session_objd;
-	int channel_objd;
+struct ust_registry_event_metadata {
+	size_t len;
+	/* NOT null-terminated ! Use memcpy. */
+	char text[];
+};
+
+/*
+ * Immutable description of an event sent by the UST tracer. Descriptions are
+ * interned: every channel of every registry registering the same event
+ * references a single copy, so two registry events have the same declaration
+ * if and only if they point to the same description. Within a channel, the
+ * event id still only depends on the name and signature.
+ */
+struct ust_registry_event_desc {
 	/* Name of the event returned by the tracer. */
 	char name[LTTNG_UST_SYM_NAME_LEN];
 	char *signature;
@@ -127,6 +138,30 @@ struct ust_registry_event {
 	size_t nr_fields;
 	struct ustctl_field *fields;
 	char *model_emf_uri;
+	/* Hash of the whole description, computed once when interned. */
+	uint64_t hash;
+	/* Hash of the name and signature, indexing the events of a channel. */
+	uint64_t key_hash;
+	/*
+	 * Metadata rendered on the first dump for little and big endian
+	 * sessions. Set once with a compare and exchange.
+	 */
+	struct ust_registry_event_metadata *metadata[2];
+	/* Registry events using the description. Protected by the intern lock. */
+	unsigned int refcount;
+	struct lttng_ht_node_u64 node;
+};
+
+/*
+ * Event registered from a UST tracer sent to the session daemon. This is
+ * indexed and matched by the name and signature of its interned description.
+ */
+struct ust_registry_event {
+	int id;
+	/* Both objd are set by the tracer. */
+	int session_objd;
+	int channel_objd;
+	struct ust_registry_event_desc *desc;
 	struct lttng_ust_object_data *obj;
 	/*
 	 * Flag for this channel if the metadata was dumped once during
@@ -134,8 +169,8 @@ struct ust_registry_event {
 	 */
 	unsigned int metadata_dumped;
 	/*
-	 * Node in the ust-registry hash table. The event name is used to
-	 * initialize the node and the event_name/signature for the match function.
+	 * Node in the ust-registry hash table, hashed and matched by the name and
+	 * signature of the description.
 	 */
 	struct lttng_ht_node_u64 node;
 };
@@ -228,7 +263,8 @@ int ust_registry_create_event(struct ust_registry_session *session,
 		char *sig, size_t nr_fields, struct ustctl_field *fields, int loglevel,
 		char *model_emf_uri, int buffer_type, uint32_t *event_id_p);
 struct ust_registry_event *ust_registry_find_event(
-		struct ust_registry_channel *chan, char *name, char *sig);
+		struct ust_registry_channel *chan,
+		struct ust_registry_event_desc *desc);
 void ust_registry_destroy_event(struct ust_registry_channel *chan,
 		struct ust_registry_event *event);
 
@@ -289,7 +325,8 @@ int ust_registry_create_event(struct ust_registry_session *session,
 }
 static inline
 struct ust_registry_event *ust_registry_find_event(
-		struct ust_registry_channel *chan, char *name, char *sig)
+		struct ust_registry_channel *chan,
+		struct ust_registry_event_desc *desc)
 {
 	return NULL;
 }
@@ -55,5 +55,6 @@ extern int cmd_calibrate(int argc, const char **argv);
 extern int cmd_view(int argc, const char **argv);
 extern int cmd_enable_consumer(int argc, const char **argv);
 extern int cmd_disable_consumer(int argc, const char **argv);
+extern int cmd_snapshot(int argc, const char **argv);
 
 #endif /* _LTTNG_CMD_H */
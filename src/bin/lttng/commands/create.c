@@ -41,6 +41,7 @@ static char *opt_ctrl_url;
 static char *opt_data_url;
 static int opt_no_consumer;
 static int opt_disable_consumer;
+static int opt_snapshot;
 
 enum {
 	OPT_HELP = 1,
@@ -57,6 +58,7 @@ static struct poptOption long_options[] = {
 	{"data-url",       'D', POPT_ARG_STRING, &opt_data_url, 0, 0, 0},
 	{"no-consumer",      0, POPT_ARG_VAL, &opt_no_consumer, 1, 0, 0},
 	{"disable-consumer", 0, POPT_ARG_VAL, &opt_disable_consumer, 1, 0, 0},
+	{"snapshot",         0, POPT_ARG_VAL, &opt_snapshot, 1, 0, 0},
 	{0, 0, 0, 0, 0, 0, 0}
 };
 
@@ -66,6 +68,8 @@ static struct poptOption long_options[] = {
  */
 extern int _lttng_create_session_ext(const char *name, const char *url,
 		const char *datetime);
+extern int _lttng_create_session_snapshot_ext(const char *name,
+		const char *url, const char *datetime);
 
 /*
  * usage
@@ -80,6 +84,9 @@ static void usage(FILE *ofp)
 	fprintf(ofp, "  -h, --help           Show this help\n");
 	fprintf(ofp, "      --list-options   Simple listing of options\n");
 	fprintf(ofp, "  -o, --output PATH    Specify output path for traces\n");
+	fprintf(ofp, "      --snapshot       Set the session in snapshot mode.\n");
+	fprintf(ofp, "                       The buffers are only written to the\n");
+	fprintf(ofp, "                       output by the snapshot command.\n");
 	fprintf(ofp, "\n");
 	fprintf(ofp, "Extended Options:\n");
 	fprintf(ofp, "\n");
@@ -280,7 +287,11 @@ static int create_session(void)
 		goto error;
 	}
 
-	ret = _lttng_create_session_ext(session_name, url, datetime);
+	if (opt_snapshot) {
+		ret = _lttng_create_session_snapshot_ext(session_name, url, datetime);
+	} else {
+		ret = _lttng_create_session_ext(session_name, url, datetime);
+	}
 	if (ret < 0) {
 		/* Don't set ret so lttng can interpret the sessiond error. */
 		switch (-ret) {
@@ -305,7 +316,11 @@ static int create_session(void)
 
 	MSG("Session %s created.", session_name);
 	if (print_str_url) {
-		MSG("Traces will be written in %s", print_str_url);
+		if (opt_snapshot) {
+			MSG("Snapshots will be written in %s", print_str_url);
+		} else {
+			MSG("Traces will be written in %s", print_str_url);
+		}
 	}
 
 	/* Init lttng session config */
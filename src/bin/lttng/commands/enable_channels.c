@@ -32,6 +32,7 @@
 
 #include <src/common/sessiond-comm/sessiond-comm.h>
 #include <src/common/utils.h>
+#include <src/common/compress/compress.h>
 
 static char *opt_channels;
 static int opt_kernel;
@@ -39,9 +40,11 @@ static char *opt_session_name;
 static int opt_userspace;
 static struct lttng_channel chan;
 static char *opt_output;
+static char *opt_compression;
 static int opt_buffer_uid;
 static int opt_buffer_pid;
 static int opt_buffer_global;
+static char *opt_provision_uids;
 
 enum {
 	OPT_HELP = 1,
@@ -55,6 +58,7 @@ enum {
 	OPT_LIST_OPTIONS,
 	OPT_TRACEFILE_SIZE,
 	OPT_TRACEFILE_COUNT,
+	OPT_LIVE_TIMER,
 };
 
 static struct lttng_handle *handle;
@@ -81,6 +85,9 @@ static struct poptOption long_options[] = {
 	{"buffers-global", 0,	POPT_ARG_VAL, &opt_buffer_global, 1, 0, 0},
 	{"tracefile-size", 'C',   POPT_ARG_INT, 0, OPT_TRACEFILE_SIZE, 0, 0},
 	{"tracefile-count", 'W',   POPT_ARG_INT, 0, OPT_TRACEFILE_COUNT, 0, 0},
+	{"compression",    0,   POPT_ARG_STRING, &opt_compression, 0, 0, 0},
+	{"live-timer",     0,   POPT_ARG_INT, 0, OPT_LIVE_TIMER, 0, 0},
+	{"provision-uids", 0,   POPT_ARG_STRING, &opt_provision_uids, 0, 0, 0},
 	{0, 0, 0, 0, 0, 0, 0}
 };
 
@@ -133,6 +140,9 @@ static void usage(FILE *ofp)
 	fprintf(ofp, "      --buffers-uid        Use per UID buffer (-u only)\n");
 	fprintf(ofp, "      --buffers-pid        Use per PID buffer (-u only)\n");
 	fprintf(ofp, "      --buffers-global     Use shared buffer for the whole system (-k only)\n");
+	fprintf(ofp, "      --provision-uids UID[,UID2,...]\n");
+	fprintf(ofp, "                           Create the per UID buffers of these users when tracing\n");
+	fprintf(ofp, "                           starts, before their applications register (--buffers-uid only)\n");
 	fprintf(ofp, "  -C, --tracefile-size SIZE\n");
 	fprintf(ofp, "                           Maximum size of each tracefile within a stream (in bytes). 0 means unlimited.\n");
 	fprintf(ofp, "                               (default: %u)\n", DEFAULT_CHANNEL_TRACEFILE_SIZE);
@@ -140,6 +150,15 @@ static void usage(FILE *ofp)
 	fprintf(ofp, "                           Used in conjunction with -C option, this will limit the number\n");
 	fprintf(ofp, "                           of files created to the specified count. 0 means unlimited.\n");
 	fprintf(ofp, "                               (default: %u)\n", DEFAULT_CHANNEL_TRACEFILE_COUNT);
+	fprintf(ofp, "      --compression ALGO   Compress the trace packets in the consumer (Values: %s, %s, %s)\n",
+			lttng_compress_name(LTTNG_COMPRESSION_NONE),
+			lttng_compress_name(LTTNG_COMPRESSION_LZ4),
+			lttng_compress_name(LTTNG_COMPRESSION_ZSTD));
+	fprintf(ofp, "                               (default: %s)\n",
+			lttng_compress_name(DEFAULT_CHANNEL_COMPRESSION));
+	fprintf(ofp, "      --live-timer USEC    Flush timer interval in usec of the streamed buffers,\n");
+	fprintf(ofp, "                           for live reading on the relay daemon. 0 disables it.\n");
+	fprintf(ofp, "                               (default: %u)\n", DEFAULT_CHANNEL_LIVE_TIMER);
 	fprintf(ofp, "\n");
 }
 
@@ -178,6 +197,43 @@ static void set_default_attr(struct lttng_domain *dom)
 	if (chan.attr.tracefile_size == -1) {
 		chan.attr.tracefile_size = default_attr.tracefile_size;
 	}
+	if (chan.attr.compression == -1) {
+		chan.attr.compression = default_attr.compression;
+	}
+	if (chan.attr.live_timer_interval == -1) {
+		chan.attr.live_timer_interval = default_attr.live_timer_interval;
+	}
+}
+
+/*
+ * Parse the comma separated UID list of --provision-uids into uids.
+ *
+ * Return the number of UIDs or -1 on error.
+ */
+static int parse_provision_uids(char *list, uid_t *uids)
+{
+	int count = 0;
+	char *token, *end, *saveptr = NULL;
+	unsigned long v;
+
+	for (token = strtok_r(list, ",", &saveptr); token;
+			token = strtok_r(NULL, ",", &saveptr)) {
+		if (count == DEFAULT_UST_PROVISION_UIDS_MAX) {
+			ERR("At most %d UIDs can be provisioned",
+					DEFAULT_UST_PROVISION_UIDS_MAX);
+			return -1;
+		}
+		errno = 0;
+		v = strtoul(token, &end, 10);
+		if (errno != 0 || !isdigit(token[0]) || *end != '\0' ||
+				v != (uid_t) v) {
+			ERR("Wrong UID in --provision-uids parameter: %s", token);
+			return -1;
+		}
+		uids[count++] = (uid_t) v;
+	}
+
+	return count;
 }
 
 /*
@@ -185,9 +241,10 @@ static void set_default_attr(struct lttng_domain *dom)
  */
 static int enable_channel(char *session_name)
 {
-	int ret = CMD_SUCCESS, warn = 0;
+	int ret = CMD_SUCCESS, warn = 0, nb_uids = 0;
 	char *channel_name;
 	struct lttng_domain dom;
+	uid_t uids[DEFAULT_UST_PROVISION_UIDS_MAX];
 
 	memset(&dom, 0, sizeof(dom));
 
@@ -218,6 +275,20 @@ static int enable_channel(char *session_name)
 		goto error;
 	}
 
+	if (opt_provision_uids) {
+		if (dom.type != LTTNG_DOMAIN_UST ||
+				dom.buf_type != LTTNG_BUFFER_PER_UID) {
+			ERR("Option --provision-uids requires -u and --buffers-uid");
+			ret = CMD_ERROR;
+			goto error;
+		}
+		nb_uids = parse_provision_uids(opt_provision_uids, uids);
+		if (nb_uids < 0) {
+			ret = CMD_ERROR;
+			goto error;
+		}
+	}
+
 	set_default_attr(&dom);
 
 	if (chan.attr.tracefile_size == 0 && chan.attr.tracefile_count) {
@@ -249,6 +320,29 @@ static int enable_channel(char *session_name)
 		}
 	}
 
+	/* Setting channel compression */
+	if (opt_compression) {
+		enum lttng_compression algo;
+
+		for (algo = LTTNG_COMPRESSION_NONE; algo <= LTTNG_COMPRESSION_ZSTD;
+				algo++) {
+			if (!strcmp(opt_compression, lttng_compress_name(algo))) {
+				break;
+			}
+		}
+		if (algo > LTTNG_COMPRESSION_ZSTD) {
+			ERR("Unknown compression %s. Possible values are: %s, %s, %s\n",
+					opt_compression,
+					lttng_compress_name(LTTNG_COMPRESSION_NONE),
+					lttng_compress_name(LTTNG_COMPRESSION_LZ4),
+					lttng_compress_name(LTTNG_COMPRESSION_ZSTD));
+			usage(stderr);
+			ret = CMD_ERROR;
+			goto error;
+		}
+		chan.attr.compression = algo;
+	}
+
 	handle = lttng_create_handle(session_name, &dom);
 	if (handle == NULL) {
 		ret = -1;
@@ -288,6 +382,18 @@ static int enable_channel(char *session_name)
 		channel_name = strtok(NULL, ",");
 	}
 
+	if (opt_provision_uids) {
+		ret = lttng_set_provision_uids(handle, uids, nb_uids);
+		if (ret < 0) {
+			ERR("Provision UIDs: %s (session %s)", lttng_strerror(ret),
+					session_name);
+			warn = 1;
+		} else {
+			MSG("Per UID buffers of %d user(s) provisioned at start for session %s",
+					nb_uids, session_name);
+		}
+	}
+
 	ret = CMD_SUCCESS;
 
 error:
@@ -439,6 +545,27 @@ int cmd_enable_channels(int argc, const char **argv)
 			DBG("Channel read timer interval set to %d", chan.attr.read_timer_interval);
 			break;
 		}
+		case OPT_LIVE_TIMER:
+		{
+			unsigned long v;
+
+			errno = 0;
+			opt_arg = poptGetOptArg(pc);
+			v = strtoul(opt_arg, NULL, 0);
+			if (errno != 0 || !isdigit(opt_arg[0])) {
+				ERR("Wrong value in --live-timer parameter: %s", opt_arg);
+				ret = CMD_ERROR;
+				goto end;
+			}
+			if (v != (uint32_t) v) {
+				ERR("32-bit overflow in --live-timer parameter: %s", opt_arg);
+				ret = CMD_ERROR;
+				goto end;
+			}
+			chan.attr.live_timer_interval = (uint32_t) v;
+			DBG("Channel live timer interval set to %d", chan.attr.live_timer_interval);
+			break;
+		}
 		case OPT_USERSPACE:
 			opt_userspace = 1;
 			break;
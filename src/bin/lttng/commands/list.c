@@ -23,6 +23,8 @@
 #include <string.h>
 #include <assert.h>
 
+#include <common/compress/compress.h>
+
 #include "../command.h"
 
 static int opt_userspace;
@@ -30,10 +32,15 @@ static int opt_kernel;
 static char *opt_channel;
 static int opt_domain;
 static int opt_fields;
+static int opt_pid;
+static char *opt_name;
+static int opt_unique;
+static int opt_offset;
+static int opt_limit;
+static int opt_machine;
 #if 0
 /* Not implemented yet */
 static char *opt_cmd_name;
-static pid_t opt_pid;
 #endif
 
 const char *indent4 = "    ";
@@ -55,13 +62,18 @@ static struct poptOption long_options[] = {
 #if 0
 	/* Not implemented yet */
 	{"userspace",      'u', POPT_ARG_STRING | POPT_ARGFLAG_OPTIONAL, &opt_cmd_name, OPT_USERSPACE, 0, 0},
-	{"pid",            'p', POPT_ARG_INT, &opt_pid, 0, 0, 0},
 #else
 	{"userspace",      'u', POPT_ARG_NONE, 0, OPT_USERSPACE, 0, 0},
 #endif
 	{"channel",   'c', POPT_ARG_STRING, &opt_channel, 0, 0, 0},
 	{"domain",    'd', POPT_ARG_VAL, &opt_domain, 1, 0, 0},
 	{"fields",    'f', POPT_ARG_VAL, &opt_fields, 1, 0, 0},
+	{"pid",       'p', POPT_ARG_INT, &opt_pid, 0, 0, 0},
+	{"name",      0,   POPT_ARG_STRING, &opt_name, 0, 0, 0},
+	{"unique",    0,   POPT_ARG_VAL, &opt_unique, 1, 0, 0},
+	{"offset",    0,   POPT_ARG_INT, &opt_offset, 0, 0, 0},
+	{"limit",     0,   POPT_ARG_INT, &opt_limit, 0, 0, 0},
+	{"machine",   'm', POPT_ARG_VAL, &opt_machine, 1, 0, 0},
 	{"list-options", 0, POPT_ARG_NONE, NULL, OPT_LIST_OPTIONS, NULL, NULL},
 	{0, 0, 0, 0, 0, 0, 0}
 };
@@ -83,9 +95,15 @@ static void usage(FILE *ofp)
 	fprintf(ofp, "  -k, --kernel            Select kernel domain\n");
 	fprintf(ofp, "  -u, --userspace         Select user-space domain.\n");
 	fprintf(ofp, "  -f, --fields            List event fields.\n");
-#if 0
+	fprintf(ofp, "\n");
+	fprintf(ofp, "Event listing Options (-k or -u without a session):\n");
 	fprintf(ofp, "  -p, --pid PID           List user-space events by PID\n");
-#endif
+	fprintf(ofp, "      --name PATTERN      List events matching the glob PATTERN\n");
+	fprintf(ofp, "      --unique            List events once across applications\n");
+	fprintf(ofp, "      --offset N          Skip the first N events\n");
+	fprintf(ofp, "      --limit N           List at most N events\n");
+	fprintf(ofp, "  -m, --machine           One tab separated line per event:\n");
+	fprintf(ofp, "                          PID, name, loglevel\n");
 	fprintf(ofp, "\n");
 	fprintf(ofp, "Session Options:\n");
 	fprintf(ofp, "  -c, --channel NAME      List details of a channel\n");
@@ -294,6 +312,48 @@ static void print_event_field(struct lttng_event_field *field)
 		field_type(field), field->nowrite ? " [no write]" : "");
 }
 
+/*
+ * Print single event as a tab separated line for scripts: PID, name and
+ * loglevel (-1 if none).
+ */
+static void print_events_machine(struct lttng_event *event)
+{
+	MSG("%d\t%s\t%d", event->pid, event->name, event->loglevel);
+}
+
+/*
+ * Fill tracepoint query from the command line options.
+ */
+static int fill_tracepoint_query(struct lttng_tracepoint_query *query)
+{
+	int ret = CMD_SUCCESS;
+
+	memset(query, 0, sizeof(*query));
+
+	if (opt_offset < 0 || opt_limit < 0 || opt_pid < 0) {
+		ERR("Invalid negative value for --pid, --offset or --limit");
+		ret = CMD_ERROR;
+		goto end;
+	}
+
+	if (opt_name) {
+		if (strlen(opt_name) >= sizeof(query->name)) {
+			ERR("Name pattern too long (max %zu characters)",
+					sizeof(query->name) - 1);
+			ret = CMD_ERROR;
+			goto end;
+		}
+		strncpy(query->name, opt_name, sizeof(query->name));
+	}
+	query->pid = opt_pid;
+	query->offset = opt_offset;
+	query->count = opt_limit;
+	query->merge_duplicates = opt_unique;
+
+end:
+	return ret;
+}
+
 /*
  * Ask session daemon for all user space tracepoints available.
  */
@@ -303,6 +363,7 @@ static int list_ust_events(void)
 	struct lttng_domain domain;
 	struct lttng_handle *handle;
 	struct lttng_event *event_list;
+	struct lttng_tracepoint_query query;
 	pid_t cur_pid = 0;
 	char *cmdline = NULL;
 
@@ -310,6 +371,10 @@ static int list_ust_events(void)
 
 	DBG("Getting UST tracing events");
 
+	if (fill_tracepoint_query(&query) != CMD_SUCCESS) {
+		return -1;
+	}
+
 	domain.type = LTTNG_DOMAIN_UST;
 
 	handle = lttng_create_handle(NULL, &domain);
@@ -317,13 +382,20 @@ static int list_ust_events(void)
 		goto error;
 	}
 
-	size = lttng_list_tracepoints(handle, &event_list);
+	size = lttng_list_tracepoints_query(handle, &query, &event_list);
 	if (size < 0) {
 		ERR("Unable to list UST events: %s", lttng_strerror(size));
 		lttng_destroy_handle(handle);
 		return size;
 	}
 
+	if (opt_machine) {
+		for (i = 0; i < size; i++) {
+			print_events_machine(&event_list[i]);
+		}
+		goto end;
+	}
+
 	MSG("UST events:\n-------------");
 
 	if (size == 0) {
@@ -331,6 +403,11 @@ static int list_ust_events(void)
 	}
 
 	for (i = 0; i < size; i++) {
+		if (opt_unique) {
+			/* Merged events do not belong to a single application. */
+			print_events(&event_list[i]);
+			continue;
+		}
 		if (cur_pid != event_list[i].pid) {
 			cur_pid = event_list[i].pid;
 			cmdline = get_cmdline_by_pid(cur_pid);
@@ -342,6 +419,7 @@ static int list_ust_events(void)
 
 	MSG("");
 
+end:
 	free(event_list);
 	lttng_destroy_handle(handle);
 
@@ -427,11 +505,16 @@ static int list_kernel_events(void)
 	struct lttng_domain domain;
 	struct lttng_handle *handle;
 	struct lttng_event *event_list;
+	struct lttng_tracepoint_query query;
 
 	memset(&domain, 0, sizeof(domain));
 
 	DBG("Getting kernel tracing events");
 
+	if (fill_tracepoint_query(&query) != CMD_SUCCESS) {
+		return -1;
+	}
+
 	domain.type = LTTNG_DOMAIN_KERNEL;
 
 	handle = lttng_create_handle(NULL, &domain);
@@ -439,20 +522,26 @@ static int list_kernel_events(void)
 		goto error;
 	}
 
-	size = lttng_list_tracepoints(handle, &event_list);
+	size = lttng_list_tracepoints_query(handle, &query, &event_list);
 	if (size < 0) {
 		ERR("Unable to list kernel events: %s", lttng_strerror(size));
 		lttng_destroy_handle(handle);
 		return size;
 	}
 
-	MSG("Kernel events:\n-------------");
+	if (opt_machine) {
+		for (i = 0; i < size; i++) {
+			print_events_machine(&event_list[i]);
+		}
+	} else {
+		MSG("Kernel events:\n-------------");
 
-	for (i = 0; i < size; i++) {
-		print_events(&event_list[i]);
-	}
+		for (i = 0; i < size; i++) {
+			print_events(&event_list[i]);
+		}
 
-	MSG("");
+		MSG("");
+	}
 
 	free(event_list);
 
@@ -520,6 +609,14 @@ static void print_channel(struct lttng_channel *channel)
 			MSG("%soutput: mmap()", indent6);
 			break;
 	}
+	if (channel->attr.compression != LTTNG_COMPRESSION_NONE) {
+		MSG("%scompression: %s", indent6,
+				lttng_compress_name(channel->attr.compression));
+	}
+	if (channel->attr.live_timer_interval) {
+		MSG("%slive timer interval: %u", indent6,
+				channel->attr.live_timer_interval);
+	}
 }
 
 /*
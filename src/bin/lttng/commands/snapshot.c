@@ -0,0 +1,156 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 only,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include <popt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <inttypes.h>
+
+#include "../command.h"
+
+#include <src/common/sessiond-comm/sessiond-comm.h>
+#include <src/common/utils.h>
+
+static char *opt_session_name;
+static char *opt_snapshot_name;
+static uint64_t opt_max_size;
+
+enum {
+	OPT_HELP = 1,
+	OPT_LIST_OPTIONS,
+	OPT_MAX_SIZE,
+};
+
+static struct poptOption long_options[] = {
+	/* longName, shortName, argInfo, argPtr, value, descrip, argDesc */
+	{"help",         'h', POPT_ARG_NONE, 0, OPT_HELP, 0, 0},
+	{"session",      's', POPT_ARG_STRING, &opt_session_name, 0, 0, 0},
+	{"max-size",     'm', POPT_ARG_STRING, 0, OPT_MAX_SIZE, 0, 0},
+	{"list-options", 0, POPT_ARG_NONE, NULL, OPT_LIST_OPTIONS, NULL, NULL},
+	{0, 0, 0, 0, 0, 0, 0}
+};
+
+/*
+ * usage
+ */
+static void usage(FILE *ofp)
+{
+	fprintf(ofp, "usage: lttng snapshot [NAME] [OPTIONS]\n");
+	fprintf(ofp, "\n");
+	fprintf(ofp, "Record a snapshot of the buffers of a session created with\n");
+	fprintf(ofp, "'lttng create --snapshot' without stopping tracing.\n");
+	fprintf(ofp, "\n");
+	fprintf(ofp, "Where NAME is an optional snapshot name written under the session\n");
+	fprintf(ofp, "output. If not specified, a name made of a sequence number and the\n");
+	fprintf(ofp, "date and time is used.\n");
+	fprintf(ofp, "\n");
+	fprintf(ofp, "Options:\n");
+	fprintf(ofp, "  -h, --help               Show this help\n");
+	fprintf(ofp, "      --list-options       Simple listing of options\n");
+	fprintf(ofp, "  -s, --session NAME       Apply to session name\n");
+	fprintf(ofp, "  -m, --max-size SIZE      Maximum bytes recorded for each stream.\n");
+	fprintf(ofp, "                           The most recent sub-buffers are kept.\n");
+	fprintf(ofp, "                           We support suffixes k, M and G.\n");
+	fprintf(ofp, "\n");
+}
+
+/*
+ * Record a snapshot of the session.
+ */
+static int record_snapshot(void)
+{
+	int ret;
+	char *session_name;
+
+	if (opt_session_name == NULL) {
+		session_name = get_session_name();
+		if (session_name == NULL) {
+			ret = CMD_ERROR;
+			goto error;
+		}
+	} else {
+		session_name = opt_session_name;
+	}
+
+	DBG("Recording snapshot of session %s", session_name);
+
+	ret = lttng_snapshot_record(session_name, opt_snapshot_name, opt_max_size);
+	if (ret < 0) {
+		ERR("%s", lttng_strerror(ret));
+		goto free_name;
+	}
+
+	ret = CMD_SUCCESS;
+
+	MSG("Snapshot recorded for session %s", session_name);
+
+free_name:
+	if (opt_session_name == NULL) {
+		free(session_name);
+	}
+error:
+	return ret;
+}
+
+/*
+ *  cmd_snapshot
+ *
+ *  The 'snapshot <options>' first level command
+ */
+int cmd_snapshot(int argc, const char **argv)
+{
+	int opt, ret = CMD_SUCCESS;
+	char *opt_arg;
+	static poptContext pc;
+
+	pc = poptGetContext(NULL, argc, argv, long_options, 0);
+	poptReadDefaultConfig(pc, 0);
+
+	while ((opt = poptGetNextOpt(pc)) != -1) {
+		switch (opt) {
+		case OPT_HELP:
+			usage(stdout);
+			goto end;
+		case OPT_LIST_OPTIONS:
+			list_cmd_options(stdout, long_options);
+			goto end;
+		case OPT_MAX_SIZE:
+			opt_arg = poptGetOptArg(pc);
+			if (utils_parse_size_suffix(opt_arg, &opt_max_size) < 0) {
+				ERR("Wrong value in --max-size parameter: %s", opt_arg);
+				ret = CMD_ERROR;
+				goto end;
+			}
+			break;
+		default:
+			usage(stderr);
+			ret = CMD_UNDEFINED;
+			goto end;
+		}
+	}
+
+	opt_snapshot_name = (char*) poptGetArg(pc);
+
+	ret = record_snapshot();
+
+end:
+	poptFreeContext(pc);
+	return ret;
+}
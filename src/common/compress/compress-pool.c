@@ -0,0 +1,293 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <urcu.h>
+
+#include <common/common.h>
+
+#include "compress-pool.h"
+
+struct lttng_compress_worker {
+	pthread_t thread;
+	struct lttng_compress_pool *pool;
+	/* Jobs to compress, in submission order. */
+	struct cds_list_head queue;
+	pthread_cond_t cond;
+};
+
+struct lttng_compress_pool {
+	/* Protects the queues, the job counters and the quit flag. */
+	pthread_mutex_t lock;
+	/* Signaled each time a job completes. */
+	pthread_cond_t idle_cond;
+	unsigned int nr_jobs;
+	unsigned int max_jobs;
+	int quit;
+	unsigned int nr_workers;
+	struct lttng_compress_worker *workers;
+};
+
+/*
+ * Compress the packet of a job in a newly allocated frame.
+ */
+static void compress_job(struct lttng_compress_job *job)
+{
+	size_t bound;
+
+	if (job->algo == LTTNG_COMPRESSION_NONE) {
+		return;
+	}
+
+	bound = lttng_compress_frame_bound(job->algo, job->src_len);
+	if (!bound) {
+		job->frame_len = -ENOTSUP;
+		return;
+	}
+
+	job->frame = malloc(bound);
+	if (!job->frame) {
+		job->frame_len = -ENOMEM;
+		return;
+	}
+
+	job->frame_len = lttng_compress_frame(job->algo, job->src, job->src_len,
+			job->frame, bound);
+	if (job->frame_len < 0) {
+		free(job->frame);
+		job->frame = NULL;
+	}
+}
+
+/*
+ * Worker thread. Compress the jobs of its queue in order and hand them to
+ * their done callback. The queue is drained before quitting.
+ */
+static void *thread_compress_worker(void *data)
+{
+	struct lttng_compress_job *job;
+	struct lttng_compress_lane *lane;
+	struct lttng_compress_worker *worker = data;
+	struct lttng_compress_pool *pool = worker->pool;
+
+	/* The done callbacks may use RCU protected objects. */
+	rcu_register_thread();
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		while (cds_list_empty(&worker->queue) && !pool->quit) {
+			pthread_cond_wait(&worker->cond, &pool->lock);
+		}
+		if (cds_list_empty(&worker->queue)) {
+			break;
+		}
+		job = cds_list_entry(worker->queue.next, struct lttng_compress_job,
+				node);
+		cds_list_del(&job->node);
+		pthread_mutex_unlock(&pool->lock);
+
+		compress_job(job);
+		/* The job is freed by the callback. */
+		lane = job->lane;
+		job->done(job);
+
+		pthread_mutex_lock(&pool->lock);
+		lane->pending--;
+		pool->nr_jobs--;
+		if (lane->completed) {
+			lane->completed(lane);
+		}
+		pthread_cond_broadcast(&pool->idle_cond);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	rcu_unregister_thread();
+	return NULL;
+}
+
+/*
+ * Create a pool of nr_workers compression threads. At most max_jobs packets
+ * can be waiting in the pool, a submission blocks beyond that. A max_jobs of
+ * 0 leaves the pool unbounded for users bounding their lanes themselves.
+ *
+ * Return the pool or NULL on error.
+ */
+struct lttng_compress_pool *lttng_compress_pool_create(unsigned int nr_workers,
+		unsigned int max_jobs)
+{
+	int ret;
+	unsigned int i;
+	struct lttng_compress_pool *pool;
+
+	assert(nr_workers > 0);
+
+	pool = zmalloc(sizeof(*pool));
+	if (!pool) {
+		PERROR("zmalloc compress pool");
+		goto error;
+	}
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->idle_cond, NULL);
+	pool->max_jobs = max_jobs;
+
+	pool->workers = zmalloc(nr_workers * sizeof(*pool->workers));
+	if (!pool->workers) {
+		PERROR("zmalloc compress workers");
+		goto error_free;
+	}
+
+	for (i = 0; i < nr_workers; i++) {
+		struct lttng_compress_worker *worker = &pool->workers[i];
+
+		worker->pool = pool;
+		CDS_INIT_LIST_HEAD(&worker->queue);
+		pthread_cond_init(&worker->cond, NULL);
+		ret = pthread_create(&worker->thread, NULL, thread_compress_worker,
+				worker);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_create compress worker");
+			goto error_join;
+		}
+		pool->nr_workers++;
+	}
+
+	DBG("Compression pool created with %u workers", nr_workers);
+	return pool;
+
+error_join:
+	lttng_compress_pool_destroy(pool);
+	return NULL;
+error_free:
+	free(pool);
+error:
+	return NULL;
+}
+
+/*
+ * Complete every submitted job, stop the workers and free the pool.
+ */
+void lttng_compress_pool_destroy(struct lttng_compress_pool *pool)
+{
+	int ret;
+	unsigned int i;
+
+	if (!pool) {
+		return;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->quit = 1;
+	for (i = 0; i < pool->nr_workers; i++) {
+		pthread_cond_signal(&pool->workers[i].cond);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; i < pool->nr_workers; i++) {
+		ret = pthread_join(pool->workers[i].thread, NULL);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_join compress worker");
+		}
+		pthread_cond_destroy(&pool->workers[i].cond);
+	}
+
+	free(pool->workers);
+	pthread_cond_destroy(&pool->idle_cond);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool);
+}
+
+/*
+ * Initialize a lane, assigning it to a worker from its key.
+ */
+void lttng_compress_lane_init(struct lttng_compress_pool *pool,
+		struct lttng_compress_lane *lane, uint64_t key)
+{
+	assert(pool);
+	assert(lane);
+
+	lane->worker = &pool->workers[key % pool->nr_workers];
+	lane->pending = 0;
+	lane->completed = NULL;
+}
+
+/*
+ * Queue a job on its lane. The job must have its lane, algo, src and done
+ * callback set. Blocks while the pool is full.
+ */
+void lttng_compress_pool_submit(struct lttng_compress_pool *pool,
+		struct lttng_compress_job *job)
+{
+	struct lttng_compress_worker *worker;
+
+	assert(pool);
+	assert(job);
+	assert(job->lane && job->lane->worker);
+	assert(job->done);
+
+	worker = job->lane->worker;
+	job->frame = NULL;
+	job->frame_len = 0;
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->max_jobs && pool->nr_jobs >= pool->max_jobs) {
+		pthread_cond_wait(&pool->idle_cond, &pool->lock);
+	}
+	cds_list_add_tail(&job->node, &worker->queue);
+	job->lane->pending++;
+	pool->nr_jobs++;
+	pthread_cond_signal(&worker->cond);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/*
+ * Return the number of jobs of a lane not completed yet.
+ */
+unsigned int lttng_compress_lane_pending(struct lttng_compress_pool *pool,
+		struct lttng_compress_lane *lane)
+{
+	unsigned int pending;
+
+	assert(pool);
+	assert(lane);
+
+	pthread_mutex_lock(&pool->lock);
+	pending = lane->pending;
+	pthread_mutex_unlock(&pool->lock);
+
+	return pending;
+}
+
+/*
+ * Wait for the completion of every job submitted on a lane. Must not be
+ * called from a done callback.
+ */
+void lttng_compress_lane_wait(struct lttng_compress_pool *pool,
+		struct lttng_compress_lane *lane)
+{
+	assert(pool);
+	assert(lane);
+
+	pthread_mutex_lock(&pool->lock);
+	while (lane->pending > 0) {
+		pthread_cond_wait(&pool->idle_cond, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,79 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef LTTNG_COMPRESS_POOL_H
+#define LTTNG_COMPRESS_POOL_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <urcu/list.h>
+
+#include "compress.h"
+
+struct lttng_compress_pool;
+struct lttng_compress_worker;
+
+/*
+ * Ordered sequence of jobs, typically the packets of one stream. The jobs of
+ * a lane are always handled by the same worker thread, in submission order.
+ */
+struct lttng_compress_lane {
+	struct lttng_compress_worker *worker;
+	/* Jobs submitted and not completed yet. Protected by the pool lock. */
+	unsigned int pending;
+	/*
+	 * Optional, called by the worker with the pool lock held once a job of
+	 * the lane is completed and accounted for in pending.
+	 */
+	void (*completed)(struct lttng_compress_lane *lane);
+};
+
+/*
+ * A packet to compress. It is usually embedded in a structure of the user
+ * carrying what the done callback needs to write the frame. A job with the
+ * LTTNG_COMPRESSION_NONE algorithm is only ordered on its lane: the frame is
+ * left NULL and the done callback uses src.
+ */
+struct lttng_compress_job {
+	struct cds_list_head node;
+	struct lttng_compress_lane *lane;
+	enum lttng_compression algo;
+	/* Uncompressed packet, owned by the job. */
+	char *src;
+	size_t src_len;
+	/* Frame allocated by the worker, or NULL with a negative frame_len. */
+	char *frame;
+	ssize_t frame_len;
+	/*
+	 * Called by the worker thread once the packet is compressed, in the
+	 * submission order of the lane. It owns the job and must free it along
+	 * with src and frame.
+	 */
+	void (*done)(struct lttng_compress_job *job);
+};
+
+struct lttng_compress_pool *lttng_compress_pool_create(unsigned int nr_workers,
+		unsigned int max_jobs);
+void lttng_compress_pool_destroy(struct lttng_compress_pool *pool);
+void lttng_compress_lane_init(struct lttng_compress_pool *pool,
+		struct lttng_compress_lane *lane, uint64_t key);
+void lttng_compress_pool_submit(struct lttng_compress_pool *pool,
+		struct lttng_compress_job *job);
+unsigned int lttng_compress_lane_pending(struct lttng_compress_pool *pool,
+		struct lttng_compress_lane *lane);
+void lttng_compress_lane_wait(struct lttng_compress_pool *pool,
+		struct lttng_compress_lane *lane);
+
+#endif /* LTTNG_COMPRESS_POOL_H */
@@ -0,0 +1,209 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <endian.h>
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+
+#ifdef LTTNG_HAVE_LIBLZ4
+#include <lz4.h>
+#endif
+#ifdef LTTNG_HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+
+#include <common/defaults.h>
+
+#include "compress.h"
+
+/*
+ * Return the maximum size of the frame of a packet of len bytes, header
+ * included, or 0 if the algorithm is not supported.
+ */
+size_t lttng_compress_frame_bound(enum lttng_compression algo, size_t len)
+{
+	size_t bound;
+
+	switch (algo) {
+#ifdef LTTNG_HAVE_LIBLZ4
+	case LTTNG_COMPRESSION_LZ4:
+		if (len > LZ4_MAX_INPUT_SIZE) {
+			return 0;
+		}
+		bound = LZ4_compressBound(len);
+		break;
+#endif
+#ifdef LTTNG_HAVE_LIBZSTD
+	case LTTNG_COMPRESSION_ZSTD:
+		bound = ZSTD_compressBound(len);
+		break;
+#endif
+	default:
+		return 0;
+	}
+
+	return sizeof(struct lttng_compress_frame_hdr) + bound;
+}
+
+/*
+ * Compress the len bytes of a packet in a frame written in dst, dst_len
+ * being at least lttng_compress_frame_bound(algo, len).
+ *
+ * Return the size of the frame or a negative errno value.
+ */
+ssize_t lttng_compress_frame(enum lttng_compression algo, const char *src,
+		size_t len, char *dst, size_t dst_len)
+{
+	size_t payload_len;
+	struct lttng_compress_frame_hdr hdr;
+
+	assert(src);
+	assert(dst);
+
+	if (len > UINT32_MAX || dst_len < lttng_compress_frame_bound(algo, len)) {
+		return -EINVAL;
+	}
+
+	switch (algo) {
+#ifdef LTTNG_HAVE_LIBLZ4
+	case LTTNG_COMPRESSION_LZ4:
+	{
+		int ret;
+
+		ret = LZ4_compress_default(src, dst + sizeof(hdr), len,
+				dst_len - sizeof(hdr));
+		if (ret <= 0) {
+			return -EIO;
+		}
+		payload_len = ret;
+		break;
+	}
+#endif
+#ifdef LTTNG_HAVE_LIBZSTD
+	case LTTNG_COMPRESSION_ZSTD:
+	{
+		size_t ret;
+
+		ret = ZSTD_compress(dst + sizeof(hdr), dst_len - sizeof(hdr),
+				src, len, DEFAULT_COMPRESSION_ZSTD_LEVEL);
+		if (ZSTD_isError(ret)) {
+			return -EIO;
+		}
+		payload_len = ret;
+		break;
+	}
+#endif
+	default:
+		return -ENOTSUP;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = htobe32(LTTNG_COMPRESS_FRAME_MAGIC);
+	hdr.algo = algo;
+	hdr.compressed_size = htobe32(payload_len);
+	hdr.uncompressed_size = htobe32(len);
+	memcpy(dst, &hdr, sizeof(hdr));
+
+	return sizeof(hdr) + payload_len;
+}
+
+/*
+ * Return 1 if the buffer starts with a frame header.
+ */
+int lttng_compress_is_frame(const char *buf, size_t len)
+{
+	uint32_t magic;
+
+	if (len < sizeof(struct lttng_compress_frame_hdr)) {
+		return 0;
+	}
+	memcpy(&magic, buf, sizeof(magic));
+	return be32toh(magic) == LTTNG_COMPRESS_FRAME_MAGIC;
+}
+
+/*
+ * Decompress the beginning of a frame, up to dst_len bytes. A reader only
+ * needing the packet header can ask for a few bytes without paying for the
+ * whole packet.
+ *
+ * Return the number of bytes written in dst or a negative errno value.
+ */
+ssize_t lttng_compress_frame_decode(const char *frame, size_t frame_len,
+		char *dst, size_t dst_len)
+{
+	struct lttng_compress_frame_hdr hdr;
+	size_t payload_len, uncompressed_len;
+
+	assert(frame);
+	assert(dst);
+
+	if (!lttng_compress_is_frame(frame, frame_len)) {
+		return -EINVAL;
+	}
+	memcpy(&hdr, frame, sizeof(hdr));
+	payload_len = be32toh(hdr.compressed_size);
+	uncompressed_len = be32toh(hdr.uncompressed_size);
+	if (payload_len > frame_len - sizeof(hdr)) {
+		return -EINVAL;
+	}
+	if (dst_len > uncompressed_len) {
+		dst_len = uncompressed_len;
+	}
+
+	switch (hdr.algo) {
+#ifdef LTTNG_HAVE_LIBLZ4
+	case LTTNG_COMPRESSION_LZ4:
+	{
+		int ret;
+
+		ret = LZ4_decompress_safe_partial(frame + sizeof(hdr), dst,
+				payload_len, dst_len, dst_len);
+		if (ret < 0) {
+			return -EIO;
+		}
+		return ret;
+	}
+#endif
+#ifdef LTTNG_HAVE_LIBZSTD
+	case LTTNG_COMPRESSION_ZSTD:
+	{
+		size_t ret;
+		ZSTD_DStream *dstream;
+		ZSTD_inBuffer in = { frame + sizeof(hdr), payload_len, 0 };
+		ZSTD_outBuffer out = { dst, dst_len, 0 };
+
+		dstream = ZSTD_createDStream();
+		if (!dstream) {
+			return -ENOMEM;
+		}
+		ret = ZSTD_initDStream(dstream);
+		while (!ZSTD_isError(ret) && out.pos < out.size &&
+				in.pos < in.size) {
+			ret = ZSTD_decompressStream(dstream, &out, &in);
+		}
+		ZSTD_freeDStream(dstream);
+		if (ZSTD_isError(ret)) {
+			return -EIO;
+		}
+		return out.pos;
+	}
+#endif
+	default:
+		return -ENOTSUP;
+	}
+}
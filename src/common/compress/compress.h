@@ -0,0 +1,91 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef LTTNG_COMPRESS_H
+#define LTTNG_COMPRESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <lttng/lttng.h>
+#include <common/macros.h>
+
+/*
+ * A compressed tracefile is a sequence of frames, one per packet, each made
+ * of a header followed by the compressed packet. Every header field is big
+ * endian. A frame decompresses to the exact bytes the packet would have in
+ * an uncompressed tracefile, padding included.
+ *
+ * The frames are seekable through the packet index of the tracefile: the
+ * offset of an entry is the offset of the frame in the file while its sizes
+ * and timestamps are the ones of the uncompressed packet.
+ */
+#define LTTNG_COMPRESS_FRAME_MAGIC	0xC1FC0F4A
+
+struct lttng_compress_frame_hdr {
+	uint32_t magic;
+	uint8_t algo;			/* enum lttng_compression */
+	uint8_t reserved[3];
+	uint32_t compressed_size;	/* bytes following the header */
+	uint32_t uncompressed_size;	/* bytes of the packet */
+} LTTNG_PACKED;
+
+/*
+ * Return 1 if this build can compress with the given algorithm.
+ */
+static inline int lttng_compress_supported(enum lttng_compression algo)
+{
+	switch (algo) {
+	case LTTNG_COMPRESSION_NONE:
+		return 1;
+#ifdef LTTNG_HAVE_LIBLZ4
+	case LTTNG_COMPRESSION_LZ4:
+		return 1;
+#endif
+#ifdef LTTNG_HAVE_LIBZSTD
+	case LTTNG_COMPRESSION_ZSTD:
+		return 1;
+#endif
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Return the name of a compression algorithm as used on the command line.
+ */
+static inline const char *lttng_compress_name(enum lttng_compression algo)
+{
+	switch (algo) {
+	case LTTNG_COMPRESSION_NONE:
+		return "none";
+	case LTTNG_COMPRESSION_LZ4:
+		return "lz4";
+	case LTTNG_COMPRESSION_ZSTD:
+		return "zstd";
+	default:
+		return "unknown";
+	}
+}
+
+size_t lttng_compress_frame_bound(enum lttng_compression algo, size_t len);
+ssize_t lttng_compress_frame(enum lttng_compression algo, const char *src,
+		size_t len, char *dst, size_t dst_len);
+int lttng_compress_is_frame(const char *buf, size_t len);
+ssize_t lttng_compress_frame_decode(const char *frame, size_t frame_len,
+		char *dst, size_t dst_len);
+
+#endif /* LTTNG_COMPRESS_H */
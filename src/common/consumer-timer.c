@@ -23,9 +23,13 @@
 
 #include <common/common.h>
 
+#include <common/kernel-ctl/kernel-ctl.h>
+
 #include "consumer-timer.h"
 #include "ust-consumer/ust-consumer.h"
 
+extern struct lttng_consumer_global_data consumer_data;
+
 static struct timer_signal_data timer_signal = {
 	.tid = 0,
 	.setup_done = 0,
@@ -52,6 +56,10 @@ static void setmask(sigset_t *mask)
 	if (ret) {
 		PERROR("sigaddset");
 	}
+	ret = sigaddset(mask, LTTNG_CONSUMER_SIG_LIVE);
+	if (ret) {
+		PERROR("sigaddset");
+	}
 }
 
 /*
@@ -86,6 +94,53 @@ static void metadata_switch_timer(struct lttng_consumer_local_data *ctx,
 	}
 }
 
+/*
+ * Execute action on a live timer: flush the current packet of every stream of
+ * the channel so the relayd receives it and live viewers can read it.
+ *
+ * A stream being consumed or torn down is skipped, the next tick catches up.
+ */
+static void live_timer(struct lttng_consumer_local_data *ctx,
+		int sig, siginfo_t *si, void *uc)
+{
+	int ret;
+	struct lttng_ht_iter iter;
+	struct lttng_consumer_channel *channel;
+	struct lttng_consumer_stream *stream;
+	struct lttng_ht *ht = consumer_data.stream_per_chan_id_ht;
+
+	channel = si->si_value.sival_ptr;
+	assert(channel);
+
+	DBG3("Live timer for channel %" PRIu64, channel->key);
+
+	rcu_read_lock();
+	cds_lfht_for_each_entry_duplicate(ht->ht,
+			ht->hash_fct(&channel->key, lttng_ht_seed), ht->match_fct,
+			&channel->key, &iter.iter, stream, node_channel_id.node) {
+		if (pthread_mutex_trylock(&stream->lock)) {
+			continue;
+		}
+		switch (ctx->type) {
+		case LTTNG_CONSUMER32_UST:
+		case LTTNG_CONSUMER64_UST:
+			lttng_ustconsumer_flush_buffer(stream, 1);
+			break;
+		case LTTNG_CONSUMER_KERNEL:
+			ret = kernctl_buffer_flush(stream->wait_fd);
+			if (ret < 0) {
+				ERR("Live timer kernel flush of stream %d", stream->wait_fd);
+			}
+			break;
+		case LTTNG_CONSUMER_UNKNOWN:
+			assert(0);
+			break;
+		}
+		pthread_mutex_unlock(&stream->lock);
+	}
+	rcu_read_unlock();
+}
+
 static
 void consumer_timer_signal_thread_qs(unsigned int signr)
 {
@@ -108,7 +163,7 @@ void consumer_timer_signal_thread_qs(unsigned int signr)
 		if (ret == -1) {
 			PERROR("sigpending");
 		}
-		if (!sigismember(&pending_set, LTTNG_CONSUMER_SIG_SWITCH)) {
+		if (!sigismember(&pending_set, signr)) {
 			break;
 		}
 		caa_cpu_relax();
@@ -194,6 +249,65 @@ void consumer_timer_switch_stop(struct lttng_consumer_channel *channel)
 	channel->switch_timer_enabled = 0;
 }
 
+/*
+ * Set the timer for periodical flush of the data streams of a channel
+ * streamed to a relayd, used for live reading.
+ */
+void consumer_timer_live_start(struct lttng_consumer_channel *channel,
+		unsigned int live_timer_interval)
+{
+	int ret;
+	struct sigevent sev;
+	struct itimerspec its;
+
+	assert(channel);
+	assert(channel->key);
+
+	if (live_timer_interval == 0) {
+		return;
+	}
+
+	sev.sigev_notify = SIGEV_SIGNAL;
+	sev.sigev_signo = LTTNG_CONSUMER_SIG_LIVE;
+	sev.sigev_value.sival_ptr = channel;
+	ret = timer_create(CLOCKID, &sev, &channel->live_timer);
+	if (ret == -1) {
+		PERROR("timer_create");
+		return;
+	}
+	channel->live_timer_enabled = 1;
+
+	its.it_value.tv_sec = live_timer_interval / 1000000;
+	its.it_value.tv_nsec = (live_timer_interval % 1000000) * 1000;
+	its.it_interval.tv_sec = its.it_value.tv_sec;
+	its.it_interval.tv_nsec = its.it_value.tv_nsec;
+
+	ret = timer_settime(channel->live_timer, 0, &its, NULL);
+	if (ret == -1) {
+		PERROR("timer_settime");
+	}
+}
+
+/*
+ * Stop and delete the live timer.
+ */
+void consumer_timer_live_stop(struct lttng_consumer_channel *channel)
+{
+	int ret;
+
+	assert(channel);
+
+	ret = timer_delete(channel->live_timer);
+	if (ret == -1) {
+		PERROR("timer_delete");
+	}
+
+	consumer_timer_signal_thread_qs(LTTNG_CONSUMER_SIG_LIVE);
+
+	channel->live_timer = 0;
+	channel->live_timer_enabled = 0;
+}
+
 /*
  * Block the RT signals for the entire process. It must be called from the
  * consumer main before creating the threads
@@ -213,9 +327,10 @@ void consumer_signal_init(void)
 }
 
 /*
- * This thread is the sighandler for signals LTTNG_CONSUMER_SIG_SWITCH and
- * LTTNG_CONSUMER_SIG_TEARDOWN that are emitted by the periodic timer to check
- * if new metadata is available.
+ * This thread is the sighandler for signals LTTNG_CONSUMER_SIG_SWITCH,
+ * LTTNG_CONSUMER_SIG_LIVE and LTTNG_CONSUMER_SIG_TEARDOWN that are emitted by
+ * the periodic timers to check if new metadata is available and to flush the
+ * streamed data channels.
  */
 void *consumer_timer_metadata_thread(void *data)
 {
@@ -237,6 +352,8 @@ void *consumer_timer_metadata_thread(void *data)
 			continue;
 		} else if (signr == LTTNG_CONSUMER_SIG_SWITCH) {
 			metadata_switch_timer(ctx, info.si_signo, &info, NULL);
+		} else if (signr == LTTNG_CONSUMER_SIG_LIVE) {
+			live_timer(ctx, info.si_signo, &info, NULL);
 		} else if (signr == LTTNG_CONSUMER_SIG_TEARDOWN) {
 			cmm_smp_mb();
 			CMM_STORE_SHARED(timer_signal.qs_done, 1);
@@ -19,6 +19,7 @@
 
 #define _GNU_SOURCE
 #include <assert.h>
+#include <fcntl.h>
 #include <poll.h>
 #include <pthread.h>
 #include <stdlib.h>
@@ -28,9 +29,11 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <signal.h>
 
 #include <common/common.h>
+#include <common/runas.h>
 #include <common/utils.h>
 #include <common/compat/poll.h>
 #include <common/kernel-ctl/kernel-ctl.h>
@@ -38,13 +41,19 @@
 #include <common/sessiond-comm/sessiond-comm.h>
 #include <common/kernel-consumer/kernel-consumer.h>
 #include <common/relayd/relayd.h>
+#include <common/index/index.h>
 #include <common/ust-consumer/ust-consumer.h>
+#include <common/consumer-timer.h>
+#include <common/consumer-metadata-cache.h>
+#include <common/cpu-topology.h>
+#include <common/obj-pool.h>
+#include <common/str-intern.h>
 
 #include "consumer.h"
 
 struct lttng_consumer_global_data consumer_data = {
 	.stream_count = 0,
-	.need_update = 1,
+	.update_gen = 1,
 	.type = LTTNG_CONSUMER_UNKNOWN,
 };
 
@@ -76,6 +85,35 @@ volatile int consumer_quit;
 static struct lttng_ht *metadata_ht;
 static struct lttng_ht *data_ht;
 
+/*
+ * Pool of threads compressing the packets of the compressed channels,
+ * created on first use.
+ */
+static struct lttng_compress_pool *compress_pool;
+static pthread_mutex_t compress_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Tracefiles of the local streams, closed while the streams are idle when
+ * there are too many of them.
+ */
+static struct lttng_fd_cache out_fd_cache;
+
+/* Order in which the data threads consume their ready streams. */
+static struct lttng_stream_sched_config sched_config;
+
+/*
+ * Streams and channels, recycled once freed instead of going back to malloc
+ * as they come and go with the per-PID buffers of the applications.
+ */
+static struct lttng_obj_pool stream_pool;
+static struct lttng_obj_pool channel_pool;
+
+/* A packet of a stream waiting in the compression pool. */
+struct consumer_compress_job {
+	struct lttng_compress_job job;
+	struct lttng_consumer_stream *stream;
+};
+
 /*
  * Notify a thread lttng pipe to poll back again. This usually means that some
  * global state has changed so we just send back the thread in a poll wait
@@ -90,6 +128,18 @@ static void notify_thread_lttng_pipe(struct lttng_pipe *pipe)
 	(void) lttng_pipe_write(pipe, &null_stream, sizeof(null_stream));
 }
 
+/*
+ * Wake up every data poll thread.
+ */
+static void notify_data_threads(struct lttng_consumer_local_data *ctx)
+{
+	unsigned int i;
+
+	for (i = 0; i < ctx->nb_data_threads; i++) {
+		notify_thread_lttng_pipe(ctx->data_threads[i].pipe);
+	}
+}
+
 static void notify_channel_pipe(struct lttng_consumer_local_data *ctx,
 		struct lttng_consumer_channel *chan,
 		uint64_t key,
@@ -208,24 +258,45 @@ struct lttng_consumer_channel *consumer_find_channel(uint64_t key)
 	return channel;
 }
 
-static void free_stream_rcu(struct rcu_head *head)
+/*
+ * Drop the interned path of a channel once it is no more read.
+ */
+static void release_channel(void *obj)
 {
-	struct lttng_ht_node_u64 *node =
-		caa_container_of(head, struct lttng_ht_node_u64, head);
-	struct lttng_consumer_stream *stream =
-		caa_container_of(node, struct lttng_consumer_stream, node);
+	struct lttng_consumer_channel *channel = obj;
 
-	free(stream);
+	lttng_intern_put(channel->pathname);
+	channel->pathname = NULL;
 }
 
-static void free_channel_rcu(struct rcu_head *head)
+/*
+ * Free a stream which was never added to the global hash tables, reusable
+ * right away.
+ */
+void consumer_free_stream(struct lttng_consumer_stream *stream)
 {
-	struct lttng_ht_node_u64 *node =
-		caa_container_of(head, struct lttng_ht_node_u64, head);
-	struct lttng_consumer_channel *channel =
-		caa_container_of(node, struct lttng_consumer_channel, node);
+	lttng_obj_pool_free(&stream_pool, stream);
+}
+
+/*
+ * Free a channel which was never added to the global hash tables, reusable
+ * right away.
+ */
+void consumer_free_channel(struct lttng_consumer_channel *channel)
+{
+	lttng_obj_pool_free(&channel_pool, channel);
+}
+
+/*
+ * Close the data connections of a relayd socket pair.
+ */
+static void close_relayd_data_socks(struct consumer_relayd_sock_pair *relayd)
+{
+	unsigned int i;
 
-	free(channel);
+	for (i = 0; i < relayd->nb_data_socks; i++) {
+		(void) relayd_close(&relayd->data_socks[i].sock);
+	}
 }
 
 /*
@@ -247,7 +318,7 @@ static void free_relayd_rcu(struct rcu_head *head)
 	 * there is no one referencing to this relayd object.
 	 */
 	(void) relayd_close(&relayd->control_sock);
-	(void) relayd_close(&relayd->data_sock);
+	close_relayd_data_socks(relayd);
 
 	free(relayd);
 }
@@ -279,6 +350,46 @@ static void destroy_relayd(struct consumer_relayd_sock_pair *relayd)
 	call_rcu(&relayd->node.head, free_relayd_rcu);
 }
 
+/*
+ * Destroy the streams of an unmonitored channel. Those were never added to the
+ * stream hash tables nor given an output.
+ */
+static void clean_channel_stream_list(struct lttng_consumer_channel *channel)
+{
+	int ret;
+	struct lttng_consumer_stream *stream, *stmp;
+
+	cds_list_for_each_entry_safe(stream, stmp, &channel->streams.head,
+			send_node) {
+		cds_list_del(&stream->send_node);
+		switch (consumer_data.type) {
+		case LTTNG_CONSUMER_KERNEL:
+			if (stream->mmap_base != NULL) {
+				ret = munmap(stream->mmap_base, stream->mmap_len);
+				if (ret != 0) {
+					PERROR("munmap");
+				}
+			}
+			if (stream->wait_fd >= 0) {
+				ret = close(stream->wait_fd);
+				if (ret) {
+					PERROR("close");
+				}
+			}
+			break;
+		case LTTNG_CONSUMER32_UST:
+		case LTTNG_CONSUMER64_UST:
+			lttng_ustconsumer_del_stream(stream);
+			break;
+		default:
+			ERR("Unknown consumer_data type");
+			assert(0);
+		}
+		consumer_free_stream(stream);
+	}
+	channel->streams.count = 0;
+}
+
 /*
  * Remove a channel from the global list protected by a mutex. This function is
  * also responsible for freeing its data structures.
@@ -292,6 +403,14 @@ void consumer_del_channel(struct lttng_consumer_channel *channel)
 
 	pthread_mutex_lock(&consumer_data.lock);
 
+	if (channel->live_timer_enabled == 1) {
+		consumer_timer_live_stop(channel);
+	}
+
+	if (!channel->monitor) {
+		clean_channel_stream_list(channel);
+	}
+
 	switch (consumer_data.type) {
 	case LTTNG_CONSUMER_KERNEL:
 		break;
@@ -311,11 +430,135 @@ void consumer_del_channel(struct lttng_consumer_channel *channel)
 	assert(!ret);
 	rcu_read_unlock();
 
-	call_rcu(&channel->node.head, free_channel_rcu);
+	if (channel->dirfd >= 0) {
+		ret = close(channel->dirfd);
+		if (ret) {
+			PERROR("close channel dirfd");
+		}
+		channel->dirfd = -1;
+	}
+
+	lttng_obj_pool_free_rcu(&channel_pool, channel);
 end:
 	pthread_mutex_unlock(&consumer_data.lock);
 }
 
+/*
+ * Return the directory of the channel tracefiles, opening it on first use.
+ * Streams of a channel are created by the session daemon thread while the
+ * data threads rotate the tracefiles of the other streams so the first one
+ * to open the directory wins.
+ *
+ * The directory is opened as the channel uid/gid like the tracefiles are, so
+ * the permissions of the session user are checked on the path leading to it,
+ * and the directory itself can't be a symbolic link.
+ *
+ * Return the directory file descriptor or -1 if it can't be opened, in which
+ * case the tracefiles are created with their full path.
+ */
+int consumer_channel_get_dirfd(struct lttng_consumer_channel *channel)
+{
+	int ret, fd;
+	size_t len;
+	char path[PATH_MAX];
+
+	assert(channel);
+
+	fd = uatomic_read(&channel->dirfd);
+	if (fd >= 0) {
+		goto end;
+	}
+
+	/* A trailing slash would follow a symbolic link despite O_NOFOLLOW. */
+	ret = snprintf(path, sizeof(path), "%s", channel->pathname);
+	if (ret < 0 || ret >= sizeof(path)) {
+		fd = -1;
+		goto end;
+	}
+	for (len = strlen(path); len > 1 && path[len - 1] == '/'; len--) {
+		path[len - 1] = '\0';
+	}
+
+	fd = run_as_open(path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC,
+			0, channel->uid, channel->gid);
+	if (fd < 0) {
+		DBG("Unable to open channel directory %s, using full paths",
+				channel->pathname);
+		goto end;
+	}
+
+	ret = uatomic_cmpxchg(&channel->dirfd, -1, fd);
+	if (ret != -1) {
+		/* Opened concurrently, use the other one. */
+		(void) close(fd);
+		fd = ret;
+	}
+
+end:
+	return fd;
+}
+
+/*
+ * Reopen the current tracefile of a local stream, closed by the fd cache.
+ */
+static int reopen_stream_out_fd(struct lttng_fd_cache_entry *entry)
+{
+	struct lttng_consumer_stream *stream = caa_container_of(entry,
+			struct lttng_consumer_stream, out_fd_entry);
+
+	DBG3("Reopening tracefile of stream %s", stream->name);
+	return utils_reopen_stream_file(consumer_channel_get_dirfd(stream->chan),
+			stream->chan->pathname, stream->name,
+			stream->chan->tracefile_size, stream->tracefile_count_current,
+			stream->uid, stream->gid);
+}
+
+/*
+ * Let the fd cache close the tracefile of a local stream while it is idle.
+ * Called once the out_fd of the stream is opened.
+ */
+void consumer_stream_cache_out_fd(struct lttng_consumer_stream *stream)
+{
+	assert(stream);
+	assert(stream->out_fd >= 0);
+
+	lttng_fd_cache_add(&out_fd_cache, &stream->out_fd_entry);
+}
+
+/*
+ * Remove the tracefile of a stream from the fd cache before closing it.
+ */
+void consumer_stream_uncache_out_fd(struct lttng_consumer_stream *stream)
+{
+	assert(stream);
+
+	lttng_fd_cache_del(&out_fd_cache, &stream->out_fd_entry);
+}
+
+/*
+ * Get the tracefile of a local stream before writing to it, reopening it if
+ * it was closed by the fd cache. It is kept open until
+ * consumer_stream_put_out_fd() which MUST be called even on error.
+ *
+ * Return the out_fd of the stream or a negative value.
+ */
+int consumer_stream_get_out_fd(struct lttng_consumer_stream *stream)
+{
+	assert(stream);
+
+	return lttng_fd_cache_get(&out_fd_cache, &stream->out_fd_entry);
+}
+
+/*
+ * Release the tracefile of a stream obtained by consumer_stream_get_out_fd().
+ */
+void consumer_stream_put_out_fd(struct lttng_consumer_stream *stream)
+{
+	assert(stream);
+
+	lttng_fd_cache_put(&stream->out_fd_entry);
+}
+
 /*
  * Iterate over the relayd hash table and destroy each element. Finally,
  * destroy the whole hash table.
@@ -408,7 +651,7 @@ static void cleanup_relayd(struct consumer_relayd_sock_pair *relayd,
 	 * read of this status which happens AFTER receiving this notify.
 	 */
 	if (ctx) {
-		notify_thread_lttng_pipe(ctx->consumer_data_pipe);
+		notify_data_threads(ctx);
 		notify_thread_lttng_pipe(ctx->consumer_metadata_pipe);
 	}
 }
@@ -453,6 +696,11 @@ void consumer_del_stream(struct lttng_consumer_stream *stream,
 		goto free_stream_rcu;
 	}
 
+	/* The output is used by the compression workers until then. */
+	if (stream->compress_lane.worker) {
+		lttng_compress_lane_wait(compress_pool, &stream->compress_lane);
+	}
+
 	pthread_mutex_lock(&consumer_data.lock);
 	pthread_mutex_lock(&stream->lock);
 
@@ -499,6 +747,7 @@ void consumer_del_stream(struct lttng_consumer_stream *stream,
 	assert(consumer_data.stream_count > 0);
 	consumer_data.stream_count--;
 
+	consumer_stream_uncache_out_fd(stream);
 	if (stream->out_fd >= 0) {
 		ret = close(stream->out_fd);
 		if (ret) {
@@ -506,6 +755,13 @@ void consumer_del_stream(struct lttng_consumer_stream *stream,
 		}
 	}
 
+	if (stream->index_fd >= 0) {
+		ret = close(stream->index_fd);
+		if (ret) {
+			PERROR("close index");
+		}
+	}
+
 	/* Check and cleanup relayd */
 	rcu_read_lock();
 	relayd = consumer_find_relayd(stream->net_seq_idx);
@@ -542,7 +798,7 @@ void consumer_del_stream(struct lttng_consumer_stream *stream,
 	}
 
 end:
-	consumer_data.need_update = 1;
+	consumer_data.update_gen++;
 	pthread_mutex_unlock(&stream->lock);
 	pthread_mutex_unlock(&consumer_data.lock);
 
@@ -551,7 +807,7 @@ end:
 	}
 
 free_stream_rcu:
-	call_rcu(&stream->node.head, free_stream_rcu);
+	lttng_obj_pool_free_rcu(&stream_pool, stream);
 }
 
 struct lttng_consumer_stream *consumer_allocate_stream(uint64_t channel_key,
@@ -569,9 +825,8 @@ struct lttng_consumer_stream *consumer_allocate_stream(uint64_t channel_key,
 	int ret;
 	struct lttng_consumer_stream *stream;
 
-	stream = zmalloc(sizeof(*stream));
+	stream = lttng_obj_pool_zalloc(&stream_pool);
 	if (stream == NULL) {
-		PERROR("malloc struct lttng_consumer_stream");
 		ret = -ENOMEM;
 		goto end;
 	}
@@ -580,12 +835,17 @@ struct lttng_consumer_stream *consumer_allocate_stream(uint64_t channel_key,
 
 	stream->key = stream_key;
 	stream->out_fd = -1;
+	lttng_fd_cache_entry_init(&stream->out_fd_entry, &stream->out_fd,
+			reopen_stream_out_fd);
+	stream->index_fd = -1;
 	stream->out_fd_offset = 0;
 	stream->state = state;
 	stream->uid = uid;
 	stream->gid = gid;
 	stream->net_seq_idx = relayd_id;
+	stream->relayd_data_sock = -1;
 	stream->session_id = session_id;
+	stream->cpu = cpu;
 	pthread_mutex_init(&stream->lock, NULL);
 
 	/* If channel is the metadata, flag this stream as metadata. */
@@ -620,7 +880,7 @@ struct lttng_consumer_stream *consumer_allocate_stream(uint64_t channel_key,
 
 error:
 	rcu_read_unlock();
-	free(stream);
+	consumer_free_stream(stream);
 end:
 	if (alloc_ret) {
 		*alloc_ret = ret;
@@ -682,7 +942,7 @@ static int add_stream(struct lttng_consumer_stream *stream,
 
 	/* Update consumer data once the node is inserted. */
 	consumer_data.stream_count++;
-	consumer_data.need_update = 1;
+	consumer_data.update_gen++;
 
 	rcu_read_unlock();
 	pthread_mutex_unlock(&stream->lock);
@@ -721,6 +981,7 @@ end:
 struct consumer_relayd_sock_pair *consumer_allocate_relayd_sock_pair(
 		int net_seq_idx)
 {
+	unsigned int i;
 	struct consumer_relayd_sock_pair *obj = NULL;
 
 	/* Negative net sequence index is a failure */
@@ -738,7 +999,10 @@ struct consumer_relayd_sock_pair *consumer_allocate_relayd_sock_pair(
 	obj->refcount = 0;
 	obj->destroy_flag = 0;
 	obj->control_sock.sock.fd = -1;
-	obj->data_sock.sock.fd = -1;
+	for (i = 0; i < DEFAULT_RELAYD_MAX_DATA_CONNECTIONS; i++) {
+		obj->data_socks[i].sock.sock.fd = -1;
+		pthread_mutex_init(&obj->data_socks[i].mutex, NULL);
+	}
 	lttng_ht_node_init_u64(&obj->node, obj->net_seq_idx);
 	pthread_mutex_init(&obj->ctrl_sock_mutex, NULL);
 
@@ -775,6 +1039,32 @@ error:
 	return relayd;
 }
 
+/*
+ * Return the relayd data connection of a stream, mapping the stream on one
+ * by its relayd stream id the first time. The session daemon sends all the
+ * data connections of a relayd before any stream, so the mapping is stable
+ * and the packets of a stream stay in order on a single connection.
+ */
+static struct consumer_relayd_data_sock *get_relayd_data_sock(
+		struct lttng_consumer_stream *stream,
+		struct consumer_relayd_sock_pair *relayd)
+{
+	unsigned int nb_data_socks;
+
+	if (stream->relayd_data_sock < 0) {
+		nb_data_socks = CMM_LOAD_SHARED(relayd->nb_data_socks);
+		if (nb_data_socks == 0) {
+			/* No data connection yet, writing on the invalid fd fails. */
+			return &relayd->data_socks[0];
+		}
+		/* Match the publication of the connection. */
+		cmm_smp_rmb();
+		stream->relayd_data_sock = stream->relayd_stream_id % nb_data_socks;
+	}
+
+	return &relayd->data_socks[stream->relayd_data_sock];
+}
+
 /*
  * Handle stream for relayd transmission if the stream applies for network
  * streaming where the net sequence index is set.
@@ -787,6 +1077,7 @@ static int write_relayd_stream_header(struct lttng_consumer_stream *stream,
 {
 	int outfd = -1, ret;
 	struct lttcomm_relayd_data_hdr data_hdr;
+	struct consumer_relayd_data_sock *data_sock;
 
 	/* Safety net */
 	assert(stream);
@@ -819,7 +1110,9 @@ static int write_relayd_stream_header(struct lttng_consumer_stream *stream,
 		data_hdr.net_seq_num = htobe64(stream->next_net_seq_num);
 		/* Other fields are zeroed previously */
 
-		ret = relayd_send_data_hdr(&relayd->data_sock, &data_hdr,
+		/* Caller MUST acquire the lock of the stream data socket */
+		data_sock = get_relayd_data_sock(stream, relayd);
+		ret = relayd_send_data_hdr(&data_sock->sock, &data_hdr,
 				sizeof(data_hdr));
 		if (ret < 0) {
 			goto error;
@@ -828,7 +1121,7 @@ static int write_relayd_stream_header(struct lttng_consumer_stream *stream,
 		++stream->next_net_seq_num;
 
 		/* Set to go on data socket */
-		outfd = relayd->data_sock.sock.fd;
+		outfd = data_sock->sock.sock.fd;
 	}
 
 error:
@@ -850,13 +1143,22 @@ struct lttng_consumer_channel *consumer_allocate_channel(uint64_t key,
 		int relayd_id,
 		enum lttng_event_output output,
 		uint64_t tracefile_size,
-		uint64_t tracefile_count)
+		uint64_t tracefile_count,
+		enum lttng_compression compression,
+		unsigned int live_timer_interval)
 {
 	struct lttng_consumer_channel *channel;
 
-	channel = zmalloc(sizeof(*channel));
+	channel = lttng_obj_pool_zalloc(&channel_pool);
 	if (channel == NULL) {
-		PERROR("malloc struct lttng_consumer_channel");
+		goto end;
+	}
+
+	/* Shared by the channels of a session with the same output path. */
+	channel->pathname = lttng_intern_get(pathname);
+	if (!channel->pathname) {
+		consumer_free_channel(channel);
+		channel = NULL;
 		goto end;
 	}
 
@@ -869,16 +1171,21 @@ struct lttng_consumer_channel *consumer_allocate_channel(uint64_t key,
 	channel->output = output;
 	channel->tracefile_size = tracefile_size;
 	channel->tracefile_count = tracefile_count;
-
-	strncpy(channel->pathname, pathname, sizeof(channel->pathname));
-	channel->pathname[sizeof(channel->pathname) - 1] = '\0';
+	channel->compression = compression;
+	channel->live_timer_interval = live_timer_interval;
+	/* Overridden for the channels of snapshot sessions. */
+	channel->monitor = 1;
 
 	strncpy(channel->name, name, sizeof(channel->name));
 	channel->name[sizeof(channel->name) - 1] = '\0';
 
+	channel->sched_weight = lttng_stream_sched_weight(&sched_config,
+			channel->name);
+
 	lttng_ht_node_init_u64(&channel->node, channel->key);
 
 	channel->wait_fd = -1;
+	channel->dirfd = -1;
 
 	CDS_INIT_LIST_HEAD(&channel->streams.head);
 
@@ -925,13 +1232,132 @@ end:
 }
 
 /*
- * Allocate the pollfd structure and the local view of the out fds to avoid
- * doing a lookup in the linked list and concurrency issues when writing is
- * needed. Called with consumer_data.lock held.
+ * Destroy the pipes of the data threads of a consumer and free them.
+ */
+static void fini_data_threads(struct lttng_consumer_local_data *ctx)
+{
+	unsigned int i;
+
+	for (i = 0; i < ctx->nb_data_threads; i++) {
+		lttng_pipe_destroy(ctx->data_threads[i].pipe);
+	}
+	free(ctx->data_threads);
+	ctx->data_threads = NULL;
+	ctx->nb_data_threads = 0;
+}
+
+/*
+ * Set up the data threads of a consumer from the
+ * DEFAULT_CONSUMERD_DATA_THREADS_ENV environment variable: one per NUMA node
+ * or group of CPUs, each pinned to its CPUs, else a single unpinned one. The
+ * pinned threads are experimental and only used when asked for.
+ *
+ * Return 0 on success or a negative value.
+ */
+static int init_data_threads(struct lttng_consumer_local_data *ctx)
+{
+	int ret, nb_sets = 0;
+	unsigned int i;
+	unsigned long nb;
+	char *env, *end;
+	cpu_set_t *sets = NULL;
+
+	env = getenv(DEFAULT_CONSUMERD_DATA_THREADS_ENV);
+	if (env && !strcmp(env, "node")) {
+		nb_sets = lttng_cpu_topology_nodes(&sets);
+	} else if (env) {
+		errno = 0;
+		nb = strtoul(env, &end, 10);
+		if (errno || end == env || *end != '\0' || nb == 0 ||
+				nb > DEFAULT_CONSUMERD_MAX_DATA_THREADS) {
+			WARN("Invalid value %s of %s, using a single data thread", env,
+					DEFAULT_CONSUMERD_DATA_THREADS_ENV);
+		} else if (nb > 1) {
+			nb_sets = lttng_cpu_topology_groups(nb, &sets);
+		}
+	}
+	if (nb_sets > DEFAULT_CONSUMERD_MAX_DATA_THREADS) {
+		nb_sets = DEFAULT_CONSUMERD_MAX_DATA_THREADS;
+	}
+
+	/* A single set spans every CPU, the thread is left unpinned. */
+	ctx->nb_data_threads = nb_sets > 1 ? nb_sets : 1;
+	ctx->data_threads = zmalloc(ctx->nb_data_threads *
+			sizeof(*ctx->data_threads));
+	if (!ctx->data_threads) {
+		PERROR("zmalloc data threads");
+		ctx->nb_data_threads = 0;
+		ret = -ENOMEM;
+		goto end;
+	}
+
+	for (i = 0; i < ctx->nb_data_threads; i++) {
+		struct lttng_consumer_data_thread *thread = &ctx->data_threads[i];
+
+		thread->id = i;
+		thread->ctx = ctx;
+		if (nb_sets > 1) {
+			thread->cpus = sets[i];
+		}
+		thread->pipe = lttng_pipe_open(0);
+		if (!thread->pipe) {
+			ret = -1;
+			goto error;
+		}
+	}
+	ctx->nb_data_threads_running = ctx->nb_data_threads;
+
+	if (nb_sets > 1) {
+		WARN("Consumer uses %u data threads pinned to their CPUs, this mode "
+				"is experimental", ctx->nb_data_threads);
+	} else {
+		DBG("Consumer uses a single data thread");
+	}
+	ret = 0;
+	goto end;
+
+error:
+	fini_data_threads(ctx);
+end:
+	free(sets);
+	return ret;
+}
+
+/*
+ * Return the pipe of the data thread to which a data stream is sent, the
+ * thread of the CPU of the stream if there is one, else the first one.
+ */
+struct lttng_pipe *consumer_data_stream_pipe(
+		struct lttng_consumer_local_data *ctx,
+		struct lttng_consumer_stream *stream)
+{
+	unsigned int i;
+
+	assert(ctx);
+	assert(stream);
+
+	stream->data_thread = 0;
+	if (stream->cpu >= 0 && stream->cpu < CPU_SETSIZE) {
+		for (i = 0; i < ctx->nb_data_threads; i++) {
+			if (CPU_ISSET(stream->cpu, &ctx->data_threads[i].cpus)) {
+				stream->data_thread = i;
+				break;
+			}
+		}
+	}
+
+	return ctx->data_threads[stream->data_thread].pipe;
+}
+
+/*
+ * Allocate the pollfd structure and the local view of the out fds of the
+ * streams of a data thread to avoid doing a lookup in the linked list and
+ * concurrency issues when writing is needed. Called with consumer_data.lock
+ * held.
  *
  * Returns the number of fds in the structures.
  */
-static int update_poll_array(struct lttng_consumer_local_data *ctx,
+static int update_poll_array(struct lttng_consumer_data_thread *thread,
 		struct pollfd **pollfd, struct lttng_consumer_stream **local_stream,
 		struct lttng_ht *ht)
 {
@@ -939,7 +1365,7 @@ static int update_poll_array(struct lttng_consumer_local_data *ctx,
 	struct lttng_ht_iter iter;
 	struct lttng_consumer_stream *stream;
 
-	assert(ctx);
+	assert(thread);
 	assert(ht);
 	assert(pollfd);
 	assert(local_stream);
@@ -956,7 +1382,8 @@ static int update_poll_array(struct lttng_consumer_local_data *ctx,
 		 * be deleted once the thread is notified that the end point state has
 		 * changed where this function will be called back again.
 		 */
-		if (stream->state != LTTNG_CONSUMER_ACTIVE_STREAM ||
+		if (stream->data_thread != thread->id ||
+				stream->state != LTTNG_CONSUMER_ACTIVE_STREAM ||
 				stream->endpoint_status == CONSUMER_ENDPOINT_INACTIVE) {
 			continue;
 		}
@@ -974,10 +1401,10 @@ static int update_poll_array(struct lttng_consumer_local_data *ctx,
 	rcu_read_unlock();
 
 	/*
-	 * Insert the consumer_data_pipe at the end of the array and don't
+	 * Insert the data pipe of the thread at the end of the array and don't
 	 * increment i so nb_fd is the number of real FD.
 	 */
-	(*pollfd)[i].fd = lttng_pipe_get_readfd(ctx->consumer_data_pipe);
+	(*pollfd)[i].fd = lttng_pipe_get_readfd(thread->pipe);
 	(*pollfd)[i].events = POLLIN | POLLPRI;
 	return i;
 }
@@ -1044,6 +1471,20 @@ int lttng_consumer_send_error(struct lttng_consumer_local_data *ctx, int cmd)
 	return 0;
 }
 
+/*
+ * Log the memory footprint of an object pool.
+ */
+static void log_obj_pool(struct lttng_obj_pool *pool)
+{
+	struct lttng_obj_pool_stats stats;
+
+	lttng_obj_pool_get_stats(pool, &stats);
+	DBG("Consumer %s pool: %zu bytes per object, %" PRIu64 " allocated "
+			"(%" PRIu64 " recycled), %lu in use at most (%zu bytes), %lu free",
+			pool->name, stats.obj_size, stats.allocs, stats.reuses,
+			stats.max_used, stats.max_used * stats.obj_size, stats.nr_free);
+}
+
 /*
  * Close all the tracefiles and stream fds and MUST be called when all
  * instances are destroyed i.e. when all threads were joined and are ended.
@@ -1052,6 +1493,8 @@ void lttng_consumer_cleanup(void)
 {
 	struct lttng_ht_iter iter;
 	struct lttng_consumer_channel *channel;
+	struct lttng_fd_cache_stats stats;
+	struct lttng_intern_stats intern_stats;
 
 	rcu_read_lock();
 
@@ -1074,6 +1517,25 @@ void lttng_consumer_cleanup(void)
 	 * it.
 	 */
 	lttng_ht_destroy(consumer_data.stream_list_ht);
+
+	lttng_compress_pool_destroy(compress_pool);
+	compress_pool = NULL;
+
+	lttng_fd_cache_get_stats(&out_fd_cache, &stats);
+	DBG("Consumer tracefile cache: %" PRIu64 " hits, %" PRIu64 " reopens "
+			"(%" PRIu64 " ns average), %" PRIu64 " closed while idle",
+			stats.hits, stats.reopens,
+			stats.reopens ? stats.reopen_ns / stats.reopens : 0,
+			stats.evictions);
+
+	log_obj_pool(&stream_pool);
+	log_obj_pool(&channel_pool);
+	lttng_intern_get_stats(&intern_stats);
+	DBG("Consumer interned paths: %lu strings, %lu references, %zu bytes",
+			intern_stats.nr_strings, intern_stats.nr_refs,
+			intern_stats.bytes);
+	lttng_obj_pool_destroy(&stream_pool);
+	lttng_obj_pool_destroy(&channel_pool);
 }
 
 /*
@@ -1173,8 +1635,8 @@ struct lttng_consumer_local_data *lttng_consumer_create(
 	ctx->on_recv_stream = recv_stream;
 	ctx->on_update_stream = update_stream;
 
-	ctx->consumer_data_pipe = lttng_pipe_open(0);
-	if (!ctx->consumer_data_pipe) {
+	ret = init_data_threads(ctx);
+	if (ret < 0) {
 		goto error_poll_pipe;
 	}
 
@@ -1217,7 +1679,7 @@ error_channel_pipe:
 error_thread_pipe:
 	utils_close_pipe(ctx->consumer_should_quit);
 error_quit_pipe:
-	lttng_pipe_destroy(ctx->consumer_data_pipe);
+	fini_data_threads(ctx);
 error_poll_pipe:
 	free(ctx);
 error:
@@ -1243,7 +1705,7 @@ void lttng_consumer_destroy(struct lttng_consumer_local_data *ctx)
 	}
 	utils_close_pipe(ctx->consumer_thread_pipe);
 	utils_close_pipe(ctx->consumer_channel_pipe);
-	lttng_pipe_destroy(ctx->consumer_data_pipe);
+	fini_data_threads(ctx);
 	lttng_pipe_destroy(ctx->consumer_metadata_pipe);
 	utils_close_pipe(ctx->consumer_should_quit);
 	utils_close_pipe(ctx->consumer_splice_metadata_pipe);
@@ -1293,49 +1755,393 @@ end:
 }
 
 /*
- * Mmap the ring buffer, read it and write the data to the tracefile. This is a
- * core function for writing trace buffers to either the local filesystem or
- * the network.
- *
- * It must be called with the stream lock held.
- *
- * Careful review MUST be put if any changes occur!
+ * Return the size of a long for the tracer of this consumer.
+ */
+static unsigned int consumer_long_size(void)
+{
+	switch (consumer_data.type) {
+	case LTTNG_CONSUMER32_UST:
+		return 4;
+	case LTTNG_CONSUMER64_UST:
+		return 8;
+	case LTTNG_CONSUMER_KERNEL:
+	default:
+		return sizeof(long);
+	}
+}
+
+/*
+ * Create the packet index file of the current tracefile of a local data
+ * stream. A failure only disables the index of the stream, the trace data is
+ * still written.
  *
- * Returns the number of bytes written
+ * Return 0 on success or else a negative value.
  */
-ssize_t lttng_consumer_on_read_subbuffer_mmap(
-		struct lttng_consumer_local_data *ctx,
-		struct lttng_consumer_stream *stream, unsigned long len,
-		unsigned long padding)
+int consumer_stream_create_index(struct lttng_consumer_stream *stream)
 {
-	unsigned long mmap_offset;
-	void *mmap_base;
-	ssize_t ret = 0, written = 0;
-	off_t orig_offset = stream->out_fd_offset;
-	/* Default is on the disk */
-	int outfd = stream->out_fd;
-	struct consumer_relayd_sock_pair *relayd = NULL;
-	unsigned int relayd_hang_up = 0;
+	int ret;
 
-	/* RCU lock for the relayd pointer */
-	rcu_read_lock();
+	assert(stream);
 
-	/* Flag that the current stream if set for network streaming. */
-	if (stream->net_seq_idx != -1) {
-		relayd = consumer_find_relayd(stream->net_seq_idx);
-		if (relayd == NULL) {
-			goto end;
-		}
+	if (stream->metadata_flag || stream->net_seq_idx != (uint64_t) -1ULL) {
+		return 0;
 	}
 
-	/* get the offset inside the fd to mmap */
-	switch (consumer_data.type) {
-	case LTTNG_CONSUMER_KERNEL:
-		mmap_base = stream->mmap_base;
-		ret = kernctl_get_mmap_read_offset(stream->wait_fd, &mmap_offset);
-		break;
-	case LTTNG_CONSUMER32_UST:
-	case LTTNG_CONSUMER64_UST:
+	ret = index_create_file(consumer_channel_get_dirfd(stream->chan),
+			stream->chan->pathname, stream->name,
+			stream->chan->tracefile_size, stream->tracefile_count_current,
+			stream->uid, stream->gid);
+	if (ret < 0) {
+		ERR("Unable to create index of stream %s, packets won't be indexed",
+				stream->name);
+		stream->index_fd = -1;
+		return ret;
+	}
+	stream->index_fd = ret;
+
+	return 0;
+}
+
+/*
+ * Return the compression the relayd must apply to a stream. The metadata is
+ * never compressed.
+ */
+enum lttng_compression consumer_stream_relayd_compression(
+		struct lttng_consumer_stream *stream)
+{
+	assert(stream);
+
+	if (stream->metadata_flag) {
+		return LTTNG_COMPRESSION_NONE;
+	}
+	return stream->chan->compression;
+}
+
+/*
+ * Switch the index file of a stream after a tracefile rotation.
+ */
+static void rotate_stream_index(struct lttng_consumer_stream *stream)
+{
+	int ret;
+
+	if (stream->index_fd < 0) {
+		return;
+	}
+
+	ret = close(stream->index_fd);
+	if (ret < 0) {
+		PERROR("close index");
+	}
+	stream->index_fd = -1;
+	(void) consumer_stream_create_index(stream);
+}
+
+/*
+ * Append the index entry of a packet written at the given offset of the
+ * current tracefile, buf pointing to the beginning of the packet.
+ */
+static void write_stream_index(struct lttng_consumer_stream *stream,
+		const char *buf, size_t len, uint64_t offset)
+{
+	int ret;
+	struct ctf_packet_index index;
+
+	ret = index_packet_parse(buf, len, consumer_long_size(), offset, &index);
+	if (ret < 0) {
+		DBG("Invalid packet header in stream %s, not indexed", stream->name);
+		return;
+	}
+
+	ret = index_write(stream->index_fd, &index);
+	if (ret < 0) {
+		errno = -ret;
+		PERROR("write index of stream %s", stream->name);
+		ret = close(stream->index_fd);
+		if (ret < 0) {
+			PERROR("close index");
+		}
+		stream->index_fd = -1;
+	}
+}
+
+/*
+ * Return the compression pool, creating it with one worker per online CPU on
+ * first use. Return NULL on error.
+ */
+static struct lttng_compress_pool *get_compress_pool(void)
+{
+	long nr_cpus;
+
+	pthread_mutex_lock(&compress_pool_lock);
+	if (!compress_pool) {
+		nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		if (nr_cpus < 1) {
+			nr_cpus = 1;
+		}
+		compress_pool = lttng_compress_pool_create(nr_cpus,
+				DEFAULT_COMPRESSION_MAX_JOBS);
+	}
+	pthread_mutex_unlock(&compress_pool_lock);
+
+	return compress_pool;
+}
+
+/*
+ * Write the frame of a job, or its raw packet, of len bytes to the tracefile
+ * of a local stream, rotating it and indexing the packet like the mmap and
+ * splice paths.
+ */
+static void write_frame_local(struct lttng_consumer_stream *stream,
+		struct lttng_compress_job *job, char *buf, size_t len)
+{
+	ssize_t ret;
+	uint64_t packet_offset;
+	off_t orig_offset = stream->out_fd_offset;
+
+	/* The tracefile is reopened if it was closed while idle. */
+	if (consumer_stream_get_out_fd(stream) < 0) {
+		ERR("Reopening output file of stream %s", stream->name);
+		goto end;
+	}
+
+	if (stream->chan->tracefile_size > 0 &&
+			(stream->tracefile_size_current + len) >
+			stream->chan->tracefile_size) {
+		ret = utils_rotate_stream_file(
+				consumer_channel_get_dirfd(stream->chan),
+				stream->chan->pathname,
+				stream->name, stream->chan->tracefile_size,
+				stream->chan->tracefile_count, stream->uid, stream->gid,
+				stream->out_fd, &(stream->tracefile_count_current));
+		if (ret < 0) {
+			ERR("Rotating output file");
+			/* The previous tracefile is closed. */
+			stream->out_fd = -1;
+			goto end;
+		}
+		stream->out_fd = ret;
+		/* Reset current size because we just perform a rotation. */
+		stream->tracefile_size_current = 0;
+		rotate_stream_index(stream);
+	}
+	packet_offset = stream->tracefile_size_current;
+	stream->tracefile_size_current += len;
+
+	while (len > 0) {
+		do {
+			ret = write(stream->out_fd, buf, len);
+		} while (ret < 0 && errno == EINTR);
+		if (ret < 0) {
+			PERROR("write compressed packet of stream %s", stream->name);
+			goto end;
+		}
+		/* This won't block, but will start writeout asynchronously */
+		lttng_sync_file_range(stream->out_fd, stream->out_fd_offset, ret,
+				SYNC_FILE_RANGE_WRITE);
+		stream->out_fd_offset += ret;
+		buf += ret;
+		len -= ret;
+	}
+
+	/* The entry describes the uncompressed packet found at the frame. */
+	if (stream->index_fd >= 0) {
+		write_stream_index(stream, job->src, job->src_len, packet_offset);
+	}
+	lttng_consumer_sync_trace_file(stream, orig_offset);
+
+end:
+	consumer_stream_put_out_fd(stream);
+}
+
+/*
+ * Send the frame of a job, or its raw packet, of len bytes to the relayd of a
+ * stream as a regular data packet without padding.
+ */
+static void write_frame_relayd(struct lttng_consumer_stream *stream,
+		char *buf, size_t len)
+{
+	int outfd;
+	ssize_t ret;
+	unsigned int relayd_hang_up = 0;
+	struct consumer_relayd_sock_pair *relayd;
+	struct consumer_relayd_data_sock *data_sock;
+
+	rcu_read_lock();
+	relayd = consumer_find_relayd(stream->net_seq_idx);
+	if (relayd == NULL) {
+		goto end;
+	}
+
+	data_sock = get_relayd_data_sock(stream, relayd);
+	pthread_mutex_lock(&data_sock->mutex);
+	outfd = write_relayd_stream_header(stream, len, 0, relayd);
+	if (outfd < 0) {
+		if (outfd == -EPIPE || outfd == -EINVAL) {
+			relayd_hang_up = 1;
+		}
+		goto end_unlock;
+	}
+
+	while (len > 0) {
+		do {
+			ret = write(outfd, buf, len);
+		} while (ret < 0 && errno == EINTR);
+		if (ret < 0) {
+			DBG("Error sending compressed packet of stream %s", stream->name);
+			if (errno == EPIPE || errno == EINVAL) {
+				relayd_hang_up = 1;
+			}
+			goto end_unlock;
+		}
+		buf += ret;
+		len -= ret;
+	}
+
+end_unlock:
+	pthread_mutex_unlock(&data_sock->mutex);
+	if (relayd_hang_up) {
+		/* Cleaned up by the data thread, see compress_relayd_hang_up. */
+		uatomic_set(&stream->compress_relayd_hang_up, 1);
+	}
+end:
+	rcu_read_unlock();
+}
+
+/*
+ * Completion of a compression job, called by the worker of the stream lane
+ * in the order the packets were read.
+ *
+ * The stream lock is not taken: the data thread holds it while it waits for
+ * room in the pool in lttng_compress_pool_submit(). The output of the stream
+ * is owned by the lane instead, see compress_lane.
+ */
+static void compress_job_done(struct lttng_compress_job *job)
+{
+	struct consumer_compress_job *cjob =
+		caa_container_of(job, struct consumer_compress_job, job);
+	struct lttng_consumer_stream *stream = cjob->stream;
+	char *buf;
+	size_t len;
+
+	if (job->frame_len < 0) {
+		/* Readers tell raw packets from frames by their magic number. */
+		errno = -job->frame_len;
+		PERROR("Compressing packet of stream %s, writing it uncompressed",
+				stream->name);
+		buf = job->src;
+		len = job->src_len;
+	} else {
+		DBG3("Stream %s packet compressed from %zu to %zd bytes",
+				stream->name, job->src_len, job->frame_len);
+		buf = job->frame;
+		len = job->frame_len;
+	}
+
+	if (stream->net_seq_idx != (uint64_t) -1ULL) {
+		write_frame_relayd(stream, buf, len);
+	} else {
+		write_frame_local(stream, job, buf, len);
+	}
+
+	free(job->frame);
+	free(job->src);
+	free(cjob);
+}
+
+/*
+ * Copy a sub-buffer of a compressed stream and queue it for compression. The
+ * sub-buffer can be released by the caller on return.
+ *
+ * Returns the number of bytes consumed, matching the value the mmap path
+ * returns for the stream output, or a negative value on error.
+ */
+static ssize_t compress_subbuffer(struct lttng_consumer_stream *stream,
+		const char *buf, unsigned long len, unsigned long padding)
+{
+	struct lttng_compress_pool *pool;
+	struct consumer_compress_job *cjob;
+
+	pool = get_compress_pool();
+	if (!pool) {
+		return -ENOMEM;
+	}
+
+	cjob = zmalloc(sizeof(*cjob));
+	if (!cjob) {
+		PERROR("zmalloc compress job");
+		return -ENOMEM;
+	}
+
+	/* The padding is compressed too so the frame decodes to the packet. */
+	cjob->job.src_len = len + padding;
+	cjob->job.src = malloc(cjob->job.src_len);
+	if (!cjob->job.src) {
+		PERROR("malloc compress job packet");
+		free(cjob);
+		return -ENOMEM;
+	}
+	memcpy(cjob->job.src, buf, cjob->job.src_len);
+
+	if (!stream->compress_lane.worker) {
+		lttng_compress_lane_init(pool, &stream->compress_lane, stream->key);
+	}
+	cjob->job.lane = &stream->compress_lane;
+	cjob->job.algo = stream->chan->compression;
+	cjob->job.done = compress_job_done;
+	cjob->stream = stream;
+
+	lttng_compress_pool_submit(pool, &cjob->job);
+
+	return stream->net_seq_idx != (uint64_t) -1ULL ? len : len + padding;
+}
+
+/*
+ * Mmap the ring buffer, read it and write the data to the tracefile. This is a
+ * core function for writing trace buffers to either the local filesystem or
+ * the network.
+ *
+ * It must be called with the stream lock held.
+ *
+ * Careful review MUST be put if any changes occur!
+ *
+ * Returns the number of bytes written
+ */
+ssize_t lttng_consumer_on_read_subbuffer_mmap(
+		struct lttng_consumer_local_data *ctx,
+		struct lttng_consumer_stream *stream, unsigned long len,
+		unsigned long padding)
+{
+	unsigned long mmap_offset, packet_mmap_offset, packet_len = 0;
+	uint64_t packet_offset = 0;
+	void *mmap_base;
+	ssize_t ret = 0, written = 0;
+	off_t orig_offset = stream->out_fd_offset;
+	/* Default is on the disk */
+	int outfd = stream->out_fd;
+	struct consumer_relayd_sock_pair *relayd = NULL;
+	struct consumer_relayd_data_sock *data_sock = NULL;
+	unsigned int relayd_hang_up = 0;
+	unsigned int out_fd_held = 0;
+
+	/* RCU lock for the relayd pointer */
+	rcu_read_lock();
+
+	/* Flag that the current stream if set for network streaming. */
+	if (stream->net_seq_idx != -1) {
+		relayd = consumer_find_relayd(stream->net_seq_idx);
+		if (relayd == NULL) {
+			goto end;
+		}
+	}
+
+	/* get the offset inside the fd to mmap */
+	switch (consumer_data.type) {
+	case LTTNG_CONSUMER_KERNEL:
+		mmap_base = stream->mmap_base;
+		ret = kernctl_get_mmap_read_offset(stream->wait_fd, &mmap_offset);
+		break;
+	case LTTNG_CONSUMER32_UST:
+	case LTTNG_CONSUMER64_UST:
 		mmap_base = lttng_ustctl_get_mmap_base(stream);
 		if (!mmap_base) {
 			ERR("read mmap get mmap base for stream %s", stream->name);
@@ -1356,6 +2162,24 @@ ssize_t lttng_consumer_on_read_subbuffer_mmap(
 		goto end;
 	}
 
+	/*
+	 * The compression workers write the packet, unless the relayd compresses
+	 * it, which the protocols before 2.3 can't ask for.
+	 */
+	if (stream->chan->compression != LTTNG_COMPRESSION_NONE &&
+			!stream->metadata_flag &&
+			(!relayd || relayd->control_sock.minor < 3)) {
+		/* A relayd hang up seen by the lane worker is handled here. */
+		if (relayd && uatomic_read(&stream->compress_relayd_hang_up)) {
+			relayd_hang_up = 1;
+			written = -EPIPE;
+			goto write_error;
+		}
+		written = compress_subbuffer(stream, mmap_base + mmap_offset, len,
+				padding);
+		goto end;
+	}
+
 	/* Handle stream on the relayd if the output is on the network */
 	if (relayd) {
 		unsigned long netlen = len;
@@ -1368,6 +2192,9 @@ ssize_t lttng_consumer_on_read_subbuffer_mmap(
 			/* Metadata requires the control socket. */
 			pthread_mutex_lock(&relayd->ctrl_sock_mutex);
 			netlen += sizeof(struct lttcomm_relayd_metadata_payload);
+		} else {
+			data_sock = get_relayd_data_sock(stream, relayd);
+			pthread_mutex_lock(&data_sock->mutex);
 		}
 
 		ret = write_relayd_stream_header(stream, netlen, padding, relayd);
@@ -1400,27 +2227,43 @@ ssize_t lttng_consumer_on_read_subbuffer_mmap(
 		/* No streaming, we have to set the len with the full padding */
 		len += padding;
 
+		/* The tracefile is reopened if it was closed while idle. */
+		outfd = consumer_stream_get_out_fd(stream);
+		out_fd_held = 1;
+		if (outfd < 0) {
+			ERR("Reopening output file of stream %s", stream->name);
+			goto end;
+		}
+
 		/*
 		 * Check if we need to change the tracefile before writing the packet.
 		 */
 		if (stream->chan->tracefile_size > 0 &&
 				(stream->tracefile_size_current + len) >
 				stream->chan->tracefile_size) {
-			ret = utils_rotate_stream_file(stream->chan->pathname,
+			ret = utils_rotate_stream_file(
+					consumer_channel_get_dirfd(stream->chan),
+					stream->chan->pathname,
 					stream->name, stream->chan->tracefile_size,
 					stream->chan->tracefile_count, stream->uid, stream->gid,
 					stream->out_fd, &(stream->tracefile_count_current));
 			if (ret < 0) {
 				ERR("Rotating output file");
+				/* The previous tracefile is closed. */
+				stream->out_fd = -1;
 				goto end;
 			}
 			outfd = stream->out_fd = ret;
 			/* Reset current size because we just perform a rotation. */
 			stream->tracefile_size_current = 0;
+			rotate_stream_index(stream);
 		}
+		packet_offset = stream->tracefile_size_current;
+		packet_len = len;
 		stream->tracefile_size_current += len;
 	}
 
+	packet_mmap_offset = mmap_offset;
 	while (len > 0) {
 		do {
 			ret = write(outfd, mmap_base + mmap_offset, len);
@@ -1461,6 +2304,10 @@ ssize_t lttng_consumer_on_read_subbuffer_mmap(
 		}
 		written += ret;
 	}
+	if (!relayd && stream->index_fd >= 0) {
+		write_stream_index(stream, mmap_base + packet_mmap_offset, packet_len,
+				packet_offset);
+	}
 	lttng_consumer_sync_trace_file(stream, orig_offset);
 
 write_error:
@@ -1477,6 +2324,12 @@ end:
 	if (relayd && stream->metadata_flag) {
 		pthread_mutex_unlock(&relayd->ctrl_sock_mutex);
 	}
+	if (data_sock) {
+		pthread_mutex_unlock(&data_sock->mutex);
+	}
+	if (out_fd_held) {
+		consumer_stream_put_out_fd(stream);
+	}
 
 	rcu_read_unlock();
 	return written;
@@ -1496,13 +2349,17 @@ ssize_t lttng_consumer_on_read_subbuffer_splice(
 {
 	ssize_t ret = 0, written = 0, ret_splice = 0;
 	loff_t offset = 0;
+	uint64_t packet_offset = 0;
+	unsigned long packet_len = 0;
 	off_t orig_offset = stream->out_fd_offset;
 	int fd = stream->wait_fd;
 	/* Default is on the disk */
 	int outfd = stream->out_fd;
 	struct consumer_relayd_sock_pair *relayd = NULL;
+	struct consumer_relayd_data_sock *data_sock = NULL;
 	int *splice_pipe;
 	unsigned int relayd_hang_up = 0;
+	unsigned int out_fd_held = 0;
 
 	switch (consumer_data.type) {
 	case LTTNG_CONSUMER_KERNEL:
@@ -1563,6 +2420,9 @@ ssize_t lttng_consumer_on_read_subbuffer_splice(
 			}
 
 			total_len += sizeof(struct lttcomm_relayd_metadata_payload);
+		} else {
+			data_sock = get_relayd_data_sock(stream, relayd);
+			pthread_mutex_lock(&data_sock->mutex);
 		}
 
 		ret = write_relayd_stream_header(stream, total_len, padding, relayd);
@@ -1582,24 +2442,39 @@ ssize_t lttng_consumer_on_read_subbuffer_splice(
 		/* No streaming, we have to set the len with the full padding */
 		len += padding;
 
+		/* The tracefile is reopened if it was closed while idle. */
+		outfd = consumer_stream_get_out_fd(stream);
+		out_fd_held = 1;
+		if (outfd < 0) {
+			ERR("Reopening output file of stream %s", stream->name);
+			goto end;
+		}
+
 		/*
 		 * Check if we need to change the tracefile before writing the packet.
 		 */
 		if (stream->chan->tracefile_size > 0 &&
 				(stream->tracefile_size_current + len) >
 				stream->chan->tracefile_size) {
-			ret = utils_rotate_stream_file(stream->chan->pathname,
+			ret = utils_rotate_stream_file(
+					consumer_channel_get_dirfd(stream->chan),
+					stream->chan->pathname,
 					stream->name, stream->chan->tracefile_size,
 					stream->chan->tracefile_count, stream->uid, stream->gid,
 					stream->out_fd, &(stream->tracefile_count_current));
 			if (ret < 0) {
 				ERR("Rotating output file");
+				/* The previous tracefile is closed. */
+				stream->out_fd = -1;
 				goto end;
 			}
 			outfd = stream->out_fd = ret;
 			/* Reset current size because we just perform a rotation. */
 			stream->tracefile_size_current = 0;
+			rotate_stream_index(stream);
 		}
+		packet_offset = stream->tracefile_size_current;
+		packet_len = len;
 		stream->tracefile_size_current += len;
 	}
 
@@ -1669,87 +2544,607 @@ ssize_t lttng_consumer_on_read_subbuffer_splice(
 					SYNC_FILE_RANGE_WRITE);
 			stream->out_fd_offset += ret_splice;
 		}
-		written += ret_splice;
+		written += ret_splice;
+	}
+	if (!relayd && stream->index_fd >= 0) {
+		char header[CTF_PACKET_HEADER_MAX_LEN];
+
+		/* The packet never went through user space, read its header back. */
+		ret = pread(outfd, header, min(sizeof(header), packet_len),
+				packet_offset);
+		if (ret < 0) {
+			PERROR("pread packet header of stream %s", stream->name);
+		} else {
+			write_stream_index(stream, header, ret, packet_offset);
+		}
+	}
+	lttng_consumer_sync_trace_file(stream, orig_offset);
+
+	ret = ret_splice;
+
+	goto end;
+
+write_error:
+	/*
+	 * This is a special case that the relayd has closed its socket. Let's
+	 * cleanup the relayd object and all associated streams.
+	 */
+	if (relayd && relayd_hang_up) {
+		cleanup_relayd(relayd, ctx);
+		/* Skip splice error so the consumer does not fail */
+		goto end;
+	}
+
+splice_error:
+	/* send the appropriate error description to sessiond */
+	switch (ret) {
+	case EINVAL:
+		lttng_consumer_send_error(ctx, LTTCOMM_CONSUMERD_SPLICE_EINVAL);
+		break;
+	case ENOMEM:
+		lttng_consumer_send_error(ctx, LTTCOMM_CONSUMERD_SPLICE_ENOMEM);
+		break;
+	case ESPIPE:
+		lttng_consumer_send_error(ctx, LTTCOMM_CONSUMERD_SPLICE_ESPIPE);
+		break;
+	}
+
+end:
+	if (relayd && stream->metadata_flag) {
+		pthread_mutex_unlock(&relayd->ctrl_sock_mutex);
+	}
+	if (data_sock) {
+		pthread_mutex_unlock(&data_sock->mutex);
+	}
+	if (out_fd_held) {
+		consumer_stream_put_out_fd(stream);
+	}
+
+	rcu_read_unlock();
+	return written;
+}
+
+/*
+ * Take a snapshot for a specific fd
+ *
+ * Returns 0 on success, < 0 on error
+ */
+int lttng_consumer_take_snapshot(struct lttng_consumer_stream *stream)
+{
+	switch (consumer_data.type) {
+	case LTTNG_CONSUMER_KERNEL:
+		return lttng_kconsumer_take_snapshot(stream);
+	case LTTNG_CONSUMER32_UST:
+	case LTTNG_CONSUMER64_UST:
+		return lttng_ustconsumer_take_snapshot(stream);
+	default:
+		ERR("Unknown consumer_data type");
+		assert(0);
+		return -ENOSYS;
+	}
+}
+
+/*
+ * Get the produced position
+ *
+ * Returns 0 on success, < 0 on error
+ */
+int lttng_consumer_get_produced_snapshot(struct lttng_consumer_stream *stream,
+		unsigned long *pos)
+{
+	switch (consumer_data.type) {
+	case LTTNG_CONSUMER_KERNEL:
+		return lttng_kconsumer_get_produced_snapshot(stream, pos);
+	case LTTNG_CONSUMER32_UST:
+	case LTTNG_CONSUMER64_UST:
+		return lttng_ustconsumer_get_produced_snapshot(stream, pos);
+	default:
+		ERR("Unknown consumer_data type");
+		assert(0);
+		return -ENOSYS;
+	}
+}
+
+/*
+ * Get the consumed position
+ *
+ * Returns 0 on success, < 0 on error
+ */
+int lttng_consumer_get_consumed_snapshot(struct lttng_consumer_stream *stream,
+		unsigned long *pos)
+{
+	switch (consumer_data.type) {
+	case LTTNG_CONSUMER_KERNEL:
+		return lttng_kconsumer_get_consumed_snapshot(stream, pos);
+	case LTTNG_CONSUMER32_UST:
+	case LTTNG_CONSUMER64_UST:
+		return lttng_ustconsumer_get_consumed_snapshot(stream, pos);
+	default:
+		ERR("Unknown consumer_data type");
+		assert(0);
+		return -ENOSYS;
+	}
+}
+
+/*
+ * Open the snapshot output of a stream, a new tracefile in the path directory
+ * or a new stream on the relayd if relayd_id is not -1. The stream lock MUST
+ * be held.
+ *
+ * Return 0 on success or else a negative value.
+ */
+int consumer_snapshot_open_output(struct lttng_consumer_stream *stream,
+		const char *path, uint64_t relayd_id)
+{
+	int ret;
+	struct consumer_relayd_sock_pair *relayd;
+
+	assert(stream);
+	assert(path);
+
+	/* The snapshot output is not cached, it is closed right after. */
+	consumer_stream_uncache_out_fd(stream);
+	stream->out_fd = -1;
+	stream->out_fd_offset = 0;
+	stream->index_fd = -1;
+	stream->tracefile_size_current = 0;
+	stream->tracefile_count_current = 0;
+	stream->next_net_seq_num = 0;
+	stream->compress_relayd_hang_up = 0;
+	stream->net_seq_idx = (uint64_t) -1ULL;
+
+	if (relayd_id != (uint64_t) -1ULL) {
+		rcu_read_lock();
+		relayd = consumer_find_relayd(relayd_id);
+		if (relayd == NULL) {
+			ERR("Snapshot relayd %" PRIu64 " not found", relayd_id);
+			rcu_read_unlock();
+			ret = -1;
+			goto error;
+		}
+		pthread_mutex_lock(&relayd->ctrl_sock_mutex);
+		ret = relayd_add_stream(&relayd->control_sock, stream->name, path,
+				&stream->relayd_stream_id, 0, 0, LTTNG_COMPRESSION_NONE);
+		pthread_mutex_unlock(&relayd->ctrl_sock_mutex);
+		if (ret < 0) {
+			rcu_read_unlock();
+			goto error;
+		}
+		uatomic_inc(&relayd->refcount);
+		rcu_read_unlock();
+		stream->net_seq_idx = relayd_id;
+	} else {
+		ret = utils_create_stream_file(-1, (char *) path, stream->name, 0, 0,
+				stream->uid, stream->gid);
+		if (ret < 0) {
+			goto error;
+		}
+		stream->out_fd = ret;
+	}
+
+	DBG("Snapshot output of stream %s opened in %s", stream->name, path);
+	return 0;
+
+error:
+	return ret;
+}
+
+/*
+ * Close the snapshot output of a stream opened by
+ * consumer_snapshot_open_output(). The stream lock MUST be held.
+ */
+void consumer_snapshot_close_output(struct lttng_consumer_stream *stream)
+{
+	int ret;
+	struct consumer_relayd_sock_pair *relayd;
+
+	assert(stream);
+
+	/* The output is used by the compression workers until then. */
+	if (stream->compress_lane.worker) {
+		lttng_compress_lane_wait(compress_pool, &stream->compress_lane);
+	}
+
+	if (stream->net_seq_idx != (uint64_t) -1ULL) {
+		rcu_read_lock();
+		relayd = consumer_find_relayd(stream->net_seq_idx);
+		if (relayd != NULL) {
+			pthread_mutex_lock(&relayd->ctrl_sock_mutex);
+			ret = relayd_send_close_stream(&relayd->control_sock,
+					stream->relayd_stream_id,
+					stream->next_net_seq_num - 1);
+			pthread_mutex_unlock(&relayd->ctrl_sock_mutex);
+			if (ret < 0) {
+				DBG("Unable to close snapshot stream on the relayd");
+			}
+			uatomic_dec(&relayd->refcount);
+			assert(uatomic_read(&relayd->refcount) >= 0);
+			if (uatomic_read(&relayd->refcount) == 0 &&
+					uatomic_read(&relayd->destroy_flag)) {
+				pthread_mutex_lock(&consumer_data.lock);
+				destroy_relayd(relayd);
+				pthread_mutex_unlock(&consumer_data.lock);
+			}
+		}
+		rcu_read_unlock();
+	}
+
+	if (stream->out_fd >= 0) {
+		ret = close(stream->out_fd);
+		if (ret) {
+			PERROR("close snapshot output");
+		}
+	}
+
+	stream->out_fd = -1;
+	stream->net_seq_idx = (uint64_t) -1ULL;
+}
+
+/*
+ * Return the position of the first sub-buffer to record in a snapshot of a
+ * stream holding the [consumed, produced) range: all of it if max_size is 0,
+ * else the last sub-buffers fitting in max_size, keeping at least one.
+ */
+unsigned long consumer_snapshot_first_pos(unsigned long consumed,
+		unsigned long produced, unsigned long max_sb_size, uint64_t max_size)
+{
+	uint64_t nb_subbuf;
+
+	if (max_size == 0 || max_sb_size == 0) {
+		return consumed;
+	}
+
+	nb_subbuf = max_size / max_sb_size;
+	if (nb_subbuf == 0) {
+		nb_subbuf = 1;
+	}
+	if ((uint64_t) (produced - consumed) / max_sb_size <= nb_subbuf) {
+		return consumed;
+	}
+
+	return produced - (unsigned long) (nb_subbuf * max_sb_size);
+}
+
+/*
+ * Record the snapshot of one stream of an unmonitored channel.
+ */
+static int snapshot_stream(struct lttng_consumer_stream *stream,
+		const char *path, uint64_t relayd_id, uint64_t max_stream_size,
+		struct lttng_consumer_local_data *ctx)
+{
+	int ret;
+
+	pthread_mutex_lock(&stream->lock);
+
+	ret = consumer_snapshot_open_output(stream, path, relayd_id);
+	if (ret < 0) {
+		goto end;
+	}
+
+	switch (consumer_data.type) {
+	case LTTNG_CONSUMER_KERNEL:
+		ret = lttng_kconsumer_snapshot_stream(stream, max_stream_size, ctx);
+		break;
+	case LTTNG_CONSUMER32_UST:
+	case LTTNG_CONSUMER64_UST:
+		ret = lttng_ustconsumer_snapshot_stream(stream, max_stream_size, ctx);
+		break;
+	default:
+		ERR("Unknown consumer_data type");
+		assert(0);
+		ret = -ENOSYS;
+	}
+
+	consumer_snapshot_close_output(stream);
+
+end:
+	pthread_mutex_unlock(&stream->lock);
+	return ret;
+}
+
+/*
+ * State shared by the threads recording the streams of a channel snapshot.
+ */
+struct snapshot_work {
+	struct lttng_consumer_stream **streams;
+	unsigned int nb_streams;
+	/* Index of the next stream to record. */
+	unsigned int next;
+	const char *path;
+	uint64_t relayd_id;
+	uint64_t max_stream_size;
+	struct lttng_consumer_local_data *ctx;
+	/* Set by any thread failing to record a stream. */
+	int error;
+};
+
+/*
+ * Record the streams of the work until none is left.
+ */
+static void record_snapshot_work(struct snapshot_work *work)
+{
+	int ret;
+	unsigned int idx;
+
+	while ((idx = uatomic_add_return(&work->next, 1) - 1) <
+			work->nb_streams) {
+		ret = snapshot_stream(work->streams[idx], work->path,
+				work->relayd_id, work->max_stream_size, work->ctx);
+		if (ret < 0) {
+			ERR("Snapshot of stream %s failed",
+					work->streams[idx]->name);
+			uatomic_set(&work->error, 1);
+		}
+	}
+}
+
+/*
+ * Snapshot thread helping the command thread to record the streams.
+ */
+static void *snapshot_thread(void *data)
+{
+	rcu_register_thread();
+	record_snapshot_work(data);
+	rcu_unregister_thread();
+	return NULL;
+}
+
+/*
+ * Take a reference on a channel found by key unless it is being deleted.
+ */
+static struct lttng_consumer_channel *get_channel(uint64_t key)
+{
+	long refcount;
+	struct lttng_consumer_channel *channel;
+
+	rcu_read_lock();
+	channel = consumer_find_channel(key);
+	if (!channel) {
+		goto end;
+	}
+	do {
+		refcount = uatomic_read(&channel->refcount);
+		if (refcount == 0) {
+			channel = NULL;
+			goto end;
+		}
+	} while (uatomic_cmpxchg(&channel->refcount, refcount, refcount + 1) !=
+			refcount);
+
+end:
+	rcu_read_unlock();
+	return channel;
+}
+
+/*
+ * Release a reference taken by get_channel().
+ */
+static void put_channel(struct lttng_consumer_channel *channel)
+{
+	if (!uatomic_sub_return(&channel->refcount, 1)) {
+		consumer_del_channel(channel);
 	}
-	lttng_consumer_sync_trace_file(stream, orig_offset);
+}
 
-	ret = ret_splice;
+/*
+ * Record a snapshot of the streams of an unmonitored channel in the path
+ * directory, or on the relayd if relayd_id is not -1. The streams are
+ * recorded in parallel by up to one thread per online CPU and tracing goes on
+ * meanwhile. At most max_stream_size bytes of each stream are recorded, the
+ * most recent ones, 0 meaning the whole buffers.
+ *
+ * Return 0 on success, -ENOENT if the channel is unknown or else a negative
+ * value.
+ */
+int lttng_consumer_snapshot_channel(uint64_t key, const char *path,
+		uint64_t relayd_id, uint64_t max_stream_size,
+		struct lttng_consumer_local_data *ctx)
+{
+	int ret;
+	long nr_cpus;
+	unsigned int i = 0, nb_threads;
+	pthread_t *threads = NULL;
+	struct snapshot_work work;
+	struct lttng_consumer_stream *stream;
+	struct lttng_consumer_channel *channel;
 
-	goto end;
+	assert(path);
 
-write_error:
-	/*
-	 * This is a special case that the relayd has closed its socket. Let's
-	 * cleanup the relayd object and all associated streams.
-	 */
-	if (relayd && relayd_hang_up) {
-		cleanup_relayd(relayd, ctx);
-		/* Skip splice error so the consumer does not fail */
+	memset(&work, 0, sizeof(work));
+
+	channel = get_channel(key);
+	if (!channel) {
+		ret = -ENOENT;
 		goto end;
 	}
 
-splice_error:
-	/* send the appropriate error description to sessiond */
-	switch (ret) {
-	case EINVAL:
-		lttng_consumer_send_error(ctx, LTTCOMM_CONSUMERD_SPLICE_EINVAL);
-		break;
-	case ENOMEM:
-		lttng_consumer_send_error(ctx, LTTCOMM_CONSUMERD_SPLICE_ENOMEM);
-		break;
-	case ESPIPE:
-		lttng_consumer_send_error(ctx, LTTCOMM_CONSUMERD_SPLICE_ESPIPE);
-		break;
+	if (channel->monitor) {
+		ERR("Snapshot of monitored channel %" PRIu64, key);
+		ret = -EINVAL;
+		goto end_put;
 	}
 
-end:
-	if (relayd && stream->metadata_flag) {
-		pthread_mutex_unlock(&relayd->ctrl_sock_mutex);
+	DBG("Consumer snapshot channel %" PRIu64 " in %s", key, path);
+
+	/* The stream list of an unmonitored channel is fixed once received. */
+	work.nb_streams = channel->streams.count;
+	if (work.nb_streams == 0) {
+		ret = 0;
+		goto end_put;
+	}
+	work.streams = zmalloc(work.nb_streams * sizeof(*work.streams));
+	if (!work.streams) {
+		PERROR("zmalloc snapshot streams");
+		ret = -ENOMEM;
+		goto end_put;
+	}
+	cds_list_for_each_entry(stream, &channel->streams.head, send_node) {
+		work.streams[i++] = stream;
+	}
+	assert(i == work.nb_streams);
+	work.path = path;
+	work.relayd_id = relayd_id;
+	work.max_stream_size = max_stream_size;
+	work.ctx = ctx;
+
+	nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nr_cpus < 1) {
+		nr_cpus = 1;
+	}
+	nb_threads = min(work.nb_streams, (unsigned long) nr_cpus);
+
+	if (nb_threads > 1) {
+		threads = zmalloc(nb_threads * sizeof(*threads));
+		if (!threads) {
+			PERROR("zmalloc snapshot threads");
+			ret = -ENOMEM;
+			goto end_free;
+		}
 	}
 
-	rcu_read_unlock();
-	return written;
+	/* The calling thread records streams too. */
+	for (i = 0; i + 1 < nb_threads; i++) {
+		ret = pthread_create(&threads[i], NULL, snapshot_thread, &work);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_create snapshot");
+			break;
+		}
+	}
+	record_snapshot_work(&work);
+	nb_threads = i;
+	for (i = 0; i < nb_threads; i++) {
+		ret = pthread_join(threads[i], NULL);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_join snapshot");
+		}
+	}
+
+	ret = uatomic_read(&work.error) ? -1 : 0;
+
+	free(threads);
+end_free:
+	free(work.streams);
+end_put:
+	put_channel(channel);
+end:
+	return ret;
 }
 
 /*
- * Take a snapshot for a specific fd
+ * Record a snapshot of the metadata cache of a UST metadata channel as a
+ * metadata stream in the path directory, or on the relayd if relayd_id is not
+ * -1. The cache holds all the metadata of the session.
  *
- * Returns 0 on success, < 0 on error
+ * Return 0 on success, -ENOENT if the channel is unknown or else a negative
+ * value.
  */
-int lttng_consumer_take_snapshot(struct lttng_consumer_stream *stream)
+int lttng_consumer_snapshot_metadata_cache(uint64_t key, const char *path,
+		uint64_t relayd_id)
 {
-	switch (consumer_data.type) {
-	case LTTNG_CONSUMER_KERNEL:
-		return lttng_kconsumer_take_snapshot(stream);
-	case LTTNG_CONSUMER32_UST:
-	case LTTNG_CONSUMER64_UST:
-		return lttng_ustconsumer_take_snapshot(stream);
-	default:
-		ERR("Unknown consumer_data type");
-		assert(0);
-		return -ENOSYS;
+	int ret = 0, alloc_ret, fd;
+	char *data = NULL;
+	uint64_t len = 0, offset = 0;
+	size_t chunk;
+	ssize_t size;
+	struct lttng_consumer_channel *channel;
+	struct lttng_consumer_stream *stream = NULL;
+	struct consumer_relayd_sock_pair *relayd;
+
+	assert(path);
+
+	pthread_mutex_lock(&consumer_data.lock);
+	rcu_read_lock();
+	channel = consumer_find_channel(key);
+	if (!channel || cds_lfht_is_node_deleted(&channel->node.node) ||
+			!channel->metadata_cache) {
+		rcu_read_unlock();
+		pthread_mutex_unlock(&consumer_data.lock);
+		ret = -ENOENT;
+		goto end;
 	}
-}
+	pthread_mutex_lock(&channel->metadata_cache->lock);
+	len = channel->metadata_cache->max_offset;
+	if (len > 0) {
+		data = zmalloc(len);
+		if (data) {
+			memcpy(data, channel->metadata_cache->data, len);
+		}
+	}
+	pthread_mutex_unlock(&channel->metadata_cache->lock);
 
-/*
- * Get the produced position
- *
- * Returns 0 on success, < 0 on error
- */
-int lttng_consumer_get_produced_snapshot(struct lttng_consumer_stream *stream,
-		unsigned long *pos)
-{
-	switch (consumer_data.type) {
-	case LTTNG_CONSUMER_KERNEL:
-		return lttng_kconsumer_get_produced_snapshot(stream, pos);
-	case LTTNG_CONSUMER32_UST:
-	case LTTNG_CONSUMER64_UST:
-		return lttng_ustconsumer_get_produced_snapshot(stream, pos);
-	default:
-		ERR("Unknown consumer_data type");
-		assert(0);
-		return -ENOSYS;
+	stream = consumer_allocate_stream(channel->key, -1ULL,
+			LTTNG_CONSUMER_ACTIVE_STREAM, channel->name, channel->uid,
+			channel->gid, -1, channel->session_id, 0, &alloc_ret,
+			CONSUMER_CHANNEL_TYPE_METADATA);
+	rcu_read_unlock();
+	pthread_mutex_unlock(&consumer_data.lock);
+	if (len > 0 && !data) {
+		PERROR("zmalloc metadata snapshot");
+		ret = -ENOMEM;
+		goto end;
+	}
+	if (!stream) {
+		ret = alloc_ret;
+		goto end;
+	}
+	stream->metadata_flag = 1;
+
+	pthread_mutex_lock(&stream->lock);
+	ret = consumer_snapshot_open_output(stream, path, relayd_id);
+	if (ret < 0) {
+		goto end_unlock;
+	}
+
+	rcu_read_lock();
+	while (offset < len) {
+		chunk = min(len - offset, DEFAULT_METADATA_SUBBUF_SIZE);
+		fd = stream->out_fd;
+		relayd = NULL;
+		if (stream->net_seq_idx != (uint64_t) -1ULL) {
+			relayd = consumer_find_relayd(stream->net_seq_idx);
+			if (!relayd) {
+				ret = -1;
+				break;
+			}
+			pthread_mutex_lock(&relayd->ctrl_sock_mutex);
+			fd = write_relayd_stream_header(stream, chunk +
+					sizeof(struct lttcomm_relayd_metadata_payload), 0,
+					relayd);
+			if (fd >= 0 && write_relayd_metadata_id(fd, stream, relayd,
+					0) < 0) {
+				fd = -1;
+			}
+			if (fd < 0) {
+				pthread_mutex_unlock(&relayd->ctrl_sock_mutex);
+				ret = -1;
+				break;
+			}
+		}
+		do {
+			size = write(fd, data + offset, chunk);
+		} while (size < 0 && errno == EINTR);
+		if (relayd) {
+			pthread_mutex_unlock(&relayd->ctrl_sock_mutex);
+		}
+		if (size < 0 || (relayd && (size_t) size != chunk)) {
+			PERROR("write metadata snapshot");
+			ret = -1;
+			break;
+		}
+		offset += size;
 	}
+	rcu_read_unlock();
+
+	consumer_snapshot_close_output(stream);
+
+end_unlock:
+	pthread_mutex_unlock(&stream->lock);
+	consumer_del_stream(stream, NULL);
+end:
+	free(data);
+	return ret;
 }
 
 int lttng_consumer_recv_cmd(struct lttng_consumer_local_data *ctx,
@@ -1916,6 +3311,7 @@ void consumer_del_metadata_stream(struct lttng_consumer_stream *stream,
 	assert(!ret);
 	rcu_read_unlock();
 
+	consumer_stream_uncache_out_fd(stream);
 	if (stream->out_fd >= 0) {
 		ret = close(stream->out_fd);
 		if (ret) {
@@ -1975,7 +3371,7 @@ end:
 	}
 
 free_stream_rcu:
-	call_rcu(&stream->node.head, free_stream_rcu);
+	lttng_obj_pool_free_rcu(&stream_pool, stream);
 }
 
 /*
@@ -2052,9 +3448,11 @@ static int add_metadata_stream(struct lttng_consumer_stream *stream,
 }
 
 /*
- * Delete data stream that are flagged for deletion (endpoint_status).
+ * Delete the data streams of a data thread that are flagged for deletion
+ * (endpoint_status).
  */
-static void validate_endpoint_status_data_stream(void)
+static void validate_endpoint_status_data_stream(
+		struct lttng_consumer_data_thread *thread)
 {
 	struct lttng_ht_iter iter;
 	struct lttng_consumer_stream *stream;
@@ -2064,7 +3462,8 @@ static void validate_endpoint_status_data_stream(void)
 	rcu_read_lock();
 	cds_lfht_for_each_entry(data_ht->ht, &iter.iter, stream, node.node) {
 		/* Validate delete flag of the stream */
-		if (stream->endpoint_status == CONSUMER_ENDPOINT_ACTIVE) {
+		if (stream->data_thread != thread->id ||
+				stream->endpoint_status == CONSUMER_ENDPOINT_ACTIVE) {
 			continue;
 		}
 		/* Delete it right now */
@@ -2299,23 +3698,148 @@ end_ht:
 }
 
 /*
- * This thread polls the fds in the set to consume the data and write
- * it to tracefile if necessary.
+ * Return the bytes produced and not consumed in the buffer of a data stream,
+ * 0 if the positions can't be read. This costs the stream lock and three
+ * snapshot calls, so it is only done when ready streams have to be ordered.
+ */
+static uint64_t get_stream_backlog(struct lttng_consumer_stream *stream)
+{
+	int ret;
+	unsigned long produced, consumed;
+
+	pthread_mutex_lock(&stream->lock);
+	ret = lttng_consumer_take_snapshot(stream);
+	if (ret < 0) {
+		goto error;
+	}
+	ret = lttng_consumer_get_produced_snapshot(stream, &produced);
+	if (ret < 0) {
+		goto error;
+	}
+	ret = lttng_consumer_get_consumed_snapshot(stream, &consumed);
+	if (ret < 0) {
+		goto error;
+	}
+	pthread_mutex_unlock(&stream->lock);
+
+	return (long) (produced - consumed) > 0 ? produced - consumed : 0;
+
+error:
+	pthread_mutex_unlock(&stream->lock);
+	return 0;
+}
+
+/*
+ * Fill the ready array with the streams of the poll array ready to be consumed
+ * in this pass, the urgent ones or the others, in the order they are consumed.
+ * The backlogs are only read when there is more than one stream to order.
+ *
+ * Return the number of ready streams.
+ */
+static int sched_ready_streams(struct pollfd *pollfd,
+		struct lttng_consumer_stream **local_stream, int nb_fd, int urgent,
+		struct lttng_stream_sched_entry *ready)
+{
+	int i, nb_ready = 0;
+	struct lttng_consumer_stream *stream;
+
+	for (i = 0; i < nb_fd; i++) {
+		stream = local_stream[i];
+		if (stream == NULL) {
+			continue;
+		}
+		if (urgent && !(pollfd[i].revents & POLLPRI)) {
+			continue;
+		}
+		if (!urgent && !(pollfd[i].revents & POLLIN) &&
+				!stream->hangup_flush_done) {
+			continue;
+		}
+
+		ready[nb_ready].index = i;
+		ready[nb_ready].priority = 0;
+		ready[nb_ready].burst = sched_config.backlog ?
+				sched_config.max_burst : 1;
+		nb_ready++;
+	}
+
+	if (lttng_stream_sched_needs_backlog(&sched_config, nb_ready)) {
+		for (i = 0; i < nb_ready; i++) {
+			stream = local_stream[ready[i].index];
+			lttng_stream_sched_set(&ready[i], &sched_config, ready[i].index,
+					get_stream_backlog(stream), stream->max_sb_size,
+					stream->chan->sched_weight);
+		}
+		lttng_stream_sched_sort(ready, nb_ready);
+	}
+
+	return nb_ready;
+}
+
+/*
+ * Consume up to burst subbuffers of a ready stream of a data thread, stopping
+ * when none is left. The stream is deleted and its slot set to NULL on error.
+ */
+static void consume_ready_stream(struct lttng_consumer_data_thread *thread,
+		struct lttng_consumer_stream **stream, unsigned int burst)
+{
+	unsigned int i;
+	ssize_t len;
+	struct lttng_consumer_local_data *ctx = thread->ctx;
+
+	for (i = 0; i < burst; i++) {
+		len = ctx->on_buffer_ready(*stream, ctx);
+		/* it's ok to have an unavailable sub-buffer */
+		if (len < 0 && len != -EAGAIN && len != -ENODATA) {
+			/* Clean the stream and free it. */
+			consumer_del_stream(*stream, data_ht);
+			*stream = NULL;
+			break;
+		} else if (len <= 0) {
+			break;
+		}
+		(*stream)->data_read = 1;
+		thread->nb_subbuf++;
+		thread->bytes += len;
+	}
+}
+
+/*
+ * This thread polls the fds of the streams of a data thread to consume the
+ * data and write it to tracefile if necessary.
  */
 void *consumer_thread_data_poll(void *data)
 {
-	int num_rdy, num_hup, high_prio, ret, i;
+	int num_rdy, num_hup, ret, i, nb_ready;
+	/* Consecutive passes consuming only the urgent streams. */
+	unsigned int high_prio = 0;
 	struct pollfd *pollfd = NULL;
 	/* local view of the streams */
 	struct lttng_consumer_stream **local_stream = NULL, *new_stream = NULL;
+	/* Ready streams of a pass, in the order they are consumed. */
+	struct lttng_stream_sched_entry *ready = NULL;
 	/* local view of consumer_data.fds_count */
 	int nb_fd = 0;
-	struct lttng_consumer_local_data *ctx = data;
-	ssize_t len;
+	/* consumer_data.update_gen of the last update of the local view */
+	unsigned long update_gen = 0;
+	struct lttng_consumer_data_thread *thread = data;
+	struct lttng_consumer_local_data *ctx = thread->ctx;
 
 	rcu_register_thread();
 
-	data_ht = lttng_ht_new(0, LTTNG_HT_TYPE_U64);
+	/*
+	 * Run on the CPUs of the streams so the pages touched to consume them
+	 * are allocated on their node. Keep going unpinned on error.
+	 */
+	if (CPU_COUNT(&thread->cpus)) {
+		ret = pthread_setaffinity_np(pthread_self(), sizeof(thread->cpus),
+				&thread->cpus);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_setaffinity_np data thread %u", thread->id);
+		}
+	}
+
 	if (data_ht == NULL) {
 		/* ENOMEM at this point. Better to bail out. */
 		goto end;
@@ -2324,7 +3848,6 @@ void *consumer_thread_data_poll(void *data)
 	local_stream = zmalloc(sizeof(struct lttng_consumer_stream));
 
 	while (1) {
-		high_prio = 0;
 		num_hup = 0;
 
 		/*
@@ -2332,13 +3855,16 @@ void *consumer_thread_data_poll(void *data)
 		 * local array as well
 		 */
 		pthread_mutex_lock(&consumer_data.lock);
-		if (consumer_data.need_update) {
+		if (update_gen != consumer_data.update_gen) {
 			free(pollfd);
 			pollfd = NULL;
 
 			free(local_stream);
 			local_stream = NULL;
 
+			free(ready);
+			ready = NULL;
+
 			/* allocate for all fds + 1 for the consumer_data_pipe */
 			pollfd = zmalloc((consumer_data.stream_count + 1) * sizeof(struct pollfd));
 			if (pollfd == NULL) {
@@ -2355,7 +3881,15 @@ void *consumer_thread_data_poll(void *data)
 				pthread_mutex_unlock(&consumer_data.lock);
 				goto end;
 			}
-			ret = update_poll_array(ctx, &pollfd, local_stream,
+
+			ready = zmalloc((consumer_data.stream_count + 1) *
+					sizeof(*ready));
+			if (ready == NULL) {
+				PERROR("ready streams malloc");
+				pthread_mutex_unlock(&consumer_data.lock);
+				goto end;
+			}
+			ret = update_poll_array(thread, &pollfd, local_stream,
 					data_ht);
 			if (ret < 0) {
 				ERR("Error in allocating pollfd or local_outfds");
@@ -2364,7 +3898,7 @@ void *consumer_thread_data_poll(void *data)
 				goto end;
 			}
 			nb_fd = ret;
-			consumer_data.need_update = 0;
+			update_gen = consumer_data.update_gen;
 		}
 		pthread_mutex_unlock(&consumer_data.lock);
 
@@ -2393,15 +3927,15 @@ void *consumer_thread_data_poll(void *data)
 		}
 
 		/*
-		 * If the consumer_data_pipe triggered poll go directly to the
+		 * If the data pipe of the thread triggered poll go directly to the
 		 * beginning of the loop to update the array. We want to prioritize
 		 * array update over low-priority reads.
 		 */
 		if (pollfd[nb_fd].revents & (POLLIN | POLLPRI)) {
 			ssize_t pipe_readlen;
 
-			DBG("consumer_data_pipe wake up");
-			pipe_readlen = lttng_pipe_read(ctx->consumer_data_pipe,
+			DBG("data thread %u pipe wake up", thread->id);
+			pipe_readlen = lttng_pipe_read(thread->pipe,
 					&new_stream, sizeof(new_stream));
 			if (pipe_readlen < 0) {
 				ERR("Consumer data pipe ret %ld", pipe_readlen);
@@ -2415,7 +3949,7 @@ void *consumer_thread_data_poll(void *data)
 			 * waking us up to test it.
 			 */
 			if (new_stream == NULL) {
-				validate_endpoint_status_data_stream();
+				validate_endpoint_status_data_stream(thread);
 				continue;
 			}
 
@@ -2428,6 +3962,8 @@ void *consumer_thread_data_poll(void *data)
 				 * hash table thus passing the NULL value here.
 				 */
 				consumer_del_stream(new_stream, NULL);
+			} else {
+				thread->nb_streams++;
 			}
 
 			/* Continue to update the local streams and handle prio ones */
@@ -2435,51 +3971,34 @@ void *consumer_thread_data_poll(void *data)
 		}
 
 		/* Take care of high priority channels first. */
-		for (i = 0; i < nb_fd; i++) {
-			if (local_stream[i] == NULL) {
-				continue;
-			}
-			if (pollfd[i].revents & POLLPRI) {
-				DBG("Urgent read on fd %d", pollfd[i].fd);
-				high_prio = 1;
-				len = ctx->on_buffer_ready(local_stream[i], ctx);
-				/* it's ok to have an unavailable sub-buffer */
-				if (len < 0 && len != -EAGAIN && len != -ENODATA) {
-					/* Clean the stream and free it. */
-					consumer_del_stream(local_stream[i], data_ht);
-					local_stream[i] = NULL;
-				} else if (len > 0) {
-					local_stream[i]->data_read = 1;
-				}
-			}
+		nb_ready = sched_ready_streams(pollfd, local_stream, nb_fd, 1, ready);
+		for (i = 0; i < nb_ready; i++) {
+			DBG("Urgent read on fd %d", pollfd[ready[i].index].fd);
+			consume_ready_stream(thread, &local_stream[ready[i].index],
+					ready[i].burst);
 		}
 
 		/*
-		 * If we read high prio channel in this loop, try again
-		 * for more high prio data.
+		 * If we read high prio channel in this loop, try again for more high
+		 * prio data, unless the other streams waited for too many passes.
 		 */
-		if (high_prio) {
-			continue;
+		if (nb_ready) {
+			high_prio++;
+			if (!sched_config.starvation ||
+					high_prio < sched_config.starvation) {
+				continue;
+			}
+			DBG("Data thread %u serving the normal streams after %u urgent "
+					"passes", thread->id, high_prio);
 		}
+		high_prio = 0;
 
 		/* Take care of low priority channels. */
-		for (i = 0; i < nb_fd; i++) {
-			if (local_stream[i] == NULL) {
-				continue;
-			}
-			if ((pollfd[i].revents & POLLIN) ||
-					local_stream[i]->hangup_flush_done) {
-				DBG("Normal read on fd %d", pollfd[i].fd);
-				len = ctx->on_buffer_ready(local_stream[i], ctx);
-				/* it's ok to have an unavailable sub-buffer */
-				if (len < 0 && len != -EAGAIN && len != -ENODATA) {
-					/* Clean the stream and free it. */
-					consumer_del_stream(local_stream[i], data_ht);
-					local_stream[i] = NULL;
-				} else if (len > 0) {
-					local_stream[i]->data_read = 1;
-				}
-			}
+		nb_ready = sched_ready_streams(pollfd, local_stream, nb_fd, 0, ready);
+		for (i = 0; i < nb_ready; i++) {
+			DBG("Normal read on fd %d", pollfd[ready[i].index].fd);
+			consume_ready_stream(thread, &local_stream[ready[i].index],
+					ready[i].burst);
 		}
 
 		/* Handle hangup and errors */
@@ -2530,21 +4049,27 @@ void *consumer_thread_data_poll(void *data)
 		}
 	}
 end:
-	DBG("polling thread exiting");
+	DBG("polling thread %u exiting: %" PRIu64 " streams, %" PRIu64
+			" subbuffers, %" PRIu64 " bytes consumed", thread->id,
+			thread->nb_streams, thread->nb_subbuf, thread->bytes);
 	free(pollfd);
 	free(local_stream);
+	free(ready);
 
-	/*
-	 * Close the write side of the pipe so epoll_wait() in
-	 * consumer_thread_metadata_poll can catch it. The thread is monitoring the
-	 * read side of the pipe. If we close them both, epoll_wait strangely does
-	 * not return and could create a endless wait period if the pipe is the
-	 * only tracked fd in the poll set. The thread will take care of closing
-	 * the read side.
-	 */
-	(void) lttng_pipe_write_close(ctx->consumer_metadata_pipe);
+	/* The streams of the other data threads are left to the last one. */
+	if (uatomic_sub_return(&ctx->nb_data_threads_running, 1) == 0) {
+		/*
+		 * Close the write side of the pipe so epoll_wait() in
+		 * consumer_thread_metadata_poll can catch it. The thread is
+		 * monitoring the read side of the pipe. If we close them both,
+		 * epoll_wait strangely does not return and could create a endless
+		 * wait period if the pipe is the only tracked fd in the poll set.
+		 * The thread will take care of closing the read side.
+		 */
+		(void) lttng_pipe_write_close(ctx->consumer_metadata_pipe);
 
-	destroy_data_stream_ht(data_ht);
+		destroy_data_stream_ht(data_ht);
+	}
 
 	rcu_unregister_thread();
 	return NULL;
@@ -2953,10 +4478,10 @@ end:
 	consumer_quit = 1;
 
 	/*
-	 * Notify the data poll thread to poll back again and test the
+	 * Notify the data poll threads to poll back again and test the
 	 * consumer_quit state that we just set so to quit gracefully.
 	 */
-	notify_thread_lttng_pipe(ctx->consumer_data_pipe);
+	notify_data_threads(ctx);
 
 	notify_channel_pipe(ctx, NULL, -1, CONSUMER_CHANNEL_QUIT);
 
@@ -3028,6 +4553,21 @@ void lttng_consumer_init(void)
 	consumer_data.relayd_ht = lttng_ht_new(0, LTTNG_HT_TYPE_U64);
 	consumer_data.stream_list_ht = lttng_ht_new(0, LTTNG_HT_TYPE_U64);
 	consumer_data.stream_per_chan_id_ht = lttng_ht_new(0, LTTNG_HT_TYPE_U64);
+	/* Shared by the data threads, each one polling its own streams. */
+	data_ht = lttng_ht_new(0, LTTNG_HT_TYPE_U64);
+	lttng_fd_cache_init(&out_fd_cache, lttng_fd_cache_default_max());
+	DBG("Consumer keeps at most %u tracefiles open (0: no limit)",
+			out_fd_cache.max_open);
+	lttng_stream_sched_config_init(&sched_config);
+	lttng_obj_pool_init(&stream_pool, "stream",
+			sizeof(struct lttng_consumer_stream),
+			DEFAULT_CONSUMER_POOL_MAX_FREE, NULL);
+	lttng_obj_pool_init(&channel_pool, "channel",
+			sizeof(struct lttng_consumer_channel),
+			DEFAULT_CONSUMER_POOL_MAX_FREE, release_channel);
+	DBG("Consumer data threads use the %s order, burst %u, starvation %u",
+			sched_config.backlog ? "backlog" : "poll",
+			sched_config.max_burst, sched_config.starvation);
 }
 
 /*
@@ -3135,18 +4675,30 @@ int consumer_add_relayd_socket(int net_seq_idx, int sock_type,
 			 * collect.
 			 */
 			(void) relayd_close(&relayd->control_sock);
-			(void) relayd_close(&relayd->data_sock);
+			close_relayd_data_socks(relayd);
 			goto error;
 		}
 
 		break;
 	case LTTNG_STREAM_DATA:
+	{
+		struct consumer_relayd_data_sock *data_sock;
+
+		/* Each data socket received adds a data connection. */
+		if (relayd->nb_data_socks == DEFAULT_RELAYD_MAX_DATA_CONNECTIONS) {
+			ERR("Relayd %" PRIu64 " already has %d data connections",
+					relayd->net_seq_idx, DEFAULT_RELAYD_MAX_DATA_CONNECTIONS);
+			ret = -1;
+			goto error;
+		}
+		data_sock = &relayd->data_socks[relayd->nb_data_socks];
+
 		/* Copy received lttcomm socket */
-		lttcomm_copy_sock(&relayd->data_sock.sock, &relayd_sock->sock);
-		ret = lttcomm_create_sock(&relayd->data_sock.sock);
+		lttcomm_copy_sock(&data_sock->sock.sock, &relayd_sock->sock);
+		ret = lttcomm_create_sock(&data_sock->sock.sock);
 		/* Immediately try to close the created socket if valid. */
-		if (relayd->data_sock.sock.fd >= 0) {
-			if (close(relayd->data_sock.sock.fd)) {
+		if (data_sock->sock.sock.fd >= 0) {
+			if (close(data_sock->sock.sock.fd)) {
 				PERROR("close relayd data socket");
 			}
 		}
@@ -3156,11 +4708,16 @@ int consumer_add_relayd_socket(int net_seq_idx, int sock_type,
 		}
 
 		/* Assign new file descriptor */
-		relayd->data_sock.sock.fd = fd;
+		data_sock->sock.sock.fd = fd;
 		/* Assign version values. */
-		relayd->data_sock.major = relayd_sock->major;
-		relayd->data_sock.minor = relayd_sock->minor;
+		data_sock->sock.major = relayd_sock->major;
+		data_sock->sock.minor = relayd_sock->minor;
+
+		/* Publish the connection once set up for the streams mapping on it. */
+		cmm_smp_wmb();
+		CMM_STORE_SHARED(relayd->nb_data_socks, relayd->nb_data_socks + 1);
 		break;
+	}
 	default:
 		ERR("Unknown relayd socket type (%d)", sock_type);
 		ret = -1;
@@ -3313,6 +4870,14 @@ int consumer_data_pending(uint64_t id)
 			goto data_pending;
 		}
 
+		/* Packets still being compressed are not written yet. */
+		if (stream->compress_lane.worker &&
+				lttng_compress_lane_pending(compress_pool,
+					&stream->compress_lane)) {
+			pthread_mutex_unlock(&stream->lock);
+			goto data_pending;
+		}
+
 		/*
 		 * A removed node from the hash table indicates that the stream has
 		 * been deleted thus having a guarantee that the buffers are closed
@@ -22,6 +22,8 @@
 
 #include <limits.h>
 #include <poll.h>
+#include <pthread.h>
+#include <sched.h>
 #include <unistd.h>
 #include <urcu/list.h>
 
@@ -32,6 +34,9 @@
 #include <common/compat/uuid.h>
 #include <common/sessiond-comm/sessiond-comm.h>
 #include <common/pipe.h>
+#include <common/compress/compress-pool.h>
+#include <common/fd-cache.h>
+#include <common/stream-sched.h>
 
 /* Commands for consumer */
 enum lttng_consumer_command {
@@ -54,6 +59,9 @@ enum lttng_consumer_command {
 	LTTNG_CONSUMER_CLOSE_METADATA,
 	LTTNG_CONSUMER_SETUP_METADATA,
 	LTTNG_CONSUMER_FLUSH_CHANNEL,
+	LTTNG_CONSUMER_SNAPSHOT_CHANNEL,
+	/* Batch of streams of a channel with their fds in one message. */
+	LTTNG_CONSUMER_ADD_STREAMS,
 };
 
 /* State of each fd in consumer */
@@ -102,8 +110,8 @@ struct lttng_consumer_channel {
 	int refcount;
 	/* Tracing session id on the session daemon side. */
 	uint64_t session_id;
-	/* Channel trace file path name. */
-	char pathname[PATH_MAX];
+	/* Channel trace file path name, interned (see str-intern.h). */
+	const char *pathname;
 	/* Channel name. */
 	char name[LTTNG_SYMBOL_NAME_LEN];
 	/* UID and GID of the channel. */
@@ -152,6 +160,30 @@ struct lttng_consumer_channel {
 	/* On-disk circular buffer */
 	uint64_t tracefile_size;
 	uint64_t tracefile_count;
+
+	/*
+	 * Directory of the channel tracefiles, opened on first use so the
+	 * stream files are created and rotated with openat(). -1 if not opened.
+	 */
+	int dirfd;
+
+	/* Compression of the data packets, never applied to the metadata. */
+	enum lttng_compression compression;
+
+	/* Weight of the backlog of the streams in the data thread scheduling. */
+	unsigned int sched_weight;
+
+	/* For the periodical flush of streamed data channels (live reading). */
+	unsigned int live_timer_interval;	/* usec */
+	int live_timer_enabled;
+	timer_t live_timer;
+
+	/*
+	 * Set if the streams are consumed by the data threads. Else, the streams
+	 * are kept in the stream list without output and their buffers are only
+	 * read by the snapshots. Those streams hold no reference on the channel.
+	 */
+	int monitor;
 };
 
 /*
@@ -177,6 +209,11 @@ struct lttng_consumer_stream {
 	int out_fd; /* output file to write the data */
 	/* Write position in the output file descriptor */
 	off_t out_fd_offset;
+	/*
+	 * A local tracefile can be closed while the stream is idle. The writers
+	 * get it through consumer_stream_get_out_fd().
+	 */
+	struct lttng_fd_cache_entry out_fd_entry;
 	enum lttng_consumer_stream_state state;
 	int shm_fd_is_copy;
 	int data_read;
@@ -204,6 +241,8 @@ struct lttng_consumer_stream {
 	unsigned int metadata_flag;
 	/* Used when the stream is set for network streaming */
 	uint64_t relayd_stream_id;
+	/* Index of the relayd data connection of the stream, -1 if not mapped. */
+	int relayd_data_sock;
 	/*
 	 * When sending a stream packet to a relayd, this number is used to track
 	 * the packet sent by the consumer and seen by the relayd. When sending the
@@ -228,6 +267,10 @@ struct lttng_consumer_stream {
 	pthread_mutex_t lock;
 	/* Tracing session id */
 	uint64_t session_id;
+	/* CPU of the buffer, -1 if not per-CPU. */
+	int cpu;
+	/* Data thread consuming the stream, set when it is sent to it. */
+	unsigned int data_thread;
 	/*
 	 * Indicates if the stream end point is still active or not (network
 	 * streaming or local file system). The thread "owning" the stream is
@@ -243,6 +286,38 @@ struct lttng_consumer_stream {
 	/* On-disk circular buffer */
 	uint64_t tracefile_size_current;
 	uint64_t tracefile_count_current;
+	/*
+	 * Packet index file of the current tracefile. -1 for the metadata and
+	 * the streams sent to a relayd, which writes its own index.
+	 */
+	int index_fd;
+	/*
+	 * Lane of the packets of a compressed stream in the compression pool.
+	 * Once a packet is queued, the output of the stream (out_fd, index_fd,
+	 * tracefile counters and relayd sequence number) is only used by the
+	 * worker thread of the lane until the lane is drained.
+	 */
+	struct lttng_compress_lane compress_lane;
+	/*
+	 * Set by the lane worker when the relayd hung up. The relayd is cleaned
+	 * up by the data thread on the next packet of the stream.
+	 */
+	int compress_relayd_hang_up;
+};
+
+/*
+ * Data connection of a relayd socket pair.
+ */
+struct consumer_relayd_data_sock {
+	/*
+	 * Mutex protecting the data socket. Packets are written on it by the data
+	 * thread and by the compression workers, each packet needing a header
+	 * and a payload write.
+	 *
+	 * This is nested INSIDE the stream lock.
+	 */
+	pthread_mutex_t mutex;
+	struct lttcomm_relayd_sock sock;
 };
 
 /*
@@ -276,11 +351,14 @@ struct consumer_relayd_sock_pair {
 	struct lttcomm_relayd_sock control_sock;
 
 	/*
-	 * We don't need a mutex at this point since we only splice or write single
-	 * large chunk of data with a header appended at the begining. Moreover,
-	 * this socket is for now only used in a single thread.
+	 * Data connections. A stream is mapped on one of them by its relayd
+	 * stream id when it sends its first packet and keeps it, so the packets
+	 * of a stream arrive in order while the streams are spread over the
+	 * connections.
 	 */
-	struct lttcomm_relayd_sock data_sock;
+	struct consumer_relayd_data_sock data_socks[DEFAULT_RELAYD_MAX_DATA_CONNECTIONS];
+	/* Number of data connections received from the session daemon. */
+	unsigned int nb_data_socks;
 	struct lttng_ht_node_u64 node;
 
 	/* Session id on both sides for the sockets. */
@@ -347,14 +425,40 @@ struct lttng_consumer_local_data {
 	int consumer_thread_pipe[2];
 	int consumer_channel_pipe[2];
 	int consumer_splice_metadata_pipe[2];
-	/* Data stream poll thread pipe. To transfer data stream to the thread */
-	struct lttng_pipe *consumer_data_pipe;
+	/*
+	 * Data stream poll threads, each one with a pipe to transfer data streams
+	 * to it. There is a single one unless the threads are spread over the
+	 * NUMA nodes or CPU groups.
+	 */
+	struct lttng_consumer_data_thread *data_threads;
+	unsigned int nb_data_threads;
+	/* Data threads not exited yet, the last one closes the metadata pipe. */
+	unsigned int nb_data_threads_running;
 	/* to let the signal handler wake up the fd receiver thread */
 	int consumer_should_quit[2];
 	/* Metadata poll thread pipe. Transfer metadata stream to it */
 	struct lttng_pipe *consumer_metadata_pipe;
 };
 
+/*
+ * Poll thread consuming the data streams of the CPUs of a NUMA node or CPU
+ * group. Being pinned to them, the memory it touches to consume the streams
+ * is allocated on the node of the buffers.
+ */
+struct lttng_consumer_data_thread {
+	unsigned int id;
+	struct lttng_consumer_local_data *ctx;
+	pthread_t thread;
+	/* Transfer a data stream to the thread. */
+	struct lttng_pipe *pipe;
+	/* CPUs of the streams and of the thread, empty for any. */
+	cpu_set_t cpus;
+	/* Counters of the thread, only updated by it. */
+	uint64_t nb_streams;
+	uint64_t nb_subbuf;
+	uint64_t bytes;
+};
+
 /*
  * Library-level data. One instance per process.
  */
@@ -378,10 +482,11 @@ struct lttng_consumer_global_data {
 	/* Channel hash table protected by consumer_data.lock. */
 	struct lttng_ht *channel_ht;
 	/*
-	 * Flag specifying if the local array of FDs needs update in the
-	 * poll function. Protected by consumer_data.lock.
+	 * Incremented when a data stream is added or deleted. A data poll thread
+	 * updates its local array of FDs when it changed since its last update.
+	 * Protected by consumer_data.lock.
 	 */
-	unsigned int need_update;
+	unsigned long update_gen;
 	enum lttng_consumer_type type;
 
 	/*
@@ -472,7 +577,9 @@ struct lttng_consumer_channel *consumer_allocate_channel(uint64_t key,
 		int relayd_id,
 		enum lttng_event_output output,
 		uint64_t tracefile_size,
-		uint64_t tracefile_count);
+		uint64_t tracefile_count,
+		enum lttng_compression compression,
+		unsigned int live_timer_interval);
 void consumer_del_stream(struct lttng_consumer_stream *stream,
 		struct lttng_ht *ht);
 void consumer_del_metadata_stream(struct lttng_consumer_stream *stream,
@@ -480,6 +587,16 @@ void consumer_del_metadata_stream(struct lttng_consumer_stream *stream,
 int consumer_add_channel(struct lttng_consumer_channel *channel,
 		struct lttng_consumer_local_data *ctx);
 void consumer_del_channel(struct lttng_consumer_channel *channel);
+int consumer_channel_get_dirfd(struct lttng_consumer_channel *channel);
+void consumer_stream_cache_out_fd(struct lttng_consumer_stream *stream);
+void consumer_stream_uncache_out_fd(struct lttng_consumer_stream *stream);
+void consumer_free_stream(struct lttng_consumer_stream *stream);
+void consumer_free_channel(struct lttng_consumer_channel *channel);
+int consumer_stream_get_out_fd(struct lttng_consumer_stream *stream);
+void consumer_stream_put_out_fd(struct lttng_consumer_stream *stream);
+int consumer_stream_create_index(struct lttng_consumer_stream *stream);
+enum lttng_compression consumer_stream_relayd_compression(
+		struct lttng_consumer_stream *stream);
 
 /* lttng-relayd consumer command */
 struct consumer_relayd_sock_pair *consumer_allocate_relayd_sock_pair(
@@ -509,8 +626,13 @@ ssize_t lttng_consumer_on_read_subbuffer_splice(
 int lttng_consumer_take_snapshot(struct lttng_consumer_stream *stream);
 int lttng_consumer_get_produced_snapshot(struct lttng_consumer_stream *stream,
 		unsigned long *pos);
+int lttng_consumer_get_consumed_snapshot(struct lttng_consumer_stream *stream,
+		unsigned long *pos);
 void *consumer_thread_metadata_poll(void *data);
 void *consumer_thread_data_poll(void *data);
+struct lttng_pipe *consumer_data_stream_pipe(
+		struct lttng_consumer_local_data *ctx,
+		struct lttng_consumer_stream *stream);
 void *consumer_thread_sessiond_poll(void *data);
 void *consumer_thread_channel_poll(void *data);
 int lttng_consumer_recv_cmd(struct lttng_consumer_local_data *ctx,
@@ -526,6 +648,16 @@ int consumer_add_relayd_socket(int net_seq_idx, int sock_type,
 void consumer_flag_relayd_for_destroy(
 		struct consumer_relayd_sock_pair *relayd);
 int consumer_data_pending(uint64_t id);
+int consumer_snapshot_open_output(struct lttng_consumer_stream *stream,
+		const char *path, uint64_t relayd_id);
+void consumer_snapshot_close_output(struct lttng_consumer_stream *stream);
+unsigned long consumer_snapshot_first_pos(unsigned long consumed,
+		unsigned long produced, unsigned long max_sb_size, uint64_t max_size);
+int lttng_consumer_snapshot_channel(uint64_t key, const char *path,
+		uint64_t relayd_id, uint64_t max_stream_size,
+		struct lttng_consumer_local_data *ctx);
+int lttng_consumer_snapshot_metadata_cache(uint64_t key, const char *path,
+		uint64_t relayd_id);
 int consumer_send_status_msg(int sock, int ret_code);
 int consumer_send_status_channel(int sock,
 		struct lttng_consumer_channel *channel);
@@ -0,0 +1,233 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <common/common.h>
+
+#include "cpu-topology.h"
+
+#define SYSFS_NODE_PATH		"/sys/devices/system/node"
+#define SYSFS_CPU_POSSIBLE_PATH	"/sys/devices/system/cpu/possible"
+
+/*
+ * Parse a CPU list of the kernel, like "0-3,8,10-11", in a CPU set. A trailing
+ * newline is accepted.
+ *
+ * Return 0 on success or -1 if the list is invalid.
+ */
+LTTNG_HIDDEN
+int lttng_cpu_list_parse(const char *str, cpu_set_t *set)
+{
+	const char *p = str;
+	char *end;
+	unsigned long first, last, cpu;
+
+	assert(str);
+	assert(set);
+
+	CPU_ZERO(set);
+
+	while (*p != '\0' && *p != '\n') {
+		if (!isdigit((unsigned char) *p)) {
+			goto error;
+		}
+		first = strtoul(p, &end, 10);
+		last = first;
+		p = end;
+		if (*p == '-') {
+			p++;
+			if (!isdigit((unsigned char) *p)) {
+				goto error;
+			}
+			last = strtoul(p, &end, 10);
+			p = end;
+		}
+		if (last < first || last >= CPU_SETSIZE) {
+			goto error;
+		}
+		for (cpu = first; cpu <= last; cpu++) {
+			CPU_SET(cpu, set);
+		}
+
+		if (*p == ',') {
+			p++;
+			if (*p == '\0' || *p == '\n') {
+				goto error;
+			}
+		} else if (*p != '\0' && *p != '\n') {
+			goto error;
+		}
+	}
+
+	return 0;
+
+error:
+	CPU_ZERO(set);
+	return -1;
+}
+
+/*
+ * Read a CPU list file of sysfs in a CPU set.
+ *
+ * Return 0 on success or -1.
+ */
+static int read_cpu_list(const char *path, cpu_set_t *set)
+{
+	int ret;
+	FILE *fp;
+	char buf[4096];
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		return -1;
+	}
+	if (!fgets(buf, sizeof(buf), fp)) {
+		ret = -1;
+		goto end;
+	}
+	ret = lttng_cpu_list_parse(buf, set);
+	if (ret < 0) {
+		WARN("Invalid CPU list in %s", path);
+	}
+
+end:
+	fclose(fp);
+	return ret;
+}
+
+/*
+ * Get the CPUs of each NUMA node having some, from sysfs. The array of CPU
+ * sets is allocated and MUST be freed by the caller.
+ *
+ * Return the number of nodes, 0 if the topology is not available, or a
+ * negative value on error.
+ */
+LTTNG_HIDDEN
+int lttng_cpu_topology_nodes(cpu_set_t **nodes)
+{
+	int ret, nr_nodes = 0;
+	DIR *dir;
+	struct dirent *entry;
+	char path[PATH_MAX], *end;
+	unsigned long node;
+	cpu_set_t set, *tmp;
+
+	assert(nodes);
+
+	*nodes = NULL;
+	dir = opendir(SYSFS_NODE_PATH);
+	if (!dir) {
+		DBG("No NUMA topology in %s", SYSFS_NODE_PATH);
+		return 0;
+	}
+
+	while ((entry = readdir(dir))) {
+		if (strncmp(entry->d_name, "node", 4) ||
+				!isdigit((unsigned char) entry->d_name[4])) {
+			continue;
+		}
+		node = strtoul(entry->d_name + 4, &end, 10);
+		if (*end != '\0') {
+			continue;
+		}
+		snprintf(path, sizeof(path), SYSFS_NODE_PATH "/node%lu/cpulist",
+				node);
+		ret = read_cpu_list(path, &set);
+		/* Memory-only nodes have no CPU. */
+		if (ret < 0 || !CPU_COUNT(&set)) {
+			continue;
+		}
+
+		tmp = realloc(*nodes, (nr_nodes + 1) * sizeof(**nodes));
+		if (!tmp) {
+			PERROR("realloc NUMA nodes");
+			free(*nodes);
+			*nodes = NULL;
+			nr_nodes = -ENOMEM;
+			goto end;
+		}
+		*nodes = tmp;
+		(*nodes)[nr_nodes++] = set;
+	}
+
+end:
+	closedir(dir);
+	return nr_nodes;
+}
+
+/*
+ * Split the possible CPUs in nr_groups groups of consecutive CPUs, the first
+ * groups getting one more CPU when they don't divide evenly. There are fewer
+ * groups when there are fewer CPUs. The array of CPU sets is allocated and
+ * MUST be freed by the caller.
+ *
+ * Return the number of groups or a negative value on error.
+ */
+LTTNG_HIDDEN
+int lttng_cpu_topology_groups(unsigned int nr_groups, cpu_set_t **groups)
+{
+	int ret, cpu, nr_cpus, group = 0, in_group = 0, group_size;
+	cpu_set_t possible;
+
+	assert(nr_groups > 0);
+	assert(groups);
+
+	ret = read_cpu_list(SYSFS_CPU_POSSIBLE_PATH, &possible);
+	if (ret < 0) {
+		ret = sched_getaffinity(0, sizeof(possible), &possible);
+		if (ret < 0) {
+			PERROR("sched_getaffinity");
+			return -1;
+		}
+	}
+	nr_cpus = CPU_COUNT(&possible);
+	if (nr_groups > nr_cpus) {
+		nr_groups = nr_cpus;
+	}
+
+	*groups = zmalloc(nr_groups * sizeof(**groups));
+	if (!*groups) {
+		PERROR("zmalloc CPU groups");
+		return -ENOMEM;
+	}
+
+	group_size = nr_cpus / nr_groups + (nr_cpus % nr_groups ? 1 : 0);
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (!CPU_ISSET(cpu, &possible)) {
+			continue;
+		}
+		CPU_SET(cpu, &(*groups)[group]);
+		if (++in_group == group_size) {
+			group++;
+			in_group = 0;
+			/* The remaining CPUs divide evenly in the remaining groups. */
+			if (group == nr_cpus % nr_groups) {
+				group_size = nr_cpus / nr_groups;
+			}
+		}
+	}
+
+	return nr_groups;
+}
@@ -0,0 +1,27 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef LTTNG_CPU_TOPOLOGY_H
+#define LTTNG_CPU_TOPOLOGY_H
+
+/* cpu_set_t needs _GNU_SOURCE defined before the first system header. */
+#include <sched.h>
+
+int lttng_cpu_list_parse(const char *str, cpu_set_t *set);
+int lttng_cpu_topology_nodes(cpu_set_t **nodes);
+int lttng_cpu_topology_groups(unsigned int nr_groups, cpu_set_t **groups);
+
+#endif /* LTTNG_CPU_TOPOLOGY_H */
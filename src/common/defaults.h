@@ -37,6 +37,8 @@
 
 /* Default size of a hash table */
 #define DEFAULT_HT_SIZE                         4
+/* Default maximum number of buckets of a chunk or mmap allocated hash table */
+#define DEFAULT_HT_MAX_BUCKETS                  (1UL << 20)
 
 /* Default session daemon paths */
 #define DEFAULT_HOME_DIR						"/tmp"
@@ -58,6 +60,12 @@
  */
 #define DEFAULT_SESSION_NAME                    "auto"
 
+/*
+ * Default snapshot name. This default value will get the snapshot sequence
+ * number and the date and time appended (%Y%m%d-%H%M%S) to it.
+ */
+#define DEFAULT_SNAPSHOT_NAME                   "snapshot"
+
 /* Default consumer paths */
 #define DEFAULT_CONSUMERD_RUNDIR                "%s"
 
@@ -115,6 +123,8 @@
 #define DEFAULT_CHANNEL_OVERWRITE       0
 #define DEFAULT_CHANNEL_TRACEFILE_SIZE  0
 #define DEFAULT_CHANNEL_TRACEFILE_COUNT 0
+#define DEFAULT_CHANNEL_COMPRESSION     LTTNG_COMPRESSION_NONE
+#define DEFAULT_CHANNEL_LIVE_TIMER      0
 
 /* Must always be a power of 2 */
 #define _DEFAULT_CHANNEL_SUBBUF_SIZE	4096    /* bytes */
@@ -174,6 +184,7 @@
 /* Default network ports for trace streaming support */
 #define DEFAULT_NETWORK_CONTROL_PORT        5342
 #define DEFAULT_NETWORK_DATA_PORT           5343
+#define DEFAULT_NETWORK_VIEWER_PORT         5344
 
 /*
  * If a thread stalls for this amount of time, it will be considered bogus (bad
@@ -200,8 +211,98 @@
 #define DEFAULT_APP_SOCKET_RW_TIMEOUT       5  /* sec */
 #define DEFAULT_APP_SOCKET_TIMEOUT_ENV      "LTTNG_APP_SOCKET_TIMEOUT"
 
+/*
+ * Maximum number of unregistered applications torn down after a single grace
+ * period by the session daemon reclaim thread.
+ */
+#define DEFAULT_UST_APP_RECLAIM_BATCH       64
+
+/*
+ * Lifetime of the tracepoint catalogue of an application cached by the
+ * session daemon, after which it is queried again.
+ */
+#define DEFAULT_UST_TRACEPOINT_CACHE_TTL    10 /* sec */
+
 #define DEFAULT_UST_STREAM_FD_NUM			2 /* Number of fd per UST stream. */
 
+/* Maximum number of UIDs of which a session provisions the per UID buffers. */
+#define DEFAULT_UST_PROVISION_UIDS_MAX      64
+/* Size of the getpwuid_r() buffer when the system gives no hint. */
+#define DEFAULT_GETPW_BUF_LEN               16384
+
+/*
+ * Packet compression: packets waiting in the compression pool before the
+ * reading thread blocks, and compression level of zstd.
+ */
+#define DEFAULT_COMPRESSION_MAX_JOBS        256
+#define DEFAULT_COMPRESSION_ZSTD_LEVEL      1
+
+/*
+ * Packets queued on the writer of a relayd stream before its data connection
+ * stops being read, and queue size at which reading resumes.
+ */
+#define DEFAULT_RELAYD_STREAM_MAX_PACKETS   16
+#define DEFAULT_RELAYD_STREAM_LOW_PACKETS   (DEFAULT_RELAYD_STREAM_MAX_PACKETS / 2)
+
+/*
+ * Data connections opened to a relayd for each consumer output, the streams
+ * being spread over them. Experimental: the throughput gain of more than one
+ * connection has not been measured yet, so the default stays at a single
+ * one. The environment variable overrides the default.
+ */
+#define DEFAULT_RELAYD_DATA_CONNECTIONS     1
+#define DEFAULT_RELAYD_MAX_DATA_CONNECTIONS 16
+#define DEFAULT_RELAYD_DATA_CONNECTIONS_ENV "LTTNG_RELAYD_DATA_CONNECTIONS"
+
+/*
+ * Share, in percent of RLIMIT_NOFILE, of the stream output files kept open by
+ * the consumer and relay daemons, the least recently used being closed.
+ */
+#define DEFAULT_FD_CACHE_THRESHOLD          50
+/* Maximum number of stream output files kept open, 0 for no limit. */
+#define DEFAULT_FD_CACHE_MAX_ENV            "LTTNG_FD_CACHE_MAX"
+
+/*
+ * Data threads of a consumer daemon, each one pinned to a NUMA node or a
+ * group of CPUs and consuming the streams of these CPUs. The environment
+ * variable is "node" for a thread per node or a number of CPU groups.
+ * Experimental: no throughput or locality gain of the pinned threads has been
+ * measured yet, so the default stays a single unpinned thread and the
+ * environment variable is the only way to opt in.
+ */
+#define DEFAULT_CONSUMERD_DATA_THREADS_ENV  "LTTNG_CONSUMERD_DATA_THREADS"
+#define DEFAULT_CONSUMERD_MAX_DATA_THREADS  256
+
+/*
+ * Scheduling of the streams of a consumer data thread: "poll" order or
+ * "backlog" order, the fullest weighted buffers first. The burst is the most
+ * subbuffers consumed from a stream in a pass and the starvation limit the
+ * most consecutive passes serving only the urgent streams.
+ */
+#define DEFAULT_CONSUMERD_SCHED_ENV            "LTTNG_CONSUMERD_SCHED"
+#define DEFAULT_CONSUMERD_SCHED_BURST          4
+#define DEFAULT_CONSUMERD_SCHED_BURST_ENV      "LTTNG_CONSUMERD_SCHED_BURST"
+#define DEFAULT_CONSUMERD_SCHED_STARVATION     16
+#define DEFAULT_CONSUMERD_SCHED_STARVATION_ENV "LTTNG_CONSUMERD_SCHED_STARVATION"
+#define DEFAULT_CONSUMERD_SCHED_WEIGHTS_ENV    "LTTNG_CONSUMERD_SCHED_WEIGHTS"
+#define DEFAULT_CONSUMERD_SCHED_MAX_WEIGHT     1000
+
+/*
+ * Freed objects kept for reuse by each object pool of the consumer and relay
+ * daemons, like their streams and channels.
+ */
+#define DEFAULT_CONSUMER_POOL_MAX_FREE         256
+#define DEFAULT_RELAYD_POOL_MAX_FREE           256
+
+/*
+ * Largest packet sent to a live viewer per request, a backstop to the check
+ * against the index of the stream.
+ */
+#define DEFAULT_RELAYD_VIEWER_PACKET_MAX (64 * 1024 * 1024)
+
+/* Largest chunk of metadata sent to a live viewer per request. */
+#define DEFAULT_RELAYD_VIEWER_METADATA_CHUNK 65536
+
 extern size_t default_channel_subbuf_size;
 extern size_t default_metadata_subbuf_size;
 extern size_t default_ust_pid_channel_subbuf_size;
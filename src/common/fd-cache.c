@@ -0,0 +1,281 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <common/common.h>
+#include <common/defaults.h>
+
+#include "fd-cache.h"
+
+/*
+ * Return the current time in nanoseconds.
+ */
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Close the descriptors of the least recently used entries until the cache is
+ * within its maximum. An entry in use, its lock being held, is skipped, as is
+ * the entry just opened by the caller. The cache can stay over its maximum
+ * if every entry is in use.
+ *
+ * The cache lock MUST be held.
+ */
+static void evict_cold(struct lttng_fd_cache *cache,
+		struct lttng_fd_cache_entry *self)
+{
+	int ret;
+	struct cds_list_head *pos;
+	struct lttng_fd_cache_entry *entry;
+
+	while (cache->max_open && cache->nr_open > cache->max_open) {
+		entry = NULL;
+		cds_list_for_each_prev(pos, &cache->lru) {
+			struct lttng_fd_cache_entry *victim = cds_list_entry(pos,
+					struct lttng_fd_cache_entry, lru_node);
+
+			if (victim == self || pthread_mutex_trylock(&victim->lock)) {
+				continue;
+			}
+			entry = victim;
+			break;
+		}
+		if (!entry) {
+			DBG("Fd cache over its maximum, every output in use");
+			break;
+		}
+
+		if (*entry->fd >= 0) {
+			ret = close(*entry->fd);
+			if (ret) {
+				PERROR("close cold output");
+			}
+			*entry->fd = -1;
+		}
+		cds_list_del(&entry->lru_node);
+		entry->cached = 0;
+		entry->evicted = 1;
+		cache->nr_open--;
+		cache->stats.evictions++;
+		pthread_mutex_unlock(&entry->lock);
+	}
+}
+
+/*
+ * Initialize a cache keeping at most max_open descriptors open, 0 for no
+ * limit.
+ */
+LTTNG_HIDDEN
+void lttng_fd_cache_init(struct lttng_fd_cache *cache, unsigned int max_open)
+{
+	assert(cache);
+
+	memset(cache, 0, sizeof(*cache));
+	pthread_mutex_init(&cache->lock, NULL);
+	CDS_INIT_LIST_HEAD(&cache->lru);
+	cache->max_open = max_open;
+}
+
+/*
+ * Return the maximum number of output files of a daemon: the value of the
+ * LTTNG_FD_CACHE_MAX environment variable if set, else a share of the
+ * RLIMIT_NOFILE limit. 0 means no limit.
+ */
+LTTNG_HIDDEN
+unsigned int lttng_fd_cache_default_max(void)
+{
+	int ret;
+	char *env, *end;
+	unsigned long max;
+	struct rlimit rlim;
+
+	env = getenv(DEFAULT_FD_CACHE_MAX_ENV);
+	if (env) {
+		errno = 0;
+		max = strtoul(env, &end, 10);
+		if (!errno && end != env && *end == '\0' && max <= UINT_MAX) {
+			return max;
+		}
+		WARN("Invalid value %s of %s, using the default", env,
+				DEFAULT_FD_CACHE_MAX_ENV);
+	}
+
+	ret = getrlimit(RLIMIT_NOFILE, &rlim);
+	if (ret < 0) {
+		PERROR("getrlimit");
+		return 0;
+	}
+	if (rlim.rlim_cur == RLIM_INFINITY ||
+			rlim.rlim_cur / 100 > UINT_MAX / DEFAULT_FD_CACHE_THRESHOLD) {
+		return 0;
+	}
+
+	return rlim.rlim_cur * DEFAULT_FD_CACHE_THRESHOLD / 100;
+}
+
+/*
+ * Initialize the entry of an output file whose descriptor is in *fd.
+ */
+LTTNG_HIDDEN
+void lttng_fd_cache_entry_init(struct lttng_fd_cache_entry *entry, int *fd,
+		int (*reopen)(struct lttng_fd_cache_entry *entry))
+{
+	assert(entry);
+	assert(fd);
+	assert(reopen);
+
+	entry->fd = fd;
+	entry->reopen = reopen;
+	pthread_mutex_init(&entry->lock, NULL);
+	CDS_INIT_LIST_HEAD(&entry->lru_node);
+	entry->cached = 0;
+	entry->evicted = 0;
+}
+
+/*
+ * Add the entry of a newly opened output file to the cache, possibly closing
+ * colder ones.
+ */
+LTTNG_HIDDEN
+void lttng_fd_cache_add(struct lttng_fd_cache *cache,
+		struct lttng_fd_cache_entry *entry)
+{
+	assert(cache);
+	assert(entry);
+
+	pthread_mutex_lock(&cache->lock);
+	if (!entry->cached) {
+		cds_list_add(&entry->lru_node, &cache->lru);
+		entry->cached = 1;
+		entry->evicted = 0;
+		cache->nr_open++;
+		evict_cold(cache, entry);
+	}
+	pthread_mutex_unlock(&cache->lock);
+}
+
+/*
+ * Remove an entry from the cache before its owner closes the descriptor. The
+ * cache doesn't close it anymore once this returns.
+ */
+LTTNG_HIDDEN
+void lttng_fd_cache_del(struct lttng_fd_cache *cache,
+		struct lttng_fd_cache_entry *entry)
+{
+	assert(cache);
+	assert(entry);
+
+	pthread_mutex_lock(&cache->lock);
+	if (entry->cached) {
+		cds_list_del(&entry->lru_node);
+		cache->nr_open--;
+	}
+	entry->cached = 0;
+	entry->evicted = 0;
+	pthread_mutex_unlock(&cache->lock);
+}
+
+/*
+ * Get the descriptor of an entry for writing, reopening it if the cache
+ * closed it. The descriptor stays open, and the owner can replace it in *fd
+ * on a tracefile rotation, until lttng_fd_cache_put() which MUST be called
+ * even on error.
+ *
+ * Return the descriptor or a negative value.
+ */
+LTTNG_HIDDEN
+int lttng_fd_cache_get(struct lttng_fd_cache *cache,
+		struct lttng_fd_cache_entry *entry)
+{
+	int fd;
+	uint64_t start;
+
+	assert(cache);
+	assert(entry);
+
+	pthread_mutex_lock(&entry->lock);
+
+	pthread_mutex_lock(&cache->lock);
+	if (entry->cached) {
+		cds_list_move(&entry->lru_node, &cache->lru);
+		cache->stats.hits++;
+	}
+	if (!entry->evicted) {
+		pthread_mutex_unlock(&cache->lock);
+		return *entry->fd;
+	}
+	pthread_mutex_unlock(&cache->lock);
+
+	/* Reopen out of the cache lock, it can be run as the stream user. */
+	start = now_ns();
+	fd = entry->reopen(entry);
+	if (fd < 0) {
+		return fd;
+	}
+	*entry->fd = fd;
+
+	pthread_mutex_lock(&cache->lock);
+	cds_list_add(&entry->lru_node, &cache->lru);
+	entry->cached = 1;
+	entry->evicted = 0;
+	cache->nr_open++;
+	cache->stats.reopens++;
+	cache->stats.reopen_ns += now_ns() - start;
+	evict_cold(cache, entry);
+	pthread_mutex_unlock(&cache->lock);
+
+	return fd;
+}
+
+/*
+ * Release an entry obtained with lttng_fd_cache_get(), the cache being free to
+ * close its descriptor again.
+ */
+LTTNG_HIDDEN
+void lttng_fd_cache_put(struct lttng_fd_cache_entry *entry)
+{
+	assert(entry);
+
+	pthread_mutex_unlock(&entry->lock);
+}
+
+/*
+ * Copy the counters of the cache.
+ */
+LTTNG_HIDDEN
+void lttng_fd_cache_get_stats(struct lttng_fd_cache *cache,
+		struct lttng_fd_cache_stats *stats)
+{
+	assert(cache);
+	assert(stats);
+
+	pthread_mutex_lock(&cache->lock);
+	*stats = cache->stats;
+	pthread_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,81 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef LTTNG_FD_CACHE_H
+#define LTTNG_FD_CACHE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <urcu/list.h>
+
+/*
+ * Output file of a stream whose descriptor can be closed by the cache while
+ * the stream is cold, and reopened at its end on the next use.
+ */
+struct lttng_fd_cache_entry {
+	/* Field of the owner holding the descriptor, -1 while closed. */
+	int *fd;
+	/*
+	 * Reopen the current file of the entry for appending. Called with the
+	 * entry lock held, returns the descriptor or a negative value.
+	 */
+	int (*reopen)(struct lttng_fd_cache_entry *entry);
+	/* Held between get and put, tried by the cache to close the fd. */
+	pthread_mutex_t lock;
+	/* The fields below are protected by the cache lock. */
+	struct cds_list_head lru_node;
+	unsigned int cached:1;
+	unsigned int evicted:1;
+};
+
+struct lttng_fd_cache_stats {
+	/* Uses of an open descriptor. */
+	uint64_t hits;
+	/* Uses of a descriptor closed by the cache, and the time to reopen. */
+	uint64_t reopens;
+	uint64_t reopen_ns;
+	/* Descriptors closed by the cache. */
+	uint64_t evictions;
+};
+
+/*
+ * Bounded set of open output files, the least recently used one being closed
+ * when a file opened or reopened goes over the maximum.
+ */
+struct lttng_fd_cache {
+	pthread_mutex_t lock;
+	/* Most recently used first. */
+	struct cds_list_head lru;
+	unsigned int nr_open;
+	/* 0 for no limit. */
+	unsigned int max_open;
+	struct lttng_fd_cache_stats stats;
+};
+
+void lttng_fd_cache_init(struct lttng_fd_cache *cache, unsigned int max_open);
+unsigned int lttng_fd_cache_default_max(void);
+void lttng_fd_cache_entry_init(struct lttng_fd_cache_entry *entry, int *fd,
+		int (*reopen)(struct lttng_fd_cache_entry *entry));
+void lttng_fd_cache_add(struct lttng_fd_cache *cache,
+		struct lttng_fd_cache_entry *entry);
+void lttng_fd_cache_del(struct lttng_fd_cache *cache,
+		struct lttng_fd_cache_entry *entry);
+int lttng_fd_cache_get(struct lttng_fd_cache *cache,
+		struct lttng_fd_cache_entry *entry);
+void lttng_fd_cache_put(struct lttng_fd_cache_entry *entry);
+void lttng_fd_cache_get_stats(struct lttng_fd_cache *cache,
+		struct lttng_fd_cache_stats *stats);
+
+#endif /* LTTNG_FD_CACHE_H */
@@ -66,15 +66,57 @@ static int match_u64(struct cds_lfht_node *node, const void *key)
 }
 
 /*
- * Return an allocated lttng hashtable.
+ * Return an allocated lttng hashtable created with the given attributes.
  */
-struct lttng_ht *lttng_ht_new(unsigned long size, int type)
+struct lttng_ht *lttng_ht_new_attr(const struct lttng_ht_attr *attr,
+		int type)
 {
+	int flags = CDS_LFHT_ACCOUNTING;
+	unsigned long size, max_buckets;
+	const struct cds_lfht_mm_type *mm;
 	struct lttng_ht *ht;
 
+	assert(attr);
+
 	/* Test size */
+	size = attr->size_hint;
 	if (!size)
 		size = DEFAULT_HT_SIZE;
+	/* The RCU hashtable only deals with power of two sizes. */
+	size = 1UL << cds_lfht_get_count_order_ulong(size);
+
+	max_buckets = attr->max_buckets;
+	if (max_buckets) {
+		max_buckets = 1UL << cds_lfht_get_count_order_ulong(max_buckets);
+	}
+
+	switch (attr->mm) {
+	case LTTNG_HT_MM_DEFAULT:
+		mm = NULL;
+		if (!max_buckets) {
+			max_buckets = max_hash_buckets_size;
+		}
+		break;
+	case LTTNG_HT_MM_ORDER:
+		mm = &cds_lfht_mm_order;
+		break;
+	case LTTNG_HT_MM_CHUNK:
+		mm = &cds_lfht_mm_chunk;
+		break;
+	case LTTNG_HT_MM_MMAP:
+		mm = &cds_lfht_mm_mmap;
+		break;
+	default:
+		ERR("Unknown lttng hashtable allocator %d", attr->mm);
+		goto error;
+	}
+	if (mm && mm != &cds_lfht_mm_order && !max_buckets) {
+		max_buckets = DEFAULT_HT_MAX_BUCKETS;
+	}
+
+	if (!attr->no_auto_resize) {
+		flags |= CDS_LFHT_AUTO_RESIZE;
+	}
 
 	ht = zmalloc(sizeof(*ht));
 	if (ht == NULL) {
@@ -82,8 +124,8 @@ struct lttng_ht *lttng_ht_new(unsigned long size, int type)
 		goto error;
 	}
 
-	ht->ht = cds_lfht_new(size, min_hash_alloc_size, max_hash_buckets_size,
-			CDS_LFHT_AUTO_RESIZE | CDS_LFHT_ACCOUNTING, NULL);
+	ht->ht = _cds_lfht_new(size, min_hash_alloc_size, max_buckets, flags, mm,
+			&rcu_flavor, NULL);
 	/*
 	 * There is already an assert in the RCU hashtable code so if the ht is
 	 * NULL here there is a *huge* problem.
@@ -117,6 +159,20 @@ error:
 	return NULL;
 }
 
+/*
+ * Return an allocated lttng hashtable of the default attributes with an
+ * initial size hint.
+ */
+struct lttng_ht *lttng_ht_new(unsigned long size, int type)
+{
+	struct lttng_ht_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size_hint = size;
+
+	return lttng_ht_new_attr(&attr, type);
+}
+
 /*
  * Free a lttng hashtable.
  */
@@ -35,6 +35,32 @@ enum lttng_ht_type {
 	LTTNG_HT_TYPE_U64,
 };
 
+/*
+ * Bucket table allocators of the RCU hashtable. The default one is the mmap
+ * allocator on 64-bit when the maximum number of buckets is bounded, else the
+ * order allocator.
+ */
+enum lttng_ht_mm {
+	LTTNG_HT_MM_DEFAULT	= 0,
+	LTTNG_HT_MM_ORDER	= 1,
+	LTTNG_HT_MM_CHUNK	= 2,
+	LTTNG_HT_MM_MMAP	= 3,
+};
+
+/*
+ * Creation attributes of a hashtable. A zeroed structure gives the same
+ * table as lttng_ht_new(0, type).
+ */
+struct lttng_ht_attr {
+	/* Expected number of nodes. Rounded up to a power of two of buckets. */
+	unsigned long size_hint;
+	enum lttng_ht_mm mm;
+	/* Maximum number of buckets, power of two. Required by chunk and mmap. */
+	unsigned long max_buckets;
+	/* Keep the initial number of buckets for the table lifetime. */
+	unsigned int no_auto_resize;
+};
+
 struct lttng_ht {
 	struct cds_lfht *ht;
 	cds_lfht_match_fct match_fct;
@@ -65,6 +91,8 @@ struct lttng_ht_node_u64 {
 
 /* Hashtable new and destroy */
 extern struct lttng_ht *lttng_ht_new(unsigned long size, int type);
+extern struct lttng_ht *lttng_ht_new_attr(const struct lttng_ht_attr *attr,
+		int type);
 extern void lttng_ht_destroy(struct lttng_ht *ht);
 
 /* Specialized node init and free functions */
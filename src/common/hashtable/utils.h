@@ -18,13 +18,19 @@
 #ifndef _LTT_HT_UTILS_H
 #define _LTT_HT_UTILS_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 unsigned long hash_key_ulong(void *_key, unsigned long seed);
 unsigned long hash_key_u64(void *_key, unsigned long seed);
 unsigned long hash_key_str(void *key, unsigned long seed);
+unsigned long hash_key_buf(const void *buf, size_t len, unsigned long seed);
 int hash_match_key_ulong(void *key1, void *key2);
 int hash_match_key_u64(void *key1, void *key2);
 int hash_match_key_str(void *key1, void *key2);
 
+/* Previous implementations, for benchmarking. */
+unsigned long hash_key_u64_jenkins(void *_key, unsigned long seed);
+unsigned long hash_key_str_jenkins(void *key, unsigned long seed);
+
 #endif /* _LTT_HT_UTILS_H */
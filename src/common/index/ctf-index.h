@@ -0,0 +1,57 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef LTTNG_INDEX_CTF_INDEX_H
+#define LTTNG_INDEX_CTF_INDEX_H
+
+#include <stdint.h>
+
+#include <common/macros.h>
+
+/*
+ * On-disk format of the packet index files written next to the tracefiles, in
+ * the "index" subdirectory of a channel with the ".idx" extension. Every
+ * field is big endian.
+ *
+ * The file starts with a header followed by one entry per packet, in the
+ * order of the packets in the tracefile, so a reader can binary search the
+ * entries on the timestamps.
+ */
+#define CTF_INDEX_MAGIC			0xC1F1DCC1
+#define CTF_INDEX_MAJOR			1
+#define CTF_INDEX_MINOR			0
+
+#define CTF_INDEX_DIR			"index"
+#define CTF_INDEX_EXT			".idx"
+
+struct ctf_packet_index_file_hdr {
+	uint32_t magic;
+	uint32_t index_major;
+	uint32_t index_minor;
+	/* Size of struct ctf_packet_index, for forward compatibility. */
+	uint32_t packet_index_len;
+} LTTNG_PACKED;
+
+struct ctf_packet_index {
+	uint64_t offset;		/* offset of the packet in the file, in bytes */
+	uint64_t packet_size;		/* packet size, in bits */
+	uint64_t content_size;		/* content size, in bits */
+	uint64_t timestamp_begin;
+	uint64_t timestamp_end;
+	uint64_t events_discarded;
+	uint64_t stream_id;
+} LTTNG_PACKED;
+
+#endif /* LTTNG_INDEX_CTF_INDEX_H */
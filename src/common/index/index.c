@@ -0,0 +1,339 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <byteswap.h>
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <common/common.h>
+#include <common/runas.h>
+
+#include "index.h"
+
+/* Magic number of a CTF packet header. */
+#define CTF_PACKET_MAGIC		0xC1FC1FC1
+
+/*
+ * Offsets in the packed packet header and context written by the LTTng
+ * ring buffer clients of both tracers.
+ */
+#define CTF_PACKET_MAGIC_OFFSET		0
+#define CTF_PACKET_STREAM_ID_OFFSET	20
+#define CTF_PACKET_TS_BEGIN_OFFSET	24
+#define CTF_PACKET_TS_END_OFFSET	32
+#define CTF_PACKET_CONTENT_SIZE_OFFSET	40
+#define CTF_PACKET_PACKET_SIZE_OFFSET	48
+#define CTF_PACKET_DISCARDED_OFFSET	56
+
+static uint32_t read_u32(const char *buf, size_t offset, int swap)
+{
+	uint32_t val;
+
+	memcpy(&val, buf + offset, sizeof(val));
+	return swap ? bswap_32(val) : val;
+}
+
+static uint64_t read_u64(const char *buf, size_t offset, int swap)
+{
+	uint64_t val;
+
+	memcpy(&val, buf + offset, sizeof(val));
+	return swap ? bswap_64(val) : val;
+}
+
+/*
+ * Fill an index entry from the header of a packet written at the given offset
+ * of its tracefile. The packet is in the byte order of the tracer and
+ * long_size is the size of a long for the tracer, 4 or 8.
+ *
+ * Return 0 on success or a negative value if the buffer does not start with a
+ * valid packet header.
+ */
+int index_packet_parse(const char *buf, size_t len, unsigned int long_size,
+		uint64_t offset, struct ctf_packet_index *index)
+{
+	int swap;
+	uint32_t magic;
+	uint64_t discarded;
+
+	assert(buf);
+	assert(index);
+	assert(long_size == 4 || long_size == 8);
+
+	if (len < CTF_PACKET_HEADER_LEN(long_size)) {
+		return -EINVAL;
+	}
+
+	magic = read_u32(buf, CTF_PACKET_MAGIC_OFFSET, 0);
+	if (magic == CTF_PACKET_MAGIC) {
+		swap = 0;
+	} else if (bswap_32(magic) == CTF_PACKET_MAGIC) {
+		swap = 1;
+	} else {
+		return -EINVAL;
+	}
+
+	if (long_size == 8) {
+		discarded = read_u64(buf, CTF_PACKET_DISCARDED_OFFSET, swap);
+	} else {
+		discarded = read_u32(buf, CTF_PACKET_DISCARDED_OFFSET, swap);
+	}
+
+	index->offset = htobe64(offset);
+	index->packet_size = htobe64(read_u64(buf, CTF_PACKET_PACKET_SIZE_OFFSET,
+				swap));
+	index->content_size = htobe64(read_u64(buf,
+				CTF_PACKET_CONTENT_SIZE_OFFSET, swap));
+	index->timestamp_begin = htobe64(read_u64(buf, CTF_PACKET_TS_BEGIN_OFFSET,
+				swap));
+	index->timestamp_end = htobe64(read_u64(buf, CTF_PACKET_TS_END_OFFSET,
+				swap));
+	index->events_discarded = htobe64(discarded);
+	index->stream_id = htobe64(read_u32(buf, CTF_PACKET_STREAM_ID_OFFSET,
+				swap));
+
+	return 0;
+}
+
+/*
+ * Write exactly len bytes. Return 0 on success or a negative errno value.
+ */
+static int write_full(int fd, const void *buf, size_t len)
+{
+	ssize_t ret;
+	size_t done = 0;
+
+	while (done < len) {
+		ret = write(fd, (const char *) buf + done, len - done);
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -errno;
+		}
+		done += ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Open an index file, as the given uid/gid if any.
+ */
+static int open_index(int dirfd, const char *path, int flags, mode_t mode,
+		int uid, int gid)
+{
+	if (uid < 0 || gid < 0) {
+		if (dirfd >= 0) {
+			return openat(dirfd, path, flags, mode);
+		}
+		return open(path, flags, mode);
+	}
+	return run_as_openat(dirfd, path, flags, mode, uid, gid);
+}
+
+/*
+ * Format the path of the index file of a stream tracefile in buf, under the
+ * given index directory.
+ *
+ * Return 0 on success or else a negative value.
+ */
+static int index_file_path(char *buf, size_t len, const char *dir,
+		const char *stream_name, uint64_t size, uint64_t count)
+{
+	int ret;
+
+	if (size > 0) {
+		ret = snprintf(buf, len, "%s/%s_%" PRIu64 CTF_INDEX_EXT, dir,
+				stream_name, count);
+	} else {
+		ret = snprintf(buf, len, "%s/%s" CTF_INDEX_EXT, dir, stream_name);
+	}
+	if (ret < 0 || ret >= len) {
+		ERR("Index file path too long for %s/%s", dir, stream_name);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Create the index file of a stream tracefile and write its header. The file
+ * is created in the index subdirectory of the channel, relative to dirfd if
+ * it is opened, and is split like the tracefile if size is not 0.
+ *
+ * Return the file descriptor or a negative value on error.
+ */
+int index_create_file(int dirfd, const char *path_name, char *stream_name,
+		uint64_t size, uint64_t count, int uid, int gid)
+{
+	int ret, fd, flags, mode;
+	char path[PATH_MAX], dir[PATH_MAX];
+	struct ctf_packet_index_file_hdr hdr;
+
+	assert(path_name);
+	assert(stream_name);
+
+	ret = snprintf(dir, sizeof(dir), "%s/" CTF_INDEX_DIR, path_name);
+	if (ret < 0 || ret >= sizeof(dir)) {
+		ERR("Index directory path too long for %s", path_name);
+		ret = -1;
+		goto error;
+	}
+
+	ret = index_file_path(path, sizeof(path),
+			dirfd >= 0 ? CTF_INDEX_DIR : dir, stream_name, size, count);
+	if (ret < 0) {
+		goto error;
+	}
+
+	flags = O_WRONLY | O_CREAT | O_TRUNC;
+	/* Open with 660 mode like the tracefile. */
+	mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP;
+
+	fd = open_index(dirfd, path, flags, mode, uid, gid);
+	if (fd < 0 && errno == ENOENT) {
+		/* First index of the channel, create the directory. */
+		if (uid < 0 || gid < 0) {
+			ret = mkdir(dir, S_IRWXU | S_IRWXG);
+		} else {
+			ret = run_as_mkdir(dir, S_IRWXU | S_IRWXG, uid, gid);
+		}
+		if (ret < 0 && errno != EEXIST) {
+			PERROR("mkdir index directory %s", dir);
+			goto error;
+		}
+		fd = open_index(dirfd, path, flags, mode, uid, gid);
+	}
+	if (fd < 0) {
+		PERROR("open index file %s", path);
+		ret = -1;
+		goto error;
+	}
+
+	hdr.magic = htobe32(CTF_INDEX_MAGIC);
+	hdr.index_major = htobe32(CTF_INDEX_MAJOR);
+	hdr.index_minor = htobe32(CTF_INDEX_MINOR);
+	hdr.packet_index_len = htobe32(sizeof(struct ctf_packet_index));
+
+	ret = write_full(fd, &hdr, sizeof(hdr));
+	if (ret < 0) {
+		errno = -ret;
+		PERROR("write index file header");
+		goto error_close;
+	}
+
+	return fd;
+
+error_close:
+	if (close(fd)) {
+		PERROR("close index file");
+	}
+error:
+	return ret;
+}
+
+/*
+ * Open the index file of a stream tracefile read-only and check its header.
+ * The file is positioned on the first entry.
+ *
+ * Return the file descriptor, -ENOENT or -EAGAIN if the file or its header is
+ * not written yet, or another negative value on error.
+ */
+int index_open_file(const char *path_name, char *stream_name, uint64_t size,
+		uint64_t count)
+{
+	int ret, fd;
+	ssize_t read_len;
+	char path[PATH_MAX], dir[PATH_MAX];
+	struct ctf_packet_index_file_hdr hdr;
+
+	assert(path_name);
+	assert(stream_name);
+
+	ret = snprintf(dir, sizeof(dir), "%s/" CTF_INDEX_DIR, path_name);
+	if (ret < 0 || ret >= sizeof(dir)) {
+		ERR("Index directory path too long for %s", path_name);
+		ret = -1;
+		goto error;
+	}
+
+	ret = index_file_path(path, sizeof(path), dir, stream_name, size, count);
+	if (ret < 0) {
+		goto error;
+	}
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		ret = -errno;
+		if (errno != ENOENT) {
+			PERROR("open index file %s", path);
+		}
+		goto error;
+	}
+
+	do {
+		read_len = read(fd, &hdr, sizeof(hdr));
+	} while (read_len < 0 && errno == EINTR);
+	if (read_len < 0) {
+		PERROR("read header of index file %s", path);
+		ret = -1;
+		goto error_close;
+	} else if (read_len < sizeof(hdr)) {
+		/* The writer is still writing the header. */
+		ret = -EAGAIN;
+		goto error_close;
+	}
+
+	if (be32toh(hdr.magic) != CTF_INDEX_MAGIC ||
+			be32toh(hdr.index_major) != CTF_INDEX_MAJOR ||
+			be32toh(hdr.packet_index_len) != sizeof(struct ctf_packet_index)) {
+		ERR("Invalid header of index file %s", path);
+		ret = -1;
+		goto error_close;
+	}
+
+	return fd;
+
+error_close:
+	if (close(fd)) {
+		PERROR("close index file");
+	}
+error:
+	return ret;
+}
+
+/*
+ * Append an entry to an index file.
+ *
+ * Return 0 on success or a negative errno value.
+ */
+int index_write(int fd, struct ctf_packet_index *index)
+{
+	assert(fd >= 0);
+	assert(index);
+
+	return write_full(fd, index, sizeof(*index));
+}
@@ -0,0 +1,39 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef LTTNG_INDEX_H
+#define LTTNG_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ctf-index.h"
+
+/*
+ * Size of the LTTng packet header and context needed to fill an index entry,
+ * up to the events discarded counter which is a long of the tracer.
+ */
+#define CTF_PACKET_HEADER_LEN(long_size)	(56 + (long_size))
+#define CTF_PACKET_HEADER_MAX_LEN		CTF_PACKET_HEADER_LEN(8)
+
+int index_packet_parse(const char *buf, size_t len, unsigned int long_size,
+		uint64_t offset, struct ctf_packet_index *index);
+int index_create_file(int dirfd, const char *path_name, char *stream_name,
+		uint64_t size, uint64_t count, int uid, int gid);
+int index_write(int fd, struct ctf_packet_index *index);
+int index_open_file(const char *path_name, char *stream_name, uint64_t size,
+		uint64_t count);
+
+#endif /* LTTNG_INDEX_H */
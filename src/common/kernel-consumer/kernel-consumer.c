@@ -37,6 +37,7 @@
 #include <common/pipe.h>
 #include <common/relayd/relayd.h>
 #include <common/utils.h>
+#include <common/consumer-timer.h>
 
 #include "kernel-consumer.h"
 
@@ -83,6 +84,326 @@ int lttng_kconsumer_get_produced_snapshot(struct lttng_consumer_stream *stream,
 	return ret;
 }
 
+/*
+ * Get the consumed position
+ *
+ * Returns 0 on success, < 0 on error
+ */
+int lttng_kconsumer_get_consumed_snapshot(struct lttng_consumer_stream *stream,
+		unsigned long *pos)
+{
+	int ret;
+	int infd = stream->wait_fd;
+
+	ret = kernctl_snapshot_get_consumed(infd, pos);
+	if (ret != 0) {
+		errno = -ret;
+		perror("kernctl_snapshot_get_consumed");
+	}
+
+	return ret;
+}
+
+/*
+ * Record the unconsumed sub-buffers of an unmonitored stream in its snapshot
+ * output, at most the last max_stream_size bytes of it. Tracing goes on
+ * meanwhile so sub-buffers overwritten during the copy are skipped. The
+ * stream lock MUST be held.
+ *
+ * Returns 0 on success, < 0 on error
+ */
+int lttng_kconsumer_snapshot_stream(struct lttng_consumer_stream *stream,
+		uint64_t max_stream_size, struct lttng_consumer_local_data *ctx)
+{
+	int ret;
+	ssize_t read_len;
+	unsigned long consumed_pos, produced_pos, max_sb_size, len, subbuf_size;
+	int infd = stream->wait_fd;
+
+	assert(stream);
+	assert(stream->mmap_base);
+
+	/* Make the sub-buffer being written readable. */
+	ret = kernctl_buffer_flush(infd);
+	if (ret < 0) {
+		ERR("Failed to flush kernel stream");
+		goto end;
+	}
+
+	ret = lttng_kconsumer_take_snapshot(stream);
+	if (ret < 0) {
+		goto end;
+	}
+
+	ret = lttng_kconsumer_get_produced_snapshot(stream, &produced_pos);
+	if (ret < 0) {
+		goto end;
+	}
+
+	ret = kernctl_snapshot_get_consumed(infd, &consumed_pos);
+	if (ret < 0) {
+		errno = -ret;
+		PERROR("kernctl_snapshot_get_consumed");
+		goto end;
+	}
+
+	ret = kernctl_get_max_subbuf_size(infd, &max_sb_size);
+	if (ret < 0) {
+		errno = -ret;
+		PERROR("kernctl_get_max_subbuf_size");
+		goto end;
+	}
+
+	consumed_pos = consumer_snapshot_first_pos(consumed_pos, produced_pos,
+			max_sb_size, max_stream_size);
+
+	while ((long) (produced_pos - consumed_pos) > 0) {
+		ret = kernctl_get_subbuf(infd, &consumed_pos);
+		if (ret < 0) {
+			if (ret != -EAGAIN) {
+				errno = -ret;
+				PERROR("kernctl_get_subbuf snapshot");
+				goto end;
+			}
+			DBG("Kernel snapshot skipping overwritten sub-buffer");
+			goto next;
+		}
+
+		ret = kernctl_get_subbuf_size(infd, &subbuf_size);
+		if (ret < 0) {
+			errno = -ret;
+			PERROR("kernctl_get_subbuf_size snapshot");
+			goto error_put_subbuf;
+		}
+
+		ret = kernctl_get_padded_subbuf_size(infd, &len);
+		if (ret < 0) {
+			errno = -ret;
+			PERROR("kernctl_get_padded_subbuf_size snapshot");
+			goto error_put_subbuf;
+		}
+
+		read_len = lttng_consumer_on_read_subbuffer_mmap(ctx, stream,
+				subbuf_size, len - subbuf_size);
+		if ((stream->net_seq_idx != (uint64_t) -1ULL &&
+					read_len != subbuf_size) ||
+				(stream->net_seq_idx == (uint64_t) -1ULL &&
+					read_len != len)) {
+			ERR("Error writing kernel snapshot (ret: %zd != len: %lu)",
+					read_len, len);
+			ret = -1;
+			goto error_put_subbuf;
+		}
+
+		ret = kernctl_put_subbuf(infd);
+		if (ret < 0) {
+			errno = -ret;
+			PERROR("kernctl_put_subbuf snapshot");
+			goto end;
+		}
+next:
+		consumed_pos += max_sb_size;
+	}
+
+	ret = 0;
+	goto end;
+
+error_put_subbuf:
+	if (kernctl_put_subbuf(infd) < 0) {
+		ERR("Kernel snapshot put subbuf failed");
+	}
+end:
+	return ret;
+}
+
+/*
+ * Record the metadata of the unmonitored metadata channel created by the
+ * session daemon for this snapshot, then destroy the channel. A new kernel
+ * metadata channel holds all the metadata of the session.
+ *
+ * Returns 0 on success, < 0 on error
+ */
+static int snapshot_metadata(uint64_t key, const char *path,
+		uint64_t relayd_id, struct lttng_consumer_local_data *ctx)
+{
+	int ret;
+	ssize_t ret_read;
+	struct lttng_consumer_channel *channel;
+	struct lttng_consumer_stream *stream;
+
+	DBG("Kernel consumer snapshot metadata of channel %" PRIu64, key);
+
+	channel = consumer_find_channel(key);
+	if (!channel) {
+		ret = -ENOENT;
+		goto end;
+	}
+	if (channel->monitor || channel->streams.count != 1) {
+		ERR("Kernel snapshot metadata channel %" PRIu64 " invalid", key);
+		ret = -EINVAL;
+		goto end;
+	}
+	stream = cds_list_entry(channel->streams.head.next,
+			struct lttng_consumer_stream, send_node);
+
+	pthread_mutex_lock(&stream->lock);
+	ret = consumer_snapshot_open_output(stream, path, relayd_id);
+	if (ret < 0) {
+		goto end_unlock;
+	}
+
+	do {
+		ret_read = lttng_kconsumer_read_subbuffer(stream, ctx);
+	} while (ret_read >= 0);
+	/* No more metadata is the normal ending. */
+	if (ret_read != -EAGAIN && ret_read != -ENODATA) {
+		ERR("Kernel snapshot reading metadata failed (%zd)", ret_read);
+		ret = -1;
+	}
+
+	consumer_snapshot_close_output(stream);
+end_unlock:
+	pthread_mutex_unlock(&stream->lock);
+
+	/* The channel was created for this snapshot only. */
+	if (!uatomic_sub_return(&channel->refcount, 1)) {
+		consumer_del_channel(channel);
+	}
+end:
+	return ret;
+}
+
+/*
+ * Create the consumer stream of a stream fd received from the session daemon
+ * for the given channel and hand it to the data or metadata thread. The fd
+ * belongs to the stream once allocated, which closes it on error.
+ *
+ * Returns 0 on success, < 0 on error
+ */
+static int add_stream(struct lttng_consumer_local_data *ctx,
+		struct lttng_consumer_channel *channel, int fd, int cpu)
+{
+	int ret = 0;
+	int alloc_ret = 0;
+	struct lttng_pipe *stream_pipe;
+	struct consumer_relayd_sock_pair *relayd = NULL;
+	struct lttng_consumer_stream *new_stream;
+
+	new_stream = consumer_allocate_stream(channel->key,
+			fd,
+			LTTNG_CONSUMER_ACTIVE_STREAM,
+			channel->name,
+			channel->uid,
+			channel->gid,
+			channel->relayd_id,
+			channel->session_id,
+			cpu,
+			&alloc_ret,
+			channel->type);
+	if (new_stream == NULL) {
+		switch (alloc_ret) {
+		case -ENOMEM:
+		case -EINVAL:
+		default:
+			lttng_consumer_send_error(ctx, LTTCOMM_CONSUMERD_OUTFD_ERROR);
+			break;
+		}
+		ret = alloc_ret;
+		goto end;
+	}
+	new_stream->chan = channel;
+	new_stream->wait_fd = fd;
+	/* The kernel channels hold the lttng_event_output value. */
+	new_stream->output = (enum lttng_event_output) channel->output;
+
+	if (!channel->monitor) {
+		/*
+		 * Kept in the channel for the snapshots, without output until
+		 * one is recorded.
+		 */
+		new_stream->net_seq_idx = (uint64_t) -1ULL;
+		ret = lttng_kconsumer_on_recv_stream(new_stream);
+		if (ret < 0) {
+			consumer_del_stream(new_stream, NULL);
+			goto end;
+		}
+		cds_list_add(&new_stream->send_node, &channel->streams.head);
+		channel->streams.count++;
+		DBG("Kernel consumer snapshot stream %s (fd: %d) added",
+				new_stream->name, fd);
+		goto end;
+	}
+
+	/*
+	 * We've just assigned the channel to the stream so increment the
+	 * refcount right now.
+	 */
+	uatomic_inc(&new_stream->chan->refcount);
+
+	/*
+	 * The buffer flush is done on the session daemon side for the kernel
+	 * so no need for the stream "hangup_flush_done" variable to be
+	 * tracked. This is important for a kernel stream since we don't rely
+	 * on the flush state of the stream to read data. It's not the case for
+	 * user space tracing.
+	 */
+	new_stream->hangup_flush_done = 0;
+
+	/* The stream is not metadata. Get relayd reference if exists. */
+	relayd = consumer_find_relayd(new_stream->net_seq_idx);
+	if (relayd != NULL) {
+		/* Add stream on the relayd */
+		pthread_mutex_lock(&relayd->ctrl_sock_mutex);
+		ret = relayd_add_stream(&relayd->control_sock,
+				new_stream->name, new_stream->chan->pathname,
+				&new_stream->relayd_stream_id,
+				new_stream->chan->tracefile_size,
+				new_stream->chan->tracefile_count,
+				consumer_stream_relayd_compression(new_stream));
+		pthread_mutex_unlock(&relayd->ctrl_sock_mutex);
+		if (ret < 0) {
+			consumer_del_stream(new_stream, NULL);
+			goto end;
+		}
+	} else if (new_stream->net_seq_idx != (uint64_t) -1ULL) {
+		ERR("Network sequence index %" PRIu64 " unknown. Not adding stream.",
+				new_stream->net_seq_idx);
+		consumer_del_stream(new_stream, NULL);
+		goto end;
+	}
+
+	if (ctx->on_recv_stream) {
+		ret = ctx->on_recv_stream(new_stream);
+		if (ret < 0) {
+			consumer_del_stream(new_stream, NULL);
+			goto end;
+		}
+	}
+
+	/* Get the right pipe where the stream will be sent. */
+	if (new_stream->metadata_flag) {
+		stream_pipe = ctx->consumer_metadata_pipe;
+	} else {
+		stream_pipe = consumer_data_stream_pipe(ctx, new_stream);
+	}
+
+	ret = lttng_pipe_write(stream_pipe, &new_stream, sizeof(new_stream));
+	if (ret < 0) {
+		ERR("Consumer write %s stream to pipe %d",
+				new_stream->metadata_flag ? "metadata" : "data",
+				lttng_pipe_get_writefd(stream_pipe));
+		consumer_del_stream(new_stream, NULL);
+		goto end;
+	}
+
+	DBG("Kernel consumer added stream %s (fd: %d) with relayd id %" PRIu64,
+			new_stream->name, fd, new_stream->relayd_stream_id);
+	ret = 0;
+
+end:
+	return ret;
+}
+
 int lttng_kconsumer_recv_cmd(struct lttng_consumer_local_data *ctx,
 		int sock, struct pollfd *consumer_sockpoll)
 {
@@ -136,12 +457,19 @@ int lttng_kconsumer_recv_cmd(struct lttng_consumer_local_data *ctx,
 				msg.u.channel.name, msg.u.channel.uid, msg.u.channel.gid,
 				msg.u.channel.relayd_id, msg.u.channel.output,
 				msg.u.channel.tracefile_size,
-				msg.u.channel.tracefile_count);
+				msg.u.channel.tracefile_count,
+				(enum lttng_compression) msg.u.channel.compression,
+				msg.u.channel.live_timer_interval);
 		if (new_channel == NULL) {
 			lttng_consumer_send_error(ctx, LTTCOMM_CONSUMERD_OUTFD_ERROR);
 			goto end_nosignal;
 		}
 		new_channel->nb_init_stream_left = msg.u.channel.nb_init_streams;
+		new_channel->monitor = msg.u.channel.monitor;
+		if (!new_channel->monitor) {
+			/* Reference of the session daemon until DESTROY_CHANNEL. */
+			new_channel->refcount = 1;
+		}
 
 		/* Translate and save channel type. */
 		switch (msg.u.channel.type) {
@@ -171,16 +499,18 @@ int lttng_kconsumer_recv_cmd(struct lttng_consumer_local_data *ctx,
 			goto end_nosignal;
 		}
 
+		if (new_channel->type == CONSUMER_CHANNEL_TYPE_DATA &&
+				new_channel->monitor && new_channel->relayd_id != -1) {
+			consumer_timer_live_start(new_channel,
+					new_channel->live_timer_interval);
+		}
+
 		goto end_nosignal;
 	}
 	case LTTNG_CONSUMER_ADD_STREAM:
 	{
 		int fd;
-		struct lttng_pipe *stream_pipe;
-		struct consumer_relayd_sock_pair *relayd = NULL;
-		struct lttng_consumer_stream *new_stream;
 		struct lttng_consumer_channel *channel;
-		int alloc_ret = 0;
 
 		/*
 		 * Get stream's channel reference. Needed when adding the stream to the
@@ -231,93 +561,67 @@ int lttng_kconsumer_recv_cmd(struct lttng_consumer_local_data *ctx,
 			goto end_nosignal;
 		}
 
-		new_stream = consumer_allocate_stream(channel->key,
-				fd,
-				LTTNG_CONSUMER_ACTIVE_STREAM,
-				channel->name,
-				channel->uid,
-				channel->gid,
-				channel->relayd_id,
-				channel->session_id,
-				msg.u.stream.cpu,
-				&alloc_ret,
-				channel->type);
-		if (new_stream == NULL) {
-			switch (alloc_ret) {
-			case -ENOMEM:
-			case -EINVAL:
-			default:
-				lttng_consumer_send_error(ctx, LTTCOMM_CONSUMERD_OUTFD_ERROR);
-				break;
+		(void) add_stream(ctx, channel, fd, msg.u.stream.cpu);
+		break;
+	}
+	case LTTNG_CONSUMER_ADD_STREAMS:
+	{
+		int i, nb_streams;
+		int fds[LTTCOMM_MAX_SEND_FDS];
+		struct lttng_consumer_channel *channel = NULL;
+
+		nb_streams = lttcomm_consumer_msg_nb_streams(&msg);
+		if (nb_streams < 0) {
+			ERR("Invalid number of streams %" PRIu32 " in batch",
+					msg.u.streams.nb_streams);
+			ret_code = LTTNG_ERR_INVALID;
+		} else {
+			channel = consumer_find_channel(msg.u.streams.channel_key);
+			if (!channel) {
+				/* Same as ADD_STREAM, cpu hotplug during a teardown. */
+				ERR("Unable to find channel key %" PRIu64,
+						msg.u.streams.channel_key);
+				ret_code = LTTNG_ERR_KERN_CHAN_NOT_FOUND;
 			}
-			goto end_nosignal;
 		}
-		new_stream->chan = channel;
-		new_stream->wait_fd = fd;
 
-		/*
-		 * We've just assigned the channel to the stream so increment the
-		 * refcount right now.
-		 */
-		uatomic_inc(&new_stream->chan->refcount);
-
-		/*
-		 * The buffer flush is done on the session daemon side for the kernel
-		 * so no need for the stream "hangup_flush_done" variable to be
-		 * tracked. This is important for a kernel stream since we don't rely
-		 * on the flush state of the stream to read data. It's not the case for
-		 * user space tracing.
-		 */
-		new_stream->hangup_flush_done = 0;
-
-		/* The stream is not metadata. Get relayd reference if exists. */
-		relayd = consumer_find_relayd(new_stream->net_seq_idx);
-		if (relayd != NULL) {
-			/* Add stream on the relayd */
-			pthread_mutex_lock(&relayd->ctrl_sock_mutex);
-			ret = relayd_add_stream(&relayd->control_sock,
-					new_stream->name, new_stream->chan->pathname,
-					&new_stream->relayd_stream_id,
-					new_stream->chan->tracefile_size,
-					new_stream->chan->tracefile_count);
-			pthread_mutex_unlock(&relayd->ctrl_sock_mutex);
-			if (ret < 0) {
-				consumer_del_stream(new_stream, NULL);
-				goto end_nosignal;
-			}
-		} else if (new_stream->net_seq_idx != (uint64_t) -1ULL) {
-			ERR("Network sequence index %" PRIu64 " unknown. Not adding stream.",
-					new_stream->net_seq_idx);
-			consumer_del_stream(new_stream, NULL);
+		/* First send a status message before receiving the fds. */
+		ret = consumer_send_status_msg(sock, ret_code);
+		if (ret < 0 || ret_code != LTTNG_OK) {
 			goto end_nosignal;
 		}
 
-		if (ctx->on_recv_stream) {
-			ret = ctx->on_recv_stream(new_stream);
-			if (ret < 0) {
-				consumer_del_stream(new_stream, NULL);
-				goto end_nosignal;
-			}
+		/* block */
+		if (lttng_consumer_poll_socket(consumer_sockpoll) < 0) {
+			rcu_read_unlock();
+			return -EINTR;
 		}
 
-		/* Get the right pipe where the stream will be sent. */
-		if (new_stream->metadata_flag) {
-			stream_pipe = ctx->consumer_metadata_pipe;
-		} else {
-			stream_pipe = ctx->consumer_data_pipe;
+		/* All the stream fds of the batch come in one message. */
+		ret = lttcomm_recv_fds_unix_sock(sock, fds, nb_streams);
+		if (ret != sizeof(int) * nb_streams) {
+			lttng_consumer_send_error(ctx, LTTCOMM_CONSUMERD_ERROR_RECV_FD);
+			rcu_read_unlock();
+			return ret;
 		}
 
-		ret = lttng_pipe_write(stream_pipe, &new_stream, sizeof(new_stream));
+		/* One status for the whole batch, as for a single stream. */
+		ret = consumer_send_status_msg(sock, ret_code);
 		if (ret < 0) {
-			ERR("Consumer write %s stream to pipe %d",
-					new_stream->metadata_flag ? "metadata" : "data",
-					lttng_pipe_get_writefd(stream_pipe));
-			consumer_del_stream(new_stream, NULL);
+			for (i = 0; i < nb_streams; i++) {
+				if (close(fds[i])) {
+					PERROR("close stream fd");
+				}
+			}
 			goto end_nosignal;
 		}
 
-		DBG("Kernel consumer ADD_STREAM %s (fd: %d) with relayd id %" PRIu64,
-				new_stream->name, fd, new_stream->relayd_stream_id);
+		for (i = 0; i < nb_streams; i++) {
+			(void) add_stream(ctx, channel, fds[i], msg.u.streams.cpus[i]);
+		}
+
+		DBG("Kernel consumer ADD_STREAMS %d streams of channel %" PRIu64,
+				nb_streams, channel->key);
 		break;
 	}
 	case LTTNG_CONSUMER_UPDATE_STREAM:
@@ -361,6 +665,60 @@ int lttng_kconsumer_recv_cmd(struct lttng_consumer_local_data *ctx,
 
 		goto end_nosignal;
 	}
+	case LTTNG_CONSUMER_SNAPSHOT_CHANNEL:
+	{
+		if (msg.u.snapshot_channel.metadata) {
+			ret = snapshot_metadata(msg.u.snapshot_channel.key,
+					msg.u.snapshot_channel.pathname,
+					msg.u.snapshot_channel.relayd_id, ctx);
+		} else {
+			ret = lttng_consumer_snapshot_channel(msg.u.snapshot_channel.key,
+					msg.u.snapshot_channel.pathname,
+					msg.u.snapshot_channel.relayd_id,
+					msg.u.snapshot_channel.max_stream_size, ctx);
+		}
+		if (ret == -ENOENT) {
+			ERR("Snapshot channel %" PRIu64 " not found",
+					msg.u.snapshot_channel.key);
+			ret_code = LTTNG_ERR_KERN_CHAN_NOT_FOUND;
+		} else if (ret < 0) {
+			ret_code = LTTNG_ERR_SNAPSHOT_FAIL;
+		}
+
+		ret = consumer_send_status_msg(sock, ret_code);
+		if (ret < 0) {
+			/* Somehow, the session daemon is not responding anymore. */
+			goto end_nosignal;
+		}
+		break;
+	}
+	case LTTNG_CONSUMER_DESTROY_CHANNEL:
+	{
+		struct lttng_consumer_channel *channel;
+		uint64_t key = msg.u.destroy_channel.key;
+
+		/*
+		 * Only the unmonitored channels of snapshot sessions are destroyed
+		 * by the session daemon, the others go away with their streams.
+		 */
+		channel = consumer_find_channel(key);
+		if (!channel) {
+			ERR("Kernel consumer destroy channel %" PRIu64 " not found", key);
+			ret_code = LTTNG_ERR_KERN_CHAN_NOT_FOUND;
+		} else if (!channel->monitor) {
+			DBG("Kernel consumer destroy channel %" PRIu64, key);
+			if (!uatomic_sub_return(&channel->refcount, 1)) {
+				consumer_del_channel(channel);
+			}
+		}
+
+		ret = consumer_send_status_msg(sock, ret_code);
+		if (ret < 0) {
+			/* Somehow, the session daemon is not responding anymore. */
+			goto end_nosignal;
+		}
+		break;
+	}
 	case LTTNG_CONSUMER_DATA_PENDING:
 	{
 		int32_t ret;
@@ -522,9 +880,21 @@ int lttng_kconsumer_on_recv_stream(struct lttng_consumer_stream *stream)
 
 	assert(stream);
 
-	/* Don't create anything if this is set for streaming. */
-	if (stream->net_seq_idx == (uint64_t) -1ULL) {
-		ret = utils_create_stream_file(stream->chan->pathname, stream->name,
+	/* Used to weight this stream's backlog in the data thread scheduling. */
+	ret = kernctl_get_max_subbuf_size(stream->wait_fd, &stream->max_sb_size);
+	if (ret < 0) {
+		errno = -ret;
+		PERROR("kernctl_get_max_subbuf_size");
+		goto error;
+	}
+
+	/*
+	 * Don't create anything if this is set for streaming or kept for the
+	 * snapshots.
+	 */
+	if (stream->net_seq_idx == (uint64_t) -1ULL && stream->chan->monitor) {
+		ret = utils_create_stream_file(consumer_channel_get_dirfd(stream->chan),
+				stream->chan->pathname, stream->name,
 				stream->chan->tracefile_size, stream->tracefile_count_current,
 				stream->uid, stream->gid);
 		if (ret < 0) {
@@ -532,6 +902,9 @@ int lttng_kconsumer_on_recv_stream(struct lttng_consumer_stream *stream)
 		}
 		stream->out_fd = ret;
 		stream->tracefile_size_current = 0;
+
+		/* A stream without index is still traced. */
+		(void) consumer_stream_create_index(stream);
 	}
 
 	if (stream->output == LTTNG_EVENT_MMAP) {
@@ -555,6 +928,10 @@ int lttng_kconsumer_on_recv_stream(struct lttng_consumer_stream *stream)
 		}
 	}
 
+	if (stream->out_fd >= 0) {
+		consumer_stream_cache_out_fd(stream);
+	}
+
 	/* we return 0 to let the library handle the FD internally */
 	return 0;
 
@@ -562,8 +939,16 @@ error_close_fd:
 	{
 		int err;
 
-		err = close(stream->out_fd);
-		assert(!err);
+		if (stream->out_fd >= 0) {
+			err = close(stream->out_fd);
+			assert(!err);
+			stream->out_fd = -1;
+		}
+		if (stream->index_fd >= 0) {
+			err = close(stream->index_fd);
+			assert(!err);
+			stream->index_fd = -1;
+		}
 	}
 error:
 	return ret;
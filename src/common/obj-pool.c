@@ -0,0 +1,276 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <common/common.h>
+
+#include "obj-pool.h"
+
+/*
+ * Header of an object linking it in the pool lists. It is kept out of the
+ * object since RCU readers can still be reading a retired object.
+ */
+union obj_header {
+	struct cds_list_head node;
+	/* Alignment of the object following the header. */
+	uint64_t align;
+	void *ptr;
+};
+
+static void grace_period_done(struct rcu_head *head);
+
+/*
+ * Start a grace period for the objects retired so far.
+ *
+ * The pool lock MUST be held and no grace period be in flight.
+ */
+static void start_grace_period(struct lttng_obj_pool *pool)
+{
+	cds_list_splice(&pool->retired, &pool->grace);
+	CDS_INIT_LIST_HEAD(&pool->retired);
+	pool->grace_pending = 1;
+	call_rcu(&pool->rcu_head, grace_period_done);
+}
+
+/*
+ * Keep the released objects of a list for reuse, up to the maximum of the
+ * pool, and free the others. The objects are removed from the stats of the
+ * list they were on by the caller.
+ */
+static void recycle_list(struct lttng_obj_pool *pool, struct cds_list_head *list)
+{
+	union obj_header *hdr, *tmp;
+	struct cds_list_head overflow;
+
+	CDS_INIT_LIST_HEAD(&overflow);
+
+	pthread_mutex_lock(&pool->lock);
+	cds_list_for_each_entry_safe(hdr, tmp, list, node) {
+		cds_list_del(&hdr->node);
+		if (pool->stats.nr_free < pool->max_free) {
+			cds_list_add(&hdr->node, &pool->free_list);
+			pool->stats.nr_free++;
+		} else {
+			cds_list_add(&hdr->node, &overflow);
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	cds_list_for_each_entry_safe(hdr, tmp, &overflow, node) {
+		free(hdr);
+	}
+}
+
+/*
+ * RCU callback recycling the objects retired before the grace period
+ * started, and starting the next one for those retired since.
+ */
+static void grace_period_done(struct rcu_head *head)
+{
+	struct lttng_obj_pool *pool =
+		caa_container_of(head, struct lttng_obj_pool, rcu_head);
+	union obj_header *hdr;
+	struct cds_list_head done;
+	unsigned long nr_done = 0;
+
+	CDS_INIT_LIST_HEAD(&done);
+
+	pthread_mutex_lock(&pool->lock);
+	cds_list_splice(&pool->grace, &done);
+	CDS_INIT_LIST_HEAD(&pool->grace);
+	pool->grace_pending = 0;
+	if (!cds_list_empty(&pool->retired)) {
+		start_grace_period(pool);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	cds_list_for_each_entry(hdr, &done, node) {
+		if (pool->release) {
+			pool->release(hdr + 1);
+		}
+		nr_done++;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stats.nr_retired -= nr_done;
+	pthread_mutex_unlock(&pool->lock);
+
+	recycle_list(pool, &done);
+}
+
+/*
+ * Initialize a pool of objects of the given size keeping at most max_free
+ * freed objects for reuse. The release callback, if any, is called on an
+ * object once freed and no more read, to drop what it references.
+ *
+ * The pool MUST outlive the grace periods of its objects, so it is usually
+ * static.
+ */
+LTTNG_HIDDEN
+void lttng_obj_pool_init(struct lttng_obj_pool *pool, const char *name,
+		size_t size, unsigned int max_free, void (*release)(void *obj))
+{
+	assert(pool);
+	assert(name);
+	assert(size);
+
+	memset(pool, 0, sizeof(*pool));
+	pool->name = name;
+	pool->size = size;
+	pool->max_free = max_free;
+	pool->release = release;
+	pthread_mutex_init(&pool->lock, NULL);
+	CDS_INIT_LIST_HEAD(&pool->free_list);
+	CDS_INIT_LIST_HEAD(&pool->retired);
+	CDS_INIT_LIST_HEAD(&pool->grace);
+	pool->stats.obj_size = sizeof(union obj_header) + size;
+}
+
+/*
+ * Return a zeroed object, recycled if one is free, or NULL on ENOMEM.
+ */
+LTTNG_HIDDEN
+void *lttng_obj_pool_zalloc(struct lttng_obj_pool *pool)
+{
+	union obj_header *hdr = NULL;
+
+	assert(pool);
+
+	pthread_mutex_lock(&pool->lock);
+	if (!cds_list_empty(&pool->free_list)) {
+		hdr = cds_list_entry(pool->free_list.next, union obj_header, node);
+		cds_list_del(&hdr->node);
+		pool->stats.nr_free--;
+		pool->stats.reuses++;
+	}
+	pool->stats.allocs++;
+	pool->stats.nr_used++;
+	if (pool->stats.nr_used > pool->stats.max_used) {
+		pool->stats.max_used = pool->stats.nr_used;
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	if (!hdr) {
+		hdr = malloc(sizeof(*hdr) + pool->size);
+		if (!hdr) {
+			PERROR("malloc %s pool object", pool->name);
+			pthread_mutex_lock(&pool->lock);
+			pool->stats.allocs--;
+			pool->stats.nr_used--;
+			pthread_mutex_unlock(&pool->lock);
+			return NULL;
+		}
+	}
+	memset(hdr + 1, 0, pool->size);
+
+	return hdr + 1;
+}
+
+/*
+ * Free an object no one else can be reading, it is reusable right away.
+ */
+LTTNG_HIDDEN
+void lttng_obj_pool_free(struct lttng_obj_pool *pool, void *obj)
+{
+	union obj_header *hdr;
+	struct cds_list_head list;
+
+	assert(pool);
+
+	if (!obj) {
+		return;
+	}
+	hdr = (union obj_header *) obj - 1;
+
+	if (pool->release) {
+		pool->release(obj);
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stats.nr_used--;
+	pthread_mutex_unlock(&pool->lock);
+
+	CDS_INIT_LIST_HEAD(&list);
+	cds_list_add(&hdr->node, &list);
+	recycle_list(pool, &list);
+}
+
+/*
+ * Free an object RCU readers can still be reading. It is released and reused
+ * after a grace period, shared with all the objects of the pool freed in the
+ * meantime.
+ */
+LTTNG_HIDDEN
+void lttng_obj_pool_free_rcu(struct lttng_obj_pool *pool, void *obj)
+{
+	union obj_header *hdr;
+
+	assert(pool);
+
+	if (!obj) {
+		return;
+	}
+	hdr = (union obj_header *) obj - 1;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stats.nr_used--;
+	pool->stats.nr_retired++;
+	cds_list_add_tail(&hdr->node, &pool->retired);
+	if (!pool->grace_pending) {
+		start_grace_period(pool);
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/*
+ * Free the objects kept for reuse. The objects still waiting for a grace
+ * period are freed once it ends, the pool keeping no more free objects.
+ */
+LTTNG_HIDDEN
+void lttng_obj_pool_destroy(struct lttng_obj_pool *pool)
+{
+	union obj_header *hdr, *tmp;
+
+	assert(pool);
+
+	pthread_mutex_lock(&pool->lock);
+	pool->max_free = 0;
+	cds_list_for_each_entry_safe(hdr, tmp, &pool->free_list, node) {
+		cds_list_del(&hdr->node);
+		free(hdr);
+	}
+	pool->stats.nr_free = 0;
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/*
+ * Copy the counters of the pool.
+ */
+LTTNG_HIDDEN
+void lttng_obj_pool_get_stats(struct lttng_obj_pool *pool,
+		struct lttng_obj_pool_stats *stats)
+{
+	assert(pool);
+	assert(stats);
+
+	pthread_mutex_lock(&pool->lock);
+	*stats = pool->stats;
+	pthread_mutex_unlock(&pool->lock);
+}
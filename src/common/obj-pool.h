@@ -0,0 +1,72 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef LTTNG_OBJ_POOL_H
+#define LTTNG_OBJ_POOL_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <urcu.h>
+#include <urcu/list.h>
+
+struct lttng_obj_pool_stats {
+	/* Objects handed out, and how many of them were recycled. */
+	uint64_t allocs;
+	uint64_t reuses;
+	/* Objects in use, at most at once, and kept free for reuse. */
+	unsigned long nr_used;
+	unsigned long max_used;
+	unsigned long nr_free;
+	/* Objects freed waiting for a grace period before reuse. */
+	unsigned long nr_retired;
+	/* Size of an object including the pool header. */
+	size_t obj_size;
+};
+
+/*
+ * Cache of same size objects. The freed objects are kept for the next
+ * allocations, up to max_free of them, instead of going back to malloc. The
+ * objects read by RCU readers are recycled once a grace period elapsed, with
+ * a single call_rcu for all the objects freed in the meantime.
+ */
+struct lttng_obj_pool {
+	const char *name;
+	size_t size;
+	unsigned int max_free;
+	/* Called on an object before it is recycled or freed. Can be NULL. */
+	void (*release)(void *obj);
+	pthread_mutex_t lock;
+	struct cds_list_head free_list;
+	/* Freed since the grace period in flight started. */
+	struct cds_list_head retired;
+	/* Freed before the grace period in flight started. */
+	struct cds_list_head grace;
+	int grace_pending;
+	struct rcu_head rcu_head;
+	struct lttng_obj_pool_stats stats;
+};
+
+void lttng_obj_pool_init(struct lttng_obj_pool *pool, const char *name,
+		size_t size, unsigned int max_free, void (*release)(void *obj));
+void *lttng_obj_pool_zalloc(struct lttng_obj_pool *pool);
+void lttng_obj_pool_free(struct lttng_obj_pool *pool, void *obj);
+void lttng_obj_pool_free_rcu(struct lttng_obj_pool *pool, void *obj);
+void lttng_obj_pool_destroy(struct lttng_obj_pool *pool);
+void lttng_obj_pool_get_stats(struct lttng_obj_pool *pool,
+		struct lttng_obj_pool_stats *stats);
+
+#endif /* LTTNG_OBJ_POOL_H */
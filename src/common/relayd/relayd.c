@@ -165,16 +165,20 @@ error:
 
 /*
  * Add stream on the relayd and assign stream handle to the stream_id argument.
+ * The relayd compresses the packets of the stream with the given algorithm,
+ * which is ignored by the protocols before 2.3.
  *
  * On success return 0 else return ret_code negative value.
  */
 int relayd_add_stream(struct lttcomm_relayd_sock *rsock, const char *channel_name,
 		const char *pathname, uint64_t *stream_id,
-		uint64_t tracefile_size, uint64_t tracefile_count)
+		uint64_t tracefile_size, uint64_t tracefile_count,
+		enum lttng_compression compression)
 {
 	int ret;
 	struct lttcomm_relayd_add_stream msg;
 	struct lttcomm_relayd_add_stream_2_2 msg_2_2;
+	struct lttcomm_relayd_add_stream_2_3 msg_2_3;
 	struct lttcomm_relayd_status_stream reply;
 
 	/* Code flow error. Safety net. */
@@ -194,8 +198,8 @@ int relayd_add_stream(struct lttcomm_relayd_sock *rsock, const char *channel_nam
 		if (ret < 0) {
 			goto error;
 		}
-	} else {
-		/* Compat with relayd 2.2+ */
+	} else if (rsock->minor == 2) {
+		/* Compat with relayd 2.2 */
 		strncpy(msg_2_2.channel_name, channel_name, sizeof(msg_2_2.channel_name));
 		strncpy(msg_2_2.pathname, pathname, sizeof(msg_2_2.pathname));
 		msg_2_2.tracefile_size = htobe64(tracefile_size);
@@ -206,6 +210,19 @@ int relayd_add_stream(struct lttcomm_relayd_sock *rsock, const char *channel_nam
 		if (ret < 0) {
 			goto error;
 		}
+	} else {
+		/* Compat with relayd 2.3+ */
+		strncpy(msg_2_3.channel_name, channel_name, sizeof(msg_2_3.channel_name));
+		strncpy(msg_2_3.pathname, pathname, sizeof(msg_2_3.pathname));
+		msg_2_3.tracefile_size = htobe64(tracefile_size);
+		msg_2_3.tracefile_count = htobe64(tracefile_count);
+		msg_2_3.compression = htobe32(compression);
+
+		/* Send command */
+		ret = send_command(rsock, RELAYD_ADD_STREAM, (void *) &msg_2_3, sizeof(msg_2_3), 0);
+		if (ret < 0) {
+			goto error;
+		}
 	}
 
 	/* Waiting for reply */
@@ -28,7 +28,8 @@ int relayd_close(struct lttcomm_relayd_sock *sock);
 int relayd_create_session(struct lttcomm_relayd_sock *sock, uint64_t *session_id);
 int relayd_add_stream(struct lttcomm_relayd_sock *sock, const char *channel_name,
 		const char *pathname, uint64_t *stream_id,
-		uint64_t tracefile_size, uint64_t tracefile_count);
+		uint64_t tracefile_size, uint64_t tracefile_count,
+		enum lttng_compression compression);
 int relayd_send_close_stream(struct lttcomm_relayd_sock *sock, uint64_t stream_id,
 		uint64_t last_net_seq_num);
 int relayd_version_check(struct lttcomm_relayd_sock *sock);
@@ -17,323 +17,801 @@
  */
 
 #define _GNU_SOURCE
+#include <assert.h>
 #include <errno.h>
 #include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
 #include <sys/wait.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
-#include <sched.h>
-#include <sys/signal.h>
+#include <urcu/list.h>
 
 #include <common/common.h>
 #include <common/utils.h>
-#include <common/compat/mman.h>
-#include <common/compat/clone.h>
 
 #include "runas.h"
 
-#define RUNAS_CHILD_STACK_SIZE	10485760
+/*
+ * Maximum number of operations per request sent to a worker. Every file
+ * descriptor opened by a batch is passed back in a single message so this
+ * must stay below the SCM_RIGHTS limit of the kernel (SCM_MAX_FD).
+ */
+#define RUN_AS_MAX_BATCH	64
 
-#ifndef MAP_STACK
-#define MAP_STACK		0
-#endif
+/* Descriptors closed by a new worker if the limit is unknown. */
+#define RUN_AS_WORKER_MAX_FD	1024
 
-#ifdef __FreeBSD__
-/* FreeBSD MAP_STACK always return -ENOMEM */
-#define LTTNG_MAP_STACK		0
-#else
-#define LTTNG_MAP_STACK		MAP_STACK
-#endif
+enum run_as_cmd {
+	RUN_AS_MKDIR			= 0,
+	RUN_AS_MKDIR_RECURSIVE		= 1,
+	RUN_AS_OPEN			= 2,
+};
 
-#ifndef MAP_GROWSDOWN
-#define MAP_GROWSDOWN		0
-#endif
+/*
+ * Request sent to a worker, followed by count paths each prefixed by its
+ * length including the terminating NULL byte.
+ */
+struct run_as_worker_msg {
+	uint32_t cmd;
+	uint32_t count;
+	int32_t flags;
+	uint32_t mode;
+} LTTNG_PACKED;
 
-#ifndef MAP_ANONYMOUS
-#define MAP_ANONYMOUS		MAP_ANON
-#endif
+/*
+ * Reply of a worker for each operation of a request. For an open, the file
+ * descriptors of the successful operations are passed along in order.
+ */
+struct run_as_worker_ret {
+	int32_t ret;
+	int32_t _errno;
+} LTTNG_PACKED;
 
-struct run_as_data {
-	int (*cmd)(void *data);
-	void *data;
+/*
+ * Long-lived process running the file operations of a uid/gid pair. It is
+ * forked on first use and exits when its socket is closed.
+ */
+struct run_as_worker {
 	uid_t uid;
 	gid_t gid;
-	int retval_pipe;
+	pid_t pid;
+	/* Socket connected to the worker, -1 if the worker is dead. */
+	int sock;
+	/*
+	 * Serialize the requests sent to this worker, and protects its pid and
+	 * sock which change when it is respawned or killed.
+	 */
+	pthread_mutex_t lock;
+	struct cds_list_head node;
 };
 
-struct run_as_mkdir_data {
-	const char *path;
-	mode_t mode;
-};
+/* Protects the worker list. Workers are never removed from it. */
+static pthread_mutex_t run_as_workers_lock = PTHREAD_MUTEX_INITIALIZER;
+static CDS_LIST_HEAD(run_as_workers);
 
-struct run_as_open_data {
-	const char *path;
-	int flags;
-	mode_t mode;
-};
+/*
+ * Run a single operation in the current process context. An open is done
+ * relative to dirfd if it is valid.
+ */
+static
+int run_as_cmd_exec(enum run_as_cmd cmd, int dirfd, const char *path,
+		int flags, mode_t mode)
+{
+	switch (cmd) {
+	case RUN_AS_MKDIR:
+		return mkdir(path, mode);
+	case RUN_AS_MKDIR_RECURSIVE:
+		return utils_mkdir_recursive(path, mode);
+	case RUN_AS_OPEN:
+		if (dirfd >= 0) {
+			return openat(dirfd, path, flags, mode);
+		}
+		return open(path, flags, mode);
+	default:
+		errno = EINVAL;
+		return -1;
+	}
+}
 
 /*
- * Create recursively directory using the FULL path.
+ * Send exactly len bytes. Return 0 on success else -1 with errno set.
  */
 static
-int _mkdir_recursive(void *_data)
+int run_as_send(int sock, const void *buf, size_t len)
 {
-	struct run_as_mkdir_data *data = _data;
-	const char *path;
-	mode_t mode;
+	ssize_t ret;
+	size_t done = 0;
 
-	path = data->path;
-	mode = data->mode;
+	while (done < len) {
+		ret = send(sock, (const char *) buf + done, len - done,
+				MSG_NOSIGNAL);
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		done += ret;
+	}
 
-	return utils_mkdir_recursive(path, mode);
+	return 0;
 }
 
+/*
+ * Receive exactly len bytes. Return 0 on success else -1 with errno set,
+ * EPIPE if the peer is gone.
+ */
 static
-int _mkdir(void *_data)
+int run_as_recv(int sock, void *buf, size_t len)
 {
-	struct run_as_mkdir_data *data = _data;
-	return mkdir(data->path, data->mode);
+	ssize_t ret;
+	size_t done = 0;
+
+	while (done < len) {
+		ret = recv(sock, (char *) buf + done, len - done, 0);
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		if (ret == 0) {
+			errno = EPIPE;
+			return -1;
+		}
+		done += ret;
+	}
+
+	return 0;
 }
 
+/*
+ * Send len bytes along with nb_fd file descriptors passed with SCM_RIGHTS.
+ *
+ * Return 0 on success else -1 with errno set.
+ */
 static
-int _open(void *_data)
+int run_as_send_fds(int sock, const void *buf, size_t len, const int *fds,
+		unsigned int nb_fd)
 {
-	struct run_as_open_data *data = _data;
-	return open(data->path, data->flags, data->mode);
+	ssize_t ret;
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	char cmsg_buf[CMSG_SPACE(sizeof(int) * RUN_AS_MAX_BATCH)];
+
+	assert(nb_fd <= RUN_AS_MAX_BATCH);
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = (void *) buf;
+	iov.iov_len = len;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+
+	if (nb_fd > 0) {
+		memset(cmsg_buf, 0, sizeof(cmsg_buf));
+		msg.msg_control = cmsg_buf;
+		msg.msg_controllen = CMSG_SPACE(sizeof(int) * nb_fd);
+		cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int) * nb_fd);
+		memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * nb_fd);
+	}
+
+	do {
+		ret = sendmsg(sock, &msg, MSG_NOSIGNAL);
+	} while (ret < 0 && errno == EINTR);
+	if (ret < 0) {
+		return -1;
+	}
+
+	/* The rest of the message, if any, is regular data. */
+	if ((size_t) ret < len) {
+		return run_as_send(sock, (const char *) buf + ret, len - ret);
+	}
+	return 0;
 }
 
+/*
+ * Receive len bytes along with at most max_fd file descriptors passed with
+ * SCM_RIGHTS, nb_fd being set to their number.
+ *
+ * Return 0 on success else -1 with errno set, EPIPE if the peer is gone.
+ */
 static
-int child_run_as(void *_data)
+int run_as_recv_fds(int sock, void *buf, size_t len, int *fds,
+		unsigned int max_fd, unsigned int *nb_fd)
+{
+	ssize_t ret;
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	char cmsg_buf[CMSG_SPACE(sizeof(int) * RUN_AS_MAX_BATCH)];
+
+	assert(max_fd <= RUN_AS_MAX_BATCH);
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = buf;
+	iov.iov_len = len;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cmsg_buf;
+	msg.msg_controllen = CMSG_SPACE(sizeof(int) * max_fd);
+
+	*nb_fd = 0;
+
+	do {
+		ret = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+	} while (ret < 0 && errno == EINTR);
+	if (ret <= 0) {
+		if (ret == 0) {
+			errno = EPIPE;
+		}
+		return -1;
+	}
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET &&
+				cmsg->cmsg_type == SCM_RIGHTS) {
+			*nb_fd = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * *nb_fd);
+			break;
+		}
+	}
+	if (msg.msg_flags & MSG_CTRUNC) {
+		ERR("run_as file descriptors truncated");
+		errno = EMSGSIZE;
+		return -1;
+	}
+
+	/* The rest of the message, if any, is regular data. */
+	if ((size_t) ret < len) {
+		return run_as_recv(sock, (char *) buf + ret, len - ret);
+	}
+	return 0;
+}
+
+/*
+ * Worker side: receive and run one request.
+ *
+ * Return 0 on success or -1 when the socket is closed or on error.
+ */
+static
+int worker_handle_request(int sock)
+{
+	int ret, dirfd = -1;
+	unsigned int i, nb_fd = 0, nb_dirfd;
+	uint32_t len;
+	char path[PATH_MAX];
+	int fds[RUN_AS_MAX_BATCH];
+	struct run_as_worker_msg msg;
+	struct run_as_worker_ret rets[RUN_AS_MAX_BATCH];
+
+	/* The directory of an openat is passed along with the request. */
+	ret = run_as_recv_fds(sock, &msg, sizeof(msg), &dirfd, 1, &nb_dirfd);
+	if (ret < 0) {
+		return -1;
+	}
+	if (msg.count == 0 || msg.count > RUN_AS_MAX_BATCH) {
+		ret = -1;
+		goto error;
+	}
+
+	for (i = 0; i < msg.count; i++) {
+		ret = run_as_recv(sock, &len, sizeof(len));
+		if (ret < 0 || len == 0 || len > sizeof(path)) {
+			goto error;
+		}
+		ret = run_as_recv(sock, path, len);
+		if (ret < 0) {
+			goto error;
+		}
+		path[len - 1] = '\0';
+
+		errno = 0;
+		rets[i].ret = run_as_cmd_exec(msg.cmd, dirfd, path, msg.flags,
+				msg.mode);
+		rets[i]._errno = rets[i].ret < 0 ? errno : 0;
+		if (msg.cmd == RUN_AS_OPEN && rets[i].ret >= 0) {
+			fds[nb_fd++] = rets[i].ret;
+		}
+	}
+
+	ret = run_as_send_fds(sock, rets, sizeof(*rets) * msg.count, fds, nb_fd);
+
+error:
+	/* Our copies of the file descriptors are not needed anymore. */
+	for (i = 0; i < nb_fd; i++) {
+		(void) close(fds[i]);
+	}
+	if (dirfd >= 0) {
+		(void) close(dirfd);
+	}
+	return ret < 0 ? -1 : 0;
+}
+
+/*
+ * Worker side: drop privileges and serve requests until the socket is closed.
+ */
+static
+void worker_run(int sock, uid_t uid, gid_t gid)
 {
 	int ret;
-	struct run_as_data *data = _data;
-	ssize_t writelen;
-	size_t writeleft, index;
-	union {
-		int i;
-		char c[sizeof(int)];
-	} sendret;
 
 	/*
-	 * Child: it is safe to drop egid and euid while sharing the
-	 * file descriptors with the parent process, since we do not
-	 * drop "uid": therefore, the user we are dropping egid/euid to
-	 * cannot attach to this process with, e.g. ptrace, nor map this
-	 * process memory.
+	 * Only the effective ids are dropped so the user we are dropping to
+	 * cannot attach to this process with, e.g. ptrace. Unlike the
+	 * session daemon, the worker does not share any memory with it.
 	 */
-	if (data->gid != getegid()) {
-		ret = setegid(data->gid);
+	if (gid != getegid()) {
+		ret = setegid(gid);
 		if (ret < 0) {
 			PERROR("setegid");
-			return EXIT_FAILURE;
+			_exit(EXIT_FAILURE);
 		}
 	}
-	if (data->uid != geteuid()) {
-		ret = seteuid(data->uid);
+	if (uid != geteuid()) {
+		ret = seteuid(uid);
 		if (ret < 0) {
 			PERROR("seteuid");
-			return EXIT_FAILURE;
+			_exit(EXIT_FAILURE);
 		}
 	}
 	/*
 	 * Also set umask to 0 for mkdir executable bit.
 	 */
 	umask(0);
-	sendret.i = (*data->cmd)(data->data);
-	/* send back return value */
-	writeleft = sizeof(sendret);
-	index = 0;
-	do {
-		do {
-			writelen = write(data->retval_pipe, &sendret.c[index],
-					writeleft);
-		} while (writelen < 0 && errno == EINTR);
-		if (writelen < 0) {
-			PERROR("write");
-			return EXIT_FAILURE;
+
+	while (worker_handle_request(sock) == 0) {
+		/* Continue serving requests. */
+	}
+
+	_exit(EXIT_SUCCESS);
+}
+
+/*
+ * Close every file descriptor of a newly forked worker but its socket, so it
+ * holds none of the daemon's application, consumer and relayd sockets,
+ * pipes or tracefiles. The standard input is replaced by /dev/null, the
+ * standard output and error are kept for the error messages of the worker.
+ *
+ * Only async-signal-safe calls are done here, right after the fork of a
+ * multithreaded process.
+ */
+static
+void worker_close_fds(int sock)
+{
+	int fd, null_fd;
+	long max_fd;
+
+	max_fd = sysconf(_SC_OPEN_MAX);
+	if (max_fd < 0) {
+		max_fd = RUN_AS_WORKER_MAX_FD;
+	}
+	for (fd = 3; fd < max_fd; fd++) {
+		if (fd != sock) {
+			(void) close(fd);
 		}
-		writeleft -= writelen;
-		index += writelen;
-	} while (writeleft > 0);
-	return EXIT_SUCCESS;
+	}
+
+	null_fd = open("/dev/null", O_RDONLY);
+	if (null_fd >= 0 && null_fd != STDIN_FILENO) {
+		(void) dup2(null_fd, STDIN_FILENO);
+		(void) close(null_fd);
+	}
 }
 
+/*
+ * Fork a worker for the uid/gid pair. The worker lock MUST be held.
+ *
+ * Return 0 on success else a negative value.
+ */
 static
-int run_as_clone(int (*cmd)(void *data), void *data, uid_t uid, gid_t gid)
+int worker_spawn(struct run_as_worker *worker)
 {
-	struct run_as_data run_as_data;
-	int ret = 0;
-	int status;
+	int ret, sv[2];
 	pid_t pid;
-	int retval_pipe[2];
-	ssize_t readlen, readleft, index;
-	void *child_stack;
-	union {
-		int i;
-		char c[sizeof(int)];
-	} retval;
+
+	ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv);
+	if (ret < 0) {
+		PERROR("socketpair run_as worker");
+		goto end;
+	}
 
 	/*
-	 * If we are non-root, we can only deal with our own uid.
+	 * We need to lock pthread exit, which deadlocks __nptl_setxid in the
+	 * child.
 	 */
-	if (geteuid() != 0) {
-		if (uid != geteuid()) {
-			ERR("Client (%d)/Server (%d) UID mismatch (and sessiond is not root)",
-				uid, geteuid());
-			return -EPERM;
+	pthread_mutex_lock(&lttng_libc_state_lock);
+	pid = fork();
+	if (pid == 0) {
+		/*
+		 * The worker never execs. Beside the descriptors, the only state
+		 * it uses from the daemon is malloc and stdio, whose locks libc
+		 * resets in the child of a fork.
+		 */
+		worker_close_fds(sv[1]);
+		worker_run(sv[1], worker->uid, worker->gid);
+	}
+	pthread_mutex_unlock(&lttng_libc_state_lock);
+	if (pid < 0) {
+		PERROR("fork run_as worker");
+		(void) close(sv[0]);
+		(void) close(sv[1]);
+		ret = -1;
+		goto end;
+	}
+
+	ret = close(sv[1]);
+	if (ret < 0) {
+		PERROR("close run_as worker socket");
+	}
+	worker->sock = sv[0];
+	worker->pid = pid;
+	DBG("run_as worker %d spawned for uid %d and gid %d", pid, worker->uid,
+			worker->gid);
+	ret = 0;
+
+end:
+	return ret;
+}
+
+/*
+ * Close the socket of a worker and reap it. The worker lock MUST be held.
+ */
+static
+void worker_kill(struct run_as_worker *worker)
+{
+	int ret, status;
+
+	if (worker->sock < 0) {
+		return;
+	}
+
+	ret = close(worker->sock);
+	if (ret < 0) {
+		PERROR("close run_as worker socket");
+	}
+	worker->sock = -1;
+
+	/* The worker exits as soon as its socket hangs up. */
+	ret = waitpid(worker->pid, &status, 0);
+	if (ret < 0) {
+		PERROR("waitpid run_as worker");
+	}
+}
+
+/*
+ * Return the worker of a uid/gid pair, spawning it if needed. The worker is
+ * returned locked, the spawn being done under its lock like the kill so they
+ * can't race on its socket and pid.
+ */
+static
+struct run_as_worker *worker_get(uid_t uid, gid_t gid)
+{
+	int ret;
+	struct run_as_worker *worker;
+
+	pthread_mutex_lock(&run_as_workers_lock);
+	cds_list_for_each_entry(worker, &run_as_workers, node) {
+		if (worker->uid == uid && worker->gid == gid) {
+			goto found;
 		}
 	}
 
-	ret = pipe(retval_pipe);
+	worker = zmalloc(sizeof(*worker));
+	if (!worker) {
+		PERROR("zmalloc run_as worker");
+		goto error;
+	}
+	worker->uid = uid;
+	worker->gid = gid;
+	worker->sock = -1;
+	pthread_mutex_init(&worker->lock, NULL);
+	cds_list_add(&worker->node, &run_as_workers);
+
+found:
+	pthread_mutex_unlock(&run_as_workers_lock);
+
+	pthread_mutex_lock(&worker->lock);
+	if (worker->sock < 0) {
+		ret = worker_spawn(worker);
+		if (ret < 0) {
+			pthread_mutex_unlock(&worker->lock);
+			return NULL;
+		}
+	}
+	return worker;
+
+error:
+	pthread_mutex_unlock(&run_as_workers_lock);
+	return NULL;
+}
+
+/*
+ * Send a request to a worker. The worker lock MUST be held.
+ */
+static
+int worker_send_request(struct run_as_worker *worker, enum run_as_cmd cmd,
+		int dirfd, const char **paths, unsigned int count, int flags,
+		mode_t mode)
+{
+	int ret;
+	unsigned int i;
+	uint32_t len;
+	struct run_as_worker_msg msg;
+
+	msg.cmd = cmd;
+	msg.count = count;
+	msg.flags = flags;
+	msg.mode = mode;
+
+	ret = run_as_send_fds(worker->sock, &msg, sizeof(msg), &dirfd,
+			dirfd >= 0 ? 1 : 0);
 	if (ret < 0) {
-		PERROR("pipe");
-		retval.i = ret;
 		goto end;
 	}
-	run_as_data.data = data;
-	run_as_data.cmd = cmd;
-	run_as_data.uid = uid;
-	run_as_data.gid = gid;
-	run_as_data.retval_pipe = retval_pipe[1];	/* write end */
-	child_stack = mmap(NULL, RUNAS_CHILD_STACK_SIZE,
-		PROT_WRITE | PROT_READ,
-		MAP_PRIVATE | MAP_GROWSDOWN | MAP_ANONYMOUS | LTTNG_MAP_STACK,
-		-1, 0);
-	if (child_stack == MAP_FAILED) {
-		PERROR("mmap");
-		retval.i = -ENOMEM;
-		goto close_pipe;
-	}
-	/*
-	 * Pointing to the middle of the stack to support architectures
-	 * where the stack grows up (HPPA).
-	 */
-	pid = lttng_clone_files(child_run_as, child_stack + (RUNAS_CHILD_STACK_SIZE / 2),
-		&run_as_data);
-	if (pid < 0) {
-		PERROR("clone");
-		retval.i = pid;
-		goto unmap_stack;
+
+	for (i = 0; i < count; i++) {
+		len = strlen(paths[i]) + 1;
+		if (len > PATH_MAX) {
+			/* Checked by the caller. */
+			assert(0);
+		}
+		ret = run_as_send(worker->sock, &len, sizeof(len));
+		if (ret < 0) {
+			goto end;
+		}
+		ret = run_as_send(worker->sock, paths[i], len);
+		if (ret < 0) {
+			goto end;
+		}
 	}
-	/* receive return value */
-	readleft = sizeof(retval);
-	index = 0;
-	do {
-		readlen = read(retval_pipe[0], &retval.c[index], readleft);
-		if (readlen < 0) {
-			PERROR("read");
-			ret = -1;
-			break;
+
+end:
+	return ret;
+}
+
+/*
+ * Run a batch of at most RUN_AS_MAX_BATCH operations in the worker of the
+ * uid/gid pair. The result of each operation is stored in results, the file
+ * descriptor for an open, and errno is set from the last failed one.
+ *
+ * Return 0 if the worker could run the batch else a negative value.
+ */
+static
+int run_as_worker_batch(enum run_as_cmd cmd, int dirfd, const char **paths,
+		unsigned int count, int flags, mode_t mode, uid_t uid, gid_t gid,
+		int *results)
+{
+	int ret, saved_errno = 0;
+	unsigned int i, nb_fd, fd_idx = 0;
+	int fds[RUN_AS_MAX_BATCH];
+	struct run_as_worker_ret rets[RUN_AS_MAX_BATCH];
+	struct run_as_worker *worker;
+
+	assert(count > 0 && count <= RUN_AS_MAX_BATCH);
+
+	for (i = 0; i < count; i++) {
+		if (strlen(paths[i]) >= PATH_MAX) {
+			errno = ENAMETOOLONG;
+			return -1;
 		}
-		readleft -= readlen;
-		index += readlen;
-	} while (readleft > 0);
+	}
 
-	/*
-	 * Parent: wait for child to return, in which case the
-	 * shared memory map will have been created.
-	 */
-	pid = waitpid(pid, &status, 0);
-	if (pid < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
-		PERROR("wait");
-		retval.i = -1;
+	worker = worker_get(uid, gid);
+	if (!worker) {
+		return -1;
 	}
-unmap_stack:
-	ret = munmap(child_stack, RUNAS_CHILD_STACK_SIZE);
+
+	ret = worker_send_request(worker, cmd, dirfd, paths, count, flags,
+			mode);
 	if (ret < 0) {
-		PERROR("munmap");
-		retval.i = ret;
+		/*
+		 * The worker died while idle and never saw this request, which
+		 * is safe to send to a new one.
+		 */
+		DBG("run_as worker %d is gone, respawning it", worker->pid);
+		worker_kill(worker);
+		pthread_mutex_unlock(&worker->lock);
+		worker = worker_get(uid, gid);
+		if (!worker) {
+			return -1;
+		}
+		ret = worker_send_request(worker, cmd, dirfd, paths, count, flags,
+			mode);
+		if (ret < 0) {
+			PERROR("send run_as request");
+			goto error;
+		}
 	}
-close_pipe:
-	ret = close(retval_pipe[0]);
-	if (ret) {
-		PERROR("close");
+
+	ret = run_as_recv_fds(worker->sock, rets, sizeof(*rets) * count, fds,
+			RUN_AS_MAX_BATCH, &nb_fd);
+	if (ret < 0) {
+		PERROR("recv run_as reply");
+		goto error;
 	}
-	ret = close(retval_pipe[1]);
-	if (ret) {
-		PERROR("close");
+	pthread_mutex_unlock(&worker->lock);
+
+	for (i = 0; i < count; i++) {
+		if (rets[i].ret < 0) {
+			results[i] = rets[i].ret;
+			saved_errno = rets[i]._errno;
+		} else if (cmd == RUN_AS_OPEN) {
+			results[i] = fd_idx < nb_fd ? fds[fd_idx++] : -1;
+		} else {
+			results[i] = rets[i].ret;
+		}
 	}
-end:
-	return retval.i;
+	errno = saved_errno;
+	return 0;
+
+error:
+	/* The state of the worker is unknown, start a new one next time. */
+	saved_errno = errno;
+	worker_kill(worker);
+	pthread_mutex_unlock(&worker->lock);
+	errno = saved_errno;
+	return -1;
 }
 
 /*
  * To be used on setups where gdb has issues debugging programs using
- * clone/rfork. Note that this is for debuging ONLY, and should not be
- * considered secure.
+ * fork. Note that this is for debuging ONLY, and should not be considered
+ * secure.
  */
 static
-int run_as_noclone(int (*cmd)(void *data), void *data, uid_t uid, gid_t gid)
+void run_as_noclone(enum run_as_cmd cmd, int dirfd, const char **paths,
+		unsigned int count, int flags, mode_t mode, int *results)
 {
-	int ret;
+	unsigned int i;
 	mode_t old_mask;
 
 	old_mask = umask(0);
-	ret = cmd(data);
+	for (i = 0; i < count; i++) {
+		results[i] = run_as_cmd_exec(cmd, dirfd, paths[i], flags, mode);
+	}
 	umask(old_mask);
+}
 
+/*
+ * Run count operations as the given uid/gid, the result of each one being
+ * stored in results. Paths are relative to dirfd for an open if it is valid.
+ *
+ * Return 0 on success else a negative value if the operations could not be
+ * run at all.
+ */
+static
+int run_as(enum run_as_cmd cmd, int dirfd, const char **paths,
+		unsigned int count, int flags, mode_t mode, uid_t uid, gid_t gid,
+		int *results)
+{
+	int ret;
+	unsigned int i, done, batch;
+
+	/*
+	 * If we are non-root, we can only deal with our own uid.
+	 */
+	if (geteuid() != 0) {
+		if (uid != geteuid()) {
+			ERR("Client (%d)/Server (%d) UID mismatch (and sessiond is not root)",
+				uid, geteuid());
+			return -EPERM;
+		}
+	}
+
+	if (getenv("LTTNG_DEBUG_NOCLONE")) {
+		DBG("Using run_as_noclone");
+		run_as_noclone(cmd, dirfd, paths, count, flags, mode, results);
+		return 0;
+	}
+
+	DBG("Using run_as worker");
+	for (done = 0; done < count; done += batch) {
+		batch = count - done;
+		if (batch > RUN_AS_MAX_BATCH) {
+			batch = RUN_AS_MAX_BATCH;
+		}
+		ret = run_as_worker_batch(cmd, dirfd, paths + done, batch, flags,
+				mode, uid, gid, results + done);
+		if (ret < 0) {
+			goto error;
+		}
+	}
+
+	return 0;
+
+error:
+	/* Close the files opened by the previous batches. */
+	for (i = 0; cmd == RUN_AS_OPEN && i < done; i++) {
+		if (results[i] >= 0) {
+			(void) close(results[i]);
+		}
+		results[i] = -1;
+	}
 	return ret;
 }
 
+/*
+ * Run a single operation as the given uid/gid and return its result.
+ */
 static
-int run_as(int (*cmd)(void *data), void *data, uid_t uid, gid_t gid)
+int run_as_one(enum run_as_cmd cmd, int dirfd, const char *path, int flags,
+		mode_t mode, uid_t uid, gid_t gid)
 {
-	if (!getenv("LTTNG_DEBUG_NOCLONE")) {
-		int ret;
+	int ret, result;
 
-		DBG("Using run_as_clone");
-		pthread_mutex_lock(&lttng_libc_state_lock);
-		ret = run_as_clone(cmd, data, uid, gid);
-		pthread_mutex_unlock(&lttng_libc_state_lock);
+	ret = run_as(cmd, dirfd, &path, 1, flags, mode, uid, gid, &result);
+	if (ret < 0) {
 		return ret;
-	} else {
-		DBG("Using run_as_noclone");
-		return run_as_noclone(cmd, data, uid, gid);
 	}
+	return result;
 }
 
 LTTNG_HIDDEN
 int run_as_mkdir_recursive(const char *path, mode_t mode, uid_t uid, gid_t gid)
 {
-	struct run_as_mkdir_data data;
-
 	DBG3("mkdir() recursive %s with mode %d for uid %d and gid %d",
 			path, mode, uid, gid);
-	data.path = path;
-	data.mode = mode;
-	return run_as(_mkdir_recursive, &data, uid, gid);
+	return run_as_one(RUN_AS_MKDIR_RECURSIVE, -1, path, 0, mode, uid, gid);
 }
 
 LTTNG_HIDDEN
 int run_as_mkdir(const char *path, mode_t mode, uid_t uid, gid_t gid)
 {
-	struct run_as_mkdir_data data;
-
 	DBG3("mkdir() %s with mode %d for uid %d and gid %d",
 			path, mode, uid, gid);
-	data.path = path;
-	data.mode = mode;
-	return run_as(_mkdir, &data, uid, gid);
+	return run_as_one(RUN_AS_MKDIR, -1, path, 0, mode, uid, gid);
 }
 
 /*
- * Note: open_run_as is currently not working. We'd need to pass the fd
- * opened in the child to the parent.
+ * The file descriptor is opened by the worker and passed back with
+ * SCM_RIGHTS.
  */
 LTTNG_HIDDEN
 int run_as_open(const char *path, int flags, mode_t mode, uid_t uid, gid_t gid)
 {
-	struct run_as_open_data data;
-
 	DBG3("open() %s with flags %X mode %d for uid %d and gid %d",
 			path, flags, mode, uid, gid);
-	data.path = path;
-	data.flags = flags;
-	data.mode = mode;
-	return run_as(_open, &data, uid, gid);
+	return run_as_one(RUN_AS_OPEN, -1, path, flags, mode, uid, gid);
+}
+
+/*
+ * Same as run_as_open() with a path relative to the directory dirfd, which is
+ * passed to the worker along with the request.
+ */
+LTTNG_HIDDEN
+int run_as_openat(int dirfd, const char *path, int flags, mode_t mode,
+		uid_t uid, gid_t gid)
+{
+	DBG3("openat() %s with flags %X mode %d for uid %d and gid %d",
+			path, flags, mode, uid, gid);
+	return run_as_one(RUN_AS_OPEN, dirfd, path, flags, mode, uid, gid);
+}
+
+/*
+ * Open count files relative to the directory dirfd, or at their absolute path
+ * if dirfd is -1, with the same flags and mode as the given uid/gid. A single
+ * round trip to the worker is done per RUN_AS_MAX_BATCH files. Each file
+ * descriptor, or a negative value on error, is stored in fds.
+ *
+ * Return 0 on success else a negative value if the files could not be opened
+ * at all, in which case no file descriptor is returned.
+ */
+LTTNG_HIDDEN
+int run_as_openat_batch(int dirfd, const char **paths, unsigned int count,
+		int flags, mode_t mode, uid_t uid, gid_t gid, int *fds)
+{
+	DBG3("openat() batch of %u files with flags %X mode %d for uid %d and gid %d",
+			count, flags, mode, uid, gid);
+	return run_as(RUN_AS_OPEN, dirfd, paths, count, flags, mode, uid, gid,
+			fds);
 }
@@ -25,10 +25,14 @@
 int run_as_mkdir_recursive(const char *path, mode_t mode, uid_t uid, gid_t gid);
 int run_as_mkdir(const char *path, mode_t mode, uid_t uid, gid_t gid);
 int run_as_open(const char *path, int flags, mode_t mode, uid_t uid, gid_t gid);
+int run_as_openat(int dirfd, const char *path, int flags, mode_t mode,
+		uid_t uid, gid_t gid);
+int run_as_openat_batch(int dirfd, const char **paths, unsigned int count,
+		int flags, mode_t mode, uid_t uid, gid_t gid, int *fds);
 
 /*
  * We need to lock pthread exit, which deadlocks __nptl_setxid in the
- * clone.
+ * run_as worker fork.
  */
 extern pthread_mutex_t lttng_libc_state_lock;
 
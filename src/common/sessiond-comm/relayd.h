@@ -28,7 +28,7 @@
 #include <common/defaults.h>
 
 #define RELAYD_VERSION_COMM_MAJOR             2
-#define RELAYD_VERSION_COMM_MINOR             2
+#define RELAYD_VERSION_COMM_MINOR             3
 
 /*
  * lttng-relayd communication header.
@@ -80,6 +80,19 @@ struct lttcomm_relayd_add_stream_2_2 {
 	uint64_t tracefile_count;
 } LTTNG_PACKED;
 
+/*
+ * Used to add a stream on the relay daemon.
+ * Protocol version 2.3
+ */
+struct lttcomm_relayd_add_stream_2_3 {
+	char channel_name[DEFAULT_STREAM_NAME_LEN];
+	char pathname[PATH_MAX];
+	uint64_t tracefile_size;
+	uint64_t tracefile_count;
+	/* enum lttng_compression of the tracefiles, applied by the relayd. */
+	uint32_t compression;
+} LTTNG_PACKED;
+
 /*
  * Answer from an add stream command.
  */
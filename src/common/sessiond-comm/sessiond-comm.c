@@ -314,6 +314,25 @@ void lttcomm_destroy_sock(struct lttcomm_sock *sock)
 	free(sock);
 }
 
+/*
+ * Return the number of streams of a LTTNG_CONSUMER_ADD_STREAMS message, their
+ * fds following it in a single message, or -1 if the count is invalid.
+ */
+LTTNG_HIDDEN
+int lttcomm_consumer_msg_nb_streams(struct lttcomm_consumer_msg *msg)
+{
+	uint32_t nb_streams;
+
+	assert(msg);
+
+	nb_streams = msg->u.streams.nb_streams;
+	if (nb_streams == 0 || nb_streams > LTTCOMM_MAX_SEND_FDS) {
+		return -1;
+	}
+
+	return nb_streams;
+}
+
 /*
  * Allocate and return a relayd socket object using a given URI to initialize
  * it and the major/minor version of the supported protocol.
@@ -44,8 +44,11 @@
 /* Queue size of listen(2) */
 #define LTTNG_SESSIOND_COMM_MAX_LISTEN 64
 
-/* Maximum number of FDs that can be sent over a Unix socket */
-#define LTTCOMM_MAX_SEND_FDS           4
+/*
+ * Maximum number of FDs that can be sent over a Unix socket in one message,
+ * below the SCM_MAX_FD limit of Linux.
+ */
+#define LTTCOMM_MAX_SEND_FDS           64
 
 /*
  * Get the error code index from 0 since LTTCOMM_OK start at 1000
@@ -82,6 +85,11 @@ enum lttcomm_sessiond_command {
 	LTTNG_ENABLE_EVENT_WITH_FILTER      = 22,
 	LTTNG_HEALTH_CHECK                  = 23,
 	LTTNG_DATA_PENDING                  = 24,
+	LTTNG_LIST_TRACEPOINTS_QUERY        = 25,
+	LTTNG_HEALTH_STATS                  = 26,
+	LTTNG_CREATE_SESSION_SNAPSHOT       = 27,
+	LTTNG_SNAPSHOT_RECORD               = 28,
+	LTTNG_SET_PROVISION_UIDS            = 29,
 };
 
 enum lttcomm_relayd_command {
@@ -234,12 +242,22 @@ struct lttcomm_session_msg {
 		struct {
 			char channel_name[LTTNG_SYMBOL_NAME_LEN];
 		} LTTNG_PACKED list;
+		/* Filtering and pagination of the tracepoint listing. */
+		struct lttng_tracepoint_query tp_query;
 		struct lttng_calibrate calibrate;
 		/* Used by the set_consumer_url and used by create_session also call */
 		struct {
 			/* Number of lttng_uri following */
 			uint32_t size;
 		} LTTNG_PACKED uri;
+		struct {
+			char name[NAME_MAX];	/* Empty for a generated name. */
+			uint64_t max_size;	/* Per stream, 0 for no limit. */
+		} LTTNG_PACKED snapshot_record;
+		struct {
+			uint32_t count;
+			uint32_t uids[DEFAULT_UST_PROVISION_UIDS_MAX];
+		} LTTNG_PACKED provision_uids;
 	} u;
 } LTTNG_PACKED;
 
@@ -280,6 +298,15 @@ struct lttcomm_health_data {
 	uint32_t ret_code;
 } LTTNG_PACKED;
 
+/*
+ * Reply header of a LTTNG_HEALTH_STATS command, followed by a struct
+ * lttng_health_stats and nb_apps struct lttng_health_app_stats.
+ */
+struct lttcomm_health_stats_reply {
+	uint32_t ret_code;
+	uint32_t nb_apps;
+} LTTNG_PACKED;
+
 /*
  * lttcomm_consumer_msg is the message sent from sessiond to consumerd
  * to either add a channel, add a stream, update a stream, or stop
@@ -303,12 +330,20 @@ struct lttcomm_consumer_msg {
 			int type; /* Per cpu or metadata. */
 			uint64_t tracefile_size; /* bytes */
 			uint32_t tracefile_count; /* number of tracefiles */
+			uint32_t compression; /* enum lttng_compression */
+			uint32_t live_timer_interval; /* usec */
+			uint32_t monitor; /* 0: streams kept for snapshots only. */
 		} LTTNG_PACKED channel; /* Only used by Kernel. */
 		struct {
 			uint64_t stream_key;
 			uint64_t channel_key;
 			int32_t cpu;	/* On which CPU this stream is assigned. */
 		} LTTNG_PACKED stream;	/* Only used by Kernel. */
+		struct {
+			uint64_t channel_key;
+			uint32_t nb_streams;	/* Number of fds following the message. */
+			int32_t cpus[LTTCOMM_MAX_SEND_FDS];	/* CPU of each stream. */
+		} LTTNG_PACKED streams;	/* Only used by Kernel. */
 		struct {
 			uint64_t net_index;
 			enum lttng_stream_type type;
@@ -342,6 +377,9 @@ struct lttcomm_consumer_msg {
 			uint32_t chan_id;			/* Channel ID on the tracer side. */
 			uint64_t tracefile_size;	/* bytes */
 			uint32_t tracefile_count;	/* number of tracefiles */
+			uint32_t compression;		/* enum lttng_compression */
+			uint32_t live_timer_interval;	/* usec */
+			uint32_t monitor;		/* 0: streams kept for snapshots only. */
 		} LTTNG_PACKED ask_channel;
 		struct {
 			uint64_t key;
@@ -363,6 +401,13 @@ struct lttcomm_consumer_msg {
 		struct {
 			uint64_t key;	/* Channel key. */
 		} LTTNG_PACKED flush_channel;
+		struct {
+			char pathname[PATH_MAX];	/* Snapshot output directory. */
+			uint32_t metadata;		/* Metadata channel. */
+			uint64_t relayd_id;		/* Relayd id if apply. */
+			uint64_t key;			/* Channel key. */
+			uint64_t max_stream_size;	/* bytes, 0 for no limit. */
+		} LTTNG_PACKED snapshot_channel;
 	} u;
 } LTTNG_PACKED;
 
@@ -439,4 +484,6 @@ extern void lttcomm_copy_sock(struct lttcomm_sock *dst,
 extern struct lttcomm_relayd_sock *lttcomm_alloc_relayd_sock(
 		struct lttng_uri *uri, uint32_t major, uint32_t minor);
 
+extern int lttcomm_consumer_msg_nb_streams(struct lttcomm_consumer_msg *msg);
+
 #endif	/* _LTTNG_SESSIOND_COMM_H */
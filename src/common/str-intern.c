@@ -0,0 +1,200 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/*
+ * Process wide table of reference counted immutable strings, sharing a single
+ * copy of the strings held by many objects like the paths of the channels of
+ * a session instead of a PATH_MAX buffer in each of them.
+ */
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <common/common.h>
+
+#include "str-intern.h"
+
+#define INTERN_MIN_BUCKETS	64
+
+struct intern_entry {
+	struct intern_entry *next;
+	unsigned long hash;
+	unsigned long refcount;
+	char str[];
+};
+
+static struct {
+	pthread_mutex_t lock;
+	struct intern_entry **buckets;
+	/* Power of two. */
+	unsigned long nr_buckets;
+	struct lttng_intern_stats stats;
+} table = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/*
+ * FNV-1a hash of a string.
+ */
+static unsigned long hash_str(const char *str)
+{
+	uint32_t hash = 2166136261U;
+
+	while (*str) {
+		hash ^= (unsigned char) *str++;
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+/*
+ * Double the number of buckets once there are more strings than buckets.
+ * Keep the current buckets if the allocation fails, lookups get slower.
+ *
+ * The table lock MUST be held.
+ */
+static void grow_table(void)
+{
+	unsigned long i, nr_buckets;
+	struct intern_entry **buckets, *entry, *next;
+
+	if (table.buckets && table.stats.nr_strings <= table.nr_buckets) {
+		return;
+	}
+
+	nr_buckets = table.buckets ? table.nr_buckets << 1 : INTERN_MIN_BUCKETS;
+	buckets = zmalloc(nr_buckets * sizeof(*buckets));
+	if (!buckets) {
+		PERROR("zmalloc intern table");
+		return;
+	}
+
+	for (i = 0; i < table.nr_buckets; i++) {
+		for (entry = table.buckets[i]; entry; entry = next) {
+			next = entry->next;
+			entry->next = buckets[entry->hash & (nr_buckets - 1)];
+			buckets[entry->hash & (nr_buckets - 1)] = entry;
+		}
+	}
+	free(table.buckets);
+	table.buckets = buckets;
+	table.nr_buckets = nr_buckets;
+}
+
+/*
+ * Return the shared copy of a string, taking a reference on it released with
+ * lttng_intern_put(). The copy MUST NOT be modified.
+ *
+ * Return NULL on ENOMEM.
+ */
+LTTNG_HIDDEN
+const char *lttng_intern_get(const char *str)
+{
+	size_t len;
+	unsigned long hash;
+	struct intern_entry *entry = NULL;
+
+	assert(str);
+
+	hash = hash_str(str);
+
+	pthread_mutex_lock(&table.lock);
+	grow_table();
+	if (!table.buckets) {
+		goto end;
+	}
+
+	for (entry = table.buckets[hash & (table.nr_buckets - 1)]; entry;
+			entry = entry->next) {
+		if (entry->hash == hash && !strcmp(entry->str, str)) {
+			entry->refcount++;
+			table.stats.nr_refs++;
+			goto end;
+		}
+	}
+
+	len = strlen(str) + 1;
+	entry = malloc(sizeof(*entry) + len);
+	if (!entry) {
+		PERROR("malloc interned string");
+		goto end;
+	}
+	entry->hash = hash;
+	entry->refcount = 1;
+	memcpy(entry->str, str, len);
+	entry->next = table.buckets[hash & (table.nr_buckets - 1)];
+	table.buckets[hash & (table.nr_buckets - 1)] = entry;
+	table.stats.nr_strings++;
+	table.stats.nr_refs++;
+	table.stats.bytes += sizeof(*entry) + len;
+
+end:
+	pthread_mutex_unlock(&table.lock);
+	return entry ? entry->str : NULL;
+}
+
+/*
+ * Release a reference on a string returned by lttng_intern_get(), freeing it
+ * with the last one. NULL is ignored.
+ */
+LTTNG_HIDDEN
+void lttng_intern_put(const char *str)
+{
+	struct intern_entry **pos, *entry;
+
+	if (!str) {
+		return;
+	}
+	entry = (struct intern_entry *) (str - offsetof(struct intern_entry, str));
+
+	pthread_mutex_lock(&table.lock);
+	assert(entry->refcount > 0);
+	table.stats.nr_refs--;
+	if (--entry->refcount) {
+		goto end;
+	}
+
+	for (pos = &table.buckets[entry->hash & (table.nr_buckets - 1)];
+			*pos != entry; pos = &(*pos)->next) {
+		assert(*pos);
+	}
+	*pos = entry->next;
+	table.stats.nr_strings--;
+	table.stats.bytes -= sizeof(*entry) + strlen(entry->str) + 1;
+	free(entry);
+
+end:
+	pthread_mutex_unlock(&table.lock);
+}
+
+/*
+ * Copy the counters of the table.
+ */
+LTTNG_HIDDEN
+void lttng_intern_get_stats(struct lttng_intern_stats *stats)
+{
+	assert(stats);
+
+	pthread_mutex_lock(&table.lock);
+	*stats = table.stats;
+	pthread_mutex_unlock(&table.lock);
+}
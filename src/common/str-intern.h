@@ -0,0 +1,33 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef LTTNG_STR_INTERN_H
+#define LTTNG_STR_INTERN_H
+
+#include <stddef.h>
+
+struct lttng_intern_stats {
+	/* Distinct strings, references to them and bytes allocated. */
+	unsigned long nr_strings;
+	unsigned long nr_refs;
+	size_t bytes;
+};
+
+const char *lttng_intern_get(const char *str);
+void lttng_intern_put(const char *str);
+void lttng_intern_get_stats(struct lttng_intern_stats *stats);
+
+#endif /* LTTNG_STR_INTERN_H */
@@ -0,0 +1,183 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <common/common.h>
+#include <common/defaults.h>
+
+#include "stream-sched.h"
+
+/*
+ * Parse an unsigned value of an environment variable, keeping def if it is
+ * not set or invalid.
+ */
+static unsigned int parse_env_uint(const char *name, unsigned int def)
+{
+	char *env, *end;
+	unsigned long val;
+
+	env = getenv(name);
+	if (!env) {
+		return def;
+	}
+	errno = 0;
+	val = strtoul(env, &end, 10);
+	if (errno || end == env || *end != '\0' || val > UINT_MAX) {
+		WARN("Invalid value %s of %s, using the default", env, name);
+		return def;
+	}
+
+	return val;
+}
+
+/*
+ * Set the scheduling of the data threads from the environment.
+ */
+LTTNG_HIDDEN
+void lttng_stream_sched_config_init(struct lttng_stream_sched_config *config)
+{
+	char *env;
+
+	assert(config);
+
+	memset(config, 0, sizeof(*config));
+	env = getenv(DEFAULT_CONSUMERD_SCHED_ENV);
+	if (env && !strcmp(env, "backlog")) {
+		config->backlog = 1;
+	} else if (env && strcmp(env, "poll")) {
+		WARN("Invalid value %s of %s, using the poll order", env,
+				DEFAULT_CONSUMERD_SCHED_ENV);
+	}
+	config->max_burst = parse_env_uint(DEFAULT_CONSUMERD_SCHED_BURST_ENV,
+			DEFAULT_CONSUMERD_SCHED_BURST);
+	if (!config->max_burst) {
+		config->max_burst = 1;
+	}
+	config->starvation = parse_env_uint(DEFAULT_CONSUMERD_SCHED_STARVATION_ENV,
+			DEFAULT_CONSUMERD_SCHED_STARVATION);
+	config->weights = getenv(DEFAULT_CONSUMERD_SCHED_WEIGHTS_ENV);
+}
+
+/*
+ * Return the weight of a channel in the "<channel>=<weight>,..." list of the
+ * configuration, 1 if it is not listed.
+ */
+LTTNG_HIDDEN
+unsigned int lttng_stream_sched_weight(
+		const struct lttng_stream_sched_config *config, const char *channel)
+{
+	const char *p, *eq;
+	char *end;
+	size_t len;
+	unsigned long weight;
+
+	assert(config);
+	assert(channel);
+
+	len = strlen(channel);
+	for (p = config->weights; p && *p != '\0'; p = strchr(p, ',')) {
+		if (*p == ',') {
+			p++;
+		}
+		eq = strchr(p, '=');
+		if (!eq) {
+			break;
+		}
+		if ((size_t) (eq - p) != len || strncmp(p, channel, len)) {
+			continue;
+		}
+		weight = strtoul(eq + 1, &end, 10);
+		if (end == eq + 1 || (*end != '\0' && *end != ',') || !weight ||
+				weight > DEFAULT_CONSUMERD_SCHED_MAX_WEIGHT) {
+			WARN("Invalid weight of channel %s in %s", channel,
+					DEFAULT_CONSUMERD_SCHED_WEIGHTS_ENV);
+			break;
+		}
+		return weight;
+	}
+
+	return 1;
+}
+
+/*
+ * Return 1 if the backlogs of the ready streams of a pass must be read, that
+ * is in backlog order with more than one stream to order, else 0. A single
+ * ready stream is consumed up to the maximum burst, its consumption stopping
+ * at the first missing subbuffer anyway.
+ */
+LTTNG_HIDDEN
+int lttng_stream_sched_needs_backlog(
+		const struct lttng_stream_sched_config *config, unsigned int nr_ready)
+{
+	assert(config);
+
+	return config->backlog && nr_ready > 1;
+}
+
+/*
+ * Set the entry of a ready stream from its backlog, the bytes produced and
+ * not consumed. A ready stream has at least a subbuffer to consume.
+ */
+LTTNG_HIDDEN
+void lttng_stream_sched_set(struct lttng_stream_sched_entry *entry,
+		const struct lttng_stream_sched_config *config, int index,
+		uint64_t backlog, unsigned long subbuf_size, unsigned int weight)
+{
+	uint64_t subbufs;
+
+	assert(entry);
+	assert(config);
+
+	subbufs = subbuf_size ? backlog / subbuf_size : 0;
+	if (!subbufs) {
+		subbufs = 1;
+	}
+
+	entry->index = index;
+	entry->priority = subbufs * weight;
+	entry->burst = subbufs < config->max_burst ? subbufs : config->max_burst;
+}
+
+/*
+ * Fullest streams first, then in poll order.
+ */
+static int compare_entries(const void *a, const void *b)
+{
+	const struct lttng_stream_sched_entry *ea = a, *eb = b;
+
+	if (ea->priority != eb->priority) {
+		return ea->priority > eb->priority ? -1 : 1;
+	}
+	return ea->index - eb->index;
+}
+
+/*
+ * Sort the ready streams of a pass in the order they are consumed.
+ */
+LTTNG_HIDDEN
+void lttng_stream_sched_sort(struct lttng_stream_sched_entry *entries,
+		unsigned int nr_entries)
+{
+	assert(entries || !nr_entries);
+
+	qsort(entries, nr_entries, sizeof(*entries), compare_entries);
+}
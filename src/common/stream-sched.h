@@ -0,0 +1,62 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef LTTNG_STREAM_SCHED_H
+#define LTTNG_STREAM_SCHED_H
+
+#include <stdint.h>
+
+/*
+ * Order in which a data thread consumes its ready streams. By default they are
+ * consumed in poll order, one subbuffer each per pass. With the backlog order,
+ * the streams with the most subbuffers produced and not consumed, weighted by
+ * their channel, are consumed first and several subbuffers at a time.
+ */
+struct lttng_stream_sched_config {
+	int backlog;
+	/* Most subbuffers consumed from a stream in a pass. */
+	unsigned int max_burst;
+	/*
+	 * Most consecutive passes consuming only the urgent streams before the
+	 * others are consumed, 0 for no limit.
+	 */
+	unsigned int starvation;
+	/* "<channel>=<weight>,..." list, NULL if every weight is 1. */
+	const char *weights;
+};
+
+/* Ready stream of a pass. */
+struct lttng_stream_sched_entry {
+	/* Index of the stream in the poll array of the thread. */
+	int index;
+	/* Weighted backlog, in subbuffers. */
+	uint64_t priority;
+	/* Subbuffers to consume in this pass. */
+	unsigned int burst;
+};
+
+void lttng_stream_sched_config_init(struct lttng_stream_sched_config *config);
+unsigned int lttng_stream_sched_weight(
+		const struct lttng_stream_sched_config *config, const char *channel);
+int lttng_stream_sched_needs_backlog(
+		const struct lttng_stream_sched_config *config, unsigned int nr_ready);
+void lttng_stream_sched_set(struct lttng_stream_sched_entry *entry,
+		const struct lttng_stream_sched_config *config, int index,
+		uint64_t backlog, unsigned long subbuf_size, unsigned int weight);
+void lttng_stream_sched_sort(struct lttng_stream_sched_entry *entries,
+		unsigned int nr_entries);
+
+#endif /* LTTNG_STREAM_SCHED_H */
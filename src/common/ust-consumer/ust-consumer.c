@@ -63,7 +63,8 @@ static void destroy_channel(struct lttng_consumer_channel *channel)
 			send_node) {
 		cds_list_del(&stream->send_node);
 		ustctl_destroy_stream(stream->ustream);
-		free(stream);
+		consumer_stream_uncache_out_fd(stream);
+		consumer_free_stream(stream);
 	}
 
 	/*
@@ -73,7 +74,7 @@ static void destroy_channel(struct lttng_consumer_channel *channel)
 	if (channel->uchan) {
 		lttng_ustconsumer_del_channel(channel);
 	}
-	free(channel);
+	consumer_free_channel(channel);
 }
 
 /*
@@ -114,13 +115,15 @@ error:
 static struct lttng_consumer_channel *allocate_channel(uint64_t session_id,
 		const char *pathname, const char *name, uid_t uid, gid_t gid,
 		int relayd_id, uint64_t key, enum lttng_event_output output,
-		uint64_t tracefile_size, uint64_t tracefile_count)
+		uint64_t tracefile_size, uint64_t tracefile_count,
+		enum lttng_compression compression, unsigned int live_timer_interval)
 {
 	assert(pathname);
 	assert(name);
 
 	return consumer_allocate_channel(key, session_id, pathname, name, uid, gid,
-			relayd_id, output, tracefile_size, tracefile_count);
+			relayd_id, output, tracefile_size, tracefile_count, compression,
+			live_timer_interval);
 }
 
 /*
@@ -192,7 +195,7 @@ static int send_stream_to_thread(struct lttng_consumer_stream *stream,
 	if (stream->metadata_flag) {
 		stream_pipe = ctx->consumer_metadata_pipe;
 	} else {
-		stream_pipe = ctx->consumer_data_pipe;
+		stream_pipe = consumer_data_stream_pipe(ctx, stream);
 	}
 
 	ret = lttng_pipe_write(stream_pipe, &stream, sizeof(stream));
@@ -225,7 +228,8 @@ static int send_stream_to_relayd(struct lttng_consumer_stream *stream)
 		ret = relayd_add_stream(&relayd->control_sock, stream->name,
 				stream->chan->pathname, &stream->relayd_stream_id,
 				stream->chan->tracefile_size,
-				stream->chan->tracefile_count);
+				stream->chan->tracefile_count,
+				consumer_stream_relayd_compression(stream));
 		pthread_mutex_unlock(&relayd->ctrl_sock_mutex);
 		if (ret < 0) {
 			goto error;
@@ -241,6 +245,67 @@ error:
 	return ret;
 }
 
+/*
+ * Create the tracefiles of all the local streams of a channel, relative to
+ * the channel directory. The streams sent to a relayd are skipped.
+ *
+ * Return 0 on success or else a negative value.
+ */
+static int create_stream_files(struct lttng_consumer_channel *channel)
+{
+	int ret, *fds = NULL;
+	unsigned int nb_files = 0, i = 0;
+	char **names = NULL;
+	struct lttng_consumer_stream *stream;
+
+	cds_list_for_each_entry(stream, &channel->streams.head, send_node) {
+		if (stream->net_seq_idx == (uint64_t) -1ULL) {
+			nb_files++;
+		}
+	}
+	if (nb_files == 0) {
+		ret = 0;
+		goto end;
+	}
+
+	names = zmalloc(nb_files * sizeof(*names));
+	fds = zmalloc(nb_files * sizeof(*fds));
+	if (!names || !fds) {
+		PERROR("zmalloc stream files");
+		ret = -ENOMEM;
+		goto end;
+	}
+
+	cds_list_for_each_entry(stream, &channel->streams.head, send_node) {
+		if (stream->net_seq_idx == (uint64_t) -1ULL) {
+			names[i++] = stream->name;
+		}
+	}
+
+	/* Every stream of a channel has the same path, uid and gid. */
+	stream = cds_list_entry(channel->streams.head.next,
+			struct lttng_consumer_stream, send_node);
+	ret = utils_create_stream_files(consumer_channel_get_dirfd(channel),
+			channel->pathname, names, nb_files, channel->tracefile_size,
+			stream->tracefile_count_current, stream->uid, stream->gid, fds);
+	if (ret < 0) {
+		goto end;
+	}
+
+	i = 0;
+	cds_list_for_each_entry(stream, &channel->streams.head, send_node) {
+		if (stream->net_seq_idx == (uint64_t) -1ULL) {
+			stream->out_fd = fds[i++];
+			stream->tracefile_size_current = 0;
+		}
+	}
+
+end:
+	free(names);
+	free(fds);
+	return ret;
+}
+
 /*
  * Create streams for the given channel using liblttng-ust-ctl.
  *
@@ -280,9 +345,12 @@ static int create_ust_streams(struct lttng_consumer_channel *channel,
 
 		/*
 		 * Increment channel refcount since the channel reference has now been
-		 * assigned in the allocation process above.
+		 * assigned in the allocation process above. The streams of an
+		 * unmonitored channel stay in its list until the channel goes away.
 		 */
-		uatomic_inc(&stream->chan->refcount);
+		if (channel->monitor) {
+			uatomic_inc(&stream->chan->refcount);
+		}
 
 		/*
 		 * Order is important this is why a list is used. On error, the caller
@@ -298,14 +366,6 @@ static int create_ust_streams(struct lttng_consumer_channel *channel,
 			goto error;
 		}
 
-		/* Do actions once stream has been received. */
-		if (ctx->on_recv_stream) {
-			ret = ctx->on_recv_stream(stream);
-			if (ret < 0) {
-				goto error;
-			}
-		}
-
 		DBG("UST consumer add stream %s (key: %" PRIu64 ") with relayd id %" PRIu64,
 				stream->name, stream->key, stream->relayd_stream_id);
 
@@ -318,6 +378,25 @@ static int create_ust_streams(struct lttng_consumer_channel *channel,
 		}
 	}
 
+	/* Do actions once the streams have been received. */
+	if (ctx->on_recv_stream && channel->monitor) {
+		/*
+		 * Create every tracefile of the channel at once so it costs a
+		 * single run_as request instead of one per CPU.
+		 */
+		ret = create_stream_files(channel);
+		if (ret < 0) {
+			goto error;
+		}
+
+		cds_list_for_each_entry(stream, &channel->streams.head, send_node) {
+			ret = ctx->on_recv_stream(stream);
+			if (ret < 0) {
+				goto error;
+			}
+		}
+	}
+
 	return 0;
 
 error:
@@ -416,8 +495,11 @@ static int send_sessiond_channel(int sock,
 
 	/* The channel was sent successfully to the sessiond at this point. */
 	cds_list_for_each_entry(stream, &channel->streams.head, send_node) {
-		/* Try to send the stream to the relayd if one is available. */
-		ret = send_stream_to_relayd(stream);
+		/* Snapshot streams are sent to the relayd when recorded. */
+		if (channel->monitor) {
+			/* Try to send the stream to the relayd if one is available. */
+			ret = send_stream_to_relayd(stream);
+		}
 		if (ret < 0) {
 			/*
 			 * Flag that the relayd was the problem here probably due to a
@@ -891,10 +973,13 @@ int lttng_ustconsumer_recv_cmd(struct lttng_consumer_local_data *ctx,
 				msg.u.ask_channel.relayd_id, msg.u.ask_channel.key,
 				(enum lttng_event_output) msg.u.ask_channel.output,
 				msg.u.ask_channel.tracefile_size,
-				msg.u.ask_channel.tracefile_count);
+				msg.u.ask_channel.tracefile_count,
+				(enum lttng_compression) msg.u.ask_channel.compression,
+				msg.u.ask_channel.live_timer_interval);
 		if (!channel) {
 			goto end_channel_error;
 		}
+		channel->monitor = msg.u.ask_channel.monitor;
 
 		/* Build channel attributes from received message. */
 		attr.subbuf_size = msg.u.ask_channel.subbuf_size;
@@ -969,6 +1054,11 @@ int lttng_ustconsumer_recv_cmd(struct lttng_consumer_local_data *ctx,
 			goto end_channel_error;
 		}
 
+		if (msg.u.ask_channel.type != LTTNG_UST_CHAN_METADATA &&
+				channel->monitor && channel->relayd_id != -1) {
+			consumer_timer_live_start(channel, channel->live_timer_interval);
+		}
+
 		/*
 		 * Channel and streams are now created. Inform the session daemon that
 		 * everything went well and should wait to receive the channel and
@@ -1024,6 +1114,11 @@ int lttng_ustconsumer_recv_cmd(struct lttng_consumer_local_data *ctx,
 			goto error_fatal;
 		}
 
+		/* The streams of a snapshot channel stay in its list. */
+		if (!channel->monitor) {
+			goto end_msg_sessiond;
+		}
+
 		ret = send_streams_to_thread(channel, ctx);
 		if (ret < 0) {
 			/*
@@ -1071,6 +1166,30 @@ int lttng_ustconsumer_recv_cmd(struct lttng_consumer_local_data *ctx,
 
 		goto end_msg_sessiond;
 	}
+	case LTTNG_CONSUMER_SNAPSHOT_CHANNEL:
+	{
+		int ret;
+
+		if (msg.u.snapshot_channel.metadata) {
+			ret = lttng_consumer_snapshot_metadata_cache(msg.u.snapshot_channel.key,
+					msg.u.snapshot_channel.pathname,
+					msg.u.snapshot_channel.relayd_id);
+		} else {
+			ret = lttng_consumer_snapshot_channel(msg.u.snapshot_channel.key,
+					msg.u.snapshot_channel.pathname,
+					msg.u.snapshot_channel.relayd_id,
+					msg.u.snapshot_channel.max_stream_size, ctx);
+		}
+		if (ret == -ENOENT) {
+			ERR("UST snapshot channel %" PRIu64 " not found",
+					msg.u.snapshot_channel.key);
+			ret_code = LTTNG_ERR_UST_CHAN_NOT_FOUND;
+		} else if (ret < 0) {
+			ret_code = LTTNG_ERR_SNAPSHOT_FAIL;
+		}
+
+		goto end_msg_sessiond;
+	}
 	case LTTNG_CONSUMER_PUSH_METADATA:
 	{
 		int ret;
@@ -1218,6 +1337,118 @@ int lttng_ustconsumer_get_produced_snapshot(
 	return ustctl_snapshot_get_produced(stream->ustream, pos);
 }
 
+/*
+ * Get the consumed position
+ *
+ * Returns 0 on success, < 0 on error
+ */
+int lttng_ustconsumer_get_consumed_snapshot(
+		struct lttng_consumer_stream *stream, unsigned long *pos)
+{
+	assert(stream);
+	assert(stream->ustream);
+	assert(pos);
+
+	return ustctl_snapshot_get_consumed(stream->ustream, pos);
+}
+
+/*
+ * Record the unconsumed sub-buffers of an unmonitored stream in its snapshot
+ * output, at most the last max_stream_size bytes of it. Tracing goes on
+ * meanwhile so sub-buffers overwritten during the copy are skipped. The
+ * stream lock MUST be held.
+ *
+ * Returns 0 on success, < 0 on error
+ */
+int lttng_ustconsumer_snapshot_stream(struct lttng_consumer_stream *stream,
+		uint64_t max_stream_size, struct lttng_consumer_local_data *ctx)
+{
+	int ret;
+	ssize_t read_len;
+	unsigned long consumed_pos, produced_pos, len, subbuf_size;
+
+	assert(stream);
+	assert(stream->ustream);
+
+	/* Make the sub-buffer being written readable. */
+	ustctl_flush_buffer(stream->ustream, 1);
+
+	ret = lttng_ustconsumer_take_snapshot(stream);
+	if (ret < 0) {
+		ERR("Taking UST snapshot");
+		goto end;
+	}
+
+	ret = lttng_ustconsumer_get_produced_snapshot(stream, &produced_pos);
+	if (ret < 0) {
+		ERR("Produced UST snapshot position");
+		goto end;
+	}
+
+	ret = ustctl_snapshot_get_consumed(stream->ustream, &consumed_pos);
+	if (ret < 0) {
+		ERR("Consumed UST snapshot position");
+		goto end;
+	}
+
+	consumed_pos = consumer_snapshot_first_pos(consumed_pos, produced_pos,
+			stream->max_sb_size, max_stream_size);
+
+	while ((long) (produced_pos - consumed_pos) > 0) {
+		ret = ustctl_get_subbuf(stream->ustream, &consumed_pos);
+		if (ret < 0) {
+			if (ret != -EAGAIN) {
+				ERR("ustctl_get_subbuf snapshot (%d)", ret);
+				goto end;
+			}
+			DBG("UST snapshot skipping overwritten sub-buffer");
+			goto next;
+		}
+
+		ret = ustctl_get_subbuf_size(stream->ustream, &subbuf_size);
+		if (ret < 0) {
+			ERR("Snapshot ustctl_get_subbuf_size");
+			goto error_put_subbuf;
+		}
+
+		ret = ustctl_get_padded_subbuf_size(stream->ustream, &len);
+		if (ret < 0) {
+			ERR("Snapshot ustctl_get_padded_subbuf_size");
+			goto error_put_subbuf;
+		}
+
+		read_len = lttng_consumer_on_read_subbuffer_mmap(ctx, stream,
+				subbuf_size, len - subbuf_size);
+		if ((stream->net_seq_idx != (uint64_t) -1ULL &&
+					read_len != subbuf_size) ||
+				(stream->net_seq_idx == (uint64_t) -1ULL &&
+					read_len != len)) {
+			ERR("Error writing UST snapshot (ret: %zd != len: %lu)",
+					read_len, len);
+			ret = -1;
+			goto error_put_subbuf;
+		}
+
+		ret = ustctl_put_subbuf(stream->ustream);
+		if (ret < 0) {
+			ERR("Snapshot ustctl_put_subbuf");
+			goto end;
+		}
+next:
+		consumed_pos += stream->max_sb_size;
+	}
+
+	ret = 0;
+	goto end;
+
+error_put_subbuf:
+	if (ustctl_put_subbuf(stream->ustream) < 0) {
+		ERR("Snapshot ustctl_put_subbuf");
+	}
+end:
+	return ret;
+}
+
 /*
  * Called when the stream signal the consumer that it has hang up.
  */
@@ -1230,6 +1461,18 @@ void lttng_ustconsumer_on_stream_hangup(struct lttng_consumer_stream *stream)
 	stream->hangup_flush_done = 1;
 }
 
+/*
+ * Flush the current packet of a stream. Called with the stream lock held.
+ */
+void lttng_ustconsumer_flush_buffer(struct lttng_consumer_stream *stream,
+		int producer)
+{
+	assert(stream);
+	assert(stream->ustream);
+
+	ustctl_flush_buffer(stream->ustream, producer);
+}
+
 void lttng_ustconsumer_del_channel(struct lttng_consumer_channel *chan)
 {
 	assert(chan);
@@ -1348,9 +1591,13 @@ int lttng_ustconsumer_on_recv_stream(struct lttng_consumer_stream *stream)
 {
 	int ret;
 
-	/* Don't create anything if this is set for streaming. */
-	if (stream->net_seq_idx == (uint64_t) -1ULL) {
-		ret = utils_create_stream_file(stream->chan->pathname, stream->name,
+	/*
+	 * Don't create anything if this is set for streaming or if the tracefile
+	 * was already created with the other streams of the channel.
+	 */
+	if (stream->net_seq_idx == (uint64_t) -1ULL && stream->out_fd < 0) {
+		ret = utils_create_stream_file(consumer_channel_get_dirfd(stream->chan),
+				stream->chan->pathname, stream->name,
 				stream->chan->tracefile_size, stream->tracefile_count_current,
 				stream->uid, stream->gid);
 		if (ret < 0) {
@@ -1359,6 +1606,13 @@ int lttng_ustconsumer_on_recv_stream(struct lttng_consumer_stream *stream)
 		stream->out_fd = ret;
 		stream->tracefile_size_current = 0;
 	}
+	if (stream->out_fd >= 0) {
+		consumer_stream_cache_out_fd(stream);
+	}
+	if (stream->net_seq_idx == (uint64_t) -1ULL && stream->index_fd < 0) {
+		/* A stream without index is still traced. */
+		(void) consumer_stream_create_index(stream);
+	}
 	ret = 0;
 
 error:
@@ -31,6 +31,12 @@ int lttng_ustconsumer_take_snapshot(struct lttng_consumer_stream *stream);
 int lttng_ustconsumer_get_produced_snapshot(
 		struct lttng_consumer_stream *stream, unsigned long *pos);
 
+int lttng_ustconsumer_get_consumed_snapshot(
+		struct lttng_consumer_stream *stream, unsigned long *pos);
+
+int lttng_ustconsumer_snapshot_stream(struct lttng_consumer_stream *stream,
+		uint64_t max_stream_size, struct lttng_consumer_local_data *ctx);
+
 int lttng_ustconsumer_recv_cmd(struct lttng_consumer_local_data *ctx,
 		int sock, struct pollfd *consumer_sockpoll);
 
@@ -44,6 +50,8 @@ int lttng_ustconsumer_read_subbuffer(struct lttng_consumer_stream *stream,
 int lttng_ustconsumer_on_recv_stream(struct lttng_consumer_stream *stream);
 
 void lttng_ustconsumer_on_stream_hangup(struct lttng_consumer_stream *stream);
+void lttng_ustconsumer_flush_buffer(struct lttng_consumer_stream *stream,
+		int producer);
 
 int lttng_ustctl_get_mmap_read_offset(struct lttng_consumer_stream *stream,
 		unsigned long *off);
@@ -91,6 +99,20 @@ int lttng_ustconsumer_get_produced_snapshot(
 	return -ENOSYS;
 }
 
+static inline
+int lttng_ustconsumer_get_consumed_snapshot(
+		struct lttng_consumer_stream *stream, unsigned long *pos)
+{
+	return -ENOSYS;
+}
+
+static inline
+int lttng_ustconsumer_snapshot_stream(struct lttng_consumer_stream *stream,
+		uint64_t max_stream_size, struct lttng_consumer_local_data *ctx)
+{
+	return -ENOSYS;
+}
+
 static inline
 int lttng_ustconsumer_recv_cmd(struct lttng_consumer_local_data *ctx,
 		int sock, struct pollfd *consumer_sockpoll)
@@ -138,6 +160,12 @@ void lttng_ustconsumer_on_stream_hangup(struct lttng_consumer_stream *stream)
 {
 }
 
+static inline
+void lttng_ustconsumer_flush_buffer(struct lttng_consumer_stream *stream,
+		int producer)
+{
+}
+
 static inline
 int lttng_ustctl_get_mmap_read_offset(struct lttng_consumer_stream *stream,
 		unsigned long *off)
@@ -306,66 +306,232 @@ error:
 }
 
 /*
- * Create the stream tracefile on disk.
+ * Format the path of a stream tracefile in buf. The path is relative to the
+ * channel directory if it is opened (dirfd >= 0).
  *
  * Return 0 on success or else a negative value.
  */
-LTTNG_HIDDEN
-int utils_create_stream_file(char *path_name, char *file_name, uint64_t size,
-		uint64_t count, int uid, int gid)
+static int stream_file_path(char *buf, size_t len, int dirfd,
+		const char *path_name, char *file_name, uint64_t size, uint64_t count)
 {
-	int ret, out_fd, flags, mode;
-	char full_path[PATH_MAX], *path_name_id = NULL, *path;
+	int ret;
+
+	/*
+	 * If we split the trace in multiple files, we have to add the count at the
+	 * end of the tracefile name
+	 */
+	if (dirfd >= 0 && size > 0) {
+		ret = snprintf(buf, len, "%s_%" PRIu64, file_name, count);
+	} else if (dirfd >= 0) {
+		ret = snprintf(buf, len, "%s", file_name);
+	} else if (size > 0) {
+		ret = snprintf(buf, len, "%s/%s_%" PRIu64, path_name, file_name, count);
+	} else {
+		ret = snprintf(buf, len, "%s/%s", path_name, file_name);
+	}
+	if (ret < 0 || (size_t) ret >= len) {
+		ERR("Stream file path too long for %s/%s", path_name, file_name);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Open the stream tracefile with the given flags, relative to the channel
+ * directory dirfd if it is opened else at its full path.
+ *
+ * Return the file descriptor or else a negative value.
+ */
+static int open_stream_file(int dirfd, const char *path_name, char *file_name,
+		uint64_t size, uint64_t count, int uid, int gid, int flags)
+{
+	int ret, out_fd, mode;
+	char path[PATH_MAX];
 
 	assert(path_name);
 	assert(file_name);
 
-	ret = snprintf(full_path, sizeof(full_path), "%s/%s",
-			path_name, file_name);
+	ret = stream_file_path(path, sizeof(path), dirfd, path_name, file_name,
+			size, count);
 	if (ret < 0) {
-		PERROR("snprintf create output file");
 		goto error;
 	}
 
+	/* Open with 660 mode */
+	mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP;
+
+	if (uid < 0 || gid < 0) {
+		if (dirfd >= 0) {
+			out_fd = openat(dirfd, path, flags, mode);
+		} else {
+			out_fd = open(path, flags, mode);
+		}
+	} else {
+		out_fd = run_as_openat(dirfd, path, flags, mode, uid, gid);
+	}
+	if (out_fd < 0) {
+		PERROR("open stream path %s/%s", path_name, path);
+		goto error;
+	}
+	ret = out_fd;
+
+error:
+	return ret;
+}
+
+/*
+ * Create the stream tracefile on disk, relative to the channel directory
+ * dirfd if it is opened else at its full path.
+ *
+ * Return the file descriptor or else a negative value.
+ */
+LTTNG_HIDDEN
+int utils_create_stream_file(int dirfd, const char *path_name, char *file_name,
+		uint64_t size, uint64_t count, int uid, int gid)
+{
 	/*
-	 * If we split the trace in multiple files, we have to add the count at the
-	 * end of the tracefile name
+	 * Readable so the header of a packet spliced in the file can be read back
+	 * to index it.
 	 */
-	if (size > 0) {
-		ret = asprintf(&path_name_id, "%s_%" PRIu64, full_path, count);
+	return open_stream_file(dirfd, path_name, file_name, size, count, uid,
+			gid, O_RDWR | O_CREAT | O_TRUNC);
+}
+
+/*
+ * Reopen an existing stream tracefile for appending to it, once its
+ * descriptor was closed while the stream was idle.
+ *
+ * Return the file descriptor or else a negative value.
+ */
+LTTNG_HIDDEN
+int utils_reopen_stream_file(int dirfd, const char *path_name, char *file_name,
+		uint64_t size, uint64_t count, int uid, int gid)
+{
+	return open_stream_file(dirfd, path_name, file_name, size, count, uid,
+			gid, O_RDWR | O_APPEND);
+}
+
+/*
+ * Open an existing stream tracefile read-only at its full path, with the
+ * credentials of the caller.
+ *
+ * Return the file descriptor or a negative value, errno being set.
+ */
+LTTNG_HIDDEN
+int utils_open_stream_file(const char *path_name, char *file_name,
+		uint64_t size, uint64_t count)
+{
+	int ret;
+	char path[PATH_MAX];
+
+	assert(path_name);
+	assert(file_name);
+
+	ret = stream_file_path(path, sizeof(path), -1, path_name, file_name,
+			size, count);
+	if (ret < 0) {
+		errno = ENAMETOOLONG;
+		goto error;
+	}
+
+	ret = open(path, O_RDONLY);
+
+error:
+	return ret;
+}
+
+/*
+ * Create the tracefiles of several streams of the same channel on disk,
+ * relative to the channel directory dirfd if it is opened, using a single
+ * run_as request when a uid/gid is given. The file descriptor of each stream
+ * is stored in fds.
+ *
+ * Return 0 on success or else a negative value, in which case no file
+ * descriptor is returned.
+ */
+LTTNG_HIDDEN
+int utils_create_stream_files(int dirfd, const char *path_name,
+		char **file_names, unsigned int nb_files, uint64_t size,
+		uint64_t count, int uid, int gid, int *fds)
+{
+	int ret, flags, mode;
+	unsigned int i;
+	char **paths;
+
+	assert(path_name);
+	assert(file_names);
+	assert(fds);
+
+	paths = zmalloc(nb_files * (sizeof(*paths) + PATH_MAX));
+	if (!paths) {
+		PERROR("zmalloc stream paths");
+		ret = -ENOMEM;
+		goto error;
+	}
+
+	for (i = 0; i < nb_files; i++) {
+		/* The path buffers follow the pointer array. */
+		paths[i] = (char *) (paths + nb_files) + i * PATH_MAX;
+		ret = stream_file_path(paths[i], PATH_MAX, dirfd, path_name,
+				file_names[i], size, count);
 		if (ret < 0) {
-			PERROR("Allocating path name ID");
-			goto error;
+			goto error_free;
 		}
-		path = path_name_id;
-	} else {
-		path = full_path;
 	}
 
-	flags = O_WRONLY | O_CREAT | O_TRUNC;
+	/*
+	 * Readable so the header of a packet spliced in the file can be read back
+	 * to index it.
+	 */
+	flags = O_RDWR | O_CREAT | O_TRUNC;
 	/* Open with 660 mode */
 	mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP;
 
 	if (uid < 0 || gid < 0) {
-		out_fd = open(path, flags, mode);
+		for (i = 0; i < nb_files; i++) {
+			if (dirfd >= 0) {
+				fds[i] = openat(dirfd, paths[i], flags, mode);
+			} else {
+				fds[i] = open(paths[i], flags, mode);
+			}
+		}
 	} else {
-		out_fd = run_as_open(path, flags, mode, uid, gid);
+		ret = run_as_openat_batch(dirfd, (const char **) paths, nb_files,
+				flags, mode, uid, gid, fds);
+		if (ret < 0) {
+			PERROR("open stream files in %s", path_name);
+			goto error_free;
+		}
 	}
-	if (out_fd < 0) {
-		PERROR("open stream path %s", path);
-		goto error_open;
+
+	ret = 0;
+	for (i = 0; i < nb_files; i++) {
+		if (fds[i] < 0) {
+			PERROR("open stream path %s/%s", path_name, paths[i]);
+			ret = -1;
+		}
+	}
+	if (ret < 0) {
+		/* All or nothing. */
+		for (i = 0; i < nb_files; i++) {
+			if (fds[i] >= 0) {
+				(void) close(fds[i]);
+			}
+			fds[i] = -1;
+		}
 	}
-	ret = out_fd;
 
-error_open:
-	free(path_name_id);
+error_free:
+	free(paths);
 error:
 	return ret;
 }
 
 /*
  * Change the output tracefile according to the given size and count The
- * new_count pointer is set during this operation.
+ * new_count pointer is set during this operation. The new tracefile is created
+ * relative to the channel directory dirfd if it is opened.
  *
  * From the consumer, the stream lock MUST be held before calling this function
  * because we are modifying the stream status.
@@ -373,8 +539,9 @@ error:
  * Return 0 on success or else a negative value.
  */
 LTTNG_HIDDEN
-int utils_rotate_stream_file(char *path_name, char *file_name, uint64_t size,
-		uint64_t count, int uid, int gid, int out_fd, uint64_t *new_count)
+int utils_rotate_stream_file(int dirfd, const char *path_name, char *file_name,
+		uint64_t size, uint64_t count, int uid, int gid, int out_fd,
+		uint64_t *new_count)
 {
 	int ret;
 
@@ -390,8 +557,8 @@ int utils_rotate_stream_file(char *path_name, char *file_name, uint64_t size,
 		(*new_count)++;
 	}
 
-	return utils_create_stream_file(path_name, file_name, size, *new_count,
-			uid, gid);
+	return utils_create_stream_file(dirfd, path_name, file_name, size,
+			*new_count, uid, gid);
 error:
 	return ret;
 }
@@ -34,10 +34,18 @@ char *utils_strdupdelim(const char *begin, const char *end);
 int utils_set_fd_cloexec(int fd);
 int utils_create_pid_file(pid_t pid, const char *filepath);
 int utils_mkdir_recursive(const char *path, mode_t mode);
-int utils_create_stream_file(char *path_name, char *file_name, uint64_t size,
-		uint64_t count, int uid, int gid);
-int utils_rotate_stream_file(char *path_name, char *file_name, uint64_t size,
-		uint64_t count, int uid, int gid, int out_fd, uint64_t *new_count);
+int utils_create_stream_file(int dirfd, const char *path_name, char *file_name,
+		uint64_t size, uint64_t count, int uid, int gid);
+int utils_reopen_stream_file(int dirfd, const char *path_name, char *file_name,
+		uint64_t size, uint64_t count, int uid, int gid);
+int utils_create_stream_files(int dirfd, const char *path_name,
+		char **file_names, unsigned int nb_files, uint64_t size,
+		uint64_t count, int uid, int gid, int *fds);
+int utils_open_stream_file(const char *path_name, char *file_name,
+		uint64_t size, uint64_t count);
+int utils_rotate_stream_file(int dirfd, const char *path_name, char *file_name,
+		uint64_t size, uint64_t count, int uid, int gid, int out_fd,
+		uint64_t *new_count);
 int utils_parse_size_suffix(char *str, uint64_t *size);
 int utils_get_count_order_u32(uint32_t x);
 
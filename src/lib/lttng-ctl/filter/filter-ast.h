@@ -185,8 +185,11 @@ int filter_visitor_print_xml(struct filter_parser_ctx *ctx, FILE *stream,
 			int indent);
 int filter_visitor_ir_generate(struct filter_parser_ctx *ctx);
 void filter_ir_free(struct filter_parser_ctx *ctx);
+void filter_ir_free_op(struct ir_op *op);
+int filter_visitor_ir_optimize(struct filter_parser_ctx *ctx);
 int filter_visitor_bytecode_generate(struct filter_parser_ctx *ctx);
 void filter_bytecode_free(struct filter_parser_ctx *ctx);
+int filter_bytecode_count_ops(struct filter_parser_ctx *ctx);
 int filter_visitor_ir_check_binary_op_nesting(struct filter_parser_ctx *ctx);
 int filter_visitor_ir_check_binary_comparator(struct filter_parser_ctx *ctx);
 
@@ -169,6 +169,75 @@ int bytecode_patch(struct lttng_filter_bytecode_alloc **fb,
 	return 0;
 }
 
+/*
+ * Return the typed comparator matching a generic comparator when the type
+ * of both operands is known when generating the bytecode, which spares the
+ * tracer the runtime specialization. Field and context references are only
+ * typed once linked by the tracer, so they keep the generic comparator.
+ */
+static
+filter_opcode_t specialize_binary_compare(filter_opcode_t op,
+		struct ir_op *left, struct ir_op *right)
+{
+	filter_opcode_t base;
+
+	if (op < FILTER_OP_EQ || op > FILTER_OP_LE) {
+		return op;
+	}
+
+	if (left->data_type == IR_DATA_STRING
+			&& right->data_type == IR_DATA_STRING) {
+		base = FILTER_OP_EQ_STRING;
+	} else if (left->data_type == IR_DATA_NUMERIC
+			&& right->data_type == IR_DATA_NUMERIC) {
+		base = FILTER_OP_EQ_S64;
+	} else if (left->data_type == IR_DATA_FLOAT
+			&& right->data_type == IR_DATA_FLOAT) {
+		base = FILTER_OP_EQ_DOUBLE;
+	} else if (left->data_type == IR_DATA_FLOAT
+			&& right->data_type == IR_DATA_NUMERIC) {
+		base = FILTER_OP_EQ_DOUBLE_S64;
+	} else if (left->data_type == IR_DATA_NUMERIC
+			&& right->data_type == IR_DATA_FLOAT) {
+		base = FILTER_OP_EQ_S64_DOUBLE;
+	} else {
+		return op;
+	}
+
+	/* Every comparator family follows the EQ, NE, GT, LT, GE, LE order. */
+	return base + (op - FILTER_OP_EQ);
+}
+
+/*
+ * Return the typed unary operator when the operand type is known.
+ */
+static
+filter_opcode_t specialize_unary(filter_opcode_t op, struct ir_op *child)
+{
+	switch (child->data_type) {
+	case IR_DATA_NUMERIC:
+		switch (op) {
+		case FILTER_OP_UNARY_MINUS:
+			return FILTER_OP_UNARY_MINUS_S64;
+		case FILTER_OP_UNARY_NOT:
+			return FILTER_OP_UNARY_NOT_S64;
+		default:
+			return op;
+		}
+	case IR_DATA_FLOAT:
+		switch (op) {
+		case FILTER_OP_UNARY_MINUS:
+			return FILTER_OP_UNARY_MINUS_DOUBLE;
+		case FILTER_OP_UNARY_NOT:
+			return FILTER_OP_UNARY_NOT_DOUBLE;
+		default:
+			return op;
+		}
+	default:
+		return op;
+	}
+}
+
 static
 int visit_node_root(struct filter_parser_ctx *ctx, struct ir_op *node)
 {
@@ -316,10 +385,12 @@ int visit_node_unary(struct filter_parser_ctx *ctx, struct ir_op *node)
 		/* Nothing to do. */
 		return 0;
 	case AST_UNARY_MINUS:
-		insn.op = FILTER_OP_UNARY_MINUS;
+		insn.op = specialize_unary(FILTER_OP_UNARY_MINUS,
+				node->u.unary.child);
 		return bytecode_push(&ctx->bytecode, &insn, 1, sizeof(insn));
 	case AST_UNARY_NOT:
-		insn.op = FILTER_OP_UNARY_NOT;
+		insn.op = specialize_unary(FILTER_OP_UNARY_NOT,
+				node->u.unary.child);
 		return bytecode_push(&ctx->bytecode, &insn, 1, sizeof(insn));
 	}
 }
@@ -405,6 +476,8 @@ int visit_node_binary(struct filter_parser_ctx *ctx, struct ir_op *node)
 		insn.op = FILTER_OP_LE;
 		break;
 	}
+	insn.op = specialize_binary_compare(insn.op, node->u.binary.left,
+			node->u.binary.right);
 	return bytecode_push(&ctx->bytecode, &insn, 1, sizeof(insn));
 }
 
@@ -525,6 +598,71 @@ void filter_bytecode_free(struct filter_parser_ctx *ctx)
 	ctx->bytecode_reloc = NULL;
 }
 
+/*
+ * Count the instructions of the generated bytecode, relocation table
+ * excluded.
+ *
+ * Return the number of instructions or a negative value on error.
+ */
+LTTNG_HIDDEN
+int filter_bytecode_count_ops(struct filter_parser_ctx *ctx)
+{
+	struct lttng_filter_bytecode *b;
+	uint32_t pc = 0;
+	int nr_ops = 0;
+
+	if (!ctx->bytecode) {
+		return -EINVAL;
+	}
+	b = &ctx->bytecode->b;
+
+	while (pc < b->reloc_table_offset) {
+		filter_opcode_t op = (filter_opcode_t) b->data[pc];
+
+		switch (op) {
+		case FILTER_OP_RETURN:
+			pc += sizeof(struct return_op);
+			break;
+		case FILTER_OP_MUL ... FILTER_OP_LE_S64_DOUBLE:
+			pc += sizeof(struct binary_op);
+			break;
+		case FILTER_OP_UNARY_PLUS ... FILTER_OP_UNARY_NOT_DOUBLE:
+			pc += sizeof(struct unary_op);
+			break;
+		case FILTER_OP_AND:
+		case FILTER_OP_OR:
+			pc += sizeof(struct logical_op);
+			break;
+		case FILTER_OP_LOAD_FIELD_REF ... FILTER_OP_LOAD_FIELD_REF_DOUBLE:
+		case FILTER_OP_GET_CONTEXT_REF ... FILTER_OP_GET_CONTEXT_REF_DOUBLE:
+			pc += sizeof(struct load_op) + sizeof(struct field_ref);
+			break;
+		case FILTER_OP_LOAD_STRING:
+			pc += sizeof(struct load_op)
+				+ strlen(&b->data[pc + sizeof(struct load_op)]) + 1;
+			break;
+		case FILTER_OP_LOAD_S64:
+			pc += sizeof(struct load_op)
+				+ sizeof(struct literal_numeric);
+			break;
+		case FILTER_OP_LOAD_DOUBLE:
+			pc += sizeof(struct load_op)
+				+ sizeof(struct literal_double);
+			break;
+		case FILTER_OP_CAST_TO_S64 ... FILTER_OP_CAST_NOP:
+			pc += sizeof(struct cast_op);
+			break;
+		case FILTER_OP_UNKNOWN:
+		default:
+			fprintf(stderr, "[error] Unknown bytecode op %u in %s\n",
+				(unsigned int) op, __func__);
+			return -EINVAL;
+		}
+		nr_ops++;
+	}
+	return nr_ops;
+}
+
 LTTNG_HIDDEN
 int filter_visitor_bytecode_generate(struct filter_parser_ctx *ctx)
 {
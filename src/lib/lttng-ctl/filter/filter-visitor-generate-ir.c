@@ -520,6 +520,12 @@ void filter_free_ir_recursive(struct ir_op *op)
 	free(op);
 }
 
+LTTNG_HIDDEN
+void filter_ir_free_op(struct ir_op *op)
+{
+	filter_free_ir_recursive(op);
+}
+
 static
 struct ir_op *make_expression(struct filter_parser_ctx *ctx,
 		struct filter_node *node, enum ir_side side)
@@ -0,0 +1,459 @@
+/*
+ * filter-visitor-ir-optimize.c
+ *
+ * LTTng filter IR optimization pass
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License, version 2.1 only,
+ * as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include "filter-ast.h"
+#include "filter-parser.h"
+#include "filter-ir.h"
+
+#include <common/macros.h>
+
+/*
+ * Filter expressions have no side effect, which is what allows this pass
+ * to drop operands. They can however fail at runtime, for instance when
+ * a field does not have the type the comparison expects, and the tracer
+ * interpreter then discards the event whatever the rest of the expression
+ * gives. An operand the unoptimized bytecode evaluates is therefore only
+ * dropped when it cannot fail, and operands are never reordered since the
+ * short-circuit decides which of them are evaluated.
+ */
+
+static
+int optimize_recursive(struct ir_op **nodep);
+
+static
+int is_literal(struct ir_op *node)
+{
+	return node->op == IR_OP_LOAD
+		&& (node->data_type == IR_DATA_NUMERIC
+			|| node->data_type == IR_DATA_FLOAT
+			|| node->data_type == IR_DATA_STRING);
+}
+
+static
+int is_numeric_literal(struct ir_op *node)
+{
+	return node->op == IR_OP_LOAD
+		&& (node->data_type == IR_DATA_NUMERIC
+			|| node->data_type == IR_DATA_FLOAT);
+}
+
+/*
+ * Return the truth value of a numeric or float literal, as seen by a
+ * logical operator. The tracer casts a double operand with
+ * FILTER_OP_CAST_DOUBLE_TO_S64, which truncates toward zero: 0.5 is false.
+ * Compare against the range instead of casting, since casting an out of
+ * range double is undefined; such a value truncates to a non-zero s64
+ * anyway. NaN cannot be written as a filter literal.
+ */
+static
+int literal_truth(struct ir_op *node)
+{
+	if (node->data_type == IR_DATA_FLOAT) {
+		return node->u.load.u.flt >= 1.0 || node->u.load.u.flt <= -1.0;
+	}
+	return node->u.load.u.num != 0;
+}
+
+/*
+ * Return 1 if the node always evaluates to a s64 holding either 0 or 1,
+ * which means it can replace a logical operator without changing the
+ * result seen by the parent.
+ */
+static
+int is_boolean_valued(struct ir_op *node)
+{
+	if (node->data_type != IR_DATA_NUMERIC) {
+		return 0;
+	}
+	switch (node->op) {
+	case IR_OP_BINARY:
+	case IR_OP_LOGICAL:
+		return 1;
+	case IR_OP_UNARY:
+		return node->u.unary.type == AST_UNARY_NOT;
+	case IR_OP_LOAD:
+		return node->u.load.u.num == 0 || node->u.load.u.num == 1;
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Turn a node into a numeric literal in place, freeing its children.
+ */
+static
+void make_numeric_literal(struct ir_op *node, int64_t v)
+{
+	switch (node->op) {
+	case IR_OP_UNARY:
+		filter_ir_free_op(node->u.unary.child);
+		break;
+	case IR_OP_BINARY:
+		filter_ir_free_op(node->u.binary.left);
+		filter_ir_free_op(node->u.binary.right);
+		break;
+	case IR_OP_LOGICAL:
+		filter_ir_free_op(node->u.logical.left);
+		filter_ir_free_op(node->u.logical.right);
+		break;
+	case IR_OP_LOAD:
+		assert(node->data_type == IR_DATA_NUMERIC
+			|| node->data_type == IR_DATA_FLOAT);
+		break;
+	default:
+		assert(0);
+	}
+	memset(&node->u, 0, sizeof(node->u));
+	node->op = IR_OP_LOAD;
+	node->data_type = IR_DATA_NUMERIC;
+	node->signedness = IR_SIGNED;
+	node->u.load.u.num = v;
+}
+
+/*
+ * Replace *nodep by one of its children. The child inherits the side of
+ * the node it replaces. Only the node itself is freed, the other children
+ * (if any) must have been freed or detached by the caller.
+ */
+static
+void replace_by_child(struct ir_op **nodep, struct ir_op *child)
+{
+	struct ir_op *node = *nodep;
+
+	child->side = node->side;
+	*nodep = child;
+	free(node);
+}
+
+/*
+ * Return 1 if evaluating the subtree can fail at runtime. Field and context
+ * references are typed by the event, and only comparisons of a string with
+ * a string or of two numbers are known to be implemented by the tracer.
+ */
+static
+int may_fail(struct ir_op *node)
+{
+	switch (node->op) {
+	case IR_OP_LOAD:
+		return !is_literal(node);
+	case IR_OP_UNARY:
+		return may_fail(node->u.unary.child);
+	case IR_OP_BINARY:
+	{
+		struct ir_op *left = node->u.binary.left;
+		struct ir_op *right = node->u.binary.right;
+
+		switch (node->u.binary.type) {
+		case AST_OP_EQ:
+		case AST_OP_NE:
+		case AST_OP_GT:
+		case AST_OP_LT:
+		case AST_OP_GE:
+		case AST_OP_LE:
+			break;
+		default:
+			return 1;
+		}
+		if (may_fail(left) || may_fail(right)) {
+			return 1;
+		}
+		return (left->data_type == IR_DATA_STRING)
+			!= (right->data_type == IR_DATA_STRING);
+	}
+	case IR_OP_LOGICAL:
+		return may_fail(node->u.logical.left)
+			|| may_fail(node->u.logical.right);
+	default:
+		return 1;
+	}
+}
+
+/*
+ * Compare two string literals the way the tracer does. Literals holding a
+ * '*' wildcard or a '\' escape are not folded, so the caller can keep the
+ * comparison for the tracer to evaluate.
+ *
+ * Return 0 on success and set *result to the strcmp() result, else -1.
+ */
+static
+int fold_strcmp(const char *a, const char *b, int *result)
+{
+	if (strpbrk(a, "*\\") || strpbrk(b, "*\\")) {
+		return -1;
+	}
+	*result = strcmp(a, b);
+	return 0;
+}
+
+/*
+ * Evaluate a comparator on two literals.
+ *
+ * Return 0 on success and set *result to 0 or 1, else -1 if the comparison
+ * cannot be folded.
+ */
+static
+int fold_binary_compare(enum op_type type, struct ir_op *left,
+		struct ir_op *right, int64_t *result)
+{
+	int cmp;
+
+	if (left->data_type == IR_DATA_STRING
+			|| right->data_type == IR_DATA_STRING) {
+		if (left->data_type != right->data_type) {
+			return -1;
+		}
+		if (fold_strcmp(left->u.load.u.string, right->u.load.u.string,
+					&cmp)) {
+			return -1;
+		}
+	} else if (left->data_type == IR_DATA_FLOAT
+			|| right->data_type == IR_DATA_FLOAT) {
+		double l, r;
+
+		/* Mixed s64/double comparisons are done as double. */
+		l = left->data_type == IR_DATA_FLOAT ?
+			left->u.load.u.flt : (double) left->u.load.u.num;
+		r = right->data_type == IR_DATA_FLOAT ?
+			right->u.load.u.flt : (double) right->u.load.u.num;
+		cmp = (l > r) - (l < r);
+	} else {
+		int64_t l = left->u.load.u.num, r = right->u.load.u.num;
+
+		cmp = (l > r) - (l < r);
+	}
+
+	switch (type) {
+	case AST_OP_EQ:
+		*result = cmp == 0;
+		break;
+	case AST_OP_NE:
+		*result = cmp != 0;
+		break;
+	case AST_OP_GT:
+		*result = cmp > 0;
+		break;
+	case AST_OP_LT:
+		*result = cmp < 0;
+		break;
+	case AST_OP_GE:
+		*result = cmp >= 0;
+		break;
+	case AST_OP_LE:
+		*result = cmp <= 0;
+		break;
+	default:
+		return -1;
+	}
+	return 0;
+}
+
+static
+int optimize_unary(struct ir_op **nodep)
+{
+	int ret;
+	struct ir_op *node = *nodep, *child;
+
+	ret = optimize_recursive(&node->u.unary.child);
+	if (ret) {
+		return ret;
+	}
+	child = node->u.unary.child;
+
+	/* Unary plus generates no instruction, drop it from the tree. */
+	if (node->u.unary.type == AST_UNARY_PLUS) {
+		replace_by_child(nodep, child);
+		return 0;
+	}
+
+	if (is_numeric_literal(child)) {
+		switch (node->u.unary.type) {
+		case AST_UNARY_MINUS:
+			if (child->data_type == IR_DATA_FLOAT) {
+				child->u.load.u.flt = -child->u.load.u.flt;
+			} else if (child->u.load.u.num == INT64_MIN) {
+				/* Overflows, leave it to the tracer. */
+				return 0;
+			} else {
+				child->u.load.u.num = -child->u.load.u.num;
+			}
+			replace_by_child(nodep, child);
+			return 0;
+		case AST_UNARY_NOT:
+			/* Keep the operand type, as the tracer does. */
+			if (child->data_type == IR_DATA_FLOAT) {
+				child->u.load.u.flt = !child->u.load.u.flt;
+			} else {
+				child->u.load.u.num = !child->u.load.u.num;
+			}
+			replace_by_child(nodep, child);
+			return 0;
+		default:
+			return 0;
+		}
+	}
+
+	/* !!x is x when x is already a boolean. */
+	if (node->u.unary.type == AST_UNARY_NOT && child->op == IR_OP_UNARY
+			&& child->u.unary.type == AST_UNARY_NOT
+			&& is_boolean_valued(child->u.unary.child)) {
+		struct ir_op *grandchild = child->u.unary.child;
+
+		free(child);
+		replace_by_child(nodep, grandchild);
+	}
+	return 0;
+}
+
+static
+int optimize_binary(struct ir_op **nodep)
+{
+	int ret;
+	int64_t result;
+	struct ir_op *node = *nodep;
+
+	ret = optimize_recursive(&node->u.binary.left);
+	if (ret) {
+		return ret;
+	}
+	ret = optimize_recursive(&node->u.binary.right);
+	if (ret) {
+		return ret;
+	}
+
+	if (!is_literal(node->u.binary.left)
+			|| !is_literal(node->u.binary.right)) {
+		return 0;
+	}
+	ret = fold_binary_compare(node->u.binary.type, node->u.binary.left,
+			node->u.binary.right, &result);
+	if (ret) {
+		/* Not foldable, leave it to the tracer. */
+		return 0;
+	}
+	make_numeric_literal(node, result);
+	return 0;
+}
+
+static
+int optimize_logical(struct ir_op **nodep)
+{
+	int ret;
+	struct ir_op *node = *nodep, *left, *right, *constant, *other;
+	int is_and;
+
+	ret = optimize_recursive(&node->u.logical.left);
+	if (ret) {
+		return ret;
+	}
+	ret = optimize_recursive(&node->u.logical.right);
+	if (ret) {
+		return ret;
+	}
+	left = node->u.logical.left;
+	right = node->u.logical.right;
+	is_and = node->u.logical.type == AST_OP_AND;
+
+	if (is_numeric_literal(left)) {
+		constant = left;
+		other = right;
+	} else if (is_numeric_literal(right)) {
+		constant = right;
+		other = left;
+	} else {
+		return 0;
+	}
+
+	/*
+	 * "false && x" and "true || x" are constant. x is not evaluated when
+	 * the constant comes first, else it must not be able to fail.
+	 */
+	if (literal_truth(constant) != is_and) {
+		if (constant == right && may_fail(other)) {
+			return 0;
+		}
+		make_numeric_literal(node, !is_and);
+		return 0;
+	}
+
+	/*
+	 * "true && x" and "false || x" reduce to x, provided x already
+	 * evaluates to 0 or 1.
+	 */
+	if (is_numeric_literal(other)) {
+		make_numeric_literal(node, literal_truth(other));
+		return 0;
+	}
+	if (is_boolean_valued(other)) {
+		filter_ir_free_op(constant);
+		replace_by_child(nodep, other);
+	}
+	return 0;
+}
+
+static
+int optimize_recursive(struct ir_op **nodep)
+{
+	struct ir_op *node = *nodep;
+
+	switch (node->op) {
+	case IR_OP_UNKNOWN:
+	default:
+		fprintf(stderr, "[error] %s: unknown op type\n", __func__);
+		return -EINVAL;
+
+	case IR_OP_ROOT:
+	{
+		int ret;
+
+		ret = optimize_recursive(&node->u.root.child);
+		if (ret) {
+			return ret;
+		}
+		node->data_type = node->u.root.child->data_type;
+		node->signedness = node->u.root.child->signedness;
+		return 0;
+	}
+	case IR_OP_LOAD:
+		return 0;
+	case IR_OP_UNARY:
+		return optimize_unary(nodep);
+	case IR_OP_BINARY:
+		return optimize_binary(nodep);
+	case IR_OP_LOGICAL:
+		return optimize_logical(nodep);
+	}
+}
+
+/*
+ * Optimize the IR tree before bytecode generation: fold constant
+ * sub-expressions and prune the dead logical branches. Must run after the
+ * IR validation visitors.
+ */
+LTTNG_HIDDEN
+int filter_visitor_ir_optimize(struct filter_parser_ctx *ctx)
+{
+	return optimize_recursive(&ctx->ir_root);
+}
@@ -952,6 +952,16 @@ int lttng_enable_event_with_filter(struct lttng_handle *handle,
 	}
 	dbg_printf("done\n");
 
+	dbg_printf("Optimizing IR... ");
+	fflush(stdout);
+	ret = filter_visitor_ir_optimize(ctx);
+	if (ret) {
+		fprintf(stderr, "Optimize IR error\n");
+		ret = -LTTNG_ERR_FILTER_INVAL;
+		goto parse_error;
+	}
+	dbg_printf("done\n");
+
 	dbg_printf("Generating bytecode... ");
 	fflush(stdout);
 	ret = filter_visitor_bytecode_generate(ctx);
@@ -963,6 +973,8 @@ int lttng_enable_event_with_filter(struct lttng_handle *handle,
 	dbg_printf("done\n");
 	dbg_printf("Size of bytecode generated: %u bytes.\n",
 		bytecode_get_len(&ctx->bytecode->b));
+	dbg_printf("Number of bytecode instructions: %d\n",
+		filter_bytecode_count_ops(ctx));
 
 	memset(&lsm, 0, sizeof(lsm));
 
@@ -1120,6 +1132,7 @@ int lttng_list_tracepoints(struct lttng_handle *handle,
 		return -LTTNG_ERR_INVALID;
 	}
 
+	memset(&lsm, 0, sizeof(lsm));
 	lsm.cmd_type = LTTNG_LIST_TRACEPOINTS;
 	copy_lttng_domain(&lsm.domain, &handle->domain);
 
@@ -1131,6 +1144,38 @@ int lttng_list_tracepoints(struct lttng_handle *handle,
 	return ret / sizeof(struct lttng_event);
 }
 
+/*
+ *  Lists the available tracepoints of domain matching the query.
+ *  Sets the contents of the events array.
+ *  Returns the number of lttng_event entries in events;
+ *  on error, returns a negative value.
+ */
+int lttng_list_tracepoints_query(struct lttng_handle *handle,
+		const struct lttng_tracepoint_query *query,
+		struct lttng_event **events)
+{
+	int ret;
+	struct lttcomm_session_msg lsm;
+
+	if (handle == NULL || query == NULL) {
+		return -LTTNG_ERR_INVALID;
+	}
+
+	memset(&lsm, 0, sizeof(lsm));
+	lsm.cmd_type = LTTNG_LIST_TRACEPOINTS_QUERY;
+	copy_lttng_domain(&lsm.domain, &handle->domain);
+	memcpy(&lsm.u.tp_query, query, sizeof(lsm.u.tp_query));
+	/* Force NULL byte on the pattern. */
+	lsm.u.tp_query.name[sizeof(lsm.u.tp_query.name) - 1] = '\0';
+
+	ret = ask_sessiond(&lsm, (void **) events);
+	if (ret < 0) {
+		return ret;
+	}
+
+	return ret / sizeof(struct lttng_event);
+}
+
 /*
  *  Lists all available tracepoint fields of domain.
  *  Sets the contents of the event field array.
@@ -1168,11 +1213,11 @@ const char *lttng_strerror(int code)
 }
 
 /*
- * Create a brand new session using name and url for destination.
- *
- * Returns LTTNG_OK on success or a negative error code.
+ * Create a session of the given command type using name and url for
+ * destination.
  */
-int lttng_create_session(const char *name, const char *url)
+static int create_session(const char *name, const char *url,
+		enum lttcomm_sessiond_command cmd_type)
 {
 	int ret;
 	ssize_t size;
@@ -1185,7 +1230,7 @@ int lttng_create_session(const char *name, const char *url)
 
 	memset(&lsm, 0, sizeof(lsm));
 
-	lsm.cmd_type = LTTNG_CREATE_SESSION;
+	lsm.cmd_type = cmd_type;
 	copy_string(lsm.session.name, name, sizeof(lsm.session.name));
 
 	/* There should never be a data URL */
@@ -1203,6 +1248,27 @@ int lttng_create_session(const char *name, const char *url)
 	return ret;
 }
 
+/*
+ * Create a brand new session using name and url for destination.
+ *
+ * Returns LTTNG_OK on success or a negative error code.
+ */
+int lttng_create_session(const char *name, const char *url)
+{
+	return create_session(name, url, LTTNG_CREATE_SESSION);
+}
+
+/*
+ * Create a brand new session in snapshot mode using name and url for the
+ * destination of its snapshots.
+ *
+ * Returns LTTNG_OK on success or a negative error code.
+ */
+int lttng_create_session_snapshot(const char *name, const char *url)
+{
+	return create_session(name, url, LTTNG_CREATE_SESSION_SNAPSHOT);
+}
+
 /*
  *  Destroy session using name.
  *  Returns size of returned session payload data or a negative error code.
@@ -1390,6 +1456,8 @@ void lttng_channel_set_default_attr(struct lttng_domain *domain,
 	attr->overwrite = DEFAULT_CHANNEL_OVERWRITE;
 	attr->tracefile_size = DEFAULT_CHANNEL_TRACEFILE_SIZE;
 	attr->tracefile_count = DEFAULT_CHANNEL_TRACEFILE_COUNT;
+	attr->compression = DEFAULT_CHANNEL_COMPRESSION;
+	attr->live_timer_interval = DEFAULT_CHANNEL_LIVE_TIMER;
 
 	switch (domain->type) {
 	case LTTNG_DOMAIN_KERNEL:
@@ -1606,25 +1674,90 @@ error:
 }
 
 /*
- * This is an extension of create session that is ONLY and SHOULD only be used
- * by the lttng command line program. It exists to avoid using URI parsing in
- * the lttng client.
- *
- * We need the date and time for the trace path subdirectory for the case where
- * the user does NOT define one using either -o or -U. Using the normal
- * lttng_create_session API call, we have no clue on the session daemon side if
- * the URL was generated automatically by the client or define by the user.
- *
- * So this function "wrapper" is hidden from the public API, takes the datetime
- * string and appends it if necessary to the URI subdirectory before sending it
- * to the session daemon.
+ * Get session daemon internal statistics.
  *
- * With this extra function, the lttng_create_session call behavior is not
- * changed and the timestamp is appended to the URI on the session daemon side
- * if necessary.
+ * Return the number of app statistics entries set in apps or else a negative
+ * lttng error code.
  */
-int _lttng_create_session_ext(const char *name, const char *url,
-		const char *datetime)
+int lttng_health_stats(struct lttng_health_stats *stats,
+		struct lttng_health_app_stats **apps)
+{
+	int sock, ret;
+	size_t apps_size;
+	struct lttcomm_health_msg msg;
+	struct lttcomm_health_stats_reply reply;
+	struct lttng_health_app_stats *tmp_apps = NULL;
+
+	if (stats == NULL || apps == NULL) {
+		ret = -LTTNG_ERR_INVALID;
+		goto error;
+	}
+
+	/* Connect to the sesssion daemon */
+	sock = lttcomm_connect_unix_sock(health_sock_path);
+	if (sock < 0) {
+		ret = -LTTNG_ERR_NO_SESSIOND;
+		goto error;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	msg.cmd = LTTNG_HEALTH_STATS;
+
+	ret = lttcomm_send_unix_sock(sock, (void *)&msg, sizeof(msg));
+	if (ret < 0) {
+		ret = -LTTNG_ERR_FATAL;
+		goto close_error;
+	}
+
+	ret = lttcomm_recv_unix_sock(sock, (void *)&reply, sizeof(reply));
+	if (ret <= 0) {
+		ret = -LTTNG_ERR_FATAL;
+		goto close_error;
+	}
+
+	if (reply.ret_code != LTTNG_OK) {
+		ret = -reply.ret_code;
+		goto close_error;
+	}
+
+	ret = lttcomm_recv_unix_sock(sock, (void *)stats, sizeof(*stats));
+	if (ret <= 0) {
+		ret = -LTTNG_ERR_FATAL;
+		goto close_error;
+	}
+
+	if (reply.nb_apps > 0) {
+		apps_size = reply.nb_apps * sizeof(*tmp_apps);
+		tmp_apps = malloc(apps_size);
+		if (tmp_apps == NULL) {
+			ret = -LTTNG_ERR_FATAL;
+			goto close_error;
+		}
+
+		ret = lttcomm_recv_unix_sock(sock, (void *)tmp_apps, apps_size);
+		if (ret <= 0) {
+			free(tmp_apps);
+			ret = -LTTNG_ERR_FATAL;
+			goto close_error;
+		}
+	}
+
+	*apps = tmp_apps;
+	ret = reply.nb_apps;
+
+close_error:
+	close(sock);
+
+error:
+	return ret;
+}
+
+/*
+ * Create a session of the given command type, appending the datetime to the
+ * URI subdirectory if necessary. See _lttng_create_session_ext().
+ */
+static int create_session_ext(const char *name, const char *url,
+		const char *datetime, enum lttcomm_sessiond_command cmd_type)
 {
 	int ret;
 	ssize_t size;
@@ -1637,7 +1770,7 @@ int _lttng_create_session_ext(const char *name, const char *url,
 
 	memset(&lsm, 0, sizeof(lsm));
 
-	lsm.cmd_type = LTTNG_CREATE_SESSION;
+	lsm.cmd_type = cmd_type;
 	copy_string(lsm.session.name, name, sizeof(lsm.session.name));
 
 	/* There should never be a data URL */
@@ -1673,6 +1806,102 @@ error:
 	return ret;
 }
 
+/*
+ * This is an extension of create session that is ONLY and SHOULD only be used
+ * by the lttng command line program. It exists to avoid using URI parsing in
+ * the lttng client.
+ *
+ * We need the date and time for the trace path subdirectory for the case where
+ * the user does NOT define one using either -o or -U. Using the normal
+ * lttng_create_session API call, we have no clue on the session daemon side if
+ * the URL was generated automatically by the client or define by the user.
+ *
+ * So this function "wrapper" is hidden from the public API, takes the datetime
+ * string and appends it if necessary to the URI subdirectory before sending it
+ * to the session daemon.
+ *
+ * With this extra function, the lttng_create_session call behavior is not
+ * changed and the timestamp is appended to the URI on the session daemon side
+ * if necessary.
+ */
+int _lttng_create_session_ext(const char *name, const char *url,
+		const char *datetime)
+{
+	return create_session_ext(name, url, datetime, LTTNG_CREATE_SESSION);
+}
+
+/*
+ * Same as _lttng_create_session_ext() but the session is created in snapshot
+ * mode. Hidden from the public API for the same reason.
+ */
+int _lttng_create_session_snapshot_ext(const char *name, const char *url,
+		const char *datetime)
+{
+	return create_session_ext(name, url, datetime,
+			LTTNG_CREATE_SESSION_SNAPSHOT);
+}
+
+/*
+ * Record a snapshot of the buffers of a snapshot mode session. The snapshot
+ * is written in a directory named after snapshot_name (a default one is
+ * generated if NULL) under the session output. max_size, if not 0, caps the
+ * size recorded for each stream.
+ *
+ * Returns LTTNG_OK on success or a negative error code.
+ */
+int lttng_snapshot_record(const char *session_name, const char *snapshot_name,
+		uint64_t max_size)
+{
+	struct lttcomm_session_msg lsm;
+
+	if (session_name == NULL) {
+		return -LTTNG_ERR_INVALID;
+	}
+
+	memset(&lsm, 0, sizeof(lsm));
+
+	lsm.cmd_type = LTTNG_SNAPSHOT_RECORD;
+	copy_string(lsm.session.name, session_name, sizeof(lsm.session.name));
+	if (snapshot_name) {
+		copy_string(lsm.u.snapshot_record.name, snapshot_name,
+				sizeof(lsm.u.snapshot_record.name));
+	}
+	lsm.u.snapshot_record.max_size = max_size;
+
+	return ask_sessiond(&lsm, NULL);
+}
+
+/*
+ * Set the UIDs of which the per UID buffers of the session are created when
+ * tracing starts, before any of their applications registers.
+ *
+ * Returns LTTNG_OK on success or a negative error code.
+ */
+int lttng_set_provision_uids(struct lttng_handle *handle, const uid_t *uids,
+		unsigned int count)
+{
+	unsigned int i;
+	struct lttcomm_session_msg lsm;
+
+	if (handle == NULL || (uids == NULL && count > 0) ||
+			count > DEFAULT_UST_PROVISION_UIDS_MAX) {
+		return -LTTNG_ERR_INVALID;
+	}
+
+	memset(&lsm, 0, sizeof(lsm));
+
+	lsm.cmd_type = LTTNG_SET_PROVISION_UIDS;
+	copy_lttng_domain(&lsm.domain, &handle->domain);
+	copy_string(lsm.session.name, handle->session_name,
+			sizeof(lsm.session.name));
+	for (i = 0; i < count; i++) {
+		lsm.u.provision_uids.uids[i] = (uint32_t) uids[i];
+	}
+	lsm.u.provision_uids.count = count;
+
+	return ask_sessiond(&lsm, NULL);
+}
+
 /*
  * For a given session name, this call checks if the data is ready to be read
  * or is still being extracted by the consumer(s) hence not ready to be used by
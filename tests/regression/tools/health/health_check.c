@@ -15,7 +15,9 @@
  * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <inttypes.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "lttng/lttng.h"
 
@@ -25,10 +27,25 @@
 #define HEALTH_KERNEL_FAIL  (1 << 3)
 #define HEALTH_CSMR_FAIL    (1 << 4)
 
+/*
+ * Print a latency histogram summary. Not part of the health status.
+ */
+static void print_latency(const char *name,
+		const struct lttng_health_latency *latency)
+{
+	printf("%s: count %" PRIu64 ", avg %" PRIu64 " ns, p99 under %" PRIu64
+			" ns, max %" PRIu64 " ns\n", name, latency->count,
+			latency->count ? latency->total_ns / latency->count : 0,
+			latency->p99_ns, latency->max_ns);
+}
+
 int main(int argc, char *argv[])
 {
 	int health = -1;
 	int status = 0;
+	int nb_apps;
+	struct lttng_health_stats stats;
+	struct lttng_health_app_stats *apps = NULL;
 
 	/* Command thread */
 	health = lttng_health_check(LTTNG_HEALTH_CMD);
@@ -69,5 +86,18 @@ int main(int argc, char *argv[])
 		status |= HEALTH_CSMR_FAIL;
 	}
 
+	/* Statistics, only printed */
+	nb_apps = lttng_health_stats(&stats, &apps);
+	if (nb_apps >= 0) {
+		print_latency("Stats app. registration", &stats.app_registration);
+		print_latency("Stats app. command", &stats.app_cmd);
+		print_latency("Stats consumer command", &stats.consumer_cmd);
+		printf("Stats app. registration queue depth: %" PRIu64
+				" (max %" PRIu64 ")\n", stats.app_reg_queue_depth,
+				stats.app_reg_queue_max_depth);
+		printf("Stats apps: %d\n", nb_apps);
+		free(apps);
+	}
+
 	return status;
 }
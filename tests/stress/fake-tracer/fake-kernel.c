@@ -0,0 +1,370 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Fake lttng-modules tracer, LD_PRELOAD'ed in the session daemon (and
+ * inherited by the consumer daemons it spawns).
+ *
+ * The kernctl_* wrappers of kernel-ctl.c issue ioctl() on the /proc/lttng
+ * file and on the file descriptors it returns. This library opens /dev/null
+ * in place of /proc/lttng and answers every LTTng ioctl with synthetic file
+ * descriptors: /dev/null for sessions, channels and events, a pipe per stream
+ * so the consumer can poll it and a temporary file for the tracepoint list.
+ * Streams never have data. The write end of the stream pipes is closed with
+ * the channel so the consumer sees the usual hang up on teardown.
+ *
+ * Only the splice output is supported since stream pipes can't be mmap'ed.
+ *
+ * Environment variables:
+ *   FAKE_KERNEL_NR_CPUS    Streams per channel (default: online CPUs).
+ *   FAKE_KERNEL_NR_EVENTS  Size of the tracepoint list (default: 1000).
+ */
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <lttng/lttng.h>
+#include <common/lttng-kernel.h>
+#include <common/kernel-ctl/kernel-ioctl.h>
+
+#define FAKE_KERNEL_PROC_PATH		"/proc/lttng"
+#define FAKE_KERNEL_MAX_FD		65536
+#define FAKE_KERNEL_NR_EVENTS		1000
+#define FAKE_KERNEL_SUBBUF_SIZE		4096
+
+enum fake_fd_type {
+	FAKE_FD_NONE = 0,
+	FAKE_FD_TRACER,
+	FAKE_FD_SESSION,
+	FAKE_FD_CHANNEL,
+	FAKE_FD_METADATA,
+	FAKE_FD_EVENT,
+};
+
+/* Write ends of the stream pipes of a channel. */
+struct fake_channel {
+	int *stream_wfds;
+	unsigned int nr_streams;
+};
+
+static pthread_mutex_t fake_lock = PTHREAD_MUTEX_INITIALIZER;
+static enum fake_fd_type fake_fds[FAKE_KERNEL_MAX_FD];
+static struct fake_channel fake_channels[FAKE_KERNEL_MAX_FD];
+
+static int (*real_open)(const char *, int, ...);
+static int (*real_open64)(const char *, int, ...);
+static int (*real_close)(int);
+static int (*real_ioctl)(int, unsigned long, ...);
+
+/*
+ * Resolve the libc symbols overridden by this library.
+ */
+static void fake_init(void)
+{
+	if (real_ioctl) {
+		return;
+	}
+	real_open = dlsym(RTLD_NEXT, "open");
+	real_open64 = dlsym(RTLD_NEXT, "open64");
+	real_close = dlsym(RTLD_NEXT, "close");
+	real_ioctl = dlsym(RTLD_NEXT, "ioctl");
+}
+
+/*
+ * Return the value of a positive integer environment variable or the default.
+ */
+static unsigned int fake_env_uint(const char *name, unsigned int def)
+{
+	long val;
+	char *str = getenv(name);
+
+	if (!str) {
+		return def;
+	}
+	val = strtol(str, NULL, 10);
+	return val > 0 ? (unsigned int) val : def;
+}
+
+/*
+ * Create a synthetic object file descriptor of the given type.
+ */
+static int fake_new_fd(enum fake_fd_type type)
+{
+	int fd;
+
+	fd = real_open("/dev/null", O_RDWR | O_CLOEXEC);
+	if (fd < 0) {
+		return -1;
+	}
+	if (fd >= FAKE_KERNEL_MAX_FD) {
+		real_close(fd);
+		errno = EMFILE;
+		return -1;
+	}
+
+	pthread_mutex_lock(&fake_lock);
+	fake_fds[fd] = type;
+	pthread_mutex_unlock(&fake_lock);
+
+	return fd;
+}
+
+/*
+ * Create the next stream of a channel or fail with ENOENT once every stream
+ * is created, like lttng-modules does. Fail with EINVAL if the file
+ * descriptor is not a channel. The type of the file descriptor is read with
+ * the lock held since another thread can close it.
+ */
+static int fake_new_stream(int chan_fd)
+{
+	int ret, pipefd[2];
+	int *wfds;
+	unsigned int max_streams;
+	struct fake_channel *chan;
+
+	if (chan_fd < 0 || chan_fd >= FAKE_KERNEL_MAX_FD) {
+		errno = EINVAL;
+		return -1;
+	}
+	chan = &fake_channels[chan_fd];
+
+	pthread_mutex_lock(&fake_lock);
+	if (fake_fds[chan_fd] != FAKE_FD_CHANNEL &&
+			fake_fds[chan_fd] != FAKE_FD_METADATA) {
+		errno = EINVAL;
+		ret = -1;
+		goto end;
+	}
+
+	max_streams = fake_fds[chan_fd] == FAKE_FD_METADATA ? 1 :
+		fake_env_uint("FAKE_KERNEL_NR_CPUS", sysconf(_SC_NPROCESSORS_ONLN));
+	if (chan->nr_streams >= max_streams) {
+		errno = ENOENT;
+		ret = -1;
+		goto end;
+	}
+
+	wfds = realloc(chan->stream_wfds, (chan->nr_streams + 1) * sizeof(int));
+	if (!wfds) {
+		errno = ENOMEM;
+		ret = -1;
+		goto end;
+	}
+	chan->stream_wfds = wfds;
+
+	ret = pipe2(pipefd, O_CLOEXEC | O_NONBLOCK);
+	if (ret < 0) {
+		goto end;
+	}
+	chan->stream_wfds[chan->nr_streams++] = pipefd[1];
+	ret = pipefd[0];
+
+end:
+	pthread_mutex_unlock(&fake_lock);
+	return ret;
+}
+
+/*
+ * Return a file descriptor on a tracepoint list in the /proc/lttng format.
+ */
+static int fake_tracepoint_list(void)
+{
+	int fd = -1;
+	unsigned int i, nr_events;
+	FILE *fp;
+
+	fp = tmpfile();
+	if (!fp) {
+		return -1;
+	}
+
+	nr_events = fake_env_uint("FAKE_KERNEL_NR_EVENTS", FAKE_KERNEL_NR_EVENTS);
+	for (i = 0; i < nr_events; i++) {
+		fprintf(fp, "event { name = fake_event_%u; };\n", i);
+	}
+	if (fflush(fp) == 0 && fseek(fp, 0, SEEK_SET) == 0) {
+		fd = dup(fileno(fp));
+		if (fd >= 0 && lseek(fd, 0, SEEK_SET) < 0) {
+			real_close(fd);
+			fd = -1;
+		}
+	}
+	fclose(fp);
+
+	return fd;
+}
+
+/*
+ * Answer an LTTng ioctl. Unknown file descriptors are streams received by
+ * the consumer daemon.
+ */
+static int fake_lttng_ioctl(int fd, unsigned long request, void *arg)
+{
+	switch (request) {
+	case LTTNG_KERNEL_TRACER_VERSION:
+	{
+		struct lttng_kernel_tracer_version *v = arg;
+
+		v->major = 2;
+		v->minor = 2;
+		v->patchlevel = 0;
+		return 0;
+	}
+	case LTTNG_KERNEL_SESSION:
+		return fake_new_fd(FAKE_FD_SESSION);
+	case LTTNG_KERNEL_TRACEPOINT_LIST:
+		return fake_tracepoint_list();
+	case LTTNG_KERNEL_METADATA:
+		return fake_new_fd(FAKE_FD_METADATA);
+	case LTTNG_KERNEL_CHANNEL:
+		return fake_new_fd(FAKE_FD_CHANNEL);
+	case LTTNG_KERNEL_EVENT:
+		return fake_new_fd(FAKE_FD_EVENT);
+	case LTTNG_KERNEL_STREAM:
+		return fake_new_stream(fd);
+	case LTTNG_KERNEL_WAIT_QUIESCENT:
+	case LTTNG_KERNEL_CALIBRATE:
+	case LTTNG_KERNEL_SESSION_START:
+	case LTTNG_KERNEL_SESSION_STOP:
+	case LTTNG_KERNEL_CONTEXT:
+	case LTTNG_KERNEL_ENABLE:
+	case LTTNG_KERNEL_DISABLE:
+		return 0;
+	case RING_BUFFER_GET_NEXT_SUBBUF:
+	case RING_BUFFER_GET_SUBBUF:
+		/* Streams are always empty. */
+		errno = EAGAIN;
+		return -1;
+	case RING_BUFFER_SNAPSHOT_GET_CONSUMED:
+	case RING_BUFFER_SNAPSHOT_GET_PRODUCED:
+	case RING_BUFFER_GET_MMAP_READ_OFFSET:
+		*(unsigned long *) arg = 0;
+		return 0;
+	case RING_BUFFER_GET_SUBBUF_SIZE:
+	case RING_BUFFER_GET_PADDED_SUBBUF_SIZE:
+	case RING_BUFFER_GET_MAX_SUBBUF_SIZE:
+	case RING_BUFFER_GET_MMAP_LEN:
+		*(unsigned long *) arg = FAKE_KERNEL_SUBBUF_SIZE;
+		return 0;
+	case RING_BUFFER_SNAPSHOT:
+	case RING_BUFFER_PUT_SUBBUF:
+	case RING_BUFFER_PUT_NEXT_SUBBUF:
+	case RING_BUFFER_FLUSH:
+		return 0;
+	default:
+		/* The old ABI is never used since the new one is answered. */
+		errno = ENOTTY;
+		return -1;
+	}
+}
+
+int ioctl(int fd, unsigned long request, ...)
+{
+	void *arg;
+	va_list ap;
+
+	fake_init();
+
+	va_start(ap, request);
+	arg = va_arg(ap, void *);
+	va_end(ap);
+
+	if (_IOC_TYPE(request) != 0xF6) {
+		return real_ioctl(fd, request, arg);
+	}
+	return fake_lttng_ioctl(fd, request, arg);
+}
+
+/*
+ * Open /dev/null in place of the LTTng control file.
+ */
+static int fake_open(int (*open_fn)(const char *, int, ...),
+		const char *path, int flags, mode_t mode)
+{
+	int fd;
+
+	if (strcmp(path, FAKE_KERNEL_PROC_PATH) != 0) {
+		return open_fn(path, flags, mode);
+	}
+
+	fd = fake_new_fd(FAKE_FD_TRACER);
+	return fd;
+}
+
+int open(const char *path, int flags, ...)
+{
+	mode_t mode = 0;
+	va_list ap;
+
+	fake_init();
+
+	if (flags & O_CREAT) {
+		va_start(ap, flags);
+		mode = va_arg(ap, mode_t);
+		va_end(ap);
+	}
+	return fake_open(real_open, path, flags, mode);
+}
+
+int open64(const char *path, int flags, ...)
+{
+	mode_t mode = 0;
+	va_list ap;
+
+	fake_init();
+
+	if (flags & O_CREAT) {
+		va_start(ap, flags);
+		mode = va_arg(ap, mode_t);
+		va_end(ap);
+	}
+	return fake_open(real_open64, path, flags, mode);
+}
+
+int close(int fd)
+{
+	unsigned int i;
+
+	fake_init();
+
+	if (fd >= 0 && fd < FAKE_KERNEL_MAX_FD) {
+		pthread_mutex_lock(&fake_lock);
+		if (fake_fds[fd] == FAKE_FD_CHANNEL ||
+				fake_fds[fd] == FAKE_FD_METADATA) {
+			struct fake_channel *chan = &fake_channels[fd];
+
+			/* Hang up the streams of the channel. */
+			for (i = 0; i < chan->nr_streams; i++) {
+				real_close(chan->stream_wfds[i]);
+			}
+			free(chan->stream_wfds);
+			chan->stream_wfds = NULL;
+			chan->nr_streams = 0;
+		}
+		fake_fds[fd] = FAKE_FD_NONE;
+		pthread_mutex_unlock(&fake_lock);
+	}
+
+	return real_close(fd);
+}
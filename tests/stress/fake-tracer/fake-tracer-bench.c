@@ -0,0 +1,631 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Control plane benchmark driven by the fake tracers.
+ *
+ * In UST mode, a child process simulates the requested number of applications
+ * against a session daemon started with libfakeustctl.so preloaded. In kernel
+ * mode, the session daemon must be started with libfakekernel.so preloaded.
+ * The benchmark then reports the registration throughput, the memory used by
+ * the session daemon per application and the time taken by every session
+ * setup step through liblttng-ctl.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <lttng/lttng.h>
+#include <bin/lttng-sessiond/lttng-ust-ctl.h>
+#include <bin/lttng-sessiond/lttng-ust-error.h>
+#include <common/defaults.h>
+
+#include "fake-ust.h"
+
+#define BENCH_SESSION_NAME	"fake-tracer-bench"
+#define BENCH_CHANNEL_NAME	"channel0"
+#define BENCH_PID_BASE		1000000
+
+/* State of a simulated application. */
+struct fake_app {
+	pid_t pid;
+	int cmd_sock;
+	int notify_sock;
+	int registered;
+	int next_handle;
+	/* Next tracepoint returned by a tracepoint list get. */
+	unsigned int tp_iter;
+};
+
+/* Sent by the application simulator once every application is registered. */
+struct bench_reg_result {
+	uint64_t elapsed_ns;
+	uint32_t nr_registered;
+};
+
+static unsigned int opt_nr_apps = 100;
+static unsigned int opt_nr_events = 100;
+static int opt_kernel;
+static pid_t opt_sessiond_pid;
+static char *opt_sock_path;
+
+static struct option long_options[] = {
+	{ "apps", 1, 0, 'a' },
+	{ "events", 1, 0, 'e' },
+	{ "kernel", 0, 0, 'k' },
+	{ "sessiond-pid", 1, 0, 'p' },
+	{ "sock-path", 1, 0, 's' },
+	{ "help", 0, 0, 'h' },
+	{ NULL, 0, 0, 0 },
+};
+
+static void usage(FILE *fp)
+{
+	fprintf(fp, "Usage: fake_tracer_bench [OPTIONS]\n\n");
+	fprintf(fp, "  -a, --apps N           Number of simulated UST applications (default: 100)\n");
+	fprintf(fp, "  -e, --events N         Events per application or kernel events to enable (default: 100)\n");
+	fprintf(fp, "  -k, --kernel           Benchmark the kernel domain, no applications are simulated\n");
+	fprintf(fp, "  -p, --sessiond-pid PID Session daemon PID, used to report its memory usage\n");
+	fprintf(fp, "  -s, --sock-path PATH   Applications socket of the session daemon\n");
+	fprintf(fp, "  -h, --help             Show this help\n");
+}
+
+/*
+ * Return the nanoseconds elapsed since start.
+ */
+static uint64_t elapsed_ns(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((uint64_t) now.tv_sec - start->tv_sec) * 1000000000ULL
+		+ now.tv_nsec - start->tv_nsec;
+}
+
+/*
+ * Return the resident set size of a process in kB or -1 on error.
+ */
+static long get_rss_kb(pid_t pid)
+{
+	long rss = -1;
+	char path[64], line[256];
+	FILE *fp;
+
+	snprintf(path, sizeof(path), "/proc/%d/status", pid);
+	fp = fopen(path, "r");
+	if (!fp) {
+		return -1;
+	}
+	while (fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, "VmRSS: %ld kB", &rss) == 1) {
+			break;
+		}
+	}
+	fclose(fp);
+
+	return rss;
+}
+
+/*
+ * Send or receive exactly len bytes. Return 0 on success else -1.
+ */
+static int xfer(int sock, void *buf, size_t len, int do_send)
+{
+	ssize_t ret;
+	size_t done = 0;
+
+	while (done < len) {
+		if (do_send) {
+			ret = send(sock, (char *) buf + done, len - done, MSG_NOSIGNAL);
+		} else {
+			ret = recv(sock, (char *) buf + done, len - done, 0);
+		}
+		if (ret < 0 && errno == EINTR) {
+			continue;
+		}
+		if (ret <= 0) {
+			return -1;
+		}
+		done += ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Connect a socket of a simulated application and send its registration.
+ */
+static int app_connect(struct fake_app *app, enum fake_ust_sock_type type)
+{
+	int sock, ret;
+	struct sockaddr_un addr;
+	struct fake_ust_reg_msg msg;
+
+	sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (sock < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, opt_sock_path, sizeof(addr.sun_path) - 1);
+
+	ret = connect(sock, (struct sockaddr *) &addr, sizeof(addr));
+	if (ret < 0) {
+		perror("connect apps socket");
+		goto error;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	msg.magic = FAKE_UST_MAGIC;
+	msg.type = type;
+	msg.pid = app->pid;
+	msg.ppid = getpid();
+	msg.uid = getuid();
+	msg.gid = getgid();
+	msg.bits_per_long = sizeof(long) * 8;
+	snprintf(msg.name, sizeof(msg.name), "fakeapp%u",
+			(unsigned int) (app->pid - BENCH_PID_BASE));
+
+	ret = xfer(sock, &msg, sizeof(msg), 1);
+	if (ret < 0) {
+		perror("send registration");
+		goto error;
+	}
+
+	return sock;
+
+error:
+	close(sock);
+	return -1;
+}
+
+/*
+ * Answer a command of the session daemon.
+ *
+ * Return 1 if the command was the registration done notification, 0 for any
+ * other command and -1 if the session daemon is gone.
+ */
+static int app_handle_cmd(struct fake_app *app)
+{
+	int ret, done = 0;
+	struct fake_ust_cmd_msg msg;
+	struct fake_ust_reply_msg reply;
+
+	ret = xfer(app->cmd_sock, &msg, sizeof(msg), 0);
+	if (ret < 0) {
+		return -1;
+	}
+
+	memset(&reply, 0, sizeof(reply));
+	reply.handle = -1;
+
+	switch (msg.cmd) {
+	case FAKE_UST_CMD_REGISTER_DONE:
+		done = 1;
+		break;
+	case FAKE_UST_CMD_CREATE_SESSION:
+	case FAKE_UST_CMD_SEND_CHANNEL:
+	case FAKE_UST_CMD_CREATE_EVENT:
+	case FAKE_UST_CMD_ADD_CONTEXT:
+	case FAKE_UST_CMD_TP_FIELD_LIST:
+		reply.handle = app->next_handle++;
+		break;
+	case FAKE_UST_CMD_TP_LIST:
+		app->tp_iter = 0;
+		reply.handle = app->next_handle++;
+		break;
+	case FAKE_UST_CMD_TP_LIST_GET:
+		if (app->tp_iter >= opt_nr_events) {
+			reply.ret_code = -LTTNG_UST_ERR_NOENT;
+			break;
+		}
+		snprintf(reply.name, sizeof(reply.name), "fake_app:event_%u",
+				app->tp_iter++);
+		reply.loglevel = -1;
+		break;
+	case FAKE_UST_CMD_TP_FIELD_LIST_GET:
+		/* Fields are not simulated. */
+		reply.ret_code = -LTTNG_UST_ERR_NOENT;
+		break;
+	default:
+		/* Every other command applies to an existing object. */
+		break;
+	}
+
+	ret = xfer(app->cmd_sock, &reply, sizeof(reply), 1);
+	if (ret < 0) {
+		return -1;
+	}
+
+	return done;
+}
+
+/*
+ * Raise the file descriptor limit to fit two sockets per application.
+ */
+static void raise_nofile_limit(void)
+{
+	struct rlimit rlim;
+
+	if (getrlimit(RLIMIT_NOFILE, &rlim) < 0) {
+		return;
+	}
+	rlim.rlim_cur = rlim.rlim_max;
+	(void) setrlimit(RLIMIT_NOFILE, &rlim);
+}
+
+/*
+ * Simulate the applications until the control pipe is closed by the parent.
+ * The registration result is written on the result pipe.
+ */
+static int run_apps(int ctrl_fd, int result_fd)
+{
+	int ret, epfd, i, nr_fds;
+	unsigned int nr_registered = 0, nr_alive = 0, n;
+	struct fake_app *apps;
+	struct epoll_event ev, events[64];
+	struct timespec start;
+	struct bench_reg_result result;
+
+	raise_nofile_limit();
+
+	apps = calloc(opt_nr_apps, sizeof(*apps));
+	if (!apps) {
+		perror("calloc apps");
+		return -1;
+	}
+
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd < 0) {
+		perror("epoll_create1");
+		free(apps);
+		return -1;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, ctrl_fd, &ev) < 0) {
+		perror("epoll_ctl control pipe");
+		goto end;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (n = 0; n < opt_nr_apps; n++) {
+		struct fake_app *app = &apps[n];
+
+		app->pid = BENCH_PID_BASE + n;
+		app->next_handle = 1;
+		app->cmd_sock = app_connect(app, FAKE_UST_SOCK_CMD);
+		if (app->cmd_sock < 0) {
+			break;
+		}
+		app->notify_sock = app_connect(app, FAKE_UST_SOCK_NOTIFY);
+		if (app->notify_sock < 0) {
+			close(app->cmd_sock);
+			break;
+		}
+
+		/* The notify socket only needs to stay open. */
+		ev.events = EPOLLIN;
+		ev.data.ptr = app;
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, app->cmd_sock, &ev) < 0) {
+			perror("epoll_ctl app");
+			close(app->cmd_sock);
+			close(app->notify_sock);
+			break;
+		}
+		nr_alive++;
+	}
+	if (nr_alive < opt_nr_apps) {
+		fprintf(stderr, "Only %u of %u applications connected\n", nr_alive,
+				opt_nr_apps);
+	}
+	if (nr_alive == 0) {
+		/* The parent sees the result pipe hang up. */
+		goto end;
+	}
+
+	for (;;) {
+		nr_fds = epoll_wait(epfd, events, 64, -1);
+		if (nr_fds < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("epoll_wait");
+			break;
+		}
+
+		for (i = 0; i < nr_fds; i++) {
+			struct fake_app *app = events[i].data.ptr;
+
+			if (!app) {
+				/* Control pipe closed, the benchmark is over. */
+				goto end;
+			}
+
+			ret = app_handle_cmd(app);
+			if (ret < 0) {
+				(void) epoll_ctl(epfd, EPOLL_CTL_DEL, app->cmd_sock, NULL);
+				close(app->cmd_sock);
+				close(app->notify_sock);
+				app->cmd_sock = app->notify_sock = -1;
+				continue;
+			}
+			if (ret == 1 && !app->registered) {
+				app->registered = 1;
+				if (++nr_registered == nr_alive) {
+					result.elapsed_ns = elapsed_ns(&start);
+					result.nr_registered = nr_registered;
+					if (write(result_fd, &result, sizeof(result)) < 0) {
+						perror("write result");
+					}
+				}
+			}
+		}
+	}
+
+end:
+	for (n = 0; n < nr_alive; n++) {
+		if (apps[n].cmd_sock >= 0) {
+			close(apps[n].cmd_sock);
+			close(apps[n].notify_sock);
+		}
+	}
+	close(epfd);
+	free(apps);
+	return 0;
+}
+
+/*
+ * Run and time a liblttng-ctl call, printing its result.
+ */
+#define BENCH_STEP(label, call)						\
+	do {								\
+		struct timespec _start;					\
+		int _ret;						\
+									\
+		clock_gettime(CLOCK_MONOTONIC, &_start);		\
+		_ret = (call);						\
+		printf("%-28s %10.3f ms%s%s\n", label,			\
+				elapsed_ns(&_start) / 1e6,		\
+				_ret < 0 ? "  error: " : "",		\
+				_ret < 0 ? lttng_strerror(_ret) : "");	\
+	} while (0)
+
+/*
+ * Enable the benchmark events, one by one like a user would.
+ */
+static int enable_events(struct lttng_handle *handle)
+{
+	int ret = 0;
+	unsigned int i;
+	struct lttng_event ev;
+
+	for (i = 0; i < opt_nr_events; i++) {
+		memset(&ev, 0, sizeof(ev));
+		ev.type = LTTNG_EVENT_TRACEPOINT;
+		if (opt_kernel) {
+			snprintf(ev.name, sizeof(ev.name), "fake_event_%u", i);
+		} else {
+			snprintf(ev.name, sizeof(ev.name), "fake_app:event_%u", i);
+			ev.loglevel = -1;
+		}
+		ret = lttng_enable_event(handle, &ev, BENCH_CHANNEL_NAME);
+		if (ret < 0) {
+			break;
+		}
+	}
+
+	return ret;
+}
+
+/*
+ * List the tracepoints, freeing the result.
+ */
+static int list_tracepoints(struct lttng_handle *handle)
+{
+	int ret;
+	struct lttng_event *events = NULL;
+
+	ret = lttng_list_tracepoints(handle, &events);
+	free(events);
+	return ret;
+}
+
+/*
+ * Time the setup and teardown of a session through liblttng-ctl.
+ */
+static int run_session(void)
+{
+	struct lttng_domain dom;
+	struct lttng_channel chan;
+	struct lttng_handle *handle;
+
+	memset(&dom, 0, sizeof(dom));
+	dom.type = opt_kernel ? LTTNG_DOMAIN_KERNEL : LTTNG_DOMAIN_UST;
+	if (!opt_kernel) {
+		dom.buf_type = LTTNG_BUFFER_PER_PID;
+	}
+
+	memset(&chan, 0, sizeof(chan));
+	strncpy(chan.name, BENCH_CHANNEL_NAME, sizeof(chan.name));
+	lttng_channel_set_default_attr(&dom, &chan.attr);
+	if (opt_kernel) {
+		/* Stream pipes of the fake kernel tracer can't be mmap'ed. */
+		chan.attr.output = LTTNG_EVENT_SPLICE;
+	}
+
+	handle = lttng_create_handle(BENCH_SESSION_NAME, &dom);
+	if (!handle) {
+		fprintf(stderr, "Unable to create handle\n");
+		return -1;
+	}
+
+	BENCH_STEP("List tracepoints", list_tracepoints(handle));
+	BENCH_STEP("Create session",
+			lttng_create_session(BENCH_SESSION_NAME, "file:///tmp/fake-tracer-bench"));
+	BENCH_STEP("Enable channel", lttng_enable_channel(handle, &chan));
+	BENCH_STEP("Enable events", enable_events(handle));
+	BENCH_STEP("Start tracing", lttng_start_tracing(BENCH_SESSION_NAME));
+	BENCH_STEP("Stop tracing", lttng_stop_tracing(BENCH_SESSION_NAME));
+	BENCH_STEP("Destroy session", lttng_destroy_session(BENCH_SESSION_NAME));
+
+	lttng_destroy_handle(handle);
+	return 0;
+}
+
+/*
+ * Set the applications socket path to the one lttng-ust would use.
+ */
+static int set_default_sock_path(void)
+{
+	int ret;
+	const char *home;
+
+	if (getuid() == 0) {
+		opt_sock_path = strdup(DEFAULT_GLOBAL_APPS_UNIX_SOCK);
+		return opt_sock_path ? 0 : -1;
+	}
+
+	home = getenv("HOME");
+	if (!home) {
+		fprintf(stderr, "HOME is not set, use --sock-path\n");
+		return -1;
+	}
+	ret = asprintf(&opt_sock_path, DEFAULT_HOME_APPS_UNIX_SOCK, home);
+	return ret < 0 ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	int opt, ret, status;
+	int ctrl_pipe[2], result_pipe[2];
+	long rss_before = -1, rss_after = -1;
+	pid_t child;
+	struct bench_reg_result result;
+
+	while ((opt = getopt_long(argc, argv, "a:e:kp:s:h", long_options,
+					NULL)) != -1) {
+		switch (opt) {
+		case 'a':
+			opt_nr_apps = strtoul(optarg, NULL, 10);
+			break;
+		case 'e':
+			opt_nr_events = strtoul(optarg, NULL, 10);
+			break;
+		case 'k':
+			opt_kernel = 1;
+			break;
+		case 'p':
+			opt_sessiond_pid = atoi(optarg);
+			break;
+		case 's':
+			opt_sock_path = strdup(optarg);
+			break;
+		case 'h':
+			usage(stdout);
+			return EXIT_SUCCESS;
+		default:
+			usage(stderr);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (opt_kernel) {
+		ret = run_session();
+		return ret < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+
+	if (!opt_sock_path && set_default_sock_path() < 0) {
+		return EXIT_FAILURE;
+	}
+
+	if (pipe2(ctrl_pipe, O_CLOEXEC) < 0 || pipe2(result_pipe, O_CLOEXEC) < 0) {
+		perror("pipe2");
+		return EXIT_FAILURE;
+	}
+
+	if (opt_sessiond_pid > 0) {
+		rss_before = get_rss_kb(opt_sessiond_pid);
+	}
+
+	child = fork();
+	if (child < 0) {
+		perror("fork");
+		return EXIT_FAILURE;
+	} else if (child == 0) {
+		close(ctrl_pipe[1]);
+		close(result_pipe[0]);
+		ret = run_apps(ctrl_pipe[0], result_pipe[1]);
+		_exit(ret < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+	close(ctrl_pipe[0]);
+	close(result_pipe[1]);
+
+	ret = read(result_pipe[0], &result, sizeof(result));
+	if (ret != sizeof(result)) {
+		ret = -1;
+		fprintf(stderr, "Application simulator failed\n");
+		goto end;
+	}
+
+	printf("Registered %u applications in %.3f ms (%.1f apps/s)\n",
+			result.nr_registered, result.elapsed_ns / 1e6,
+			result.nr_registered / (result.elapsed_ns / 1e9));
+
+	if (opt_sessiond_pid > 0) {
+		rss_after = get_rss_kb(opt_sessiond_pid);
+	}
+	if (rss_before >= 0 && rss_after >= 0 && result.nr_registered) {
+		printf("Session daemon RSS: %ld kB -> %ld kB (%.1f kB per app)\n",
+				rss_before, rss_after,
+				(double) (rss_after - rss_before) / result.nr_registered);
+	}
+
+	ret = run_session();
+
+	if (opt_sessiond_pid > 0) {
+		printf("Session daemon RSS after teardown: %ld kB\n",
+				get_rss_kb(opt_sessiond_pid));
+	}
+
+end:
+	/* Closing the control pipe terminates the simulated applications. */
+	close(ctrl_pipe[1]);
+	waitpid(child, &status, 0);
+	free(opt_sock_path);
+
+	return ret < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,90 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _FAKE_UST_H
+#define _FAKE_UST_H
+
+#include <stdint.h>
+
+/*
+ * Protocol spoken between the fake ustctl library preloaded in the session
+ * daemon (libfakeustctl) and the simulated applications of the fake tracer
+ * benchmark. Both ends are built from this tree so the messages are fixed
+ * size and in host byte order. It only mimics the command flow of lttng-ust,
+ * not its wire format.
+ */
+
+#define FAKE_UST_MAGIC			0x46414b45	/* "FAKE" */
+#define FAKE_UST_NAME_LEN		256
+#define FAKE_UST_PROCNAME_LEN		16
+
+enum fake_ust_sock_type {
+	FAKE_UST_SOCK_CMD		= 0,
+	FAKE_UST_SOCK_NOTIFY		= 1,
+};
+
+/* Sent by the application on both sockets once connected. */
+struct fake_ust_reg_msg {
+	uint32_t magic;
+	uint32_t type;			/* enum fake_ust_sock_type */
+	uint32_t pid;
+	uint32_t ppid;
+	uint32_t uid;
+	uint32_t gid;
+	uint32_t bits_per_long;
+	char name[FAKE_UST_PROCNAME_LEN];
+};
+
+enum fake_ust_cmd {
+	FAKE_UST_CMD_REGISTER_DONE	= 0,
+	FAKE_UST_CMD_CREATE_SESSION	= 1,
+	FAKE_UST_CMD_RELEASE		= 2,
+	FAKE_UST_CMD_SEND_CHANNEL	= 3,
+	FAKE_UST_CMD_SEND_STREAM	= 4,
+	FAKE_UST_CMD_CREATE_EVENT	= 5,
+	FAKE_UST_CMD_ADD_CONTEXT	= 6,
+	FAKE_UST_CMD_SET_FILTER		= 7,
+	FAKE_UST_CMD_ENABLE		= 8,
+	FAKE_UST_CMD_DISABLE		= 9,
+	FAKE_UST_CMD_START		= 10,
+	FAKE_UST_CMD_STOP		= 11,
+	FAKE_UST_CMD_WAIT_QUIESCENT	= 12,
+	FAKE_UST_CMD_FLUSH_BUFFER	= 13,
+	FAKE_UST_CMD_CALIBRATE		= 14,
+	FAKE_UST_CMD_TP_LIST		= 15,
+	FAKE_UST_CMD_TP_LIST_GET	= 16,
+	FAKE_UST_CMD_TP_FIELD_LIST	= 17,
+	FAKE_UST_CMD_TP_FIELD_LIST_GET	= 18,
+};
+
+/* Command sent by the session daemon on the command socket. */
+struct fake_ust_cmd_msg {
+	uint32_t cmd;			/* enum fake_ust_cmd */
+	int32_t handle;			/* Object the command applies to. */
+};
+
+/*
+ * Reply of the application. The handle is the one of the created object, if
+ * any, and the name and loglevel are only set for a tracepoint list get.
+ * A negative ret_code is a negated lttng-ust error code.
+ */
+struct fake_ust_reply_msg {
+	int32_t ret_code;
+	int32_t handle;
+	int32_t loglevel;
+	char name[FAKE_UST_NAME_LEN];
+};
+
+#endif /* _FAKE_UST_H */
@@ -0,0 +1,423 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Fake lttng-ust control library, LD_PRELOAD'ed in the session daemon.
+ *
+ * It overrides the liblttng-ust-ctl functions used by the session daemon to
+ * talk to the applications so it can be driven by the simulated applications
+ * of fake-tracer-bench instead of real lttng-ust instrumented processes. The
+ * functions talking to the consumer daemon are NOT overridden so the consumer
+ * still allocates real shared memory ring buffers for every application.
+ */
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <endian.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <bin/lttng-sessiond/lttng-ust-ctl.h>
+#include <bin/lttng-sessiond/lttng-ust-error.h>
+
+#include "fake-ust.h"
+
+/*
+ * Send or receive exactly len bytes.
+ *
+ * Return 0 on success or a negative errno value, -EPIPE when the application
+ * is gone like lttng-ust does.
+ */
+static int fake_xfer(int sock, void *buf, size_t len, int do_send)
+{
+	ssize_t ret;
+	size_t done = 0;
+
+	while (done < len) {
+		if (do_send) {
+			ret = send(sock, (char *) buf + done, len - done, MSG_NOSIGNAL);
+		} else {
+			ret = recv(sock, (char *) buf + done, len - done, 0);
+		}
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return errno == ECONNRESET ? -EPIPE : -errno;
+		}
+		if (ret == 0) {
+			/* Orderly shutdown of the application. */
+			return -EPIPE;
+		}
+		done += ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Send a command to the application and wait for its reply.
+ *
+ * Return the reply code of the application or a negative errno value.
+ */
+static int fake_cmd(int sock, enum fake_ust_cmd cmd, int handle,
+		struct fake_ust_reply_msg *reply)
+{
+	int ret;
+	struct fake_ust_cmd_msg msg;
+	struct fake_ust_reply_msg tmp_reply;
+
+	if (!reply) {
+		reply = &tmp_reply;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	msg.cmd = cmd;
+	msg.handle = handle;
+
+	ret = fake_xfer(sock, &msg, sizeof(msg), 1);
+	if (ret < 0) {
+		return ret;
+	}
+	ret = fake_xfer(sock, reply, sizeof(*reply), 0);
+	if (ret < 0) {
+		return ret;
+	}
+
+	return reply->ret_code;
+}
+
+/*
+ * Allocate an object for a handle created by the application.
+ */
+static struct lttng_ust_object_data *fake_object(enum lttng_ust_object_type type,
+		int handle)
+{
+	struct lttng_ust_object_data *obj;
+
+	obj = calloc(1, sizeof(*obj));
+	if (!obj) {
+		return NULL;
+	}
+	obj->type = type;
+	obj->handle = handle;
+
+	return obj;
+}
+
+int ustctl_recv_reg_msg(int sock,
+	enum ustctl_socket_type *type,
+	uint32_t *major,
+	uint32_t *minor,
+	uint32_t *pid,
+	uint32_t *ppid,
+	uint32_t *uid,
+	uint32_t *gid,
+	uint32_t *bits_per_long,
+	uint32_t *uint8_t_alignment,
+	uint32_t *uint16_t_alignment,
+	uint32_t *uint32_t_alignment,
+	uint32_t *uint64_t_alignment,
+	uint32_t *long_alignment,
+	int *byte_order,
+	char *name)
+{
+	int ret;
+	struct fake_ust_reg_msg msg;
+
+	ret = fake_xfer(sock, &msg, sizeof(msg), 0);
+	if (ret < 0) {
+		return ret;
+	}
+	if (msg.magic != FAKE_UST_MAGIC) {
+		return -LTTNG_UST_ERR_INVAL;
+	}
+
+	*type = msg.type == FAKE_UST_SOCK_NOTIFY ?
+		USTCTL_SOCKET_NOTIFY : USTCTL_SOCKET_CMD;
+	*major = LTTNG_UST_ABI_MAJOR_VERSION;
+	*minor = LTTNG_UST_ABI_MINOR_VERSION;
+	*pid = msg.pid;
+	*ppid = msg.ppid;
+	*uid = msg.uid;
+	*gid = msg.gid;
+	*bits_per_long = msg.bits_per_long;
+	*uint8_t_alignment = __alignof__(uint8_t);
+	*uint16_t_alignment = __alignof__(uint16_t);
+	*uint32_t_alignment = __alignof__(uint32_t);
+	*uint64_t_alignment = __alignof__(uint64_t);
+	*long_alignment = __alignof__(long);
+	*byte_order = BYTE_ORDER;
+	memcpy(name, msg.name, LTTNG_UST_ABI_PROCNAME_LEN);
+	name[LTTNG_UST_ABI_PROCNAME_LEN - 1] = '\0';
+
+	return 0;
+}
+
+int ustctl_register_done(int sock)
+{
+	return fake_cmd(sock, FAKE_UST_CMD_REGISTER_DONE, -1, NULL);
+}
+
+int ustctl_tracer_version(int sock, struct lttng_ust_tracer_version *v)
+{
+	/* Answered locally, the version is never checked for fake apps. */
+	v->major = 2;
+	v->minor = 2;
+	v->patchlevel = 0;
+	return 0;
+}
+
+int ustctl_create_session(int sock)
+{
+	int ret;
+	struct fake_ust_reply_msg reply;
+
+	ret = fake_cmd(sock, FAKE_UST_CMD_CREATE_SESSION, -1, &reply);
+	if (ret < 0) {
+		return ret;
+	}
+	return reply.handle;
+}
+
+int ustctl_create_event(int sock, struct lttng_ust_event *ev,
+		struct lttng_ust_object_data *channel_data,
+		struct lttng_ust_object_data **event_data)
+{
+	int ret;
+	struct fake_ust_reply_msg reply;
+	struct lttng_ust_object_data *obj;
+
+	ret = fake_cmd(sock, FAKE_UST_CMD_CREATE_EVENT, channel_data->handle,
+			&reply);
+	if (ret < 0) {
+		return ret;
+	}
+
+	obj = fake_object(LTTNG_UST_OBJECT_TYPE_EVENT, reply.handle);
+	if (!obj) {
+		return -ENOMEM;
+	}
+	*event_data = obj;
+	return 0;
+}
+
+int ustctl_add_context(int sock, struct lttng_ust_context *ctx,
+		struct lttng_ust_object_data *obj_data,
+		struct lttng_ust_object_data **context_data)
+{
+	int ret;
+	struct fake_ust_reply_msg reply;
+	struct lttng_ust_object_data *obj;
+
+	ret = fake_cmd(sock, FAKE_UST_CMD_ADD_CONTEXT, obj_data->handle, &reply);
+	if (ret < 0) {
+		return ret;
+	}
+
+	obj = fake_object(LTTNG_UST_OBJECT_TYPE_CONTEXT, reply.handle);
+	if (!obj) {
+		return -ENOMEM;
+	}
+	*context_data = obj;
+	return 0;
+}
+
+int ustctl_set_filter(int sock, struct lttng_ust_filter_bytecode *bytecode,
+		struct lttng_ust_object_data *obj_data)
+{
+	return fake_cmd(sock, FAKE_UST_CMD_SET_FILTER, obj_data->handle, NULL);
+}
+
+int ustctl_enable(int sock, struct lttng_ust_object_data *object)
+{
+	return fake_cmd(sock, FAKE_UST_CMD_ENABLE, object->handle, NULL);
+}
+
+int ustctl_disable(int sock, struct lttng_ust_object_data *object)
+{
+	return fake_cmd(sock, FAKE_UST_CMD_DISABLE, object->handle, NULL);
+}
+
+int ustctl_start_session(int sock, int handle)
+{
+	return fake_cmd(sock, FAKE_UST_CMD_START, handle, NULL);
+}
+
+int ustctl_stop_session(int sock, int handle)
+{
+	return fake_cmd(sock, FAKE_UST_CMD_STOP, handle, NULL);
+}
+
+int ustctl_tracepoint_list(int sock)
+{
+	int ret;
+	struct fake_ust_reply_msg reply;
+
+	ret = fake_cmd(sock, FAKE_UST_CMD_TP_LIST, -1, &reply);
+	if (ret < 0) {
+		return ret;
+	}
+	return reply.handle;
+}
+
+int ustctl_tracepoint_list_get(int sock, int tp_list_handle,
+		struct lttng_ust_tracepoint_iter *iter)
+{
+	int ret;
+	struct fake_ust_reply_msg reply;
+
+	ret = fake_cmd(sock, FAKE_UST_CMD_TP_LIST_GET, tp_list_handle, &reply);
+	if (ret < 0) {
+		return ret;
+	}
+
+	memset(iter, 0, sizeof(*iter));
+	strncpy(iter->name, reply.name, sizeof(iter->name));
+	iter->name[sizeof(iter->name) - 1] = '\0';
+	iter->loglevel = reply.loglevel;
+	return 0;
+}
+
+int ustctl_tracepoint_field_list(int sock)
+{
+	int ret;
+	struct fake_ust_reply_msg reply;
+
+	ret = fake_cmd(sock, FAKE_UST_CMD_TP_FIELD_LIST, -1, &reply);
+	if (ret < 0) {
+		return ret;
+	}
+	return reply.handle;
+}
+
+int ustctl_tracepoint_field_list_get(int sock, int tp_field_list_handle,
+		struct lttng_ust_field_iter *iter)
+{
+	int ret;
+	struct fake_ust_reply_msg reply;
+
+	ret = fake_cmd(sock, FAKE_UST_CMD_TP_FIELD_LIST_GET, tp_field_list_handle,
+			&reply);
+	if (ret < 0) {
+		return ret;
+	}
+
+	memset(iter, 0, sizeof(*iter));
+	strncpy(iter->event_name, reply.name, sizeof(iter->event_name));
+	iter->event_name[sizeof(iter->event_name) - 1] = '\0';
+	iter->loglevel = reply.loglevel;
+	return 0;
+}
+
+int ustctl_wait_quiescent(int sock)
+{
+	return fake_cmd(sock, FAKE_UST_CMD_WAIT_QUIESCENT, -1, NULL);
+}
+
+int ustctl_sock_flush_buffer(int sock, struct lttng_ust_object_data *object)
+{
+	return fake_cmd(sock, FAKE_UST_CMD_FLUSH_BUFFER, object->handle, NULL);
+}
+
+int ustctl_calibrate(int sock, struct lttng_ust_calibrate *calibrate)
+{
+	return fake_cmd(sock, FAKE_UST_CMD_CALIBRATE, -1, NULL);
+}
+
+/*
+ * Same local cleanup as lttng-ust since this is also called on the objects
+ * received from the consumer, with a negative socket.
+ */
+int ustctl_release_object(int sock, struct lttng_ust_object_data *data)
+{
+	int ret;
+
+	assert(data);
+
+	switch (data->type) {
+	case LTTNG_UST_OBJECT_TYPE_CHANNEL:
+		if (data->u.channel.wakeup_fd >= 0) {
+			ret = close(data->u.channel.wakeup_fd);
+			if (ret < 0) {
+				return -errno;
+			}
+		}
+		free(data->u.channel.data);
+		break;
+	case LTTNG_UST_OBJECT_TYPE_STREAM:
+		if (data->u.stream.shm_fd >= 0) {
+			ret = close(data->u.stream.shm_fd);
+			if (ret < 0) {
+				return -errno;
+			}
+		}
+		if (data->u.stream.wakeup_fd >= 0) {
+			ret = close(data->u.stream.wakeup_fd);
+			if (ret < 0) {
+				return -errno;
+			}
+		}
+		break;
+	case LTTNG_UST_OBJECT_TYPE_EVENT:
+	case LTTNG_UST_OBJECT_TYPE_CONTEXT:
+		break;
+	default:
+		assert(0);
+	}
+
+	if (sock < 0 || data->handle < 0) {
+		return 0;
+	}
+	return fake_cmd(sock, FAKE_UST_CMD_RELEASE, data->handle, NULL);
+}
+
+int ustctl_release_handle(int sock, int handle)
+{
+	if (sock < 0 || handle < 0) {
+		return 0;
+	}
+	return fake_cmd(sock, FAKE_UST_CMD_RELEASE, handle, NULL);
+}
+
+/*
+ * The shared memory and wakeup file descriptors are not passed, the simulated
+ * application never writes in the buffers.
+ */
+int ustctl_send_channel_to_ust(int sock, int session_handle,
+		struct lttng_ust_object_data *channel_data)
+{
+	int ret;
+	struct fake_ust_reply_msg reply;
+
+	ret = fake_cmd(sock, FAKE_UST_CMD_SEND_CHANNEL, session_handle, &reply);
+	if (ret < 0) {
+		return ret;
+	}
+	channel_data->handle = reply.handle;
+	return 0;
+}
+
+int ustctl_send_stream_to_ust(int sock,
+		struct lttng_ust_object_data *channel_data,
+		struct lttng_ust_object_data *stream_data)
+{
+	return fake_cmd(sock, FAKE_UST_CMD_SEND_STREAM, channel_data->handle,
+			NULL);
+}
@@ -0,0 +1,311 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Stress test of the tracefile fd cache of the consumer and relay daemons.
+ * Many streams, 100000 by default, each have a tracefile while at most a few
+ * of them are kept open. Writer threads append packets to the streams, most
+ * of them to a small hot set like the busy CPUs or processes of a session,
+ * the others to any stream. The files are checked to hold every packet, and
+ * the hit rate and reopen cost of the cache are reported.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <common/fd-cache.h>
+#include <common/utils.h>
+
+/* For error.h */
+int lttng_opt_quiet = 1;
+int lttng_opt_verbose;
+
+#define BENCH_PACKET_SIZE	256
+
+struct bench_stream {
+	int fd;
+	char name[32];
+	/* Bytes written, protected by the entry lock. */
+	uint64_t written;
+	struct lttng_fd_cache_entry entry;
+};
+
+static unsigned long opt_nr_streams = 100000;
+static unsigned long opt_max_open = 1024;
+static unsigned long opt_nr_writes = 1000000;
+static unsigned long opt_nr_threads = 4;
+static unsigned long opt_hot_percent = 90;
+static char *opt_dir;
+static int opt_keep;
+
+static char dir_path[PATH_MAX];
+static struct bench_stream *streams;
+static struct lttng_fd_cache cache;
+static char packet[BENCH_PACKET_SIZE];
+
+static struct option long_options[] = {
+	{ "streams", 1, 0, 's' },
+	{ "max-open", 1, 0, 'm' },
+	{ "writes", 1, 0, 'w' },
+	{ "threads", 1, 0, 't' },
+	{ "hot", 1, 0, 'H' },
+	{ "dir", 1, 0, 'd' },
+	{ "keep", 0, 0, 'k' },
+	{ "help", 0, 0, 'h' },
+	{ NULL, 0, 0, 0 },
+};
+
+static void usage(FILE *fp)
+{
+	fprintf(fp, "Usage: fd_cache_bench [OPTIONS]\n\n");
+	fprintf(fp, "  -s, --streams N     Number of streams (default: 100000)\n");
+	fprintf(fp, "  -m, --max-open N    Tracefiles kept open, 0 for all (default: 1024)\n");
+	fprintf(fp, "  -w, --writes N      Packets written in total (default: 1000000)\n");
+	fprintf(fp, "  -t, --threads N     Writer threads (default: 4)\n");
+	fprintf(fp, "  -H, --hot PERCENT   Packets of the 1%% hot streams (default: 90)\n");
+	fprintf(fp, "  -d, --dir PATH      Directory of the tracefiles (default: in /tmp)\n");
+	fprintf(fp, "  -k, --keep          Keep the tracefiles\n");
+	fprintf(fp, "  -h, --help          Show this help\n");
+}
+
+/*
+ * Return the nanoseconds elapsed since start.
+ */
+static uint64_t elapsed_ns(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((uint64_t) now.tv_sec - start->tv_sec) * 1000000000ULL
+		+ now.tv_nsec - start->tv_nsec;
+}
+
+/*
+ * Reopen the tracefile of a stream like the daemons do.
+ */
+static int reopen_stream(struct lttng_fd_cache_entry *entry)
+{
+	struct bench_stream *stream =
+		caa_container_of(entry, struct bench_stream, entry);
+
+	return utils_reopen_stream_file(-1, dir_path, stream->name, 0, 0, -1, -1);
+}
+
+/*
+ * Append packets to the streams, a share of them to the hot set.
+ */
+static void *writer_thread(void *data)
+{
+	unsigned long i, nr_writes = (unsigned long) data;
+	unsigned long nr_hot = opt_nr_streams / 100 ? opt_nr_streams / 100 : 1;
+	unsigned int seed = (unsigned int) (uintptr_t) &i;
+	struct bench_stream *stream;
+	ssize_t ret;
+	int fd;
+
+	for (i = 0; i < nr_writes; i++) {
+		if ((unsigned long) rand_r(&seed) % 100 < opt_hot_percent) {
+			stream = &streams[rand_r(&seed) % nr_hot];
+		} else {
+			stream = &streams[rand_r(&seed) % opt_nr_streams];
+		}
+
+		fd = lttng_fd_cache_get(&cache, &stream->entry);
+		if (fd < 0) {
+			perror("reopen tracefile");
+			lttng_fd_cache_put(&stream->entry);
+			exit(EXIT_FAILURE);
+		}
+		do {
+			ret = write(fd, packet, sizeof(packet));
+		} while (ret < 0 && errno == EINTR);
+		if (ret != sizeof(packet)) {
+			perror("write packet");
+			lttng_fd_cache_put(&stream->entry);
+			exit(EXIT_FAILURE);
+		}
+		stream->written += ret;
+		lttng_fd_cache_put(&stream->entry);
+	}
+
+	return NULL;
+}
+
+/*
+ * Check every tracefile holds the packets written to its stream, close it
+ * and remove it unless asked to keep it. Return the number of bad files.
+ */
+static unsigned long check_streams(void)
+{
+	int ret;
+	unsigned long i, errors = 0;
+	char path[PATH_MAX];
+	struct stat st;
+
+	for (i = 0; i < opt_nr_streams; i++) {
+		struct bench_stream *stream = &streams[i];
+
+		lttng_fd_cache_del(&cache, &stream->entry);
+		if (stream->fd >= 0) {
+			(void) close(stream->fd);
+		}
+
+		snprintf(path, sizeof(path), "%s/%s", dir_path, stream->name);
+		ret = stat(path, &st);
+		if (ret < 0 || (uint64_t) st.st_size != stream->written) {
+			errors++;
+		}
+		if (!opt_keep) {
+			(void) unlink(path);
+		}
+	}
+	if (!opt_keep && !opt_dir) {
+		(void) rmdir(dir_path);
+	}
+
+	return errors;
+}
+
+int main(int argc, char **argv)
+{
+	int opt, ret;
+	unsigned long i, errors;
+	pthread_t *threads;
+	struct timespec start;
+	struct lttng_fd_cache_stats stats;
+	uint64_t create_ns, write_ns;
+
+	while ((opt = getopt_long(argc, argv, "s:m:w:t:H:d:kh", long_options,
+					NULL)) != -1) {
+		switch (opt) {
+		case 's':
+			opt_nr_streams = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			opt_max_open = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			opt_nr_writes = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			opt_nr_threads = strtoul(optarg, NULL, 0);
+			break;
+		case 'H':
+			opt_hot_percent = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			opt_dir = optarg;
+			break;
+		case 'k':
+			opt_keep = 1;
+			break;
+		case 'h':
+			usage(stdout);
+			return EXIT_SUCCESS;
+		default:
+			usage(stderr);
+			return EXIT_FAILURE;
+		}
+	}
+	if (!opt_nr_streams || !opt_nr_threads || opt_hot_percent > 100) {
+		usage(stderr);
+		return EXIT_FAILURE;
+	}
+
+	if (opt_dir) {
+		snprintf(dir_path, sizeof(dir_path), "%s", opt_dir);
+	} else {
+		snprintf(dir_path, sizeof(dir_path), "/tmp/lttng-fd-cache-XXXXXX");
+		if (!mkdtemp(dir_path)) {
+			perror("mkdtemp");
+			return EXIT_FAILURE;
+		}
+	}
+
+	streams = calloc(opt_nr_streams, sizeof(*streams));
+	threads = calloc(opt_nr_threads, sizeof(*threads));
+	if (!streams || !threads) {
+		perror("calloc streams");
+		return EXIT_FAILURE;
+	}
+	memset(packet, 'p', sizeof(packet));
+	lttng_fd_cache_init(&cache, opt_max_open);
+
+	/* Created like the stream tracefiles, added to the cache once open. */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < opt_nr_streams; i++) {
+		struct bench_stream *stream = &streams[i];
+
+		snprintf(stream->name, sizeof(stream->name), "stream_%lu", i);
+		lttng_fd_cache_entry_init(&stream->entry, &stream->fd, reopen_stream);
+		stream->fd = utils_create_stream_file(-1, dir_path, stream->name, 0,
+				0, -1, -1);
+		if (stream->fd < 0) {
+			fprintf(stderr, "Creating stream %lu failed, raise the fd limit "
+					"or lower --max-open\n", i);
+			return EXIT_FAILURE;
+		}
+		lttng_fd_cache_add(&cache, &stream->entry);
+	}
+	create_ns = elapsed_ns(&start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < opt_nr_threads; i++) {
+		ret = pthread_create(&threads[i], NULL, writer_thread,
+				(void *) (opt_nr_writes / opt_nr_threads));
+		if (ret) {
+			errno = ret;
+			perror("pthread_create");
+			return EXIT_FAILURE;
+		}
+	}
+	for (i = 0; i < opt_nr_threads; i++) {
+		(void) pthread_join(threads[i], NULL);
+	}
+	write_ns = elapsed_ns(&start);
+
+	lttng_fd_cache_get_stats(&cache, &stats);
+	errors = check_streams();
+
+	printf("%lu streams, %lu open at most, %lu threads, %lu%% hot\n",
+			opt_nr_streams, opt_max_open, opt_nr_threads, opt_hot_percent);
+	printf("create: %.2f us/stream\n",
+			(double) create_ns / 1000 / opt_nr_streams);
+	printf("write:  %.2f us/packet, hit rate %.2f%%\n",
+			(double) write_ns / 1000 / (opt_nr_writes ? opt_nr_writes : 1),
+			stats.hits + stats.reopens ?
+				100.0 * stats.hits / (stats.hits + stats.reopens) : 0);
+	printf("reopen: %" PRIu64 " (%.2f us average), %" PRIu64 " closed while idle\n",
+			stats.reopens,
+			stats.reopens ? (double) stats.reopen_ns / 1000 / stats.reopens : 0,
+			stats.evictions);
+	printf("check:  %lu bad tracefiles\n", errors);
+
+	free(threads);
+	free(streams);
+
+	return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
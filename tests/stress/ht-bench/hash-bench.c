@@ -0,0 +1,195 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Benchmark of the lttng_ht hash functions against the Jenkins hash they
+ * replaced, on the key sets of the daemons: sequential u64 keys, tracepoint
+ * names and ust registry event signatures. For each, the time per hash and
+ * the longest bucket chain of a table with one key per bucket on average are
+ * reported.
+ */
+
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <common/hashtable/utils.h>
+
+#define BENCH_NR_BUCKETS	4096
+
+typedef unsigned long (*bench_hash_fct)(void *key, unsigned long seed);
+
+static unsigned long opt_nr_keys = BENCH_NR_BUCKETS;
+static unsigned long opt_nr_loops = 1000;
+
+static struct option long_options[] = {
+	{ "keys", 1, 0, 'k' },
+	{ "loops", 1, 0, 'l' },
+	{ "help", 0, 0, 'h' },
+	{ NULL, 0, 0, 0 },
+};
+
+static void usage(FILE *fp)
+{
+	fprintf(fp, "Usage: hash_bench [OPTIONS]\n\n");
+	fprintf(fp, "  -k, --keys N    Number of keys of each set (default: 4096)\n");
+	fprintf(fp, "  -l, --loops N   Hashes of every key (default: 1000)\n");
+	fprintf(fp, "  -h, --help      Show this help\n");
+}
+
+/*
+ * Return the nanoseconds elapsed since start.
+ */
+static uint64_t elapsed_ns(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((uint64_t) now.tv_sec - start->tv_sec) * 1000000000ULL
+		+ now.tv_nsec - start->tv_nsec;
+}
+
+/*
+ * Hash every key of the set and report the time per hash and the longest
+ * chain of BENCH_NR_BUCKETS buckets.
+ */
+static void run_hash(const char *name, bench_hash_fct hash, void **keys)
+{
+	unsigned long i, l, max_chain = 0;
+	unsigned int *chains;
+	volatile unsigned long sink = 0;
+	struct timespec start;
+	uint64_t ns;
+
+	chains = calloc(BENCH_NR_BUCKETS, sizeof(*chains));
+	if (!chains) {
+		perror("calloc chains");
+		exit(EXIT_FAILURE);
+	}
+
+	for (i = 0; i < opt_nr_keys; i++) {
+		unsigned long bucket = hash(keys[i], 0) & (BENCH_NR_BUCKETS - 1);
+
+		if (++chains[bucket] > max_chain) {
+			max_chain = chains[bucket];
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (l = 0; l < opt_nr_loops; l++) {
+		for (i = 0; i < opt_nr_keys; i++) {
+			sink += hash(keys[i], l);
+		}
+	}
+	ns = elapsed_ns(&start);
+
+	printf("%-24s %8.2f ns/hash, longest chain %lu (%.1f keys/bucket)\n",
+			name, (double) ns / (opt_nr_keys * opt_nr_loops), max_chain,
+			(double) opt_nr_keys / BENCH_NR_BUCKETS);
+	free(chains);
+}
+
+/*
+ * Allocate an ust registry like event signature.
+ */
+static void *alloc_signature(unsigned long i)
+{
+	char *sig;
+
+	if (asprintf(&sig, "event_%lu: struct { integer { size = 32; align = 8; "
+				"signed = 1; } _intfield; string _stringfield; "
+				"integer { size = 64; align = 8; signed = 0; "
+				"base = 16; } _seqfield_length; }", i) < 0) {
+		return NULL;
+	}
+
+	return sig;
+}
+
+int main(int argc, char **argv)
+{
+	int opt;
+	unsigned long i;
+	uint64_t *u64_keys;
+	void **keys, **names, **sigs;
+
+	while ((opt = getopt_long(argc, argv, "k:l:h", long_options,
+					NULL)) != -1) {
+		switch (opt) {
+		case 'k':
+			opt_nr_keys = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			opt_nr_loops = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+			usage(stdout);
+			return EXIT_SUCCESS;
+		default:
+			usage(stderr);
+			return EXIT_FAILURE;
+		}
+	}
+	if (!opt_nr_keys || !opt_nr_loops) {
+		usage(stderr);
+		return EXIT_FAILURE;
+	}
+
+	u64_keys = calloc(opt_nr_keys, sizeof(*u64_keys));
+	keys = calloc(opt_nr_keys, sizeof(*keys));
+	names = calloc(opt_nr_keys, sizeof(*names));
+	sigs = calloc(opt_nr_keys, sizeof(*sigs));
+	if (!u64_keys || !keys || !names || !sigs) {
+		perror("calloc keys");
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < opt_nr_keys; i++) {
+		u64_keys[i] = i;
+		keys[i] = &u64_keys[i];
+		if (asprintf((char **) &names[i], "lttng_ust_bench:event_%lu",
+					i) < 0) {
+			perror("asprintf name");
+			return EXIT_FAILURE;
+		}
+		sigs[i] = alloc_signature(i);
+		if (!sigs[i]) {
+			perror("asprintf signature");
+			return EXIT_FAILURE;
+		}
+	}
+
+	run_hash("u64", hash_key_u64, keys);
+	run_hash("u64 (jenkins)", hash_key_u64_jenkins, keys);
+	run_hash("event name", hash_key_str, names);
+	run_hash("event name (jenkins)", hash_key_str_jenkins, names);
+	run_hash("signature", hash_key_str, sigs);
+	run_hash("signature (jenkins)", hash_key_str_jenkins, sigs);
+
+	for (i = 0; i < opt_nr_keys; i++) {
+		free(names[i]);
+		free(sigs[i]);
+	}
+	free(sigs);
+	free(names);
+	free(keys);
+	free(u64_keys);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,458 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Microbenchmark of the lttng_ht layer with the key sets of the daemons.
+ *
+ * The u64 keys are sequential like the channel and stream keys of the
+ * consumer, the ulong keys are small dense integers like the sockets and
+ * session ids of the session daemon and relayd and the string keys are
+ * tracepoint names. For the requested allocator, size hint and maximum
+ * number of buckets, the benchmark times the addition of every node, lookups by
+ * concurrent RCU readers with and without a writer deleting and adding nodes,
+ * iterations and the deletion of every node.
+ */
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <urcu.h>
+
+#include <lttng/lttng.h>
+#include <common/hashtable/hashtable.h>
+#include <common/hashtable/utils.h>
+
+/* Node of every key type, only the member of the benchmarked type is used. */
+struct bench_node {
+	union {
+		struct lttng_ht_node_u64 u64;
+		struct lttng_ht_node_ulong ulong;
+		struct lttng_ht_node_str str;
+	} n;
+	char name[LTTNG_SYMBOL_NAME_LEN];
+	struct rcu_head rcu_head;
+};
+
+struct bench_reader {
+	pthread_t tid;
+	unsigned int seed;
+	uint64_t nr_lookups;
+	uint64_t nr_misses;
+};
+
+static int opt_type = LTTNG_HT_TYPE_U64;
+static unsigned long opt_nr_nodes = 10000;
+static unsigned int opt_nr_readers = 4;
+static unsigned int opt_duration = 2;
+static struct lttng_ht_attr opt_attr;
+
+static struct lttng_ht *ht;
+static struct bench_node **nodes;
+static volatile int test_stop;
+
+static struct option long_options[] = {
+	{ "type", 1, 0, 't' },
+	{ "mm", 1, 0, 'm' },
+	{ "nodes", 1, 0, 'n' },
+	{ "readers", 1, 0, 'r' },
+	{ "duration", 1, 0, 'd' },
+	{ "size-hint", 1, 0, 's' },
+	{ "max-buckets", 1, 0, 'b' },
+	{ "no-auto-resize", 0, 0, 'R' },
+	{ "help", 0, 0, 'h' },
+	{ NULL, 0, 0, 0 },
+};
+
+static void usage(FILE *fp)
+{
+	fprintf(fp, "Usage: ht_bench [OPTIONS]\n\n");
+	fprintf(fp, "  -t, --type TYPE            Key type: u64, ulong or string (default: u64)\n");
+	fprintf(fp, "  -m, --mm MM                Bucket allocator: default, order, chunk or mmap\n");
+	fprintf(fp, "  -n, --nodes N              Number of nodes (default: 10000)\n");
+	fprintf(fp, "  -r, --readers N            Concurrent RCU readers (default: 4)\n");
+	fprintf(fp, "  -d, --duration SEC         Duration of the concurrent phases (default: 2)\n");
+	fprintf(fp, "  -s, --size-hint N          Expected number of nodes given to the table\n");
+	fprintf(fp, "  -b, --max-buckets N        Maximum number of buckets\n");
+	fprintf(fp, "  -R, --no-auto-resize       Keep the initial number of buckets\n");
+	fprintf(fp, "  -h, --help                 Show this help\n");
+}
+
+/*
+ * Return the nanoseconds elapsed since start.
+ */
+static uint64_t elapsed_ns(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((uint64_t) now.tv_sec - start->tv_sec) * 1000000000ULL
+		+ now.tv_nsec - start->tv_nsec;
+}
+
+/*
+ * Allocate the node of index i with the key distribution of its type.
+ */
+static struct bench_node *alloc_node(unsigned long i)
+{
+	struct bench_node *node;
+
+	node = calloc(1, sizeof(*node));
+	if (!node) {
+		perror("calloc node");
+		exit(EXIT_FAILURE);
+	}
+
+	switch (opt_type) {
+	case LTTNG_HT_TYPE_U64:
+		lttng_ht_node_init_u64(&node->n.u64, (uint64_t) i);
+		break;
+	case LTTNG_HT_TYPE_ULONG:
+		/* File descriptors start after the standard ones. */
+		lttng_ht_node_init_ulong(&node->n.ulong, i + 3);
+		break;
+	case LTTNG_HT_TYPE_STRING:
+		snprintf(node->name, sizeof(node->name), "lttng_ust_bench:event_%lu",
+				i);
+		lttng_ht_node_init_str(&node->n.str, node->name);
+		break;
+	}
+
+	return node;
+}
+
+/*
+ * Call RCU callback freeing a node.
+ */
+static void free_node_rcu(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct bench_node, rcu_head));
+}
+
+/*
+ * Add a node to the table.
+ */
+static void add_node(struct bench_node *node)
+{
+	switch (opt_type) {
+	case LTTNG_HT_TYPE_U64:
+		lttng_ht_add_unique_u64(ht, &node->n.u64);
+		break;
+	case LTTNG_HT_TYPE_ULONG:
+		lttng_ht_add_unique_ulong(ht, &node->n.ulong);
+		break;
+	case LTTNG_HT_TYPE_STRING:
+		lttng_ht_add_unique_str(ht, &node->n.str);
+		break;
+	}
+}
+
+/*
+ * Lookup the key of index i. The RCU read side lock must be held.
+ */
+static void lookup_key(unsigned long i, struct lttng_ht_iter *iter)
+{
+	uint64_t key_u64 = i;
+	char name[LTTNG_SYMBOL_NAME_LEN];
+
+	switch (opt_type) {
+	case LTTNG_HT_TYPE_U64:
+		lttng_ht_lookup(ht, &key_u64, iter);
+		break;
+	case LTTNG_HT_TYPE_ULONG:
+		lttng_ht_lookup(ht, (void *) (i + 3), iter);
+		break;
+	case LTTNG_HT_TYPE_STRING:
+		snprintf(name, sizeof(name), "lttng_ust_bench:event_%lu", i);
+		lttng_ht_lookup(ht, name, iter);
+		break;
+	}
+}
+
+/*
+ * Remove the node of index i from the table and free it after a grace period.
+ */
+static void del_node(unsigned long i)
+{
+	int ret;
+	struct lttng_ht_iter iter;
+
+	rcu_read_lock();
+	lookup_key(i, &iter);
+	if (iter.iter.node) {
+		ret = lttng_ht_del(ht, &iter);
+		if (!ret) {
+			call_rcu(&nodes[i]->rcu_head, free_node_rcu);
+		}
+	}
+	rcu_read_unlock();
+}
+
+/*
+ * RCU reader looking up random keys until the test is stopped.
+ */
+static void *reader_thread(void *data)
+{
+	struct bench_reader *reader = data;
+	struct lttng_ht_iter iter;
+
+	rcu_register_thread();
+
+	while (!CMM_LOAD_SHARED(test_stop)) {
+		rcu_read_lock();
+		lookup_key(rand_r(&reader->seed) % opt_nr_nodes, &iter);
+		if (!iter.iter.node) {
+			reader->nr_misses++;
+		}
+		rcu_read_unlock();
+		reader->nr_lookups++;
+	}
+
+	rcu_unregister_thread();
+	return NULL;
+}
+
+/*
+ * Run the readers for the test duration, with a writer replacing random nodes
+ * if churn is set, and report the throughput.
+ */
+static int run_readers(const char *phase, int churn)
+{
+	int ret;
+	unsigned int i, seed = 42;
+	uint64_t nr_lookups = 0, nr_misses = 0, nr_updates = 0, ns;
+	struct bench_reader *readers;
+	struct timespec start;
+
+	readers = calloc(opt_nr_readers, sizeof(*readers));
+	if (!readers) {
+		perror("calloc readers");
+		return -1;
+	}
+
+	CMM_STORE_SHARED(test_stop, 0);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < opt_nr_readers; i++) {
+		readers[i].seed = i + 1;
+		ret = pthread_create(&readers[i].tid, NULL, reader_thread,
+				&readers[i]);
+		if (ret) {
+			errno = ret;
+			perror("pthread_create reader");
+			opt_nr_readers = i;
+			break;
+		}
+	}
+
+	if (churn) {
+		while (elapsed_ns(&start) < opt_duration * 1000000000ULL) {
+			unsigned long idx = rand_r(&seed) % opt_nr_nodes;
+
+			del_node(idx);
+			nodes[idx] = alloc_node(idx);
+			rcu_read_lock();
+			add_node(nodes[idx]);
+			rcu_read_unlock();
+			nr_updates++;
+		}
+	} else {
+		sleep(opt_duration);
+	}
+	CMM_STORE_SHARED(test_stop, 1);
+
+	for (i = 0; i < opt_nr_readers; i++) {
+		(void) pthread_join(readers[i].tid, NULL);
+		nr_lookups += readers[i].nr_lookups;
+		nr_misses += readers[i].nr_misses;
+	}
+	ns = elapsed_ns(&start);
+
+	printf("%-20s %12.1f lookups/s/reader (%" PRIu64 " misses)", phase,
+			opt_nr_readers ?
+			(double) nr_lookups * 1e9 / ns / opt_nr_readers : 0.0,
+			nr_misses);
+	if (churn) {
+		printf(", %.1f updates/s", (double) nr_updates * 1e9 / ns);
+	}
+	printf("\n");
+
+	free(readers);
+	return 0;
+}
+
+/*
+ * Parse the allocator name.
+ */
+static int parse_mm(const char *str)
+{
+	if (!strcmp(str, "default")) {
+		opt_attr.mm = LTTNG_HT_MM_DEFAULT;
+	} else if (!strcmp(str, "order")) {
+		opt_attr.mm = LTTNG_HT_MM_ORDER;
+	} else if (!strcmp(str, "chunk")) {
+		opt_attr.mm = LTTNG_HT_MM_CHUNK;
+	} else if (!strcmp(str, "mmap")) {
+		opt_attr.mm = LTTNG_HT_MM_MMAP;
+	} else {
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Parse the key type name.
+ */
+static int parse_type(const char *str)
+{
+	if (!strcmp(str, "u64")) {
+		opt_type = LTTNG_HT_TYPE_U64;
+	} else if (!strcmp(str, "ulong")) {
+		opt_type = LTTNG_HT_TYPE_ULONG;
+	} else if (!strcmp(str, "string")) {
+		opt_type = LTTNG_HT_TYPE_STRING;
+	} else {
+		return -1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int opt, ret = EXIT_FAILURE;
+	unsigned long i, count;
+	struct lttng_ht_iter iter;
+	struct cds_lfht_node *ht_node;
+	struct timespec start;
+	uint64_t ns;
+
+	while ((opt = getopt_long(argc, argv, "t:m:n:r:d:s:b:Rh",
+					long_options, NULL)) != -1) {
+		switch (opt) {
+		case 't':
+			if (parse_type(optarg) < 0) {
+				usage(stderr);
+				goto end;
+			}
+			break;
+		case 'm':
+			if (parse_mm(optarg) < 0) {
+				usage(stderr);
+				goto end;
+			}
+			break;
+		case 'n':
+			opt_nr_nodes = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			opt_nr_readers = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			opt_duration = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			opt_attr.size_hint = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			opt_attr.max_buckets = strtoul(optarg, NULL, 0);
+			break;
+		case 'R':
+			opt_attr.no_auto_resize = 1;
+			break;
+		case 'h':
+			usage(stdout);
+			ret = EXIT_SUCCESS;
+			goto end;
+		default:
+			usage(stderr);
+			goto end;
+		}
+	}
+	if (!opt_nr_nodes) {
+		usage(stderr);
+		goto end;
+	}
+
+	rcu_register_thread();
+	lttng_ht_seed = hash_key_ulong((void *) time(NULL), 0);
+
+	ht = lttng_ht_new_attr(&opt_attr, opt_type);
+	if (!ht) {
+		goto end_rcu;
+	}
+	nodes = calloc(opt_nr_nodes, sizeof(*nodes));
+	if (!nodes) {
+		perror("calloc nodes");
+		goto end_ht;
+	}
+	for (i = 0; i < opt_nr_nodes; i++) {
+		nodes[i] = alloc_node(i);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	rcu_read_lock();
+	for (i = 0; i < opt_nr_nodes; i++) {
+		add_node(nodes[i]);
+	}
+	rcu_read_unlock();
+	ns = elapsed_ns(&start);
+	printf("%-20s %12.1f ns/op (%lu buckets)\n", "add", (double) ns / opt_nr_nodes,
+			CMM_LOAD_SHARED(ht->ht->size));
+
+	/* Let the lazy resize of the additions complete. */
+	synchronize_rcu();
+
+	run_readers("lookup", 0);
+	run_readers("lookup+update", 1);
+
+	count = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	do {
+		rcu_read_lock();
+		cds_lfht_for_each(ht->ht, &iter.iter, ht_node) {
+			count++;
+		}
+		rcu_read_unlock();
+		ns = elapsed_ns(&start);
+	} while (ns < opt_duration * 1000000000ULL / 4);
+	printf("%-20s %12.1f ns/node\n", "iterate", (double) ns / count);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < opt_nr_nodes; i++) {
+		del_node(i);
+	}
+	ns = elapsed_ns(&start);
+	printf("%-20s %12.1f ns/op\n", "del", (double) ns / opt_nr_nodes);
+
+	ret = EXIT_SUCCESS;
+
+	rcu_barrier();
+	free(nodes);
+end_ht:
+	lttng_ht_destroy(ht);
+end_rcu:
+	rcu_unregister_thread();
+end:
+	return ret;
+}
@@ -0,0 +1,537 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/*
+ * Throughput of the consumer to relayd data path for a number of data
+ * connections, measured against a real lttng-relayd.
+ *
+ * The benchmark plays the consumer: it creates a session and its streams on
+ * the control connection, then sends packets of every stream with
+ * relayd_send_data_hdr() on the data connection the stream maps on (relayd
+ * stream id modulo the number of connections) under the lock of that
+ * connection. The clock stops once the relayd reports no data pending for
+ * every stream, so the numbers include the relayd receiving and writing the
+ * packets.
+ *
+ * By default a relayd is spawned on free loopback ports and writes to a
+ * temporary directory, removed at the end. Use --connect to measure a relayd
+ * started on another host instead.
+ */
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <ftw.h>
+#include <limits.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <common/common.h>
+#include <common/defaults.h>
+#include <common/relayd/relayd.h>
+#include <common/uri.h>
+
+/* For error.h */
+int lttng_opt_quiet = 1;
+int lttng_opt_verbose;
+
+/* Time given to a spawned relayd to listen, in 10 ms steps. */
+#define BENCH_RELAYD_START_TRIES	500
+
+struct bench_conn {
+	struct lttcomm_relayd_sock *rsock;
+	pthread_mutex_t lock;
+};
+
+struct bench_stream {
+	uint64_t relayd_id;
+	uint64_t next_net_seq_num;
+};
+
+struct bench_sender {
+	pthread_t tid;
+	unsigned int id;
+	uint64_t nr_bytes;
+	int error;
+};
+
+static unsigned int opt_nr_conns = 1;
+static unsigned int opt_nr_streams = 16;
+static unsigned int opt_nr_senders = 1;
+static unsigned long opt_packet_size = 262144;
+static unsigned int opt_duration = 5;
+static char *opt_connect;
+static int opt_control_port = DEFAULT_NETWORK_CONTROL_PORT;
+static int opt_data_port = DEFAULT_NETWORK_DATA_PORT;
+static char *opt_relayd = RELAYD_BIN;
+static char *opt_output;
+
+static struct bench_conn conns[DEFAULT_RELAYD_MAX_DATA_CONNECTIONS];
+static struct bench_stream *streams;
+static volatile int test_stop;
+
+static struct option long_options[] = {
+	{ "connections", 1, 0, 'c' },
+	{ "streams", 1, 0, 's' },
+	{ "senders", 1, 0, 'w' },
+	{ "packet-size", 1, 0, 'S' },
+	{ "duration", 1, 0, 'd' },
+	{ "connect", 1, 0, 'C' },
+	{ "control-port", 1, 0, 'P' },
+	{ "data-port", 1, 0, 'D' },
+	{ "relayd", 1, 0, 'r' },
+	{ "output", 1, 0, 'o' },
+	{ "help", 0, 0, 'h' },
+	{ NULL, 0, 0, 0 },
+};
+
+static void usage(FILE *fp)
+{
+	fprintf(fp, "Usage: relayd_conn_bench [OPTIONS]\n\n");
+	fprintf(fp, "  -c, --connections N   Data connections (default: 1, max: %d)\n",
+			DEFAULT_RELAYD_MAX_DATA_CONNECTIONS);
+	fprintf(fp, "  -s, --streams N       Streams spread over the connections (default: 16)\n");
+	fprintf(fp, "  -w, --senders N       Sending threads (default: 1)\n");
+	fprintf(fp, "  -S, --packet-size N   Bytes per packet (default: 262144)\n");
+	fprintf(fp, "  -d, --duration N      Seconds of sending (default: 5)\n");
+	fprintf(fp, "  -C, --connect HOST    Use the relayd of HOST instead of spawning one\n");
+	fprintf(fp, "  -P, --control-port N  Control port of the --connect relayd (default: %d)\n",
+			DEFAULT_NETWORK_CONTROL_PORT);
+	fprintf(fp, "  -D, --data-port N     Data port of the --connect relayd (default: %d)\n",
+			DEFAULT_NETWORK_DATA_PORT);
+	fprintf(fp, "  -r, --relayd PATH     lttng-relayd to spawn (default: %s)\n",
+			RELAYD_BIN);
+	fprintf(fp, "  -o, --output DIR      Output of the spawned relayd (default: temporary)\n");
+	fprintf(fp, "  -h, --help            Show this help\n");
+}
+
+/*
+ * Return the seconds elapsed since start.
+ */
+static double elapsed_s(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) +
+		(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+ * Return a loopback TCP port free at the time of the call, or -1.
+ */
+static int get_free_port(void)
+{
+	int fd, port = -1;
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+			getsockname(fd, (struct sockaddr *) &addr, &len) < 0) {
+		perror("bind free port");
+	} else {
+		port = ntohs(addr.sin_port);
+	}
+	close(fd);
+
+	return port;
+}
+
+/*
+ * Spawn a relayd listening on free loopback ports, setting the control and
+ * data ports for the benchmark.
+ *
+ * Return the pid of the relayd or -1.
+ */
+static pid_t spawn_relayd(void)
+{
+	pid_t pid;
+	int live_port;
+	char ctrl_url[64], data_url[64], live_url[64];
+
+	opt_control_port = get_free_port();
+	opt_data_port = get_free_port();
+	live_port = get_free_port();
+	if (opt_control_port < 0 || opt_data_port < 0 || live_port < 0) {
+		return -1;
+	}
+	snprintf(ctrl_url, sizeof(ctrl_url), "tcp://127.0.0.1:%d", opt_control_port);
+	snprintf(data_url, sizeof(data_url), "tcp://127.0.0.1:%d", opt_data_port);
+	snprintf(live_url, sizeof(live_url), "tcp://127.0.0.1:%d", live_port);
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return -1;
+	}
+	if (pid == 0) {
+		execl(opt_relayd, "lttng-relayd", "-C", ctrl_url, "-D", data_url,
+				"-L", live_url, "-o", opt_output, NULL);
+		perror("exec lttng-relayd");
+		_exit(EXIT_FAILURE);
+	}
+
+	return pid;
+}
+
+/*
+ * Connect a control or data socket to the relayd, checking the version of a
+ * control one. A spawned relayd is given some time to listen.
+ *
+ * Return the socket or NULL.
+ */
+static struct lttcomm_relayd_sock *connect_relayd(int port,
+		enum lttng_stream_type stype, unsigned int tries)
+{
+	int ret;
+	char url[PATH_MAX];
+	struct lttng_uri *uri;
+	struct lttcomm_relayd_sock *rsock = NULL;
+
+	snprintf(url, sizeof(url), "tcp://%s:%d",
+			opt_connect ? opt_connect : "127.0.0.1", port);
+	if (uri_parse(url, &uri) != 1) {
+		fprintf(stderr, "Invalid relayd URL %s\n", url);
+		return NULL;
+	}
+	uri->stype = stype;
+
+	for (;;) {
+		rsock = lttcomm_alloc_relayd_sock(uri, RELAYD_VERSION_COMM_MAJOR,
+				RELAYD_VERSION_COMM_MINOR);
+		if (!rsock) {
+			break;
+		}
+		ret = relayd_connect(rsock);
+		if (!ret) {
+			break;
+		}
+		(void) relayd_close(rsock);
+		free(rsock);
+		rsock = NULL;
+		if (--tries == 0) {
+			fprintf(stderr, "Unable to reach the relayd on %s\n", url);
+			break;
+		}
+		usleep(10000);
+	}
+	if (rsock && stype == LTTNG_STREAM_CONTROL &&
+			relayd_version_check(rsock) < 0) {
+		fprintf(stderr, "Incompatible relayd on %s\n", url);
+		(void) relayd_close(rsock);
+		free(rsock);
+		rsock = NULL;
+	}
+	uri_free(uri);
+
+	return rsock;
+}
+
+/*
+ * Send packets of the streams of the sender, in turn, until the end of the
+ * benchmark, as the consumer does for the relayd of a stream.
+ */
+static void *thread_sender(void *data)
+{
+	struct bench_sender *sender = data;
+	struct bench_stream *stream;
+	struct bench_conn *conn;
+	struct lttcomm_relayd_data_hdr hdr;
+	unsigned int i;
+	ssize_t ret;
+	char *buf;
+
+	buf = calloc(1, opt_packet_size);
+	if (!buf) {
+		perror("calloc packet");
+		sender->error = 1;
+		return NULL;
+	}
+
+	while (!test_stop) {
+		for (i = sender->id; i < opt_nr_streams && !test_stop;
+				i += opt_nr_senders) {
+			stream = &streams[i];
+			conn = &conns[stream->relayd_id % opt_nr_conns];
+
+			memset(&hdr, 0, sizeof(hdr));
+			hdr.stream_id = htobe64(stream->relayd_id);
+			hdr.net_seq_num = htobe64(stream->next_net_seq_num);
+			hdr.data_size = htobe32(opt_packet_size);
+
+			pthread_mutex_lock(&conn->lock);
+			ret = relayd_send_data_hdr(conn->rsock, &hdr, sizeof(hdr));
+			if (ret >= 0) {
+				ret = conn->rsock->sock.ops->sendmsg(&conn->rsock->sock,
+						buf, opt_packet_size, 0);
+			}
+			pthread_mutex_unlock(&conn->lock);
+			if (ret < 0) {
+				fprintf(stderr, "Sending packet of stream %" PRIu64 " failed\n",
+						stream->relayd_id);
+				sender->error = 1;
+				goto end;
+			}
+			stream->next_net_seq_num++;
+			sender->nr_bytes += opt_packet_size;
+		}
+	}
+
+end:
+	free(buf);
+	return NULL;
+}
+
+/*
+ * Wait until the relayd received and wrote every packet sent.
+ *
+ * Return 0 on success or -1.
+ */
+static int wait_data_pending(struct lttcomm_relayd_sock *ctrl)
+{
+	int ret;
+	unsigned int i;
+
+	for (i = 0; i < opt_nr_streams; i++) {
+		if (!streams[i].next_net_seq_num) {
+			continue;
+		}
+		do {
+			ret = relayd_data_pending(ctrl, streams[i].relayd_id,
+					streams[i].next_net_seq_num - 1);
+			if (ret == 1) {
+				usleep(1000);
+			}
+		} while (ret == 1);
+		if (ret < 0) {
+			fprintf(stderr, "Data pending of stream %" PRIu64 " failed\n",
+					streams[i].relayd_id);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Remove a file of the temporary output, called by nftw().
+ */
+static int remove_output_file(const char *path, const struct stat *sb,
+		int flag, struct FTW *ftwbuf)
+{
+	return remove(path);
+}
+
+int main(int argc, char **argv)
+{
+	int opt, ret = EXIT_FAILURE, tmp_output = 0;
+	unsigned int i, nr_conns = 0;
+	uint64_t nr_bytes = 0, session_id;
+	double send_s, total_s;
+	pid_t relayd_pid = -1;
+	char tmp_dir[] = "/tmp/relayd-bench-XXXXXX";
+	char name[LTTNG_SYMBOL_NAME_LEN];
+	struct lttcomm_relayd_sock *ctrl = NULL;
+	struct bench_sender *senders = NULL;
+	struct timespec start;
+
+	while ((opt = getopt_long(argc, argv, "c:s:w:S:d:C:P:D:r:o:h",
+					long_options, NULL)) != -1) {
+		switch (opt) {
+		case 'c':
+			opt_nr_conns = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			opt_nr_streams = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			opt_nr_senders = strtoul(optarg, NULL, 0);
+			break;
+		case 'S':
+			opt_packet_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			opt_duration = strtoul(optarg, NULL, 0);
+			break;
+		case 'C':
+			opt_connect = optarg;
+			break;
+		case 'P':
+			opt_control_port = atoi(optarg);
+			break;
+		case 'D':
+			opt_data_port = atoi(optarg);
+			break;
+		case 'r':
+			opt_relayd = optarg;
+			break;
+		case 'o':
+			opt_output = optarg;
+			break;
+		case 'h':
+			usage(stdout);
+			return EXIT_SUCCESS;
+		default:
+			usage(stderr);
+			return EXIT_FAILURE;
+		}
+	}
+	if (!opt_nr_conns || opt_nr_conns > DEFAULT_RELAYD_MAX_DATA_CONNECTIONS ||
+			!opt_nr_streams || !opt_nr_senders || !opt_packet_size ||
+			opt_packet_size > UINT32_MAX || (opt_connect && opt_output)) {
+		usage(stderr);
+		return EXIT_FAILURE;
+	}
+
+	/* A relayd that died must not kill the benchmark on send. */
+	signal(SIGPIPE, SIG_IGN);
+
+	if (!opt_connect) {
+		if (!opt_output) {
+			opt_output = mkdtemp(tmp_dir);
+			if (!opt_output) {
+				perror("mkdtemp");
+				return EXIT_FAILURE;
+			}
+			tmp_output = 1;
+		}
+		relayd_pid = spawn_relayd();
+		if (relayd_pid < 0) {
+			goto end;
+		}
+	}
+
+	ctrl = connect_relayd(opt_control_port, LTTNG_STREAM_CONTROL,
+			opt_connect ? 1 : BENCH_RELAYD_START_TRIES);
+	if (!ctrl) {
+		goto end;
+	}
+	for (nr_conns = 0; nr_conns < opt_nr_conns; nr_conns++) {
+		conns[nr_conns].rsock = connect_relayd(opt_data_port,
+				LTTNG_STREAM_DATA, 1);
+		if (!conns[nr_conns].rsock) {
+			goto end;
+		}
+		pthread_mutex_init(&conns[nr_conns].lock, NULL);
+	}
+
+	if (relayd_create_session(ctrl, &session_id) < 0) {
+		fprintf(stderr, "Unable to create a relayd session\n");
+		goto end;
+	}
+	streams = calloc(opt_nr_streams, sizeof(*streams));
+	if (!streams) {
+		perror("calloc streams");
+		goto end;
+	}
+	for (i = 0; i < opt_nr_streams; i++) {
+		snprintf(name, sizeof(name), "bench_%u", i);
+		if (relayd_add_stream(ctrl, name, "relayd-bench",
+					&streams[i].relayd_id, 0, 0,
+					LTTNG_COMPRESSION_NONE) < 0) {
+			fprintf(stderr, "Unable to add stream %s\n", name);
+			goto end;
+		}
+	}
+
+	senders = calloc(opt_nr_senders, sizeof(*senders));
+	if (!senders) {
+		perror("calloc senders");
+		goto end;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < opt_nr_senders; i++) {
+		senders[i].id = i;
+		if (pthread_create(&senders[i].tid, NULL, thread_sender, &senders[i])) {
+			perror("pthread_create sender");
+			test_stop = 1;
+			opt_nr_senders = i;
+			break;
+		}
+	}
+
+	sleep(opt_duration);
+	test_stop = 1;
+
+	ret = EXIT_SUCCESS;
+	for (i = 0; i < opt_nr_senders; i++) {
+		pthread_join(senders[i].tid, NULL);
+		nr_bytes += senders[i].nr_bytes;
+		if (senders[i].error) {
+			ret = EXIT_FAILURE;
+		}
+	}
+	send_s = elapsed_s(&start);
+	if (ret == EXIT_SUCCESS && wait_data_pending(ctrl) < 0) {
+		ret = EXIT_FAILURE;
+	}
+	total_s = elapsed_s(&start);
+	if (ret == EXIT_SUCCESS) {
+		printf("%u connection(s), %u stream(s), %u sender(s): "
+				"%" PRIu64 " packets, sent in %.2f s, written in %.2f s, "
+				"%.1f MB/s\n", opt_nr_conns, opt_nr_streams,
+				opt_nr_senders, nr_bytes / opt_packet_size, send_s,
+				total_s, nr_bytes / total_s / 1e6);
+	}
+
+	for (i = 0; i < opt_nr_streams; i++) {
+		(void) relayd_send_close_stream(ctrl, streams[i].relayd_id,
+				streams[i].next_net_seq_num - 1);
+	}
+
+end:
+	for (i = 0; i < nr_conns; i++) {
+		(void) relayd_close(conns[i].rsock);
+		free(conns[i].rsock);
+	}
+	if (ctrl) {
+		(void) relayd_close(ctrl);
+		free(ctrl);
+	}
+	if (relayd_pid > 0) {
+		(void) kill(relayd_pid, SIGTERM);
+		(void) waitpid(relayd_pid, NULL, 0);
+	}
+	if (tmp_output) {
+		(void) nftw(opt_output, remove_output_file, 16,
+				FTW_DEPTH | FTW_PHYS);
+	}
+	free(senders);
+	free(streams);
+
+	return ret;
+}
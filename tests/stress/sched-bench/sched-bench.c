@@ -0,0 +1,343 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/*
+ * Throughput benchmark of the stream scheduling of the consumer data threads.
+ * The per-CPU buffers of a session are simulated in discard mode: a few hot
+ * streams produce much more than the others and the consumer can only read a
+ * given number of subbuffers per tick, like a thread bound by its output. The
+ * same production is consumed in poll order, as the data threads did before,
+ * then in the order of the configured scheduling, and the discarded events of
+ * both runs are reported.
+ */
+
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <common/defaults.h>
+#include <common/stream-sched.h>
+
+/* For error.h */
+int lttng_opt_quiet = 1;
+int lttng_opt_verbose;
+
+struct bench_stream {
+	/* Weight of the channel of the stream. */
+	unsigned int weight;
+	/* Events per tick produced by the stream. */
+	double rate;
+	/* Fraction of event carried over to the next tick. */
+	double carry;
+	/* Events produced and not consumed. */
+	uint64_t backlog;
+	uint64_t produced;
+	uint64_t discarded;
+};
+
+struct bench_result {
+	uint64_t produced;
+	uint64_t discarded;
+	unsigned long discarding_streams;
+	uint64_t max_discarded;
+};
+
+static unsigned long opt_nr_streams = 64;
+static unsigned long opt_nr_hot = 4;
+static double opt_hot_rate = 2000;
+static double opt_cold_rate = 50;
+static unsigned long opt_subbuf_events = 1000;
+static unsigned long opt_nr_subbufs = 8;
+static unsigned long opt_capacity = 12;
+static unsigned long opt_ticks = 100000;
+static struct lttng_stream_sched_config sched;
+
+static struct option long_options[] = {
+	{ "streams", 1, 0, 's' },
+	{ "hot", 1, 0, 'H' },
+	{ "hot-rate", 1, 0, 'r' },
+	{ "cold-rate", 1, 0, 'c' },
+	{ "subbuf-events", 1, 0, 'e' },
+	{ "subbufs", 1, 0, 'n' },
+	{ "capacity", 1, 0, 'C' },
+	{ "ticks", 1, 0, 't' },
+	{ "burst", 1, 0, 'b' },
+	{ "starvation", 1, 0, 'S' },
+	{ "weights", 1, 0, 'w' },
+	{ "help", 0, 0, 'h' },
+	{ NULL, 0, 0, 0 },
+};
+
+static void usage(FILE *fp)
+{
+	fprintf(fp, "Usage: sched_bench [OPTIONS]\n\n");
+	fprintf(fp, "  -s, --streams N        Streams (default: 64)\n");
+	fprintf(fp, "  -H, --hot N            Hot streams, of channel \"hot\" (default: 4)\n");
+	fprintf(fp, "  -r, --hot-rate N       Events per tick of a hot stream (default: 2000)\n");
+	fprintf(fp, "  -c, --cold-rate N      Events per tick of a cold stream (default: 50)\n");
+	fprintf(fp, "  -e, --subbuf-events N  Events per subbuffer (default: 1000)\n");
+	fprintf(fp, "  -n, --subbufs N        Subbuffers per buffer (default: 8)\n");
+	fprintf(fp, "  -C, --capacity N       Subbuffers consumed per tick (default: 12)\n");
+	fprintf(fp, "  -t, --ticks N          Ticks simulated (default: 100000)\n");
+	fprintf(fp, "  -b, --burst N          Most subbuffers per stream and pass (default: %d)\n",
+			DEFAULT_CONSUMERD_SCHED_BURST);
+	fprintf(fp, "  -S, --starvation N     Most consecutive urgent passes, 0 for no limit\n"
+			"                         (default: %d)\n",
+			DEFAULT_CONSUMERD_SCHED_STARVATION);
+	fprintf(fp, "  -w, --weights LIST     Channel weights, like \"cold=2\"\n");
+	fprintf(fp, "  -h, --help             Show this help\n");
+}
+
+/*
+ * Produce the events of a tick, discarding the ones not fitting in the buffer.
+ */
+static void produce(struct bench_stream *streams, unsigned int *seed)
+{
+	unsigned long i;
+	uint64_t events, room, size = opt_subbuf_events * opt_nr_subbufs;
+
+	for (i = 0; i < opt_nr_streams; i++) {
+		struct bench_stream *stream = &streams[i];
+		/* Bursty production around the rate of the stream. */
+		double amount = stream->rate * 2 * (rand_r(seed) / (RAND_MAX + 1.0)) +
+			stream->carry;
+
+		events = (uint64_t) amount;
+		stream->carry = amount - events;
+		room = size - stream->backlog;
+		stream->produced += events;
+		if (events > room) {
+			stream->discarded += events - room;
+			events = room;
+		}
+		stream->backlog += events;
+	}
+}
+
+/*
+ * Consume a subbuffer of a stream. Return 1 if one was ready.
+ */
+static int consume(struct bench_stream *stream)
+{
+	if (stream->backlog < opt_subbuf_events) {
+		return 0;
+	}
+	stream->backlog -= opt_subbuf_events;
+	return 1;
+}
+
+/*
+ * Run a pass over the ready streams like a data thread, the urgent ones being
+ * the full buffers. Return the subbuffers consumed, at most budget.
+ */
+static unsigned long run_pass(struct bench_stream *streams,
+		const struct lttng_stream_sched_config *config,
+		struct lttng_stream_sched_entry *ready, int urgent,
+		unsigned long budget)
+{
+	unsigned long i, b, nr_ready = 0, consumed = 0;
+	uint64_t full = opt_subbuf_events * (opt_nr_subbufs - 1);
+
+	for (i = 0; i < opt_nr_streams; i++) {
+		struct bench_stream *stream = &streams[i];
+
+		if (stream->backlog < opt_subbuf_events ||
+				(urgent && stream->backlog < full)) {
+			continue;
+		}
+		if (config->backlog) {
+			lttng_stream_sched_set(&ready[nr_ready], config, i,
+					stream->backlog, opt_subbuf_events, stream->weight);
+		} else {
+			ready[nr_ready].index = i;
+			ready[nr_ready].burst = 1;
+		}
+		nr_ready++;
+	}
+	if (config->backlog) {
+		lttng_stream_sched_sort(ready, nr_ready);
+	}
+
+	for (i = 0; i < nr_ready && consumed < budget; i++) {
+		for (b = 0; b < ready[i].burst && consumed < budget; b++) {
+			if (!consume(&streams[ready[i].index])) {
+				break;
+			}
+			consumed++;
+		}
+	}
+
+	return consumed;
+}
+
+/*
+ * Simulate the streams consumed with a scheduling configuration.
+ */
+static void run(const struct lttng_stream_sched_config *config,
+		struct bench_result *result)
+{
+	unsigned long i, tick, budget, consumed;
+	unsigned int seed = 42, urgent_passes = 0;
+	struct bench_stream *streams;
+	struct lttng_stream_sched_entry *ready;
+
+	streams = calloc(opt_nr_streams, sizeof(*streams));
+	ready = calloc(opt_nr_streams, sizeof(*ready));
+	if (!streams || !ready) {
+		perror("calloc streams");
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < opt_nr_streams; i++) {
+		/* The hot streams are the last ones of the poll array. */
+		if (i >= opt_nr_streams - opt_nr_hot) {
+			streams[i].weight = lttng_stream_sched_weight(config, "hot");
+			streams[i].rate = opt_hot_rate;
+		} else {
+			streams[i].weight = lttng_stream_sched_weight(config, "cold");
+			streams[i].rate = opt_cold_rate;
+		}
+	}
+
+	for (tick = 0; tick < opt_ticks; tick++) {
+		produce(streams, &seed);
+		budget = opt_capacity;
+		while (budget) {
+			if (!config->starvation || urgent_passes < config->starvation) {
+				consumed = run_pass(streams, config, ready, 1, budget);
+				if (consumed) {
+					urgent_passes++;
+					budget -= consumed;
+					continue;
+				}
+			}
+			urgent_passes = 0;
+			consumed = run_pass(streams, config, ready, 0, budget);
+			if (!consumed) {
+				break;
+			}
+			budget -= consumed;
+		}
+	}
+
+	memset(result, 0, sizeof(*result));
+	for (i = 0; i < opt_nr_streams; i++) {
+		result->produced += streams[i].produced;
+		result->discarded += streams[i].discarded;
+		if (streams[i].discarded) {
+			result->discarding_streams++;
+		}
+		if (streams[i].discarded > result->max_discarded) {
+			result->max_discarded = streams[i].discarded;
+		}
+	}
+
+	free(ready);
+	free(streams);
+}
+
+static void print_result(const char *name, const struct bench_result *result)
+{
+	printf("%-8s %" PRIu64 " events, %" PRIu64 " discarded (%.3f%%), "
+			"%lu streams discarding, at most %" PRIu64 "\n", name,
+			result->produced, result->discarded,
+			result->produced ?
+				100.0 * result->discarded / result->produced : 0,
+			result->discarding_streams, result->max_discarded);
+}
+
+int main(int argc, char **argv)
+{
+	int opt;
+	struct lttng_stream_sched_config poll_order;
+	struct bench_result before, after;
+
+	memset(&sched, 0, sizeof(sched));
+	sched.backlog = 1;
+	sched.max_burst = DEFAULT_CONSUMERD_SCHED_BURST;
+	sched.starvation = DEFAULT_CONSUMERD_SCHED_STARVATION;
+
+	while ((opt = getopt_long(argc, argv, "s:H:r:c:e:n:C:t:b:S:w:h",
+					long_options, NULL)) != -1) {
+		switch (opt) {
+		case 's':
+			opt_nr_streams = strtoul(optarg, NULL, 0);
+			break;
+		case 'H':
+			opt_nr_hot = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			opt_hot_rate = strtod(optarg, NULL);
+			break;
+		case 'c':
+			opt_cold_rate = strtod(optarg, NULL);
+			break;
+		case 'e':
+			opt_subbuf_events = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			opt_nr_subbufs = strtoul(optarg, NULL, 0);
+			break;
+		case 'C':
+			opt_capacity = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			opt_ticks = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			sched.max_burst = strtoul(optarg, NULL, 0);
+			break;
+		case 'S':
+			sched.starvation = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			sched.weights = optarg;
+			break;
+		case 'h':
+			usage(stdout);
+			return EXIT_SUCCESS;
+		default:
+			usage(stderr);
+			return EXIT_FAILURE;
+		}
+	}
+	if (!opt_nr_streams || opt_nr_hot > opt_nr_streams || !opt_subbuf_events ||
+			opt_nr_subbufs < 2 || !opt_capacity || !sched.max_burst) {
+		usage(stderr);
+		return EXIT_FAILURE;
+	}
+
+	/* The data threads before: poll order, urgent streams without limit. */
+	memset(&poll_order, 0, sizeof(poll_order));
+	poll_order.max_burst = 1;
+
+	run(&poll_order, &before);
+	run(&sched, &after);
+
+	printf("%lu streams, %lu hot, %lu subbuffers of %lu events, "
+			"%lu subbuffers consumed per tick\n", opt_nr_streams, opt_nr_hot,
+			opt_nr_subbufs, opt_subbuf_events, opt_capacity);
+	printf("backlog order: burst %u, starvation %u, weights %s\n",
+			sched.max_burst, sched.starvation,
+			sched.weights ? sched.weights : "none");
+	print_result("before:", &before);
+	print_result("after:", &after);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,106 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <tap/tap.h>
+
+#include <src/common/compress/compress.h>
+
+/* For lttngerr.h */
+int lttng_opt_quiet = 1;
+int lttng_opt_verbose = 3;
+
+#define NUM_TESTS		10
+#define PACKET_SIZE		16384
+#define PACKET_HEADER_SIZE	64
+
+/*
+ * Fill a packet with a header followed by repetitive event payloads, like a
+ * real sub-buffer.
+ */
+static void make_packet(char *buf)
+{
+	unsigned int i;
+
+	for (i = 0; i < PACKET_HEADER_SIZE; i++) {
+		buf[i] = i;
+	}
+	for (; i < PACKET_SIZE; i++) {
+		buf[i] = "event payload"[i % 13];
+	}
+}
+
+static void test_compress_algo(enum lttng_compression algo)
+{
+	ssize_t ret, frame_len;
+	size_t bound;
+	char *packet, *frame, *out;
+
+	skip_start(!lttng_compress_supported(algo), 5,
+			"%s compression not built", lttng_compress_name(algo));
+
+	packet = malloc(PACKET_SIZE);
+	out = malloc(PACKET_SIZE);
+	bound = lttng_compress_frame_bound(algo, PACKET_SIZE);
+	frame = malloc(bound);
+	if (!packet || !out || !frame) {
+		fail("Allocate %s buffers", lttng_compress_name(algo));
+		goto end;
+	}
+	make_packet(packet);
+
+	frame_len = lttng_compress_frame(algo, packet, PACKET_SIZE, frame, bound);
+	ok(frame_len > 0 && frame_len < PACKET_SIZE, "Compress packet with %s",
+			lttng_compress_name(algo));
+	ok(lttng_compress_is_frame(frame, frame_len), "%s frame is recognized",
+			lttng_compress_name(algo));
+
+	ret = lttng_compress_frame_decode(frame, frame_len, out, PACKET_SIZE);
+	ok(ret == PACKET_SIZE && !memcmp(out, packet, PACKET_SIZE),
+			"Decode whole %s frame", lttng_compress_name(algo));
+
+	memset(out, 0, PACKET_SIZE);
+	ret = lttng_compress_frame_decode(frame, frame_len, out,
+			PACKET_HEADER_SIZE);
+	ok(ret == PACKET_HEADER_SIZE && !memcmp(out, packet, PACKET_HEADER_SIZE),
+			"Decode %s packet header only", lttng_compress_name(algo));
+
+	ret = lttng_compress_frame(algo, packet, PACKET_SIZE, frame, bound - 1);
+	ok(ret == -EINVAL, "Reject %s frame buffer below bound",
+			lttng_compress_name(algo));
+
+end:
+	free(frame);
+	free(out);
+	free(packet);
+
+	skip_end();
+}
+
+int main(int argc, char **argv)
+{
+	plan_tests(NUM_TESTS);
+
+	diag("Packet compression tests");
+
+	test_compress_algo(LTTNG_COMPRESSION_LZ4);
+	test_compress_algo(LTTNG_COMPRESSION_ZSTD);
+
+	return exit_status();
+}
@@ -0,0 +1,234 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <tap/tap.h>
+
+#include <common/common.h>
+#include <common/sessiond-comm/sessiond-comm.h>
+#include <bin/lttng-sessiond/consumer.h>
+
+/* For lttngerr.h */
+int lttng_opt_quiet = 1;
+int lttng_opt_verbose = 0;
+
+int ust_consumerd32_fd;
+int ust_consumerd64_fd;
+
+#define CHANNEL_KEY	42
+/* Streams of a channel spanning two full batches and a partial one. */
+#define NB_STREAMS	(2 * LTTCOMM_MAX_SEND_FDS + 3)
+
+/* Number of TAP tests in this file */
+#define NUM_TESTS 11
+
+/*
+ * Fd given to the stream of a CPU, never opened.
+ */
+static int cpu_fd(int cpu)
+{
+	return 1000 + cpu;
+}
+
+static void test_batch_boundary(void)
+{
+	int i, full = 0, fds[LTTCOMM_MAX_SEND_FDS];
+	int mapped = 1;
+	struct lttcomm_consumer_msg msg;
+
+	consumer_init_streams_comm_msg(&msg, CHANNEL_KEY);
+	ok(msg.cmd_type == LTTNG_CONSUMER_ADD_STREAMS &&
+			msg.u.streams.channel_key == CHANNEL_KEY &&
+			msg.u.streams.nb_streams == 0,
+			"Empty batch of the channel");
+
+	for (i = 0; i < LTTCOMM_MAX_SEND_FDS - 1; i++) {
+		full |= consumer_add_streams_comm_msg(&msg, fds, cpu_fd(i), i);
+	}
+	ok(!full && msg.u.streams.nb_streams == LTTCOMM_MAX_SEND_FDS - 1,
+			"Batch not full below %d streams", LTTCOMM_MAX_SEND_FDS);
+
+	full = consumer_add_streams_comm_msg(&msg, fds, cpu_fd(i), i);
+	ok(full && msg.u.streams.nb_streams == LTTCOMM_MAX_SEND_FDS,
+			"Batch full at %d streams", LTTCOMM_MAX_SEND_FDS);
+
+	for (i = 0; i < LTTCOMM_MAX_SEND_FDS; i++) {
+		if (msg.u.streams.cpus[i] != i || fds[i] != cpu_fd(i)) {
+			mapped = 0;
+		}
+	}
+	ok(mapped, "Each fd is at the index of its CPU");
+}
+
+/*
+ * Batch the streams of a channel like kernel_consumer_send_channel_stream()
+ * and check the size and content of every batch.
+ */
+static void test_batches(void)
+{
+	int i, j, nb_batches = 0, mapped = 1;
+	int fds[LTTCOMM_MAX_SEND_FDS];
+	uint32_t sizes[3] = { 0, 0, 0 };
+	struct lttcomm_consumer_msg msg;
+
+	consumer_init_streams_comm_msg(&msg, CHANNEL_KEY);
+	for (i = 0; i < NB_STREAMS; i++) {
+		if (!consumer_add_streams_comm_msg(&msg, fds, cpu_fd(i), i)) {
+			continue;
+		}
+		/* Batch sent, its first CPU is the one of its first stream. */
+		for (j = 0; j < msg.u.streams.nb_streams; j++) {
+			if (msg.u.streams.cpus[j] != i + 1 - msg.u.streams.nb_streams + j ||
+					fds[j] != cpu_fd(msg.u.streams.cpus[j])) {
+				mapped = 0;
+			}
+		}
+		if (nb_batches < 3) {
+			sizes[nb_batches] = msg.u.streams.nb_streams;
+		}
+		nb_batches++;
+		consumer_init_streams_comm_msg(&msg, CHANNEL_KEY);
+	}
+	if (msg.u.streams.nb_streams) {
+		for (j = 0; j < msg.u.streams.nb_streams; j++) {
+			if (msg.u.streams.cpus[j] != NB_STREAMS -
+					msg.u.streams.nb_streams + j) {
+				mapped = 0;
+			}
+		}
+		if (nb_batches < 3) {
+			sizes[nb_batches] = msg.u.streams.nb_streams;
+		}
+		nb_batches++;
+	}
+
+	ok(nb_batches == 3, "%d streams sent in 3 batches", NB_STREAMS);
+	ok(sizes[0] == LTTCOMM_MAX_SEND_FDS && sizes[1] == LTTCOMM_MAX_SEND_FDS &&
+			sizes[2] == NB_STREAMS - 2 * LTTCOMM_MAX_SEND_FDS,
+			"Two full batches then a partial one");
+	ok(mapped, "Every batch maps its fds to the CPUs in order");
+}
+
+static void test_unpack_count(void)
+{
+	struct lttcomm_consumer_msg msg;
+
+	consumer_init_streams_comm_msg(&msg, CHANNEL_KEY);
+	ok(lttcomm_consumer_msg_nb_streams(&msg) == -1, "Empty batch refused");
+
+	msg.u.streams.nb_streams = LTTCOMM_MAX_SEND_FDS + 1;
+	ok(lttcomm_consumer_msg_nb_streams(&msg) == -1,
+			"Batch above %d streams refused", LTTCOMM_MAX_SEND_FDS);
+}
+
+/*
+ * Send a full batch of pipe read ends over a UNIX socket like the session
+ * daemon, receive it like the consumer and check that the fd received for
+ * each CPU reads from the pipe of that CPU.
+ */
+static void test_send_recv(void)
+{
+	int i, ret, nb_streams, mapped = 1;
+	int sv[2], pipes[LTTCOMM_MAX_SEND_FDS][2];
+	int fds[LTTCOMM_MAX_SEND_FDS], recv_fds[LTTCOMM_MAX_SEND_FDS];
+	struct lttcomm_consumer_msg msg, recv_msg;
+
+	for (i = 0; i < LTTCOMM_MAX_SEND_FDS; i++) {
+		pipes[i][0] = pipes[i][1] = recv_fds[i] = -1;
+	}
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+		fail("Create the session daemon and consumer sockets");
+		skip(1, "No sockets");
+		return;
+	}
+
+	/* CPUs in reverse order so the fd index differs from the CPU. */
+	consumer_init_streams_comm_msg(&msg, CHANNEL_KEY);
+	for (i = 0; i < LTTCOMM_MAX_SEND_FDS; i++) {
+		if (pipe(pipes[i]) < 0) {
+			fail("Create the stream pipes");
+			goto error;
+		}
+		(void) consumer_add_streams_comm_msg(&msg, fds, pipes[i][0],
+				LTTCOMM_MAX_SEND_FDS - 1 - i);
+	}
+
+	ret = lttcomm_send_unix_sock(sv[0], &msg, sizeof(msg));
+	if (ret == sizeof(msg)) {
+		ret = lttcomm_send_fds_unix_sock(sv[0], fds,
+				msg.u.streams.nb_streams);
+	}
+	if (ret <= 0) {
+		fail("Send the batch");
+		goto error;
+	}
+
+	ret = lttcomm_recv_unix_sock(sv[1], &recv_msg, sizeof(recv_msg));
+	nb_streams = lttcomm_consumer_msg_nb_streams(&recv_msg);
+	if (ret != sizeof(recv_msg) || nb_streams != LTTCOMM_MAX_SEND_FDS) {
+		fail("Receive the batch of %d streams", LTTCOMM_MAX_SEND_FDS);
+		goto error;
+	}
+	ret = lttcomm_recv_fds_unix_sock(sv[1], recv_fds, nb_streams);
+	ok(ret == sizeof(int) * nb_streams,
+			"Receive the %d fds of the batch in one message", nb_streams);
+
+	for (i = 0; i < nb_streams; i++) {
+		char cpu = LTTCOMM_MAX_SEND_FDS - 1 - i, read_cpu = -1;
+
+		if (write(pipes[i][1], &cpu, 1) != 1 ||
+				read(recv_fds[i], &read_cpu, 1) != 1 ||
+				read_cpu != recv_msg.u.streams.cpus[i]) {
+			mapped = 0;
+		}
+	}
+	ok(mapped, "Each received fd is the stream of its CPU");
+	goto end;
+
+error:
+	skip(1, "No batch received");
+end:
+	for (i = 0; i < LTTCOMM_MAX_SEND_FDS; i++) {
+		if (pipes[i][0] >= 0) {
+			close(pipes[i][0]);
+			close(pipes[i][1]);
+		}
+		if (recv_fds[i] >= 0) {
+			close(recv_fds[i]);
+		}
+	}
+	close(sv[0]);
+	close(sv[1]);
+}
+
+int main(int argc, char **argv)
+{
+	plan_tests(NUM_TESTS);
+
+	diag("Consumer add streams message unit test");
+
+	test_batch_boundary();
+	test_batches();
+	test_unpack_count();
+	test_send_recv();
+
+	return exit_status();
+}
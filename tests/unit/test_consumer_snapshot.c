@@ -0,0 +1,92 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <tap/tap.h>
+
+#include <common/consumer.h>
+
+/* For lttngerr.h */
+int lttng_opt_quiet = 1;
+int lttng_opt_verbose = 3;
+
+/* Sub-buffer size of the test cases. */
+#define SB	4096UL
+
+struct first_pos_test_input {
+	const char *desc;
+	unsigned long consumed;
+	unsigned long produced;
+	unsigned long max_sb_size;
+	uint64_t max_size;
+	unsigned long expected;
+};
+
+/* First snapshot position test cases */
+static struct first_pos_test_input first_pos_tests_inputs[] = {
+	{ "No size limit", 0, 8 * SB, SB, 0, 0 },
+	{ "Unknown sub-buffer size", 0, 8 * SB, 0, 2 * SB, 0 },
+	{ "Empty range", 5 * SB, 5 * SB, SB, 2 * SB, 5 * SB },
+	{ "Range smaller than the limit", SB, 3 * SB, SB, 4 * SB, SB },
+	{ "Range equal to the limit", SB, 5 * SB, SB, 4 * SB, SB },
+	{ "Range larger than the limit", 0, 8 * SB, SB, 3 * SB, 5 * SB },
+	{ "Limit not a multiple of sub-buffers", 0, 8 * SB, SB,
+		2 * SB + SB / 2, 6 * SB },
+	{ "Limit smaller than a sub-buffer", 0, 8 * SB, SB, SB / 2, 7 * SB },
+	{ "Limit larger than any range", 0, 8 * SB, SB, UINT64_MAX, 0 },
+	{ "Wrapped range fitting", ULONG_MAX - SB + 1, SB, SB, 4 * SB,
+		ULONG_MAX - SB + 1 },
+	{ "Wrapped range trimmed", ULONG_MAX - SB + 1, 3 * SB, SB, 2 * SB,
+		SB },
+	{ "Wrapped range trimmed before the wrap", ULONG_MAX - 4 * SB + 1,
+		SB, SB, 2 * SB, ULONG_MAX - SB + 1 },
+};
+static const int num_first_pos_tests =
+	sizeof(first_pos_tests_inputs) / sizeof(first_pos_tests_inputs[0]);
+
+static void test_snapshot_first_pos(void)
+{
+	int i;
+	unsigned long pos;
+	struct first_pos_test_input *in;
+
+	for (i = 0; i < num_first_pos_tests; i++) {
+		in = &first_pos_tests_inputs[i];
+		pos = consumer_snapshot_first_pos(in->consumed, in->produced,
+				in->max_sb_size, in->max_size);
+		ok(pos == in->expected, "%s: expected %lu, got %lu", in->desc,
+				in->expected, pos);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	plan_tests(num_first_pos_tests);
+
+	diag("Consumer snapshot unit test");
+
+	test_snapshot_first_pos();
+
+	return exit_status();
+}
@@ -0,0 +1,115 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <tap/tap.h>
+
+#include <common/cpu-topology.h>
+
+/* For lttngerr.h */
+int lttng_opt_quiet = 1;
+int lttng_opt_verbose = 3;
+
+struct valid_test_input {
+	char *input;
+	/* CPUs of the list, ended by -1. */
+	int cpus[8];
+};
+
+/* Valid test cases */
+static struct valid_test_input valid_tests_inputs[] = {
+		{ "", { -1 } },
+		{ "0", { 0, -1 } },
+		{ "0-3", { 0, 1, 2, 3, -1 } },
+		{ "0-1,8,10-11", { 0, 1, 8, 10, 11, -1 } },
+		{ "5,2", { 2, 5, -1 } },
+		{ "7-7", { 7, -1 } },
+};
+static const int num_valid_tests = sizeof(valid_tests_inputs) / sizeof(valid_tests_inputs[0]);
+
+/* Invalid test cases */
+static char *invalid_tests_inputs[] = { "-1", "3-1", "0,", "0-", "a", "1 2",
+	"0-99999" };
+static const int num_invalid_tests = sizeof(invalid_tests_inputs) / sizeof(invalid_tests_inputs[0]);
+
+static void test_cpu_list_parse(void)
+{
+	int ret, i, j, count;
+	cpu_set_t set, expected;
+	char name[100];
+
+	/* Test valid cases */
+	for (i = 0; i < num_valid_tests; i++) {
+		CPU_ZERO(&expected);
+		for (j = 0; valid_tests_inputs[i].cpus[j] >= 0; j++) {
+			CPU_SET(valid_tests_inputs[i].cpus[j], &expected);
+		}
+		count = j;
+
+		sprintf(name, "valid test case: \"%s\"", valid_tests_inputs[i].input);
+		ret = lttng_cpu_list_parse(valid_tests_inputs[i].input, &set);
+		ok(ret == 0 && CPU_EQUAL(&set, &expected) && CPU_COUNT(&set) == count,
+				name);
+	}
+
+	/* Test invalid cases */
+	for (i = 0; i < num_invalid_tests; i++) {
+		sprintf(name, "invalid test case: \"%s\"", invalid_tests_inputs[i]);
+		ret = lttng_cpu_list_parse(invalid_tests_inputs[i], &set);
+		ok(ret != 0 && CPU_COUNT(&set) == 0, name);
+	}
+}
+
+static void test_cpu_topology_groups(void)
+{
+	int ret, i, total = 0, overlap = 0;
+	cpu_set_t *groups, all, both;
+
+	CPU_ZERO(&all);
+	ret = lttng_cpu_topology_groups(2, &groups);
+	ok(ret >= 1 && ret <= 2, "Split the CPUs in 2 groups");
+	if (ret < 1) {
+		skip(1, "No CPU group");
+		return;
+	}
+
+	for (i = 0; i < ret; i++) {
+		CPU_AND(&both, &all, &groups[i]);
+		overlap += CPU_COUNT(&both);
+		CPU_OR(&all, &all, &groups[i]);
+		total += CPU_COUNT(&groups[i]);
+	}
+	ok(overlap == 0 && total == CPU_COUNT(&all) && total > 0,
+			"Each CPU is in a single group");
+	free(groups);
+}
+
+int main(int argc, char **argv)
+{
+	plan_tests(num_valid_tests + num_invalid_tests + 2);
+
+	diag("CPU topology tests");
+
+	test_cpu_list_parse();
+	test_cpu_topology_groups();
+
+	return exit_status();
+}
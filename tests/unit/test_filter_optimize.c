@@ -0,0 +1,401 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <tap/tap.h>
+
+#include "filter-ast.h"
+#include "filter-parser.h"
+#include "filter-bytecode.h"
+
+/* For lttngerr.h */
+int lttng_opt_quiet = 1;
+int lttng_opt_verbose = 3;
+
+#define INTERP_STACK_LEN	64
+
+/*
+ * Literal only filters, evaluated without and with the IR optimization.
+ * Field and context references are left out since the result would depend
+ * on the event.
+ */
+static char *tests_inputs[] = {
+	/* Float truth is the truncation done by FILTER_OP_CAST_DOUBLE_TO_S64. */
+	"0.5 && 1",
+	"1 && 0.5",
+	"-0.5 || 0",
+	"0 || 0.999",
+	"1.0 && 1",
+	"-1.5 && 1",
+	"0.0 || 1e300",
+	"1e999 && 1",
+	"!0.5 == 0",
+	"!0.0 == 1",
+	"!!0.5 == 1",
+	"!(0.5 && 1)",
+	/* Negating INT64_MIN overflows. */
+	"-9223372036854775808 < 0",
+	"-(-9223372036854775808) < 0",
+	"18446744073709551615 == -1",
+	"9223372036854775807 > -9223372036854775808",
+	/* Logical operators only return 0 or 1 once folded. */
+	"1 && 2",
+	"2 || 0",
+	"0 || 2",
+	"3 && 0",
+	"!3 || !!3",
+	/* Mixed s64 and double comparisons are done as double. */
+	"1 == 1.0",
+	"9007199254740993 == 9007199254740992.0",
+	"0.5 > 0",
+	"-0.0 == 0",
+	/* Strings. */
+	"\"abc\" == \"abc\"",
+	"\"abc\" < \"abd\"",
+	"\"ab\" > \"abc\"",
+	"\"\" == \"\"",
+	"1 < 2 && (\"x\" != \"y\" || 0.1)",
+};
+static const int num_tests = sizeof(tests_inputs) / sizeof(tests_inputs[0]);
+
+/*
+ * Filters with references, which the interpreter below evaluates as
+ * failing: an operand evaluated without the optimization must still make
+ * the filter fail once optimized.
+ */
+static char *tests_fail_inputs[] = {
+	"intfield == 1 || 1",
+	"intfield == 1 && 0",
+	"(intfield == 1 && 0) || 1",
+	"$ctx.vtid == 1 || 1",
+	"intfield == 1 || strfield == \"abc\"",
+	"intfield == 1 && 1",
+	"!!(intfield == 1) || 1",
+	/* Short-circuited references are never evaluated. */
+	"1 || intfield == 1",
+	"0 && intfield == 1",
+	"(0 && intfield == 1) || 1",
+};
+static const int num_fail_tests =
+	sizeof(tests_fail_inputs) / sizeof(tests_fail_inputs[0]);
+
+enum interp_type {
+	INTERP_S64,
+	INTERP_DOUBLE,
+	INTERP_STRING,
+};
+
+struct interp_reg {
+	enum interp_type type;
+	int64_t v;
+	double d;
+	const char *s;
+};
+
+/*
+ * Compare two strings the way the tracer does for literals holding no
+ * wildcard nor escape, which are the only ones the optimization folds.
+ */
+static int interp_strcmp(const char *a, const char *b)
+{
+	int ret = strcmp(a, b);
+
+	return (ret > 0) - (ret < 0);
+}
+
+/*
+ * Compare two registers, converting s64 to double when mixed.
+ */
+static int interp_compare(struct interp_reg *a, struct interp_reg *b, int *cmp)
+{
+	if (a->type == INTERP_STRING || b->type == INTERP_STRING) {
+		if (a->type != b->type) {
+			return -1;
+		}
+		*cmp = interp_strcmp(a->s, b->s);
+	} else if (a->type == INTERP_DOUBLE || b->type == INTERP_DOUBLE) {
+		double l = a->type == INTERP_DOUBLE ? a->d : (double) a->v;
+		double r = b->type == INTERP_DOUBLE ? b->d : (double) b->v;
+
+		*cmp = (l > r) - (l < r);
+	} else {
+		*cmp = (a->v > b->v) - (a->v < b->v);
+	}
+	return 0;
+}
+
+/*
+ * Truncate a double to s64 as FILTER_OP_CAST_DOUBLE_TO_S64 does on the
+ * architectures the tracer runs on, where an out of range value gives
+ * INT64_MIN.
+ */
+static int64_t interp_double_to_s64(double d)
+{
+	if (d >= 9223372036854775808.0 || d < -9223372036854775808.0 || d != d) {
+		return INT64_MIN;
+	}
+	return (int64_t) d;
+}
+
+/*
+ * Evaluate literal only bytecode with the semantic of the tracer
+ * interpreter: a logical operator leaves its right operand on the stack
+ * when not skipping, and the filter result is the truth of the returned
+ * value. Field and context references always fail, as the tracer does
+ * when the event field type does not fit the operation.
+ *
+ * Return 0 on success and set *result, else -1.
+ */
+static int interpret(struct lttng_filter_bytecode *b, int64_t *result)
+{
+	struct interp_reg stack[INTERP_STACK_LEN], *ax;
+	uint32_t pc = 0;
+	int top = -1, cmp;
+
+	while (pc < b->reloc_table_offset) {
+		filter_opcode_t op = (filter_opcode_t) b->data[pc];
+		char *data = &b->data[pc + sizeof(struct load_op)];
+
+		ax = top >= 0 ? &stack[top] : NULL;
+		switch (op) {
+		case FILTER_OP_RETURN:
+			if (!ax || ax->type != INTERP_S64) {
+				return -1;
+			}
+			*result = !!ax->v;
+			return 0;
+		case FILTER_OP_LOAD_S64:
+		case FILTER_OP_LOAD_DOUBLE:
+		case FILTER_OP_LOAD_STRING:
+			if (++top >= INTERP_STACK_LEN) {
+				return -1;
+			}
+			ax = &stack[top];
+			if (op == FILTER_OP_LOAD_S64) {
+				ax->type = INTERP_S64;
+				memcpy(&ax->v, data, sizeof(ax->v));
+				pc += sizeof(struct load_op)
+					+ sizeof(struct literal_numeric);
+			} else if (op == FILTER_OP_LOAD_DOUBLE) {
+				ax->type = INTERP_DOUBLE;
+				memcpy(&ax->d, data, sizeof(ax->d));
+				pc += sizeof(struct load_op)
+					+ sizeof(struct literal_double);
+			} else {
+				ax->type = INTERP_STRING;
+				ax->s = data;
+				pc += sizeof(struct load_op) + strlen(data) + 1;
+			}
+			break;
+		case FILTER_OP_EQ ... FILTER_OP_LE_S64_DOUBLE:
+		{
+			/* Every comparator family follows the EQ ... LE order. */
+			int base = (op - FILTER_OP_EQ) % 6;
+
+			if (top < 1 || interp_compare(&stack[top - 1], ax, &cmp)) {
+				return -1;
+			}
+			top--;
+			ax = &stack[top];
+			ax->type = INTERP_S64;
+			switch (base) {
+			case 0:
+				ax->v = cmp == 0;
+				break;
+			case 1:
+				ax->v = cmp != 0;
+				break;
+			case 2:
+				ax->v = cmp > 0;
+				break;
+			case 3:
+				ax->v = cmp < 0;
+				break;
+			case 4:
+				ax->v = cmp >= 0;
+				break;
+			default:
+				ax->v = cmp <= 0;
+				break;
+			}
+			pc += sizeof(struct binary_op);
+			break;
+		}
+		case FILTER_OP_UNARY_MINUS:
+		case FILTER_OP_UNARY_MINUS_S64:
+		case FILTER_OP_UNARY_MINUS_DOUBLE:
+			if (!ax || ax->type == INTERP_STRING) {
+				return -1;
+			}
+			if (ax->type == INTERP_DOUBLE) {
+				ax->d = -ax->d;
+			} else {
+				/* Wraps around, as on the tracer architectures. */
+				ax->v = (int64_t) -(uint64_t) ax->v;
+			}
+			pc += sizeof(struct unary_op);
+			break;
+		case FILTER_OP_UNARY_NOT:
+		case FILTER_OP_UNARY_NOT_S64:
+		case FILTER_OP_UNARY_NOT_DOUBLE:
+			if (!ax || ax->type == INTERP_STRING) {
+				return -1;
+			}
+			if (ax->type == INTERP_DOUBLE) {
+				ax->d = !ax->d;
+			} else {
+				ax->v = !ax->v;
+			}
+			pc += sizeof(struct unary_op);
+			break;
+		case FILTER_OP_CAST_DOUBLE_TO_S64:
+			if (!ax || ax->type != INTERP_DOUBLE) {
+				return -1;
+			}
+			ax->type = INTERP_S64;
+			ax->v = interp_double_to_s64(ax->d);
+			pc += sizeof(struct cast_op);
+			break;
+		case FILTER_OP_AND:
+		case FILTER_OP_OR:
+		{
+			struct logical_op insn;
+
+			if (!ax || ax->type != INTERP_S64) {
+				return -1;
+			}
+			memcpy(&insn, &b->data[pc], sizeof(insn));
+			if (op == FILTER_OP_AND && ax->v == 0) {
+				pc = insn.skip_offset;
+			} else if (op == FILTER_OP_OR && ax->v != 0) {
+				ax->v = 1;
+				pc = insn.skip_offset;
+			} else {
+				top--;
+				pc += sizeof(insn);
+			}
+			break;
+		}
+		case FILTER_OP_LOAD_FIELD_REF:
+		case FILTER_OP_GET_CONTEXT_REF:
+			return -1;
+		default:
+			diag("Unexpected bytecode op %u", (unsigned int) op);
+			return -1;
+		}
+	}
+	return -1;
+}
+
+/*
+ * Compile a filter expression to bytecode, optionally optimizing its IR,
+ * and evaluate it.
+ *
+ * Return 0 on success and set *result and *nr_ops, else -1.
+ */
+static int eval_filter(const char *expression, int optimize, int64_t *result,
+		int *nr_ops)
+{
+	int ret = -1;
+	FILE *fmem;
+	struct filter_parser_ctx *ctx;
+
+	fmem = fmemopen((void *) expression, strlen(expression), "r");
+	if (!fmem) {
+		goto end;
+	}
+	ctx = filter_parser_ctx_alloc(fmem);
+	if (!ctx) {
+		goto error_close;
+	}
+	if (filter_parser_ctx_append_ast(ctx) ||
+			filter_visitor_set_parent(ctx) ||
+			filter_visitor_ir_generate(ctx) ||
+			filter_visitor_ir_check_binary_op_nesting(ctx)) {
+		goto error_free;
+	}
+	if (optimize && filter_visitor_ir_optimize(ctx)) {
+		goto error_free;
+	}
+	if (filter_visitor_bytecode_generate(ctx)) {
+		goto error_free;
+	}
+	*nr_ops = filter_bytecode_count_ops(ctx);
+	ret = interpret(&ctx->bytecode->b, result);
+
+	filter_bytecode_free(ctx);
+error_free:
+	filter_ir_free(ctx);
+	filter_parser_ctx_free(ctx);
+error_close:
+	fclose(fmem);
+end:
+	return ret;
+}
+
+static void test_filter_optimize(void)
+{
+	int i, ret_plain, ret_opt, ops_plain, ops_opt;
+	int64_t res_plain = 0, res_opt = 0;
+	char name[200];
+
+	for (i = 0; i < num_tests; i++) {
+		ret_plain = eval_filter(tests_inputs[i], 0, &res_plain, &ops_plain);
+		ret_opt = eval_filter(tests_inputs[i], 1, &res_opt, &ops_opt);
+
+		snprintf(name, sizeof(name), "%s: %" PRId64 " (%d ops), optimized %" PRId64 " (%d ops)",
+				tests_inputs[i], res_plain, ops_plain, res_opt, ops_opt);
+		ok(ret_plain == 0 && ret_opt == 0 && res_plain == res_opt &&
+				ops_opt <= ops_plain, name);
+	}
+}
+
+static void test_filter_optimize_fail(void)
+{
+	int i, ret_plain, ret_opt, ops_plain, ops_opt;
+	int64_t res_plain = 0, res_opt = 0;
+	char name[200];
+
+	for (i = 0; i < num_fail_tests; i++) {
+		ret_plain = eval_filter(tests_fail_inputs[i], 0, &res_plain,
+				&ops_plain);
+		ret_opt = eval_filter(tests_fail_inputs[i], 1, &res_opt, &ops_opt);
+
+		snprintf(name, sizeof(name), "%s: %s, optimized %s",
+				tests_fail_inputs[i], ret_plain ? "fails" : "succeeds",
+				ret_opt ? "fails" : "succeeds");
+		ok(ret_plain == ret_opt && (ret_plain || res_plain == res_opt),
+				name);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	plan_tests(num_tests + num_fail_tests);
+
+	diag("Filter IR optimization tests");
+
+	test_filter_optimize();
+	test_filter_optimize_fail();
+
+	return exit_status();
+}
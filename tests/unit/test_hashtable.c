@@ -0,0 +1,220 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <urcu.h>
+
+#include <tap/tap.h>
+
+#include <src/common/hashtable/hashtable.h>
+#include <src/common/hashtable/utils.h>
+
+/* For lttngerr.h */
+int lttng_opt_quiet = 1;
+int lttng_opt_verbose = 3;
+
+#define NUM_NODES	4096
+#define NUM_TESTS	20
+
+static struct lttng_ht_node_u64 nodes[NUM_NODES];
+
+/*
+ * Add every node to the table, look them up, delete them and return the
+ * number of checks that failed.
+ */
+static int run_table(struct lttng_ht *ht)
+{
+	int ret, errors = 0;
+	uint64_t i, key;
+	struct lttng_ht_iter iter;
+
+	rcu_read_lock();
+	for (i = 0; i < NUM_NODES; i++) {
+		lttng_ht_node_init_u64(&nodes[i], i);
+		lttng_ht_add_unique_u64(ht, &nodes[i]);
+	}
+	if (lttng_ht_get_count(ht) != NUM_NODES) {
+		errors++;
+	}
+
+	for (i = 0; i < NUM_NODES; i++) {
+		lttng_ht_lookup(ht, &i, &iter);
+		if (lttng_ht_iter_get_node_u64(&iter) != &nodes[i]) {
+			errors++;
+		}
+	}
+	key = NUM_NODES;
+	lttng_ht_lookup(ht, &key, &iter);
+	if (lttng_ht_iter_get_node_u64(&iter)) {
+		errors++;
+	}
+
+	for (i = 0; i < NUM_NODES; i++) {
+		lttng_ht_lookup(ht, &i, &iter);
+		ret = lttng_ht_del(ht, &iter);
+		if (ret) {
+			errors++;
+		}
+	}
+	if (lttng_ht_get_count(ht) != 0) {
+		errors++;
+	}
+	rcu_read_unlock();
+
+	/* The nodes are static, wait for the readers before reusing them. */
+	synchronize_rcu();
+
+	return errors;
+}
+
+static void test_ht_new_attr_mm(void)
+{
+	unsigned int i;
+	struct lttng_ht *ht;
+	struct lttng_ht_attr attr;
+	static const struct {
+		enum lttng_ht_mm mm;
+		const char *name;
+	} mms[] = {
+		{ LTTNG_HT_MM_DEFAULT, "default" },
+		{ LTTNG_HT_MM_ORDER, "order" },
+		{ LTTNG_HT_MM_CHUNK, "chunk" },
+		{ LTTNG_HT_MM_MMAP, "mmap" },
+	};
+
+	for (i = 0; i < sizeof(mms) / sizeof(mms[0]); i++) {
+		memset(&attr, 0, sizeof(attr));
+		attr.mm = mms[i].mm;
+
+		ht = lttng_ht_new_attr(&attr, LTTNG_HT_TYPE_U64);
+		ok(ht != NULL, "Create hashtable with the %s allocator", mms[i].name);
+		if (!ht) {
+			skip(2, "Hashtable creation failed");
+			continue;
+		}
+		ok(run_table(ht) == 0, "Add, lookup and delete with the %s allocator",
+				mms[i].name);
+		lttng_ht_destroy(ht);
+		pass("Destroy hashtable with the %s allocator", mms[i].name);
+	}
+}
+
+static void test_ht_new_attr_size(void)
+{
+	struct lttng_ht *ht;
+	struct lttng_ht_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size_hint = 1000;
+	attr.no_auto_resize = 1;
+	ht = lttng_ht_new_attr(&attr, LTTNG_HT_TYPE_U64);
+	ok(ht != NULL && ht->ht->size == 1024,
+			"Size hint is rounded up to a power of two");
+	if (ht) {
+		ok(run_table(ht) == 0 && ht->ht->size == 1024,
+				"Table without automatic resize keeps its size");
+		lttng_ht_destroy(ht);
+	} else {
+		skip(1, "Hashtable creation failed");
+	}
+
+	memset(&attr, 0, sizeof(attr));
+	attr.mm = LTTNG_HT_MM_MMAP;
+	attr.size_hint = 64;
+	attr.max_buckets = 16;
+	ht = lttng_ht_new_attr(&attr, LTTNG_HT_TYPE_U64);
+	ok(ht != NULL && ht->ht->size == 16,
+			"Initial size is capped by the maximum number of buckets");
+	if (ht) {
+		lttng_ht_destroy(ht);
+	}
+
+	memset(&attr, 0, sizeof(attr));
+	attr.mm = 42;
+	ht = lttng_ht_new_attr(&attr, LTTNG_HT_TYPE_U64);
+	ok(ht == NULL, "Reject unknown allocator");
+
+	ht = lttng_ht_new(3, LTTNG_HT_TYPE_U64);
+	ok(ht != NULL && ht->ht->size == 4,
+			"Legacy size is rounded up to a power of two");
+	if (ht) {
+		lttng_ht_destroy(ht);
+	}
+}
+
+/*
+ * Return the longest chain of NUM_NODES buckets holding NUM_NODES keys.
+ */
+static unsigned int longest_chain(int string)
+{
+	unsigned int i, max = 0;
+	unsigned long bucket;
+	static unsigned int chains[NUM_NODES];
+	char name[64];
+	uint64_t key;
+
+	memset(chains, 0, sizeof(chains));
+	for (i = 0; i < NUM_NODES; i++) {
+		if (string) {
+			snprintf(name, sizeof(name), "ust_tests_hello:tptest%u", i);
+			bucket = hash_key_str(name, 0x42);
+		} else {
+			key = i;
+			bucket = hash_key_u64(&key, 0x42);
+		}
+		bucket &= NUM_NODES - 1;
+		if (++chains[bucket] > max) {
+			max = chains[bucket];
+		}
+	}
+
+	return max;
+}
+
+static void test_hash_key(void)
+{
+	char name1[] = "sched_switch", name2[] = "sched_switch";
+	char buf[64];
+
+	memset(buf, 'a', sizeof(buf));
+	ok(hash_key_str(name1, 1) == hash_key_str(name2, 1) &&
+			hash_key_str(name1, 1) != hash_key_str(name1, 2) &&
+			hash_key_buf(buf, sizeof(buf), 1) !=
+				hash_key_buf(buf, sizeof(buf) - 1, 1),
+			"Hash depends on the key content, length and seed");
+	/* Far below the 4096 keys of a degenerate hash. */
+	ok(longest_chain(0) <= 16, "Sequential u64 keys spread over the buckets");
+	ok(longest_chain(1) <= 16, "Event names spread over the buckets");
+}
+
+int main(int argc, char **argv)
+{
+	plan_tests(NUM_TESTS);
+
+	diag("Hashtable tests");
+
+	rcu_register_thread();
+
+	test_ht_new_attr_mm();
+	test_ht_new_attr_size();
+	test_hash_key();
+
+	rcu_unregister_thread();
+
+	return exit_status();
+}
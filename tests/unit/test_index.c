@@ -0,0 +1,130 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include <byteswap.h>
+#include <endian.h>
+#include <string.h>
+
+#include <tap/tap.h>
+
+#include <src/common/index/index.h>
+
+/* For lttngerr.h */
+int lttng_opt_quiet = 1;
+int lttng_opt_verbose = 3;
+
+#define NUM_TESTS 10
+
+/*
+ * Fill buf with an LTTng packet header and context in the native byte order,
+ * or in the reverse one if swap is set.
+ */
+static void make_header(char *buf, unsigned int long_size, int swap)
+{
+	uint32_t magic = 0xC1FC1FC1, stream_id = 3;
+	uint64_t ts_begin = 1000, ts_end = 2000;
+	uint64_t content_size = 8000, packet_size = 32768;
+	uint32_t discarded32 = 42;
+	uint64_t discarded64 = 42;
+
+	if (swap) {
+		magic = bswap_32(magic);
+		stream_id = bswap_32(stream_id);
+		ts_begin = bswap_64(ts_begin);
+		ts_end = bswap_64(ts_end);
+		content_size = bswap_64(content_size);
+		packet_size = bswap_64(packet_size);
+		discarded32 = bswap_32(discarded32);
+		discarded64 = bswap_64(discarded64);
+	}
+
+	memset(buf, 0, CTF_PACKET_HEADER_MAX_LEN);
+	memcpy(buf, &magic, sizeof(magic));
+	memcpy(buf + 20, &stream_id, sizeof(stream_id));
+	memcpy(buf + 24, &ts_begin, sizeof(ts_begin));
+	memcpy(buf + 32, &ts_end, sizeof(ts_end));
+	memcpy(buf + 40, &content_size, sizeof(content_size));
+	memcpy(buf + 48, &packet_size, sizeof(packet_size));
+	if (long_size == 8) {
+		memcpy(buf + 56, &discarded64, sizeof(discarded64));
+	} else {
+		memcpy(buf + 56, &discarded32, sizeof(discarded32));
+	}
+}
+
+/*
+ * Return 1 if the index entry matches the header made by make_header.
+ */
+static int check_index(struct ctf_packet_index *index, uint64_t offset)
+{
+	return be64toh(index->offset) == offset &&
+		be64toh(index->packet_size) == 32768 &&
+		be64toh(index->content_size) == 8000 &&
+		be64toh(index->timestamp_begin) == 1000 &&
+		be64toh(index->timestamp_end) == 2000 &&
+		be64toh(index->events_discarded) == 42 &&
+		be64toh(index->stream_id) == 3;
+}
+
+static void test_index_packet_parse(void)
+{
+	int ret;
+	char buf[CTF_PACKET_HEADER_MAX_LEN];
+	struct ctf_packet_index index;
+
+	make_header(buf, 8, 0);
+	ret = index_packet_parse(buf, sizeof(buf), 8, 4096, &index);
+	ok(ret == 0, "Parse native packet header");
+	ok(check_index(&index, 4096), "Native index entry is valid");
+
+	make_header(buf, 8, 1);
+	ret = index_packet_parse(buf, sizeof(buf), 8, 0, &index);
+	ok(ret == 0, "Parse byte swapped packet header");
+	ok(check_index(&index, 0), "Byte swapped index entry is valid");
+
+	make_header(buf, 4, 0);
+	ret = index_packet_parse(buf, CTF_PACKET_HEADER_LEN(4), 4, 8192, &index);
+	ok(ret == 0, "Parse 32-bit packet header");
+	ok(check_index(&index, 8192), "32-bit index entry is valid");
+
+	make_header(buf, 4, 1);
+	ret = index_packet_parse(buf, CTF_PACKET_HEADER_LEN(4), 4, 0, &index);
+	ok(ret == 0 && check_index(&index, 0),
+			"Parse byte swapped 32-bit packet header");
+
+	make_header(buf, 8, 0);
+	ret = index_packet_parse(buf, CTF_PACKET_HEADER_LEN(8) - 1, 8, 0, &index);
+	ok(ret < 0, "Reject truncated packet header");
+
+	buf[0] = 0;
+	ret = index_packet_parse(buf, sizeof(buf), 8, 0, &index);
+	ok(ret < 0, "Reject invalid magic number");
+
+	memset(buf, 0, sizeof(buf));
+	ret = index_packet_parse(buf, sizeof(buf), 4, 0, &index);
+	ok(ret < 0, "Reject zeroed packet header");
+}
+
+int main(int argc, char **argv)
+{
+	plan_tests(NUM_TESTS);
+
+	diag("Packet index tests");
+
+	test_index_packet_parse();
+
+	return exit_status();
+}
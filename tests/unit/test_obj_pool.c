@@ -0,0 +1,168 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <urcu.h>
+
+#include <tap/tap.h>
+
+#include <common/obj-pool.h>
+#include <common/str-intern.h>
+
+/* For lttngerr.h */
+int lttng_opt_quiet = 1;
+int lttng_opt_verbose = 3;
+
+#define OBJ_SIZE	100
+#define NR_STRINGS	1000
+
+static unsigned int nr_released;
+
+/*
+ * Count the objects released by the pool.
+ */
+static void release_obj(void *obj)
+{
+	nr_released++;
+}
+
+/*
+ * Return 1 if the object is all zero.
+ */
+static int is_zeroed(const char *obj)
+{
+	int i;
+
+	for (i = 0; i < OBJ_SIZE; i++) {
+		if (obj[i]) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static void test_obj_pool(void)
+{
+	int i;
+	char *obj, *objs[4];
+	struct lttng_obj_pool pool;
+	struct lttng_obj_pool_stats stats;
+
+	lttng_obj_pool_init(&pool, "test", OBJ_SIZE, 2, release_obj);
+
+	obj = lttng_obj_pool_zalloc(&pool);
+	ok(obj && is_zeroed(obj), "Allocate a zeroed object");
+	memset(obj, 0xff, OBJ_SIZE);
+	lttng_obj_pool_free(&pool, obj);
+	lttng_obj_pool_get_stats(&pool, &stats);
+	ok(nr_released == 1 && stats.nr_free == 1 && stats.nr_used == 0,
+			"Freed object released and kept");
+
+	objs[0] = lttng_obj_pool_zalloc(&pool);
+	lttng_obj_pool_get_stats(&pool, &stats);
+	ok(objs[0] == obj && is_zeroed(objs[0]) && stats.reuses == 1,
+			"Freed object reused zeroed");
+
+	for (i = 1; i < 4; i++) {
+		objs[i] = lttng_obj_pool_zalloc(&pool);
+	}
+	lttng_obj_pool_get_stats(&pool, &stats);
+	ok(stats.nr_used == 4 && stats.max_used == 4, "Objects in use counted");
+	for (i = 0; i < 4; i++) {
+		lttng_obj_pool_free(&pool, objs[i]);
+	}
+	lttng_obj_pool_get_stats(&pool, &stats);
+	ok(stats.nr_free == 2 && stats.nr_used == 0,
+			"Free objects kept up to the maximum");
+
+	nr_released = 0;
+	for (i = 0; i < 4; i++) {
+		objs[i] = lttng_obj_pool_zalloc(&pool);
+	}
+	for (i = 0; i < 4; i++) {
+		lttng_obj_pool_free_rcu(&pool, objs[i]);
+	}
+	do {
+		/* Grace periods started from the callbacks need another barrier. */
+		rcu_barrier();
+		lttng_obj_pool_get_stats(&pool, &stats);
+	} while (stats.nr_retired);
+	ok(nr_released == 4 && stats.nr_free == 2 && stats.nr_used == 0,
+			"Objects freed under RCU recycled after a grace period");
+
+	lttng_obj_pool_destroy(&pool);
+	lttng_obj_pool_get_stats(&pool, &stats);
+	ok(stats.nr_free == 0, "Destroy frees the free objects");
+}
+
+static void test_str_intern(void)
+{
+	int i, same = 1;
+	char buf[32];
+	const char *a, *b, *c, *d, *strs[NR_STRINGS];
+	struct lttng_intern_stats stats;
+
+	a = lttng_intern_get("ust/uid/1000/64-bit/");
+	snprintf(buf, sizeof(buf), "ust/uid/1000/64-bit/");
+	b = lttng_intern_get(buf);
+	c = lttng_intern_get("ust/uid/0/64-bit/");
+	ok(a && a == b && a != buf && !strcmp(a, buf),
+			"Equal strings share a single copy");
+	ok(c && c != a && !strcmp(c, "ust/uid/0/64-bit/"),
+			"Distinct strings have their own copy");
+	lttng_intern_get_stats(&stats);
+	ok(stats.nr_strings == 2 && stats.nr_refs == 3, "Strings and references counted");
+
+	for (i = 0; i < NR_STRINGS; i++) {
+		snprintf(buf, sizeof(buf), "ust/pid/app-%d/", i);
+		strs[i] = lttng_intern_get(buf);
+	}
+	for (i = 0; i < NR_STRINGS; i++) {
+		snprintf(buf, sizeof(buf), "ust/pid/app-%d/", i);
+		d = lttng_intern_get(buf);
+		same &= d == strs[i] && !strcmp(d, buf);
+		lttng_intern_put(d);
+		lttng_intern_put(strs[i]);
+	}
+	ok(same, "Strings found again once the table grew");
+
+	lttng_intern_put(a);
+	lttng_intern_put(b);
+	lttng_intern_put(c);
+	lttng_intern_put(NULL);
+	lttng_intern_get_stats(&stats);
+	ok(stats.nr_strings == 0 && stats.nr_refs == 0 && stats.bytes == 0,
+			"Strings freed with their last reference");
+}
+
+int main(int argc, char **argv)
+{
+	plan_tests(12);
+
+	diag("Object pool and interned string tests");
+
+	rcu_register_thread();
+	test_obj_pool();
+	test_str_intern();
+	rcu_unregister_thread();
+
+	return exit_status();
+}
@@ -0,0 +1,263 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <tap/tap.h>
+
+#include <common/common.h>
+#include <common/compat/endian.h>
+#include <common/compress/compress.h>
+#include <common/relayd/relayd.h>
+#include <common/sessiond-comm/sessiond-comm.h>
+#include <bin/lttng-relayd/lttng-relayd.h>
+#include <bin/lttng-relayd/cmd-generic.h>
+#include <bin/lttng-relayd/cmd-2-2.h>
+#include <bin/lttng-relayd/cmd-2-3.h>
+
+/* For lttngerr.h */
+int lttng_opt_quiet = 1;
+int lttng_opt_verbose = 3;
+
+/* Output directory of the relayd, only used to build the stream paths. */
+char *opt_output_path = "/tmp/lttng-relayd-test";
+
+#define TRACEFILE_SIZE	4096
+#define TRACEFILE_COUNT	3
+
+/*
+ * Relayd end of an add stream command.
+ */
+struct relayd_side {
+	struct lttcomm_sock *sock;
+	/* Protocol minor version negotiated with the session daemon. */
+	unsigned int minor;
+	struct lttcomm_relayd_hdr hdr;
+	struct relay_stream stream;
+	int ret;
+};
+
+static unsigned int compression_tests[] = {
+	LTTNG_COMPRESSION_NONE,
+	LTTNG_COMPRESSION_LZ4,
+	LTTNG_COMPRESSION_ZSTD,
+	/* Unknown algorithm of a newer session daemon. */
+	42,
+};
+static const int num_compression_tests =
+	sizeof(compression_tests) / sizeof(compression_tests[0]);
+
+/* Tests per compression algorithm. */
+#define TESTS_PER_ALGO	4
+
+/*
+ * Receive an add stream command like the relayd and reply to it.
+ */
+static void *relayd_thread(void *data)
+{
+	struct relayd_side *side = data;
+	struct relay_command cmd;
+	struct lttcomm_relayd_status_stream reply;
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.sock = side->sock;
+	cmd.major = 2;
+	cmd.minor = side->minor;
+
+	side->ret = cmd_recv(side->sock, &side->hdr, sizeof(side->hdr));
+	if (side->ret < 0) {
+		goto end;
+	}
+	/* Dispatched on the minor version like relay_add_stream(). */
+	if (side->minor == 2) {
+		side->ret = cmd_recv_stream_2_2(&cmd, &side->stream);
+	} else {
+		side->ret = cmd_recv_stream_2_3(&cmd, &side->stream);
+	}
+
+	memset(&reply, 0, sizeof(reply));
+	reply.handle = htobe64(1);
+	reply.ret_code = htobe32(side->ret < 0 ? LTTNG_ERR_UNK : LTTNG_OK);
+	side->sock->ops->sendmsg(side->sock, &reply, sizeof(reply), 0);
+
+end:
+	return NULL;
+}
+
+/*
+ * Create a TCP socket listening on an ephemeral loopback port.
+ */
+static struct lttcomm_sock *create_listen_sock(unsigned int *port)
+{
+	int ret;
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof(addr);
+	struct lttcomm_sock *sock;
+
+	sock = lttcomm_alloc_sock(LTTCOMM_SOCK_TCP);
+	if (!sock) {
+		return NULL;
+	}
+	ret = lttcomm_init_inet_sockaddr(&sock->sockaddr, "127.0.0.1", 1);
+	if (ret < 0) {
+		goto error;
+	}
+	/* Port 0 is refused by the init, let bind() pick a free one. */
+	sock->sockaddr.addr.sin.sin_port = 0;
+	ret = lttcomm_create_sock(sock);
+	if (ret < 0) {
+		goto error;
+	}
+	ret = sock->ops->bind(sock);
+	if (ret < 0) {
+		goto error;
+	}
+	ret = sock->ops->listen(sock, -1);
+	if (ret < 0) {
+		goto error;
+	}
+	ret = getsockname(sock->fd, (struct sockaddr *) &addr, &addr_len);
+	if (ret < 0) {
+		goto error;
+	}
+	*port = ntohs(addr.sin_port);
+	return sock;
+
+error:
+	if (sock->fd >= 0) {
+		(void) sock->ops->close(sock);
+	}
+	lttcomm_destroy_sock(sock);
+	return NULL;
+}
+
+/*
+ * Add a stream compressed with algo from a session daemon socket to the
+ * relayd end, with the given protocol minor version, and check what the
+ * relayd stream got. Only the 2.3 protocol carries the compression.
+ */
+static void test_add_stream(struct lttcomm_sock *listen_sock,
+		unsigned int port, unsigned int minor, unsigned int algo)
+{
+	int ret;
+	uint64_t handle = 0;
+	pthread_t thread;
+	unsigned int expected;
+	size_t payload_size;
+	struct relayd_side side;
+	struct lttcomm_relayd_sock rsock;
+
+	memset(&side, 0, sizeof(side));
+	side.minor = minor;
+	memset(&rsock, 0, sizeof(rsock));
+	rsock.major = 2;
+	rsock.minor = minor;
+	rsock.sock.fd = -1;
+	rsock.sock.proto = LTTCOMM_SOCK_TCP;
+
+	if (lttcomm_init_inet_sockaddr(&rsock.sock.sockaddr, "127.0.0.1",
+				port) < 0 ||
+			lttcomm_create_sock(&rsock.sock) < 0 ||
+			rsock.sock.ops->connect(&rsock.sock) < 0) {
+		fail("Connect to the relayd end");
+		skip(TESTS_PER_ALGO - 1, "No connection");
+		goto end;
+	}
+	side.sock = listen_sock->ops->accept(listen_sock);
+	if (!side.sock) {
+		fail("Accept the session daemon connection");
+		skip(TESTS_PER_ALGO - 1, "No connection");
+		goto end;
+	}
+	ret = pthread_create(&thread, NULL, relayd_thread, &side);
+	if (ret) {
+		fail("Start the relayd end");
+		skip(TESTS_PER_ALGO - 1, "No relayd end");
+		goto end;
+	}
+
+	ret = relayd_add_stream(&rsock, "chan_0", "session/ust", &handle,
+			TRACEFILE_SIZE, TRACEFILE_COUNT, algo);
+	pthread_join(thread, NULL);
+
+	ok(ret == 0 && side.ret == 0 && handle == 1,
+			"Add stream compressed with %s (%u) with protocol 2.%u",
+			lttng_compress_name(algo), algo, minor);
+	payload_size = minor == 2 ?
+		sizeof(struct lttcomm_relayd_add_stream_2_2) :
+		sizeof(struct lttcomm_relayd_add_stream_2_3);
+	ok(be32toh(side.hdr.cmd) == RELAYD_ADD_STREAM &&
+			be64toh(side.hdr.data_size) == payload_size,
+			"Command and payload size of the 2.%u protocol", minor);
+	ok(side.stream.tracefile_size == TRACEFILE_SIZE &&
+			side.stream.tracefile_count == TRACEFILE_COUNT,
+			"Tracefile size and count received");
+	if (minor == 2 || !lttng_compress_supported(algo)) {
+		expected = LTTNG_COMPRESSION_NONE;
+	} else {
+		expected = algo;
+	}
+	ok(side.stream.compression == expected,
+			"Compression received as %u, expected %u",
+			(unsigned int) side.stream.compression, expected);
+
+end:
+	free(side.stream.path_name);
+	free(side.stream.channel_name);
+	if (side.sock) {
+		(void) side.sock->ops->close(side.sock);
+		lttcomm_destroy_sock(side.sock);
+	}
+	if (rsock.sock.fd >= 0) {
+		(void) rsock.sock.ops->close(&rsock.sock);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	int i;
+	unsigned int port;
+	struct lttcomm_sock *listen_sock;
+
+	plan_tests((num_compression_tests + 1) * TESTS_PER_ALGO);
+
+	diag("Relayd add stream unit test");
+
+	listen_sock = create_listen_sock(&port);
+	if (!listen_sock) {
+		skip((num_compression_tests + 1) * TESTS_PER_ALGO,
+				"Listening on the loopback failed");
+		goto end;
+	}
+
+	for (i = 0; i < num_compression_tests; i++) {
+		test_add_stream(listen_sock, port, RELAYD_VERSION_COMM_MINOR,
+				compression_tests[i]);
+	}
+	/* A 2.2 session daemon can't ask for the compression. */
+	test_add_stream(listen_sock, port, 2, LTTNG_COMPRESSION_LZ4);
+
+	(void) listen_sock->ops->close(listen_sock);
+	lttcomm_destroy_sock(listen_sock);
+
+end:
+	return exit_status();
+}
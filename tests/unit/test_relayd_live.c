@@ -0,0 +1,419 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <tap/tap.h>
+
+#include <common/common.h>
+#include <common/compat/endian.h>
+#include <common/compress/compress.h>
+#include <common/defaults.h>
+#include <common/fd-cache.h>
+#include <common/index/index.h>
+#include <common/sessiond-comm/sessiond-comm.h>
+#include <common/uri.h>
+#include <common/utils.h>
+#include <bin/lttng-relayd/lttng-relayd.h>
+#include <bin/lttng-relayd/lttng-viewer.h>
+#include <bin/lttng-relayd/live.h>
+
+/* For lttngerr.h */
+int lttng_opt_quiet = 1;
+int lttng_opt_verbose = 3;
+
+/* Globals of the relayd used by the live thread. */
+char *opt_output_path;
+struct lttng_ht *relay_sessions_ht;
+struct lttng_ht *relay_streams_ht;
+struct lttng_fd_cache stream_fd_cache;
+
+#define SESSION_ID	1
+#define STREAM_HANDLE	7
+#define CHANNEL_NAME	"chan_0"
+#define PACKET_SIZE	4096
+/* Ports tried for the viewer socket, from the default one. */
+#define PORT_TRIES	32
+
+#define NUM_TESTS	19
+
+static char trace_dir[] = "/tmp/test-relayd-live-XXXXXX";
+static struct relay_session session;
+static struct relay_stream stream;
+static char packet[PACKET_SIZE];
+static int quit_pipe[2] = { -1, -1 };
+
+/*
+ * Append an index entry of a packet of PACKET_SIZE bytes at offset.
+ */
+static int write_index_entry(int index_fd, uint64_t offset)
+{
+	struct ctf_packet_index entry;
+
+	memset(&entry, 0, sizeof(entry));
+	entry.offset = htobe64(offset);
+	entry.packet_size = htobe64(PACKET_SIZE * 8);
+	entry.content_size = htobe64(PACKET_SIZE * 8);
+	entry.stream_id = htobe64(STREAM_HANDLE);
+
+	return index_write(index_fd, &entry);
+}
+
+/*
+ * Write the tracefile of the stream: a raw packet at offset 0 then, at offset
+ * PACKET_SIZE, a frame header announcing far more data than the index allows.
+ * Only the first packet is indexed, the second one is indexed by the caller.
+ *
+ * Return the index file descriptor or a negative value.
+ */
+static int create_trace(void)
+{
+	int fd, index_fd;
+	struct lttng_compress_frame_hdr hdr;
+
+	fd = utils_create_stream_file(-1, trace_dir, CHANNEL_NAME, 0, 0, -1, -1);
+	if (fd < 0) {
+		return -1;
+	}
+	memset(packet, 'a', sizeof(packet));
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = htobe32(LTTNG_COMPRESS_FRAME_MAGIC);
+	hdr.algo = LTTNG_COMPRESSION_LZ4;
+	hdr.compressed_size = htobe32(UINT32_MAX - sizeof(hdr));
+	hdr.uncompressed_size = htobe32(PACKET_SIZE);
+	if (write(fd, packet, sizeof(packet)) != sizeof(packet) ||
+			write(fd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+		close(fd);
+		return -1;
+	}
+	close(fd);
+
+	index_fd = index_create_file(-1, trace_dir, CHANNEL_NAME, 0, 0, -1, -1);
+	if (index_fd < 0) {
+		return -1;
+	}
+	if (write_index_entry(index_fd, 0) < 0) {
+		close(index_fd);
+		return -1;
+	}
+
+	return index_fd;
+}
+
+/*
+ * Add the session and its stream to the relayd hash tables.
+ */
+static void add_session_stream(void)
+{
+	session.id = SESSION_ID;
+	stream.stream_handle = STREAM_HANDLE;
+	stream.session = &session;
+	stream.path_name = trace_dir;
+	stream.channel_name = CHANNEL_NAME;
+
+	rcu_read_lock();
+	lttng_ht_node_init_ulong(&session.session_n, session.id);
+	lttng_ht_add_unique_ulong(relay_sessions_ht, &session.session_n);
+	lttng_ht_node_init_ulong(&stream.stream_n, stream.stream_handle);
+	lttng_ht_add_unique_ulong(relay_streams_ht, &stream.stream_n);
+	rcu_read_unlock();
+}
+
+/*
+ * Start the live thread on the first free loopback port.
+ *
+ * Return the port or 0 on error.
+ */
+static unsigned int start_live(void)
+{
+	unsigned int i;
+	struct lttng_uri uri;
+
+	memset(&uri, 0, sizeof(uri));
+	uri.dtype = LTTNG_DST_IPV4;
+	uri.proto = LTTNG_TCP;
+	strcpy(uri.dst.ipv4, "127.0.0.1");
+
+	for (i = 0; i < PORT_TRIES; i++) {
+		uri.port = DEFAULT_NETWORK_VIEWER_PORT + i;
+		if (live_start_threads(&uri, quit_pipe[0]) == 0) {
+			return uri.port;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Connect a viewer to the live port.
+ */
+static struct lttcomm_sock *connect_viewer(unsigned int port)
+{
+	int ret;
+	struct lttcomm_sock *sock;
+
+	sock = lttcomm_alloc_sock(LTTCOMM_SOCK_TCP);
+	if (!sock) {
+		return NULL;
+	}
+	ret = lttcomm_init_inet_sockaddr(&sock->sockaddr, "127.0.0.1", port);
+	if (ret < 0) {
+		goto error;
+	}
+	ret = lttcomm_create_sock(sock);
+	if (ret < 0) {
+		goto error;
+	}
+	ret = sock->ops->connect(sock);
+	if (ret < 0) {
+		goto error;
+	}
+	return sock;
+
+error:
+	if (sock->fd >= 0) {
+		(void) sock->ops->close(sock);
+	}
+	lttcomm_destroy_sock(sock);
+	return NULL;
+}
+
+/*
+ * Send a viewer command with its payload and receive reply_len bytes back.
+ *
+ * Return 0 on success or else a negative value.
+ */
+static int viewer_cmd(struct lttcomm_sock *sock, uint32_t cmd,
+		void *payload, size_t payload_len, void *reply, size_t reply_len)
+{
+	ssize_t ret;
+	struct lttng_viewer_cmd hdr;
+
+	hdr.data_size = htobe64(payload_len);
+	hdr.cmd = htobe32(cmd);
+	ret = sock->ops->sendmsg(sock, &hdr, sizeof(hdr), 0);
+	if (ret < (ssize_t) sizeof(hdr)) {
+		return -1;
+	}
+	if (payload_len > 0) {
+		ret = sock->ops->sendmsg(sock, payload, payload_len, 0);
+		if (ret < (ssize_t) payload_len) {
+			return -1;
+		}
+	}
+	ret = sock->ops->recvmsg(sock, reply, reply_len, 0);
+	if (ret < (ssize_t) reply_len) {
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Request the next index of the stream.
+ *
+ * Return its status or a negative value, the offset being set if it is OK.
+ */
+static int get_next_index(struct lttcomm_sock *sock, uint64_t *offset)
+{
+	struct lttng_viewer_get_next_index request;
+	struct lttng_viewer_index reply;
+
+	request.stream_id = htobe64(STREAM_HANDLE);
+	if (viewer_cmd(sock, VIEWER_GET_NEXT_INDEX, &request, sizeof(request),
+				&reply, sizeof(reply)) < 0) {
+		return -1;
+	}
+	*offset = be64toh(reply.offset);
+
+	return be32toh(reply.status);
+}
+
+/*
+ * Request the packet at offset, its data being received in buf if it is OK.
+ *
+ * Return its status or a negative value.
+ */
+static int get_packet(struct lttcomm_sock *sock, uint64_t offset, char *buf)
+{
+	ssize_t ret;
+	struct lttng_viewer_get_packet request;
+	struct lttng_viewer_trace_packet reply;
+
+	request.stream_id = htobe64(STREAM_HANDLE);
+	request.offset = htobe64(offset);
+	request.len = htobe32(PACKET_SIZE);
+	if (viewer_cmd(sock, VIEWER_GET_PACKET, &request, sizeof(request),
+				&reply, sizeof(reply)) < 0) {
+		return -1;
+	}
+	if (be32toh(reply.status) == VIEWER_GET_PACKET_OK) {
+		if (be32toh(reply.len) != PACKET_SIZE) {
+			return -1;
+		}
+		ret = sock->ops->recvmsg(sock, buf, PACKET_SIZE, 0);
+		if (ret < PACKET_SIZE) {
+			return -1;
+		}
+	}
+
+	return be32toh(reply.status);
+}
+
+static void test_viewer_session(struct lttcomm_sock *sock)
+{
+	int ret;
+	struct lttng_viewer_connect connect;
+	struct lttng_viewer_list_sessions list;
+	struct lttng_viewer_session list_session;
+	struct lttng_viewer_attach_session_request attach;
+	struct lttng_viewer_attach_session_response attach_reply;
+	struct lttng_viewer_stream attach_stream;
+
+	connect.major = htobe32(LTTNG_VIEWER_VERSION_MAJOR);
+	connect.minor = htobe32(LTTNG_VIEWER_VERSION_MINOR);
+	ret = viewer_cmd(sock, VIEWER_CONNECT, &connect, sizeof(connect),
+			&connect, sizeof(connect));
+	ok(ret == 0 && be32toh(connect.major) == LTTNG_VIEWER_VERSION_MAJOR,
+			"Connect with the protocol version");
+
+	ret = viewer_cmd(sock, VIEWER_LIST_SESSIONS, NULL, 0, &list, sizeof(list));
+	ok(ret == 0 && be32toh(list.sessions_count) == 1,
+			"List sessions returns the session");
+	ret = sock->ops->recvmsg(sock, &list_session, sizeof(list_session), 0);
+	ok(ret == sizeof(list_session) &&
+			be64toh(list_session.id) == SESSION_ID &&
+			be32toh(list_session.streams) == 1,
+			"Listed session has its stream");
+
+	attach.session_id = htobe64(SESSION_ID + 1);
+	ret = viewer_cmd(sock, VIEWER_ATTACH_SESSION, &attach, sizeof(attach),
+			&attach_reply, sizeof(attach_reply));
+	ok(ret == 0 && be32toh(attach_reply.status) == VIEWER_ATTACH_UNK,
+			"Attach to an unknown session");
+
+	attach.session_id = htobe64(SESSION_ID);
+	ret = viewer_cmd(sock, VIEWER_ATTACH_SESSION, &attach, sizeof(attach),
+			&attach_reply, sizeof(attach_reply));
+	ok(ret == 0 && be32toh(attach_reply.status) == VIEWER_ATTACH_OK &&
+			be32toh(attach_reply.streams_count) == 1,
+			"Attach to the session");
+	ret = sock->ops->recvmsg(sock, &attach_stream, sizeof(attach_stream), 0);
+	ok(ret == sizeof(attach_stream) &&
+			be64toh(attach_stream.id) == STREAM_HANDLE &&
+			be32toh(attach_stream.metadata_flag) == 0 &&
+			!strcmp(attach_stream.channel_name, CHANNEL_NAME),
+			"Attached stream sent");
+}
+
+static void test_viewer_packets(struct lttcomm_sock *sock, int index_fd)
+{
+	int ret;
+	uint64_t offset;
+	char buf[PACKET_SIZE];
+
+	ret = get_packet(sock, 0, buf);
+	ok(ret == VIEWER_GET_PACKET_ERR, "Packet before its index refused");
+
+	ret = get_next_index(sock, &offset);
+	ok(ret == VIEWER_INDEX_OK && offset == 0, "First index entry");
+
+	ret = get_packet(sock, 0, buf);
+	ok(ret == VIEWER_GET_PACKET_OK && !memcmp(buf, packet, PACKET_SIZE),
+			"Raw packet read");
+
+	ret = get_packet(sock, PACKET_SIZE, buf);
+	ok(ret == VIEWER_GET_PACKET_ERR, "Packet past the index refused");
+
+	ret = get_next_index(sock, &offset);
+	ok(ret == VIEWER_INDEX_RETRY, "No new index entry yet");
+
+	ok(write_index_entry(index_fd, PACKET_SIZE) == 0,
+			"Index entry of the frame written");
+	ret = get_next_index(sock, &offset);
+	ok(ret == VIEWER_INDEX_OK && offset == PACKET_SIZE,
+			"Second index entry");
+
+	ret = get_packet(sock, PACKET_SIZE, buf);
+	ok(ret == VIEWER_GET_PACKET_ERR,
+			"Frame larger than its index extent refused");
+
+	ret = get_packet(sock, 0, buf);
+	ok(ret == VIEWER_GET_PACKET_OK && !memcmp(buf, packet, PACKET_SIZE),
+			"Connection still served after a refused frame");
+}
+
+int main(int argc, char **argv)
+{
+	int index_fd;
+	unsigned int port;
+	char path[PATH_MAX];
+	struct lttcomm_sock *sock;
+
+	plan_tests(NUM_TESTS);
+
+	diag("Relayd live viewer protocol tests");
+
+	rcu_register_thread();
+	relay_sessions_ht = lttng_ht_new(0, LTTNG_HT_TYPE_ULONG);
+	relay_streams_ht = lttng_ht_new(0, LTTNG_HT_TYPE_ULONG);
+	lttng_fd_cache_init(&stream_fd_cache, lttng_fd_cache_default_max());
+
+	ok(mkdtemp(trace_dir) != NULL, "Trace directory created");
+	index_fd = create_trace();
+	ok(index_fd >= 0, "Tracefile and index written");
+	add_session_stream();
+
+	ok(utils_create_pipe_cloexec(quit_pipe) == 0, "Quit pipe created");
+	port = start_live();
+	ok(port != 0, "Live thread listening");
+	sock = port ? connect_viewer(port) : NULL;
+	if (!sock || index_fd < 0) {
+		skip(NUM_TESTS - 4, "No viewer connection");
+		goto end;
+	}
+
+	test_viewer_session(sock);
+	test_viewer_packets(sock, index_fd);
+
+	(void) sock->ops->close(sock);
+	lttcomm_destroy_sock(sock);
+
+end:
+	if (port) {
+		(void) write(quit_pipe[1], "!", 1);
+		live_stop_threads();
+	}
+	utils_close_pipe(quit_pipe);
+	if (index_fd >= 0) {
+		close(index_fd);
+	}
+	snprintf(path, sizeof(path), "%s/" CTF_INDEX_DIR "/%s" CTF_INDEX_EXT,
+			trace_dir, CHANNEL_NAME);
+	(void) unlink(path);
+	snprintf(path, sizeof(path), "%s/" CTF_INDEX_DIR, trace_dir);
+	(void) rmdir(path);
+	snprintf(path, sizeof(path), "%s/%s", trace_dir, CHANNEL_NAME);
+	(void) unlink(path);
+	(void) rmdir(trace_dir);
+	rcu_unregister_thread();
+
+	return exit_status();
+}
@@ -0,0 +1,191 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <tap/tap.h>
+
+#include <common/common.h>
+#include <common/compress/compress-pool.h>
+#include <common/defaults.h>
+#include <bin/lttng-relayd/lttng-relayd.h>
+#include <bin/lttng-relayd/stream-throttle.h>
+
+/* For lttngerr.h */
+int lttng_opt_quiet = 1;
+int lttng_opt_verbose = 3;
+
+#define STREAM_HANDLE	7
+
+#define NUM_TESTS	11
+
+static struct lttng_compress_pool *pool;
+static struct relay_stream stream;
+static struct relay_command conn;
+/* Held by the test to keep the writer from completing the packets. */
+static pthread_mutex_t gate = PTHREAD_MUTEX_INITIALIZER;
+/* Written by the lane completion callback, like the relayd wakeup pipe. */
+static int wakeup_pipe[2] = { -1, -1 };
+
+/*
+ * Write job of the test, waiting on the gate before completing.
+ */
+static void job_done(struct lttng_compress_job *job)
+{
+	pthread_mutex_lock(&gate);
+	pthread_mutex_unlock(&gate);
+	free(job->src);
+	free(job);
+}
+
+/*
+ * Lane completion callback, called with the pool lock held.
+ */
+static void lane_completed(struct lttng_compress_lane *lane)
+{
+	int ret;
+
+	if (!stream_throttle_release(&stream, lane->pending)) {
+		return;
+	}
+	do {
+		ret = write(wakeup_pipe[1], "!", 1);
+	} while (ret < 0 && errno == EINTR);
+}
+
+/*
+ * Queue a packet on the lane of the stream.
+ *
+ * Return the stream_throttle_queued() value, or -1 on error.
+ */
+static int queue_packet(void)
+{
+	struct lttng_compress_job *job;
+
+	job = zmalloc(sizeof(*job));
+	if (!job) {
+		return -1;
+	}
+	job->src_len = 64;
+	job->src = zmalloc(job->src_len);
+	if (!job->src) {
+		free(job);
+		return -1;
+	}
+	job->lane = &stream.write_lane;
+	job->algo = LTTNG_COMPRESSION_NONE;
+	job->done = job_done;
+	lttng_compress_pool_submit(pool, job);
+
+	return stream_throttle_queued(pool, &stream);
+}
+
+static void test_fill_lane(void)
+{
+	int i, ret, throttled = 0;
+
+	pthread_mutex_lock(&gate);
+	for (i = 0; i < DEFAULT_RELAYD_STREAM_MAX_PACKETS - 1; i++) {
+		ret = queue_packet();
+		if (ret) {
+			throttled = 1;
+		}
+	}
+	ok(!throttled && !stream.throttled,
+			"Stream not throttled below the maximum queue");
+
+	ret = queue_packet();
+	ok(ret == 1 && stream.throttled, "Stream throttled with a full queue");
+
+	/* What the worker thread does with the data connection. */
+	conn.throttled = 1;
+	conn.throttled_stream = stream.stream_handle;
+	ok(!stream_throttle_resume(pool, &conn, &stream) && conn.throttled,
+			"Data connection stays throttled while the queue is full");
+}
+
+static void test_resume(void)
+{
+	int ret;
+	char c;
+
+	/* Let the writer drain the lane. */
+	pthread_mutex_unlock(&gate);
+
+	do {
+		ret = read(wakeup_pipe[0], &c, 1);
+	} while (ret < 0 && errno == EINTR);
+	ok(ret == 1, "Lane completion wakes up the worker thread");
+	ok(!stream.throttled, "Stream no more throttled");
+	ok(lttng_compress_lane_pending(pool, &stream.write_lane) <=
+			DEFAULT_RELAYD_STREAM_LOW_PACKETS,
+			"Queue is below the low watermark");
+
+	ok(stream_throttle_resume(pool, &conn, &stream) && !conn.throttled,
+			"Data connection resumes");
+	ok(!stream_throttle_resume(pool, &conn, &stream),
+			"Data connection not throttled is left alone");
+
+	lttng_compress_lane_wait(pool, &stream.write_lane);
+	ok(!stream_throttle(pool, &stream) && !stream.throttled,
+			"Stream with an empty queue is not throttled");
+	ok(!stream_throttle_release(&stream, 0),
+			"Completion of a stream not throttled wakes up nothing");
+
+	conn.throttled = 1;
+	ok(stream_throttle_resume(pool, &conn, NULL) && !conn.throttled,
+			"Data connection of a deleted stream resumes");
+}
+
+int main(int argc, char **argv)
+{
+	plan_tests(NUM_TESTS);
+
+	diag("Relayd stream throttling tests");
+
+	if (pipe(wakeup_pipe) < 0) {
+		diag("pipe: %s", strerror(errno));
+		goto error;
+	}
+	pool = lttng_compress_pool_create(1, 0);
+	if (!pool) {
+		diag("Unable to create the writer pool");
+		goto error_pipe;
+	}
+
+	stream.stream_handle = STREAM_HANDLE;
+	lttng_compress_lane_init(pool, &stream.write_lane, stream.stream_handle);
+	stream.write_lane.completed = lane_completed;
+
+	test_fill_lane();
+	test_resume();
+
+	lttng_compress_pool_destroy(pool);
+	close(wakeup_pipe[0]);
+	close(wakeup_pipe[1]);
+	return exit_status();
+
+error_pipe:
+	close(wakeup_pipe[0]);
+	close(wakeup_pipe[1]);
+error:
+	skip(NUM_TESTS, "Unable to set up the writer pool");
+	return exit_status();
+}
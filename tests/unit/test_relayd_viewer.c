@@ -0,0 +1,161 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <tap/tap.h>
+
+#include <common/compat/endian.h>
+#include <common/defaults.h>
+#include <bin/lttng-relayd/viewer-request.h>
+
+/* For lttngerr.h */
+int lttng_opt_quiet = 1;
+int lttng_opt_verbose = 3;
+
+struct request_test {
+	const char *name;
+	uint64_t offset;
+	uint32_t len;
+	uint64_t index_end;
+	int valid;
+};
+
+static struct request_test request_tests[] = {
+	{ "Whole indexed packet", 4096, 4096, 8192, 1 },
+	{ "Part of the indexed packets", 0, 100, 8192, 1 },
+	{ "Empty packet", 0, 0, 8192, 0 },
+	{ "Nothing indexed yet", 0, 4096, 0, 0 },
+	{ "Packet past the index", 4096, 4097, 8192, 0 },
+	{ "Offset past the index", 8193, 1, 8192, 0 },
+	{ "Largest length", 0, UINT32_MAX, UINT64_MAX, 0 },
+	{ "Above the maximum", 0, DEFAULT_RELAYD_VIEWER_PACKET_MAX + 1,
+		UINT64_MAX, 0 },
+	{ "At the maximum", 0, DEFAULT_RELAYD_VIEWER_PACKET_MAX, UINT64_MAX, 1 },
+	{ "Offset wrapping around", UINT64_MAX, 2, 8192, 0 },
+	{ "Length wrapping around", UINT64_MAX - 1, 4, UINT64_MAX, 0 },
+};
+static const int num_request_tests =
+	sizeof(request_tests) / sizeof(request_tests[0]);
+
+/* Number of TAP tests in test_frame_len. */
+#define NUM_FRAME_TESTS 8
+
+static void test_index_entry_end(void)
+{
+	struct ctf_packet_index entry;
+
+	memset(&entry, 0, sizeof(entry));
+	entry.offset = htobe64(4096);
+	entry.packet_size = htobe64(4096 * 8);
+	ok(viewer_index_entry_end(&entry) == 8192,
+			"Index entry end from its offset and size in bits");
+
+	entry.offset = htobe64(UINT64_MAX - 10);
+	entry.packet_size = htobe64(4096 * 8);
+	ok(viewer_index_entry_end(&entry) == 0,
+			"Index entry end overflowing is 0");
+}
+
+static void init_frame_hdr(struct lttng_compress_frame_hdr *hdr,
+		enum lttng_compression algo, uint32_t compressed_size,
+		uint32_t uncompressed_size)
+{
+	memset(hdr, 0, sizeof(*hdr));
+	hdr->magic = htobe32(LTTNG_COMPRESS_FRAME_MAGIC);
+	hdr->algo = algo;
+	hdr->compressed_size = htobe32(compressed_size);
+	hdr->uncompressed_size = htobe32(uncompressed_size);
+}
+
+static void test_frame_len(void)
+{
+	size_t bound;
+	enum lttng_compression algo;
+	struct lttng_compress_frame_hdr hdr;
+
+	init_frame_hdr(&hdr, LTTNG_COMPRESSION_NONE, 100, 4096);
+	ok(viewer_frame_len(&hdr, 0, 4096, 8192) == 0,
+			"Frame of an algorithm without frames rejected");
+
+	if (lttng_compress_frame_bound(LTTNG_COMPRESSION_LZ4, 4096)) {
+		algo = LTTNG_COMPRESSION_LZ4;
+	} else if (lttng_compress_frame_bound(LTTNG_COMPRESSION_ZSTD, 4096)) {
+		algo = LTTNG_COMPRESSION_ZSTD;
+	} else {
+		skip(NUM_FRAME_TESTS - 1, "No compression algorithm supported");
+		return;
+	}
+	bound = lttng_compress_frame_bound(algo, 4096);
+
+	init_frame_hdr(&hdr, algo, 100, 4096);
+	ok(viewer_frame_len(&hdr, 4096, 4096, 8192) == sizeof(hdr) + 100,
+			"Compressed frame accepted");
+
+	init_frame_hdr(&hdr, algo, bound - sizeof(hdr), 4096);
+	ok(viewer_frame_len(&hdr, 4096, 4096, 8192) == bound,
+			"Incompressible frame of the last packet accepted");
+
+	init_frame_hdr(&hdr, algo, bound - sizeof(hdr) + 1, 4096);
+	ok(viewer_frame_len(&hdr, 4096, 4096, 8192) == 0,
+			"Frame above the compression bound rejected");
+
+	init_frame_hdr(&hdr, algo, UINT32_MAX, 4096);
+	ok(viewer_frame_len(&hdr, 4096, 4096, 8192) == 0,
+			"Frame of the largest size rejected");
+
+	init_frame_hdr(&hdr, algo, 0, 4096);
+	ok(viewer_frame_len(&hdr, 4096, 4096, 8192) == 0,
+			"Empty frame rejected");
+
+	init_frame_hdr(&hdr, algo, 100, 8192);
+	ok(viewer_frame_len(&hdr, 4096, 4096, 8192) == 0,
+			"Frame of another packet size rejected");
+
+	init_frame_hdr(&hdr, algo, 100, 4096);
+	ok(viewer_frame_len(&hdr, 8192, 4096, 4096) == 0,
+			"Frame past the index rejected");
+}
+
+static void test_packet_request(void)
+{
+	int i;
+
+	for (i = 0; i < num_request_tests; i++) {
+		struct request_test *test = &request_tests[i];
+
+		ok(viewer_packet_request_valid(test->offset, test->len,
+					test->index_end) == test->valid,
+				"%s %s", test->name,
+				test->valid ? "accepted" : "rejected");
+	}
+}
+
+int main(int argc, char **argv)
+{
+	plan_tests(num_request_tests + 2 + NUM_FRAME_TESTS);
+
+	diag("Relayd live viewer request tests");
+
+	test_index_entry_end();
+	test_packet_request();
+	test_frame_len();
+
+	return exit_status();
+}
@@ -0,0 +1,119 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <tap/tap.h>
+
+#include <bin/lttng-sessiond/stats.h>
+
+/* For lttngerr.h */
+int lttng_opt_quiet = 1;
+int lttng_opt_verbose = 3;
+
+struct bucket_test_input {
+	uint64_t ns;
+	unsigned int bucket;
+};
+
+/* Bucket 0 is under 1 us, bucket N is [2^(N-1), 2^N[ us. */
+static struct bucket_test_input bucket_tests_inputs[] = {
+		{ 0, 0 },
+		{ 999, 0 },
+		{ 1000, 1 },
+		{ 1999, 1 },
+		{ 2000, 2 },
+		{ 3999, 2 },
+		{ 4000, 3 },
+		{ 1023999, 10 },
+		{ 1024000, 11 },
+		/* Last bucket, 2^22 us and above. */
+		{ 4194303999ULL, 22 },
+		{ 4194304000ULL, 23 },
+		{ UINT64_MAX, 23 },
+};
+static const int num_bucket_tests = sizeof(bucket_tests_inputs) / sizeof(bucket_tests_inputs[0]);
+
+static void test_bucket(void)
+{
+	int i;
+	unsigned int bucket;
+	char name[100];
+
+	for (i = 0; i < num_bucket_tests; i++) {
+		bucket = stats_latency_bucket(bucket_tests_inputs[i].ns);
+		sprintf(name, "%" PRIu64 " ns in bucket %u",
+				bucket_tests_inputs[i].ns,
+				bucket_tests_inputs[i].bucket);
+		ok(bucket == bucket_tests_inputs[i].bucket, name);
+	}
+}
+
+static void test_percentile(void)
+{
+	int i;
+	struct lttng_health_latency latency;
+
+	memset(&latency, 0, sizeof(latency));
+	ok(stats_latency_percentile(&latency, 99) == 0,
+			"Percentile of an empty histogram is 0");
+
+	/* 98 latencies of 500 ns, one of 3 us and one of 100 us. */
+	for (i = 0; i < 98; i++) {
+		stats_latency_add(&latency, 500);
+	}
+	stats_latency_add(&latency, 3000);
+	stats_latency_add(&latency, 100000);
+	ok(latency.count == 100 && latency.max_ns == 100000 &&
+			latency.buckets[0] == 98 && latency.buckets[2] == 1 &&
+			latency.buckets[7] == 1,
+			"Latencies counted in their buckets");
+
+	ok(stats_latency_percentile(&latency, 50) == 1000,
+			"50th percentile under the end of bucket 0");
+	ok(stats_latency_percentile(&latency, 98) == 1000,
+			"98th percentile under the end of bucket 0");
+	ok(stats_latency_percentile(&latency, 99) == 4000,
+			"99th percentile under the end of bucket 2");
+	ok(stats_latency_percentile(&latency, 100) == 100000,
+			"100th percentile capped by the maximum");
+	ok(stats_latency_percentile(&latency, 0) == 1000,
+			"0th percentile is the first latency");
+
+	stats_latency_add(&latency, 5000000000ULL);
+	ok(stats_latency_percentile(&latency, 100) == 5000000000ULL,
+			"Percentile in the last bucket is the maximum");
+
+	memset(&latency, 0, sizeof(latency));
+	stats_latency_add(&latency, 1500);
+	ok(stats_latency_percentile(&latency, 99) == 1500,
+			"Percentile of a single latency is the latency");
+}
+
+int main(int argc, char **argv)
+{
+	plan_tests(num_bucket_tests + 9);
+
+	diag("Session daemon statistics tests");
+
+	test_bucket();
+	test_percentile();
+
+	return exit_status();
+}
@@ -0,0 +1,154 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License, version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <tap/tap.h>
+
+#include <common/stream-sched.h>
+
+/* For lttngerr.h */
+int lttng_opt_quiet = 1;
+int lttng_opt_verbose = 3;
+
+struct weight_test_input {
+	char *weights;
+	char *channel;
+	unsigned int weight;
+};
+
+/* Weight test cases */
+static struct weight_test_input weight_tests_inputs[] = {
+		{ NULL, "chan", 1 },
+		{ "", "chan", 1 },
+		{ "chan=4", "chan", 4 },
+		{ "a=2,chan=7,b=3", "chan", 7 },
+		{ "a=2,b=3", "chan", 1 },
+		{ "ch=5", "chan", 1 },
+		{ "chan2=5", "chan", 1 },
+		{ "chan=1000", "chan", 1000 },
+		/* Invalid weights fall back to 1. */
+		{ "chan=0", "chan", 1 },
+		{ "chan=1001", "chan", 1 },
+		{ "chan=", "chan", 1 },
+		{ "chan=x", "chan", 1 },
+		{ "chan=3x", "chan", 1 },
+		{ "chan", "chan", 1 },
+};
+static const int num_weight_tests = sizeof(weight_tests_inputs) / sizeof(weight_tests_inputs[0]);
+
+static void test_sched_weight(void)
+{
+	int i;
+	unsigned int weight;
+	struct lttng_stream_sched_config config;
+	char name[100];
+
+	memset(&config, 0, sizeof(config));
+	for (i = 0; i < num_weight_tests; i++) {
+		config.weights = weight_tests_inputs[i].weights;
+		weight = lttng_stream_sched_weight(&config,
+				weight_tests_inputs[i].channel);
+		sprintf(name, "weight of \"%s\" in \"%s\" is %u",
+				weight_tests_inputs[i].channel,
+				weight_tests_inputs[i].weights ? : "(null)",
+				weight_tests_inputs[i].weight);
+		ok(weight == weight_tests_inputs[i].weight, name);
+	}
+}
+
+static void test_sched_set(void)
+{
+	struct lttng_stream_sched_config config;
+	struct lttng_stream_sched_entry entry;
+
+	memset(&config, 0, sizeof(config));
+	config.max_burst = 4;
+
+	lttng_stream_sched_set(&entry, &config, 3, 3 * 4096, 4096, 2);
+	ok(entry.index == 3 && entry.priority == 6 && entry.burst == 3,
+			"Backlog of 3 subbuffers with weight 2");
+
+	lttng_stream_sched_set(&entry, &config, 0, 100, 4096, 5);
+	ok(entry.priority == 5 && entry.burst == 1,
+			"Partial subbuffer counts as one");
+
+	lttng_stream_sched_set(&entry, &config, 0, 1 << 20, 0, 1);
+	ok(entry.priority == 1 && entry.burst == 1,
+			"Unknown subbuffer size counts as one subbuffer");
+
+	lttng_stream_sched_set(&entry, &config, 0, 64 * 4096, 4096, 1);
+	ok(entry.priority == 64 && entry.burst == 4,
+			"Burst is capped by the maximum burst");
+}
+
+static void test_sched_needs_backlog(void)
+{
+	struct lttng_stream_sched_config config;
+
+	memset(&config, 0, sizeof(config));
+	ok(!lttng_stream_sched_needs_backlog(&config, 8),
+			"Poll order never reads the backlogs");
+
+	config.backlog = 1;
+	ok(!lttng_stream_sched_needs_backlog(&config, 0) &&
+			!lttng_stream_sched_needs_backlog(&config, 1),
+			"Backlog order skips the backlogs of a single ready stream");
+	ok(lttng_stream_sched_needs_backlog(&config, 2),
+			"Backlog order reads the backlogs of several ready streams");
+}
+
+static void test_sched_sort(void)
+{
+	int i, sorted = 1;
+	struct lttng_stream_sched_entry entries[] = {
+		{ .index = 0, .priority = 1 },
+		{ .index = 1, .priority = 8 },
+		{ .index = 2, .priority = 3 },
+		{ .index = 3, .priority = 8 },
+		{ .index = 4, .priority = 1 },
+	};
+	static const int expected[] = { 1, 3, 2, 0, 4 };
+
+	lttng_stream_sched_sort(entries, 5);
+	for (i = 0; i < 5; i++) {
+		if (entries[i].index != expected[i]) {
+			sorted = 0;
+		}
+	}
+	ok(sorted, "Sorted by priority, then in poll order");
+
+	lttng_stream_sched_sort(NULL, 0);
+	pass("Sort of no entry");
+}
+
+int main(int argc, char **argv)
+{
+	plan_tests(num_weight_tests + 9);
+
+	diag("Stream scheduling tests");
+
+	test_sched_weight();
+	test_sched_set();
+	test_sched_needs_backlog();
+	test_sched_sort();
+
+	return exit_status();
+}
@@ -28,8 +28,10 @@
 #include <lttng/lttng.h>
 #include <bin/lttng-sessiond/lttng-ust-abi.h>
 #include <common/defaults.h>
+#include <common/compat/endian.h>
 #include <bin/lttng-sessiond/trace-ust.h>
 #include <bin/lttng-sessiond/ust-app.h>
+#include <bin/lttng-sessiond/ust-registry.h>
 
 #include <tap/tap.h>
 
@@ -39,7 +41,7 @@
 #define RANDOM_STRING_LEN	11
 
 /* Number of TAP tests in this file */
-#define NUM_TESTS 10
+#define NUM_TESTS 21
 
 /* For lttngerr.h */
 int lttng_opt_quiet = 1;
@@ -164,6 +166,41 @@ static void test_create_ust_event(void)
 	trace_ust_destroy_event(event);
 }
 
+static void test_create_ust_event_shared_filter(void)
+{
+	struct ltt_ust_event *event1, *event2;
+	struct lttng_event ev;
+	struct lttng_filter_bytecode *filter;
+	const char data[] = "filter bytecode";
+
+	filter = calloc(1, sizeof(*filter) + sizeof(data));
+	assert(filter);
+	filter->len = sizeof(data);
+	memcpy(filter->data, data, sizeof(data));
+
+	memset(&ev, 0, sizeof(ev));
+	strncpy(ev.name, get_random_string(), LTTNG_SYMBOL_NAME_LEN);
+	ev.type = LTTNG_EVENT_TRACEPOINT;
+	ev.loglevel_type = LTTNG_EVENT_LOGLEVEL_ALL;
+
+	event1 = trace_ust_create_event(&ev, filter);
+	strncpy(ev.name, get_random_string(), LTTNG_SYMBOL_NAME_LEN);
+	event2 = trace_ust_create_event(&ev, filter);
+	/* Events keep their own reference on a shared copy. */
+	free(filter);
+
+	ok(event1 != NULL && event2 != NULL && event1->filter != NULL,
+	   "Create UST events with filter");
+
+	ok(event1->filter == event2->filter &&
+	   event1->filter->len == sizeof(data) &&
+	   memcmp(event1->filter->data, data, sizeof(data)) == 0,
+	   "Validate UST event filter is shared");
+
+	trace_ust_destroy_event(event1);
+	trace_ust_destroy_event(event2);
+}
+
 static void test_create_ust_context(void)
 {
 	struct lttng_event_context ectx;
@@ -179,6 +216,107 @@ static void test_create_ust_context(void)
 	free(uctx);
 }
 
+static void test_ust_registry_session_abi(void)
+{
+	int ret;
+	struct ust_registry_session *reg = NULL;
+
+	ret = ust_registry_session_init(&reg, NULL, 64, 8, 16, 32, 64, 64,
+			LITTLE_ENDIAN, 2, 2);
+	ok(ret == 0 && reg != NULL, "Create UST per UID registry");
+	if (!reg) {
+		skip(2, "UST per UID registry creation failed");
+		return;
+	}
+
+	/* Buffers provisioned for other UIDs copy the ABI of the registry. */
+	ok(reg->bits_per_long == 64 && reg->uint8_t_alignment == 8 &&
+			reg->uint16_t_alignment == 16 && reg->uint32_t_alignment == 32 &&
+			reg->uint64_t_alignment == 64 && reg->long_alignment == 64 &&
+			reg->byte_order == LITTLE_ENDIAN,
+			"Registry keeps the application layout");
+	ok(reg->major == 2 && reg->minor == 2,
+			"Registry keeps the tracer version");
+
+	ust_registry_session_destroy(reg);
+	free(reg);
+}
+
+/*
+ * Allocate an integer event field of the given size, the bytes the tracer
+ * leaves uninitialized being set to garbage.
+ */
+static struct ustctl_field *alloc_int_field(const char *name, uint32_t size,
+		int garbage)
+{
+	struct ustctl_field *field;
+
+	field = malloc(sizeof(*field));
+	if (!field) {
+		return NULL;
+	}
+	memset(field, garbage, sizeof(*field));
+	strcpy(field->name, name);
+	field->type.atype = ustctl_atype_integer;
+	field->type.u.basic.integer.size = size;
+	field->type.u.basic.integer.signedness = 1;
+	field->type.u.basic.integer.reverse_byte_order = 0;
+	field->type.u.basic.integer.base = 10;
+	field->type.u.basic.integer.encoding = ustctl_encode_none;
+	field->type.u.basic.integer.alignment = 8;
+
+	return field;
+}
+
+/*
+ * Register an event with a single integer field in channel 1 of a registry.
+ */
+static int create_int_event(struct ust_registry_session *reg, char *name,
+		uint32_t size, int garbage, int loglevel, uint32_t *event_id)
+{
+	return ust_registry_create_event(reg, 1, 0, 0, name, strdup("sig"), 1,
+			alloc_int_field("field", size, garbage), loglevel, NULL,
+			LTTNG_BUFFER_PER_UID, event_id);
+}
+
+static void test_ust_registry_event_desc(void)
+{
+	int ret;
+	uint32_t id_zero, id_garbage, id_same, id_other;
+	char name[] = "tp:event", other_name[] = "tp:other";
+	struct ust_registry_session *reg = NULL;
+
+	ret = ust_registry_session_init(&reg, NULL, 64, 8, 16, 32, 64, 64,
+			LITTLE_ENDIAN, 2, 2);
+	if (ret || !reg || ust_registry_channel_add(reg, 1)) {
+		fail("Create UST registry channel");
+		skip(4, "UST registry channel creation failed");
+		goto end;
+	}
+	pass("Create UST registry channel");
+
+	ret = create_int_event(reg, name, 32, 0, 13, &id_zero);
+	ok(ret == 0, "Register UST event");
+
+	ret = create_int_event(reg, name, 32, 0xa5, 13, &id_garbage);
+	ok(ret == 0 && id_garbage == id_zero,
+			"Event differing by padding bytes only is the same");
+
+	/* The id of a channel event only depends on its name and signature. */
+	ret = create_int_event(reg, name, 64, 0, 14, &id_same);
+	ok(ret == 0 && id_same == id_zero,
+			"Event of another description but the same signature is the same");
+
+	ret = create_int_event(reg, other_name, 32, 0, 13, &id_other);
+	ok(ret == 0 && id_other != id_zero, "Event of another name is another one");
+
+end:
+	if (reg) {
+		ust_registry_session_destroy(reg);
+		free(reg);
+	}
+}
+
 int main(int argc, char **argv)
 {
 	plan_tests(NUM_TESTS);
@@ -189,7 +327,10 @@ int main(int argc, char **argv)
 	test_create_ust_metadata();
 	test_create_ust_channel();
 	test_create_ust_event();
+	test_create_ust_event_shared_filter();
 	test_create_ust_context();
+	test_ust_registry_session_abi();
+	test_ust_registry_event_desc();
 
 	return exit_status();
 }